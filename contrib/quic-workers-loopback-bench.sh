@@ -0,0 +1,126 @@
+#!/usr/bin/env bash
+#
+# Measure how the throughput of a DNS over QUIC frontend scales with the number
+# of worker threads (the 'workers' option of addDOQLocal), over the loopback
+# interface. dnsdist answers every query itself with a spoofed A record, so
+# that no backend is needed, and several client processes each open a few
+# connections and send queries over them as fast as the answers come back.
+#
+# Requirements: openssl, python3 with aioquic and dnspython, and a dnsdist
+# built with DNS over QUIC support (override with DNSDIST=...).
+#
+# Usage: ./quic-workers-loopback-bench.sh [max-workers] [client-processes] [seconds]
+
+set -euo pipefail
+
+DNSDIST=${DNSDIST:-dnsdist}
+MAX_WORKERS=${1:-4}
+CLIENTS=${2:-8}
+DURATION=${3:-10}
+CONNECTIONS_PER_CLIENT=4
+PORT=18853
+WORK_DIR=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+  for pid in "${PIDS[@]}"; do
+    kill "${pid}" 2>/dev/null || true
+  done
+  rm -rf "${WORK_DIR}"
+}
+trap cleanup EXIT
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=quic.bench.dnsdist.org" \
+  -keyout "${WORK_DIR}/server.key" -out "${WORK_DIR}/server.pem" > /dev/null 2>&1
+
+cat > "${WORK_DIR}/client.py" <<'EOF'
+import asyncio
+import ssl
+import struct
+import sys
+import time
+
+import dns.message
+from aioquic.asyncio.client import connect
+from aioquic.asyncio.protocol import QuicConnectionProtocol
+from aioquic.quic.configuration import QuicConfiguration
+from aioquic.quic.events import StreamDataReceived
+
+class DnsClientProtocol(QuicConnectionProtocol):
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self._waiters = {}
+        self._buffers = {}
+
+    async def query(self, wire):
+        stream_id = self._quic.get_next_available_stream_id()
+        waiter = self._loop.create_future()
+        self._waiters[stream_id] = waiter
+        self._buffers[stream_id] = b''
+        self._quic.send_stream_data(stream_id, struct.pack('!H', len(wire)) + wire, end_stream=True)
+        self.transmit()
+        return await waiter
+
+    def quic_event_received(self, event):
+        if isinstance(event, StreamDataReceived) and event.stream_id in self._waiters:
+            self._buffers[event.stream_id] += event.data
+            if event.end_stream:
+                self._waiters.pop(event.stream_id).set_result(self._buffers.pop(event.stream_id))
+
+async def run_connection(port, deadline, counter):
+    configuration = QuicConfiguration(alpn_protocols=['doq'], is_client=True)
+    configuration.verify_mode = ssl.CERT_NONE
+    wire = dns.message.make_query('bench.quic.powerdns.com.', 'A').to_wire()
+    async with connect('127.0.0.1', port, configuration=configuration, create_protocol=DnsClientProtocol) as client:
+        while time.monotonic() < deadline:
+            await asyncio.wait_for(client.query(wire), 2)
+            counter[0] += 1
+
+async def main(port, connections, duration):
+    counter = [0]
+    deadline = time.monotonic() + duration
+    await asyncio.gather(*[run_connection(port, deadline, counter) for _ in range(connections)], return_exceptions=True)
+    print(counter[0])
+
+asyncio.run(main(int(sys.argv[1]), int(sys.argv[2]), float(sys.argv[3])))
+EOF
+
+workers=1
+while [ "${workers}" -le "${MAX_WORKERS}" ]; do
+  cat > "${WORK_DIR}/dnsdist.conf" <<EOF
+setACL({"127.0.0.0/8"})
+addAction(AllRule(), SpoofAction("192.0.2.53", {ttl=3600}))
+addDOQLocal("127.0.0.1:${PORT}", "${WORK_DIR}/server.pem", "${WORK_DIR}/server.key", {workers=${workers}})
+EOF
+
+  "${DNSDIST}" --supervised --disable-syslog -C "${WORK_DIR}/dnsdist.conf" > "${WORK_DIR}/dnsdist.log" 2>&1 &
+  dnsdist_pid=$!
+  PIDS+=("${dnsdist_pid}")
+  sleep 2
+
+  client_pids=()
+  for idx in $(seq 1 "${CLIENTS}"); do
+    python3 "${WORK_DIR}/client.py" "${PORT}" "${CONNECTIONS_PER_CLIENT}" "${DURATION}" > "${WORK_DIR}/client-${idx}.out" 2>&1 &
+    client_pids+=($!)
+  done
+  for pid in "${client_pids[@]}"; do
+    wait "${pid}" || true
+  done
+
+  total=0
+  for idx in $(seq 1 "${CLIENTS}"); do
+    answers=$(tail -n 1 "${WORK_DIR}/client-${idx}.out")
+    if ! [[ "${answers}" =~ ^[0-9]+$ ]]; then
+      echo "Client ${idx} failed:" >&2
+      cat "${WORK_DIR}/client-${idx}.out" >&2
+      cat "${WORK_DIR}/dnsdist.log" >&2
+      exit 1
+    fi
+    total=$((total + answers))
+  done
+  echo "workers: ${workers}, answers: ${total}, qps: $((total / DURATION))"
+
+  kill "${dnsdist_pid}" 2>/dev/null || true
+  wait "${dnsdist_pid}" 2>/dev/null || true
+  workers=$((workers * 2))
+done
@@ -0,0 +1,131 @@
+#!/usr/bin/env bash
+#
+# Check the in-kernel rate-limiting of the XDP filter, configured by dnsdist
+# from a dynamic block rules group, without a real network card: a veth pair
+# connects the host, where the XDP program is attached and dnsdist listens, to
+# a network namespace acting as the client.
+#
+#   client netns (xdpclient)              host
+#   xdpveth1 198.51.100.2/24  <------->   xdpveth0 198.51.100.1/24 (XDP)
+#
+# dnsdist answers every query itself with a spoofed A record, so that no
+# backend is needed. The client sends a burst of queries much larger than the
+# allowed rate and the script checks that most of them have been dropped in
+# the kernel, and that dnsdist reports them via its Prometheus endpoint.
+#
+# Requirements: root, iproute2, curl, python3 with bcc, netaddr and dnspython,
+# and a dnsdist built with eBPF support (override with DNSDIST=...).
+#
+# Usage: sudo ./xdp-ratelimit-veth-test.sh [number-of-queries]
+
+set -euo pipefail
+
+DNSDIST=${DNSDIST:-dnsdist}
+QUERIES=${1:-2000}
+RATE=50
+NETNS=xdpclient
+HOST_IF=xdpveth0
+CLIENT_IF=xdpveth1
+HOST_ADDR=198.51.100.1
+CLIENT_ADDR=198.51.100.2
+API_KEY=xdpharness
+PIN_DIR=/sys/fs/bpf/dnsdist
+CONTRIB_DIR=$(cd "$(dirname "$0")" && pwd)
+WORK_DIR=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+  for pid in "${PIDS[@]}"; do
+    kill "${pid}" 2>/dev/null || true
+  done
+  ip link set dev "${HOST_IF}" xdp off 2>/dev/null || true
+  # removing the namespace also removes the veth pair
+  ip netns del "${NETNS}" 2>/dev/null || true
+  rm -f "${PIN_DIR}/ratelimit-config" "${PIN_DIR}/ratelimit-stats"
+  rm -rf "${WORK_DIR}"
+}
+trap cleanup EXIT
+
+if [ "$(id -u)" -ne 0 ]; then
+  echo "This script needs to be run as root" >&2
+  exit 1
+fi
+
+ip netns add "${NETNS}"
+ip link add "${HOST_IF}" type veth peer name "${CLIENT_IF}"
+ip link set "${CLIENT_IF}" netns "${NETNS}"
+ip addr add "${HOST_ADDR}/24" dev "${HOST_IF}"
+ip link set "${HOST_IF}" up
+ip -n "${NETNS}" addr add "${CLIENT_ADDR}/24" dev "${CLIENT_IF}"
+ip -n "${NETNS}" link set "${CLIENT_IF}" up
+ip -n "${NETNS}" link set lo up
+
+(cd "${CONTRIB_DIR}" && exec python3 xdp.py --interface "${HOST_IF}") > "${WORK_DIR}/xdp.log" 2>&1 &
+PIDS+=($!)
+for _ in $(seq 1 30); do
+  if [ -e "${PIN_DIR}/ratelimit-config" ]; then
+    break
+  fi
+  sleep 1
+done
+
+cat > "${WORK_DIR}/dnsdist.conf" <<EOF
+setLocal("${HOST_ADDR}:53")
+setACL({"${CLIENT_ADDR}/32"})
+addAction(AllRule(), SpoofAction("192.0.2.53", {ttl=3600}))
+bpf = newBPFFilter({external=true,
+                    ipv4MaxItems=1024, ipv4PinnedPath="${PIN_DIR}/addr-v4",
+                    ipv6MaxItems=1024, ipv6PinnedPath="${PIN_DIR}/addr-v6",
+                    cidr4MaxItems=1024, cidr4PinnedPath="${PIN_DIR}/cidr4",
+                    cidr6MaxItems=1024, cidr6PinnedPath="${PIN_DIR}/cidr6",
+                    qnamesMaxItems=1024, qnamesPinnedPath="${PIN_DIR}/qnames",
+                    ratelimitConfigPinnedPath="${PIN_DIR}/ratelimit-config",
+                    ratelimitStatsPinnedPath="${PIN_DIR}/ratelimit-stats"})
+setDefaultBPFFilter(bpf)
+local dbr = dynBlockRulesGroup()
+dbr:setQueryRate(${RATE}, 1, "Exceeded query rate", 60, DNSAction.Drop)
+dbr:setMasks(24, 64, 0)
+dbr:setBPFRateLimits(bpf, {suffixRate=${RATE}, suffixLabels=2})
+function maintenance()
+  dbr:apply()
+end
+webserver("127.0.0.1:18084")
+setWebserverConfig({apiKey="${API_KEY}", acl="127.0.0.0/8"})
+EOF
+
+"${DNSDIST}" --supervised --disable-syslog -C "${WORK_DIR}/dnsdist.conf" > "${WORK_DIR}/dnsdist.log" 2>&1 &
+PIDS+=($!)
+sleep 2
+
+cat > "${WORK_DIR}/client.py" <<EOF
+import socket
+import dns.message
+
+query = dns.message.make_query('ratelimit.powerdns.com.', 'A').to_wire()
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.connect(('${HOST_ADDR}', 53))
+for _ in range(${QUERIES}):
+    sock.send(query)
+sock.settimeout(1)
+answers = 0
+try:
+    while True:
+        sock.recv(512)
+        answers += 1
+except socket.timeout:
+    pass
+print(answers)
+EOF
+
+answers=$(ip netns exec "${NETNS}" python3 "${WORK_DIR}/client.py")
+metrics=$(curl -s -H "X-API-Key: ${API_KEY}" "http://127.0.0.1:18084/metrics" | grep '^dnsdist_ebpf_ratelimit' || true)
+echo "Queries: ${QUERIES}, answers: ${answers}"
+echo "${metrics}"
+
+limited=$(echo "${metrics}" | awk '/^dnsdist_ebpf_ratelimit_limited\{stage="sources"\}/ { print $2 }')
+# each CPU allows the burst (rate * 1s), so be generous
+if [ "${answers}" -ge $((QUERIES / 2)) ] || [ -z "${limited}" ] || [ "${limited}" -eq 0 ]; then
+  echo "The queries have not been rate-limited in the kernel" >&2
+  cat "${WORK_DIR}/dnsdist.log" >&2
+  exit 1
+fi
@@ -129,6 +129,48 @@ struct map_value
   enum dns_action action;
 };
 
+/*
+ * Configuration of a rate-limiting stage, set by dnsdist
+ * (entry 0: per source netmask, entry 1: per qname suffix)
+ */
+struct ratelimit_config
+{
+  uint64_t rate;   // queries per second, 0 disables the stage
+  uint64_t burst;  // size of the bucket, in queries
+  uint32_t v4mask; // prefix length applied to IPv4 sources
+  uint32_t v6mask; // prefix length applied to IPv6 sources
+  uint32_t labels; // number of labels of the qname making the suffix
+  uint32_t action; // enum dns_action
+};
+
+/*
+ * Per-CPU token bucket, tokens are stored in billionths of a query
+ * so that they can be refilled from the elapsed time in nanoseconds
+ */
+struct ratelimit_bucket
+{
+  uint64_t tokens;
+  uint64_t last;
+};
+
+/*
+ * Masked source address, the key of the per-source buckets
+ */
+struct ratelimit_source
+{
+  uint32_t family;
+  uint32_t addr[4];
+};
+
+/*
+ * Per-CPU counters of a rate-limiting stage, read by dnsdist
+ */
+struct ratelimit_counters
+{
+  uint64_t passed;
+  uint64_t limited;
+};
+
 
 /*
  * Initializer of a cursor pointer
@@ -51,6 +51,7 @@ v6filter = xdp.get_table("v6filter")
 cidr4filter = xdp.get_table("cidr4filter")
 cidr6filter = xdp.get_table("cidr6filter")
 qnamefilter = xdp.get_table("qnamefilter")
+ratelimitstats = xdp.get_table("ratelimitstats")
 
 if parameters.xsk:
   xskDestinations = xdp.get_table("xskDestinationsV4")
@@ -131,5 +132,8 @@ for item in cidr6filter.items():
   print(f"{str(socket.inet_ntop(socket.AF_INET6, item[0].addr))}/{str(item[0].cidr)} ({ACTIONS[item[1].action]}): {item[1].counter}")
 for item in qnamefilter.items():
   print(f"{''.join(map(chr, item[0].qname)).strip()}/{INV_QTYPES[item[0].qtype]} ({ACTIONS[item[1].action]}): {item[1].counter}")
+for stage, name in ((0, 'sources'), (1, 'suffixes')):
+  values = ratelimitstats[ratelimitstats.Key(stage)]
+  print(f"rate-limited {name}: {sum(value.limited for value in values)} (passed {sum(value.passed for value in values)})")
 
 xdp.remove_xdp(parameters.interface, 0)
@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+#
+# Exercise dnsdist's AF_XDP (XSK) support, including the cache fast path,
+# without a real network card: a veth pair connects the host, where dnsdist
+# listens via XSK, to a network namespace acting as the client.
+#
+#   client netns (xskclient)              host
+#   xskveth1 198.51.100.2/24  <------->   xskveth0 198.51.100.1/24 (XDP + XSK)
+#
+# A second dnsdist instance, answering every query with a spoofed A record on
+# 127.0.0.1:10053, acts as the backend so that no resolver is needed.
+#
+# Requirements: root, iproute2, dig, curl, python3 with bcc and netaddr (for
+# xdp.py), and a dnsdist built with --with-xsk (override with DNSDIST=...).
+#
+# Usage: sudo ./xsk-veth-harness.sh [number-of-queries]
+
+set -euo pipefail
+
+DNSDIST=${DNSDIST:-dnsdist}
+QUERIES=${1:-1000}
+NETNS=xskclient
+HOST_IF=xskveth0
+CLIENT_IF=xskveth1
+HOST_ADDR=198.51.100.1
+CLIENT_ADDR=198.51.100.2
+API_KEY=xskharness
+CONTRIB_DIR=$(cd "$(dirname "$0")" && pwd)
+WORK_DIR=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+  for pid in "${PIDS[@]}"; do
+    kill "${pid}" 2>/dev/null || true
+  done
+  ip link set dev "${HOST_IF}" xdp off 2>/dev/null || true
+  # removing the namespace also removes the veth pair
+  ip netns del "${NETNS}" 2>/dev/null || true
+  rm -rf "${WORK_DIR}"
+}
+trap cleanup EXIT
+
+if [ "$(id -u)" -ne 0 ]; then
+  echo "This script needs to be run as root" >&2
+  exit 1
+fi
+
+ip netns add "${NETNS}"
+ip link add "${HOST_IF}" type veth peer name "${CLIENT_IF}"
+ip link set "${CLIENT_IF}" netns "${NETNS}"
+ip addr add "${HOST_ADDR}/24" dev "${HOST_IF}"
+ip link set "${HOST_IF}" up
+ip -n "${NETNS}" addr add "${CLIENT_ADDR}/24" dev "${CLIENT_IF}"
+ip -n "${NETNS}" link set "${CLIENT_IF}" up
+ip -n "${NETNS}" link set lo up
+# XSK only uses the first queue of the veth
+ethtool -L "${HOST_IF}" combined 1 2>/dev/null || true
+
+(cd "${CONTRIB_DIR}" && exec python3 xdp.py --xsk --interface "${HOST_IF}") > "${WORK_DIR}/xdp.log" 2>&1 &
+PIDS+=($!)
+for _ in $(seq 1 30); do
+  if [ -e /sys/fs/bpf/dnsdist/xskmap ]; then
+    break
+  fi
+  sleep 1
+done
+
+cat > "${WORK_DIR}/backend.conf" <<EOF
+setLocal("127.0.0.1:10053")
+addAction(AllRule(), SpoofAction("192.0.2.53", {ttl=3600}))
+EOF
+
+cat > "${WORK_DIR}/dnsdist.conf" <<EOF
+setLocal("127.0.0.1:10054")
+setACL({"127.0.0.0/8", "${CLIENT_ADDR}/32"})
+newServer({address="127.0.0.1:10053", healthCheckMode="up"})
+pc = newPacketCache(10000, {lockFree=true})
+getPool(""):setCache(pc)
+xsk = newXsk({ifName="${HOST_IF}", NIC_queue_id=0, frameNums=4096, xskMapPath="/sys/fs/bpf/dnsdist/xskmap"})
+addLocal("${HOST_ADDR}:53", {xskSocket=xsk, xskCacheFastPath=true})
+webserver("127.0.0.1:18083")
+setWebserverConfig({apiKey="${API_KEY}", acl="127.0.0.0/8"})
+EOF
+
+"${DNSDIST}" --supervised --disable-syslog -C "${WORK_DIR}/backend.conf" > "${WORK_DIR}/backend.log" 2>&1 &
+PIDS+=($!)
+"${DNSDIST}" --supervised --disable-syslog -C "${WORK_DIR}/dnsdist.conf" > "${WORK_DIR}/dnsdist.log" 2>&1 &
+PIDS+=($!)
+sleep 2
+
+# the first query is a cache miss, forwarded to the backend
+answer=$(ip netns exec "${NETNS}" dig +short +tries=1 +time=2 @"${HOST_ADDR}" xsk.powerdns.com. A || true)
+if [ "${answer}" != "192.0.2.53" ]; then
+  echo "Unexpected answer to the first query: '${answer}'" >&2
+  cat "${WORK_DIR}/dnsdist.log" >&2
+  exit 1
+fi
+
+failures=0
+for _ in $(seq 1 "${QUERIES}"); do
+  answer=$(ip netns exec "${NETNS}" dig +short +tries=1 +time=1 @"${HOST_ADDR}" xsk.POWERDNS.com. A || true)
+  if [ "${answer}" != "192.0.2.53" ]; then
+    failures=$((failures + 1))
+  fi
+done
+
+stats=$(curl -s -H "X-API-Key: ${API_KEY}" "http://127.0.0.1:18083/jsonstat?command=stats")
+echo "Queries: ${QUERIES}, failures: ${failures}"
+echo "${stats}" | python3 -c 'import json, sys; stats = json.load(sys.stdin); print("queries: %d, cache-hits: %d, cache-misses: %d, responses: %d" % (stats["queries"], stats["cache-hits"], stats["cache-misses"], stats["responses"]))'
+
+if [ "${failures}" -ne 0 ]; then
+  exit 1
+fi
@@ -25,6 +25,7 @@
 
 #ifdef HAVE_EBPF
 
+#include <fstream>
 #include <sys/syscall.h>
 #include <sys/resource.h>
 #include <linux/bpf.h>
@@ -195,6 +196,57 @@ struct QNameValue
   uint16_t qtype{0};
 };
 
+/* these two have to match the layout of the ratelimit_config and ratelimit_counters
+   structures used by the external XDP program (contrib/xdp.h) */
+struct RateLimitConfigValue
+{
+  uint64_t rate;
+  uint64_t burst;
+  uint32_t v4Mask;
+  uint32_t v6Mask;
+  uint32_t labels;
+  uint32_t action;
+};
+
+struct RateLimitCountersValue
+{
+  uint64_t passed;
+  uint64_t limited;
+};
+
+/* the kernel rounds the size of each per-CPU value up to 8 bytes */
+static_assert(sizeof(RateLimitCountersValue) % 8 == 0, "The size of a per-CPU value should be a multiple of 8");
+
+/* one entry per BPFFilter::RateLimitStage */
+static constexpr uint32_t s_rateLimitStages{2};
+
+/* Per-CPU maps return one value per possible CPU, which is not the same
+   as the number of online CPUs. The format of that file is "0-7" or "0,2-3". */
+static size_t getPossibleCPUsCount()
+{
+  static const size_t count = []() {
+    std::ifstream ifs("/sys/devices/system/cpu/possible");
+    std::string line;
+    if (!std::getline(ifs, line)) {
+      throw std::runtime_error("Unable to read the number of possible CPUs");
+    }
+    std::vector<std::string> ranges;
+    stringtok(ranges, line, ",");
+    size_t result = 0;
+    for (const auto& range : ranges) {
+      auto pos = range.find('-');
+      if (pos == std::string::npos) {
+        ++result;
+      }
+      else {
+        result += std::stoul(range.substr(pos + 1)) - std::stoul(range.substr(0, pos)) + 1;
+      }
+    }
+    return result;
+  }();
+  return count;
+}
+
 
 BPFFilter::Map::Map(const BPFFilter::MapConfiguration& config, BPFFilter::MapFormat format): d_config(config)
 {
@@ -254,6 +306,16 @@ BPFFilter::Map::Map(const BPFFilter::MapConfiguration& config, BPFFilter::MapFor
         keySize = sizeof(QNameAndQTypeKey);
         valueSize = sizeof(CounterAndActionValue);
         break;
+      case MapType::RateLimitConfig:
+        keySize = sizeof(uint32_t);
+        valueSize = sizeof(RateLimitConfigValue);
+        type = BPF_MAP_TYPE_ARRAY;
+        break;
+      case MapType::RateLimitStats:
+        keySize = sizeof(uint32_t);
+        valueSize = sizeof(RateLimitCountersValue);
+        type = BPF_MAP_TYPE_PERCPU_ARRAY;
+        break;
       default:
         throw std::runtime_error("Unsupported eBPF map type: " + std::to_string(static_cast<uint8_t>(d_config.d_type)));
       }
@@ -314,6 +376,10 @@ BPFFilter::Map::Map(const BPFFilter::MapConfiguration& config, BPFFilter::MapFor
           }
           break;
         }
+        case MapType::RateLimitConfig:
+        case MapType::RateLimitStats:
+          /* arrays, all the entries always exist */
+          break;
 
         default:
           throw std::runtime_error("Unsupported eBPF map type: " + std::to_string(static_cast<uint8_t>(d_config.d_type)));
@@ -386,6 +452,18 @@ BPFFilter::BPFFilter(std::unordered_map<std::string, MapConfiguration>& configs,
   if (d_mapFormat != BPFFilter::MapFormat::Legacy) {
     maps->d_cidr4 = BPFFilter::Map(configs["cidr4"], d_mapFormat);
     maps->d_cidr6 = BPFFilter::Map(configs["cidr6"], d_mapFormat);
+
+    /* the rate-limiting maps are only used by an external program, so there is no point in creating them unless they are pinned */
+    if (auto& config = configs["ratelimitConfig"]; !config.d_pinnedPath.empty()) {
+      config.d_type = BPFFilter::MapType::RateLimitConfig;
+      config.d_maxItems = s_rateLimitStages;
+      maps->d_rateLimitConfig = BPFFilter::Map(config, d_mapFormat);
+    }
+    if (auto& config = configs["ratelimitStats"]; !config.d_pinnedPath.empty()) {
+      config.d_type = BPFFilter::MapType::RateLimitStats;
+      config.d_maxItems = s_rateLimitStages;
+      maps->d_rateLimitStats = BPFFilter::Map(config, d_mapFormat);
+    }
   }
 
   if (!external) {
@@ -896,6 +974,70 @@ uint64_t BPFFilter::getHits(const ComboAddress& requestor)
   return 0;
 }
 
+void BPFFilter::setRateLimit(RateLimitStage stage, const RateLimitSettings& settings)
+{
+  if (!d_external) {
+    throw std::runtime_error("In-kernel rate-limiting is only supported with an external eBPF program");
+  }
+  if (settings.d_rate > 0 && settings.d_burst == 0) {
+    throw std::runtime_error("The burst of an eBPF rate-limiting stage should be larger than 0");
+  }
+  if (settings.d_v4Mask > 32 || settings.d_v6Mask > 128) {
+    throw std::runtime_error("Invalid masks for eBPF rate-limiting: " + std::to_string(settings.d_v4Mask) + ", " + std::to_string(settings.d_v6Mask));
+  }
+  if (stage == RateLimitStage::Suffixes && settings.d_rate > 0 && settings.d_suffixLabels == 0) {
+    throw std::runtime_error("The number of labels of the eBPF rate-limiting suffixes should be larger than 0");
+  }
+
+  RateLimitConfigValue value{};
+  value.rate = settings.d_rate;
+  value.burst = settings.d_burst;
+  value.v4Mask = settings.d_v4Mask;
+  value.v6Mask = settings.d_v6Mask;
+  value.labels = settings.d_suffixLabels;
+  value.action = static_cast<uint32_t>(settings.d_action);
+  auto key = static_cast<uint32_t>(stage);
+
+  auto maps = d_maps.lock();
+  auto& map = maps->d_rateLimitConfig;
+  if (map.d_fd.getHandle() == -1) {
+    throw std::runtime_error("In-kernel rate-limiting requires the rate-limiting configuration map to be pinned (ratelimitConfigPinnedPath)");
+  }
+  if (bpf_update_elem(map.d_fd.getHandle(), &key, &value, BPF_ANY) != 0) {
+    throw std::runtime_error("Error updating the eBPF rate-limiting configuration: " + stringerror());
+  }
+}
+
+BPFFilter::RateLimitCounters BPFFilter::getRateLimitCounters(RateLimitStage stage)
+{
+  RateLimitCounters result;
+  std::vector<RateLimitCountersValue> values(getPossibleCPUsCount());
+  auto key = static_cast<uint32_t>(stage);
+
+  auto maps = d_maps.lock();
+  auto& map = maps->d_rateLimitStats;
+  if (map.d_fd.getHandle() == -1) {
+    return result;
+  }
+  if (bpf_lookup_elem(map.d_fd.getHandle(), &key, values.data()) != 0) {
+    return result;
+  }
+  for (const auto& value : values) {
+    result.d_passed += value.passed;
+    result.d_limited += value.limited;
+  }
+  return result;
+}
+
+bool BPFFilter::supportsRateLimiting()
+{
+  if (!d_external) {
+    return false;
+  }
+  auto maps = d_maps.lock();
+  return maps->d_rateLimitConfig.d_fd.getHandle() != -1;
+}
+
 #else
 
 BPFFilter::BPFFilter(std::unordered_map<std::string, MapConfiguration>& configs, BPFFilter::MapFormat format, bool external)
@@ -961,6 +1103,21 @@ uint64_t BPFFilter::getHits(const ComboAddress&)
 {
   return 0;
 }
+
+void BPFFilter::setRateLimit(RateLimitStage, const RateLimitSettings&)
+{
+  throw std::runtime_error("eBPF support not enabled");
+}
+
+BPFFilter::RateLimitCounters BPFFilter::getRateLimitCounters(RateLimitStage)
+{
+  return RateLimitCounters();
+}
+
+bool BPFFilter::supportsRateLimiting()
+{
+  return false;
+}
 #endif /* HAVE_EBPF */
 
 bool BPFFilter::supportsMatchAction(MatchAction action) const
@@ -38,7 +38,9 @@ public:
     QNames,
     Filters,
     CIDR4,
-    CIDR6
+    CIDR6,
+    RateLimitConfig,
+    RateLimitStats
   };
 
   enum class MapFormat : uint8_t {
@@ -76,7 +78,39 @@ public:
     uint64_t counter{0};
     BPFFilter::MatchAction action{BPFFilter::MatchAction::Pass};
   };
-  
+
+  /* The external XDP program can rate-limit queries in-kernel, using per-CPU token buckets,
+     before they reach dnsdist. There is one stage per source netmask and one per qname suffix. */
+  enum class RateLimitStage : uint8_t {
+    Sources = 0,
+    Suffixes = 1
+  };
+
+  struct RateLimitSettings
+  {
+    /* queries per second refilled into each bucket, 0 disables the stage */
+    uint64_t d_rate{0};
+    /* size of each bucket, in queries */
+    uint64_t d_burst{0};
+    uint8_t d_v4Mask{32};
+    uint8_t d_v6Mask{128};
+    /* number of labels of the qname making the suffix */
+    uint8_t d_suffixLabels{0};
+    MatchAction d_action{MatchAction::Drop};
+
+    bool operator==(const RateLimitSettings& rhs) const
+    {
+      return d_rate == rhs.d_rate && d_burst == rhs.d_burst && d_v4Mask == rhs.d_v4Mask && d_v6Mask == rhs.d_v6Mask && d_suffixLabels == rhs.d_suffixLabels && d_action == rhs.d_action;
+    }
+  };
+
+  /* summed over all CPUs */
+  struct RateLimitCounters
+  {
+    uint64_t d_passed{0};
+    uint64_t d_limited{0};
+  };
+
 
   BPFFilter(std::unordered_map<std::string, MapConfiguration>& configs, BPFFilter::MapFormat format, bool external);
   BPFFilter(const BPFFilter&) = delete;
@@ -99,6 +133,10 @@ public:
 
   uint64_t getHits(const ComboAddress& requestor);
 
+  void setRateLimit(RateLimitStage stage, const RateLimitSettings& settings);
+  RateLimitCounters getRateLimitCounters(RateLimitStage stage);
+  bool supportsRateLimiting();
+
   bool supportsMatchAction(MatchAction action) const;
   bool isExternal() const;
 
@@ -122,6 +160,9 @@ private:
     Map d_cidr4;
     Map d_cidr6;
     Map d_qnames;
+    /* only present when a pinned path has been set, since they are only used by an external program */
+    Map d_rateLimitConfig;
+    Map d_rateLimitStats;
     /* The qname filter program held in d_qnamefilter is
        stored in an eBPF map, so we can call it from the
        main filter. This is the only entry in that map. */
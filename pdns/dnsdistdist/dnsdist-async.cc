@@ -146,6 +146,14 @@ void AsynchronousHolder::mainThread(std::shared_ptr<Data> data)
         resumeQuery(std::move(query));
       }
     }
+
+    std::vector<std::unique_ptr<CrossProtocolQuery>> toResume;
+    toResume.swap(*data->d_toResume.lock());
+    for (auto& query : toResume) {
+      if (!resumeQuery(std::move(query))) {
+        vinfolog("Unable to resume a query handed to the asynchronous thread");
+      }
+    }
   }
 }
 
@@ -174,6 +182,23 @@ void AsynchronousHolder::push(uint16_t asyncID, uint16_t queryID, const struct t
   }
 }
 
+void AsynchronousHolder::resume(std::vector<std::unique_ptr<CrossProtocolQuery>>&& queries)
+{
+  if (queries.empty()) {
+    return;
+  }
+
+  {
+    auto toResume = d_data->d_toResume.lock();
+    for (auto& query : queries) {
+      toResume->push_back(std::move(query));
+    }
+  }
+  queries.clear();
+
+  notify();
+}
+
 std::unique_ptr<CrossProtocolQuery> AsynchronousHolder::get(uint16_t asyncID, uint16_t queryID)
 {
   /* no need to notify, worst case the thread wakes up for nothing because this was the next TTD */
@@ -285,6 +310,8 @@ bool resumeQuery(std::unique_ptr<CrossProtocolQuery>&& query)
 
   DNSQuestion dnsQuestion = query->getDQ();
   LocalHolders holders;
+  /* a resumed query cannot be suspended again, so it should not wait for an identical one either */
+  dnsQuestion.ids.skipCollapsing = true;
 
   auto result = processQueryAfterRules(dnsQuestion, holders, query->downstream);
   if (result == ProcessQueryResult::Drop) {
@@ -39,6 +39,8 @@ public:
   ~AsynchronousHolder();
   void push(uint16_t asyncID, uint16_t queryID, const struct timeval& ttd, std::unique_ptr<CrossProtocolQuery>&& query);
   std::unique_ptr<CrossProtocolQuery> get(uint16_t asyncID, uint16_t queryID);
+  /* resume these queries from the asynchronous thread, as soon as possible */
+  void resume(std::vector<std::unique_ptr<CrossProtocolQuery>>&& queries);
   bool empty();
   void stop();
 
@@ -84,6 +86,7 @@ private:
     ~Data() = default;
 
     LockGuarded<content_t> d_content;
+    LockGuarded<std::vector<std::unique_ptr<CrossProtocolQuery>>> d_toResume;
     pdns::channel::Notifier d_notifier;
     pdns::channel::Waiter d_waiter;
     bool d_failOpen{true};
@@ -24,6 +24,7 @@
 #include "dnsdist-backoff.hh"
 #include "dnsdist-metrics.hh"
 #include "dnsdist-nghttp2.hh"
+#include "dnsdist-query-collapsing.hh"
 #include "dnsdist-random.hh"
 #include "dnsdist-rings.hh"
 #include "dnsdist-tcp.hh"
@@ -233,6 +234,8 @@ void DownstreamState::stop()
   }
 }
 
+std::atomic<uint64_t> DownstreamState::s_hashesGeneration{0};
+
 void DownstreamState::hash()
 {
   vinfolog("Computing hashes for id=%s and weight=%d", *d_config.id, d_config.d_weight);
@@ -249,6 +252,7 @@ void DownstreamState::hash()
   }
   std::sort(lockedHashes->begin(), lockedHashes->end());
   hashesComputed = true;
+  ++s_hashesGeneration;
 }
 
 void DownstreamState::setId(const boost::uuids::uuid& newId)
@@ -352,12 +356,8 @@ void DownstreamState::start()
 
 void DownstreamState::connectUDPSockets()
 {
-  if (s_randomizeIDs) {
-    idStates.clear();
-  }
-  else {
-    idStates.resize(g_maxOutstanding);
-  }
+  /* randomized IDs still use the whole 16-bit space, see getIDStateIndex() */
+  d_idStates.resize(g_maxOutstanding);
   sockets.resize(d_config.d_numberOfSockets);
 
   if (sockets.size() > 1) {
@@ -434,6 +434,7 @@ void DownstreamState::handleUDPTimeout(IDState& ids)
   ids.age = 0;
   ids.inUse = false;
   DOHUnitInterface::handleTimeout(std::move(ids.internal.du));
+  dnsdist::collapsing::releaseWaiting(ids.internal);
   ++reuseds;
   --outstanding;
   ++dnsdist::metrics::g_stats.downstreamTimeouts; // this is an 'actively' discovered timeout
@@ -461,147 +462,142 @@ void DownstreamState::reportResponse(uint8_t rcode)
 {
   if (d_config.availability == Availability::Lazy && d_config.d_lazyHealthCheckSampleSize > 0) {
     bool failure = d_config.d_lazyHealthCheckMode == LazyHealthCheckMode::TimeoutOrServFail ? rcode == RCode::ServFail : false;
-    d_lazyHealthCheckStats.lock()->d_lastResults.push_back(failure);
+    auto& counters = getLazyHealthCheckCounters();
+    auto& counter = failure ? counters.d_failures : counters.d_successes;
+    /* we are the only writer */
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
   }
 }
 
 void DownstreamState::reportTimeoutOrError()
 {
+  /* as far as the latency-aware policies are concerned, a failure costs as much as a timeout */
+  const auto timeout = isTCPOnly() ? d_config.tcpRecvTimeout : s_udpTimeout;
+  latencyPeakEWMA.submit(timeout * 1000000.0);
+
   if (d_config.availability == Availability::Lazy && d_config.d_lazyHealthCheckSampleSize > 0) {
-    d_lazyHealthCheckStats.lock()->d_lastResults.push_back(true);
+    auto& counter = getLazyHealthCheckCounters().d_failures;
+    /* we are the only writer */
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
   }
 }
 
+DownstreamState::LazyHealthCheckCounters& DownstreamState::getLazyHealthCheckCounters()
+{
+  /* the entries of the backends that are gone are only referenced by this thread */
+  thread_local std::unordered_map<uint64_t, std::shared_ptr<LazyHealthCheckCounters>> t_counters;
+  auto entry = t_counters.find(d_lazyHealthCheckCountersID);
+  if (entry != t_counters.end()) {
+    return *entry->second;
+  }
+
+  for (auto it = t_counters.begin(); it != t_counters.end();) {
+    if (it->second.use_count() == 1) {
+      it = t_counters.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  auto counters = std::make_shared<LazyHealthCheckCounters>();
+  d_lazyHealthCheckCounters.lock()->push_back(counters);
+  t_counters.emplace(d_lazyHealthCheckCountersID, counters);
+  return *counters;
+}
+
 void DownstreamState::handleUDPTimeouts()
 {
   if (getProtocol() != dnsdist::Protocol::DoUDP) {
     return;
   }
 
-  if (s_randomizeIDs) {
-    auto map = d_idStatesMap.lock();
-    for (auto it = map->begin(); it != map->end(); ) {
-      auto& ids = it->second;
-      if (isIDSExpired(ids)) {
-        handleUDPTimeout(ids);
-        it = map->erase(it);
-        continue;
-      }
+  if (outstanding.load() == 0) {
+    return;
+  }
+
+  d_idStates.visitInUse([this](uint16_t id, IDState& ids) {
+    if (!ids.isInUse()) {
+      return;
+    }
+    if (!isIDSExpired(ids)) {
       ++ids.age;
-      ++it;
+      return;
     }
-  }
-  else {
-    if (outstanding.load() > 0) {
-      for (IDState& ids : idStates) {
-        if (!ids.isInUse()) {
-          continue;
-        }
-        if (!isIDSExpired(ids)) {
-          ++ids.age;
-          continue;
-        }
-        auto guard = ids.acquire();
-        if (!guard) {
-          continue;
-        }
-        /* check again, now that we have locked this state */
-        if (ids.isInUse() && isIDSExpired(ids)) {
-          handleUDPTimeout(ids);
-        }
-      }
+    auto guard = ids.acquire();
+    if (!guard) {
+      return;
     }
-  }
+    /* check again, now that we have locked this state */
+    if (ids.isInUse() && isIDSExpired(ids)) {
+      handleUDPTimeout(ids);
+      d_idStates.setInUse(id, false);
+    }
+  });
 }
 
 uint16_t DownstreamState::saveState(InternalQueryState&& state)
 {
-  if (s_randomizeIDs) {
-    /* if the state is already in use we will retry,
-       up to 5 five times. The last selected one is used
-       even if it was already in use */
-    size_t remainingAttempts = 5;
-    auto map = d_idStatesMap.lock();
-
-    do {
-      uint16_t selectedID = dnsdist::getRandomValue(std::numeric_limits<uint16_t>::max());
-      auto [it, inserted] = map->emplace(selectedID, IDState());
-
-      if (!inserted) {
-        remainingAttempts--;
-        if (remainingAttempts > 0) {
-          continue;
-        }
-
-        auto oldDU = std::move(it->second.internal.du);
-        ++reuseds;
-        ++dnsdist::metrics::g_stats.downstreamTimeouts;
-        DOHUnitInterface::handleTimeout(std::move(oldDU));
-      }
-      else {
-        ++outstanding;
-      }
-
-      it->second.internal = std::move(state);
-      it->second.age.store(0);
-
-      return it->first;
-    }
-    while (true);
-  }
+  /* with randomized IDs, if the selected state is already in use we will retry,
+     up to five times. The last selected one is used even if it was already in use */
+  size_t remainingAttempts = s_randomizeIDs ? 5 : 1;
 
   do {
-    uint16_t selectedID = (idOffset++) % idStates.size();
-    IDState& ids = idStates[selectedID];
+    const auto queryID = static_cast<uint16_t>(s_randomizeIDs ? dnsdist::getRandomValue(IDStateTable::s_maxSize) : (idOffset++) % d_idStates.size());
+    const auto selectedID = static_cast<uint16_t>(getIDStateIndex(queryID));
+    IDState& ids = d_idStates[selectedID];
     auto guard = ids.acquire();
     if (!guard) {
+      ++idStateCollisions;
       continue;
     }
     if (ids.isInUse()) {
+      ++idStateCollisions;
+      remainingAttempts--;
+      if (remainingAttempts > 0) {
+        continue;
+      }
+
       /* we are reusing a state, no change in outstanding but if there was an existing DOHUnit we need
          to handle it because it's about to be overwritten. */
       auto oldDU = std::move(ids.internal.du);
       ++reuseds;
       ++dnsdist::metrics::g_stats.downstreamTimeouts;
       DOHUnitInterface::handleTimeout(std::move(oldDU));
+      dnsdist::collapsing::releaseWaiting(ids.internal);
     }
     else {
       ++outstanding;
     }
     ids.internal = std::move(state);
     ids.age.store(0);
-    ids.inUse = true;
-    return selectedID;
+    ids.queryID = queryID;
+    d_idStates.setInUse(selectedID, true);
+    return queryID;
   }
   while (true);
 }
 
 void DownstreamState::restoreState(uint16_t id, InternalQueryState&& state)
 {
-  if (s_randomizeIDs) {
-    auto map = d_idStatesMap.lock();
-
-    auto [it, inserted] = map->emplace(id, IDState());
-    if (!inserted) {
-      /* already used */
-      ++reuseds;
-      ++dnsdist::metrics::g_stats.downstreamTimeouts;
-      DOHUnitInterface::handleTimeout(std::move(state.du));
-    }
-    else {
-      it->second.internal = std::move(state);
-      ++outstanding;
-    }
+  const auto index = getIDStateIndex(id);
+  if (index >= d_idStates.size()) {
+    /* cannot be ours */
+    ++reuseds;
+    ++dnsdist::metrics::g_stats.downstreamTimeouts;
+    DOHUnitInterface::handleTimeout(std::move(state.du));
+    dnsdist::collapsing::releaseWaiting(state);
     return;
   }
 
-  auto& ids = idStates[id];
+  auto& ids = d_idStates[index];
   auto guard = ids.acquire();
   if (!guard) {
     /* already used */
     ++reuseds;
     ++dnsdist::metrics::g_stats.downstreamTimeouts;
     DOHUnitInterface::handleTimeout(std::move(state.du));
+    dnsdist::collapsing::releaseWaiting(state);
     return;
   }
   if (ids.isInUse()) {
@@ -609,10 +605,13 @@ void DownstreamState::restoreState(uint16_t id, InternalQueryState&& state)
     ++reuseds;
     ++dnsdist::metrics::g_stats.downstreamTimeouts;
     DOHUnitInterface::handleTimeout(std::move(state.du));
+    dnsdist::collapsing::releaseWaiting(state);
     return;
   }
   ids.internal = std::move(state);
-  ids.inUse = true;
+  ids.age.store(0);
+  ids.queryID = id;
+  d_idStates.setInUse(index, true);
   ++outstanding;
 }
 
@@ -620,42 +619,69 @@ std::optional<InternalQueryState> DownstreamState::getState(uint16_t id)
 {
   std::optional<InternalQueryState> result = std::nullopt;
 
-  if (s_randomizeIDs) {
-    auto map = d_idStatesMap.lock();
-
-    auto it = map->find(id);
-    if (it == map->end()) {
-      return result;
-    }
-
-    result = std::move(it->second.internal);
-    map->erase(it);
-    --outstanding;
-    return result;
-  }
-
-  if (id > idStates.size()) {
+  const auto index = getIDStateIndex(id);
+  if (index >= d_idStates.size()) {
     return result;
   }
 
-  auto& ids = idStates[id];
+  auto& ids = d_idStates[index];
   auto guard = ids.acquire();
   if (!guard) {
     return result;
   }
 
-  if (ids.isInUse()) {
+  /* with randomized IDs, another ID mapped onto the same state might be in use */
+  if (ids.isInUse() && ids.queryID == id) {
     result = std::move(ids.internal);
     --outstanding;
+    d_idStates.setInUse(index, false);
   }
-  ids.inUse = false;
   return result;
 }
 
+void DownstreamState::aggregateLazyHealthCheckResults(LazyHealthCheckStats& stats)
+{
+  uint64_t successes = 0;
+  uint64_t failures = 0;
+  for (const auto& counters : *d_lazyHealthCheckCounters.lock()) {
+    const uint64_t currentSuccesses = counters->d_successes.load(std::memory_order_relaxed);
+    const uint64_t currentFailures = counters->d_failures.load(std::memory_order_relaxed);
+    successes += currentSuccesses - counters->d_aggregatedSuccesses;
+    failures += currentFailures - counters->d_aggregatedFailures;
+    counters->d_aggregatedSuccesses = currentSuccesses;
+    counters->d_aggregatedFailures = currentFailures;
+  }
+
+  if (successes == 0 && failures == 0) {
+    return;
+  }
+
+  /* the order of the results has been lost, so we spread the failures evenly among
+     the successes. Only the most recent results are kept if there are more of them
+     than the sample size, and they have the same proportion of failures */
+  auto& lastResults = stats.d_lastResults;
+  const uint64_t total = successes + failures;
+  const uint64_t capacity = lastResults.capacity();
+  for (uint64_t idx = total > capacity ? total - capacity : 0; idx < total; idx++) {
+    const bool failure = ((idx + 1) * failures) / total > (idx * failures) / total;
+    lastResults.push_back(failure);
+  }
+}
+
+void DownstreamState::discardLazyHealthCheckResults(LazyHealthCheckStats& stats)
+{
+  stats.d_lastResults.clear();
+  for (const auto& counters : *d_lazyHealthCheckCounters.lock()) {
+    counters->d_aggregatedSuccesses = counters->d_successes.load(std::memory_order_relaxed);
+    counters->d_aggregatedFailures = counters->d_failures.load(std::memory_order_relaxed);
+  }
+}
+
 bool DownstreamState::healthCheckRequired(std::optional<time_t> currentTime)
 {
   if (d_config.availability == DownstreamState::Availability::Lazy) {
     auto stats = d_lazyHealthCheckStats.lock();
+    aggregateLazyHealthCheckResults(*stats);
     if (stats->d_status == LazyHealthCheckStats::LazyStatus::PotentialFailure) {
       vinfolog("Sending health-check query for %s which is still in the Potential Failure state", getNameWithAddr());
       return true;
@@ -824,7 +850,7 @@ void DownstreamState::submitHealthCheckResult(bool initial, bool newResult)
         auto stats = d_lazyHealthCheckStats.lock();
         vinfolog("Backend %s had %d successful checks, moving to Healthy", getNameWithAddr(), std::to_string(consecutiveSuccessfulChecks));
         stats->d_status = LazyHealthCheckStats::LazyStatus::Healthy;
-        stats->d_lastResults.clear();
+        discardLazyHealthCheckResults(*stats);
       }
     }
   }
@@ -26,6 +26,7 @@
 #include "dnsparser.hh"
 #include "dnsdist-cache.hh"
 #include "dnsdist-ecs.hh"
+#include "dnsqueryscan.hh"
 #include "ednssubnet.hh"
 #include "packetcache.hh"
 
@@ -46,6 +47,23 @@ DNSDistPacketCache::DNSDistPacketCache(size_t maxEntries, uint32_t maxTTL, uint3
   }
 }
 
+/* ecsOptionPosition points to the option code */
+static bool getClientSubnetFromOption(const PacketBuffer& packet, size_t ecsOptionPosition, size_t ecsOptionSize, boost::optional<Netmask>& subnet)
+{
+  if (ecsOptionSize <= (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE)) {
+    return false;
+  }
+
+  EDNSSubnetOpts eso;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (getEDNSSubnetOptsFromString(reinterpret_cast<const char*>(&packet.at(ecsOptionPosition + (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE))), ecsOptionSize - (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE), &eso)) {
+    subnet = eso.source;
+    return true;
+  }
+
+  return false;
+}
+
 bool DNSDistPacketCache::getClientSubnet(const PacketBuffer& packet, size_t qnameWireLength, boost::optional<Netmask>& subnet)
 {
   uint16_t optRDPosition = 0;
@@ -60,14 +78,8 @@ bool DNSDistPacketCache::getClientSubnet(const PacketBuffer& packet, size_t qnam
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
     res = getEDNSOption(reinterpret_cast<const char*>(&packet.at(optRDPosition)), remaining, EDNSOptionCode::ECS, &ecsOptionStartPosition, &ecsOptionSize);
 
-    if (res == 0 && ecsOptionSize > (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE)) {
-
-      EDNSSubnetOpts eso;
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      if (getEDNSSubnetOptsFromString(reinterpret_cast<const char*>(&packet.at(optRDPosition + ecsOptionStartPosition + (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE))), ecsOptionSize - (EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE), &eso)) {
-        subnet = eso.source;
-        return true;
-      }
+    if (res == 0) {
+      return getClientSubnetFromOption(packet, optRDPosition + ecsOptionStartPosition, ecsOptionSize, subnet);
     }
   }
 
@@ -100,6 +112,7 @@ void DNSDistPacketCache::insertLocked(CacheShard& shard, std::unordered_map<uint
 
   if (result) {
     ++shard.d_entriesCount;
+    ++d_shardedEntriesCount;
     return;
   }
 
@@ -162,14 +175,27 @@ void DNSDistPacketCache::insert(uint32_t key, const boost::optional<Netmask>& su
     }
   }
 
+  const time_t now = time(nullptr);
+  time_t newValidity = now + minTTL;
+
+  if (d_lockFreeSlots) {
+    if ((qname.wirelength() + response.size()) <= d_lockFreeEntrySize) {
+      insertLockFree(key, subnet, queryFlags, dnssecOK, qname, qtype, qclass, response, receivedOverUDP, now, newValidity);
+      return;
+    }
+    /* the sharded maps only hold the answers that are too large to be stored inline,
+       but the maximum number of entries applies to the whole cache */
+    if (getSize() >= d_maxEntries) {
+      return;
+    }
+  }
+
   uint32_t shardIndex = getShardIndex(key);
 
   if (d_shards.at(shardIndex).d_entriesCount >= (d_maxEntries / d_shardCount)) {
     return;
   }
 
-  const time_t now = time(nullptr);
-  time_t newValidity = now + minTTL;
   CacheValue newValue;
   newValue.qname = qname;
   newValue.qtype = qtype;
@@ -201,6 +227,41 @@ void DNSDistPacketCache::insert(uint32_t key, const boost::optional<Netmask>& su
   }
 }
 
+/* Build the response to a query from the cached one, restoring the query ID and the case of the qname.
+   Returns false if the cached response cannot be used. */
+static bool copyCachedResponse(PacketBuffer& response, uint16_t queryId, const DNSName::string_t& dnsQName, const uint8_t* cached, uint16_t len, bool truncatedOK)
+{
+  if (!truncatedOK) {
+    dnsheader dnsHeader{};
+    memcpy(&dnsHeader, cached, sizeof(dnsHeader));
+    if (dnsHeader.tc != 0) {
+      return false;
+    }
+  }
+
+  const size_t dnsQNameLen = dnsQName.length();
+  if (len > sizeof(dnsheader) && len < (sizeof(dnsheader) + dnsQNameLen)) {
+    return false;
+  }
+
+  response.resize(len);
+  memcpy(&response.at(0), &queryId, sizeof(queryId));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(&response.at(sizeof(queryId)), cached + sizeof(queryId), sizeof(dnsheader) - sizeof(queryId));
+
+  if (len == sizeof(dnsheader)) {
+    return true;
+  }
+
+  memcpy(&response.at(sizeof(dnsheader)), dnsQName.c_str(), dnsQNameLen);
+  if (len > (sizeof(dnsheader) + dnsQNameLen)) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    memcpy(&response.at(sizeof(dnsheader) + dnsQNameLen), cached + sizeof(dnsheader) + dnsQNameLen, len - (sizeof(dnsheader) + dnsQNameLen));
+  }
+
+  return true;
+}
+
 bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_t* keyOut, boost::optional<Netmask>& subnet, bool dnssecOK, bool receivedOverUDP, uint32_t allowExpired, bool skipAging, bool truncatedOK, bool recordMiss)
 {
   if (dnsQuestion.ids.qtype == QType::AXFR || dnsQuestion.ids.qtype == QType::IXFR) {
@@ -216,16 +277,83 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
   }
 
   if (d_parseECS) {
-    getClientSubnet(dnsQuestion.getData(), dnsQuestion.ids.qname.wirelength(), subnet);
+    const auto* scan = getQueryScan(dnsQuestion);
+    if (scan != nullptr && (scan->optRDPosition == 0 || scan->validOptions)) {
+      /* the ECS option, if any, has already been located when the query was received */
+      if (scan->ecsPosition != 0) {
+        getClientSubnetFromOption(dnsQuestion.getData(), scan->ecsPosition, scan->ecsSize, subnet);
+      }
+    }
+    else {
+      getClientSubnet(dnsQuestion.getData(), dnsQuestion.ids.qname.wirelength(), subnet);
+    }
   }
 
-  uint32_t shardIndex = getShardIndex(key);
   time_t now = time(nullptr);
   time_t age{0};
   bool stale = false;
+  bool found = false;
   auto& response = dnsQuestion.getMutableData();
-  auto& shard = d_shards.at(shardIndex);
-  {
+
+  if (d_lockFreeSlots) {
+    static thread_local PacketBuffer t_payload;
+    LockFreeEntry entry;
+    auto result = getLockFree(key, entry, t_payload);
+    if (result == LockFreeLookupResult::Busy) {
+      ++d_deferredLookups;
+      return false;
+    }
+
+    if (result == LockFreeLookupResult::Found) {
+      if (entry.validity <= now) {
+        if ((now - entry.validity) >= static_cast<time_t>(allowExpired)) {
+          if (recordMiss) {
+            ++d_misses;
+          }
+          return false;
+        }
+        stale = true;
+      }
+
+      /* check for collision */
+      if (!lockFreeEntryMatches(entry, t_payload.data(), *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), std::string_view(dnsQName.data(), dnsQName.size()), dnsQuestion.ids.qtype, dnsQuestion.ids.qclass, receivedOverUDP, dnssecOK, subnet)) {
+        ++d_lookupCollisions;
+        return false;
+      }
+
+      if (!copyCachedResponse(response, queryId, dnsQName, &t_payload.at(entry.qnameLen), entry.len, truncatedOK)) {
+        return false;
+      }
+
+      if (entry.len == sizeof(dnsheader)) {
+        /* DNS header only, our work here is done */
+        ++d_hits;
+        return true;
+      }
+
+      if (!stale) {
+        age = now - entry.added;
+      }
+      else {
+        age = (entry.validity - entry.added) - d_staleTTL;
+      }
+      found = true;
+    }
+    else {
+      /* the answer might be too large to be stored inline, but there is no point
+         in looking into the sharded maps if they are empty */
+      if (d_shardedEntriesCount == 0) {
+        if (recordMiss) {
+          ++d_misses;
+        }
+        return false;
+      }
+    }
+  }
+
+  if (!found) {
+    uint32_t shardIndex = getShardIndex(key);
+    auto& shard = d_shards.at(shardIndex);
     auto map = shard.d_map.try_read_lock();
     if (!map.owns_lock()) {
       ++d_deferredLookups;
@@ -261,34 +389,17 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
       return false;
     }
 
-    if (!truncatedOK) {
-      dnsheader dnsHeader{};
-      memcpy(&dnsHeader, value.value.data(), sizeof(dnsHeader));
-      if (dnsHeader.tc != 0) {
-        return false;
-      }
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (!copyCachedResponse(response, queryId, dnsQName, reinterpret_cast<const uint8_t*>(value.value.data()), value.len, truncatedOK)) {
+      return false;
     }
 
-    response.resize(value.len);
-    memcpy(&response.at(0), &queryId, sizeof(queryId));
-    memcpy(&response.at(sizeof(queryId)), &value.value.at(sizeof(queryId)), sizeof(dnsheader) - sizeof(queryId));
-
     if (value.len == sizeof(dnsheader)) {
       /* DNS header only, our work here is done */
       ++d_hits;
       return true;
     }
 
-    const size_t dnsQNameLen = dnsQName.length();
-    if (value.len < (sizeof(dnsheader) + dnsQNameLen)) {
-      return false;
-    }
-
-    memcpy(&response.at(sizeof(dnsheader)), dnsQName.c_str(), dnsQNameLen);
-    if (value.len > (sizeof(dnsheader) + dnsQNameLen)) {
-      memcpy(&response.at(sizeof(dnsheader) + dnsQNameLen), &value.value.at(sizeof(dnsheader) + dnsQNameLen), value.len - (sizeof(dnsheader) + dnsQNameLen));
-    }
-
     if (!stale) {
       age = now - value.added;
     }
@@ -315,6 +426,86 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
   return true;
 }
 
+size_t DNSDistPacketCache::getInPlace(uint8_t* packet, size_t querySize, size_t capacity, size_t qnameWireLength, uint16_t qtype, uint16_t qclass, bool dnssecOK, bool receivedOverUDP)
+{
+  if (!d_lockFreeSlots || d_parseECS || qtype == QType::AXFR || qtype == QType::IXFR) {
+    return 0;
+  }
+
+  if (querySize < (sizeof(dnsheader) + qnameWireLength)) {
+    return 0;
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  const uint8_t* qname = packet + sizeof(dnsheader);
+  const auto key = getKey(qname, qnameWireLength, packet, querySize, qnameWireLength, receivedOverUDP);
+
+  static thread_local PacketBuffer t_payload;
+  LockFreeEntry entry;
+  if (getLockFree(key, entry, t_payload) != LockFreeLookupResult::Found) {
+    return 0;
+  }
+
+  const time_t now = time(nullptr);
+  if (entry.validity <= now) {
+    /* stale entries are only served by the regular path */
+    return 0;
+  }
+
+  uint16_t queryFlags{0};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(&queryFlags, packet + sizeof(uint16_t), sizeof(queryFlags));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (!lockFreeEntryMatches(entry, t_payload.data(), queryFlags, std::string_view(reinterpret_cast<const char*>(qname), qnameWireLength), qtype, qclass, receivedOverUDP, dnssecOK, boost::none)) {
+    return 0;
+  }
+
+  const size_t len = entry.len;
+  if (len < sizeof(dnsheader) || len > capacity || t_payload.size() < (entry.qnameLen + len)) {
+    return 0;
+  }
+  if (len > sizeof(dnsheader) && len < (sizeof(dnsheader) + qnameWireLength)) {
+    return 0;
+  }
+
+  /* the query ID and the qname, with the case used by the client, are already in place */
+  const uint8_t* cached = &t_payload.at(entry.qnameLen);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(packet + sizeof(uint16_t), cached + sizeof(uint16_t), sizeof(dnsheader) - sizeof(uint16_t));
+  if (len > (sizeof(dnsheader) + qnameWireLength)) {
+    const size_t offset = sizeof(dnsheader) + qnameWireLength;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    memcpy(packet + offset, cached + offset, len - offset);
+  }
+
+  if (len > sizeof(dnsheader) && !d_dontAge) {
+    const dnsheader_aligned dh_aligned(packet);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    ageDNSPacket(reinterpret_cast<char*>(packet), len, now - entry.added, dh_aligned);
+  }
+
+  ++d_hits;
+  return len;
+}
+
+/* upTo applies to the whole cache: the sharded maps keep what they hold, up to upTo,
+   and the lock-free engine gets what remains */
+size_t DNSDistPacketCache::getLockFreeUpTo(size_t upTo) const
+{
+  const size_t sharded = d_shardedEntriesCount;
+  return upTo > sharded ? upTo - sharded : 0;
+}
+
+/* and once the lock-free engine has been dealt with, the sharded maps get what it did not keep */
+size_t DNSDistPacketCache::getShardedUpTo(size_t upTo) const
+{
+  if (!d_lockFreeSlots) {
+    return upTo;
+  }
+  const size_t lockFree = d_lockFreeEntriesCount;
+  return upTo > lockFree ? upTo - lockFree : 0;
+}
+
 /* Remove expired entries, until the cache has at most
    upTo entries in it.
    If the cache has more than one shard, we will try hard
@@ -322,11 +513,18 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
 */
 size_t DNSDistPacketCache::purgeExpired(size_t upTo, const time_t now)
 {
-  const size_t maxPerShard = upTo / d_shardCount;
-
   size_t removed = 0;
 
   ++d_cleanupCount;
+  if (d_lockFreeSlots) {
+    const auto lockFreeUpTo = getLockFreeUpTo(upTo);
+    if (d_lockFreeEntriesCount > lockFreeUpTo) {
+      removed += removeLockFreeEntries([now](const LockFreeEntry& entry, const PacketBuffer& /* payload */) { return entry.validity <= now; }, lockFreeUpTo);
+    }
+  }
+
+  const size_t maxPerShard = getShardedUpTo(upTo) / d_shardCount;
+
   for (auto& shard : d_shards) {
     auto map = shard.d_map.write_lock();
     if (map->size() <= maxPerShard) {
@@ -342,6 +540,7 @@ size_t DNSDistPacketCache::purgeExpired(size_t upTo, const time_t now)
         it = map->erase(it);
         --toRemove;
         --shard.d_entriesCount;
+        --d_shardedEntriesCount;
         ++removed;
       }
       else {
@@ -360,10 +559,17 @@ size_t DNSDistPacketCache::purgeExpired(size_t upTo, const time_t now)
 */
 size_t DNSDistPacketCache::expunge(size_t upTo)
 {
-  const size_t maxPerShard = upTo / d_shardCount;
-
   size_t removed = 0;
 
+  if (d_lockFreeSlots) {
+    const auto lockFreeUpTo = getLockFreeUpTo(upTo);
+    if (d_lockFreeEntriesCount > lockFreeUpTo) {
+      removed += removeLockFreeEntries([](const LockFreeEntry& /* entry */, const PacketBuffer& /* payload */) { return true; }, lockFreeUpTo);
+    }
+  }
+
+  const size_t maxPerShard = getShardedUpTo(upTo) / d_shardCount;
+
   for (auto& shard : d_shards) {
     auto map = shard.d_map.write_lock();
 
@@ -380,10 +586,12 @@ size_t DNSDistPacketCache::expunge(size_t upTo)
       std::advance(endIt, toRemove);
       map->erase(beginIt, endIt);
       shard.d_entriesCount -= toRemove;
+      d_shardedEntriesCount -= toRemove;
       removed += toRemove;
     }
     else {
       removed += map->size();
+      d_shardedEntriesCount -= map->size();
       map->clear();
       shard.d_entriesCount = 0;
     }
@@ -396,6 +604,18 @@ size_t DNSDistPacketCache::expungeByName(const DNSName& name, uint16_t qtype, bo
 {
   size_t removed = 0;
 
+  if (d_lockFreeSlots) {
+    removed += removeLockFreeEntries([&name, qtype, suffixMatch](const LockFreeEntry& entry, const PacketBuffer& payload) {
+      if (qtype != QType::ANY && qtype != entry.qtype) {
+        return false;
+      }
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      DNSName qname(reinterpret_cast<const char*>(payload.data()), entry.qnameLen, 0, false);
+      return qname == name || (suffixMatch && qname.isPartOf(name));
+    },
+                                     0);
+  }
+
   for (auto& shard : d_shards) {
     auto map = shard.d_map.write_lock();
 
@@ -405,6 +625,7 @@ size_t DNSDistPacketCache::expungeByName(const DNSName& name, uint16_t qtype, bo
       if ((value.qname == name || (suffixMatch && value.qname.isPartOf(name))) && (qtype == QType::ANY || qtype == value.qtype)) {
         it = map->erase(it);
         --shard.d_entriesCount;
+        --d_shardedEntriesCount;
         ++removed;
       }
       else {
@@ -423,13 +644,7 @@ bool DNSDistPacketCache::isFull()
 
 uint64_t DNSDistPacketCache::getSize()
 {
-  uint64_t count = 0;
-
-  for (auto& shard : d_shards) {
-    count += shard.d_entriesCount;
-  }
-
-  return count;
+  return d_lockFreeEntriesCount + d_shardedEntriesCount;
 }
 
 uint32_t DNSDistPacketCache::getMinTTL(const char* packet, uint16_t length, bool* seenNoDataSOA)
@@ -438,27 +653,34 @@ uint32_t DNSDistPacketCache::getMinTTL(const char* packet, uint16_t length, bool
 }
 
 uint32_t DNSDistPacketCache::getKey(const DNSName::string_t& qname, size_t qnameWireLength, const PacketBuffer& packet, bool receivedOverUDP)
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return getKey(reinterpret_cast<const uint8_t*>(qname.c_str()), qname.length(), packet.data(), packet.size(), qnameWireLength, receivedOverUDP);
+}
+
+uint32_t DNSDistPacketCache::getKey(const uint8_t* qname, size_t qnameLength, const uint8_t* packet, size_t packetSize, size_t qnameWireLength, bool receivedOverUDP) const
 {
   uint32_t result = 0;
   /* skip the query ID */
-  if (packet.size() < sizeof(dnsheader)) {
-    throw std::range_error("Computing packet cache key for an invalid packet size (" + std::to_string(packet.size()) + ")");
+  if (packetSize < sizeof(dnsheader)) {
+    throw std::range_error("Computing packet cache key for an invalid packet size (" + std::to_string(packetSize) + ")");
   }
 
-  result = burtle(&packet.at(2), sizeof(dnsheader) - 2, result);
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-  result = burtleCI(reinterpret_cast<const unsigned char*>(qname.c_str()), qname.length(), result);
-  if (packet.size() < sizeof(dnsheader) + qnameWireLength) {
-    throw std::range_error("Computing packet cache key for an invalid packet (" + std::to_string(packet.size()) + " < " + std::to_string(sizeof(dnsheader) + qnameWireLength) + ")");
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  result = burtle(packet + 2, sizeof(dnsheader) - 2, result);
+  result = burtleLowercase(qname, qnameLength, result);
+  if (packetSize < sizeof(dnsheader) + qnameWireLength) {
+    throw std::range_error("Computing packet cache key for an invalid packet (" + std::to_string(packetSize) + " < " + std::to_string(sizeof(dnsheader) + qnameWireLength) + ")");
   }
-  if (packet.size() > ((sizeof(dnsheader) + qnameWireLength))) {
+  if (packetSize > ((sizeof(dnsheader) + qnameWireLength))) {
     if (!d_optionsToSkip.empty()) {
       /* skip EDNS options if any */
       // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      result = PacketCache::hashAfterQname(std::string_view(reinterpret_cast<const char*>(packet.data()), packet.size()), result, sizeof(dnsheader) + qnameWireLength, d_optionsToSkip);
+      result = PacketCache::hashAfterQname(std::string_view(reinterpret_cast<const char*>(packet), packetSize), result, sizeof(dnsheader) + qnameWireLength, d_optionsToSkip);
     }
     else {
-      result = burtle(&packet.at(sizeof(dnsheader) + qnameWireLength), packet.size() - (sizeof(dnsheader) + qnameWireLength), result);
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      result = burtle(packet + sizeof(dnsheader) + qnameWireLength, packetSize - (sizeof(dnsheader) + qnameWireLength), result);
     }
   }
   // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
@@ -492,32 +714,326 @@ uint64_t DNSDistPacketCache::dump(int fileDesc)
 
   uint64_t count = 0;
   time_t now = time(nullptr);
+  auto dumpEntry = [&filePtr, &count, now](uint32_t key, const CacheValue& value) {
+    count++;
+
+    try {
+      uint8_t rcode = 0;
+      if (value.len >= sizeof(dnsheader)) {
+        dnsheader dnsHeader{};
+        memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
+        rcode = dnsHeader.rcode;
+      }
+
+      fprintf(filePtr.get(), "%s %" PRId64 " %s ; rcode %" PRIu8 ", key %" PRIu32 ", length %" PRIu16 ", received over UDP %d, added %" PRId64 "\n", value.qname.toString().c_str(), static_cast<int64_t>(value.validity - now), QType(value.qtype).toString().c_str(), rcode, key, value.len, value.receivedOverUDP ? 1 : 0, static_cast<int64_t>(value.added));
+    }
+    catch (...) {
+      fprintf(filePtr.get(), "; error printing '%s'\n", value.qname.empty() ? "EMPTY" : value.qname.toString().c_str());
+    }
+  };
+
+  if (d_lockFreeSlots) {
+    visitLockFreeEntries(dumpEntry);
+  }
+
   for (auto& shard : d_shards) {
     auto map = shard.d_map.read_lock();
 
     for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
-      count++;
+      dumpEntry(entry.first, entry.second);
+    }
+  }
+
+  return count;
+}
+
+/* Binary dumps start with a magic value, the version of the format, the version of the key function
+   and the key of a reference query, so that a dump is rejected when the keys it contains would not be
+   the ones computed by this cache (different hashing scheme, or different EDNS options skipped).
+   They are followed by the entries, each one prefixed by its length. All integers are in network byte order:
+   - key (32 bits)
+   - time the entry was added, and time it expires (64 bits each, seconds since the epoch)
+   - qtype, qclass and query flags (16 bits each)
+   - flags (8 bits): received over UDP, DNSSEC OK, has a subnet
+   - if there is a subnet: family (8 bits, 4 or 6), prefix length (8 bits) and the address (4 or 16 bytes)
+   - qname in wire format, prefixed by its length (16 bits)
+   - response, prefixed by its length (16 bits) */
+static const std::array<uint8_t, 4> s_binaryDumpMagic{'D', 'D', 'P', 'C'};
+static constexpr uint16_t s_binaryDumpVersion{2};
+/* to be increased whenever getKey() computes a different key for the same query */
+static constexpr uint16_t s_binaryDumpKeyVersion{1};
+static constexpr uint8_t s_binaryDumpFlagUDP{1};
+static constexpr uint8_t s_binaryDumpFlagDNSSECOK{2};
+static constexpr uint8_t s_binaryDumpFlagSubnet{4};
+
+template <typename T>
+static void appendBinaryDumpValue(std::string& out, T value)
+{
+  static_assert(std::is_unsigned_v<T>, "only unsigned values can be written to a dump");
+  for (size_t idx = sizeof(T); idx > 0; idx--) {
+    out.push_back(static_cast<char>((value >> ((idx - 1) * 8)) & 0xff));
+  }
+}
 
-      try {
-        uint8_t rcode = 0;
-        if (value.len >= sizeof(dnsheader)) {
-          dnsheader dnsHeader{};
-          memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
-          rcode = dnsHeader.rcode;
+template <typename T>
+static T readBinaryDumpValue(const std::string& record, size_t& pos)
+{
+  if (record.size() < pos + sizeof(T)) {
+    throw std::runtime_error("Invalid packet cache dump: truncated entry");
+  }
+  T value{0};
+  for (size_t idx = 0; idx < sizeof(T); idx++) {
+    value = static_cast<T>((value << 8) | static_cast<uint8_t>(record.at(pos + idx)));
+  }
+  pos += sizeof(T);
+  return value;
+}
+
+static std::string readBinaryDumpBytes(const std::string& record, size_t& pos, size_t length)
+{
+  if (record.size() < pos + length) {
+    throw std::runtime_error("Invalid packet cache dump: truncated entry");
+  }
+  auto result = record.substr(pos, length);
+  pos += length;
+  return result;
+}
+
+uint32_t DNSDistPacketCache::getReferenceKey() const
+{
+  /* example. IN A, with a client cookie and an ECS option */
+  static const std::array<uint8_t, 59> query{
+    0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x00, 0x00, 0x01, 0x00, 0x01,
+    0x00, 0x00, 0x29, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x17,
+    0x00, 0x0a, 0x00, 0x08, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x00, 0x08, 0x00, 0x07, 0x00, 0x01, 0x18, 0x00, 0xc0, 0x00, 0x02};
+  const size_t qnameWireLength = 9;
+  return getKey(&query.at(sizeof(dnsheader)), qnameWireLength, query.data(), query.size(), qnameWireLength, true);
+}
+
+uint64_t DNSDistPacketCache::dumpBinary(int fileDesc)
+{
+  auto filePtr = pdns::UniqueFilePtr(fdopen(dup(fileDesc), "w"));
+  if (filePtr == nullptr) {
+    throw std::runtime_error("Error opening the packet cache dump: " + stringerror());
+  }
+
+  std::string record;
+  record.insert(record.end(), s_binaryDumpMagic.begin(), s_binaryDumpMagic.end());
+  appendBinaryDumpValue(record, s_binaryDumpVersion);
+  appendBinaryDumpValue(record, s_binaryDumpKeyVersion);
+  appendBinaryDumpValue(record, getReferenceKey());
+  if (fwrite(record.data(), record.size(), 1, filePtr.get()) != 1) {
+    throw std::runtime_error("Error writing the packet cache dump: " + stringerror());
+  }
+
+  uint64_t count = 0;
+  const time_t now = time(nullptr);
+  auto dumpEntry = [&filePtr, &record, &count, now](uint32_t key, const CacheValue& value) {
+    if (value.validity <= now || value.value.size() != value.len) {
+      return;
+    }
+
+    const auto& qname = value.qname.getStorage();
+    record.clear();
+    appendBinaryDumpValue(record, uint32_t{0});
+    appendBinaryDumpValue(record, key);
+    appendBinaryDumpValue(record, static_cast<uint64_t>(value.added));
+    appendBinaryDumpValue(record, static_cast<uint64_t>(value.validity));
+    appendBinaryDumpValue(record, value.qtype);
+    appendBinaryDumpValue(record, value.qclass);
+    appendBinaryDumpValue(record, value.queryFlags);
+    uint8_t flags = (value.receivedOverUDP ? s_binaryDumpFlagUDP : 0) | (value.dnssecOK ? s_binaryDumpFlagDNSSECOK : 0) | (value.subnet ? s_binaryDumpFlagSubnet : 0);
+    appendBinaryDumpValue(record, flags);
+    if (value.subnet) {
+      const auto& network = value.subnet->getNetwork();
+      appendBinaryDumpValue(record, static_cast<uint8_t>(network.isIPv4() ? 4 : 6));
+      appendBinaryDumpValue(record, value.subnet->getBits());
+      if (network.isIPv4()) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        record.append(reinterpret_cast<const char*>(&network.sin4.sin_addr.s_addr), 4);
+      }
+      else {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        record.append(reinterpret_cast<const char*>(&network.sin6.sin6_addr.s6_addr), 16);
+      }
+    }
+    appendBinaryDumpValue(record, static_cast<uint16_t>(qname.size()));
+    record.append(qname.data(), qname.size());
+    appendBinaryDumpValue(record, value.len);
+    record.append(value.value);
+
+    const auto length = htonl(static_cast<uint32_t>(record.size() - sizeof(uint32_t)));
+    memcpy(record.data(), &length, sizeof(length));
+    if (fwrite(record.data(), record.size(), 1, filePtr.get()) != 1) {
+      throw std::runtime_error("Error writing the packet cache dump: " + stringerror());
+    }
+    count++;
+  };
+
+  /* lookups try the lock-free table first, so an entry of the shards with the same key
+     is hidden by the one of the lock-free table, and should not be dumped */
+  std::unordered_set<uint32_t> lockFreeKeys;
+  if (d_lockFreeSlots) {
+    visitLockFreeEntries([&dumpEntry, &lockFreeKeys](uint32_t key, const CacheValue& value) {
+      lockFreeKeys.insert(key);
+      dumpEntry(key, value);
+    });
+  }
+
+  std::vector<std::pair<uint32_t, CacheValue>> entries;
+  for (auto& shard : d_shards) {
+    entries.clear();
+    {
+      auto map = shard.d_map.read_lock();
+      entries.reserve(map->size());
+      for (const auto& entry : *map) {
+        if (entry.second.validity > now && lockFreeKeys.count(entry.first) == 0) {
+          entries.emplace_back(entry.first, entry.second);
         }
+      }
+    }
 
-        fprintf(filePtr.get(), "%s %" PRId64 " %s ; rcode %" PRIu8 ", key %" PRIu32 ", length %" PRIu16 ", received over UDP %d, added %" PRId64 "\n", value.qname.toString().c_str(), static_cast<int64_t>(value.validity - now), QType(value.qtype).toString().c_str(), rcode, entry.first, value.len, value.receivedOverUDP ? 1 : 0, static_cast<int64_t>(value.added));
+    for (const auto& entry : entries) {
+      dumpEntry(entry.first, entry.second);
+    }
+  }
+
+  if (fflush(filePtr.get()) != 0) {
+    throw std::runtime_error("Error writing the packet cache dump: " + stringerror());
+  }
+
+  return count;
+}
+
+uint64_t DNSDistPacketCache::load(int fileDesc)
+{
+  auto filePtr = pdns::UniqueFilePtr(fdopen(dup(fileDesc), "r"));
+  if (filePtr == nullptr) {
+    throw std::runtime_error("Error opening the packet cache dump: " + stringerror());
+  }
+
+  std::string record(s_binaryDumpMagic.size() + sizeof(s_binaryDumpVersion), '\0');
+  if (fread(record.data(), record.size(), 1, filePtr.get()) != 1 || memcmp(record.data(), s_binaryDumpMagic.data(), s_binaryDumpMagic.size()) != 0) {
+    throw std::runtime_error("Invalid packet cache dump: unknown format");
+  }
+  size_t pos = s_binaryDumpMagic.size();
+  const auto version = readBinaryDumpValue<uint16_t>(record, pos);
+  if (version != s_binaryDumpVersion) {
+    throw std::runtime_error("Invalid packet cache dump: unsupported version " + std::to_string(version));
+  }
+
+  record.resize(sizeof(s_binaryDumpKeyVersion) + sizeof(uint32_t));
+  if (fread(record.data(), record.size(), 1, filePtr.get()) != 1) {
+    throw std::runtime_error("Invalid packet cache dump: truncated header");
+  }
+  pos = 0;
+  const auto keyVersion = readBinaryDumpValue<uint16_t>(record, pos);
+  if (keyVersion != s_binaryDumpKeyVersion) {
+    throw std::runtime_error("Invalid packet cache dump: unsupported key version " + std::to_string(keyVersion));
+  }
+  if (readBinaryDumpValue<uint32_t>(record, pos) != getReferenceKey()) {
+    throw std::runtime_error("Invalid packet cache dump: the keys do not match the ones of this cache, were the EDNS options to skip changed?");
+  }
+
+  uint64_t count = 0;
+  const time_t now = time(nullptr);
+  while (true) {
+    uint32_t length{0};
+    if (fread(&length, sizeof(length), 1, filePtr.get()) != 1) {
+      if (feof(filePtr.get()) == 0) {
+        throw std::runtime_error("Error reading the packet cache dump: " + stringerror());
       }
-      catch (...) {
-        fprintf(filePtr.get(), "; error printing '%s'\n", value.qname.empty() ? "EMPTY" : value.qname.toString().c_str());
+      break;
+    }
+    length = ntohl(length);
+    if (length > (64 * 1024 * 3)) {
+      /* we cannot trust the length, so we cannot find the next entry */
+      break;
+    }
+    record.resize(length);
+    if (length > 0 && fread(record.data(), record.size(), 1, filePtr.get()) != 1) {
+      /* truncated entry, keep the ones we already loaded */
+      break;
+    }
+
+    pos = 0;
+    CacheValue value;
+    uint32_t key{0};
+    try {
+      key = readBinaryDumpValue<uint32_t>(record, pos);
+      value.added = static_cast<time_t>(readBinaryDumpValue<uint64_t>(record, pos));
+      value.validity = static_cast<time_t>(readBinaryDumpValue<uint64_t>(record, pos));
+      value.qtype = readBinaryDumpValue<uint16_t>(record, pos);
+      value.qclass = readBinaryDumpValue<uint16_t>(record, pos);
+      value.queryFlags = readBinaryDumpValue<uint16_t>(record, pos);
+      const auto flags = readBinaryDumpValue<uint8_t>(record, pos);
+      value.receivedOverUDP = (flags & s_binaryDumpFlagUDP) != 0;
+      value.dnssecOK = (flags & s_binaryDumpFlagDNSSECOK) != 0;
+      if ((flags & s_binaryDumpFlagSubnet) != 0) {
+        const auto family = readBinaryDumpValue<uint8_t>(record, pos);
+        const auto bits = readBinaryDumpValue<uint8_t>(record, pos);
+        ComboAddress network;
+        if (family == 4) {
+          network.sin4.sin_family = AF_INET;
+          memcpy(&network.sin4.sin_addr.s_addr, readBinaryDumpBytes(record, pos, 4).data(), 4);
+        }
+        else if (family == 6) {
+          network.sin6.sin6_family = AF_INET6;
+          memcpy(&network.sin6.sin6_addr.s6_addr, readBinaryDumpBytes(record, pos, 16).data(), 16);
+        }
+        else {
+          throw std::runtime_error("Invalid packet cache dump: unknown subnet family " + std::to_string(family));
+        }
+        value.subnet = Netmask(network, bits);
       }
+      const auto qnameLength = readBinaryDumpValue<uint16_t>(record, pos);
+      const auto qname = readBinaryDumpBytes(record, pos, qnameLength);
+      value.qname = DNSName(qname.data(), qname.size(), 0, false);
+      value.len = readBinaryDumpValue<uint16_t>(record, pos);
+      value.value = readBinaryDumpBytes(record, pos, value.len);
+    }
+    catch (const std::exception&) {
+      /* the length of the entry is right, so we can skip to the next one */
+      continue;
+    }
+
+    if (value.validity <= now || value.len < sizeof(dnsheader) || value.len > getMaximumEntrySize()) {
+      continue;
+    }
+    /* the settings might have changed since the dump was written */
+    value.validity = std::min(value.validity, static_cast<time_t>(now + d_maxTTL));
+
+    if (insertLoaded(key, value)) {
+      count++;
     }
   }
 
   return count;
 }
 
+bool DNSDistPacketCache::insertLoaded(uint32_t key, CacheValue& value)
+{
+  if (getSize() >= d_maxEntries) {
+    return false;
+  }
+
+  if (d_lockFreeSlots && (value.qname.wirelength() + value.len) <= d_lockFreeEntrySize) {
+    /* passing the time the entry was added, instead of now, keeps the aging of the response right */
+    insertLockFree(key, value.subnet, value.queryFlags, value.dnssecOK, value.qname, value.qtype, value.qclass, PacketBuffer(value.value.begin(), value.value.end()), value.receivedOverUDP, value.added, value.validity);
+    return true;
+  }
+
+  auto& shard = d_shards.at(getShardIndex(key));
+  if (shard.d_entriesCount >= (d_maxEntries / d_shardCount)) {
+    return false;
+  }
+  auto lock = shard.d_map.write_lock();
+  insertLocked(shard, *lock, key, value);
+  return true;
+}
+
 void DNSDistPacketCache::setSkippedOptions(const std::unordered_set<uint16_t>& optionsToSkip)
 {
   d_optionsToSkip = optionsToSkip;
@@ -527,55 +1043,61 @@ std::set<DNSName> DNSDistPacketCache::getDomainsContainingRecords(const ComboAdd
 {
   std::set<DNSName> domains;
 
-  for (auto& shard : d_shards) {
-    auto map = shard.d_map.read_lock();
-
-    for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
-
-      try {
-        if (value.len < sizeof(dnsheader)) {
-          continue;
-        }
+  auto inspectEntry = [&addr, &domains](uint32_t /* key */, const CacheValue& value) {
+    try {
+      if (value.len < sizeof(dnsheader)) {
+        return;
+      }
 
-        dnsheader dnsHeader{};
-        memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
-        if (dnsHeader.rcode != RCode::NoError || (dnsHeader.ancount == 0 && dnsHeader.nscount == 0 && dnsHeader.arcount == 0)) {
-          continue;
-        }
+      dnsheader dnsHeader{};
+      memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
+      if (dnsHeader.rcode != RCode::NoError || (dnsHeader.ancount == 0 && dnsHeader.nscount == 0 && dnsHeader.arcount == 0)) {
+        return;
+      }
 
-        bool found = false;
-        bool valid = visitDNSPacket(value.value, [addr, &found](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
-          if (qtype == QType::A && qclass == QClass::IN && addr.isIPv4() && rdatalength == 4 && rdata != nullptr) {
-            ComboAddress parsed;
-            parsed.sin4.sin_family = AF_INET;
-            memcpy(&parsed.sin4.sin_addr.s_addr, rdata, rdatalength);
-            if (parsed == addr) {
-              found = true;
-              return true;
-            }
+      bool found = false;
+      bool valid = visitDNSPacket(value.value, [addr, &found](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
+        if (qtype == QType::A && qclass == QClass::IN && addr.isIPv4() && rdatalength == 4 && rdata != nullptr) {
+          ComboAddress parsed;
+          parsed.sin4.sin_family = AF_INET;
+          memcpy(&parsed.sin4.sin_addr.s_addr, rdata, rdatalength);
+          if (parsed == addr) {
+            found = true;
+            return true;
           }
-          else if (qtype == QType::AAAA && qclass == QClass::IN && addr.isIPv6() && rdatalength == 16 && rdata != nullptr) {
-            ComboAddress parsed;
-            parsed.sin6.sin6_family = AF_INET6;
-            memcpy(&parsed.sin6.sin6_addr.s6_addr, rdata, rdatalength);
-            if (parsed == addr) {
-              found = true;
-              return true;
-            }
+        }
+        else if (qtype == QType::AAAA && qclass == QClass::IN && addr.isIPv6() && rdatalength == 16 && rdata != nullptr) {
+          ComboAddress parsed;
+          parsed.sin6.sin6_family = AF_INET6;
+          memcpy(&parsed.sin6.sin6_addr.s6_addr, rdata, rdatalength);
+          if (parsed == addr) {
+            found = true;
+            return true;
           }
+        }
 
-          return false;
-        });
+        return false;
+      });
 
-        if (valid && found) {
-          domains.insert(value.qname);
-        }
-      }
-      catch (...) {
-        continue;
+      if (valid && found) {
+        domains.insert(value.qname);
       }
     }
+    catch (...) {
+      return;
+    }
+  };
+
+  if (d_lockFreeSlots) {
+    visitLockFreeEntries(inspectEntry);
+  }
+
+  for (auto& shard : d_shards) {
+    auto map = shard.d_map.read_lock();
+
+    for (const auto& entry : *map) {
+      inspectEntry(entry.first, entry.second);
+    }
   }
 
   return domains;
@@ -585,54 +1107,436 @@ std::set<ComboAddress> DNSDistPacketCache::getRecordsForDomain(const DNSName& do
 {
   std::set<ComboAddress> addresses;
 
+  auto inspectEntry = [&domain, &addresses](uint32_t /* key */, const CacheValue& value) {
+    try {
+      if (value.qname != domain) {
+        return;
+      }
+
+      dnsheader dnsHeader{};
+      if (value.len < sizeof(dnsheader)) {
+        return;
+      }
+
+      memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
+      if (dnsHeader.rcode != RCode::NoError || (dnsHeader.ancount == 0 && dnsHeader.nscount == 0 && dnsHeader.arcount == 0)) {
+        return;
+      }
+
+      visitDNSPacket(value.value, [&addresses](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
+        if (qtype == QType::A && qclass == QClass::IN && rdatalength == 4 && rdata != nullptr) {
+          ComboAddress parsed;
+          parsed.sin4.sin_family = AF_INET;
+          memcpy(&parsed.sin4.sin_addr.s_addr, rdata, rdatalength);
+          addresses.insert(parsed);
+        }
+        else if (qtype == QType::AAAA && qclass == QClass::IN && rdatalength == 16 && rdata != nullptr) {
+          ComboAddress parsed;
+          parsed.sin6.sin6_family = AF_INET6;
+          memcpy(&parsed.sin6.sin6_addr.s6_addr, rdata, rdatalength);
+          addresses.insert(parsed);
+        }
+
+        return false;
+      });
+    }
+    catch (...) {
+      return;
+    }
+  };
+
+  if (d_lockFreeSlots) {
+    visitLockFreeEntries(inspectEntry);
+  }
+
   for (auto& shard : d_shards) {
     auto map = shard.d_map.read_lock();
 
     for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
+      inspectEntry(entry.first, entry.second);
+    }
+  }
 
-      try {
-        if (value.qname != domain) {
-          continue;
-        }
+  return addresses;
+}
 
-        dnsheader dnsHeader{};
-        if (value.len < sizeof(dnsheader)) {
-          continue;
-        }
+void DNSDistPacketCache::setMaximumEntrySize(size_t maxSize)
+{
+  d_maximumEntrySize = maxSize;
+}
 
-        memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
-        if (dnsHeader.rcode != RCode::NoError || (dnsHeader.ancount == 0 && dnsHeader.nscount == 0 && dnsHeader.arcount == 0)) {
-          continue;
-        }
+void DNSDistPacketCache::enableLockFreeEngine(size_t entrySize)
+{
+  if (entrySize <= sizeof(dnsheader) || entrySize > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error("Invalid entry size for the lock-free packet cache engine (" + std::to_string(entrySize) + ")");
+  }
 
-        visitDNSPacket(value.value, [&addresses](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
-          if (qtype == QType::A && qclass == QClass::IN && rdatalength == 4 && rdata != nullptr) {
-            ComboAddress parsed;
-            parsed.sin4.sin_family = AF_INET;
-            memcpy(&parsed.sin4.sin_addr.s_addr, rdata, rdatalength);
-            addresses.insert(parsed);
-          }
-          else if (qtype == QType::AAAA && qclass == QClass::IN && rdatalength == 16 && rdata != nullptr) {
-            ComboAddress parsed;
-            parsed.sin6.sin6_family = AF_INET6;
-            memcpy(&parsed.sin6.sin6_addr.s6_addr, rdata, rdatalength);
-            addresses.insert(parsed);
-          }
+  /* a key can only live in the bucket it hashes to, so keep the load factor at 0.5 to make overflowing a bucket unlikely */
+  d_lockFreeBucketsCount = std::max(static_cast<size_t>(1), ((d_maxEntries * 2) + s_lockFreeBucketSize - 1) / s_lockFreeBucketSize);
+  const size_t slotsCount = d_lockFreeBucketsCount * s_lockFreeBucketSize;
+  d_lockFreeEntrySize = entrySize;
+  d_lockFreeEntryWords = (entrySize + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+  d_lockFreeSlots = std::make_unique<LockFreeSlot[]>(slotsCount);
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+  d_lockFreeTags = std::make_unique<std::atomic<uint64_t>[]>(slotsCount);
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+  d_lockFreeData = std::make_unique<std::atomic<uint64_t>[]>(slotsCount * d_lockFreeEntryWords);
+}
 
-          return false;
-        });
+/* copy size bytes from src into consecutive atomic words, the last word being padded with zeros */
+static void storeToAtomicWords(std::atomic<uint64_t>* words, const uint8_t* src, size_t size)
+{
+  for (size_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+    uint64_t word{0};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    memcpy(&word, src + offset, std::min(sizeof(word), size - offset));
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    words[offset / sizeof(uint64_t)].store(word, std::memory_order_relaxed);
+  }
+}
+
+static void loadFromAtomicWords(uint8_t* dst, const std::atomic<uint64_t>* words, size_t size)
+{
+  for (size_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const uint64_t word = words[offset / sizeof(uint64_t)].load(std::memory_order_relaxed);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    memcpy(dst + offset, &word, std::min(sizeof(word), size - offset));
+  }
+}
+
+DNSDistPacketCache::LockFreeEntry DNSDistPacketCache::loadLockFreeEntry(const LockFreeSlot& slot)
+{
+  static_assert(std::is_trivially_copyable_v<LockFreeEntry>, "the entries of the lock-free engine are copied word by word");
+  std::array<uint8_t, s_lockFreeEntryWords * sizeof(uint64_t)> buffer{};
+  loadFromAtomicWords(buffer.data(), slot.d_entry.data(), sizeof(LockFreeEntry));
+  LockFreeEntry entry;
+  memcpy(&entry, buffer.data(), sizeof(entry));
+  return entry;
+}
+
+void DNSDistPacketCache::storeLockFreeEntry(LockFreeSlot& slot, const LockFreeEntry& entry)
+{
+  std::array<uint8_t, s_lockFreeEntryWords * sizeof(uint64_t)> buffer{};
+  memcpy(buffer.data(), &entry, sizeof(entry));
+  storeToAtomicWords(slot.d_entry.data(), buffer.data(), sizeof(LockFreeEntry));
+}
+
+std::atomic<uint64_t>* DNSDistPacketCache::getLockFreeData(size_t slotIndex) const
+{
+  return &d_lockFreeData[slotIndex * d_lockFreeEntryWords];
+}
+
+/* the tag of an empty slot is 0, so that readers can skip it without looking at the slot itself */
+static uint64_t getLockFreeTag(uint32_t key)
+{
+  return (static_cast<uint64_t>(1) << 32U) | key;
+}
+
+size_t DNSDistPacketCache::getLockFreeBucketStart(uint32_t key) const
+{
+  /* map the key to [0, d_lockFreeBucketsCount[ without a division */
+  return ((static_cast<uint64_t>(key) * d_lockFreeBucketsCount) >> 32U) * s_lockFreeBucketSize;
+}
+
+bool DNSDistPacketCache::lockLockFreeSlot(LockFreeSlot& slot, uint32_t& sequence, bool wait) const
+{
+  sequence = slot.d_sequence.load(std::memory_order_relaxed);
+  while (true) {
+    if ((sequence & 1U) == 0 && slot.d_sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+      /* make sure that readers cannot see any of our writes without also seeing the odd sequence number */
+      std::atomic_thread_fence(std::memory_order_release);
+      return true;
+    }
+    if (!wait) {
+      return false;
+    }
+    sequence = slot.d_sequence.load(std::memory_order_relaxed);
+  }
+}
+
+bool DNSDistPacketCache::readLockFreeSlot(size_t slotIndex, LockFreeEntry& entry, PacketBuffer& payload) const
+{
+  static constexpr size_t maxAttempts{8};
+  const auto& slot = d_lockFreeSlots[slotIndex];
+  const auto* data = getLockFreeData(slotIndex);
+
+  for (size_t attempt = 0; attempt < maxAttempts; ++attempt) {
+    const auto before = slot.d_sequence.load(std::memory_order_acquire);
+    if ((before & 1U) != 0) {
+      /* a writer is busy with this slot */
+      continue;
+    }
+
+    entry = loadLockFreeEntry(slot);
+    if (entry.used) {
+      /* the lengths might be garbage if we raced with a writer, and we will find out below, but we must not read past the slot */
+      const size_t payloadSize = std::min(static_cast<size_t>(entry.qnameLen) + entry.len, d_lockFreeEntrySize);
+      payload.resize(payloadSize);
+      loadFromAtomicWords(payload.data(), data, payloadSize);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.d_sequence.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+DNSDistPacketCache::LockFreeLookupResult DNSDistPacketCache::getLockFree(uint32_t key, LockFreeEntry& entry, PacketBuffer& payload) const
+{
+  const auto start = getLockFreeBucketStart(key);
+  const auto tag = getLockFreeTag(key);
+  bool busy = false;
+
+  for (size_t idx = start; idx < (start + s_lockFreeBucketSize); ++idx) {
+    if (d_lockFreeTags[idx].load(std::memory_order_relaxed) != tag) {
+      continue;
+    }
+
+    if (!readLockFreeSlot(idx, entry, payload)) {
+      busy = true;
+      continue;
+    }
+
+    if (entry.used && entry.key == key) {
+      return LockFreeLookupResult::Found;
+    }
+  }
+
+  return busy ? LockFreeLookupResult::Busy : LockFreeLookupResult::NotFound;
+}
+
+bool DNSDistPacketCache::lockFreeEntryMatches(const LockFreeEntry& entry, const uint8_t* qnameWire, uint16_t queryFlags, std::string_view qname, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const boost::optional<Netmask>& subnet) const
+{
+  if (entry.queryFlags != queryFlags || entry.dnssecOK != dnssecOK || entry.receivedOverUDP != receivedOverUDP || entry.qtype != qtype || entry.qclass != qclass) {
+    return false;
+  }
+
+  if (qname.size() != entry.qnameLen) {
+    return false;
+  }
+
+  for (size_t idx = 0; idx < qname.size(); ++idx) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    if (dns_tolower(static_cast<uint8_t>(qname[idx])) != dns_tolower(qnameWire[idx])) {
+      return false;
+    }
+  }
+
+  if (d_parseECS) {
+    if (entry.hasSubnet != static_cast<bool>(subnet)) {
+      return false;
+    }
+    if (entry.hasSubnet && !(entry.subnet == *subnet)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void DNSDistPacketCache::insertLockFree(uint32_t key, const boost::optional<Netmask>& subnet, uint16_t queryFlags, bool dnssecOK, const DNSName& qname, uint16_t qtype, uint16_t qclass, const PacketBuffer& response, bool receivedOverUDP, time_t now, time_t newValidity)
+{
+  const auto start = getLockFreeBucketStart(key);
+  const auto tag = getLockFreeTag(key);
+  std::optional<size_t> target;
+
+  /* we prefer a slot already holding this key, then an empty one, then the one that expired first */
+  for (size_t idx = start; idx < (start + s_lockFreeBucketSize); ++idx) {
+    if (d_lockFreeTags[idx].load(std::memory_order_relaxed) == tag) {
+      target = idx;
+      break;
+    }
+  }
+  if (!target) {
+    for (size_t idx = start; idx < (start + s_lockFreeBucketSize); ++idx) {
+      if (d_lockFreeTags[idx].load(std::memory_order_relaxed) == 0) {
+        target = idx;
+        break;
+      }
+    }
+  }
+  if (!target) {
+    time_t oldest = now;
+    for (size_t idx = start; idx < (start + s_lockFreeBucketSize); ++idx) {
+      /* this read might see a partial update but it is only a hint, the slot is checked again once we own it */
+      const auto validity = loadLockFreeEntry(d_lockFreeSlots[idx]).validity;
+      if (validity <= oldest) {
+        oldest = validity;
+        target = idx;
+      }
+    }
+  }
+  if (!target) {
+    ++d_insertCollisions;
+    return;
+  }
+
+  auto& slot = d_lockFreeSlots[*target];
+  uint32_t sequence = 0;
+  if (!lockLockFreeSlot(slot, sequence, !d_deferrableInsertLock)) {
+    ++d_deferredInserts;
+    return;
+  }
+
+  auto* data = getLockFreeData(*target);
+  auto entry = loadLockFreeEntry(slot);
+  if (entry.used) {
+    if (entry.key != key) {
+      if (entry.validity > now) {
+        /* another key got there first */
+        slot.d_sequence.store(sequence, std::memory_order_release);
+        ++d_insertCollisions;
+        return;
+      }
+    }
+    else {
+      /* in case of collision, don't override the existing entry
+         except if it has expired */
+      bool wasExpired = entry.validity <= now;
+      std::array<uint8_t, DNSName::s_maxDNSNameLength + 1> existingQName{};
+      loadFromAtomicWords(existingQName.data(), data, std::min(static_cast<size_t>(entry.qnameLen), existingQName.size()));
+      if (!wasExpired && !lockFreeEntryMatches(entry, existingQName.data(), queryFlags, std::string_view(qname.getStorage().data(), qname.getStorage().size()), qtype, qclass, receivedOverUDP, dnssecOK, subnet)) {
+        slot.d_sequence.store(sequence, std::memory_order_release);
+        ++d_insertCollisions;
+        return;
       }
-      catch (...) {
+
+      /* if the existing entry had a longer TTD, keep it */
+      if (newValidity <= entry.validity) {
+        slot.d_sequence.store(sequence, std::memory_order_release);
+        return;
+      }
+    }
+  }
+  else {
+    if (getSize() >= d_maxEntries) {
+      slot.d_sequence.store(sequence, std::memory_order_release);
+      return;
+    }
+    ++d_lockFreeEntriesCount;
+  }
+
+  const auto& storage = qname.getStorage();
+  entry.key = key;
+  entry.qtype = qtype;
+  entry.qclass = qclass;
+  entry.queryFlags = queryFlags;
+  entry.qnameLen = storage.size();
+  entry.len = response.size();
+  entry.added = now;
+  entry.validity = newValidity;
+  entry.receivedOverUDP = receivedOverUDP;
+  entry.dnssecOK = dnssecOK;
+  entry.hasSubnet = static_cast<bool>(subnet);
+  entry.subnet = subnet ? *subnet : Netmask();
+  entry.used = true;
+  storeLockFreeEntry(slot, entry);
+
+  static thread_local PacketBuffer t_payload;
+  t_payload.resize(storage.size() + response.size());
+  memcpy(t_payload.data(), storage.data(), storage.size());
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(t_payload.data() + storage.size(), response.data(), response.size());
+  storeToAtomicWords(data, t_payload.data(), t_payload.size());
+
+  d_lockFreeTags[*target].store(tag, std::memory_order_relaxed);
+  slot.d_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+template <typename T>
+size_t DNSDistPacketCache::removeLockFreeEntries(T predicate, size_t upTo)
+{
+  const size_t slotsCount = d_lockFreeBucketsCount * s_lockFreeBucketSize;
+  size_t removed = 0;
+  LockFreeEntry entry;
+  PacketBuffer payload;
+
+  for (size_t idx = 0; idx < slotsCount && d_lockFreeEntriesCount > upTo; ++idx) {
+    if (d_lockFreeTags[idx].load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+
+    if (!readLockFreeSlot(idx, entry, payload) || !entry.used) {
+      continue;
+    }
+
+    try {
+      if (!predicate(entry, payload)) {
         continue;
       }
     }
+    catch (...) {
+      continue;
+    }
+
+    auto& slot = d_lockFreeSlots[idx];
+    uint32_t sequence = 0;
+    lockLockFreeSlot(slot, sequence, true);
+    /* make sure that the entry has not been replaced in the meantime */
+    auto current = loadLockFreeEntry(slot);
+    if (!current.used || current.key != entry.key || current.added != entry.added) {
+      slot.d_sequence.store(sequence, std::memory_order_release);
+      continue;
+    }
+
+    current.used = false;
+    storeLockFreeEntry(slot, current);
+    d_lockFreeTags[idx].store(0, std::memory_order_relaxed);
+    slot.d_sequence.store(sequence + 2, std::memory_order_release);
+    --d_lockFreeEntriesCount;
+    ++removed;
   }
 
-  return addresses;
+  return removed;
 }
 
-void DNSDistPacketCache::setMaximumEntrySize(size_t maxSize)
+DNSDistPacketCache::CacheValue DNSDistPacketCache::lockFreeEntryToCacheValue(const LockFreeEntry& entry, const PacketBuffer& payload)
 {
-  d_maximumEntrySize = maxSize;
+  CacheValue value;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  value.qname = DNSName(reinterpret_cast<const char*>(payload.data()), entry.qnameLen, 0, false);
+  value.value = std::string(payload.begin() + entry.qnameLen, payload.begin() + entry.qnameLen + entry.len);
+  if (entry.hasSubnet) {
+    value.subnet = entry.subnet;
+  }
+  value.qtype = entry.qtype;
+  value.qclass = entry.qclass;
+  value.queryFlags = entry.queryFlags;
+  value.added = entry.added;
+  value.validity = entry.validity;
+  value.len = entry.len;
+  value.receivedOverUDP = entry.receivedOverUDP;
+  value.dnssecOK = entry.dnssecOK;
+  return value;
+}
+
+void DNSDistPacketCache::visitLockFreeEntries(const std::function<void(uint32_t key, const CacheValue& value)>& visitor) const
+{
+  const size_t slotsCount = d_lockFreeBucketsCount * s_lockFreeBucketSize;
+  LockFreeEntry entry;
+  PacketBuffer payload;
+
+  for (size_t idx = 0; idx < slotsCount; ++idx) {
+    if (d_lockFreeTags[idx].load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+
+    if (!readLockFreeSlot(idx, entry, payload) || !entry.used) {
+      continue;
+    }
+
+    std::optional<CacheValue> value;
+    try {
+      value = lockFreeEntryToCacheValue(entry, payload);
+    }
+    catch (...) {
+      continue;
+    }
+    visitor(entry.key, *value);
+  }
 }
@@ -21,7 +21,10 @@
  */
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <functional>
+#include <string_view>
 #include <unordered_map>
 
 #include "iputils.hh"
@@ -56,6 +59,25 @@ public:
   uint64_t getCleanupCount() const { return d_cleanupCount.load(); }
   uint64_t getEntriesCount();
   uint64_t dump(int fileDesc);
+  /* Write the entries that have not expired yet to fileDesc, in a compact binary format that can be read back
+     by load(). The lock of a shard is only held while its entries are copied, not while they are written.
+     Returns the number of entries written. */
+  uint64_t dumpBinary(int fileDesc);
+  /* Insert the entries of a dump written by dumpBinary(), skipping the ones that have expired since then
+     and the ones that cannot be parsed, and stopping at a truncated one. Throws if the header of the dump
+     is not valid. Returns the number of entries inserted. */
+  uint64_t load(int fileDesc);
+  /* Only one dump of a given cache can be in progress at any time. Returns false if there is already one,
+     otherwise the caller has to call finishDump() once it is done */
+  bool startDump()
+  {
+    bool expected = false;
+    return d_dumpInProgress.compare_exchange_strong(expected, true);
+  }
+  void finishDump()
+  {
+    d_dumpInProgress.store(false);
+  }
 
   /* get the list of domains (qnames) that contains the given address in an A or AAAA record */
   std::set<DNSName> getDomainsContainingRecords(const ComboAddress& addr);
@@ -80,9 +102,36 @@ public:
     d_parseECS = enabled;
   }
 
+  /* Let queries missing the cache while an identical one is already being forwarded wait, for up to timeoutMs,
+     for its response to be inserted instead of being forwarded as well. At most maxWaiting queries wait for
+     the same response. See dnsdist-query-collapsing.hh */
+  void setCollapsing(size_t maxWaiting, uint32_t timeoutMs)
+  {
+    d_collapsingMaxWaiting = maxWaiting;
+    d_collapsingTimeout = timeoutMs;
+  }
+  bool isCollapsingEnabled() const { return d_collapsingMaxWaiting > 0; }
+  size_t getCollapsingMaxWaiting() const { return d_collapsingMaxWaiting; }
+  uint32_t getCollapsingTimeout() const { return d_collapsingTimeout; }
+
   void setMaximumEntrySize(size_t maxSize);
   size_t getMaximumEntrySize() const { return d_maximumEntrySize; }
 
+  /* Switch this cache to the lock-free engine: lookups for answers whose qname and response
+     fit into entrySize bytes are served from a flat, open-addressed table protected by per-slot
+     sequence counters, so readers never take a lock. Larger answers still go to the sharded maps.
+     Must be called before the cache is used. */
+  void enableLockFreeEngine(size_t entrySize);
+  bool isLockFreeEngineEnabled() const { return d_lockFreeSlots != nullptr; }
+  size_t getLockFreeEntrySize() const { return d_lockFreeEntrySize; }
+
+  /* Look for a fresh answer to the query in the lock-free engine only, and if there is one, overwrite the query
+     with it in place, keeping the query ID and the case of the qname. This is meant for callers that have the raw
+     query in a buffer they own, like the AF_XDP fast path: the qname has to start right after the header, without
+     compression, and the caller needs to check that ECS does not apply. Nothing is recorded on a miss, as the caller
+     is expected to fall back to get(). Returns the size of the response, or 0 if none was found. */
+  size_t getInPlace(uint8_t* packet, size_t querySize, size_t capacity, size_t qnameWireLength, uint16_t qtype, uint16_t qclass, bool dnssecOK, bool receivedOverUDP);
+
   uint32_t getKey(const DNSName::string_t& qname, size_t qnameWireLength, const PacketBuffer& packet, bool receivedOverUDP);
 
   static uint32_t getMinTTL(const char* packet, uint16_t length, bool* seenNoDataSOA);
@@ -126,9 +175,74 @@ private:
 
   bool cachedValueMatches(const CacheValue& cachedValue, uint16_t queryFlags, const DNSName& qname, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const boost::optional<Netmask>& subnet) const;
   uint32_t getShardIndex(uint32_t key) const;
+  uint32_t getKey(const uint8_t* qname, size_t qnameLength, const uint8_t* packet, size_t packetSize, size_t qnameWireLength, bool receivedOverUDP) const;
   void insertLocked(CacheShard& shard, std::unordered_map<uint32_t, CacheValue>& map, uint32_t key, CacheValue& newValue);
+  bool insertLoaded(uint32_t key, CacheValue& value);
+  /* the key of a fixed query, written to dumps to detect a change in the way keys are computed */
+  uint32_t getReferenceKey() const;
+
+  /* Lock-free engine. Everything a reader needs is stored inline: the slot metadata below,
+     plus a fixed-size payload holding the qname in wire format followed by the response.
+     Readers copy the metadata and the payload, then check that the sequence number did
+     not change (and was even) to make sure they did not see a partial update. Both are
+     stored in atomic words, accessed with relaxed loads and stores, so that a reader racing
+     with a writer only gets a copy it will discard instead of a data race. */
+  struct LockFreeEntry
+  {
+    Netmask subnet;
+    time_t added{0};
+    time_t validity{0};
+    uint32_t key{0};
+    uint16_t qtype{0};
+    uint16_t qclass{0};
+    uint16_t queryFlags{0};
+    uint16_t qnameLen{0};
+    uint16_t len{0};
+    bool used{false};
+    bool hasSubnet{false};
+    bool receivedOverUDP{false};
+    bool dnssecOK{false};
+  };
+
+  static constexpr size_t s_lockFreeEntryWords{(sizeof(LockFreeEntry) + sizeof(uint64_t) - 1) / sizeof(uint64_t)};
+
+  struct LockFreeSlot
+  {
+    /* even when the slot is stable, odd while a writer owns it */
+    std::atomic<uint32_t> d_sequence{0};
+    std::array<std::atomic<uint64_t>, s_lockFreeEntryWords> d_entry{};
+  };
+
+  /* number of slots per bucket, a key can only be stored in the bucket it hashes to */
+  static constexpr size_t s_lockFreeBucketSize{8};
+
+  enum class LockFreeLookupResult : uint8_t
+  {
+    NotFound,
+    Found,
+    Busy
+  };
+
+  size_t getLockFreeUpTo(size_t upTo) const;
+  size_t getShardedUpTo(size_t upTo) const;
+  size_t getLockFreeBucketStart(uint32_t key) const;
+  bool lockLockFreeSlot(LockFreeSlot& slot, uint32_t& sequence, bool wait) const;
+  static LockFreeEntry loadLockFreeEntry(const LockFreeSlot& slot);
+  static void storeLockFreeEntry(LockFreeSlot& slot, const LockFreeEntry& entry);
+  std::atomic<uint64_t>* getLockFreeData(size_t slotIndex) const;
+  bool readLockFreeSlot(size_t slotIndex, LockFreeEntry& entry, PacketBuffer& payload) const;
+  LockFreeLookupResult getLockFree(uint32_t key, LockFreeEntry& entry, PacketBuffer& payload) const;
+  void insertLockFree(uint32_t key, const boost::optional<Netmask>& subnet, uint16_t queryFlags, bool dnssecOK, const DNSName& qname, uint16_t qtype, uint16_t qclass, const PacketBuffer& response, bool receivedOverUDP, time_t now, time_t newValidity);
+  bool lockFreeEntryMatches(const LockFreeEntry& entry, const uint8_t* qnameWire, uint16_t queryFlags, std::string_view qname, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const boost::optional<Netmask>& subnet) const;
+  template <typename T>
+  size_t removeLockFreeEntries(T predicate, size_t upTo);
+  void visitLockFreeEntries(const std::function<void(uint32_t key, const CacheValue& value)>& visitor) const;
+  static CacheValue lockFreeEntryToCacheValue(const LockFreeEntry& entry, const PacketBuffer& payload);
 
   std::vector<CacheShard> d_shards;
+  std::unique_ptr<LockFreeSlot[]> d_lockFreeSlots{nullptr};
+  std::unique_ptr<std::atomic<uint64_t>[]> d_lockFreeTags{nullptr};
+  std::unique_ptr<std::atomic<uint64_t>[]> d_lockFreeData{nullptr};
   std::unordered_set<uint16_t> d_optionsToSkip{EDNSOptionCode::COOKIE};
 
   pdns::stat_t d_deferredLookups{0};
@@ -139,9 +253,19 @@ private:
   pdns::stat_t d_lookupCollisions{0};
   pdns::stat_t d_ttlTooShorts{0};
   pdns::stat_t d_cleanupCount{0};
+  std::atomic<uint64_t> d_lockFreeEntriesCount{0};
+  std::atomic<bool> d_dumpInProgress{false};
+  /* the sum of the d_entriesCount of all shards, so that the lock-free engine can tell whether
+     the shards hold anything without looking at each of them */
+  std::atomic<uint64_t> d_shardedEntriesCount{0};
 
   const size_t d_maxEntries;
   size_t d_maximumEntrySize{4096};
+  size_t d_collapsingMaxWaiting{0};
+  uint32_t d_collapsingTimeout{1000};
+  size_t d_lockFreeEntrySize{0};
+  size_t d_lockFreeEntryWords{0};
+  size_t d_lockFreeBucketsCount{0};
   const uint32_t d_shardCount;
   const uint32_t d_maxTTL;
   const uint32_t d_tempFailureTTL;
@@ -515,8 +515,8 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"DelayResponseAction", true, "milliseconds", "delay the response by the specified amount of milliseconds (UDP-only)"},
     {"delta", true, "", "shows all commands entered that changed the configuration"},
     {"DNSSECRule", true, "", "matches queries with the DO bit set"},
-    {"DnstapLogAction", true, "identity, FrameStreamLogger [, alterFunction]", "send the contents of this query to a FrameStreamLogger or RemoteLogger as dnstap. `alterFunction` is a callback, receiving a DNSQuestion and a DnstapMessage, that can be used to modify the dnstap message"},
-    {"DnstapLogResponseAction", true, "identity, FrameStreamLogger [, alterFunction]", "send the contents of this response to a remote or FrameStreamLogger or RemoteLogger as dnstap. `alterFunction` is a callback, receiving a DNSResponse and a DnstapMessage, that can be used to modify the dnstap message"},
+    {"DnstapLogAction", true, "identity, FrameStreamLogger [, alterFunction [, options]]", "send the contents of this query to a FrameStreamLogger or RemoteLogger as dnstap. `alterFunction` is a callback, receiving a DNSQuestion and a DnstapMessage, that can be used to modify the dnstap message"},
+    {"DnstapLogResponseAction", true, "identity, FrameStreamLogger [, alterFunction [, options]]", "send the contents of this response to a remote or FrameStreamLogger or RemoteLogger as dnstap. `alterFunction` is a callback, receiving a DNSResponse and a DnstapMessage, that can be used to modify the dnstap message"},
     {"DropAction", true, "", "drop these packets"},
     {"DropResponseAction", true, "", "drop these packets"},
     {"DSTPortRule", true, "port", "matches questions received to the destination port specified"},
@@ -551,6 +551,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"getDOH3FrontendCount", true, "", "returns the number of DoH3 listeners"},
     {"getDOQFrontend", true, "n", "returns the DoQ frontend with index n"},
     {"getDOQFrontendCount", true, "", "returns the number of DoQ listeners"},
+    {"getHeavyHitters", true, "[top]", "return the `top` heaviest clients, query name suffixes and query types as estimated by the heavy hitters sketches"},
     {"getListOfAddressesOfNetworkInterface", true, "itf", "returns the list of addresses configured on a given network interface, as strings"},
     {"getListOfNetworkInterfaces", true, "", "returns the list of network interfaces present on the system, as strings"},
     {"getListOfRangesOfNetworkInterface", true, "itf", "returns the list of network ranges configured on a given network interface, as strings"},
@@ -661,6 +662,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"NotRule", true, "selector", "Matches the traffic if the selector rule does not match"},
     {"OpcodeRule", true, "code", "Matches queries with opcode code. code can be directly specified as an integer, or one of the built-in DNSOpcodes"},
     {"OrRule", true, "selectors", "Matches the traffic if one or more of the the selectors rules does match"},
+    {"p2cPeakEWMA", false, "", "Pick two servers at random and send traffic to the one with the lowest recent peak latency multiplied by its number of outstanding queries"},
     {"PoolAction", true, "poolname [, stop]", "set the packet into the specified pool"},
     {"PoolAvailableRule", true, "poolname", "Check whether a pool has any servers available to handle queries"},
     {"PoolOutstandingRule", true, "poolname, limit", "Check whether a pool has outstanding queries above limit"},
@@ -717,6 +719,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"setECSOverride", true, "bool", "whether to override an existing EDNS Client Subnet value in the query"},
     {"setECSSourcePrefixV4", true, "prefix-length", "the EDNS Client Subnet prefix-length used for IPv4 queries"},
     {"setECSSourcePrefixV6", true, "prefix-length", "the EDNS Client Subnet prefix-length used for IPv6 queries"},
+    {"setHeavyHittersTracking", true, "[{window=60, width=2048, depth=4, capacity=100, shards=10, ipv4Mask=32, ipv6Mask=128, suffixLabels=2}]", "enable the tracking of the heaviest clients, query name suffixes and query types using fixed-size sketches"},
     {"setKey", true, "key", "set access key to that key"},
     {"setLocal", true, R"(addr [, {doTCP=true, reusePort=false, tcpFastOpenQueueSize=0, interface="", cpus={}}])", "reset the list of addresses we listen on to this address"},
     {"setMaxCachedDoHConnectionsPerDownstream", true, "max", "Set the maximum number of inactive DoH connections to a backend cached by each worker DoH thread"},
@@ -729,6 +732,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"setMaxUDPOutstanding", true, "n", "set the maximum number of outstanding UDP queries to a given backend server. This can only be set at configuration time and defaults to 65535"},
     {"setMetric", true, "name, value", "Set the value of a custom metric to the supplied value"},
     {"setPayloadSizeOnSelfGeneratedAnswers", true, "payloadSize", "set the UDP payload size advertised via EDNS on self-generated responses"},
+    {"setPeakEWMADecayTime", true, "milliseconds", "Set the time after which the latency measured for a backend by the p2cPeakEWMA policy has decayed to 1/e of its value"},
     {"setPoolServerPolicy", true, "policy, pool", "set the server selection policy for this pool to that policy"},
     {"setPoolServerPolicyLua", true, "name, function, pool", "set the server selection policy for this pool to one named 'name' and provided by 'function'"},
     {"setPoolServerPolicyLuaFFI", true, "name, function, pool", "set the server selection policy for this pool to one named 'name' and provided by 'function'"},
@@ -740,7 +744,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"setQueryCountFilter", true, "func", "filter queries that would be counted, where `func` is a function with parameter `dq` which decides whether a query should and how it should be counted"},
     {"SetReducedTTLResponseAction", true, "percentage", "Reduce the TTL of records in a response to a given percentage"},
     {"setRingBuffersLockRetries", true, "n", "set the number of attempts to get a non-blocking lock to a ringbuffer shard before blocking"},
-    {"setRingBuffersOptions", true, "{ lockRetries=int, recordQueries=true, recordResponses=true }", "set ringbuffer options"},
+    {"setRingBuffersOptions", true, "{ lockRetries=int, recordQueries=true, recordResponses=true, lockFree=false }", "set ringbuffer options"},
     {"setRingBuffersSize", true, "n [, numberOfShards]", "set the capacity of the ringbuffers used for live traffic inspection to `n`, and optionally the number of shards to use to `numberOfShards`"},
     {"setRoundRobinFailOnNoServer", true, "value", "By default the roundrobin load-balancing policy will still try to select a backend even if all backends are currently down. Setting this to true will make the policy fail and return that no server is available instead"},
     {"setRules", true, "list of rules", "replace the current rules with the supplied list of pairs of DNS Rules and DNS Actions (see `newRuleAction()`)"},
@@ -757,7 +761,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"setTCPDownstreamCleanupInterval", true, "interval", "minimum interval in seconds between two cleanups of the idle TCP downstream connections"},
     {"setTCPFastOpenKey", true, "string", "TCP Fast Open Key"},
     {"setTCPDownstreamMaxIdleTime", true, "time", "Maximum time in seconds that a downstream TCP connection to a backend might stay idle"},
-    {"setTCPInternalPipeBufferSize", true, "size", "Set the size in bytes of the internal buffer of the pipes used internally to distribute connections to TCP (and DoT) workers threads"},
+    {"setTCPInternalPipeBufferSize", true, "size", "Set the size in bytes of the internal buffer of the queues used internally to distribute connections to TCP (and DoT) workers threads"},
     {"setTCPRecvTimeout", true, "n", "set the read timeout on TCP connections from the client, in seconds"},
     {"setTCPSendTimeout", true, "n", "set the write timeout on TCP connections from the client, in seconds"},
     {"setUDPMultipleMessagesVectorSize", true, "n", "set the size of the vector passed to recvmmsg() to receive UDP messages. Default to 1 which means that the feature is disabled and recvmsg() is used instead"},
@@ -780,6 +784,7 @@ const std::vector<ConsoleKeyword> g_consoleKeywords
     {"showDOHResponseCodes", true, "", "show the HTTP response code statistics for the DoH frontends"},
     {"showDOQFrontends", true, "", "list all the available DOQ frontends"},
     {"showDynBlocks", true, "", "show dynamic blocks in force"},
+    {"showHeavyHitters", true, "[top]", "show the `top` heaviest clients, query name suffixes and query types as estimated by the heavy hitters sketches"},
     {"showPools", true, "", "show the available pools"},
     {"showPoolServerPolicy", true, "pool", "show server selection policy for this pool"},
     {"showResponseLatency", true, "", "show a plot of the response time latency distribution"},
@@ -13,19 +13,26 @@ void DynBlockRulesGroup::apply(const timespec& now)
   counts_t counts;
   StatNode statNodeRoot;
 
-  size_t entriesCount = 0;
-  if (hasQueryRules()) {
-    entriesCount += g_rings.getNumberOfQueryEntries();
-  }
-  if (hasResponseRules()) {
-    entriesCount += g_rings.getNumberOfResponseEntries();
+  updateBPFRateLimits();
+
+  if (d_incremental) {
+    processIncrementalCounters(counts, statNodeRoot, now);
   }
-  counts.reserve(entriesCount);
+  else {
+    size_t entriesCount = 0;
+    if (hasQueryRules()) {
+      entriesCount += g_rings.getNumberOfQueryEntries();
+    }
+    if (hasResponseRules()) {
+      entriesCount += g_rings.getNumberOfResponseEntries();
+    }
+    counts.reserve(entriesCount);
 
-  processQueryRules(counts, now);
-  processResponseRules(counts, statNodeRoot, now);
+    processQueryRules(counts, now);
+    processResponseRules(counts, statNodeRoot, now);
+  }
 
-  if (counts.empty() && statNodeRoot.empty()) {
+  if (counts.empty() && statNodeRoot.empty() && !d_heavyHittersRule.isEnabled()) {
     return;
   }
 
@@ -114,6 +121,8 @@ void DynBlockRulesGroup::apply(const timespec& now)
     }
   }
 
+  processHeavyHitters(blocks, now, updated);
+
   if (updated && blocks) {
     g_dynblockNMG.setState(std::move(*blocks));
   }
@@ -121,6 +130,115 @@ void DynBlockRulesGroup::apply(const timespec& now)
   applySMT(now, statNodeRoot);
 }
 
+static std::optional<BPFFilter::MatchAction> getBPFRateLimitAction(DNSAction::Action action)
+{
+  if (action == DNSAction::Action::None) {
+    action = g_dynBlockAction;
+  }
+  if (action == DNSAction::Action::Drop) {
+    return BPFFilter::MatchAction::Drop;
+  }
+  if (action == DNSAction::Action::Truncate) {
+    return BPFFilter::MatchAction::Truncate;
+  }
+  return std::nullopt;
+}
+
+void DynBlockRulesGroup::setBPFRateLimits(std::shared_ptr<BPFFilter> filter, const BPFRateLimitOptions& options)
+{
+  if (!filter || !filter->supportsRateLimiting()) {
+    throw std::runtime_error("In-kernel rate-limiting requires an external eBPF filter with a pinned rate-limiting configuration map");
+  }
+  if (options.d_suffixRate > 0 && options.d_suffixLabels == 0) {
+    throw std::runtime_error("The number of labels of the eBPF rate-limiting suffixes should be larger than 0");
+  }
+  d_bpfFilter = std::move(filter);
+  d_bpfOptions = options;
+  d_bpfSources.reset();
+  d_bpfSuffixes.reset();
+  updateBPFRateLimits();
+}
+
+void DynBlockRulesGroup::updateBPFRateLimits()
+{
+  if (!d_bpfFilter) {
+    return;
+  }
+
+  BPFFilter::RateLimitSettings sources;
+  if (d_queryRateRule.isEnabled()) {
+    if (auto action = getBPFRateLimitAction(d_queryRateRule.d_action)) {
+      sources.d_rate = d_queryRateRule.d_rate;
+      sources.d_burst = static_cast<uint64_t>(d_queryRateRule.d_rate) * std::max(d_queryRateRule.d_seconds, 1U);
+      sources.d_v4Mask = d_v4Mask;
+      sources.d_v6Mask = d_v6Mask;
+      sources.d_action = *action;
+    }
+  }
+
+  BPFFilter::RateLimitSettings suffixes;
+  if (d_bpfOptions.d_suffixRate > 0) {
+    if (auto action = getBPFRateLimitAction(d_bpfOptions.d_suffixAction)) {
+      suffixes.d_rate = d_bpfOptions.d_suffixRate;
+      suffixes.d_burst = static_cast<uint64_t>(d_bpfOptions.d_suffixRate) * std::max(d_bpfOptions.d_suffixSeconds, 1U);
+      suffixes.d_suffixLabels = d_bpfOptions.d_suffixLabels;
+      suffixes.d_action = *action;
+    }
+  }
+
+  const auto update = [this](BPFFilter::RateLimitStage stage, const BPFFilter::RateLimitSettings& settings, std::optional<BPFFilter::RateLimitSettings>& current) {
+    if (current && *current == settings) {
+      return;
+    }
+    /* do not retry on every run if the update fails */
+    current = settings;
+    try {
+      d_bpfFilter->setRateLimit(stage, settings);
+      if (!d_beQuiet) {
+        infolog("Updated the %s eBPF rate-limiting stage to %d queries per second with a burst of %d", stage == BPFFilter::RateLimitStage::Sources ? "sources" : "suffixes", settings.d_rate, settings.d_burst);
+      }
+    }
+    catch (const std::exception& exp) {
+      warnlog("Error updating the eBPF rate-limiting: %s", exp.what());
+    }
+  };
+
+  update(BPFFilter::RateLimitStage::Sources, sources, d_bpfSources);
+  update(BPFFilter::RateLimitStage::Suffixes, suffixes, d_bpfSuffixes);
+}
+
+void DynBlockRulesGroup::setHeavyHittersRate(std::shared_ptr<dnsdist::sketches::HeavyHittersTracker> tracker, DynBlockRule&& rule)
+{
+  if (!tracker) {
+    throw std::runtime_error("Heavy hitters tracking has to be enabled before a heavy hitters rule can be set");
+  }
+  /* the rate is always computed over the window of the tracker */
+  rule.d_seconds = tracker->getClients().getWindow();
+  d_heavyHitters = std::move(tracker);
+  d_heavyHittersRule = std::move(rule);
+}
+
+void DynBlockRulesGroup::processHeavyHitters(boost::optional<NetmaskTree<DynBlock, AddressAndPortRange>>& blocks, const struct timespec& now, bool& updated)
+{
+  if (!d_heavyHittersRule.isEnabled() || !d_heavyHitters) {
+    return;
+  }
+
+  /* we only look at the clients present in the SpaceSaving lists, which are guaranteed to contain
+     every client responsible for more than 1/capacity of the queries seen by a shard */
+  const auto top = d_heavyHitters->getClients().getTop(std::numeric_limits<size_t>::max(), now.tv_sec);
+  for (const auto& entry : top) {
+    const auto count = static_cast<unsigned int>(std::min(entry.d_count, static_cast<uint64_t>(std::numeric_limits<unsigned int>::max())));
+    if (d_heavyHittersRule.warningRateExceeded(count, now)) {
+      handleWarning(blocks, now, entry.d_key, d_heavyHittersRule, updated);
+    }
+
+    if (d_heavyHittersRule.rateExceeded(count, now)) {
+      addBlock(blocks, now, entry.d_key, d_heavyHittersRule, updated);
+    }
+  }
+}
+
 void DynBlockRulesGroup::applySMT(const struct timespec& now, StatNode& statNodeRoot)
 {
   if (statNodeRoot.empty()) {
@@ -179,25 +297,25 @@ void DynBlockRulesGroup::applySMT(const struct timespec& now, StatNode& statNode
   }
 }
 
-bool DynBlockRulesGroup::checkIfQueryTypeMatches(const Rings::Query& query)
+bool DynBlockRulesGroup::checkIfQueryTypeMatches(uint16_t qtype, const struct timespec& when)
 {
-  auto rule = d_qtypeRules.find(query.qtype);
+  auto rule = d_qtypeRules.find(qtype);
   if (rule == d_qtypeRules.end()) {
     return false;
   }
 
-  return rule->second.matches(query.when);
+  return rule->second.matches(when);
 }
 
-bool DynBlockRulesGroup::checkIfResponseCodeMatches(const Rings::Response& response)
+bool DynBlockRulesGroup::checkIfResponseCodeMatches(uint8_t rcode, const struct timespec& when)
 {
-  auto rule = d_rcodeRules.find(response.dh.rcode);
-  if (rule != d_rcodeRules.end() && rule->second.matches(response.when)) {
+  auto rule = d_rcodeRules.find(rcode);
+  if (rule != d_rcodeRules.end() && rule->second.matches(when)) {
     return true;
   }
 
-  auto ratio = d_rcodeRatioRules.find(response.dh.rcode);
-  return ratio != d_rcodeRatioRules.end() && ratio->second.matches(response.when);
+  auto ratio = d_rcodeRatioRules.find(rcode);
+  return ratio != d_rcodeRatioRules.end() && ratio->second.matches(when);
 }
 
 /* return the actual action that will be taken by that block:
@@ -371,122 +489,496 @@ void DynBlockRulesGroup::addOrRefreshBlockSMT(SuffixMatchTree<DynBlock>& blocks,
   }
 }
 
+/* In incremental mode, rules without a period, or with a period longer than the one
+   covered by the counters, are evaluated over the whole window. */
+static void setCutOff(DynBlockRulesGroup::DynBlockRule& rule, const struct timespec& now, const std::shared_ptr<DynBlockRulesGroup::IncrementalCounters>& incremental)
+{
+  rule.d_cutOff = rule.d_minTime = now;
+  if (incremental && (rule.d_seconds == 0 || rule.d_seconds > incremental->getWindow())) {
+    rule.d_cutOff.tv_sec -= incremental->getWindow();
+    rule.d_minTime = rule.d_cutOff;
+  }
+  else {
+    rule.d_cutOff.tv_sec -= rule.d_seconds;
+  }
+}
+
+void DynBlockRulesGroup::setQueryCutOffs(const struct timespec& now)
+{
+  setCutOff(d_queryRateRule, now, d_incremental);
+  for (auto& rule : d_qtypeRules) {
+    setCutOff(rule.second, now, d_incremental);
+  }
+}
+
+struct timespec DynBlockRulesGroup::setResponseCutOffs(const struct timespec& now)
+{
+  struct timespec responseCutOff = now;
+  const auto update = [this, &now, &responseCutOff](DynBlockRule& rule) {
+    setCutOff(rule, now, d_incremental);
+    if (rule.d_cutOff < responseCutOff) {
+      responseCutOff = rule.d_cutOff;
+    }
+  };
+
+  update(d_respRateRule);
+  update(d_suffixMatchRule);
+  update(d_respCacheMissRatioRule);
+  for (auto& rule : d_rcodeRules) {
+    update(rule.second);
+  }
+  for (auto& rule : d_rcodeRatioRules) {
+    update(rule.second);
+  }
+  return responseCutOff;
+}
+
+template <typename C>
+void DynBlockRulesGroup::countQuery(const C& getCounts, const struct timespec& when, uint16_t qtype)
+{
+  bool qRateMatches = d_queryRateRule.matches(when);
+  bool typeRuleMatches = checkIfQueryTypeMatches(qtype, when);
+
+  if (qRateMatches || typeRuleMatches) {
+    Counts& entry = getCounts();
+    if (qRateMatches) {
+      ++entry.queries;
+    }
+    if (typeRuleMatches) {
+      ++entry.d_qtypeCounts[qtype];
+    }
+  }
+}
+
+template <typename C>
+void DynBlockRulesGroup::countResponse(const C& getCounts, const struct timespec& when, uint8_t rcode, unsigned int size, bool hit)
+{
+  Counts& entry = getCounts();
+  ++entry.responses;
+
+  bool respRateMatches = d_respRateRule.matches(when);
+  bool rcodeRuleMatches = checkIfResponseCodeMatches(rcode, when);
+  bool respCacheMissRatioRuleMatches = d_respCacheMissRatioRule.matches(when);
+
+  if (respRateMatches) {
+    entry.respBytes += size;
+  }
+  if (rcodeRuleMatches) {
+    ++entry.d_rcodeCounts[rcode];
+  }
+  if (respCacheMissRatioRuleMatches && !hit) {
+    ++entry.cacheMisses;
+  }
+}
+
 void DynBlockRulesGroup::processQueryRules(counts_t& counts, const struct timespec& now)
 {
   if (!hasQueryRules()) {
     return;
   }
 
-  d_queryRateRule.d_cutOff = d_queryRateRule.d_minTime = now;
-  d_queryRateRule.d_cutOff.tv_sec -= d_queryRateRule.d_seconds;
+  setQueryCutOffs(now);
 
-  for (auto& rule : d_qtypeRules) {
-    rule.second.d_cutOff = rule.second.d_minTime = now;
-    rule.second.d_cutOff.tv_sec -= rule.second.d_seconds;
+  g_rings.visitQueries([this, &counts, &now](const Rings::Query& ringEntry) {
+    if (now < ringEntry.when) {
+      return;
+    }
+
+    countQuery([this, &counts, &ringEntry]() -> Counts& {
+      return counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
+    },
+               ringEntry.when, ringEntry.qtype);
+  },
+                       false);
+}
+
+void DynBlockRulesGroup::processResponseRules(counts_t& counts, StatNode& root, const struct timespec& now)
+{
+  if (!hasResponseRules() && !hasSuffixMatchRules()) {
+    return;
+  }
+
+  const auto responseCutOff = setResponseCutOffs(now);
+
+  g_rings.visitResponses([this, &counts, &root, &now, &responseCutOff](const Rings::Response& ringEntry) {
+    if (now < ringEntry.when) {
+      return;
+    }
+
+    if (ringEntry.when < responseCutOff) {
+      return;
+    }
+
+    const bool hit = ringEntry.isACacheHit();
+    countResponse([this, &counts, &ringEntry]() -> Counts& {
+      return counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
+    },
+                  ringEntry.when, ringEntry.dh.rcode, ringEntry.size, hit);
+
+    if (d_suffixMatchRule.matches(ringEntry.when)) {
+      root.submit(ringEntry.name, ((ringEntry.dh.rcode == 0 && ringEntry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : ringEntry.dh.rcode), ringEntry.size, hit, boost::none);
+    }
+  },
+                         /* the names are only needed by the suffix match rule */
+                         hasSuffixMatchRules());
+}
+
+void DynBlockRulesGroup::enableIncrementalEvaluation(Rings& rings, std::optional<unsigned int> windowSeconds)
+{
+  if (d_incremental) {
+    throw std::runtime_error("The incremental evaluation has already been enabled for this dynamic block rules group");
   }
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto queryRing = shard->queryRing.lock();
-    for (const auto& ringEntry : *queryRing) {
-      if (now < ringEntry.when) {
-        continue;
+  if (!windowSeconds) {
+    unsigned int longest = 0;
+    const auto update = [&longest](const DynBlockRule& rule) {
+      if (rule.isEnabled()) {
+        longest = std::max(longest, rule.d_seconds);
       }
+    };
+    update(d_queryRateRule);
+    update(d_respRateRule);
+    update(d_suffixMatchRule);
+    update(d_respCacheMissRatioRule);
+    for (const auto& rule : d_rcodeRules) {
+      update(rule.second);
+    }
+    for (const auto& rule : d_rcodeRatioRules) {
+      update(rule.second);
+    }
+    for (const auto& rule : d_qtypeRules) {
+      update(rule.second);
+    }
+    windowSeconds = longest > 0 ? longest : 10;
+  }
+
+  if (*windowSeconds == 0) {
+    throw std::runtime_error("The window of the incremental evaluation of a dynamic block rules group should be at least one second");
+  }
+
+  auto counters = std::make_shared<IncrementalCounters>(rings, *windowSeconds);
+  counters->setMasks(d_v4Mask, d_v6Mask, d_portMask);
+  d_incremental = std::move(counters);
+  updateIncrementalThresholds();
+}
 
-      bool qRateMatches = d_queryRateRule.matches(ringEntry.when);
-      bool typeRuleMatches = checkIfQueryTypeMatches(ringEntry);
+void DynBlockRulesGroup::updateIncrementalThresholds()
+{
+  if (!d_incremental) {
+    return;
+  }
+
+  const auto window = d_incremental->getWindow();
+  IncrementalCounters::Thresholds thresholds;
+  const auto updateCount = [window](uint64_t& threshold, const DynBlockRule& rule) {
+    if (!rule.isEnabled()) {
+      return;
+    }
+    uint64_t seconds = (rule.d_seconds == 0 || rule.d_seconds > window) ? window : rule.d_seconds;
+    uint64_t rate = (rule.d_warningRate > 0 && rule.d_warningRate < rule.d_rate) ? rule.d_warningRate : rule.d_rate;
+    threshold = std::min(threshold, seconds * rate);
+  };
+  const auto updateResponses = [&thresholds](const DynBlockRatioRule& rule) {
+    if (rule.isEnabled()) {
+      thresholds.d_responses = std::min(thresholds.d_responses, static_cast<uint64_t>(rule.d_minimumNumberOfResponses));
+    }
+  };
+
+  updateCount(thresholds.d_count, d_queryRateRule);
+  for (const auto& rule : d_qtypeRules) {
+    updateCount(thresholds.d_count, rule.second);
+  }
+  for (const auto& rule : d_rcodeRules) {
+    updateCount(thresholds.d_count, rule.second);
+  }
+  updateCount(thresholds.d_respBytes, d_respRateRule);
+  for (const auto& rule : d_rcodeRatioRules) {
+    updateResponses(rule.second);
+  }
+  updateResponses(d_respCacheMissRatioRule);
 
-      if (qRateMatches || typeRuleMatches) {
-        auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
-        if (qRateMatches) {
-          ++entry.queries;
+  thresholds.d_trackQueries = hasQueryRules();
+  thresholds.d_trackResponses = hasResponseRules() || hasSuffixMatchRules();
+  thresholds.d_trackSuffixes = hasSuffixMatchRules();
+  d_incremental->setThresholds(thresholds);
+}
+
+void DynBlockRulesGroup::processIncrementalCounters(counts_t& counts, StatNode& root, const struct timespec& now)
+{
+  d_incremental->update(now);
+
+  if (!hasRules() && !hasSuffixMatchRules()) {
+    return;
+  }
+
+  setQueryCutOffs(now);
+  const auto responseCutOff = setResponseCutOffs(now);
+
+  d_incremental->visitCandidates([this, &counts, &now, &responseCutOff](const AddressAndPortRange& requestor, const IncrementalCounters::Client& client) {
+    Counts* entry = nullptr;
+    const auto getCounts = [&counts, &entry, &requestor]() -> Counts& {
+      if (entry == nullptr) {
+        entry = &counts[requestor];
+      }
+      return *entry;
+    };
+
+    if (hasQueryRules()) {
+      for (const auto* query : client.d_queries) {
+        if (!(now < query->d_when)) {
+          countQuery(getCounts, query->d_when, query->d_qtype);
         }
-        if (typeRuleMatches) {
-          ++entry.d_qtypeCounts[ringEntry.qtype];
+      }
+    }
+
+    if (hasResponseRules()) {
+      for (const auto* response : client.d_responses) {
+        if (!(now < response->d_when) && !(response->d_when < responseCutOff)) {
+          countResponse(getCounts, response->d_when, response->d_rcode, response->d_size, response->d_hit);
         }
       }
     }
+  });
+
+  if (hasSuffixMatchRules()) {
+    d_incremental->visitResponses([this, &root, &now, &responseCutOff](const IncrementalCounters::ResponseEntry& response) {
+      if (now < response.d_when || response.d_when < responseCutOff || !d_suffixMatchRule.matches(response.d_when)) {
+        return;
+      }
+      root.submit(response.d_name, ((response.d_rcode == 0 && response.d_usec == std::numeric_limits<unsigned int>::max()) ? -1 : response.d_rcode), response.d_size, response.d_hit, boost::none);
+    });
   }
 }
 
-void DynBlockRulesGroup::processResponseRules(counts_t& counts, StatNode& root, const struct timespec& now)
+DynBlockRulesGroup::IncrementalCounters::IncrementalCounters(const Rings& rings, unsigned int windowSeconds) :
+  d_rings(rings), d_window(windowSeconds)
 {
-  if (!hasResponseRules() && !hasSuffixMatchRules()) {
-    return;
+}
+
+void DynBlockRulesGroup::IncrementalCounters::setMasks(uint8_t v4, uint8_t v6, uint8_t port)
+{
+  auto state = d_state.lock();
+  state->d_v4Mask = v4;
+  state->d_v6Mask = v6;
+  state->d_portMask = port;
+}
+
+void DynBlockRulesGroup::IncrementalCounters::setThresholds(const Thresholds& thresholds)
+{
+  d_state.lock()->d_thresholds = thresholds;
+}
+
+static void incrementIncrementalCount(std::vector<std::pair<uint32_t, uint32_t>>& counts, uint32_t key)
+{
+  for (auto& entry : counts) {
+    if (entry.first == key) {
+      ++entry.second;
+      return;
+    }
   }
+  counts.emplace_back(key, 1);
+}
 
-  struct timespec responseCutOff = now;
+static void decrementIncrementalCount(std::vector<std::pair<uint32_t, uint32_t>>& counts, uint32_t key)
+{
+  for (auto entryIt = counts.begin(); entryIt != counts.end(); ++entryIt) {
+    if (entryIt->first == key) {
+      if (--entryIt->second == 0) {
+        counts.erase(entryIt);
+      }
+      return;
+    }
+  }
+}
 
-  d_respRateRule.d_cutOff = d_respRateRule.d_minTime = now;
-  d_respRateRule.d_cutOff.tv_sec -= d_respRateRule.d_seconds;
-  if (d_respRateRule.d_cutOff < responseCutOff) {
-    responseCutOff = d_respRateRule.d_cutOff;
+/* entries are removed in the order they were fetched in, so the one we are looking for is usually close to the front */
+template <typename T>
+static void removeIncrementalEntry(std::deque<const T*>& entries, const T* entry)
+{
+  auto entryIt = std::find(entries.begin(), entries.end(), entry);
+  if (entryIt != entries.end()) {
+    entries.erase(entryIt);
   }
+}
+
+DynBlockRulesGroup::IncrementalCounters::ClientEntry& DynBlockRulesGroup::IncrementalCounters::getClient(State& state, const ComboAddress& requestor)
+{
+  const AddressAndPortRange key(requestor, requestor.isIPv4() ? state.d_v4Mask : state.d_v6Mask, state.d_portMask);
+  return *state.d_clients.try_emplace(key).first;
+}
 
-  d_suffixMatchRule.d_cutOff = d_suffixMatchRule.d_minTime = now;
-  d_suffixMatchRule.d_cutOff.tv_sec -= d_suffixMatchRule.d_seconds;
-  if (d_suffixMatchRule.d_cutOff < responseCutOff) {
-    responseCutOff = d_suffixMatchRule.d_cutOff;
+void DynBlockRulesGroup::IncrementalCounters::removeClientIfEmpty(State& state, ClientEntry& client)
+{
+  if (!client.second.d_queries.empty() || !client.second.d_responses.empty()) {
+    return;
   }
+  if (client.second.d_candidate) {
+    state.d_candidates.erase(client.first);
+  }
+  state.d_clients.erase(state.d_clients.find(client.first));
+}
 
-  d_respCacheMissRatioRule.d_cutOff = d_respCacheMissRatioRule.d_minTime = now;
-  d_respCacheMissRatioRule.d_cutOff.tv_sec -= d_respCacheMissRatioRule.d_seconds;
-  if (d_respCacheMissRatioRule.d_cutOff < responseCutOff) {
-    responseCutOff = d_respCacheMissRatioRule.d_cutOff;
+void DynBlockRulesGroup::IncrementalCounters::markAsCandidateIfNeeded(State& state, ClientEntry& client)
+{
+  if (!client.second.d_candidate && isAboveThresholds(client.second, state.d_thresholds)) {
+    client.second.d_candidate = true;
+    state.d_candidates.insert(client.first);
   }
+}
 
-  for (auto& rule : d_rcodeRules) {
-    rule.second.d_cutOff = rule.second.d_minTime = now;
-    rule.second.d_cutOff.tv_sec -= rule.second.d_seconds;
-    if (rule.second.d_cutOff < responseCutOff) {
-      responseCutOff = rule.second.d_cutOff;
+void DynBlockRulesGroup::IncrementalCounters::removeQuery(State& state, Shard& shard)
+{
+  const auto& query = shard.d_queries.front();
+  auto& client = *query.d_client;
+  removeIncrementalEntry(client.second.d_queries, &query);
+  decrementIncrementalCount(client.second.d_counts, query.d_qtype);
+  shard.d_queries.pop_front();
+  removeClientIfEmpty(state, client);
+}
+
+void DynBlockRulesGroup::IncrementalCounters::removeResponse(State& state, Shard& shard)
+{
+  const auto& response = shard.d_responses.front();
+  auto& client = *response.d_client;
+  removeIncrementalEntry(client.second.d_responses, &response);
+  decrementIncrementalCount(client.second.d_counts, s_rcodeKey + response.d_rcode);
+  client.second.d_respBytes -= response.d_size;
+  shard.d_responses.pop_front();
+  removeClientIfEmpty(state, client);
+}
+
+void DynBlockRulesGroup::IncrementalCounters::fetchQueries(State& state, size_t shardIdx)
+{
+  auto& shard = state.d_shards.at(shardIdx);
+  const auto [oldest, next] = d_rings.visitQueriesFrom(shardIdx, shard.d_nextQuery, [this, &state, &shard](uint64_t position, const Rings::Query& ringEntry) {
+    auto& client = getClient(state, ringEntry.requestor);
+    shard.d_queries.push_back({ringEntry.when, position, &client, ringEntry.qtype});
+    client.second.d_queries.push_back(&shard.d_queries.back());
+    incrementIncrementalCount(client.second.d_counts, ringEntry.qtype);
+    markAsCandidateIfNeeded(state, client);
+    if (state.d_latest < ringEntry.when) {
+      state.d_latest = ringEntry.when;
     }
+  },
+                                                         false);
+  shard.d_nextQuery = next;
+
+  /* forget the entries that are no longer in the rings */
+  while (!shard.d_queries.empty() && shard.d_queries.front().d_position < oldest) {
+    removeQuery(state, shard);
   }
+}
 
-  for (auto& rule : d_rcodeRatioRules) {
-    rule.second.d_cutOff = rule.second.d_minTime = now;
-    rule.second.d_cutOff.tv_sec -= rule.second.d_seconds;
-    if (rule.second.d_cutOff < responseCutOff) {
-      responseCutOff = rule.second.d_cutOff;
+void DynBlockRulesGroup::IncrementalCounters::fetchResponses(State& state, size_t shardIdx)
+{
+  auto& shard = state.d_shards.at(shardIdx);
+  const bool withNames = state.d_thresholds.d_trackSuffixes;
+  const auto [oldest, next] = d_rings.visitResponsesFrom(shardIdx, shard.d_nextResponse, [this, &state, &shard, withNames](uint64_t position, const Rings::Response& ringEntry) {
+    auto& client = getClient(state, ringEntry.requestor);
+    shard.d_responses.push_back({withNames ? ringEntry.name : DNSName(), ringEntry.when, position, &client, ringEntry.usec, ringEntry.size, static_cast<uint8_t>(ringEntry.dh.rcode), ringEntry.isACacheHit()});
+    client.second.d_responses.push_back(&shard.d_responses.back());
+    client.second.d_respBytes += ringEntry.size;
+    incrementIncrementalCount(client.second.d_counts, s_rcodeKey + ringEntry.dh.rcode);
+    markAsCandidateIfNeeded(state, client);
+    if (state.d_latest < ringEntry.when) {
+      state.d_latest = ringEntry.when;
     }
+  },
+                                                           withNames);
+  shard.d_nextResponse = next;
+
+  while (!shard.d_responses.empty() && shard.d_responses.front().d_position < oldest) {
+    removeResponse(state, shard);
   }
+}
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto responseRing = shard->respRing.lock();
-    for (const auto& ringEntry : *responseRing) {
-      if (now < ringEntry.when) {
-        continue;
-      }
+void DynBlockRulesGroup::IncrementalCounters::update(const struct timespec& now)
+{
+  auto state = d_state.lock();
+  if (state->d_generation != d_rings.getGeneration()) {
+    /* the rings have been initialized again, the positions we know are meaningless */
+    state->d_candidates.clear();
+    state->d_shards.clear();
+    state->d_clients.clear();
+    state->d_latest = {0, 0};
+    state->d_shards.resize(d_rings.getNumberOfShardsToVisit());
+    state->d_generation = d_rings.getGeneration();
+  }
+
+  for (size_t shardIdx = 0; shardIdx < state->d_shards.size(); shardIdx++) {
+    if (state->d_thresholds.d_trackQueries) {
+      fetchQueries(*state, shardIdx);
+    }
+    if (state->d_thresholds.d_trackResponses) {
+      fetchResponses(*state, shardIdx);
+    }
+  }
 
-      if (ringEntry.when < responseCutOff) {
-        continue;
-      }
+  /* and the ones that are older than the window. Entries are mostly inserted in order so we only look
+     at the oldest ones, and rules are matched against the exact time of every entry anyway */
+  auto cutOff = std::min(state->d_latest, now);
+  cutOff.tv_sec -= d_window;
+  for (auto& shard : state->d_shards) {
+    while (!shard.d_queries.empty() && shard.d_queries.front().d_when < cutOff) {
+      removeQuery(*state, shard);
+    }
+    while (!shard.d_responses.empty() && shard.d_responses.front().d_when < cutOff) {
+      removeResponse(*state, shard);
+    }
+  }
+}
 
-      auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
-      ++entry.responses;
+bool DynBlockRulesGroup::IncrementalCounters::isAboveThresholds(const Client& client, const Thresholds& thresholds)
+{
+  if (client.d_queries.size() > thresholds.d_count || client.d_respBytes > thresholds.d_respBytes || (!client.d_responses.empty() && client.d_responses.size() >= thresholds.d_responses)) {
+    return true;
+  }
+  return std::any_of(client.d_counts.begin(), client.d_counts.end(), [&thresholds](const std::pair<uint32_t, uint32_t>& total) { return total.second > thresholds.d_count; });
+}
 
-      bool respRateMatches = d_respRateRule.matches(ringEntry.when);
-      bool suffixMatchRuleMatches = d_suffixMatchRule.matches(ringEntry.when);
-      bool rcodeRuleMatches = checkIfResponseCodeMatches(ringEntry);
-      bool respCacheMissRatioRuleMatches = d_respCacheMissRatioRule.matches(ringEntry.when);
+void DynBlockRulesGroup::IncrementalCounters::visitCandidates(const std::function<void(const AddressAndPortRange&, const Client&)>& visitor)
+{
+  auto state = d_state.lock();
+  for (auto candidateIt = state->d_candidates.begin(); candidateIt != state->d_candidates.end();) {
+    auto clientIt = state->d_clients.find(*candidateIt);
+    if (clientIt == state->d_clients.end()) {
+      candidateIt = state->d_candidates.erase(candidateIt);
+      continue;
+    }
 
-      if (respRateMatches) {
-        entry.respBytes += ringEntry.size;
-      }
-      if (rcodeRuleMatches) {
-        ++entry.d_rcodeCounts[ringEntry.dh.rcode];
-      }
-      if (respCacheMissRatioRuleMatches && !ringEntry.isACacheHit()) {
-        ++entry.cacheMisses;
-      }
+    auto& client = clientIt->second;
+    visitor(clientIt->first, client);
 
-      if (suffixMatchRuleMatches) {
-        const bool hit = ringEntry.isACacheHit();
-        root.submit(ringEntry.name, ((ringEntry.dh.rcode == 0 && ringEntry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : ringEntry.dh.rcode), ringEntry.size, hit, boost::none);
-      }
+    if (!isAboveThresholds(client, state->d_thresholds)) {
+      client.d_candidate = false;
+      candidateIt = state->d_candidates.erase(candidateIt);
+    }
+    else {
+      ++candidateIt;
+    }
+  }
+}
+
+void DynBlockRulesGroup::IncrementalCounters::visitResponses(const std::function<void(const ResponseEntry&)>& visitor) const
+{
+  auto state = d_state.lock();
+  for (const auto& shard : state->d_shards) {
+    for (const auto& response : shard.d_responses) {
+      visitor(response);
     }
   }
 }
 
+size_t DynBlockRulesGroup::IncrementalCounters::getClientsCount() const
+{
+  return d_state.lock()->d_clients.size();
+}
+
+size_t DynBlockRulesGroup::IncrementalCounters::getCandidatesCount() const
+{
+  return d_state.lock()->d_candidates.size();
+}
+
 void DynBlockMaintenance::purgeExpired(const struct timespec& now)
 {
   // we need to increase the dynBlocked counter when removing
@@ -22,10 +22,13 @@
 #pragma once
 
 #ifndef DISABLE_DYNBLOCKS
+#include <deque>
 #include <unordered_set>
 
+#include "bpf-filter.hh"
 #include "dolog.hh"
 #include "dnsdist-rings.hh"
+#include "dnsdist-sketches.hh"
 #include "statnode.hh"
 
 extern "C"
@@ -150,39 +153,168 @@ private:
   using counts_t = std::unordered_map<AddressAndPortRange, Counts, AddressAndPortRange::hash>;
 
 public:
+  /* In incremental mode, instead of scanning the whole rings every time the rules are applied, the
+     entries inserted into each shard of the rings since the previous pass are fetched and kept, in a
+     compact form, for as long as they are still present in the rings and not older than the window.
+     Per-client totals are updated as entries come and go, and clients whose totals go above the lowest
+     threshold of the rules are remembered as candidates: applying the rules only looks at the entries
+     of these, with the exact same logic as the ring-based evaluation.
+     Nothing is done when entries are inserted into the rings, the work happens in the maintenance thread. */
+  class IncrementalCounters
+  {
+  public:
+    struct Client;
+    using ClientEntry = std::pair<const AddressAndPortRange, Client>;
+
+    struct QueryEntry
+    {
+      struct timespec d_when;
+      uint64_t d_position;
+      ClientEntry* d_client;
+      uint16_t d_qtype;
+    };
+
+    struct ResponseEntry
+    {
+      /* only set when the suffix match rule is enabled */
+      DNSName d_name;
+      struct timespec d_when;
+      uint64_t d_position;
+      ClientEntry* d_client;
+      unsigned int d_usec;
+      unsigned int d_size;
+      uint8_t d_rcode;
+      bool d_hit;
+    };
+
+    struct Client
+    {
+      /* the entries we still have for this client, and totals over them, used to decide whether it is a candidate */
+      std::deque<const QueryEntry*> d_queries;
+      std::deque<const ResponseEntry*> d_responses;
+      /* qtypes are stored as is, rcodes as s_rcodeKey + rcode */
+      std::vector<std::pair<uint32_t, uint32_t>> d_counts;
+      uint64_t d_respBytes{0};
+      bool d_candidate{false};
+    };
+
+    struct Thresholds
+    {
+      /* lowest number of queries, of queries of a given type or of responses with a given rcode
+         over the whole window that might trigger a rule */
+      uint64_t d_count{std::numeric_limits<uint64_t>::max()};
+      uint64_t d_respBytes{std::numeric_limits<uint64_t>::max()};
+      /* lowest number of responses that might trigger a ratio-based rule */
+      uint64_t d_responses{std::numeric_limits<uint64_t>::max()};
+      bool d_trackQueries{false};
+      bool d_trackResponses{false};
+      bool d_trackSuffixes{false};
+    };
+
+    static constexpr uint32_t s_rcodeKey{0x10000};
+
+    IncrementalCounters(const Rings& rings, unsigned int windowSeconds);
+
+    /* fetch the entries inserted into the rings since the last call, and forget the ones
+       that are no longer present in the rings or older than the window */
+    void update(const struct timespec& now);
+    void setThresholds(const Thresholds& thresholds);
+    void setMasks(uint8_t v4, uint8_t v6, uint8_t port);
+    unsigned int getWindow() const
+    {
+      return d_window;
+    }
+
+    /* call the visitor for every candidate, forgetting the ones that are no longer above the thresholds */
+    void visitCandidates(const std::function<void(const AddressAndPortRange&, const Client&)>& visitor);
+    void visitResponses(const std::function<void(const ResponseEntry&)>& visitor) const;
+    size_t getClientsCount() const;
+    size_t getCandidatesCount() const;
+
+  private:
+    struct Shard
+    {
+      /* ordered by position */
+      std::deque<QueryEntry> d_queries;
+      std::deque<ResponseEntry> d_responses;
+      uint64_t d_nextQuery{0};
+      uint64_t d_nextResponse{0};
+    };
+
+    struct State
+    {
+      std::unordered_map<AddressAndPortRange, Client, AddressAndPortRange::hash> d_clients;
+      std::unordered_set<AddressAndPortRange, AddressAndPortRange::hash> d_candidates;
+      std::vector<Shard> d_shards;
+      Thresholds d_thresholds;
+      /* the most recent time we have seen an entry for, which drives the expiration */
+      struct timespec d_latest
+      {
+        0, 0
+      };
+      uint64_t d_generation{0};
+      uint8_t d_v4Mask{32};
+      uint8_t d_v6Mask{128};
+      uint8_t d_portMask{0};
+    };
+
+    static ClientEntry& getClient(State& state, const ComboAddress& requestor);
+    static void removeClientIfEmpty(State& state, ClientEntry& client);
+    static void markAsCandidateIfNeeded(State& state, ClientEntry& client);
+    static bool isAboveThresholds(const Client& client, const Thresholds& thresholds);
+    void fetchQueries(State& state, size_t shardIdx);
+    void fetchResponses(State& state, size_t shardIdx);
+    void removeQuery(State& state, Shard& shard);
+    void removeResponse(State& state, Shard& shard);
+
+    mutable LockGuarded<State> d_state;
+    const Rings& d_rings;
+    const unsigned int d_window;
+  };
+
   DynBlockRulesGroup()
   {
   }
+  DynBlockRulesGroup(const DynBlockRulesGroup&) = delete;
+  DynBlockRulesGroup(DynBlockRulesGroup&&) = delete;
+  DynBlockRulesGroup& operator=(const DynBlockRulesGroup&) = delete;
+  DynBlockRulesGroup& operator=(DynBlockRulesGroup&&) = delete;
 
   void setQueryRate(DynBlockRule&& rule)
   {
     d_queryRateRule = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   /* rate is in bytes per second */
   void setResponseByteRate(DynBlockRule&& rule)
   {
     d_respRateRule = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   void setRCodeRate(uint8_t rcode, DynBlockRule&& rule)
   {
     d_rcodeRules[rcode] = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   void setRCodeRatio(uint8_t rcode, DynBlockRatioRule&& rule)
   {
     d_rcodeRatioRules[rcode] = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   void setQTypeRate(uint16_t qtype, DynBlockRule&& rule)
   {
     d_qtypeRules[qtype] = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   void setCacheMissRatio(DynBlockCacheMissRatioRule&& rule)
   {
     d_respCacheMissRatioRule = std::move(rule);
+    updateIncrementalThresholds();
   }
 
   using smtVisitor_t = std::function<std::tuple<bool, boost::optional<std::string>, boost::optional<int>>(const StatNode&, const StatNode::Stat&, const StatNode::Stat&)>;
@@ -191,14 +323,36 @@ public:
   {
     d_suffixMatchRule = std::move(rule);
     d_smtVisitor = std::move(visitor);
+    updateIncrementalThresholds();
   }
 
   void setSuffixMatchRuleFFI(DynBlockRule&& rule, dnsdist_ffi_stat_node_visitor_t visitor)
   {
     d_suffixMatchRule = std::move(rule);
     d_smtVisitorFFI = std::move(visitor);
+    updateIncrementalThresholds();
   }
 
+  /* block the clients whose number of queries, as estimated by the heavy hitters tracker over its window,
+     exceeds the rate of this rule. The masks of the tracker are used for the blocks. */
+  void setHeavyHittersRate(std::shared_ptr<dnsdist::sketches::HeavyHittersTracker> tracker, DynBlockRule&& rule);
+
+  struct BPFRateLimitOptions
+  {
+    /* rate of queries per suffix made of the last d_suffixLabels labels of the qname, over d_suffixSeconds */
+    unsigned int d_suffixRate{0};
+    unsigned int d_suffixSeconds{1};
+    uint8_t d_suffixLabels{0};
+    DNSAction::Action d_suffixAction{DNSAction::Action::None};
+  };
+
+  /* Compile the query rate rule of this group, with the masks of the group, and the suffix rate of the options
+     into in-kernel token buckets of the external eBPF program using this filter, so that floods are dropped before
+     they reach us. The rate of a bucket is the rate of the rule and its burst the number of queries allowed over the
+     period of the rule. Only the Drop and Truncate actions can be enforced in-kernel. The buckets are updated
+     whenever the rules are applied. */
+  void setBPFRateLimits(std::shared_ptr<BPFFilter> filter, const BPFRateLimitOptions& options);
+
   void setNewBlockHook(const dnsdist_ffi_dynamic_block_inserted_hook& callback)
   {
     d_newBlockHook = callback;
@@ -209,6 +363,24 @@ public:
     d_v4Mask = v4;
     d_v6Mask = v6;
     d_portMask = port;
+    if (d_incremental) {
+      d_incremental->setMasks(v4, v6, port);
+    }
+  }
+
+  /* Switch to the incremental mode, keeping the entries of the rings for the last windowSeconds seconds,
+     defaulting to the longest period of the existing rules. Rules covering a longer period, or no
+     period at all, are evaluated over windowSeconds. */
+  void enableIncrementalEvaluation(Rings& rings, std::optional<unsigned int> windowSeconds = std::nullopt);
+
+  bool isIncremental() const
+  {
+    return d_incremental != nullptr;
+  }
+
+  const std::shared_ptr<IncrementalCounters>& getIncrementalCounters() const
+  {
+    return d_incremental;
   }
 
   void apply()
@@ -264,6 +436,7 @@ public:
     result << "Response rate rule: " << d_respRateRule.toString() << std::endl;
     result << "SuffixMatch rule: " << d_suffixMatchRule.toString() << std::endl;
     result << "Response cache-miss ratio rule: " << d_respCacheMissRatioRule.toString() << std::endl;
+    result << "Heavy hitters rule: " << d_heavyHittersRule.toString() << std::endl;
     result << "RCode rules: " << std::endl;
     for (const auto& rule : d_rcodeRules) {
       result << "- " << RCode::to_s(rule.first) << ": " << rule.second.toString() << std::endl;
@@ -288,8 +461,15 @@ public:
 
 private:
   void applySMT(const struct timespec& now, StatNode& statNodeRoot);
-  bool checkIfQueryTypeMatches(const Rings::Query& query);
-  bool checkIfResponseCodeMatches(const Rings::Response& response);
+  bool checkIfQueryTypeMatches(uint16_t qtype, const struct timespec& when);
+  bool checkIfResponseCodeMatches(uint8_t rcode, const struct timespec& when);
+  /* update the counters returned by getCounts(), only called if something needs to be counted */
+  template <typename C>
+  void countQuery(const C& getCounts, const struct timespec& when, uint16_t qtype);
+  template <typename C>
+  void countResponse(const C& getCounts, const struct timespec& when, uint8_t rcode, unsigned int size, bool hit);
+  void setQueryCutOffs(const struct timespec& now);
+  struct timespec setResponseCutOffs(const struct timespec& now);
   void addOrRefreshBlock(boost::optional<NetmaskTree<DynBlock, AddressAndPortRange>>& blocks, const struct timespec& now, const AddressAndPortRange& requestor, const DynBlockRule& rule, bool& updated, bool warning);
   void addOrRefreshBlockSMT(SuffixMatchTree<DynBlock>& blocks, const struct timespec& now, const DNSName& name, const DynBlockRule& rule, bool& updated);
 
@@ -325,6 +505,10 @@ private:
 
   void processQueryRules(counts_t& counts, const struct timespec& now);
   void processResponseRules(counts_t& counts, StatNode& root, const struct timespec& now);
+  void processIncrementalCounters(counts_t& counts, StatNode& root, const struct timespec& now);
+  void processHeavyHitters(boost::optional<NetmaskTree<DynBlock, AddressAndPortRange>>& blocks, const struct timespec& now, bool& updated);
+  void updateIncrementalThresholds();
+  void updateBPFRateLimits();
 
   std::map<uint8_t, DynBlockRule> d_rcodeRules;
   std::map<uint8_t, DynBlockRatioRule> d_rcodeRatioRules;
@@ -333,11 +517,19 @@ private:
   DynBlockRule d_respRateRule;
   DynBlockRule d_suffixMatchRule;
   DynBlockCacheMissRatioRule d_respCacheMissRatioRule;
+  DynBlockRule d_heavyHittersRule;
   NetmaskGroup d_excludedSubnets;
   SuffixMatchNode d_excludedDomains;
   smtVisitor_t d_smtVisitor;
   dnsdist_ffi_stat_node_visitor_t d_smtVisitorFFI;
   dnsdist_ffi_dynamic_block_inserted_hook d_newBlockHook;
+  std::shared_ptr<IncrementalCounters> d_incremental{nullptr};
+  std::shared_ptr<dnsdist::sketches::HeavyHittersTracker> d_heavyHitters{nullptr};
+  std::shared_ptr<BPFFilter> d_bpfFilter{nullptr};
+  BPFRateLimitOptions d_bpfOptions;
+  /* last settings pushed to the eBPF filter, per stage */
+  std::optional<BPFFilter::RateLimitSettings> d_bpfSources;
+  std::optional<BPFFilter::RateLimitSettings> d_bpfSuffixes;
   uint8_t d_v6Mask{128};
   uint8_t d_v4Mask{32};
   uint8_t d_portMask{0};
@@ -522,6 +522,22 @@ static bool replaceEDNSClientSubnetOption(PacketBuffer& packet, size_t maximumSi
   return true;
 }
 
+const DNSQueryScan* getQueryScan(const DNSQuestion& dnsQuestion)
+{
+  const auto& scan = dnsQuestion.ids.d_queryScan;
+  if (!scan.valid || !scan.simpleLayout) {
+    return nullptr;
+  }
+
+  /* the header might have been edited without touching the rest of the packet */
+  const auto dnsHeader = dnsQuestion.getHeader();
+  if (ntohs(dnsHeader->qdcount) != 1 || dnsHeader->ancount != 0 || dnsHeader->nscount != 0 || ntohs(dnsHeader->arcount) > 1) {
+    return nullptr;
+  }
+
+  return &scan;
+}
+
 /* This function looks for an OPT RR, return true if a valid one was found (even if there was no options)
    and false otherwise. */
 bool parseEDNSOptions(const DNSQuestion& dnsQuestion)
@@ -534,6 +550,15 @@ bool parseEDNSOptions(const DNSQuestion& dnsQuestion)
   // dnsQuestion.ednsOptions is mutable
   dnsQuestion.ednsOptions = std::make_unique<EDNSOptionViewMap>();
 
+  if (const auto* scan = getQueryScan(dnsQuestion)) {
+    if (scan->optRDPosition == 0) {
+      return false;
+    }
+    const auto& packet = dnsQuestion.getData();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return getEDNSOptions(reinterpret_cast<const char*>(&packet.at(scan->optRDPosition)), packet.size() - scan->optRDPosition, *dnsQuestion.ednsOptions) == 0;
+  }
+
   if (ntohs(dnsHeader->arcount) == 0) {
     /* nothing in additional so no EDNS */
     return false;
@@ -671,6 +696,15 @@ bool handleEDNSClientSubnet(PacketBuffer& packet, const size_t maximumSize, cons
 
 bool handleEDNSClientSubnet(DNSQuestion& dnsQuestion, bool& ednsAdded, bool& ecsAdded)
 {
+  if (!dnsQuestion.ecsOverride) {
+    const auto* scan = getQueryScan(dnsQuestion);
+    if (scan != nullptr && scan->validOptions && scan->ecsPosition != 0) {
+      /* there is already an ECS option that we are not allowed to override,
+         no need to touch the packet */
+      return true;
+    }
+  }
+
   string newECSOption;
   generateECSOption(dnsQuestion.ecs ? dnsQuestion.ecs->getNetwork() : dnsQuestion.ids.origRemote, newECSOption, dnsQuestion.ecs ? dnsQuestion.ecs->getBits() : dnsQuestion.ecsPrefixLength);
 
@@ -1048,6 +1082,11 @@ bool addEDNSToQueryTurnedResponse(DNSQuestion& dnsQuestion)
 // goal in life - if you send us a reasonably normal packet, we'll get Z for you, otherwise 0
 int getEDNSZ(const DNSQuestion& dnsQuestion)
 {
+  const auto* scan = getQueryScan(dnsQuestion);
+  if (scan != nullptr && scan->optRDPosition != 0) {
+    return scan->ednsZ;
+  }
+
   try {
     const auto& dnsHeader = dnsQuestion.getHeader();
     if (ntohs(dnsHeader->qdcount) != 1 || dnsHeader->ancount != 0 || ntohs(dnsHeader->arcount) != 1 || dnsHeader->nscount != 0) {
@@ -1089,6 +1128,10 @@ int getEDNSZ(const DNSQuestion& dnsQuestion)
 
 bool queryHasEDNS(const DNSQuestion& dnsQuestion)
 {
+  if (const auto* scan = getQueryScan(dnsQuestion)) {
+    return scan->optRDPosition != 0;
+  }
+
   uint16_t optRDPosition = 0;
   size_t ecsRemaining = 0;
 
@@ -27,6 +27,7 @@
 #include "noinitvector.hh"
 
 struct DNSQuestion;
+struct DNSQueryScan;
 
 // root label (1), type (2), class (2), ttl (4) + rdlen (2)
 static const size_t optRecordMinimumSize = 11;
@@ -51,6 +52,10 @@ bool handleEDNSClientSubnet(DNSQuestion& dnsQuestion, bool& ednsAdded, bool& ecs
 bool handleEDNSClientSubnet(PacketBuffer& packet, size_t maximumSize, size_t qnameWireLength, bool& ednsAdded, bool& ecsAdded, bool overrideExisting, const string& newECSOption);
 
 bool parseEDNSOptions(const DNSQuestion& dnsQuestion);
+/* returns the result of the single-pass scan done when the query was received,
+   if it is still valid and the layout of the query is simple enough that its
+   EDNS fields can be trusted, nullptr otherwise */
+const DNSQueryScan* getQueryScan(const DNSQuestion& dnsQuestion);
 
 int getEDNSZ(const DNSQuestion& dnsQuestion);
 bool queryHasEDNS(const DNSQuestion& dnsQuestion);
@@ -20,7 +20,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <unordered_set>
+
 #include "dnsdist-healthchecks.hh"
+#include "dnsdist-timer-wheel.hh"
 #include "tcpiohandler-mplexer.hh"
 #include "dnswriter.hh"
 #include "dolog.hh"
@@ -43,6 +46,17 @@ struct HealthCheckData
   HealthCheckData(FDMultiplexer& mplexer, std::shared_ptr<DownstreamState> downstream, DNSName&& checkName, uint16_t checkType, uint16_t checkClass, uint16_t queryID) :
     d_ds(std::move(downstream)), d_mplexer(mplexer), d_udpSocket(-1), d_checkName(std::move(checkName)), d_checkType(checkType), d_checkClass(checkClass), d_queryID(queryID)
   {
+    d_ds->d_healthCheckPending = true;
+  }
+
+  HealthCheckData(const HealthCheckData&) = delete;
+  HealthCheckData(HealthCheckData&&) = delete;
+  HealthCheckData& operator=(const HealthCheckData&) = delete;
+  HealthCheckData& operator=(HealthCheckData&&) = delete;
+
+  ~HealthCheckData()
+  {
+    d_ds->d_healthCheckPending = false;
   }
 
   const std::shared_ptr<DownstreamState> d_ds;
@@ -62,7 +76,92 @@ struct HealthCheckData
   uint16_t d_queryID;
   TCPState d_tcpState{TCPState::WritingQuery};
   bool d_initial{false};
+  bool d_validResponse{false};
+};
+
+namespace
+{
+/* sockets and connections kept between two health-check queries when healthCheckKeepAlive is set */
+struct IdleHealthCheckResources
+{
+  std::weak_ptr<DownstreamState> d_ds;
+  std::unique_ptr<TCPIOHandler> d_tcpHandler{nullptr};
+  Socket d_udpSocket{-1};
+  uint16_t d_udpSocketUses{0};
 };
+}
+
+static LockGuarded<std::unordered_map<const DownstreamState*, IdleHealthCheckResources>> s_idleHealthCheckResources;
+/* we do not want to use the same source port forever */
+static constexpr uint16_t s_maxHealthCheckUDPSocketUses{100};
+
+static IdleHealthCheckResources& getIdleHealthCheckResources(std::unordered_map<const DownstreamState*, IdleHealthCheckResources>& idle, const std::shared_ptr<DownstreamState>& downstream)
+{
+  auto& entry = idle[downstream.get()];
+  if (entry.d_ds.lock() != downstream) {
+    /* new entry, or a backend that has been destroyed and whose address has been reused */
+    entry = IdleHealthCheckResources();
+    entry.d_ds = downstream;
+  }
+  return entry;
+}
+
+static Socket getIdleHealthCheckUDPSocket(const std::shared_ptr<DownstreamState>& downstream)
+{
+  auto idle = s_idleHealthCheckResources.lock();
+  auto& entry = getIdleHealthCheckResources(*idle, downstream);
+  auto sock = std::move(entry.d_udpSocket);
+  if (sock.getHandle() != -1) {
+    /* discard any late or duplicated response to a previous query */
+    std::array<char, 512> discarded{};
+    while (recv(sock.getHandle(), discarded.data(), discarded.size(), MSG_DONTWAIT) >= 0) {
+    }
+  }
+  return sock;
+}
+
+static void releaseHealthCheckUDPSocket(const std::shared_ptr<DownstreamState>& downstream, Socket&& sock)
+{
+  auto idle = s_idleHealthCheckResources.lock();
+  auto& entry = getIdleHealthCheckResources(*idle, downstream);
+  if (++entry.d_udpSocketUses >= s_maxHealthCheckUDPSocketUses) {
+    entry.d_udpSocketUses = 0;
+    return;
+  }
+  entry.d_udpSocket = std::move(sock);
+}
+
+static std::unique_ptr<TCPIOHandler> getIdleHealthCheckTCPHandler(const std::shared_ptr<DownstreamState>& downstream)
+{
+  auto idle = s_idleHealthCheckResources.lock();
+  auto& entry = getIdleHealthCheckResources(*idle, downstream);
+  auto handler = std::move(entry.d_tcpHandler);
+  /* the backend might have closed the connection in the meantime */
+  if (handler && !handler->isUsable()) {
+    handler.reset();
+  }
+  return handler;
+}
+
+static void releaseHealthCheckTCPHandler(const std::shared_ptr<DownstreamState>& downstream, std::unique_ptr<TCPIOHandler>&& handler)
+{
+  auto idle = s_idleHealthCheckResources.lock();
+  auto& entry = getIdleHealthCheckResources(*idle, downstream);
+  entry.d_tcpHandler = std::move(handler);
+}
+
+static void expungeIdleHealthCheckResources(const std::unordered_set<const DownstreamState*>& backends)
+{
+  auto idle = s_idleHealthCheckResources.lock();
+  for (auto entryIt = idle->begin(); entryIt != idle->end();) {
+    if (backends.count(entryIt->first) == 0 || entryIt->second.d_ds.expired()) {
+      entryIt = idle->erase(entryIt);
+    }
+    else {
+      ++entryIt;
+    }
+  }
+}
 
 static bool handleResponse(std::shared_ptr<HealthCheckData>& data)
 {
@@ -225,7 +324,11 @@ static void healthCheckUDPCallback(int descriptor, FDMultiplexer::funcparam_t& p
   }
 
   data->d_mplexer.removeReadFD(descriptor);
-  data->d_ds->submitHealthCheckResult(data->d_initial, handleResponse(data));
+  data->d_validResponse = handleResponse(data);
+  data->d_ds->submitHealthCheckResult(data->d_initial, data->d_validResponse);
+  if (data->d_validResponse && data->d_ds->d_config.d_healthCheckKeepAlive) {
+    releaseHealthCheckUDPSocket(data->d_ds, std::move(data->d_udpSocket));
+  }
 }
 
 static void healthCheckTCPCallback(int descriptor, FDMultiplexer::funcparam_t& param)
@@ -259,7 +362,8 @@ static void healthCheckTCPCallback(int descriptor, FDMultiplexer::funcparam_t& p
     if (data->d_tcpState == HealthCheckData::TCPState::ReadingResponse) {
       ioState = data->d_tcpHandler->tryRead(data->d_buffer, data->d_bufferPos, data->d_buffer.size());
       if (ioState == IOState::Done) {
-        data->d_ds->submitHealthCheckResult(data->d_initial, handleResponse(data));
+        data->d_validResponse = handleResponse(data);
+        data->d_ds->submitHealthCheckResult(data->d_initial, data->d_validResponse);
       }
     }
 
@@ -284,6 +388,11 @@ static void healthCheckTCPCallback(int descriptor, FDMultiplexer::funcparam_t& p
 
     /* the state has been updated, we can release the guard */
     ioGuard.release();
+
+    if (ioState == IOState::Done && data->d_validResponse && data->d_ds->d_config.d_healthCheckKeepAlive) {
+      data->d_ioState.reset();
+      releaseHealthCheckTCPHandler(data->d_ds, std::move(data->d_tcpHandler));
+    }
   }
   catch (const std::exception& e) {
     ++data->d_ds->d_healthCheckMetrics.d_networkErrors;
@@ -300,6 +409,36 @@ static void healthCheckTCPCallback(int descriptor, FDMultiplexer::funcparam_t& p
   }
 }
 
+static Socket createHealthCheckSocket(const std::shared_ptr<DownstreamState>& downstream)
+{
+  Socket sock(downstream->d_config.remote.sin4.sin_family, downstream->doHealthcheckOverTCP() ? SOCK_STREAM : SOCK_DGRAM);
+
+  sock.setNonBlocking();
+
+#ifdef SO_BINDTODEVICE
+  if (!downstream->d_config.sourceItfName.empty()) {
+    int res = setsockopt(sock.getHandle(), SOL_SOCKET, SO_BINDTODEVICE, downstream->d_config.sourceItfName.c_str(), downstream->d_config.sourceItfName.length());
+    if (res != 0 && g_verboseHealthChecks) {
+      infolog("Error setting SO_BINDTODEVICE on the health check socket for backend '%s': %s", downstream->getNameWithAddr(), stringerror());
+    }
+  }
+#endif
+
+  if (!IsAnyAddress(downstream->d_config.sourceAddr)) {
+    if (downstream->doHealthcheckOverTCP()) {
+      sock.setReuseAddr();
+    }
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    if (downstream->d_config.ipBindAddrNoPort) {
+      SSetsockopt(sock.getHandle(), SOL_IP, IP_BIND_ADDRESS_NO_PORT, 1);
+    }
+#endif
+    sock.bind(downstream->d_config.sourceAddr, false);
+  }
+
+  return sock;
+}
+
 bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared_ptr<DownstreamState>& downstream, bool initialCheck)
 {
   try {
@@ -326,6 +465,17 @@ bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared
       checkClass = std::get<2>(ret);
     }
 
+    Socket reusedUDPSocket(-1);
+    std::unique_ptr<TCPIOHandler> reusedTCPHandler{nullptr};
+    if (downstream->d_config.d_healthCheckKeepAlive && !downstream->isDoH()) {
+      if (downstream->doHealthcheckOverTCP()) {
+        reusedTCPHandler = getIdleHealthCheckTCPHandler(downstream);
+      }
+      else {
+        reusedUDPSocket = getIdleHealthCheckUDPSocket(downstream);
+      }
+    }
+
     PacketBuffer packet;
     GenericDNSPacketWriter<PacketBuffer> dpw(packet, checkName, checkType, checkClass);
     dnsheader* requestHeader = dpw.getHeader();
@@ -337,37 +487,13 @@ bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared
     size_t proxyProtocolPayloadSize = 0;
     if (downstream->d_config.useProxyProtocol) {
       proxyProtocolPayload = makeLocalProxyHeader();
-      proxyProtocolPayloadSize = proxyProtocolPayload.size();
-      if (!downstream->isDoH()) {
+      /* over TCP, the payload is only sent at the beginning of the connection */
+      if (!downstream->isDoH() && !reusedTCPHandler) {
+        proxyProtocolPayloadSize = proxyProtocolPayload.size();
         packet.insert(packet.begin(), proxyProtocolPayload.begin(), proxyProtocolPayload.end());
       }
     }
 
-    Socket sock(downstream->d_config.remote.sin4.sin_family, downstream->doHealthcheckOverTCP() ? SOCK_STREAM : SOCK_DGRAM);
-
-    sock.setNonBlocking();
-
-#ifdef SO_BINDTODEVICE
-    if (!downstream->d_config.sourceItfName.empty()) {
-      int res = setsockopt(sock.getHandle(), SOL_SOCKET, SO_BINDTODEVICE, downstream->d_config.sourceItfName.c_str(), downstream->d_config.sourceItfName.length());
-      if (res != 0 && g_verboseHealthChecks) {
-        infolog("Error setting SO_BINDTODEVICE on the health check socket for backend '%s': %s", downstream->getNameWithAddr(), stringerror());
-      }
-    }
-#endif
-
-    if (!IsAnyAddress(downstream->d_config.sourceAddr)) {
-      if (downstream->doHealthcheckOverTCP()) {
-        sock.setReuseAddr();
-      }
-#ifdef IP_BIND_ADDRESS_NO_PORT
-      if (downstream->d_config.ipBindAddrNoPort) {
-        SSetsockopt(sock.getHandle(), SOL_IP, IP_BIND_ADDRESS_NO_PORT, 1);
-      }
-#endif
-      sock.bind(downstream->d_config.sourceAddr, false);
-    }
-
     auto data = std::make_shared<HealthCheckData>(*mplexer, downstream, std::move(checkName), checkType, checkClass, queryID);
     data->d_initial = initialCheck;
 
@@ -377,8 +503,14 @@ bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared
     normalizeTV(data->d_ttd);
 
     if (!downstream->doHealthcheckOverTCP()) {
-      sock.connect(downstream->d_config.remote);
-      data->d_udpSocket = std::move(sock);
+      if (reusedUDPSocket.getHandle() != -1) {
+        data->d_udpSocket = std::move(reusedUDPSocket);
+      }
+      else {
+        auto sock = createHealthCheckSocket(downstream);
+        sock.connect(downstream->d_config.remote);
+        data->d_udpSocket = std::move(sock);
+      }
       ssize_t sent = udpClientSendRequestToBackend(downstream, data->d_udpSocket.getHandle(), packet, true);
       if (sent < 0) {
         int ret = errno;
@@ -401,21 +533,28 @@ bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared
     }
 #endif
     else {
-      data->d_tcpHandler = std::make_unique<TCPIOHandler>(downstream->d_config.d_tlsSubjectName, downstream->d_config.d_tlsSubjectIsAddr, sock.releaseHandle(), timeval{downstream->d_config.checkTimeout, 0}, downstream->d_tlsCtx);
-      data->d_ioState = std::make_unique<IOStateHandler>(*mplexer, data->d_tcpHandler->getDescriptor());
-      if (downstream->d_tlsCtx) {
-        try {
-          time_t now = time(nullptr);
-          auto tlsSession = g_sessionCache.getSession(downstream->getID(), now);
-          if (tlsSession) {
-            data->d_tcpHandler->setTLSSession(tlsSession);
+      if (reusedTCPHandler) {
+        data->d_tcpHandler = std::move(reusedTCPHandler);
+        data->d_ioState = std::make_unique<IOStateHandler>(*mplexer, data->d_tcpHandler->getDescriptor());
+      }
+      else {
+        auto sock = createHealthCheckSocket(downstream);
+        data->d_tcpHandler = std::make_unique<TCPIOHandler>(downstream->d_config.d_tlsSubjectName, downstream->d_config.d_tlsSubjectIsAddr, sock.releaseHandle(), timeval{downstream->d_config.checkTimeout, 0}, downstream->d_tlsCtx);
+        data->d_ioState = std::make_unique<IOStateHandler>(*mplexer, data->d_tcpHandler->getDescriptor());
+        if (downstream->d_tlsCtx) {
+          try {
+            time_t now = time(nullptr);
+            auto tlsSession = g_sessionCache.getSession(downstream->getID(), now);
+            if (tlsSession) {
+              data->d_tcpHandler->setTLSSession(tlsSession);
+            }
+          }
+          catch (const std::exception& e) {
+            vinfolog("Unable to restore a TLS session for the DoT healthcheck for backend %s: %s", downstream->getNameWithAddr(), e.what());
           }
         }
-        catch (const std::exception& e) {
-          vinfolog("Unable to restore a TLS session for the DoT healthcheck for backend %s: %s", downstream->getNameWithAddr(), e.what());
-        }
+        data->d_tcpHandler->tryConnect(downstream->d_config.tcpFastOpen, downstream->d_config.remote);
       }
-      data->d_tcpHandler->tryConnect(downstream->d_config.tcpFastOpen, downstream->d_config.remote);
 
       const std::array<uint8_t, 2> sizeBytes = {static_cast<uint8_t>(packetSize / 256), static_cast<uint8_t>(packetSize % 256)};
       packet.insert(packet.begin() + static_cast<ssize_t>(proxyProtocolPayloadSize), sizeBytes.begin(), sizeBytes.end());
@@ -448,6 +587,82 @@ bool queueHealthCheck(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared
   }
 }
 
+static void handleHealthCheckTimeouts(FDMultiplexer& mplexer, const struct timeval& now, bool initial)
+{
+#if defined(HAVE_DNS_OVER_HTTPS) && defined(HAVE_NGHTTP2)
+  handleH2Timeouts(mplexer, now);
+#endif
+
+  auto timeouts = mplexer.getTimeouts(now);
+  for (const auto& timeout : timeouts) {
+    if (timeout.second.type() != typeid(std::shared_ptr<HealthCheckData>)) {
+      continue;
+    }
+
+    auto data = boost::any_cast<std::shared_ptr<HealthCheckData>>(timeout.second);
+    try {
+      /* UDP does not have an IO state, H2 is handled separately */
+      if (data->d_ioState) {
+        data->d_ioState.reset();
+      }
+      else {
+        mplexer.removeReadFD(timeout.first);
+      }
+      if (g_verboseHealthChecks) {
+        infolog("Timeout while waiting for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+      }
+
+      ++data->d_ds->d_healthCheckMetrics.d_timeOuts;
+      data->d_ds->submitHealthCheckResult(initial, false);
+    }
+    catch (const std::exception& e) {
+      /* this is not supposed to happen as the file descriptor has to be
+         there for us to reach that code, and the submission code should not throw,
+         but let's provide a nice error message if it ever does. */
+      if (g_verboseHealthChecks) {
+        infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s: %s", data->d_queryID, data->d_ds->getNameWithAddr(), e.what());
+      }
+    }
+    catch (...) {
+      /* this is even less likely to happen */
+      if (g_verboseHealthChecks) {
+        infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+      }
+    }
+  }
+
+  timeouts = mplexer.getTimeouts(now, true);
+  for (const auto& timeout : timeouts) {
+    if (timeout.second.type() != typeid(std::shared_ptr<HealthCheckData>)) {
+      continue;
+    }
+    auto data = boost::any_cast<std::shared_ptr<HealthCheckData>>(timeout.second);
+    try {
+      /* UDP does not block while writing, H2 is handled separately */
+      data->d_ioState.reset();
+      if (g_verboseHealthChecks) {
+        infolog("Timeout while waiting for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+      }
+
+      ++data->d_ds->d_healthCheckMetrics.d_timeOuts;
+      data->d_ds->submitHealthCheckResult(initial, false);
+    }
+    catch (const std::exception& e) {
+      /* this is not supposed to happen as the submission code should not throw,
+         but let's provide a nice error message if it ever does. */
+      if (g_verboseHealthChecks) {
+        infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s: %s", data->d_queryID, data->d_ds->getNameWithAddr(), e.what());
+      }
+    }
+    catch (...) {
+      /* this is even less likely to happen */
+      if (g_verboseHealthChecks) {
+        infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+      }
+    }
+  }
+}
+
 void handleQueuedHealthChecks(FDMultiplexer& mplexer, bool initial)
 {
   while (mplexer.getWatchedFDCount(false) > 0 || mplexer.getWatchedFDCount(true) > 0) {
@@ -466,77 +681,84 @@ void handleQueuedHealthChecks(FDMultiplexer& mplexer, bool initial)
       continue;
     }
 
-#if defined(HAVE_DNS_OVER_HTTPS) && defined(HAVE_NGHTTP2)
-    handleH2Timeouts(mplexer, now);
-#endif
-
-    auto timeouts = mplexer.getTimeouts(now);
-    for (const auto& timeout : timeouts) {
-      if (timeout.second.type() != typeid(std::shared_ptr<HealthCheckData>)) {
-        continue;
-      }
+    handleHealthCheckTimeouts(mplexer, now, initial);
+  }
+}
 
-      auto data = boost::any_cast<std::shared_ptr<HealthCheckData>>(timeout.second);
-      try {
-        /* UDP does not have an IO state, H2 is handled separately */
-        if (data->d_ioState) {
-          data->d_ioState.reset();
-        }
-        else {
-          mplexer.removeReadFD(timeout.first);
-        }
-        if (g_verboseHealthChecks) {
-          infolog("Timeout while waiting for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
-        }
+static uint64_t getMonotonicUsec()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        ++data->d_ds->d_healthCheckMetrics.d_timeOuts;
-        data->d_ds->submitHealthCheckResult(initial, false);
-      }
-      catch (const std::exception& e) {
-        /* this is not supposed to happen as the file descriptor has to be
-           there for us to reach that code, and the submission code should not throw,
-           but let's provide a nice error message if it ever does. */
-        if (g_verboseHealthChecks) {
-          infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s: %s", data->d_queryID, data->d_ds->getNameWithAddr(), e.what());
+void runHealthChecksScheduler()
+{
+  /* Every backend is handled once per second, but at its own random offset within that
+     second instead of all of them at the same time, which would cause bursts of queries
+     and responses with a large number of backends. Backends checked less than every
+     second also start at a random second within their interval, and responses are
+     processed as they arrive instead of waiting for all the checks of a round to
+     complete. A backend whose previous check is still pending, because its
+     checkTimeout is larger than its checkInterval, is skipped so that the checks
+     do not overlap and a single unresponsive period is not counted several times. */
+  constexpr uint64_t roundUsec = 1000 * 1000;
+  constexpr uint64_t tickUsec = 10 * 1000;
+  auto states = g_dstates.getLocal(); // this points to the actual shared_ptrs!
+  std::unique_ptr<FDMultiplexer> mplexer(FDMultiplexer::getMultiplexerSilent(std::max(states->size(), static_cast<size_t>(128))));
+  dnsdist::TimerWheel<std::shared_ptr<DownstreamState>> wheel(roundUsec / tickUsec, tickUsec, getMonotonicUsec());
+  std::unordered_set<const DownstreamState*> scheduled;
+  std::unordered_set<const DownstreamState*> current;
+  uint64_t nextSweepUsec = 0;
+  bool firstSweep = true;
+
+  for (;;) {
+    auto nowUsec = getMonotonicUsec();
+    if (nowUsec >= nextSweepUsec) {
+      /* look for new and removed backends */
+      current.clear();
+      for (const auto& dss : *states) {
+        current.insert(dss.get());
+        if (!scheduled.insert(dss.get()).second) {
+          continue;
         }
-      }
-      catch (...) {
-        /* this is even less likely to happen */
-        if (g_verboseHealthChecks) {
-          infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+        /* backends present at startup have already been checked, but new ones should be checked right away */
+        if (firstSweep && dss->d_config.availability == DownstreamState::Availability::Auto && dss->d_config.checkInterval > 1) {
+          dss->d_nextCheck = 1 + dnsdist::getRandomValue(dss->d_config.checkInterval);
         }
+        wheel.schedule(std::shared_ptr<DownstreamState>(dss), nowUsec + dnsdist::getRandomValue(roundUsec));
       }
+      expungeIdleHealthCheckResources(current);
+      firstSweep = false;
+      nextSweepUsec = nowUsec + roundUsec;
     }
 
-    timeouts = mplexer.getTimeouts(now, true);
-    for (const auto& timeout : timeouts) {
-      if (timeout.second.type() != typeid(std::shared_ptr<HealthCheckData>)) {
-        continue;
-      }
-      auto data = boost::any_cast<std::shared_ptr<HealthCheckData>>(timeout.second);
-      try {
-        /* UDP does not block while writing, H2 is handled separately */
-        data->d_ioState.reset();
-        if (g_verboseHealthChecks) {
-          infolog("Timeout while waiting for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
-        }
+    const auto nextTickUsec = wheel.getNextTickUsec();
+    const auto waitMsec = nextTickUsec > nowUsec ? static_cast<int>((nextTickUsec - nowUsec + 999) / 1000) : 0;
+    struct timeval now
+    {
+    };
+    if (mplexer->run(&now, waitMsec) == -1 && g_verboseHealthChecks) {
+      infolog("Error while waiting for the health check response from backends");
+    }
+    handleHealthCheckTimeouts(*mplexer, now, false);
 
-        ++data->d_ds->d_healthCheckMetrics.d_timeOuts;
-        data->d_ds->submitHealthCheckResult(initial, false);
-      }
-      catch (const std::exception& e) {
-        /* this is not supposed to happen as the submission code should not throw,
-           but let's provide a nice error message if it ever does. */
-        if (g_verboseHealthChecks) {
-          infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s: %s", data->d_queryID, data->d_ds->getNameWithAddr(), e.what());
-        }
+    wheel.advance(getMonotonicUsec(), [&](std::shared_ptr<DownstreamState>&& dss, uint64_t whenUsec) {
+      if (current.count(dss.get()) == 0) {
+        /* this backend has been removed */
+        scheduled.erase(dss.get());
+        return;
       }
-      catch (...) {
-        /* this is even less likely to happen */
-        if (g_verboseHealthChecks) {
-          infolog("Error while dealing with a timeout for the health check response (ID %d) from backend %s", data->d_queryID, data->d_ds->getNameWithAddr());
+
+      dss->updateStatisticsInfo();
+
+      dss->handleUDPTimeouts();
+
+      if (!dss->d_healthCheckPending && dss->healthCheckRequired()) {
+        if (!queueHealthCheck(mplexer, dss)) {
+          dss->submitHealthCheckResult(false, false);
         }
       }
-    }
+
+      wheel.schedule(std::move(dss), whenUsec + roundUsec);
+    });
   }
 }
@@ -22,6 +22,7 @@
 
 #include "dnsdist-idstate.hh"
 #include "dnsdist-doh-common.hh"
+#include "dns.hh"
 #include "doh3.hh"
 #include "doq.hh"
 
@@ -54,3 +55,19 @@ InternalQueryState InternalQueryState::partialCloneForXFR() const
   ids.d_streamID = d_streamID;
   return ids;
 }
+
+void InternalQueryState::parseQuestion(const PacketBuffer& query)
+{
+  if (!scanDNSQuery(query.data(), query.size(), d_queryScan)) {
+    /* let the regular parser report what is wrong with this question */
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    qname = DNSName(reinterpret_cast<const char*>(query.data()), query.size(), sizeof(dnsheader), false, &qtype, &qclass);
+    return;
+  }
+
+  /* the labels have already been validated by the scan */
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  qname = DNSName::fromValidatedWire(reinterpret_cast<const char*>(&query.at(sizeof(dnsheader))), d_queryScan.qnameWireLength);
+  qtype = d_queryScan.qtype;
+  qclass = d_queryScan.qclass;
+}
@@ -27,10 +27,12 @@
 #include "dnscrypt.hh"
 #include "dnsname.hh"
 #include "dnsdist-protocols.hh"
+#include "dnsqueryscan.hh"
 #include "ednsextendederror.hh"
 #include "gettime.hh"
 #include "iputils.hh"
 #include "noinitvector.hh"
+#include "stat_t.hh"
 #include "uuid-utils.hh"
 
 struct ClientState;
@@ -130,6 +132,10 @@ struct InternalQueryState
   }
 
   InternalQueryState partialCloneForXFR() const;
+  /* parse the question section of the query, setting qname, qtype and qclass,
+     and remember where the EDNS parts are so that the rules, the cache and the
+     ECS code do not have to walk the packet again. Throws if the question is invalid */
+  void parseQuestion(const PacketBuffer& query);
 
   boost::optional<Netmask> subnet{boost::none}; // 40
   std::string poolName; // 32
@@ -154,6 +160,7 @@ struct InternalQueryState
   size_t d_proxyProtocolPayloadSize{0}; // 8
   std::unique_ptr<DOQUnit> doqu{nullptr}; // 8
   std::unique_ptr<DOH3Unit> doh3u{nullptr}; // 8
+  DNSQueryScan d_queryScan; // only valid as long as the query has not been modified // 24
   int32_t d_streamID{-1}; // 4
   uint32_t cacheKey{0}; // 4
   uint32_t cacheKeyNoECS{0}; // 4
@@ -177,6 +184,8 @@ struct InternalQueryState
   bool useZeroScope{false};
   bool forwardedOverUDP{false};
   bool selfGenerated{false};
+  bool collapsingLeader{false}; // identical cache misses are waiting for the response to this query
+  bool skipCollapsing{false};
 };
 
 struct IDState
@@ -187,7 +196,7 @@ struct IDState
 
   IDState(const IDState& orig) = delete;
   IDState(IDState&& rhs) noexcept :
-    internal(std::move(rhs.internal))
+    internal(std::move(rhs.internal)), queryID(rhs.queryID)
   {
     inUse.store(rhs.inUse.load());
     age.store(rhs.age.load());
@@ -198,6 +207,7 @@ struct IDState
     inUse.store(rhs.inUse.load());
     age.store(rhs.age.load());
     internal = std::move(rhs.internal);
+    queryID = rhs.queryID;
     return *this;
   }
 
@@ -233,6 +243,9 @@ struct IDState
   */
   InternalQueryState internal;
   std::atomic<uint16_t> age{0};
+  /* the ID of the query sent to the backend, which differs from the index of the
+     state when IDs are randomized. Only accessed while owning the state */
+  uint16_t queryID{0};
 
   class StateGuard
   {
@@ -273,3 +286,93 @@ struct IDState
 private:
   std::atomic<bool> locked{false}; // 1
 };
+
+/* A fixed-capacity table of states for the in-flight UDP queries to a backend, indexed by the
+   ID of the query we sent. Slots are claimed and released via IDState::acquire(), without any
+   global lock or allocation, and are aligned on a cache line so that threads working on
+   adjacent slots do not contend. A bitmap of the slots currently in use allows the timeout
+   sweep to skip over empty slots without touching them. */
+class IDStateTable
+{
+public:
+  IDStateTable() = default;
+  IDStateTable(const IDStateTable&) = delete;
+  IDStateTable(IDStateTable&&) = delete;
+  IDStateTable& operator=(const IDStateTable&) = delete;
+  IDStateTable& operator=(IDStateTable&&) = delete;
+  ~IDStateTable() = default;
+
+  /* not thread-safe, only call this before the table is used */
+  void resize(size_t size)
+  {
+    if (size > s_maxSize) {
+      throw std::runtime_error("Trying to create an ID state table with " + std::to_string(size) + " slots, the maximum is " + std::to_string(s_maxSize));
+    }
+    d_slots = std::make_unique<Slot[]>(size); // NOLINT(cppcoreguidelines-avoid-c-arrays,hicpp-avoid-c-arrays,modernize-avoid-c-arrays)
+    d_bitmapSize = (size + 63) / 64;
+    d_inUse = std::make_unique<std::atomic<uint64_t>[]>(d_bitmapSize); // NOLINT(cppcoreguidelines-avoid-c-arrays,hicpp-avoid-c-arrays,modernize-avoid-c-arrays)
+    for (size_t idx = 0; idx < d_bitmapSize; idx++) {
+      d_inUse[idx].store(0);
+    }
+    d_size = size;
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  /* the caller is responsible for checking that id is lower than size() */
+  IDState& operator[](uint16_t id)
+  {
+    return d_slots[id].d_state;
+  }
+
+  /* the caller needs to own the slot, via IDState::acquire() */
+  void setInUse(uint16_t id, bool inUse)
+  {
+    auto& state = d_slots[id].d_state;
+    const uint64_t mask = 1ULL << (id % 64);
+    state.inUse = inUse;
+    if (inUse) {
+      d_inUse[id / 64].fetch_or(mask, std::memory_order_relaxed);
+    }
+    else {
+      d_inUse[id / 64].fetch_and(~mask, std::memory_order_relaxed);
+    }
+  }
+
+  /* calls the visitor for every slot marked as used in the bitmap, without owning the slot.
+     The visitor has to acquire it and check IDState::isInUse() again before doing anything
+     else than reading atomic fields */
+  template <typename Visitor>
+  void visitInUse(const Visitor& visitor)
+  {
+    for (size_t word = 0; word < d_bitmapSize; word++) {
+      uint64_t bits = d_inUse[word].load(std::memory_order_relaxed);
+      while (bits != 0) {
+        const auto bit = static_cast<size_t>(__builtin_ctzll(bits));
+        bits &= bits - 1;
+        const auto id = static_cast<uint16_t>((word * 64) + bit);
+        visitor(id, d_slots[id].d_state);
+      }
+    }
+  }
+
+  static constexpr size_t s_maxSize{65536};
+
+private:
+#ifndef DISABLE_FALSE_SHARING_PADDING
+  struct alignas(CPU_LEVEL1_DCACHE_LINESIZE) Slot
+#else
+  struct Slot
+#endif /* DISABLE_FALSE_SHARING_PADDING */
+  {
+    IDState d_state;
+  };
+
+  std::unique_ptr<Slot[]> d_slots{nullptr}; // NOLINT(cppcoreguidelines-avoid-c-arrays,hicpp-avoid-c-arrays,modernize-avoid-c-arrays)
+  std::unique_ptr<std::atomic<uint64_t>[]> d_inUse{nullptr}; // NOLINT(cppcoreguidelines-avoid-c-arrays,hicpp-avoid-c-arrays,modernize-avoid-c-arrays)
+  size_t d_bitmapSize{0};
+  size_t d_size{0};
+};
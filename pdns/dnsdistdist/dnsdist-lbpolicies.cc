@@ -170,60 +170,154 @@ shared_ptr<DownstreamState> whashed(const ServerPolicy::NumberedServerVector& se
   return whashedFromHash(servers, dq->ids.qname.hash(g_hashperturb));
 }
 
-shared_ptr<DownstreamState> chashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t qhash)
+namespace
 {
-  unsigned int sel = std::numeric_limits<unsigned int>::max();
-  unsigned int min = std::numeric_limits<unsigned int>::max();
-  shared_ptr<DownstreamState> ret = nullptr, first = nullptr;
-
-  double targetLoad = std::numeric_limits<double>::max();
-  if (g_consistentHashBalancingFactor > 0) {
-    /* we start with one, representing the query we are currently handling */
-    double currentLoad = 1;
-    size_t totalWeight = 0;
-    for (const auto& pair : servers) {
-      if (pair.second->isUp()) {
-        currentLoad += pair.second->outstanding;
-        totalWeight += pair.second->d_config.d_weight;
+/* All the points of all the servers of a given vector, merged into a single sorted ring, plus
+   a table indexed by the highest bits of a hash giving the first point of the corresponding
+   range, so that finding the closest point of a given hash is usually done in constant time
+   instead of doing a binary search over the points of every server. It is only rebuilt when
+   the list of servers or the hashes of one of them change, and the selection is exactly
+   the same as walking the hashes of every server. */
+struct ConsistentHashRing
+{
+  void build(const ServerPolicy::NumberedServerVector& servers)
+  {
+    d_servers.clear();
+    d_points.clear();
+    d_servers.reserve(servers.size());
+    for (const auto& server : servers) {
+      // make sure hashes have been computed
+      if (!server.second->hashesComputed) {
+        server.second->hash();
       }
+      d_servers.push_back(server.second.get());
     }
 
-    if (totalWeight > 0) {
-      targetLoad = (currentLoad / totalWeight) * g_consistentHashBalancingFactor;
+    /* any change made to the hashes after this point will trigger a new rebuild */
+    d_generation = DownstreamState::s_hashesGeneration.load();
+    for (size_t idx = 0; idx < servers.size(); idx++) {
+      auto hashes = servers.at(idx).second->hashes.read_lock();
+      for (const auto hash : *hashes) {
+        d_points.emplace_back(hash, static_cast<uint32_t>(idx));
+      }
+    }
+    /* on ties, the first server in the vector wins */
+    std::sort(d_points.begin(), d_points.end());
+
+    d_shift = 32;
+    size_t bucketsCount = 1;
+    while (bucketsCount < d_points.size() && bucketsCount < s_maxBuckets) {
+      bucketsCount <<= 1;
+      d_shift--;
+    }
+    d_buckets.resize(bucketsCount);
+    uint32_t pointIdx = 0;
+    for (uint64_t bucket = 0; bucket < bucketsCount; bucket++) {
+      const uint64_t start = bucket << d_shift;
+      while (pointIdx < d_points.size() && d_points.at(pointIdx).first < start) {
+        pointIdx++;
+      }
+      d_buckets.at(bucket) = pointIdx;
     }
   }
 
-  for (const auto& d: servers) {
-    if (d.second->isUp() && (g_consistentHashBalancingFactor == 0 || d.second->outstanding <= (targetLoad * d.second->d_config.d_weight))) {
-      // make sure hashes have been computed
-      if (!d.second->hashesComputed) {
-        d.second->hash();
-      }
-      {
-        const auto& server = d.second;
-        auto hashes = server->hashes.read_lock();
-        // we want to keep track of the last hash
-        if (min > *(hashes->begin())) {
-          min = *(hashes->begin());
-          first = server;
-        }
-
-        auto hash_it = std::lower_bound(hashes->begin(), hashes->end(), qhash);
-        if (hash_it != hashes->end()) {
-          if (*hash_it < sel) {
-            sel = *hash_it;
-            ret = server;
-          }
-        }
+  bool isUpToDate(const ServerPolicy::NumberedServerVector& servers) const
+  {
+    if (d_generation != DownstreamState::s_hashesGeneration.load() || d_servers.size() != servers.size()) {
+      return false;
+    }
+    for (size_t idx = 0; idx < servers.size(); idx++) {
+      if (d_servers[idx] != servers[idx].second.get()) {
+        return false;
       }
     }
+    return true;
+  }
+
+  /* index of the first point whose hash is greater or equal to the supplied one, might be d_points.size() */
+  size_t getFirstPoint(size_t qhash) const
+  {
+    if (qhash > std::numeric_limits<uint32_t>::max()) {
+      return d_points.size();
+    }
+    size_t idx = d_buckets[static_cast<uint64_t>(qhash) >> d_shift];
+    while (idx < d_points.size() && d_points[idx].first < qhash) {
+      idx++;
+    }
+    return idx;
+  }
+
+  static constexpr size_t s_maxBuckets{1U << 20};
+  std::vector<const DownstreamState*> d_servers;
+  /* hash, index of the server in the vector */
+  std::vector<std::pair<unsigned int, uint32_t>> d_points;
+  std::vector<uint32_t> d_buckets;
+  uint64_t d_generation{0};
+  unsigned int d_shift{32};
+};
+
+constexpr size_t s_maxConsistentHashRingsPerThread{32};
+
+const ConsistentHashRing& getConsistentHashRing(const ServerPolicy::NumberedServerVector& servers)
+{
+  /* keyed by the address of the vector of servers, which is stable for a given pool as long as no
+     server is added or removed. Tables for vectors that are no longer in use are expunged when
+     there are too many of them */
+  static thread_local std::unordered_map<const ServerPolicy::NumberedServerVector*, ConsistentHashRing> t_consistentHashRings;
+
+  auto ringIt = t_consistentHashRings.find(&servers);
+  if (ringIt == t_consistentHashRings.end()) {
+    if (t_consistentHashRings.size() >= s_maxConsistentHashRingsPerThread) {
+      t_consistentHashRings.clear();
+    }
+    ringIt = t_consistentHashRings.emplace(&servers, ConsistentHashRing()).first;
+    ringIt->second.build(servers);
+  }
+  else if (!ringIt->second.isUpToDate(servers)) {
+    ringIt->second.build(servers);
+  }
+  return ringIt->second;
+}
+}
+
+shared_ptr<DownstreamState> chashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t qhash)
+{
+  /* we start with one, representing the query we are currently handling */
+  double currentLoad = 1;
+  size_t totalWeight = 0;
+  for (const auto& pair : servers) {
+    if (pair.second->isUp()) {
+      currentLoad += pair.second->outstanding;
+      totalWeight += pair.second->d_config.d_weight;
+    }
+  }
+
+  /* no need to walk the whole ring, and since the balancing factor is at least 1, one of the servers
+     that are up is always below its target load */
+  if (totalWeight == 0) {
+    return shared_ptr<DownstreamState>();
   }
-  if (ret != nullptr) {
-    return ret;
+
+  double targetLoad = std::numeric_limits<double>::max();
+  if (g_consistentHashBalancingFactor > 0) {
+    targetLoad = (currentLoad / totalWeight) * g_consistentHashBalancingFactor;
   }
-  if (first != nullptr) {
-    return first;
+
+  const auto& ring = getConsistentHashRing(servers);
+  const auto& points = ring.d_points;
+  /* walk the ring, starting at the closest point, until we find a server that is up and,
+     when bounded-load is enabled, not already handling more than its share */
+  auto pointIdx = ring.getFirstPoint(qhash);
+  for (size_t count = 0; count < points.size(); count++, pointIdx++) {
+    if (pointIdx >= points.size()) {
+      pointIdx = 0;
+    }
+    const auto& server = servers[points[pointIdx].second].second;
+    if (server->isUp() && (g_consistentHashBalancingFactor == 0 || server->outstanding <= (targetLoad * server->d_config.d_weight))) {
+      return server;
+    }
   }
+
   return shared_ptr<DownstreamState>();
 }
 
@@ -232,6 +326,85 @@ shared_ptr<DownstreamState> chashed(const ServerPolicy::NumberedServerVector& se
   return chashedFromHash(servers, dq->ids.qname.hash(g_hashperturb));
 }
 
+std::atomic<double> dnsdist::PeakEWMA::s_decayTimeUsec{1000000.0};
+
+/* a server that has not answered any query yet but has queries in the air is considered
+   to be very slow, otherwise it would get all the traffic until its first answer */
+static constexpr double s_peakEWMAUnknownLatencyPenaltyUsec{1000000000.0};
+
+static double getPeakEWMACost(const DownstreamState& server, int64_t nowUsec)
+{
+  const auto latency = server.latencyPeakEWMA.get(nowUsec);
+  const auto outstanding = server.outstanding.load();
+  double cost = 0.0;
+  if (latency == 0.0) {
+    if (outstanding == 0) {
+      return cost;
+    }
+    cost = s_peakEWMAUnknownLatencyPenaltyUsec + outstanding;
+  }
+  else {
+    cost = latency * (outstanding + 1);
+  }
+  return cost / server.d_config.d_weight;
+}
+
+// pick two different servers at random, then the one with the lowest latency multiplied by the number of queries in the air
+shared_ptr<DownstreamState> p2cPeakEWMAAtTime(const ServerPolicy::NumberedServerVector& servers, int64_t nowUsec)
+{
+  size_t usableServers = 0;
+  for (const auto& server : servers) {
+    if (server.second->isUp()) {
+      usableServers++;
+    }
+  }
+
+  if (usableServers == 0) {
+    return shared_ptr<DownstreamState>();
+  }
+
+  /* if there is only one usable server, picking it twice is fine */
+  const size_t first = dns_random(usableServers);
+  size_t second = first;
+  if (usableServers > 1) {
+    second = dns_random(usableServers - 1);
+    if (second >= first) {
+      second++;
+    }
+  }
+
+  shared_ptr<DownstreamState> firstServer{nullptr};
+  shared_ptr<DownstreamState> secondServer{nullptr};
+  size_t position = 0;
+  for (const auto& server : servers) {
+    /* the status might have changed since the first pass */
+    if (!server.second->isUp()) {
+      continue;
+    }
+    if (position == first) {
+      firstServer = server.second;
+    }
+    if (position == second) {
+      secondServer = server.second;
+    }
+    position++;
+  }
+
+  if (!firstServer || !secondServer) {
+    return firstServer ? firstServer : secondServer;
+  }
+
+  if (getPeakEWMACost(*secondServer, nowUsec) < getPeakEWMACost(*firstServer, nowUsec)) {
+    return secondServer;
+  }
+  return firstServer;
+}
+
+shared_ptr<DownstreamState> p2cPeakEWMA(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dq)
+{
+  return p2cPeakEWMAAtTime(servers, dnsdist::PeakEWMA::getNowUsec());
+}
+
 shared_ptr<DownstreamState> roundrobin(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dq)
 {
   if (servers.empty()) {
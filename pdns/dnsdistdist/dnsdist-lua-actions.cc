@@ -31,6 +31,7 @@
 #include "dnsdist-mac-address.hh"
 #include "dnsdist-protobuf.hh"
 #include "dnsdist-proxy-protocol.hh"
+#include "dnsdist-remote-logging.hh"
 #include "dnsdist-kvs.hh"
 #include "dnsdist-rule-chains.hh"
 #include "dnsdist-svc.hh"
@@ -46,6 +47,25 @@
 
 #include "ipcipher.hh"
 
+/* the value returned by a Lua function might not correspond to any action */
+static DNSAction::Action getActionFromLua(int value)
+{
+  if (value < 0 || value > static_cast<int>(DNSAction::Action::SetTag)) {
+    vinfolog("Invalid action %d returned by a Lua action, ignoring", value);
+    return DNSAction::Action::None;
+  }
+  return static_cast<DNSAction::Action>(value);
+}
+
+static DNSResponseAction::Action getResponseActionFromLua(int value)
+{
+  if (value < 0 || value > static_cast<int>(DNSResponseAction::Action::None)) {
+    vinfolog("Invalid action %d returned by a Lua response action, ignoring", value);
+    return DNSResponseAction::Action::None;
+  }
+  return static_cast<DNSResponseAction::Action>(value);
+}
+
 class DropAction : public DNSAction
 {
 public:
@@ -523,7 +543,7 @@ public:
             ruleresult->clear();
           }
         }
-        result = static_cast<Action>(std::get<0>(ret));
+        result = getActionFromLua(std::get<0>(ret));
       }
       dnsdist::handleQueuedAsynchronousEvents();
       return result;
@@ -569,7 +589,7 @@ public:
             ruleresult->clear();
           }
         }
-        result = static_cast<Action>(std::get<0>(ret));
+        result = getResponseActionFromLua(std::get<0>(ret));
       }
       dnsdist::handleQueuedAsynchronousEvents();
       return result;
@@ -619,7 +639,7 @@ public:
             ruleresult->clear();
           }
         }
-        result = static_cast<DNSAction::Action>(ret);
+        result = getActionFromLua(ret);
       }
       dnsdist::handleQueuedAsynchronousEvents();
       return result;
@@ -681,7 +701,7 @@ public:
         }
       }
       dnsdist::handleQueuedAsynchronousEvents();
-      return static_cast<DNSAction::Action>(ret);
+      return getActionFromLua(ret);
     }
     catch (const std::exception& e) {
       warnlog("LuaFFIPerThreadAction failed inside Lua, returning ServFail: %s", e.what());
@@ -742,7 +762,7 @@ public:
             ruleresult->clear();
           }
         }
-        result = static_cast<DNSResponseAction::Action>(ret);
+        result = getResponseActionFromLua(ret);
       }
       dnsdist::handleQueuedAsynchronousEvents();
       return result;
@@ -804,7 +824,7 @@ public:
         }
       }
       dnsdist::handleQueuedAsynchronousEvents();
-      return static_cast<DNSResponseAction::Action>(ret);
+      return getResponseActionFromLua(ret);
     }
     catch (const std::exception& e) {
       warnlog("LuaFFIPerThreadResponseAction failed inside Lua, returning ServFail: %s", e.what());
@@ -1543,12 +1563,16 @@ class DnstapLogAction : public DNSAction, public boost::noncopyable
 {
 public:
   // this action does not stop the processing
-  DnstapLogAction(std::string identity, std::shared_ptr<RemoteLoggerInterface>& logger, boost::optional<std::function<void(DNSQuestion*, DnstapMessage*)>> alterFunc) :
-    d_identity(std::move(identity)), d_logger(logger), d_alterFunc(std::move(alterFunc))
+  DnstapLogAction(std::string identity, std::shared_ptr<RemoteLoggerInterface>& logger, boost::optional<std::function<void(DNSQuestion*, DnstapMessage*)>> alterFunc, uint32_t sampleRate) :
+    d_identity(std::move(identity)), d_logger(logger), d_alterFunc(std::move(alterFunc)), d_sampleRate(sampleRate)
   {
   }
   DNSAction::Action operator()(DNSQuestion* dnsquestion, std::string* ruleresult) const override
   {
+    if (!dnsdist::remotelogging::isSampled(dnsquestion->ids.origRemote, dnsquestion->ids.qname, d_sampleRate)) {
+      return Action::None;
+    }
+
     static thread_local std::string data;
     data.clear();
 
@@ -1576,6 +1600,7 @@ private:
   std::string d_identity;
   std::shared_ptr<RemoteLoggerInterface> d_logger;
   boost::optional<std::function<void(DNSQuestion*, DnstapMessage*)>> d_alterFunc;
+  uint32_t d_sampleRate;
 };
 
 namespace
@@ -1636,6 +1661,8 @@ struct RemoteLogActionConfiguration
   std::string serverID;
   std::string ipEncryptKey;
   std::optional<std::string> exportExtendedErrorsToMeta{std::nullopt};
+  std::shared_ptr<dnsdist::remotelogging::Aggregator> aggregator{nullptr};
+  uint32_t sampleRate{0};
   bool includeCNAME{false};
 };
 
@@ -1644,12 +1671,20 @@ class RemoteLogAction : public DNSAction, public boost::noncopyable
 public:
   // this action does not stop the processing
   RemoteLogAction(RemoteLogActionConfiguration& config) :
-    d_tagsToExport(std::move(config.tagsToExport)), d_metas(std::move(config.metas)), d_logger(config.logger), d_alterFunc(std::move(config.alterQueryFunc)), d_serverID(config.serverID), d_ipEncryptKey(config.ipEncryptKey)
+    d_tagsToExport(std::move(config.tagsToExport)), d_metas(std::move(config.metas)), d_logger(config.logger), d_aggregator(std::move(config.aggregator)), d_alterFunc(std::move(config.alterQueryFunc)), d_serverID(config.serverID), d_ipEncryptKey(config.ipEncryptKey), d_sampleRate(config.sampleRate)
   {
   }
 
   DNSAction::Action operator()(DNSQuestion* dnsquestion, std::string* ruleresult) const override
   {
+    if (!dnsdist::remotelogging::isSampled(dnsquestion->ids.origRemote, dnsquestion->ids.qname, d_sampleRate)) {
+      return Action::None;
+    }
+    if (d_aggregator) {
+      d_aggregator->record(dnsquestion->ids.origRemote, dnsquestion->ids.qname, dnsquestion->ids.qtype, 0);
+      return Action::None;
+    }
+
     if (!dnsquestion->ids.d_protoBufData) {
       dnsquestion->ids.d_protoBufData = std::make_unique<InternalQueryState::ProtoBufData>();
     }
@@ -1688,16 +1723,18 @@ public:
   }
   [[nodiscard]] std::string toString() const override
   {
-    return "remote log to " + (d_logger ? d_logger->toString() : "");
+    return std::string(d_aggregator ? "aggregated " : "") + "remote log to " + (d_logger ? d_logger->toString() : "");
   }
 
 private:
   std::optional<std::unordered_set<std::string>> d_tagsToExport;
   std::vector<std::pair<std::string, ProtoBufMetaKey>> d_metas;
   std::shared_ptr<RemoteLoggerInterface> d_logger;
+  std::shared_ptr<dnsdist::remotelogging::Aggregator> d_aggregator;
   boost::optional<std::function<void(DNSQuestion*, DNSDistProtoBufMessage*)>> d_alterFunc;
   std::string d_serverID;
   std::string d_ipEncryptKey;
+  uint32_t d_sampleRate;
 };
 
 #endif /* DISABLE_PROTOBUF */
@@ -1756,12 +1793,16 @@ class DnstapLogResponseAction : public DNSResponseAction, public boost::noncopya
 {
 public:
   // this action does not stop the processing
-  DnstapLogResponseAction(std::string identity, std::shared_ptr<RemoteLoggerInterface>& logger, boost::optional<std::function<void(DNSResponse*, DnstapMessage*)>> alterFunc) :
-    d_identity(std::move(identity)), d_logger(logger), d_alterFunc(std::move(alterFunc))
+  DnstapLogResponseAction(std::string identity, std::shared_ptr<RemoteLoggerInterface>& logger, boost::optional<std::function<void(DNSResponse*, DnstapMessage*)>> alterFunc, uint32_t sampleRate) :
+    d_identity(std::move(identity)), d_logger(logger), d_alterFunc(std::move(alterFunc)), d_sampleRate(sampleRate)
   {
   }
   DNSResponseAction::Action operator()(DNSResponse* response, std::string* ruleresult) const override
   {
+    if (!dnsdist::remotelogging::isSampled(response->ids.origRemote, response->ids.qname, d_sampleRate)) {
+      return Action::None;
+    }
+
     static thread_local std::string data;
     struct timespec now = {};
     gettime(&now, true);
@@ -1791,6 +1832,7 @@ private:
   std::string d_identity;
   std::shared_ptr<RemoteLoggerInterface> d_logger;
   boost::optional<std::function<void(DNSResponse*, DnstapMessage*)>> d_alterFunc;
+  uint32_t d_sampleRate;
 };
 
 class RemoteLogResponseAction : public DNSResponseAction, public boost::noncopyable
@@ -1798,11 +1840,19 @@ class RemoteLogResponseAction : public DNSResponseAction, public boost::noncopya
 public:
   // this action does not stop the processing
   RemoteLogResponseAction(RemoteLogActionConfiguration& config) :
-    d_tagsToExport(std::move(config.tagsToExport)), d_metas(std::move(config.metas)), d_logger(config.logger), d_alterFunc(std::move(config.alterResponseFunc)), d_serverID(config.serverID), d_ipEncryptKey(config.ipEncryptKey), d_exportExtendedErrorsToMeta(std::move(config.exportExtendedErrorsToMeta)), d_includeCNAME(config.includeCNAME)
+    d_tagsToExport(std::move(config.tagsToExport)), d_metas(std::move(config.metas)), d_logger(config.logger), d_aggregator(std::move(config.aggregator)), d_alterFunc(std::move(config.alterResponseFunc)), d_serverID(config.serverID), d_ipEncryptKey(config.ipEncryptKey), d_exportExtendedErrorsToMeta(std::move(config.exportExtendedErrorsToMeta)), d_sampleRate(config.sampleRate), d_includeCNAME(config.includeCNAME)
   {
   }
   DNSResponseAction::Action operator()(DNSResponse* response, std::string* ruleresult) const override
   {
+    if (!dnsdist::remotelogging::isSampled(response->ids.origRemote, response->ids.qname, d_sampleRate)) {
+      return Action::None;
+    }
+    if (d_aggregator) {
+      d_aggregator->record(response->ids.origRemote, response->ids.qname, response->ids.qtype, response->getHeader()->rcode);
+      return Action::None;
+    }
+
     if (!response->ids.d_protoBufData) {
       response->ids.d_protoBufData = std::make_unique<InternalQueryState::ProtoBufData>();
     }
@@ -1845,17 +1895,19 @@ public:
   }
   [[nodiscard]] std::string toString() const override
   {
-    return "remote log response to " + (d_logger ? d_logger->toString() : "");
+    return std::string(d_aggregator ? "aggregated " : "") + "remote log response to " + (d_logger ? d_logger->toString() : "");
   }
 
 private:
   std::optional<std::unordered_set<std::string>> d_tagsToExport;
   std::vector<std::pair<std::string, ProtoBufMetaKey>> d_metas;
   std::shared_ptr<RemoteLoggerInterface> d_logger;
+  std::shared_ptr<dnsdist::remotelogging::Aggregator> d_aggregator;
   boost::optional<std::function<void(DNSResponse*, DNSDistProtoBufMessage*)>> d_alterFunc;
   std::string d_serverID;
   std::string d_ipEncryptKey;
   std::optional<std::string> d_exportExtendedErrorsToMeta{std::nullopt};
+  uint32_t d_sampleRate;
   bool d_includeCNAME;
 };
 
@@ -2375,7 +2427,7 @@ private:
 };
 
 template <typename T, typename ActionT>
-static void addAction(GlobalStateHolder<vector<T>>* someRuleActions, const luadnsrule_t& var, const std::shared_ptr<ActionT>& action, boost::optional<luaruleparams_t>& params)
+static void addAction(GlobalStateHolder<T>* someRuleActions, const luadnsrule_t& var, const std::shared_ptr<ActionT>& action, boost::optional<luaruleparams_t>& params)
 {
   setLuaSideEffect();
 
@@ -2386,7 +2438,7 @@ static void addAction(GlobalStateHolder<vector<T>>* someRuleActions, const luadn
   checkAllParametersConsumed("addAction", params);
 
   auto rule = makeRule(var, "addAction");
-  someRuleActions->modify([&rule, &action, &uuid, creationOrder, &name](vector<T>& ruleactions) {
+  someRuleActions->modify([&rule, &action, &uuid, creationOrder, &name](T& ruleactions) {
     ruleactions.push_back({std::move(rule), std::move(action), std::move(name), uuid, creationOrder});
   });
 }
@@ -2401,6 +2453,51 @@ static void parseResponseConfig(boost::optional<responseParams_t>& vars, dnsdist
   getOptionalValue<bool>(vars, "ra", config.setRA);
 }
 
+#ifndef DISABLE_PROTOBUF
+/* sampling and aggregation options, common to RemoteLogAction and RemoteLogResponseAction */
+static void parseRemoteLogSamplingOptions(const std::string& func, boost::optional<LuaAssociativeTable<std::string>>& vars, RemoteLogActionConfiguration& config, bool responses)
+{
+  getOptionalIntegerValue(func, vars, "sampleRate", config.sampleRate);
+  uint32_t interval{0};
+  getOptionalIntegerValue(func, vars, "aggregationInterval", interval);
+  dnsdist::remotelogging::Aggregator::Configuration aggregation;
+  int v4Prefix{aggregation.d_v4Prefix};
+  int v6Prefix{aggregation.d_v6Prefix};
+  getOptionalIntegerValue(func, vars, "aggregationV4Prefix", v4Prefix);
+  getOptionalIntegerValue(func, vars, "aggregationV6Prefix", v6Prefix);
+  getOptionalIntegerValue(func, vars, "aggregationMaxEntries", aggregation.d_maxEntries);
+  if (v4Prefix < 0 || v4Prefix > 32) {
+    throw std::runtime_error("Invalid value " + std::to_string(v4Prefix) + " for 'aggregationV4Prefix' in " + func + ", it should be between 0 and 32");
+  }
+  if (v6Prefix < 0 || v6Prefix > 128) {
+    throw std::runtime_error("Invalid value " + std::to_string(v6Prefix) + " for 'aggregationV6Prefix' in " + func + ", it should be between 0 and 128");
+  }
+  aggregation.d_v4Prefix = static_cast<uint8_t>(v4Prefix);
+  aggregation.d_v6Prefix = static_cast<uint8_t>(v6Prefix);
+  if (interval > 0) {
+    if (!config.ipEncryptKey.empty()) {
+      /* the summaries carry the network of the client subnet, which would otherwise be exported in clear */
+      throw std::runtime_error("The 'ipEncryptKey' and 'aggregationInterval' options of " + func + " cannot be used together");
+    }
+    /* the summaries are not built from a query or a response, so these would silently be ignored */
+    if (config.alterQueryFunc || config.alterResponseFunc) {
+      throw std::runtime_error("An alter function cannot be set when the 'aggregationInterval' option of " + func + " is used");
+    }
+    if (!config.metas.empty() || config.exportExtendedErrorsToMeta) {
+      throw std::runtime_error("Metas cannot be exported when the 'aggregationInterval' option of " + func + " is used");
+    }
+    if (config.tagsToExport) {
+      throw std::runtime_error("The 'exportTags' and 'aggregationInterval' options of " + func + " cannot be used together");
+    }
+    aggregation.d_interval = interval;
+    aggregation.d_logger = config.logger;
+    aggregation.d_serverID = config.serverID;
+    aggregation.d_responses = responses;
+    config.aggregator = dnsdist::remotelogging::Aggregator::create(std::move(aggregation));
+  }
+}
+#endif /* DISABLE_PROTOBUF */
+
 // NOLINTNEXTLINE(readability-function-cognitive-complexity): this function declares Lua bindings, even with a good refactoring it will likely blow up the threshold
 void setupLuaActions(LuaContext& luaCtx)
 {
@@ -2750,6 +2847,8 @@ void setupLuaActions(LuaContext& luaCtx)
       }
     }
 
+    parseRemoteLogSamplingOptions("RemoteLogAction", vars, config, false);
+
     checkAllParametersConsumed("RemoteLogAction", vars);
 
     return std::shared_ptr<DNSAction>(new RemoteLogAction(config));
@@ -2792,17 +2891,25 @@ void setupLuaActions(LuaContext& luaCtx)
       }
     }
 
+    parseRemoteLogSamplingOptions("RemoteLogResponseAction", vars, config, true);
+
     checkAllParametersConsumed("RemoteLogResponseAction", vars);
 
     return std::shared_ptr<DNSResponseAction>(new RemoteLogResponseAction(config));
   });
 
-  luaCtx.writeFunction("DnstapLogAction", [](const std::string& identity, std::shared_ptr<RemoteLoggerInterface> logger, boost::optional<std::function<void(DNSQuestion*, DnstapMessage*)>> alterFunc) {
-    return std::shared_ptr<DNSAction>(new DnstapLogAction(identity, logger, std::move(alterFunc)));
+  luaCtx.writeFunction("DnstapLogAction", [](const std::string& identity, std::shared_ptr<RemoteLoggerInterface> logger, boost::optional<std::function<void(DNSQuestion*, DnstapMessage*)>> alterFunc, boost::optional<LuaAssociativeTable<std::string>> vars) {
+    uint32_t sampleRate{0};
+    getOptionalIntegerValue("DnstapLogAction", vars, "sampleRate", sampleRate);
+    checkAllParametersConsumed("DnstapLogAction", vars);
+    return std::shared_ptr<DNSAction>(new DnstapLogAction(identity, logger, std::move(alterFunc), sampleRate));
   });
 
-  luaCtx.writeFunction("DnstapLogResponseAction", [](const std::string& identity, std::shared_ptr<RemoteLoggerInterface> logger, boost::optional<std::function<void(DNSResponse*, DnstapMessage*)>> alterFunc) {
-    return std::shared_ptr<DNSResponseAction>(new DnstapLogResponseAction(identity, logger, std::move(alterFunc)));
+  luaCtx.writeFunction("DnstapLogResponseAction", [](const std::string& identity, std::shared_ptr<RemoteLoggerInterface> logger, boost::optional<std::function<void(DNSResponse*, DnstapMessage*)>> alterFunc, boost::optional<LuaAssociativeTable<std::string>> vars) {
+    uint32_t sampleRate{0};
+    getOptionalIntegerValue("DnstapLogResponseAction", vars, "sampleRate", sampleRate);
+    checkAllParametersConsumed("DnstapLogResponseAction", vars);
+    return std::shared_ptr<DNSResponseAction>(new DnstapLogResponseAction(identity, logger, std::move(alterFunc), sampleRate));
   });
 #endif /* DISABLE_PROTOBUF */
 
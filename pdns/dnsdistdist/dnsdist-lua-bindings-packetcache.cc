@@ -22,13 +22,46 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <thread>
 
 #include "config.h"
 #include "dnsdist.hh"
 #include "dnsdist-lua.hh"
+#include "threadname.hh"
 
 #include <boost/lexical_cast.hpp>
 
+/* the dump is written to a temporary file first, synced to disk, then renamed, so that a partial dump is never loaded */
+static uint64_t dumpPacketCacheToFile(const std::shared_ptr<DNSDistPacketCache>& cache, const std::string& fname)
+{
+  std::string tmpName = fname + ".XXXXXX";
+  int fileDesc = mkstemp(tmpName.data());
+  if (fileDesc < 0) {
+    throw std::runtime_error("Error opening '" + tmpName + "' for writing: " + stringerror());
+  }
+
+  uint64_t records = 0;
+  try {
+    records = cache->dumpBinary(fileDesc);
+    if (fsync(fileDesc) != 0) {
+      throw std::runtime_error("Error syncing '" + tmpName + "' to disk: " + stringerror());
+    }
+  }
+  catch (const std::exception& e) {
+    close(fileDesc);
+    unlink(tmpName.c_str());
+    throw;
+  }
+
+  close(fileDesc);
+  if (rename(tmpName.c_str(), fname.c_str()) != 0) {
+    auto error = stringerror();
+    unlink(tmpName.c_str());
+    throw std::runtime_error("Error renaming '" + tmpName + "' to '" + fname + "': " + error);
+  }
+  return records;
+}
+
 void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
 {
   /* PacketCache */
@@ -46,6 +79,11 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
     bool deferrableInsertLock = true;
     bool ecsParsing = false;
     bool cookieHashing = false;
+    bool lockFree = false;
+    size_t lockFreeEntrySize = 512;
+    bool collapseQueries = false;
+    size_t collapsingMaxWaiting = 100;
+    size_t collapsingTimeout = 1000;
     LuaArray<uint16_t> skipOptions;
     std::unordered_set<uint16_t> optionsToSkip{EDNSOptionCode::COOKIE};
 
@@ -61,6 +99,11 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
     getOptionalValue<size_t>(vars, "temporaryFailureTTL", tempFailTTL);
     getOptionalValue<bool>(vars, "cookieHashing", cookieHashing);
     getOptionalValue<size_t>(vars, "maximumEntrySize", maxEntrySize);
+    getOptionalValue<bool>(vars, "lockFree", lockFree);
+    getOptionalValue<size_t>(vars, "lockFreeEntrySize", lockFreeEntrySize);
+    getOptionalValue<bool>(vars, "collapseQueries", collapseQueries);
+    getOptionalValue<size_t>(vars, "collapsingMaxWaiting", collapsingMaxWaiting);
+    getOptionalValue<size_t>(vars, "collapsingTimeout", collapsingTimeout);
 
     if (getOptionalValue<decltype(skipOptions)>(vars, "skipOptions", skipOptions) > 0) {
       for (const auto& option : skipOptions) {
@@ -74,6 +117,10 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
 
     checkAllParametersConsumed("newPacketCache", vars);
 
+    if (collapsingTimeout > std::numeric_limits<uint32_t>::max()) {
+      throw std::runtime_error("Error creating the packet cache: the value of collapsingTimeout (" + std::to_string(collapsingTimeout) + ") is too large");
+    }
+
     if (maxEntries < numberOfShards) {
       warnlog("The number of entries (%d) in the packet cache is smaller than the number of shards (%d), decreasing the number of shards to %d", maxEntries, numberOfShards, maxEntries);
       g_outputBuffer += "The number of entries (" + std::to_string(maxEntries) + " in the packet cache is smaller than the number of shards (" + std::to_string(numberOfShards) + "), decreasing the number of shards to " + std::to_string(maxEntries);
@@ -92,6 +139,17 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
     if (maxEntrySize >= sizeof(dnsheader)) {
       res->setMaximumEntrySize(maxEntrySize);
     }
+    if (lockFree) {
+      try {
+        res->enableLockFreeEngine(lockFreeEntrySize);
+      }
+      catch (const std::exception& exp) {
+        throw std::runtime_error(std::string("Error creating the packet cache: ") + exp.what());
+      }
+    }
+    if (collapseQueries && collapsingMaxWaiting > 0) {
+      res->setCollapsing(collapsingMaxWaiting, static_cast<uint32_t>(collapsingTimeout));
+    }
 
     return res;
   });
@@ -224,5 +282,78 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
         g_outputBuffer += "Dumped " + std::to_string(records) + " records\n";
       }
     });
+
+  luaCtx.registerFunction<void(std::shared_ptr<DNSDistPacketCache>::*)(const std::string& fname, boost::optional<LuaAssociativeTable<bool>> vars)const>("dumpCache", [](const std::shared_ptr<DNSDistPacketCache>& cache, const std::string& fname, boost::optional<LuaAssociativeTable<bool>> vars) {
+    if (!cache) {
+      return;
+    }
+
+    bool background = false;
+    getOptionalValue<bool>(vars, "background", background);
+    checkAllParametersConsumed("dumpCache", vars);
+
+    if (!cache->startDump()) {
+      g_outputBuffer += "A dump of this cache is already in progress\n";
+      return;
+    }
+
+    if (!background) {
+      uint64_t records = 0;
+      try {
+        records = dumpPacketCacheToFile(cache, fname);
+      }
+      catch (...) {
+        cache->finishDump();
+        throw;
+      }
+      cache->finishDump();
+      g_outputBuffer += "Dumped " + std::to_string(records) + " records\n";
+      return;
+    }
+
+    try {
+      std::thread dumper([cache, fname]() {
+        setThreadName("dnsdist/pcDump");
+        try {
+          auto records = dumpPacketCacheToFile(cache, fname);
+          infolog("Dumped %d packet cache records to %s", records, fname);
+        }
+        catch (const std::exception& e) {
+          warnlog("Error while dumping the packet cache to %s: %s", fname, e.what());
+        }
+        cache->finishDump();
+      });
+      dumper.detach();
+    }
+    catch (...) {
+      cache->finishDump();
+      throw;
+    }
+  });
+
+  luaCtx.registerFunction<uint64_t(std::shared_ptr<DNSDistPacketCache>::*)(const std::string& fname)>("loadCache", [client](const std::shared_ptr<DNSDistPacketCache>& cache, const std::string& fname) -> uint64_t {
+    if (!cache || client) {
+      return 0;
+    }
+
+    int fileDesc = open(fname.c_str(), O_RDONLY);
+    if (fileDesc < 0) {
+      warnlog("Error opening the packet cache dump %s for reading: %s", fname, stringerror());
+      return 0;
+    }
+
+    uint64_t records = 0;
+    try {
+      records = cache->load(fileDesc);
+    }
+    catch (const std::exception& e) {
+      close(fileDesc);
+      throw;
+    }
+    close(fileDesc);
+
+    infolog("Loaded %d packet cache records from %s", records, fname);
+    return records;
+  });
 #endif /* DISABLE_PACKETCACHE_BINDINGS */
 }
@@ -81,13 +81,14 @@ void setupLuaBindings(LuaContext& luaCtx, bool client, bool configCheck)
   luaCtx.registerFunction("toString", &ServerPolicy::toString);
   luaCtx.registerFunction("__tostring", &ServerPolicy::toString);
 
-  const std::array<std::shared_ptr<ServerPolicy>, 6> policies = {
+  const std::array<std::shared_ptr<ServerPolicy>, 7> policies = {
     std::make_shared<ServerPolicy>("firstAvailable", firstAvailable, false),
     std::make_shared<ServerPolicy>("roundrobin", roundrobin, false),
     std::make_shared<ServerPolicy>("wrandom", wrandom, false),
     std::make_shared<ServerPolicy>("whashed", whashed, false),
     std::make_shared<ServerPolicy>("chashed", chashed, false),
-    std::make_shared<ServerPolicy>("leastOutstanding", leastOutstanding, false)};
+    std::make_shared<ServerPolicy>("leastOutstanding", leastOutstanding, false),
+    std::make_shared<ServerPolicy>("p2cPeakEWMA", p2cPeakEWMA, false)};
   for (const auto& policy : policies) {
     luaCtx.writeVariable(policy->d_name, policy);
   }
@@ -519,6 +520,8 @@ void setupLuaBindings(LuaContext& luaCtx, bool client, bool configCheck)
     convertParamsToConfig("qnames", BPFFilter::MapType::QNames);
     convertParamsToConfig("cidr4", BPFFilter::MapType::CIDR4);
     convertParamsToConfig("cidr6", BPFFilter::MapType::CIDR6);
+    convertParamsToConfig("ratelimitConfig", BPFFilter::MapType::RateLimitConfig);
+    convertParamsToConfig("ratelimitStats", BPFFilter::MapType::RateLimitStats);
 
     BPFFilter::MapFormat format = BPFFilter::MapFormat::Legacy;
     bool external = false;
@@ -663,10 +666,64 @@ void setupLuaBindings(LuaContext& luaCtx, bool client, bool configCheck)
       for (const auto& value : qstats) {
         res += std::get<0>(value).toString() + " " + std::to_string(std::get<1>(value)) + ": " + std::to_string(std::get<2>(value)) + "\n";
       }
+      if (bpf->supportsRateLimiting()) {
+        for (const auto& [name, stage] : {std::pair{"sources", BPFFilter::RateLimitStage::Sources}, std::pair{"suffixes", BPFFilter::RateLimitStage::Suffixes}}) {
+          const auto counters = bpf->getRateLimitCounters(stage);
+          res += std::string("rate-limited ") + name + ": " + std::to_string(counters.d_limited) + " (passed " + std::to_string(counters.d_passed) + ")\n";
+        }
+      }
     }
     return res;
   });
 
+  // NOLINTNEXTLINE(performance-unnecessary-value-param): optional parameters cannot be passed by const reference
+  luaCtx.registerFunction<void (std::shared_ptr<BPFFilter>::*)(const std::string&, uint32_t, boost::optional<uint32_t>, boost::optional<LuaAssociativeTable<uint32_t>>)>("setRateLimit", [](const std::shared_ptr<BPFFilter>& bpf, const std::string& stageName, uint32_t rate, boost::optional<uint32_t> burst, boost::optional<LuaAssociativeTable<uint32_t>> vars) {
+    if (!bpf) {
+      return;
+    }
+    BPFFilter::RateLimitStage stage{};
+    if (stageName == "sources") {
+      stage = BPFFilter::RateLimitStage::Sources;
+    }
+    else if (stageName == "suffixes") {
+      stage = BPFFilter::RateLimitStage::Suffixes;
+    }
+    else {
+      throw std::runtime_error("Unsupported stage '" + stageName + "' for BPFFilter::setRateLimit, should be 'sources' or 'suffixes'");
+    }
+
+    BPFFilter::RateLimitSettings settings;
+    settings.d_rate = rate;
+    settings.d_burst = burst ? *burst : rate;
+    uint32_t value = 0;
+    if (getOptionalValue<uint32_t>(vars, "v4Mask", value) > 0) {
+      settings.d_v4Mask = static_cast<uint8_t>(std::min(value, 255U));
+    }
+    if (getOptionalValue<uint32_t>(vars, "v6Mask", value) > 0) {
+      settings.d_v6Mask = static_cast<uint8_t>(std::min(value, 255U));
+    }
+    if (getOptionalValue<uint32_t>(vars, "labels", value) > 0) {
+      settings.d_suffixLabels = static_cast<uint8_t>(std::min(value, 255U));
+    }
+    if (getOptionalValue<uint32_t>(vars, "action", value) > 0) {
+      switch (value) {
+      case 0:
+        settings.d_action = BPFFilter::MatchAction::Pass;
+        break;
+      case 1:
+        settings.d_action = BPFFilter::MatchAction::Drop;
+        break;
+      case 2:
+        settings.d_action = BPFFilter::MatchAction::Truncate;
+        break;
+      default:
+        throw std::runtime_error("Unsupported action for BPFFilter::setRateLimit");
+      }
+    }
+    checkAllParametersConsumed("setRateLimit", vars);
+    bpf->setRateLimit(stage, settings);
+  });
+
   luaCtx.registerFunction<void (std::shared_ptr<BPFFilter>::*)()>("attachToAllBinds", [](std::shared_ptr<BPFFilter>& bpf) {
     std::string res;
     if (!g_configurationDone) {
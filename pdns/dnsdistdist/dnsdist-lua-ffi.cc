@@ -1467,20 +1467,12 @@ size_t dnsdist_ffi_ring_get_entries(dnsdist_ffi_ring_entry_list_t** out)
   };
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    {
-      auto ql = shard->queryRing.lock();
-      for (const auto& entry : *ql) {
-        addRingEntryToList(list, now, entry);
-      }
-    }
-    {
-      auto rl = shard->respRing.lock();
-      for (const auto& entry : *rl) {
-        addRingEntryToList(list, now, entry);
-      }
-    }
-  }
+  g_rings.visitQueries([&list, &now](const Rings::Query& entry) {
+    addRingEntryToList(list, now, entry);
+  });
+  g_rings.visitResponses([&list, &now](const Rings::Response& entry) {
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -1514,28 +1506,20 @@ size_t dnsdist_ffi_ring_get_entries_by_addr(const char* addr, dnsdist_ffi_ring_e
   gettime(&now);
 
   auto compare = ComboAddress::addressOnlyEqual();
-  for (const auto& shard : g_rings.d_shards) {
-    {
-      auto ql = shard->queryRing.lock();
-      for (const auto& entry : *ql) {
-        if (!compare(entry.requestor, ca)) {
-          continue;
-        }
-
-        addRingEntryToList(list, now, entry);
-      }
+  g_rings.visitQueries([&list, &now, &compare, &ca](const Rings::Query& entry) {
+    if (!compare(entry.requestor, ca)) {
+      return;
     }
-    {
-      auto rl = shard->respRing.lock();
-      for (const auto& entry : *rl) {
-        if (!compare(entry.requestor, ca)) {
-          continue;
-        }
-
-        addRingEntryToList(list, now, entry);
-      }
+
+    addRingEntryToList(list, now, entry);
+  });
+  g_rings.visitResponses([&list, &now, &compare, &ca](const Rings::Response& entry) {
+    if (!compare(entry.requestor, ca)) {
+      return;
     }
-  }
+
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -1559,16 +1543,13 @@ size_t dnsdist_ffi_ring_get_entries_by_mac(const char* addr, dnsdist_ffi_ring_en
   };
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto ql = shard->queryRing.lock();
-    for (const auto& entry : *ql) {
-      if (memcmp(addr, entry.macaddress.data(), entry.macaddress.size()) != 0) {
-        continue;
-      }
-
-      addRingEntryToList(list, now, entry);
+  g_rings.visitQueries([&list, &now, addr](const Rings::Query& entry) {
+    if (memcmp(addr, entry.macaddress.data(), entry.macaddress.size()) != 0) {
+      return;
     }
-  }
+
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -26,6 +26,7 @@
 #include "dnsdist-dynblocks.hh"
 #include "dnsdist-nghttp2.hh"
 #include "dnsdist-rings.hh"
+#include "dnsdist-sketches.hh"
 #include "dnsdist-tcp.hh"
 
 #include "statnode.hh"
@@ -37,31 +38,20 @@ static LuaArray<std::vector<boost::variant<string, double>>> getGenResponses(uin
   map<DNSName, unsigned int> counts;
   unsigned int total = 0;
   {
-    for (const auto& shard : g_rings.d_shards) {
-      auto respRing = shard->respRing.lock();
+    g_rings.visitResponses([&counts, &total, &labels, &pred](const Rings::Response& entry) {
+      if (!pred(entry)) {
+        return;
+      }
       if (!labels) {
-        for (const auto& entry : *respRing) {
-          if (!pred(entry)) {
-            continue;
-          }
-          counts[entry.name]++;
-          total++;
-        }
+        counts[entry.name]++;
       }
       else {
-        unsigned int lab = *labels;
-        for (const auto& entry : *respRing) {
-          if (!pred(entry)) {
-            continue;
-          }
-
-          DNSName temp(entry.name);
-          temp.trimToLabels(lab);
-          counts[temp]++;
-          total++;
-        }
+        DNSName temp(entry.name);
+        temp.trimToLabels(*labels);
+        counts[temp]++;
       }
-    }
+      total++;
+    });
   }
   //      cout<<"Looked at "<<total<<" responses, "<<counts.size()<<" different ones"<<endl;
   vector<pair<unsigned int, DNSName>> rcounts;
@@ -128,22 +118,18 @@ static void statNodeRespRing(statvisitor_t visitor, uint64_t seconds)
   cutoff.tv_sec -= static_cast<time_t>(seconds);
 
   StatNode root;
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-
-    for (const auto& entry : *respRing) {
-      if (now < entry.when) {
-        continue;
-      }
-
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
+  g_rings.visitResponses([&root, &now, &cutoff, seconds](const Rings::Response& entry) {
+    if (now < entry.when) {
+      return;
+    }
 
-      const bool hit = entry.isACacheHit();
-      root.submit(entry.name, ((entry.dh.rcode == 0 && entry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : entry.dh.rcode), entry.size, hit, boost::none);
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
     }
-  }
+
+    const bool hit = entry.isACacheHit();
+    root.submit(entry.name, ((entry.dh.rcode == 0 && entry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : entry.dh.rcode), entry.size, hit, boost::none);
+  });
 
   StatNode::Stat node;
   root.visit([visitor = std::move(visitor)](const StatNode* node_, const StatNode::Stat& self, const StatNode::Stat& children) { visitor(*node_, self, children); }, node);
@@ -154,21 +140,17 @@ static LuaArray<LuaAssociativeTable<std::string>> getRespRing(boost::optional<in
   using entry_t = LuaAssociativeTable<std::string>;
   LuaArray<entry_t> ret;
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-
-    int count = 1;
-    for (const auto& entry : *respRing) {
-      if (rcode && (rcode.get() != entry.dh.rcode)) {
-        continue;
-      }
-      entry_t newEntry;
-      newEntry["qname"] = entry.name.toString();
-      newEntry["rcode"] = std::to_string(entry.dh.rcode);
-      ret.emplace_back(count, std::move(newEntry));
-      count++;
+  int count = 1;
+  g_rings.visitResponses([&ret, &count, &rcode](const Rings::Response& entry) {
+    if (rcode && (rcode.get() != entry.dh.rcode)) {
+      return;
     }
-  }
+    entry_t newEntry;
+    newEntry["qname"] = entry.name.toString();
+    newEntry["rcode"] = std::to_string(entry.dh.rcode);
+    ret.emplace_back(count, std::move(newEntry));
+    count++;
+  });
 
   return ret;
 }
@@ -184,23 +166,19 @@ static counts_t exceedRespGen(unsigned int rate, int seconds, const std::functio
 
   counts.reserve(g_rings.getNumberOfResponseEntries());
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-    for (const auto& entry : *respRing) {
-
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
-      if (now < entry.when) {
-        continue;
-      }
+  g_rings.visitResponses([&](const Rings::Response& entry) {
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
+    }
+    if (now < entry.when) {
+      return;
+    }
 
-      visitor(counts, entry);
-      if (entry.when < mintime) {
-        mintime = entry.when;
-      }
+    visitor(counts, entry);
+    if (entry.when < mintime) {
+      mintime = entry.when;
     }
-  }
+  });
 
   double delta = seconds != 0 ? seconds : DiffTime(now, mintime);
   return filterScore(counts, delta, rate);
@@ -217,21 +195,18 @@ static counts_t exceedQueryGen(unsigned int rate, int seconds, const std::functi
 
   counts.reserve(g_rings.getNumberOfQueryEntries());
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->queryRing.lock();
-    for (const auto& entry : *respRing) {
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
-      if (now < entry.when) {
-        continue;
-      }
-      visitor(counts, entry);
-      if (entry.when < mintime) {
-        mintime = entry.when;
-      }
+  g_rings.visitQueries([&](const Rings::Query& entry) {
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
     }
-  }
+    if (now < entry.when) {
+      return;
+    }
+    visitor(counts, entry);
+    if (entry.when < mintime) {
+      mintime = entry.when;
+    }
+  });
 
   double delta = seconds != 0 ? seconds : DiffTime(now, mintime);
   return filterScore(counts, delta, rate);
@@ -391,15 +366,11 @@ void setupLuaInspection(LuaContext& luaCtx)
     uint64_t top = top_ ? *top_ : 10U;
     map<ComboAddress, unsigned int, ComboAddress::addressOnlyLessThan> counts;
     unsigned int total = 0;
-    {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          counts[entry.requestor]++;
-          total++;
-        }
-      }
-    }
+    g_rings.visitQueries([&counts, &total](const Rings::Query& entry) {
+      counts[entry.requestor]++;
+      total++;
+    },
+                         false);
     vector<pair<unsigned int, ComboAddress>> rcounts;
     rcounts.reserve(counts.size());
     for (const auto& entry : counts) {
@@ -427,27 +398,17 @@ void setupLuaInspection(LuaContext& luaCtx)
     setLuaNoSideEffect();
     map<DNSName, unsigned int> counts;
     unsigned int total = 0;
-    if (!labels) {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          counts[entry.name]++;
-          total++;
-        }
+    g_rings.visitQueries([&counts, &total, &labels](const Rings::Query& entry) {
+      if (!labels) {
+        counts[entry.name]++;
       }
-    }
-    else {
-      unsigned int lab = *labels;
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          auto name = entry.name;
-          name.trimToLabels(lab);
-          counts[name]++;
-          total++;
-        }
+      else {
+        auto name = entry.name;
+        name.trimToLabels(*labels);
+        counts[name]++;
       }
-    }
+      total++;
+    });
 
     vector<pair<unsigned int, DNSName>> rcounts;
     rcounts.reserve(counts.size());
@@ -483,29 +444,74 @@ void setupLuaInspection(LuaContext& luaCtx)
 
   luaCtx.executeCode(R"(function topQueries(top, labels) top = top or 10; for k,v in ipairs(getTopQueries(top,labels)) do show(string.format("%4d  %-40s %4d %4.1f%%",k,v[1],v[2], v[3])) end end)");
 
-  luaCtx.writeFunction("getResponseRing", []() {
+  luaCtx.writeFunction("getHeavyHitters", [](boost::optional<uint64_t> top) {
     setLuaNoSideEffect();
-    size_t totalEntries = 0;
-    std::vector<boost::circular_buffer<Rings::Response>> rings;
-    rings.reserve(g_rings.getNumberOfShards());
-    for (const auto& shard : g_rings.d_shards) {
-      {
-        auto respRing = shard->respRing.lock();
-        rings.push_back(*respRing);
-      }
-      totalEntries += rings.back().size();
+    LuaAssociativeTable<std::vector<LuaAssociativeTable<boost::variant<std::string, uint64_t>>>> result;
+    const auto& tracker = dnsdist::sketches::g_heavyHitters;
+    if (!tracker) {
+      return result;
     }
-    vector<std::unordered_map<string, boost::variant<string, unsigned int>>> ret;
-    ret.reserve(totalEntries);
-    for (const auto& ring : rings) {
-      for (const auto& entry : ring) {
-        decltype(ret)::value_type item;
-        item["name"] = entry.name.toString();
-        item["qtype"] = entry.qtype;
-        item["rcode"] = entry.dh.rcode;
-        item["usec"] = entry.usec;
-        ret.push_back(std::move(item));
+
+    const size_t numberOfEntries = top ? *top : 10U;
+    const auto now = time(nullptr);
+    auto& clients = result["clients"];
+    for (const auto& entry : tracker->getClients().getTop(numberOfEntries, now)) {
+      clients.push_back({{"key", entry.d_key.toString()}, {"count", entry.d_count}});
+    }
+    auto& suffixes = result["suffixes"];
+    for (const auto& entry : tracker->getSuffixes().getTop(numberOfEntries, now)) {
+      suffixes.push_back({{"key", entry.d_key.toString()}, {"count", entry.d_count}});
+    }
+    auto& qtypes = result["qtypes"];
+    for (const auto& entry : tracker->getQTypes().getTop(numberOfEntries, now)) {
+      qtypes.push_back({{"key", QType(entry.d_key).toString()}, {"count", entry.d_count}});
+    }
+    return result;
+  });
+
+  luaCtx.writeFunction("showHeavyHitters", [](boost::optional<uint64_t> top) {
+    setLuaNoSideEffect();
+    const auto& tracker = dnsdist::sketches::g_heavyHitters;
+    if (!tracker) {
+      g_outputBuffer = "Heavy hitters tracking is not enabled, see setHeavyHittersTracking()\n";
+      return;
+    }
+
+    const size_t numberOfEntries = top ? *top : 10U;
+    const auto now = time(nullptr);
+    const auto window = tracker->getClients().getWindow();
+    boost::format fmt("%4d  %-40s %10d %10.1f\n");
+    auto showTop = [&fmt, window](const std::string& title, const auto& entries, const auto& toString) {
+      g_outputBuffer += title + ":\n";
+      g_outputBuffer += (boost::format("%4s  %-40s %10s %10s\n") % "#" % "Key" % "Queries" % "QPS").str();
+      unsigned int position = 1;
+      for (const auto& entry : entries) {
+        g_outputBuffer += (fmt % (position++) % toString(entry.d_key) % entry.d_count % (static_cast<double>(entry.d_count) / window)).str();
       }
+    };
+
+    g_outputBuffer = "Estimated over the last " + std::to_string(window) + " seconds\n";
+    showTop("Clients", tracker->getClients().getTop(numberOfEntries, now), [](const AddressAndPortRange& key) { return key.toString(); });
+    showTop("Suffixes", tracker->getSuffixes().getTop(numberOfEntries, now), [](const DNSName& key) { return key.toString(); });
+    showTop("QTypes", tracker->getQTypes().getTop(numberOfEntries, now), [](uint16_t key) { return QType(key).toString(); });
+  });
+
+  luaCtx.writeFunction("getResponseRing", []() {
+    setLuaNoSideEffect();
+    std::vector<Rings::Response> responses;
+    responses.reserve(g_rings.getNumberOfResponseEntries());
+    g_rings.visitResponses([&responses](const Rings::Response& entry) {
+      responses.push_back(entry);
+    });
+    vector<std::unordered_map<string, boost::variant<string, unsigned int>>> ret;
+    ret.reserve(responses.size());
+    for (const auto& entry : responses) {
+      decltype(ret)::value_type item;
+      item["name"] = entry.name.toString();
+      item["qtype"] = entry.qtype;
+      item["rcode"] = entry.dh.rcode;
+      item["usec"] = entry.usec;
+      ret.push_back(std::move(item));
     }
     return ret;
   });
@@ -556,20 +562,12 @@ void setupLuaInspection(LuaContext& luaCtx)
     std::vector<Rings::Response> responses;
     queries.reserve(g_rings.getNumberOfQueryEntries());
     responses.reserve(g_rings.getNumberOfResponseEntries());
-    for (const auto& shard : g_rings.d_shards) {
-      {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          queries.push_back(entry);
-        }
-      }
-      {
-        auto respRing = shard->respRing.lock();
-        for (const auto& entry : *respRing) {
-          responses.push_back(entry);
-        }
-      }
-    }
+    g_rings.visitQueries([&queries](const Rings::Query& entry) {
+      queries.push_back(entry);
+    });
+    g_rings.visitResponses([&responses](const Rings::Response& entry) {
+      responses.push_back(entry);
+    });
 
     sort(queries.begin(), queries.end(), [](const decltype(queries)::value_type& lhs, const decltype(queries)::value_type& rhs) {
       return rhs.when < lhs.when;
@@ -665,27 +663,23 @@ void setupLuaInspection(LuaContext& luaCtx)
 
     double totlat = 0;
     unsigned int size = 0;
-    {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->respRing.lock();
-        for (const auto& entry : *respRing) {
-          /* skip actively discovered timeouts */
-          if (entry.usec == std::numeric_limits<unsigned int>::max()) {
-            continue;
-          }
-
-          ++size;
-          auto iter = histo.lower_bound(entry.usec);
-          if (iter != histo.end()) {
-            iter->second++;
-          }
-          else {
-            histo.rbegin()++;
-          }
-          totlat += entry.usec;
-        }
+    g_rings.visitResponses([&histo, &size, &totlat](const Rings::Response& entry) {
+      /* skip actively discovered timeouts */
+      if (entry.usec == std::numeric_limits<unsigned int>::max()) {
+        return;
       }
-    }
+
+      ++size;
+      auto iter = histo.lower_bound(entry.usec);
+      if (iter != histo.end()) {
+        iter->second++;
+      }
+      else {
+        histo.rbegin()++;
+      }
+      totlat += entry.usec;
+    },
+                           false);
 
     if (size == 0) {
       g_outputBuffer = "No traffic yet.\n";
@@ -914,6 +908,14 @@ void setupLuaInspection(LuaContext& luaCtx)
     }
   });
   // NOLINTNEXTLINE(performance-unnecessary-value-param): optional parameters cannot be passed by const reference
+  luaCtx.registerFunction<void (std::shared_ptr<DynBlockRulesGroup>::*)(unsigned int, const std::string&, unsigned int, boost::optional<DNSAction::Action>, boost::optional<unsigned int>, DynamicActionOptionalParameters)>("setHeavyHittersRate", [](std::shared_ptr<DynBlockRulesGroup>& group, unsigned int rate, const std::string& reason, unsigned int blockDuration, boost::optional<DNSAction::Action> action, boost::optional<unsigned int> warningRate, DynamicActionOptionalParameters optionalParameters) {
+    if (group) {
+      DynBlockRulesGroup::DynBlockRule rule(reason, blockDuration, rate, warningRate ? *warningRate : 0, 0, action ? *action : DNSAction::Action::None);
+      parseDynamicActionOptionalParameters("setHeavyHittersRate", rule, action, optionalParameters);
+      group->setHeavyHittersRate(dnsdist::sketches::g_heavyHitters, std::move(rule));
+    }
+  });
+  // NOLINTNEXTLINE(performance-unnecessary-value-param): optional parameters cannot be passed by const reference
   luaCtx.registerFunction<void (std::shared_ptr<DynBlockRulesGroup>::*)(unsigned int, unsigned int, const std::string&, unsigned int, boost::optional<DNSAction::Action>, boost::optional<unsigned int>, DynamicActionOptionalParameters)>("setResponseByteRate", [](std::shared_ptr<DynBlockRulesGroup>& group, unsigned int rate, unsigned int seconds, const std::string& reason, unsigned int blockDuration, boost::optional<DNSAction::Action> action, boost::optional<unsigned int> warningRate, DynamicActionOptionalParameters optionalParameters) {
     if (group) {
       DynBlockRulesGroup::DynBlockRule rule(reason, blockDuration, rate, warningRate ? *warningRate : 0, seconds, action ? *action : DNSAction::Action::None);
@@ -1043,6 +1045,29 @@ void setupLuaInspection(LuaContext& luaCtx)
   luaCtx.registerFunction<void (std::shared_ptr<DynBlockRulesGroup>::*)()>("apply", [](std::shared_ptr<DynBlockRulesGroup>& group) {
     group->apply();
   });
+  luaCtx.registerFunction<void (std::shared_ptr<DynBlockRulesGroup>::*)(boost::optional<unsigned int>)>("enableIncrementalEvaluation", [](std::shared_ptr<DynBlockRulesGroup>& group, boost::optional<unsigned int> windowSeconds) {
+    if (group) {
+      group->enableIncrementalEvaluation(g_rings, windowSeconds ? std::optional<unsigned int>(*windowSeconds) : std::nullopt);
+    }
+  });
+  // NOLINTNEXTLINE(performance-unnecessary-value-param): optional parameters cannot be passed by const reference
+  luaCtx.registerFunction<void (std::shared_ptr<DynBlockRulesGroup>::*)(std::shared_ptr<BPFFilter>, boost::optional<LuaAssociativeTable<uint32_t>>)>("setBPFRateLimits", [](std::shared_ptr<DynBlockRulesGroup>& group, std::shared_ptr<BPFFilter> bpf, boost::optional<LuaAssociativeTable<uint32_t>> vars) {
+    if (!group) {
+      return;
+    }
+    DynBlockRulesGroup::BPFRateLimitOptions options;
+    uint32_t value = 0;
+    getOptionalValue<uint32_t>(vars, "suffixRate", options.d_suffixRate);
+    getOptionalValue<uint32_t>(vars, "suffixSeconds", options.d_suffixSeconds);
+    if (getOptionalValue<uint32_t>(vars, "suffixLabels", value) > 0) {
+      options.d_suffixLabels = static_cast<uint8_t>(std::min(value, 255U));
+    }
+    if (getOptionalValue<uint32_t>(vars, "suffixAction", value) > 0) {
+      options.d_suffixAction = static_cast<DNSAction::Action>(value);
+    }
+    checkAllParametersConsumed("setBPFRateLimits", vars);
+    group->setBPFRateLimits(std::move(bpf), options);
+  });
   luaCtx.registerFunction("setQuiet", &DynBlockRulesGroup::setQuiet);
   luaCtx.registerFunction("toString", &DynBlockRulesGroup::toString);
 
@@ -129,7 +129,7 @@ static std::string rulesToString(const std::vector<T>& rules, boost::optional<ru
 }
 
 template <typename T>
-static void showRules(GlobalStateHolder<vector<T>>* someRuleActions, boost::optional<ruleparams_t>& vars)
+static void showRules(GlobalStateHolder<T>* someRuleActions, boost::optional<ruleparams_t>& vars)
 {
   setLuaNoSideEffect();
 
@@ -138,7 +138,7 @@ static void showRules(GlobalStateHolder<vector<T>>* someRuleActions, boost::opti
 }
 
 template <typename T>
-static void rmRule(GlobalStateHolder<vector<T>>* someRuleActions, const boost::variant<unsigned int, std::string>& ruleID)
+static void rmRule(GlobalStateHolder<T>* someRuleActions, const boost::variant<unsigned int, std::string>& ruleID)
 {
   setLuaSideEffect();
   auto rules = someRuleActions->getCopy();
@@ -147,7 +147,7 @@ static void rmRule(GlobalStateHolder<vector<T>>* someRuleActions, const boost::v
       const auto uuid = getUniqueID(*str);
       auto removeIt = std::remove_if(rules.begin(),
                                      rules.end(),
-                                     [&uuid](const T& rule) { return rule.d_id == uuid; });
+                                     [&uuid](const typename T::value_type& rule) { return rule.d_id == uuid; });
       if (removeIt == rules.end()) {
         g_outputBuffer = "Error: no rule matched\n";
         return;
@@ -159,7 +159,7 @@ static void rmRule(GlobalStateHolder<vector<T>>* someRuleActions, const boost::v
       /* it was not an UUID, let's see if it was a name instead */
       auto removeIt = std::remove_if(rules.begin(),
                                      rules.end(),
-                                     [&str](const T& rule) { return rule.d_name == *str; });
+                                     [&str](const typename T::value_type& rule) { return rule.d_name == *str; });
       if (removeIt == rules.end()) {
         g_outputBuffer = "Error: no rule matched\n";
         return;
@@ -179,7 +179,7 @@ static void rmRule(GlobalStateHolder<vector<T>>* someRuleActions, const boost::v
 }
 
 template <typename T>
-static void moveRuleToTop(GlobalStateHolder<vector<T>>* someRuleActions)
+static void moveRuleToTop(GlobalStateHolder<T>* someRuleActions)
 {
   setLuaSideEffect();
   auto rules = someRuleActions->getCopy();
@@ -193,7 +193,7 @@ static void moveRuleToTop(GlobalStateHolder<vector<T>>* someRuleActions)
 }
 
 template <typename T>
-static void mvRule(GlobalStateHolder<vector<T>>* someRespRuleActions, unsigned int from, unsigned int destination)
+static void mvRule(GlobalStateHolder<T>* someRespRuleActions, unsigned int from, unsigned int destination)
 {
   setLuaSideEffect();
   auto rules = someRespRuleActions->getCopy();
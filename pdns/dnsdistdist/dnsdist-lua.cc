@@ -56,6 +56,7 @@
 #include "dnsdist-proxy-protocol.hh"
 #include "dnsdist-rings.hh"
 #include "dnsdist-secpoll.hh"
+#include "dnsdist-sketches.hh"
 #include "dnsdist-session-cache.hh"
 #include "dnsdist-tcp-downstream.hh"
 #include "dnsdist-web.hh"
@@ -138,13 +139,14 @@ static void parseLocalBindVars(boost::optional<localbind_t>& vars, bool& reusePo
   }
 }
 #ifdef HAVE_XSK
-static void parseXskVars(boost::optional<localbind_t>& vars, std::shared_ptr<XskSocket>& socket)
+static void parseXskVars(boost::optional<localbind_t>& vars, std::shared_ptr<XskSocket>& socket, bool& cacheFastPath)
 {
   if (!vars) {
     return;
   }
 
   getOptionalValue<std::shared_ptr<XskSocket>>(vars, "xskSocket", socket);
+  getOptionalValue<bool>(vars, "xskCacheFastPath", cacheFastPath);
 }
 #endif /* HAVE_XSK */
 
@@ -349,6 +351,7 @@ static void handleNewServerHealthCheckParameters(boost::optional<newserver_t>& v
   getOptionalValue<DownstreamState::checkfunc_t>(vars, "checkFunction", config.checkFunction);
   getOptionalIntegerValue("newServer", vars, "checkTimeout", config.checkTimeout);
   getOptionalValue<bool>(vars, "checkTCP", config.d_tcpCheck);
+  getOptionalValue<bool>(vars, "healthCheckKeepAlive", config.d_healthCheckKeepAlive);
   getOptionalValue<bool>(vars, "setCD", config.setCD);
   getOptionalValue<bool>(vars, "mustResolve", config.mustResolve);
 
@@ -814,10 +817,12 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
 
 #ifdef HAVE_XSK
       std::shared_ptr<XskSocket> socket;
-      parseXskVars(vars, socket);
+      bool xskCacheFastPath = false;
+      parseXskVars(vars, socket, xskCacheFastPath);
       if (socket) {
         udpCS->xskInfo = XskWorker::create();
         udpCS->xskInfo->sharedEmptyFrameOffset = socket->sharedEmptyFrameOffset;
+        udpCS->d_xskCacheFastPath = xskCacheFastPath;
         socket->addWorker(udpCS->xskInfo);
         socket->addWorkerRoute(udpCS->xskInfo, loc);
         vinfolog("Enabling XSK in %s mode for incoming UDP packets to %s", socket->getXDPMode(), loc.toStringWithPort());
@@ -869,10 +874,12 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       }
 #ifdef HAVE_XSK
       std::shared_ptr<XskSocket> socket;
-      parseXskVars(vars, socket);
+      bool xskCacheFastPath = false;
+      parseXskVars(vars, socket, xskCacheFastPath);
       if (socket) {
         udpCS->xskInfo = XskWorker::create();
         udpCS->xskInfo->sharedEmptyFrameOffset = socket->sharedEmptyFrameOffset;
+        udpCS->d_xskCacheFastPath = xskCacheFastPath;
         socket->addWorker(udpCS->xskInfo);
         socket->addWorkerRoute(udpCS->xskInfo, loc);
         vinfolog("Enabling XSK in %s mode for incoming UDP packets to %s", socket->getXDPMode(), loc.toStringWithPort());
@@ -2099,6 +2106,18 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
     }
   });
 
+  luaCtx.writeFunction("setPeakEWMADecayTime", [](uint64_t decayTimeMs) {
+    setLuaSideEffect();
+    if (decayTimeMs > 0) {
+      dnsdist::PeakEWMA::setDecayTime(decayTimeMs * 1000.0);
+    }
+    else {
+      errlog("Invalid value passed to setPeakEWMADecayTime()!");
+      g_outputBuffer = "Invalid value passed to setPeakEWMADecayTime()!\n";
+      return;
+    }
+  });
+
   luaCtx.writeFunction("setRingBuffersSize", [client](uint64_t capacity, boost::optional<uint64_t> numberOfShards) {
     setLuaSideEffect();
     if (!checkConfigurationTime("setRingBuffersSize")) {
@@ -2134,6 +2153,51 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       auto record = boost::get<bool>(options.at("recordResponses"));
       g_rings.setRecordResponses(record);
     }
+    if (options.count("lockFree") > 0) {
+      auto lockFree = boost::get<bool>(options.at("lockFree"));
+      g_rings.setLockFree(lockFree);
+    }
+  });
+
+  luaCtx.writeFunction("setHeavyHittersTracking", [](boost::optional<LuaAssociativeTable<uint64_t>> vars) {
+    setLuaSideEffect();
+    if (!checkConfigurationTime("setHeavyHittersTracking")) {
+      return;
+    }
+    if (dnsdist::sketches::g_heavyHitters) {
+      errlog("setHeavyHittersTracking() cannot be called more than once");
+      g_outputBuffer = "setHeavyHittersTracking() cannot be called more than once\n";
+      return;
+    }
+
+    dnsdist::sketches::HeavyHittersTracker::Options options;
+    getOptionalValue<uint64_t>(vars, "window", options.d_window);
+    getOptionalValue<uint64_t>(vars, "width", options.d_width);
+    getOptionalValue<uint64_t>(vars, "depth", options.d_depth);
+    getOptionalValue<uint64_t>(vars, "capacity", options.d_capacity);
+    uint64_t v4Mask = options.d_v4Mask;
+    uint64_t v6Mask = options.d_v6Mask;
+    uint64_t suffixLabels = options.d_suffixLabels;
+    getOptionalValue<uint64_t>(vars, "ipv4Mask", v4Mask);
+    getOptionalValue<uint64_t>(vars, "ipv6Mask", v6Mask);
+    getOptionalValue<uint64_t>(vars, "suffixLabels", suffixLabels);
+    checkAllParametersConsumed("setHeavyHittersTracking", vars);
+    checkParameterBound("setHeavyHittersTracking", v4Mask, 32);
+    checkParameterBound("setHeavyHittersTracking", v6Mask, 128);
+    checkParameterBound("setHeavyHittersTracking", suffixLabels, std::numeric_limits<uint8_t>::max());
+    options.d_v4Mask = static_cast<uint8_t>(v4Mask);
+    options.d_v6Mask = static_cast<uint8_t>(v6Mask);
+    options.d_suffixLabels = static_cast<uint8_t>(suffixLabels);
+
+    try {
+      auto tracker = std::make_shared<dnsdist::sketches::HeavyHittersTracker>(options);
+      g_rings.addObserver(tracker);
+      dnsdist::sketches::g_heavyHitters = std::move(tracker);
+    }
+    catch (const std::exception& exp) {
+      errlog("Error enabling heavy hitters tracking: %s", exp.what());
+      g_outputBuffer = "Error enabling heavy hitters tracking: " + std::string(exp.what()) + "\n";
+    }
   });
 
   luaCtx.writeFunction("setWHashedPertubation", [](uint64_t perturb) {
@@ -2664,6 +2728,19 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       getOptionalValue<int>(vars, "internalPipeBufferSize", frontend->d_internalPipeBufferSize);
       getOptionalValue<int>(vars, "idleTimeout", frontend->d_quicheParams.d_idleTimeout);
       getOptionalValue<std::string>(vars, "keyLogFile", frontend->d_quicheParams.d_keyLogFile);
+      {
+        int workers = 1;
+        if (getOptionalValue<int>(vars, "workers", workers) > 0) {
+          if (workers < 1 || workers > std::numeric_limits<uint8_t>::max()) {
+            throw std::runtime_error("Invalid number of workers (" + std::to_string(workers) + ") passed to addDOH3Local()");
+          }
+          frontend->d_workers = static_cast<size_t>(workers);
+          if (workers > 1) {
+            /* the sockets of the workers are bound to the same address */
+            reusePort = true;
+          }
+        }
+      }
       {
         std::string valueStr;
         if (getOptionalValue<std::string>(vars, "congestionControlAlgo", valueStr) > 0) {
@@ -2739,6 +2816,19 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       getOptionalValue<int>(vars, "internalPipeBufferSize", frontend->d_internalPipeBufferSize);
       getOptionalValue<int>(vars, "idleTimeout", frontend->d_quicheParams.d_idleTimeout);
       getOptionalValue<std::string>(vars, "keyLogFile", frontend->d_quicheParams.d_keyLogFile);
+      {
+        int workers = 1;
+        if (getOptionalValue<int>(vars, "workers", workers) > 0) {
+          if (workers < 1 || workers > std::numeric_limits<uint8_t>::max()) {
+            throw std::runtime_error("Invalid number of workers (" + std::to_string(workers) + ") passed to addDOQLocal()");
+          }
+          frontend->d_workers = static_cast<size_t>(workers);
+          if (workers > 1) {
+            /* the sockets of the workers are bound to the same address */
+            reusePort = true;
+          }
+        }
+      }
       {
         std::string valueStr;
         if (getOptionalValue<std::string>(vars, "congestionControlAlgo", valueStr) > 0) {
@@ -2784,11 +2874,14 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
     setLuaNoSideEffect();
     try {
       ostringstream ret;
-      boost::format fmt("%-3d %-20.20s %-15d %-15d %-15d %-15d");
-      ret << (fmt % "#" % "Address" % "Bad Version" % "Invalid Token" % "Errors" % "Valid") << endl;
+      boost::format fmt("%-3d %-20.20s %-15d %-15d %-15d %-15d %-12.2f %-12.2f");
+      ret << (fmt % "#" % "Address" % "Bad Version" % "Invalid Token" % "Errors" % "Valid" % "Dgrams/recv" % "Dgrams/send") << endl;
       size_t counter = 0;
       for (const auto& ctx : g_doqlocals) {
-        ret << (fmt % counter % ctx->d_local.toStringWithPort() % ctx->d_doqUnsupportedVersionErrors % ctx->d_doqInvalidTokensReceived % ctx->d_errorResponses % ctx->d_validResponses) << endl;
+        const auto& dgrams = ctx->d_datagramStats;
+        const double perReceive = dgrams.d_receiveCalls > 0 ? static_cast<double>(dgrams.d_receivedDatagrams) / static_cast<double>(dgrams.d_receiveCalls) : 0.0;
+        const double perSend = dgrams.d_sendCalls > 0 ? static_cast<double>(dgrams.d_sentDatagrams) / static_cast<double>(dgrams.d_sendCalls) : 0.0;
+        ret << (fmt % counter % ctx->d_local.toStringWithPort() % ctx->d_doqUnsupportedVersionErrors % ctx->d_doqInvalidTokensReceived % ctx->d_errorResponses % ctx->d_validResponses % perReceive % perSend) << endl;
         counter++;
       }
       g_outputBuffer = ret.str();
@@ -2865,11 +2958,14 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
     setLuaNoSideEffect();
     try {
       ostringstream ret;
-      boost::format fmt("%-3d %-20.20s %-15d %-15d %-15d %-15d");
-      ret << (fmt % "#" % "Address" % "Bad Version" % "Invalid Token" % "Errors" % "Valid") << endl;
+      boost::format fmt("%-3d %-20.20s %-15d %-15d %-15d %-15d %-12.2f %-12.2f");
+      ret << (fmt % "#" % "Address" % "Bad Version" % "Invalid Token" % "Errors" % "Valid" % "Dgrams/recv" % "Dgrams/send") << endl;
       size_t counter = 0;
       for (const auto& ctx : g_doh3locals) {
-        ret << (fmt % counter % ctx->d_local.toStringWithPort() % ctx->d_doh3UnsupportedVersionErrors % ctx->d_doh3InvalidTokensReceived % ctx->d_errorResponses % ctx->d_validResponses) << endl;
+        const auto& dgrams = ctx->d_datagramStats;
+        const double perReceive = dgrams.d_receiveCalls > 0 ? static_cast<double>(dgrams.d_receivedDatagrams) / static_cast<double>(dgrams.d_receiveCalls) : 0.0;
+        const double perSend = dgrams.d_sendCalls > 0 ? static_cast<double>(dgrams.d_sentDatagrams) / static_cast<double>(dgrams.d_sendCalls) : 0.0;
+        ret << (fmt % counter % ctx->d_local.toStringWithPort() % ctx->d_doh3UnsupportedVersionErrors % ctx->d_doh3InvalidTokensReceived % ctx->d_errorResponses % ctx->d_validResponses % perReceive % perSend) << endl;
         counter++;
       }
       g_outputBuffer = ret.str();
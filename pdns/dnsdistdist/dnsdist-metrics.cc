@@ -23,6 +23,7 @@
 
 #include "dnsdist-metrics.hh"
 #include "dnsdist.hh"
+#include "dnsdist-rings.hh"
 #include "dnsdist-web.hh"
 
 namespace dnsdist::metrics
@@ -139,6 +140,10 @@ Stats::Stats() :
     {"empty-queries", &emptyQueries},
     {"cache-hits", &cacheHits},
     {"cache-misses", &cacheMisses},
+    {"cache-collapsed-queries", &collapsedQueries},
+    {"cache-collapsing-overflows", &collapsingOverflows},
+    {"cache-collapsing-timeouts", &collapsingTimeouts},
+    {"xsk-response-drops", &xskResponseDrops},
     {"cpu-iowait", getCPUIOWait},
     {"cpu-steal", getCPUSteal},
     {"cpu-sys-msec", getCPUTimeSystem},
@@ -146,6 +151,8 @@ Stats::Stats() :
     {"fd-usage", getOpenFileDescriptors},
     {"dyn-blocked", &dynBlocked},
     {"dyn-block-nmg-size", [](const std::string&) { return g_dynblockNMG.getLocal()->size(); }},
+    {"rings-overwrites", [](const std::string&) { return g_rings.getNumberOfOverwrittenEntries(); }},
+    {"rings-laps", [](const std::string&) { return g_rings.getNumberOfLappedEntries(); }},
     {"security-status", &securityStatus},
     {"doh-query-pipe-full", &dohQueryPipeFull},
     {"doh-response-pipe-full", &dohResponsePipeFull},
@@ -70,6 +70,10 @@ struct Stats
   stat_t noPolicy{0};
   stat_t cacheHits{0};
   stat_t cacheMisses{0};
+  stat_t collapsedQueries{0};
+  stat_t collapsingOverflows{0};
+  stat_t collapsingTimeouts{0};
+  stat_t xskResponseDrops{0};
   stat_t latency0_1{0}, latency1_10{0}, latency10_50{0}, latency50_100{0}, latency100_1000{0}, latencySlow{0}, latencySum{0}, latencyCount{0};
   stat_t securityStatus{0};
   stat_t dohQueryPipeFull{0};
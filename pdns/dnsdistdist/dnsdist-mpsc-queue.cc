@@ -0,0 +1,103 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "dnsdist-mpsc-queue.hh"
+
+namespace dnsdist
+{
+#ifdef __linux__
+Doorbell::Doorbell() :
+  d_eventfd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+  if (d_eventfd.getHandle() < 0) {
+    throw std::runtime_error("Error creating a doorbell eventfd: " + stringerror());
+  }
+}
+
+int Doorbell::getDescriptor() const
+{
+  return d_eventfd.getHandle();
+}
+
+void Doorbell::ring()
+{
+  /* the consumer is not blocked, it will see the new object(s) before waiting */
+  if (!d_waiting.load() || !d_waiting.exchange(false)) {
+    return;
+  }
+
+  ++d_rings;
+  uint64_t value = 1;
+  while (write(d_eventfd.getHandle(), &value, sizeof(value)) != sizeof(value)) {
+    if (errno == EINTR) {
+      continue;
+    }
+    /* EAGAIN means the counter is already huge, so the consumer is going to wake up anyway */
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      throw std::runtime_error("Error writing to a doorbell eventfd: " + stringerror());
+    }
+    break;
+  }
+}
+
+void Doorbell::clear()
+{
+  uint64_t value{0};
+  while (read(d_eventfd.getHandle(), &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+}
+
+#else /* __linux__ */
+
+Doorbell::Doorbell()
+{
+  auto [notifier, waiter] = pdns::channel::createNotificationQueue(true);
+  d_notifier = std::move(notifier);
+  d_waiter = std::move(waiter);
+}
+
+int Doorbell::getDescriptor() const
+{
+  return d_waiter.getDescriptor();
+}
+
+void Doorbell::ring()
+{
+  if (!d_waiting.load() || !d_waiting.exchange(false)) {
+    return;
+  }
+
+  ++d_rings;
+  /* a full pipe means that the consumer is going to wake up anyway */
+  d_notifier.notify();
+}
+
+void Doorbell::clear()
+{
+  d_waiter.clear();
+}
+#endif /* __linux__ */
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "channel.hh"
+#include "misc.hh"
+
+namespace dnsdist
+{
+/* A lock-free, unbounded (unless a capacity is set) multiple-producers,
+   single-consumer queue of objects (Vyukov's linked-list design). Pushing
+   never blocks and only costs an allocation and an atomic exchange, but a
+   push that is not yet complete might make the consumer see the queue as
+   empty until the producer has finished linking the new node. */
+template <typename T>
+class MPSCQueue
+{
+public:
+  MPSCQueue(size_t capacity = 0) :
+    d_head(new Node()), d_tail(d_head.load()), d_capacity(capacity)
+  {
+  }
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue(MPSCQueue&&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(MPSCQueue&&) = delete;
+
+  ~MPSCQueue()
+  {
+    while (pop()) {
+    }
+    delete d_tail;
+  }
+
+  /* can be called by several threads at once. Returns false, leaving
+     the object untouched, if the capacity has been reached */
+  bool push(std::unique_ptr<T>&& object)
+  {
+    auto size = d_size.fetch_add(1);
+    if (d_capacity > 0 && size >= d_capacity) {
+      --d_size;
+      return false;
+    }
+
+    auto* node = new Node();
+    node->d_value = object.release();
+    auto* previous = d_head.exchange(node);
+    previous->d_next.store(node);
+    return true;
+  }
+
+  /* consumer only */
+  std::unique_ptr<T> pop()
+  {
+    auto* tail = d_tail;
+    auto* next = tail->d_next.load();
+    if (next == nullptr) {
+      return nullptr;
+    }
+
+    std::unique_ptr<T> result(next->d_value);
+    next->d_value = nullptr;
+    d_tail = next;
+    delete tail;
+    --d_size;
+    return result;
+  }
+
+  /* consumer only */
+  bool empty() const
+  {
+    return d_tail->d_next.load() == nullptr;
+  }
+
+  /* approximate, since it might be updated by other threads */
+  size_t size() const
+  {
+    return d_size.load();
+  }
+
+private:
+  struct Node
+  {
+    std::atomic<Node*> d_next{nullptr};
+    T* d_value{nullptr};
+  };
+
+  /* producers */
+  alignas(64) std::atomic<Node*> d_head;
+  /* consumer */
+  alignas(64) Node* d_tail;
+  std::atomic<size_t> d_size{0};
+  const size_t d_capacity;
+};
+
+/* Wakes up a thread waiting in a multiplexer when objects have been pushed
+   to its queues. The descriptor (an eventfd on Linux, a pipe otherwise) is
+   only written to when the consumer has announced, via prepareToWait(), that
+   it is about to block, so a busy consumer does not cost a system call per
+   object to the producers. */
+class Doorbell
+{
+public:
+  Doorbell();
+
+  /* descriptor to watch for readability in the consumer's multiplexer */
+  int getDescriptor() const;
+  /* called by producers after pushing to the queue(s) */
+  void ring();
+  /* called by the consumer before checking whether the queue(s) are empty
+     and blocking, and after waking up, respectively */
+  void prepareToWait()
+  {
+    d_waiting.store(true);
+  }
+  void doneWaiting()
+  {
+    d_waiting.store(false);
+  }
+  /* called by the consumer when the descriptor becomes readable */
+  void clear();
+
+  uint64_t getRingsCount() const
+  {
+    return d_rings.load(std::memory_order_relaxed);
+  }
+
+private:
+#ifdef __linux__
+  FDWrapper d_eventfd;
+#else
+  pdns::channel::Notifier d_notifier;
+  pdns::channel::Waiter d_waiter;
+#endif
+  std::atomic<uint64_t> d_rings{0};
+  alignas(64) std::atomic<bool> d_waiting{false};
+};
+}
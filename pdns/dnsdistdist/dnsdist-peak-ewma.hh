@@ -0,0 +1,112 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace dnsdist
+{
+/* Moving average of the latency of a backend that decays with time instead
+   of with the number of samples, so that it does not depend on the query
+   rate, and that immediately jumps to any sample larger than its current
+   value ("peak"): a backend becoming slow is penalized at once, while it
+   only recovers gradually. Updates are lock-free, and concurrent updates
+   might lose a sample, which is fine for our purpose. */
+class PeakEWMA
+{
+public:
+  static int64_t getNowUsec()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void submit(double latencyUsec, int64_t nowUsec)
+  {
+    auto stamp = d_stampUsec.exchange(nowUsec, std::memory_order_relaxed);
+    auto current = d_valueUsec.load(std::memory_order_relaxed);
+    double updated{0.0};
+    do {
+      if (current == 0.0 || latencyUsec > current) {
+        updated = latencyUsec;
+      }
+      else {
+        const double weight = getWeight(nowUsec - stamp);
+        updated = current * weight + latencyUsec * (1.0 - weight);
+      }
+    } while (!d_valueUsec.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+  }
+
+  void submit(double latencyUsec)
+  {
+    submit(latencyUsec, getNowUsec());
+  }
+
+  /* the value, decayed as if a zero-latency sample had been received now, so
+     that a backend which has been avoided because of a few slow responses
+     eventually gets a chance to prove itself again. The decay is bounded so
+     that the value of a long-idle backend never reaches 0, which means no
+     sample yet, and that it does not look faster than much faster backends. */
+  double get(int64_t nowUsec) const
+  {
+    const auto value = d_valueUsec.load(std::memory_order_relaxed);
+    if (value == 0.0) {
+      return value;
+    }
+    return value * getWeight(nowUsec - d_stampUsec.load(std::memory_order_relaxed));
+  }
+
+  void reset()
+  {
+    d_valueUsec.store(0.0, std::memory_order_relaxed);
+  }
+
+  static void setDecayTime(double decayTimeUsec)
+  {
+    s_decayTimeUsec.store(decayTimeUsec);
+  }
+
+  static double getDecayTime()
+  {
+    return s_decayTimeUsec.load();
+  }
+
+private:
+  static double getWeight(int64_t elapsedUsec)
+  {
+    if (elapsedUsec <= 0) {
+      return 1.0;
+    }
+    return std::max(s_minimumWeight, std::exp(-static_cast<double>(elapsedUsec) / s_decayTimeUsec.load(std::memory_order_relaxed)));
+  }
+
+  /* an idle backend is never considered more than 100 times faster than it was */
+  static constexpr double s_minimumWeight{0.01};
+
+  std::atomic<double> d_valueUsec{0.0};
+  std::atomic<int64_t> d_stampUsec{0};
+  static std::atomic<double> s_decayTimeUsec;
+};
+}
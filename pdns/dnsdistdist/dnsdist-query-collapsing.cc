@@ -0,0 +1,196 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+
+#include "dnsdist-query-collapsing.hh"
+#include "dnsdist-async.hh"
+#include "dnsdist-cache.hh"
+#include "dnsdist-internal-queries.hh"
+#include "dnsdist-metrics.hh"
+#include "dnsdist.hh"
+#include "dolog.hh"
+
+namespace dnsdist::collapsing
+{
+InFlightQueries::InFlightQueries(size_t maxEntries, size_t shardsCount) :
+  d_shards(shardsCount), d_maxEntriesPerShard(std::max(maxEntries / shardsCount, static_cast<size_t>(1)))
+{
+}
+
+InFlightQueries::Outcome InFlightQueries::add(const InFlightKey& key, const struct timeval& now, uint32_t timeoutMs, size_t maxWaiting, const std::function<std::unique_ptr<CrossProtocolQuery>()>& park, WaitingList& expired)
+{
+  struct timeval ttd = now;
+  ttd.tv_sec += timeoutMs / 1000;
+  ttd.tv_usec += static_cast<decltype(ttd.tv_usec)>((timeoutMs % 1000) * 1000);
+  normalizeTV(ttd);
+
+  auto shard = d_shards.at(key.d_cacheKey % d_shards.size()).lock();
+  auto entryIt = shard->find(key);
+  if (entryIt == shard->end()) {
+    if (shard->size() >= d_maxEntriesPerShard) {
+      return Outcome::Overflow;
+    }
+    shard->emplace(key, Entry{ttd, {}});
+    return Outcome::Leader;
+  }
+
+  auto& entry = entryIt->second;
+  if (entry.d_ttd < now) {
+    /* the leader has not been answered in time, let the queries waiting for it go and take over */
+    expired = std::move(entry.d_waiting);
+    entry.d_waiting.clear();
+    entry.d_ttd = ttd;
+    return Outcome::Leader;
+  }
+
+  if (entry.d_waiting.size() >= maxWaiting) {
+    return Outcome::Overflow;
+  }
+
+  entry.d_waiting.push_back(park());
+  return Outcome::Parked;
+}
+
+InFlightQueries::WaitingList InFlightQueries::release(const InFlightKey& key)
+{
+  WaitingList waiting;
+  auto shard = d_shards.at(key.d_cacheKey % d_shards.size()).lock();
+  auto entryIt = shard->find(key);
+  if (entryIt != shard->end()) {
+    waiting = std::move(entryIt->second.d_waiting);
+    shard->erase(entryIt);
+  }
+  return waiting;
+}
+
+InFlightQueries::WaitingList InFlightQueries::purgeExpired(const struct timeval& now)
+{
+  WaitingList expired;
+  for (auto& lockedShard : d_shards) {
+    auto shard = lockedShard.lock();
+    for (auto entryIt = shard->begin(); entryIt != shard->end();) {
+      if (!(entryIt->second.d_ttd < now)) {
+        ++entryIt;
+        continue;
+      }
+      for (auto& query : entryIt->second.d_waiting) {
+        expired.push_back(std::move(query));
+      }
+      entryIt = shard->erase(entryIt);
+    }
+  }
+  return expired;
+}
+
+size_t InFlightQueries::size()
+{
+  size_t count = 0;
+  for (auto& shard : d_shards) {
+    count += shard.read_only_lock()->size();
+  }
+  return count;
+}
+
+static InFlightQueries s_inFlight;
+
+static void resumeWaiting(InFlightQueries::WaitingList&& waiting)
+{
+  /* resuming them might take a while, and we might be about to send the response to the leader,
+     or be holding the lock of its state, so let the asynchronous thread do it */
+  if (g_asyncHolder) {
+    g_asyncHolder->resume(std::move(waiting));
+    return;
+  }
+
+  for (auto& query : waiting) {
+    if (!resumeQuery(std::move(query))) {
+      vinfolog("Unable to resume a query waiting for an identical one");
+    }
+  }
+}
+
+bool parkIfInFlight(DNSQuestion& dnsQuestion)
+{
+  auto& ids = dnsQuestion.ids;
+  const auto& cache = ids.packetCache;
+  /* only plain UDP queries are collapsed: the other protocols either have their own way of being resumed,
+     or state that would not survive being parked (proxy protocol values, XSK headers) */
+  if (!cache || !cache->isCollapsingEnabled() || ids.skipCache || ids.skipCollapsing || ids.protocol != dnsdist::Protocol::DoUDP || ids.isXSK() || dnsQuestion.proxyProtocolValues) {
+    return false;
+  }
+
+  struct timeval now
+  {
+  };
+  gettimeofday(&now, nullptr);
+
+  InFlightQueries::WaitingList expired;
+  const InFlightKey key{cache.get(), ids.cacheKey};
+  auto outcome = s_inFlight.add(key, now, cache->getCollapsingTimeout(), cache->getCollapsingMaxWaiting(), [&dnsQuestion]() {
+    /* once resumed, this query should be forwarded if it misses the cache again, not parked */
+    dnsQuestion.ids.skipCollapsing = true;
+    return getInternalQueryFromDQ(dnsQuestion, false);
+  }, expired);
+
+  if (!expired.empty()) {
+    dnsdist::metrics::g_stats.collapsingTimeouts += expired.size();
+    resumeWaiting(std::move(expired));
+  }
+
+  if (outcome == InFlightQueries::Outcome::Leader) {
+    ids.collapsingLeader = true;
+    return false;
+  }
+  if (outcome == InFlightQueries::Outcome::Overflow) {
+    ++dnsdist::metrics::g_stats.collapsingOverflows;
+    return false;
+  }
+
+  ++dnsdist::metrics::g_stats.collapsedQueries;
+  return true;
+}
+
+void releaseWaiting(InternalQueryState& ids)
+{
+  if (!ids.collapsingLeader || !ids.packetCache) {
+    return;
+  }
+  ids.collapsingLeader = false;
+
+  resumeWaiting(s_inFlight.release(InFlightKey{ids.packetCache.get(), ids.cacheKey}));
+}
+
+void purgeExpired()
+{
+  struct timeval now
+  {
+  };
+  gettimeofday(&now, nullptr);
+
+  auto expired = s_inFlight.purgeExpired(now);
+  if (!expired.empty()) {
+    dnsdist::metrics::g_stats.collapsingTimeouts += expired.size();
+    resumeWaiting(std::move(expired));
+  }
+}
+}
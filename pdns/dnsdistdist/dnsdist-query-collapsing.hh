@@ -0,0 +1,107 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "dnsdist-tcp.hh"
+#include "lock.hh"
+
+class DNSDistPacketCache;
+struct DNSQuestion;
+struct InternalQueryState;
+
+namespace dnsdist::collapsing
+{
+struct InFlightKey
+{
+  bool operator==(const InFlightKey& rhs) const
+  {
+    return d_cache == rhs.d_cache && d_cacheKey == rhs.d_cacheKey;
+  }
+
+  const DNSDistPacketCache* d_cache{nullptr};
+  uint32_t d_cacheKey{0};
+};
+
+/* Keeps track of the cache misses that are currently being forwarded to a backend, so that identical
+   queries arriving before the answer can wait for it instead of being forwarded as well. */
+class InFlightQueries
+{
+public:
+  using WaitingList = std::vector<std::unique_ptr<CrossProtocolQuery>>;
+
+  enum class Outcome : uint8_t
+  {
+    Leader, /* no identical query in flight, this one should be forwarded and release() called once it has been answered */
+    Parked, /* an identical query is in flight, this one has been taken over and will be returned by release() */
+    Overflow /* too many queries in flight or waiting, this one should be forwarded without further ado */
+  };
+
+  InFlightQueries(size_t maxEntries = 65536, size_t shardsCount = 16);
+
+  /* park() is only called if the query is going to wait. If an identical query had been in flight for longer than
+     timeoutMs, the queries waiting for it are moved to 'expired' and this one becomes the new leader */
+  Outcome add(const InFlightKey& key, const struct timeval& now, uint32_t timeoutMs, size_t maxWaiting, const std::function<std::unique_ptr<CrossProtocolQuery>()>& park, WaitingList& expired);
+  WaitingList release(const InFlightKey& key);
+  WaitingList purgeExpired(const struct timeval& now);
+  size_t size();
+
+private:
+  struct KeyHasher
+  {
+    size_t operator()(const InFlightKey& key) const
+    {
+      return std::hash<const void*>()(key.d_cache) ^ key.d_cacheKey;
+    }
+  };
+
+  struct Entry
+  {
+    struct timeval d_ttd
+    {
+    };
+    WaitingList d_waiting;
+  };
+
+  using Shard = LockGuarded<std::unordered_map<InFlightKey, Entry, KeyHasher>>;
+
+  std::vector<Shard> d_shards;
+  const size_t d_maxEntriesPerShard;
+};
+
+/* Called for a UDP query that missed a cache with collapsing enabled, right before it would be forwarded.
+   Returns true if the query has been parked behind an identical one, in which case the caller should
+   consider it asynchronous and not touch it anymore. */
+bool parkIfInFlight(DNSQuestion& dnsQuestion);
+/* Called once the response to a query that has been forwarded as a leader has been inserted into the cache,
+   hands the queries that were waiting for it to the asynchronous thread, which resumes them so that they
+   are answered from the cache. Also called on every
+   other path that ends the leader (dropped or invalid response, timeout, network error), in which case the
+   resumed queries miss the cache again and are forwarded on their own. Does nothing if the query was not a
+   leader or if the waiting queries have already been released */
+void releaseWaiting(InternalQueryState& ids);
+/* Resumes the queries waiting for a response that did not arrive in time, from the maintenance thread */
+void purgeExpired();
+}
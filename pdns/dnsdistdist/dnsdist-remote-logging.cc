@@ -0,0 +1,257 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "config.h"
+
+#ifndef DISABLE_PROTOBUF
+#include <thread>
+
+#include "dnsdist-remote-logging.hh"
+#include "burtle.hh"
+#include "dolog.hh"
+#include "protozero.hh"
+#include "qtype.hh"
+#include "remote_logger.hh"
+#include "uuid-utils.hh"
+
+namespace dnsdist::remotelogging
+{
+bool isSampled(const ComboAddress& client, const DNSName& qname, uint32_t sampleRate)
+{
+  if (sampleRate <= 1) {
+    return true;
+  }
+
+  const auto hash = qname.hash(ComboAddress::addressOnlyHash()(client));
+  return (hash % sampleRate) == 0;
+}
+
+static LockGuarded<std::vector<std::weak_ptr<Aggregator>>> s_aggregators;
+static std::atomic<uint64_t> s_aggregatorIDs{0};
+
+std::shared_ptr<Aggregator> Aggregator::create(Configuration&& config)
+{
+  if (!config.d_logger) {
+    throw std::runtime_error("A remote logger is required to aggregate Protocol Buffer messages");
+  }
+  if (config.d_interval == 0) {
+    throw std::runtime_error("The aggregation interval of Protocol Buffer messages has to be greater than 0");
+  }
+
+  auto aggregator = std::shared_ptr<Aggregator>(new Aggregator(std::move(config), time(nullptr)));
+  s_aggregators.lock()->push_back(aggregator);
+  return aggregator;
+}
+
+void Aggregator::flushExpired(time_t now)
+{
+  std::vector<std::shared_ptr<Aggregator>> aggregators;
+  {
+    auto lock = s_aggregators.lock();
+    lock->erase(std::remove_if(lock->begin(), lock->end(), [](const auto& entry) { return entry.expired(); }), lock->end());
+    aggregators.reserve(lock->size());
+    for (const auto& entry : *lock) {
+      if (auto aggregator = entry.lock()) {
+        aggregators.push_back(std::move(aggregator));
+      }
+    }
+  }
+
+  for (const auto& aggregator : aggregators) {
+    try {
+      aggregator->flush(now);
+    }
+    catch (const std::exception& exp) {
+      warnlog("Error while sending aggregated Protocol Buffer messages: %s", exp.what());
+    }
+  }
+}
+
+Aggregator::Aggregator(Configuration&& config, time_t now) :
+  d_config(std::move(config)), d_id(++s_aggregatorIDs), d_windowStart(now)
+{
+}
+
+Aggregator::~Aggregator()
+{
+  try {
+    flush(time(nullptr), true);
+  }
+  catch (...) {
+  }
+}
+
+Aggregator::ThreadTables& Aggregator::getThreadTables()
+{
+  /* keyed by the ID of the aggregator rather than its address, which might be reused */
+  static thread_local std::vector<std::pair<uint64_t, std::shared_ptr<ThreadTables>>> t_tables;
+  for (const auto& [aggregatorID, tables] : t_tables) {
+    if (aggregatorID == d_id) {
+      return *tables;
+    }
+  }
+
+  /* forget about the tables of the aggregators that have been destroyed */
+  t_tables.erase(std::remove_if(t_tables.begin(), t_tables.end(), [](const auto& entry) { return entry.second.use_count() == 1; }), t_tables.end());
+
+  auto tables = std::make_shared<ThreadTables>();
+  d_tables.lock()->push_back(tables);
+  t_tables.emplace_back(d_id, tables);
+  return *tables;
+}
+
+void Aggregator::add(Table& table, Key&& key, uint64_t count, size_t maxEntries)
+{
+  if (auto existing = table.find(key); existing != table.end()) {
+    existing->second += count;
+    return;
+  }
+
+  if (table.size() < maxEntries) {
+    table.emplace(std::move(key), count);
+    return;
+  }
+
+  /* the table is full, this goes into the catch-all tuple */
+  table[Key()] += count;
+}
+
+void Aggregator::record(const ComboAddress& client, const DNSName& qname, uint16_t qtype, uint8_t rcode)
+{
+  Key key{qname, Netmask(client, client.isIPv4() ? d_config.d_v4Prefix : d_config.d_v6Prefix), qtype, static_cast<uint8_t>(d_config.d_responses ? rcode : 0)};
+  auto& tables = getThreadTables();
+  /* announce the window we are recording into, then make sure it has not been
+     flushed in the meantime: the flushing thread bumps the window before
+     waiting for the threads still recording into the previous one */
+  auto window = d_window.load();
+  while (true) {
+    tables.d_recording.store(window);
+    const auto current = d_window.load();
+    if (current == window) {
+      break;
+    }
+    window = current;
+  }
+  add(tables.d_tables.at(window % 2), std::move(key), 1, d_config.d_maxEntries);
+  tables.d_recording.store(0, std::memory_order_release);
+}
+
+bool Aggregator::queue(const std::string& data, size_t& attempts)
+{
+  while (attempts < s_queueFullMaxAttempts) {
+    const auto result = d_config.d_logger->queueData(data);
+    if (result == RemoteLoggerInterface::Result::Queued) {
+      attempts = 0;
+      return true;
+    }
+    if (result != RemoteLoggerInterface::Result::PipeFull) {
+      break;
+    }
+    /* the summaries are sent in a burst, give the remote logger time to drain its queue */
+    ++attempts;
+    std::this_thread::sleep_for(s_queueFullWait);
+  }
+  ++d_dropped;
+  return false;
+}
+
+size_t Aggregator::flush(time_t now, bool force)
+{
+  auto windowStart = d_windowStart.load();
+  if (!force && now < windowStart + static_cast<time_t>(d_config.d_interval)) {
+    return 0;
+  }
+  if (!d_windowStart.compare_exchange_strong(windowStart, now)) {
+    /* someone else is flushing */
+    return 0;
+  }
+
+  std::lock_guard<std::mutex> flushLock(d_flushLock);
+  std::vector<std::shared_ptr<ThreadTables>> tables;
+  {
+    auto lock = d_tables.lock();
+    tables = *lock;
+  }
+
+  /* from now on the threads record into the other table */
+  const auto window = d_window.fetch_add(1);
+  Table merged;
+  for (const auto& thread : tables) {
+    while (thread->d_recording.load() == window) {
+      std::this_thread::yield();
+    }
+    Table current;
+    current.swap(thread->d_tables.at(window % 2));
+    /* moves the tuples not already present, and only leaves the other ones */
+    merged.merge(current);
+    for (const auto& [key, count] : current) {
+      merged.at(key) += count;
+    }
+  }
+
+  const auto type = d_config.d_responses ? pdns::ProtoZero::Message::MessageType::DNSResponseType : pdns::ProtoZero::Message::MessageType::DNSQueryType;
+  const auto interval = static_cast<int64_t>(now - windowStart);
+  std::string data;
+  size_t queued = 0;
+  size_t attempts = 0;
+  for (const auto& [entry, count] : merged) {
+    data.clear();
+    pdns::ProtoZero::Message msg{data};
+    msg.setType(type);
+    msg.setMessageIdentity(getUniqueID());
+    msg.setTime(now, 0);
+    if (!d_config.d_serverID.empty()) {
+      msg.setServerIdentity(d_config.d_serverID);
+    }
+    if (!entry.d_subnet.empty()) {
+      msg.setSocketFamily(entry.d_subnet.getNetwork().sin4.sin_family);
+      msg.setFrom(entry.d_subnet.getNetwork());
+    }
+    if (!entry.d_qname.empty()) {
+      msg.setQuestion(entry.d_qname, entry.d_qtype, QClass::IN);
+    }
+    if (d_config.d_responses) {
+      msg.startResponse();
+      // coverity[store_truncates_time_t]
+      msg.setQueryTime(windowStart, 0);
+      if (!entry.d_qname.empty()) {
+        msg.setResponseCode(entry.d_rcode);
+      }
+      msg.commitResponse();
+    }
+    msg.setMeta("aggregated-count", {}, {static_cast<int64_t>(count)});
+    msg.setMeta("aggregated-interval", {}, {interval});
+    if (!entry.d_subnet.empty()) {
+      msg.setMeta("aggregated-prefix-length", {}, {entry.d_subnet.getBits()});
+    }
+    if (queue(data, attempts)) {
+      ++queued;
+    }
+  }
+
+  if (queued < merged.size()) {
+    warnlog("Dropped %d out of %d aggregated Protocol Buffer messages because the remote logger %s was not able to keep up", merged.size() - queued, merged.size(), d_config.d_logger->address());
+  }
+
+  return queued;
+}
+}
+#endif /* DISABLE_PROTOBUF */
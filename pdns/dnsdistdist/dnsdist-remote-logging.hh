@@ -0,0 +1,139 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "dnsname.hh"
+#include "iputils.hh"
+#include "lock.hh"
+
+class RemoteLoggerInterface;
+
+namespace dnsdist::remotelogging
+{
+/* Deterministic 1-in-sampleRate sampling: the decision only depends on the
+   address of the client and on the qname, so that a query and its response
+   are either both logged or both skipped. A rate of 0 or 1 keeps everything */
+bool isSampled(const ComboAddress& client, const DNSName& qname, uint32_t sampleRate);
+
+/* Instead of sending one Protocol Buffer message per query or response,
+   count them per (qname, qtype, rcode, client subnet) tuple over a window of
+   d_interval seconds, then send one summary message per tuple. Each thread
+   updates its own pair of tables without taking a lock: the current window
+   selects the table to update, and the thread flushing the window only
+   waits for the threads still recording into the previous one */
+class Aggregator
+{
+public:
+  struct Configuration
+  {
+    std::shared_ptr<RemoteLoggerInterface> d_logger;
+    std::string d_serverID;
+    uint32_t d_interval{60};
+    /* maximum number of distinct tuples per thread and window, the
+       remaining ones are counted into a single tuple without qname */
+    size_t d_maxEntries{65536};
+    uint8_t d_v4Prefix{24};
+    uint8_t d_v6Prefix{56};
+    bool d_responses{false};
+  };
+
+  static std::shared_ptr<Aggregator> create(Configuration&& config);
+  /* flush the aggregators whose window has ended, called periodically */
+  static void flushExpired(time_t now);
+
+  Aggregator(const Aggregator&) = delete;
+  Aggregator(Aggregator&&) = delete;
+  Aggregator& operator=(const Aggregator&) = delete;
+  Aggregator& operator=(Aggregator&&) = delete;
+  ~Aggregator();
+
+  void record(const ComboAddress& client, const DNSName& qname, uint16_t qtype, uint8_t rcode);
+  /* merge the per-thread tables and send the summaries, if the window has ended or force is set.
+     Returns the number of messages that have been queued */
+  size_t flush(time_t now, bool force = false);
+  /* number of summaries that could not be queued to the remote logger */
+  uint64_t getDroppedCount() const
+  {
+    return d_dropped.load();
+  }
+
+  /* when the queue of the remote logger is full, wait that long for it to be drained before retrying,
+     and give up on the remaining summaries of this window after that many attempts in a row */
+  static constexpr std::chrono::milliseconds s_queueFullWait{10};
+  static constexpr size_t s_queueFullMaxAttempts{100};
+
+private:
+  Aggregator(Configuration&& config, time_t now);
+
+  struct Key
+  {
+    DNSName d_qname;
+    Netmask d_subnet;
+    uint16_t d_qtype{0};
+    uint8_t d_rcode{0};
+
+    bool operator==(const Key& rhs) const
+    {
+      return d_qtype == rhs.d_qtype && d_rcode == rhs.d_rcode && d_subnet == rhs.d_subnet && d_qname == rhs.d_qname;
+    }
+  };
+  struct KeyHasher
+  {
+    size_t operator()(const Key& key) const
+    {
+      return key.d_qname.hash(static_cast<uint32_t>(std::hash<Netmask>()(key.d_subnet)) ^ (static_cast<uint32_t>(key.d_qtype) << 8U) ^ key.d_rcode);
+    }
+  };
+  /* number of queries or responses per tuple */
+  using Table = std::unordered_map<Key, uint64_t, KeyHasher>;
+
+  /* only updated by the owning thread, except for the table of the previous window
+     which is emptied by the thread flushing it once the owner is done with it */
+  struct ThreadTables
+  {
+    std::array<Table, 2> d_tables;
+    /* the window the owning thread is recording into, 0 when it is not recording */
+    std::atomic<uint64_t> d_recording{0};
+  };
+
+  static void add(Table& table, Key&& key, uint64_t count, size_t maxEntries);
+  ThreadTables& getThreadTables();
+  bool queue(const std::string& data, size_t& attempts);
+
+  const Configuration d_config;
+  const uint64_t d_id;
+  LockGuarded<std::vector<std::shared_ptr<ThreadTables>>> d_tables;
+  /* only held while flushing, so that a window is entirely flushed before the next one starts */
+  std::mutex d_flushLock;
+  std::atomic<uint64_t> d_window{1};
+  std::atomic<time_t> d_windowStart;
+  std::atomic<uint64_t> d_dropped{0};
+};
+}
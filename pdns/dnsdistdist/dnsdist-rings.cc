@@ -43,7 +43,30 @@ void Rings::init()
     d_nbLockTries = 0;
   }
 
-  d_shards.resize(d_numberOfShards);
+  static std::atomic<uint64_t> s_generation{0};
+  d_generation = ++s_generation;
+  d_lockFreeWriters.lock()->clear();
+  d_lockFreeShards.clear();
+
+  if (d_lockFree) {
+    /* every writer thread gets its own shard, up to the number of shards. Threads
+       coming after that share a single, regular, shard. */
+    d_lockFreeShards.resize(d_numberOfShards);
+    for (auto& shard : d_lockFreeShards) {
+      shard = std::make_unique<LockFreeShard>();
+      if (shouldRecordQueries()) {
+        shard->queryRing.setCapacity(d_capacity / d_numberOfShards);
+      }
+      if (shouldRecordResponses()) {
+        shard->respRing.setCapacity(d_capacity / d_numberOfShards);
+      }
+    }
+    d_nbLockTries = 0;
+    d_shards.resize(1);
+  }
+  else {
+    d_shards.resize(d_numberOfShards);
+  }
 
   /* resize all the rings */
   for (auto& shard : d_shards) {
@@ -81,15 +104,88 @@ void Rings::setRecordResponses(bool record)
   d_recordResponses = record;
 }
 
+void Rings::setLockFree(bool lockFree)
+{
+  if (d_initialized) {
+    throw std::runtime_error("Rings::setLockFree() should not be called once the rings have been initialized");
+  }
+  d_lockFree = lockFree;
+}
+
+void Rings::addObserver(std::shared_ptr<Observer> observer)
+{
+  if (d_initialized) {
+    throw std::runtime_error("Rings::addObserver() should not be called once the rings have been initialized");
+  }
+  d_observers.push_back(std::move(observer));
+}
+
+Rings::LockFreeShard* Rings::registerLockFreeWriter()
+{
+  auto writers = d_lockFreeWriters.lock();
+  auto writerIt = writers->find(std::this_thread::get_id());
+  if (writerIt != writers->end()) {
+    return writerIt->second;
+  }
+
+  LockFreeShard* shard = nullptr;
+  if (writers->size() < d_lockFreeShards.size()) {
+    shard = d_lockFreeShards.at(writers->size()).get();
+  }
+  /* we also remember the threads that did not get a shard, so they don't come back every time.
+     Note that a thread ID might be reused after a thread has exited, in which case the new thread
+     inherits the shard of the previous one, which is fine since there is still a single writer */
+  writers->emplace(std::this_thread::get_id(), shard);
+  return shard;
+}
+
+static DNSName nameFromStorage(const char* storage, size_t length)
+{
+  if (length == 0) {
+    return {};
+  }
+  return {storage, length, 0, false};
+}
+
+Rings::Query Rings::toQuery(const LockFreeQuery& entry, bool withName)
+{
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+  return {entry.requestor, withName ? nameFromStorage(entry.name.data(), entry.nameLength) : DNSName(), entry.when, entry.dh, entry.size, entry.qtype, entry.protocol, entry.macaddress, entry.hasmac};
+#else
+  return {entry.requestor, withName ? nameFromStorage(entry.name.data(), entry.nameLength) : DNSName(), entry.when, entry.dh, entry.size, entry.qtype, entry.protocol};
+#endif
+}
+
+Rings::Response Rings::toResponse(const LockFreeResponse& entry, bool withName)
+{
+  return {entry.requestor, entry.ds, withName ? nameFromStorage(entry.name.data(), entry.nameLength) : DNSName(), entry.when, entry.dh, entry.usec, entry.size, entry.qtype, entry.protocol};
+}
+
+uint64_t Rings::getNumberOfOverwrittenEntries() const
+{
+  uint64_t total = 0;
+  for (const auto& shard : d_lockFreeShards) {
+    total += shard->queryRing.getOverwrites() + shard->respRing.getOverwrites();
+  }
+  return total;
+}
+
+uint64_t Rings::getNumberOfLappedEntries() const
+{
+  uint64_t total = 0;
+  for (const auto& shard : d_lockFreeShards) {
+    total += shard->queryRing.getLaps() + shard->respRing.getLaps();
+  }
+  return total;
+}
+
 size_t Rings::numDistinctRequestors()
 {
   std::set<ComboAddress, ComboAddress::addressOnlyLessThan> requestors;
-  for (const auto& shard : d_shards) {
-    auto queries = shard->queryRing.lock();
-    for (const auto& query : *queries) {
-      requestors.insert(query.requestor);
-    }
-  }
+  visitQueries([&requestors](const Query& query) {
+    requestors.insert(query.requestor);
+  },
+               false);
   return requestors.size();
 }
 
@@ -97,22 +193,16 @@ std::unordered_map<int, vector<boost::variant<string, double>>> Rings::getTopBan
 {
   map<ComboAddress, unsigned int, ComboAddress::addressOnlyLessThan> counts;
   uint64_t total = 0;
-  for (const auto& shard : d_shards) {
-    {
-      auto queries = shard->queryRing.lock();
-      for (const auto& query : *queries) {
-        counts[query.requestor] += query.size;
-        total += query.size;
-      }
-    }
-    {
-      auto responses = shard->respRing.lock();
-      for (const auto& response : *responses) {
-        counts[response.requestor] += response.size;
-        total += response.size;
-      }
-    }
-  }
+  visitQueries([&counts, &total](const Query& query) {
+    counts[query.requestor] += query.size;
+    total += query.size;
+  },
+               false);
+  visitResponses([&counts, &total](const Response& response) {
+    counts[response.requestor] += response.size;
+    total += response.size;
+  },
+                 false);
 
   using ret_t = vector<pair<unsigned int, ComboAddress>>;
   ret_t rcounts;
@@ -218,8 +308,13 @@ size_t Rings::loadFromFile(const std::string& filepath, const struct timespec& n
 
 bool Rings::Response::isACacheHit() const
 {
-  bool hit = ds.sin4.sin_family == 0;
-  if (!hit && ds.isIPv4() && ds.sin4.sin_addr.s_addr == 0 && ds.sin4.sin_port == 0) {
+  return isACacheHit(ds);
+}
+
+bool Rings::Response::isACacheHit(const ComboAddress& backend)
+{
+  bool hit = backend.sin4.sin_family == 0;
+  if (!hit && backend.isIPv4() && backend.sin4.sin_addr.s_addr == 0 && backend.sin4.sin_port == 0) {
     hit = true;
   }
   return hit;
@@ -21,6 +21,9 @@
  */
 #pragma once
 
+#include <array>
+#include <thread>
+#include <type_traits>
 #include <time.h>
 #include <unordered_map>
 
@@ -65,12 +68,179 @@ struct Rings
     dnsdist::Protocol protocol;
 
     bool isACacheHit() const;
+    /* whether a response sent by this backend was a cache hit */
+    static bool isACacheHit(const ComboAddress& backend);
   };
 
   struct Shard
   {
     LockGuarded<boost::circular_buffer<Query>> queryRing;
     LockGuarded<boost::circular_buffer<Response>> respRing;
+    /* number of entries ever inserted into each ring, only accessed while holding the lock of that ring */
+    uint64_t queryInserts{0};
+    uint64_t respInserts{0};
+  };
+
+  /* In lock-free mode, the entries are stored in a trivially copyable form so that readers
+     can copy them while a writer might be overwriting them, and discard the copy afterwards
+     if the sequence number of the slot tells them it was overwritten in the meantime. */
+  struct LockFreeQuery
+  {
+    ComboAddress requestor;
+    struct timespec when;
+    struct dnsheader dh;
+    uint16_t size;
+    uint16_t qtype;
+    dnsdist::Protocol protocol;
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+    dnsdist::MacAddress macaddress;
+    bool hasmac;
+#endif
+    uint16_t nameLength;
+    std::array<char, DNSName::s_maxDNSNameLength> name;
+  };
+  struct LockFreeResponse
+  {
+    ComboAddress requestor;
+    ComboAddress ds;
+    struct timespec when;
+    struct dnsheader dh;
+    unsigned int usec;
+    uint16_t size;
+    uint16_t qtype;
+    dnsdist::Protocol protocol;
+    uint16_t nameLength;
+    std::array<char, DNSName::s_maxDNSNameLength> name;
+  };
+
+  /* A ring with a single producer that never blocks and any number of readers.
+     Every slot carries a sequence number, odd while the producer is writing to it,
+     derived from the position of the entry otherwise, which tells readers whether
+     the entry they copied is the one they expected. */
+  template <typename T>
+  class LockFreeRing
+  {
+  public:
+    void setCapacity(size_t capacity)
+    {
+      d_capacity = capacity;
+      // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+      d_slots = std::make_unique<Slot[]>(capacity);
+    }
+
+    /* Returns true if the entry was inserted without overwriting an existing one */
+    template <typename F>
+    bool push(const F& filler)
+    {
+      if (d_capacity == 0) {
+        return false;
+      }
+
+      const auto position = d_writePosition.load(std::memory_order_relaxed);
+      auto& slot = d_slots[position % d_capacity];
+      slot.d_sequence.store((2 * position) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      filler(slot.d_entry);
+      slot.d_sequence.store((2 * position) + 2, std::memory_order_release);
+      d_writePosition.store(position + 1, std::memory_order_release);
+
+      if ((position - d_clearedPosition.load(std::memory_order_relaxed)) < d_capacity) {
+        return true;
+      }
+      /* we are the only writer, no need for an atomic increment */
+      d_overwrites.store(d_overwrites.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    /* the visitor returns false to stop the visit */
+    template <typename F>
+    void visit(const F& visitor) const
+    {
+      visitFrom(0, [&visitor](uint64_t /* position */, const T& entry) {
+        return visitor(entry);
+      });
+    }
+
+    /* Visit the entries whose position is at least `from`, passing their position to the visitor which
+       returns false to stop the visit. Returns the position of the oldest entry still present in the ring
+       and the position the next entry will get. */
+    template <typename F>
+    std::pair<uint64_t, uint64_t> visitFrom(uint64_t from, const F& visitor) const
+    {
+      if (d_capacity == 0) {
+        return {0, 0};
+      }
+
+      const auto end = d_writePosition.load(std::memory_order_acquire);
+      const auto oldest = std::max(end > d_capacity ? end - d_capacity : 0, d_clearedPosition.load(std::memory_order_relaxed));
+      for (auto position = std::max(from, oldest); position < end; ++position) {
+        const auto& slot = d_slots[position % d_capacity];
+        const auto expected = (2 * position) + 2;
+        if (slot.d_sequence.load(std::memory_order_acquire) != expected) {
+          /* the producer lapped us */
+          ++d_laps;
+          continue;
+        }
+        T entry = slot.d_entry;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.d_sequence.load(std::memory_order_relaxed) != expected) {
+          ++d_laps;
+          continue;
+        }
+        if (!visitor(position, entry)) {
+          break;
+        }
+      }
+      return {oldest, end};
+    }
+
+    void clear()
+    {
+      d_clearedPosition.store(d_writePosition.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    uint64_t getOverwrites() const
+    {
+      return d_overwrites.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getLaps() const
+    {
+      return d_laps.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Slot
+    {
+      std::atomic<uint64_t> d_sequence{0};
+      T d_entry;
+    };
+
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+    std::unique_ptr<Slot[]> d_slots{nullptr};
+    size_t d_capacity{0};
+    std::atomic<uint64_t> d_writePosition{0};
+    std::atomic<uint64_t> d_clearedPosition{0};
+    std::atomic<uint64_t> d_overwrites{0};
+    mutable std::atomic<uint64_t> d_laps{0};
+  };
+
+  struct LockFreeShard
+  {
+    LockFreeRing<LockFreeQuery> queryRing;
+    LockFreeRing<LockFreeResponse> respRing;
+  };
+
+  /* An observer is notified of every entry inserted into the rings, from the thread inserting it,
+     so it has to be thread-safe and as cheap as possible. */
+  class Observer
+  {
+  public:
+    virtual ~Observer() = default;
+    virtual void onQuery(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype) = 0;
+    virtual void onResponse(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, unsigned int usec, unsigned int size, const struct dnsheader& dh, const ComboAddress& backend) = 0;
+    /* the rings have been cleared */
+    virtual void onClear() = 0;
   };
 
   Rings(size_t capacity = 10000, size_t numberOfShards = 10, size_t nbLockTries = 5, bool keepLockingStats = false) :
@@ -89,6 +259,118 @@ struct Rings
   void setNumberOfLockRetries(size_t retries);
   void setRecordQueries(bool);
   void setRecordResponses(bool);
+  /* this function should not be called after init() has been called */
+  void setLockFree(bool lockFree);
+  /* this function should not be called after init() has been called either,
+     so that the list of observers never changes once entries are inserted */
+  void addObserver(std::shared_ptr<Observer> observer);
+
+  bool isLockFree() const
+  {
+    return d_lockFree;
+  }
+
+  /* number of entries overwritten before being read, in lock-free mode */
+  uint64_t getNumberOfOverwrittenEntries() const;
+  /* number of entries skipped by readers because the producer lapped them, in lock-free mode */
+  uint64_t getNumberOfLappedEntries() const;
+
+  /* Call the visitor for every query currently present in the rings, whatever the mode.
+     In locked mode the corresponding shard is locked while the visitor is called.
+     The visitor might return a boolean, false meaning that the visit should stop there.
+     In lock-free mode the name has to be converted back to a DNSName for every entry,
+     which is skipped, leaving the name empty, when withNames is false. */
+  template <typename T>
+  void visitQueries(const T& visitor, bool withNames = true) const
+  {
+    for (const auto& shard : d_shards) {
+      auto ring = shard->queryRing.lock();
+      for (const auto& entry : *ring) {
+        if (!callVisitor(visitor, entry)) {
+          return;
+        }
+      }
+    }
+    bool done = false;
+    for (const auto& shard : d_lockFreeShards) {
+      shard->queryRing.visit([&visitor, &done, withNames](const LockFreeQuery& entry) {
+        done = !callVisitor(visitor, toQuery(entry, withNames));
+        return !done;
+      });
+      if (done) {
+        return;
+      }
+    }
+  }
+
+  template <typename T>
+  void visitResponses(const T& visitor, bool withNames = true) const
+  {
+    for (const auto& shard : d_shards) {
+      auto ring = shard->respRing.lock();
+      for (const auto& entry : *ring) {
+        if (!callVisitor(visitor, entry)) {
+          return;
+        }
+      }
+    }
+    bool done = false;
+    for (const auto& shard : d_lockFreeShards) {
+      shard->respRing.visit([&visitor, &done, withNames](const LockFreeResponse& entry) {
+        done = !callVisitor(visitor, toResponse(entry, withNames));
+        return !done;
+      });
+      if (done) {
+        return;
+      }
+    }
+  }
+
+  /* Every shard numbers the entries inserted into it, which allows a reader to only look at the entries
+     inserted since its previous visit. Call the visitor with the position and content of every query still
+     present in the shard of index shardIdx, whose position is at least `from`. Locked shards come first,
+     then lock-free ones, see getNumberOfShardsToVisit().
+     Returns the position of the oldest query still present in that shard and the one the next query will get. */
+  template <typename T>
+  std::pair<uint64_t, uint64_t> visitQueriesFrom(size_t shardIdx, uint64_t from, const T& visitor, bool withNames = true) const
+  {
+    if (shardIdx < d_shards.size()) {
+      const auto& shard = d_shards.at(shardIdx);
+      auto ring = shard->queryRing.lock();
+      return visitLockedRingFrom(*ring, shard->queryInserts, from, visitor);
+    }
+    const auto& shard = d_lockFreeShards.at(shardIdx - d_shards.size());
+    return shard->queryRing.visitFrom(from, [&visitor, withNames](uint64_t position, const LockFreeQuery& entry) {
+      visitor(position, toQuery(entry, withNames));
+      return true;
+    });
+  }
+
+  template <typename T>
+  std::pair<uint64_t, uint64_t> visitResponsesFrom(size_t shardIdx, uint64_t from, const T& visitor, bool withNames = true) const
+  {
+    if (shardIdx < d_shards.size()) {
+      const auto& shard = d_shards.at(shardIdx);
+      auto ring = shard->respRing.lock();
+      return visitLockedRingFrom(*ring, shard->respInserts, from, visitor);
+    }
+    const auto& shard = d_lockFreeShards.at(shardIdx - d_shards.size());
+    return shard->respRing.visitFrom(from, [&visitor, withNames](uint64_t position, const LockFreeResponse& entry) {
+      visitor(position, toResponse(entry, withNames));
+      return true;
+    });
+  }
+
+  size_t getNumberOfShardsToVisit() const
+  {
+    return d_shards.size() + d_lockFreeShards.size();
+  }
+
+  /* changes every time the rings are initialized, invalidating the positions of the entries */
+  uint64_t getGeneration() const
+  {
+    return d_generation;
+  }
 
   size_t getNumberOfShards() const
   {
@@ -114,6 +396,35 @@ struct Rings
       hasmac = true;
     }
 #endif
+    for (const auto& observer : d_observers) {
+      observer->onQuery(when, requestor, name, qtype);
+    }
+
+    if (d_lockFree) {
+      auto* shard = getLockFreeShard();
+      if (shard != nullptr) {
+        bool newEntry = shard->queryRing.push([&](LockFreeQuery& entry) {
+          entry.requestor = requestor;
+          entry.when = when;
+          entry.dh = dh;
+          entry.size = size;
+          entry.qtype = qtype;
+          entry.protocol = protocol;
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+          entry.macaddress = macaddress;
+          entry.hasmac = hasmac;
+#endif
+          const auto& storage = name.getStorage();
+          entry.nameLength = std::min(storage.size(), entry.name.size());
+          memcpy(entry.name.data(), storage.data(), entry.nameLength);
+        });
+        if (newEntry) {
+          d_nbQueryEntries++;
+        }
+        return;
+      }
+    }
+
     for (size_t idx = 0; idx < d_nbLockTries; idx++) {
       auto& shard = getOneShard();
       auto lock = shard->queryRing.try_lock();
@@ -123,6 +434,7 @@ struct Rings
 #else
         insertQueryLocked(*lock, when, requestor, name, qtype, size, dh, protocol);
 #endif
+        ++shard->queryInserts;
         return;
       }
       if (d_keepLockingStats) {
@@ -141,15 +453,44 @@ struct Rings
 #else
     insertQueryLocked(*lock, when, requestor, name, qtype, size, dh, protocol);
 #endif
+    ++shard->queryInserts;
   }
 
   void insertResponse(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype, unsigned int usec, unsigned int size, const struct dnsheader& dh, const ComboAddress& backend, dnsdist::Protocol protocol)
   {
+    for (const auto& observer : d_observers) {
+      observer->onResponse(when, requestor, name, usec, size, dh, backend);
+    }
+
+    if (d_lockFree) {
+      auto* shard = getLockFreeShard();
+      if (shard != nullptr) {
+        bool newEntry = shard->respRing.push([&](LockFreeResponse& entry) {
+          entry.requestor = requestor;
+          entry.ds = backend;
+          entry.when = when;
+          entry.dh = dh;
+          entry.usec = usec;
+          entry.size = size;
+          entry.qtype = qtype;
+          entry.protocol = protocol;
+          const auto& storage = name.getStorage();
+          entry.nameLength = std::min(storage.size(), entry.name.size());
+          memcpy(entry.name.data(), storage.data(), entry.nameLength);
+        });
+        if (newEntry) {
+          d_nbResponseEntries++;
+        }
+        return;
+      }
+    }
+
     for (size_t idx = 0; idx < d_nbLockTries; idx++) {
       auto& shard = getOneShard();
       auto lock = shard->respRing.try_lock();
       if (lock.owns_lock()) {
         insertResponseLocked(*lock, when, requestor, name, qtype, usec, size, dh, backend, protocol);
+        ++shard->respInserts;
         return;
       }
       if (d_keepLockingStats) {
@@ -164,6 +505,7 @@ struct Rings
     auto& shard = getOneShard();
     auto lock = shard->respRing.lock();
     insertResponseLocked(*lock, when, requestor, name, qtype, usec, size, dh, backend, protocol);
+    ++shard->respInserts;
   }
 
   void clear()
@@ -172,6 +514,10 @@ struct Rings
       shard->queryRing.lock()->clear();
       shard->respRing.lock()->clear();
     }
+    for (auto& shard : d_lockFreeShards) {
+      shard->queryRing.clear();
+      shard->respRing.clear();
+    }
 
     d_nbQueryEntries.store(0);
     d_nbResponseEntries.store(0);
@@ -180,12 +526,17 @@ struct Rings
     d_blockingResponseInserts.store(0);
     d_deferredQueryInserts.store(0);
     d_deferredResponseInserts.store(0);
+
+    for (const auto& observer : d_observers) {
+      observer->onClear();
+    }
   }
 
   /* this should be called in the unit tests, and never at runtime */
   void reset()
   {
     clear();
+    d_observers.clear();
     d_initialized = false;
   }
 
@@ -204,6 +555,8 @@ struct Rings
   }
 
   std::vector<std::unique_ptr<Shard>> d_shards;
+  /* one per writer thread, in lock-free mode only */
+  std::vector<std::unique_ptr<LockFreeShard>> d_lockFreeShards;
   pdns::stat_t d_blockingQueryInserts;
   pdns::stat_t d_blockingResponseInserts;
   pdns::stat_t d_deferredQueryInserts;
@@ -212,7 +565,44 @@ struct Rings
 private:
   size_t getShardId()
   {
-    return (d_currentShardId++ % d_numberOfShards);
+    return (d_currentShardId++ % d_shards.size());
+  }
+
+  LockFreeShard* getLockFreeShard()
+  {
+    /* the generation changes every time the rings are initialized, so a thread
+       never uses a shard belonging to a previous incarnation (or object) */
+    static thread_local std::pair<uint64_t, LockFreeShard*> t_writer{0, nullptr};
+    if (t_writer.first != d_generation) {
+      t_writer = {d_generation, registerLockFreeWriter()};
+    }
+    return t_writer.second;
+  }
+
+  LockFreeShard* registerLockFreeWriter();
+  static Query toQuery(const LockFreeQuery& entry, bool withName);
+  static Response toResponse(const LockFreeResponse& entry, bool withName);
+
+  template <typename T, typename E>
+  static bool callVisitor(const T& visitor, const E& entry)
+  {
+    if constexpr (std::is_same_v<std::invoke_result_t<const T&, const E&>, bool>) {
+      return visitor(entry);
+    }
+    else {
+      visitor(entry);
+      return true;
+    }
+  }
+
+  template <typename E, typename T>
+  static std::pair<uint64_t, uint64_t> visitLockedRingFrom(const boost::circular_buffer<E>& ring, uint64_t inserts, uint64_t from, const T& visitor)
+  {
+    const uint64_t oldest = inserts - ring.size();
+    for (auto position = std::max(from, oldest); position < inserts; ++position) {
+      visitor(position, ring[position - oldest]);
+    }
+    return {oldest, inserts};
   }
 
   std::unique_ptr<Shard>& getOneShard()
@@ -252,6 +642,9 @@ private:
   std::atomic<size_t> d_nbResponseEntries;
   std::atomic<size_t> d_currentShardId;
   std::atomic<bool> d_initialized{false};
+  LockGuarded<std::unordered_map<std::thread::id, LockFreeShard*>> d_lockFreeWriters;
+  std::vector<std::shared_ptr<Observer>> d_observers;
+  uint64_t d_generation{0};
 
   size_t d_capacity;
   size_t d_numberOfShards;
@@ -259,6 +652,7 @@ private:
   bool d_keepLockingStats{false};
   bool d_recordQueries{true};
   bool d_recordResponses{true};
+  bool d_lockFree{false};
 };
 
 extern Rings g_rings;
@@ -20,12 +20,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <map>
+
 #include "dnsdist-rule-chains.hh"
+#include "dnsdist.hh"
 
 namespace dnsdist::rules
 {
-GlobalStateHolder<std::vector<RuleAction>> s_ruleActions;
-GlobalStateHolder<std::vector<RuleAction>> s_cacheMissRuleActions;
+GlobalStateHolder<RuleActions> s_ruleActions;
+GlobalStateHolder<RuleActions> s_cacheMissRuleActions;
 GlobalStateHolder<std::vector<ResponseRuleAction>> s_respruleactions;
 GlobalStateHolder<std::vector<ResponseRuleAction>> s_cachehitrespruleactions;
 GlobalStateHolder<std::vector<ResponseRuleAction>> s_selfansweredrespruleactions;
@@ -60,8 +63,146 @@ const std::vector<RuleChainDescription>& getRuleChains()
   return s_ruleChains;
 }
 
-GlobalStateHolder<std::vector<RuleAction>>& getRuleChainHolder(RuleChain chain)
+GlobalStateHolder<RuleActions>& getRuleChainHolder(RuleChain chain)
 {
   return s_ruleChains.at(static_cast<size_t>(chain)).holder;
 }
+
+static void mergePositions(CompiledRuleChain::positions_t& target, const CompiledRuleChain::positions_t& source)
+{
+  CompiledRuleChain::positions_t merged;
+  merged.reserve(target.size() + source.size());
+  std::set_union(target.begin(), target.end(), source.begin(), source.end(), std::back_inserter(merged));
+  target = std::move(merged);
+}
+
+CompiledRuleChain::CompiledRuleChain(const std::vector<RuleAction>& rules)
+{
+  /* rules whose selector is a name (resp. netmask), the index then stores for each name
+     the rules of that name and of all its ancestors, so that the longest match is enough */
+  std::map<DNSName, positions_t> names;
+  std::map<Netmask, positions_t> netmasks;
+
+  for (size_t position = 0; position < rules.size(); position++) {
+    const auto pos = static_cast<uint32_t>(position);
+    auto selector = rules.at(position).d_rule->getSelector();
+    if (!selector) {
+      d_unindexed.push_back(pos);
+      continue;
+    }
+
+    switch (selector->d_type) {
+    case RuleSelector::Type::QTypes:
+      for (const auto qtype : selector->d_values) {
+        auto& positions = d_qtypes[qtype];
+        /* an OrRule might list the same qtype twice */
+        if (positions.empty() || positions.back() != pos) {
+          positions.push_back(pos);
+        }
+      }
+      break;
+    case RuleSelector::Type::Opcodes:
+      for (const auto opcode : selector->d_values) {
+        if (opcode >= d_opcodes.size()) {
+          /* cannot match, but let the rule say so */
+          continue;
+        }
+        auto& positions = d_opcodes.at(opcode);
+        if (positions.empty() || positions.back() != pos) {
+          positions.push_back(pos);
+        }
+      }
+      break;
+    case RuleSelector::Type::Suffixes:
+      for (const auto& name : selector->d_names) {
+        auto& positions = names[name];
+        if (positions.empty() || positions.back() != pos) {
+          positions.push_back(pos);
+        }
+      }
+      break;
+    case RuleSelector::Type::SourceNetmasks:
+      for (const auto& netmask : selector->d_netmasks) {
+        auto& positions = netmasks[netmask];
+        if (positions.empty() || positions.back() != pos) {
+          positions.push_back(pos);
+        }
+      }
+      break;
+    }
+    d_indexedRules++;
+  }
+
+  for (const auto& [name, positions] : names) {
+    auto merged = positions;
+    DNSName ancestor(name);
+    while (ancestor.chopOff()) {
+      auto ancestorIt = names.find(ancestor);
+      if (ancestorIt != names.end()) {
+        mergePositions(merged, ancestorIt->second);
+      }
+    }
+    d_suffixes.add(name, std::move(merged));
+  }
+
+  std::set<std::pair<int, uint8_t>> prefixLengths;
+  for (const auto& entry : netmasks) {
+    prefixLengths.emplace(entry.first.getNetwork().sin4.sin_family, entry.first.getBits());
+  }
+  for (const auto& [netmask, positions] : netmasks) {
+    auto merged = positions;
+    for (const auto& [family, bits] : prefixLengths) {
+      if (family != netmask.getNetwork().sin4.sin_family || bits >= netmask.getBits()) {
+        continue;
+      }
+      auto ancestorIt = netmasks.find(Netmask(netmask.getNetwork(), bits));
+      if (ancestorIt != netmasks.end()) {
+        mergePositions(merged, ancestorIt->second);
+      }
+    }
+    d_sources.insert(netmask).second = std::move(merged);
+  }
+}
+
+void CompiledRuleChain::Candidates::add(const positions_t& positions, size_t from)
+{
+  const auto* begin = positions.data();
+  const auto* end = begin + positions.size(); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  if (from > 0) {
+    begin = std::lower_bound(begin, end, from);
+  }
+  if (begin != end) {
+    d_lists.at(d_count) = {begin, end};
+    d_count++;
+  }
+}
+
+CompiledRuleChain::Candidates CompiledRuleChain::getCandidates(const DNSName& qname, uint16_t qtype, uint8_t opcode, const ComboAddress& source, size_t from) const
+{
+  Candidates candidates;
+  candidates.add(d_unindexed, from);
+
+  if (!d_qtypes.empty()) {
+    auto qtypeIt = d_qtypes.find(qtype);
+    if (qtypeIt != d_qtypes.end()) {
+      candidates.add(qtypeIt->second, from);
+    }
+  }
+
+  if (opcode < d_opcodes.size()) {
+    candidates.add(d_opcodes.at(opcode), from);
+  }
+
+  if (const auto* positions = d_suffixes.lookup(qname)) {
+    candidates.add(*positions, from);
+  }
+
+  if (!d_sources.empty()) {
+    if (const auto* node = d_sources.lookup(source)) {
+      candidates.add(node->second, from);
+    }
+  }
+
+  return candidates;
+}
 }
@@ -21,10 +21,15 @@
  */
 #pragma once
 
+#include <array>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "dnsname.hh"
+#include "iputils.hh"
 #include "sholder.hh"
 #include "uuid-utils.hh"
 
@@ -43,11 +48,121 @@ struct RuleAction
   uint64_t d_creationOrder;
 };
 
+/* A condition on the query that has to hold for a rule to match, and is much
+   cheaper to check than the rule itself. Only one kind of condition is
+   reported by a given rule, see DNSRule::getSelector(). */
+struct RuleSelector
+{
+  enum class Type : uint8_t
+  {
+    QTypes,
+    Opcodes,
+    Suffixes,
+    SourceNetmasks,
+  };
+
+  Type d_type;
+  /* qtypes or opcodes */
+  std::vector<uint16_t> d_values;
+  std::vector<DNSName> d_names;
+  std::vector<Netmask> d_netmasks;
+};
+
+/* Index of the rules of a chain by their selector, so that a single lookup
+   per dimension (qtype, opcode, qname suffix and source address) returns the
+   positions of the only rules that might match a query. Rules without a
+   selector are always candidates. The candidates are returned in the order
+   of the chain, so evaluating them gives the same result as evaluating the
+   whole chain. */
+class CompiledRuleChain
+{
+public:
+  using positions_t = std::vector<uint32_t>;
+
+  explicit CompiledRuleChain(const std::vector<RuleAction>& rules);
+
+  class Candidates
+  {
+  public:
+    /* returns false once there is no candidate left */
+    bool next(size_t& position)
+    {
+      std::pair<const uint32_t*, const uint32_t*>* best = nullptr;
+      for (size_t idx = 0; idx < d_count; idx++) {
+        auto& list = d_lists.at(idx);
+        if (list.first != list.second && (best == nullptr || *list.first < *best->first)) {
+          best = &list;
+        }
+      }
+      if (best == nullptr) {
+        return false;
+      }
+      position = *best->first;
+      ++best->first;
+      return true;
+    }
+
+  private:
+    friend class CompiledRuleChain;
+    void add(const positions_t& positions, size_t from);
+
+    std::array<std::pair<const uint32_t*, const uint32_t*>, 5> d_lists{};
+    size_t d_count{0};
+  };
+
+  /* the candidates at or after position 'from' */
+  [[nodiscard]] Candidates getCandidates(const DNSName& qname, uint16_t qtype, uint8_t opcode, const ComboAddress& source, size_t from = 0) const;
+  [[nodiscard]] size_t getIndexedRulesCount() const
+  {
+    return d_indexedRules;
+  }
+
+private:
+  std::unordered_map<uint16_t, positions_t> d_qtypes;
+  std::array<positions_t, 16> d_opcodes;
+  SuffixMatchTree<positions_t> d_suffixes;
+  NetmaskTree<positions_t> d_sources;
+  positions_t d_unindexed;
+  size_t d_indexedRules{0};
+};
+
+/* The rules of a query chain. Once published via a GlobalStateHolder a chain
+   is never modified, only replaced by a modified copy, so the index is built
+   on first use and never carried over to a copy. */
+class RuleActions : public std::vector<RuleAction>
+{
+public:
+  RuleActions() = default;
+  RuleActions(const RuleActions& rhs) :
+    std::vector<RuleAction>(rhs)
+  {
+  }
+  RuleActions(RuleActions&& rhs) noexcept :
+    std::vector<RuleAction>(std::move(rhs))
+  {
+  }
+  RuleActions& operator=(const RuleActions& rhs) = delete;
+  RuleActions& operator=(RuleActions&& rhs) = delete;
+  ~RuleActions() = default;
+
+  const CompiledRuleChain& getCompiled() const
+  {
+    std::call_once(d_compiledOnce, [this]() {
+      d_compiled = std::make_unique<CompiledRuleChain>(*this);
+    });
+    return *d_compiled;
+  }
+
+private:
+  mutable std::once_flag d_compiledOnce;
+  mutable std::unique_ptr<CompiledRuleChain> d_compiled;
+};
+
 struct RuleChainDescription
 {
   std::string prefix;
   std::string metricName;
-  GlobalStateHolder<std::vector<RuleAction>>& holder;
+  GlobalStateHolder<RuleActions>& holder;
 };
 
 enum class RuleChain : uint8_t
@@ -57,7 +172,7 @@ enum class RuleChain : uint8_t
 };
 
 const std::vector<RuleChainDescription>& getRuleChains();
-GlobalStateHolder<std::vector<RuleAction>>& getRuleChainHolder(RuleChain chain);
+GlobalStateHolder<RuleActions>& getRuleChainHolder(RuleChain chain);
 
 struct ResponseRuleAction
 {
@@ -233,6 +233,21 @@ public:
     return d_nmg.match(dq->ids.origRemote);
   }
 
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    if (!d_src) {
+      return std::nullopt;
+    }
+    dnsdist::rules::RuleSelector selector{dnsdist::rules::RuleSelector::Type::SourceNetmasks, {}, {}, {}};
+    for (const auto& entry : d_nmg.toStringVector()) {
+      /* negated entries can only prevent a match */
+      if (!entry.empty() && entry.at(0) != '!') {
+        selector.d_netmasks.emplace_back(entry);
+      }
+    }
+    return selector;
+  }
+
   string toString() const override
   {
     string ret = "Src: ";
@@ -444,6 +459,15 @@ public:
     return true;
   }
 
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    /* only the first rule is always evaluated, the next ones might have side effects */
+    if (d_rules.empty()) {
+      return std::nullopt;
+    }
+    return d_rules.front()->getSelector();
+  }
+
   string toString() const override
   {
     string ret;
@@ -480,6 +504,26 @@ public:
     return false;
   }
 
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    /* the union of the conditions of the rules, provided that they are all of the same kind */
+    std::optional<dnsdist::rules::RuleSelector> result;
+    for (const auto& rule : d_rules) {
+      auto selector = rule->getSelector();
+      if (!selector || (result && result->d_type != selector->d_type)) {
+        return std::nullopt;
+      }
+      if (!result) {
+        result = std::move(selector);
+        continue;
+      }
+      result->d_values.insert(result->d_values.end(), selector->d_values.begin(), selector->d_values.end());
+      result->d_names.insert(result->d_names.end(), selector->d_names.begin(), selector->d_names.end());
+      result->d_netmasks.insert(result->d_netmasks.end(), selector->d_netmasks.begin(), selector->d_netmasks.end());
+    }
+    return result;
+  }
+
   string toString() const override
   {
     string ret;
@@ -604,6 +648,11 @@ public:
   {
     return d_smn.check(dq->ids.qname);
   }
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    const auto& names = d_smn.getNames();
+    return dnsdist::rules::RuleSelector{dnsdist::rules::RuleSelector::Type::Suffixes, {}, {names.begin(), names.end()}, {}};
+  }
   string toString() const override
   {
     if(d_quiet)
@@ -627,6 +676,10 @@ public:
   {
     return d_qname==dq->ids.qname;
   }
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    return dnsdist::rules::RuleSelector{dnsdist::rules::RuleSelector::Type::Suffixes, {}, {d_qname}, {}};
+  }
   string toString() const override
   {
     return "qname=="+d_qname.toString();
@@ -662,6 +715,10 @@ public:
   {
     return d_qtype == dq->ids.qtype;
   }
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    return dnsdist::rules::RuleSelector{dnsdist::rules::RuleSelector::Type::QTypes, {d_qtype}, {}, {}};
+  }
   string toString() const override
   {
     QType qt(d_qtype);
@@ -699,6 +756,10 @@ public:
   {
     return d_opcode == dq->getHeader()->opcode;
   }
+  std::optional<dnsdist::rules::RuleSelector> getSelector() const override
+  {
+    return dnsdist::rules::RuleSelector{dnsdist::rules::RuleSelector::Type::Opcodes, {d_opcode}, {}, {}};
+  }
   string toString() const override
   {
     return "opcode=="+std::to_string(d_opcode);
@@ -0,0 +1,143 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "dnsdist-sketches.hh"
+#include "burtle.hh"
+
+namespace dnsdist::sketches
+{
+std::shared_ptr<HeavyHittersTracker> g_heavyHitters{nullptr};
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth) :
+  d_counters(width * depth), d_width(width), d_depth(depth)
+{
+  if (width == 0 || depth == 0) {
+    throw std::runtime_error("The width and depth of a Count-Min sketch should be larger than 0");
+  }
+}
+
+uint32_t CountMinSketch::getSecondHash(uint32_t hash)
+{
+  /* the second hash has to be odd so that the rows use different indexes */
+  return burtle(reinterpret_cast<const unsigned char*>(&hash), sizeof(hash), 0x5bd1e995) | 1U; // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+size_t CountMinSketch::getIndex(uint32_t hash, uint32_t secondHash, size_t row) const
+{
+  /* Kirsch-Mitzenmacher: h_i(x) = h1(x) + i * h2(x) */
+  return (row * d_width) + ((hash + static_cast<uint32_t>(row) * secondHash) % d_width);
+}
+
+void CountMinSketch::add(uint32_t hash, uint64_t count)
+{
+  /* we are the only writer, no need for atomic increments */
+  const auto secondHash = getSecondHash(hash);
+  uint64_t minimum = std::numeric_limits<uint64_t>::max();
+  for (size_t row = 0; row < d_depth; row++) {
+    minimum = std::min(minimum, d_counters[getIndex(hash, secondHash, row)].load(std::memory_order_relaxed));
+  }
+
+  const uint64_t target = minimum + count;
+  for (size_t row = 0; row < d_depth; row++) {
+    auto& counter = d_counters[getIndex(hash, secondHash, row)];
+    if (counter.load(std::memory_order_relaxed) < target) {
+      counter.store(target, std::memory_order_relaxed);
+    }
+  }
+}
+
+uint64_t CountMinSketch::estimate(uint32_t hash) const
+{
+  const auto secondHash = getSecondHash(hash);
+  uint64_t minimum = std::numeric_limits<uint64_t>::max();
+  for (size_t row = 0; row < d_depth; row++) {
+    minimum = std::min(minimum, d_counters[getIndex(hash, secondHash, row)].load(std::memory_order_relaxed));
+  }
+  return minimum;
+}
+
+void CountMinSketch::clear()
+{
+  for (auto& counter : d_counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t getNextHeavyHittersID()
+{
+  static std::atomic<uint64_t> s_nextID{0};
+  return ++s_nextID;
+}
+
+HeavyHittersTracker::HeavyHittersTracker(const Options& options) :
+  d_options(options),
+  d_clients(options.d_width, options.d_depth, options.d_capacity, options.d_window),
+  d_suffixes(options.d_width, options.d_depth, options.d_capacity, options.d_window),
+  d_qtypes(options.d_width, options.d_depth, options.d_capacity, options.d_window)
+{
+  if (options.d_v4Mask > 32) {
+    throw std::runtime_error("Trying to set an invalid IPv4 mask (" + std::to_string(options.d_v4Mask) + ") for heavy hitters tracking");
+  }
+  if (options.d_v6Mask > 128) {
+    throw std::runtime_error("Trying to set an invalid IPv6 mask (" + std::to_string(options.d_v6Mask) + ") for heavy hitters tracking");
+  }
+}
+
+AddressAndPortRange HeavyHittersTracker::getClientKey(const ComboAddress& requestor) const
+{
+  return AddressAndPortRange(requestor, requestor.isIPv4() ? d_options.d_v4Mask : d_options.d_v6Mask, 0);
+}
+
+void HeavyHittersTracker::onQuery(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype)
+{
+  d_clients.add(getClientKey(requestor), when.tv_sec);
+
+  /* hash the last labels directly from the storage of the name, the suffix
+     itself is only built if it has to be stored in the list of heaviest ones */
+  const auto& storage = name.getStorage();
+  const auto* labels = reinterpret_cast<const unsigned char*>(storage.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto labelsCount = name.countLabels();
+  size_t offset = 0;
+  for (auto toSkip = labelsCount > d_options.d_suffixLabels ? labelsCount - d_options.d_suffixLabels : 0; toSkip > 0; toSkip--) {
+    offset += labels[offset] + 1; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+  const auto* suffix = storage.data() + offset; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  const auto suffixLength = storage.size() - offset;
+  const auto hash = static_cast<uint32_t>(burtleCI(labels + offset, suffixLength, 0)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  d_suffixes.add(hash, [suffix, suffixLength](KeyStorage<DNSName>& key) { key.setWire(suffix, suffixLength); }, when.tv_sec);
+
+  d_qtypes.add(qtype, when.tv_sec);
+}
+
+void HeavyHittersTracker::onResponse([[maybe_unused]] const struct timespec& when, [[maybe_unused]] const ComboAddress& requestor, [[maybe_unused]] const DNSName& name, [[maybe_unused]] unsigned int usec, [[maybe_unused]] unsigned int size, [[maybe_unused]] const struct dnsheader& dnsHeader, [[maybe_unused]] const ComboAddress& backend)
+{
+}
+
+void HeavyHittersTracker::onClear()
+{
+}
+
+size_t HeavyHittersTracker::getMemoryUsage() const
+{
+  return (d_clients.getNumberOfWriters() * d_clients.getMemoryUsagePerWriter()) + (d_suffixes.getNumberOfWriters() * d_suffixes.getMemoryUsagePerWriter()) + (d_qtypes.getNumberOfWriters() * d_qtypes.getMemoryUsagePerWriter());
+}
+}
@@ -0,0 +1,629 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
+#include "dnsdist-rings.hh"
+#include "dnsname.hh"
+#include "iputils.hh"
+#include "lock.hh"
+
+namespace dnsdist::sketches
+{
+/* Fixed-size Count-Min sketch: 'depth' rows of 'width' counters, each row being indexed by
+   a different hash of the key. Estimates are never lower than the actual count, and we use
+   conservative updates (only the smallest counters are increased) to reduce the overestimation.
+   There can be only one writer, but any number of readers at the same time. */
+class CountMinSketch
+{
+public:
+  CountMinSketch(size_t width, size_t depth);
+
+  void add(uint32_t hash, uint64_t count = 1);
+  [[nodiscard]] uint64_t estimate(uint32_t hash) const;
+  void clear();
+
+  [[nodiscard]] size_t getWidth() const
+  {
+    return d_width;
+  }
+
+  [[nodiscard]] size_t getDepth() const
+  {
+    return d_depth;
+  }
+
+private:
+  [[nodiscard]] size_t getIndex(uint32_t hash, uint32_t secondHash, size_t row) const;
+  static uint32_t getSecondHash(uint32_t hash);
+
+  std::vector<std::atomic<uint64_t>> d_counters;
+  size_t d_width;
+  size_t d_depth;
+};
+
+/* SpaceSaving heavy-hitters list, keeping at most 'capacity' keys. When a new key has to be
+   inserted into a full list, it replaces the key with the lowest count and inherits that count,
+   which is then recorded as the maximum overestimation (error) for that key. Any key whose
+   actual count is larger than total / capacity is guaranteed to be present. */
+template <typename K, typename H = std::hash<K>>
+class SpaceSaving
+{
+public:
+  struct Entry
+  {
+    K d_key;
+    uint64_t d_count{0};
+    uint64_t d_error{0};
+  };
+
+  explicit SpaceSaving(size_t capacity) :
+    d_capacity(capacity)
+  {
+  }
+
+  void add(const K& key, uint64_t count = 1)
+  {
+    std::optional<K> evicted;
+    add(key, count, evicted);
+  }
+
+  /* Returns true if the key was not already in the list, in which case 'evicted'
+     is set to the key it replaced if the list was full */
+  bool add(const K& key, uint64_t count, std::optional<K>& evicted)
+  {
+    if (d_capacity == 0) {
+      return false;
+    }
+
+    auto& byKey = d_entries.template get<KeyTag>();
+    auto entryIt = byKey.find(key);
+    if (entryIt != byKey.end()) {
+      byKey.modify(entryIt, [count](Entry& entry) { entry.d_count += count; });
+      return false;
+    }
+
+    if (d_entries.size() < d_capacity) {
+      d_entries.insert(Entry{key, count, 0});
+      return true;
+    }
+
+    auto& byCount = d_entries.template get<CountTag>();
+    byCount.modify(byCount.begin(), [&key, &evicted, count](Entry& entry) {
+      evicted = std::move(entry.d_key);
+      entry.d_key = key;
+      entry.d_error = entry.d_count;
+      entry.d_count += count;
+    });
+    return true;
+  }
+
+  /* visit the entries, from the highest count to the lowest */
+  template <typename F>
+  void visit(F&& visitor) const
+  {
+    const auto& byCount = d_entries.template get<CountTag>();
+    for (auto entryIt = byCount.rbegin(); entryIt != byCount.rend(); ++entryIt) {
+      visitor(*entryIt);
+    }
+  }
+
+  void clear()
+  {
+    d_entries.clear();
+  }
+
+  void swap(SpaceSaving& rhs) noexcept
+  {
+    d_entries.swap(rhs.d_entries);
+    std::swap(d_capacity, rhs.d_capacity);
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_entries.size();
+  }
+
+  [[nodiscard]] size_t getCapacity() const
+  {
+    return d_capacity;
+  }
+
+private:
+  struct KeyTag
+  {
+  };
+  struct CountTag
+  {
+  };
+
+  using entries_t = boost::multi_index_container<
+    Entry,
+    boost::multi_index::indexed_by<
+      boost::multi_index::hashed_unique<boost::multi_index::tag<KeyTag>, boost::multi_index::member<Entry, K, &Entry::d_key>, H>,
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<CountTag>, boost::multi_index::member<Entry, uint64_t, &Entry::d_count>>>>;
+
+  entries_t d_entries;
+  size_t d_capacity;
+};
+
+/* Trivially copyable representation of a key, so that readers can copy it
+   while the writer might be overwriting it, as the lock-free rings do */
+template <typename K>
+struct KeyStorage
+{
+  static_assert(std::is_trivially_copyable_v<K>, "Keys that are not trivially copyable need a specialization of KeyStorage");
+
+  void set(const K& key)
+  {
+    d_key = key;
+  }
+
+  [[nodiscard]] K get() const
+  {
+    return d_key;
+  }
+
+  K d_key;
+};
+
+template <>
+struct KeyStorage<DNSName>
+{
+  void set(const DNSName& name)
+  {
+    const auto& storage = name.getStorage();
+    setWire(storage.data(), storage.size());
+  }
+
+  /* uncompressed labels in wire format, root label included */
+  void setWire(const char* labels, size_t length)
+  {
+    d_length = std::min(length, d_name.size());
+    memcpy(d_name.data(), labels, d_length);
+  }
+
+  [[nodiscard]] DNSName get() const
+  {
+    if (d_length == 0) {
+      return {};
+    }
+    return DNSName::fromValidatedWire(d_name.data(), d_length);
+  }
+
+  uint16_t d_length{0};
+  std::array<char, DNSName::s_maxDNSNameLength> d_name;
+};
+
+uint64_t getNextHeavyHittersID();
+
+/* Combination of a Count-Min sketch, for the estimates, and of a SpaceSaving list,
+   to know which keys are the heaviest, over a sliding window of 'windowSeconds' seconds.
+   The window is approximated by keeping two consecutive epochs of 'windowSeconds' seconds,
+   the previous one being weighted by the fraction of it that is still inside the window.
+   The memory usage does not depend on the number of distinct keys.
+   Every thread adding keys gets its own sketches and lists, which it updates without taking
+   any lock, and readers merge the content of all threads. */
+template <typename K, typename H = std::hash<K>>
+class HeavyHitters
+{
+public:
+  struct Entry
+  {
+    K d_key;
+    uint64_t d_count{0};
+  };
+
+  HeavyHitters(size_t width, size_t depth, size_t capacity, unsigned int windowSeconds) :
+    d_width(width), d_depth(depth), d_capacity(capacity), d_id(getNextHeavyHittersID()), d_window(windowSeconds)
+  {
+    if (width == 0 || depth == 0) {
+      throw std::runtime_error("The width and depth of a sketch should be larger than 0");
+    }
+    if (windowSeconds == 0) {
+      throw std::runtime_error("The window of a heavy hitters sketch should be larger than 0");
+    }
+  }
+
+  void add(const K& key, time_t now, uint64_t count = 1)
+  {
+    add(static_cast<uint32_t>(H{}(key)), [&key](KeyStorage<K>& storage) { storage.set(key); }, now, count);
+  }
+
+  /* 'hash' has to be the hash of the key, which is only filled by 'filler'
+     when it needs to be stored, so the caller can avoid building it */
+  template <typename F>
+  void add(uint32_t hash, const F& filler, time_t now, uint64_t count = 1)
+  {
+    auto& writer = getWriter();
+    writer.rotate(now, d_window, d_generation.load(std::memory_order_relaxed));
+    writer.d_epochs.at(writer.d_current).add(hash, filler, count);
+  }
+
+  /* estimated number of occurrences of that key over the last 'windowSeconds' seconds */
+  [[nodiscard]] uint64_t estimate(const K& key, time_t now) const
+  {
+    return estimate(getWriters(), static_cast<uint32_t>(H{}(key)), now);
+  }
+
+  /* the 'numberOfEntries' heaviest keys over the last 'windowSeconds' seconds, heaviest first */
+  [[nodiscard]] std::vector<Entry> getTop(size_t numberOfEntries, time_t now) const
+  {
+    const auto writers = getWriters();
+    std::unordered_map<uint32_t, K> candidates;
+    for (const auto& writer : writers) {
+      for (const auto& epoch : writer->d_epochs) {
+        epoch.visitKeys(now, d_window, [&candidates](uint32_t hash, const KeyStorage<K>& key) {
+          if (candidates.count(hash) == 0) {
+            candidates.emplace(hash, key.get());
+          }
+        });
+      }
+    }
+
+    std::vector<Entry> result;
+    result.reserve(candidates.size());
+    for (auto& [hash, key] : candidates) {
+      auto count = estimate(writers, hash, now);
+      if (count > 0) {
+        result.push_back({std::move(key), count});
+      }
+    }
+
+    auto comp = [](const Entry& lhs, const Entry& rhs) {
+      return lhs.d_count > rhs.d_count;
+    };
+    if (result.size() > numberOfEntries) {
+      std::partial_sort(result.begin(), result.begin() + static_cast<ssize_t>(numberOfEntries), result.end(), comp);
+      result.resize(numberOfEntries);
+    }
+    else {
+      std::sort(result.begin(), result.end(), comp);
+    }
+    return result;
+  }
+
+  /* the threads reset their own content the next time they add a key,
+     in the meantime readers ignore it */
+  void clear()
+  {
+    d_generation++;
+  }
+
+  [[nodiscard]] unsigned int getWindow() const
+  {
+    return d_window;
+  }
+
+  [[nodiscard]] size_t getNumberOfWriters() const
+  {
+    return d_writers.lock()->size();
+  }
+
+  /* approximate memory usage of the content of a single thread, in bytes */
+  [[nodiscard]] size_t getMemoryUsagePerWriter() const
+  {
+    return 2 * ((d_width * d_depth * sizeof(uint64_t)) + (d_capacity * (sizeof(typename Epoch::KeySlot) + sizeof(typename SpaceSaving<uint32_t>::Entry))));
+  }
+
+private:
+  struct Epoch
+  {
+    struct KeySlot
+    {
+      std::atomic<uint64_t> d_sequence{0};
+      uint32_t d_hash{0};
+      KeyStorage<K> d_key;
+    };
+
+    static constexpr time_t s_invalidStart = std::numeric_limits<time_t>::min();
+
+    Epoch(size_t width, size_t depth, size_t capacity) :
+      d_sketch(width, depth), d_top(capacity), d_keys(capacity)
+    {
+    }
+
+    /* writer side */
+    void reset(time_t start)
+    {
+      const auto sequence = d_sequence.load(std::memory_order_relaxed);
+      d_sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      d_start.store(start, std::memory_order_relaxed);
+      d_keysCount.store(0, std::memory_order_relaxed);
+      d_sketch.clear();
+      d_top.clear();
+      d_keyIndexes.clear();
+      d_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /* writer side */
+    template <typename F>
+    void add(uint32_t hash, const F& filler, uint64_t count)
+    {
+      d_sketch.add(hash, count);
+
+      std::optional<uint32_t> evicted;
+      if (!d_top.add(hash, count, evicted)) {
+        return;
+      }
+
+      size_t index = d_keyIndexes.size();
+      if (evicted) {
+        auto indexIt = d_keyIndexes.find(*evicted);
+        index = indexIt->second;
+        d_keyIndexes.erase(indexIt);
+      }
+      d_keyIndexes.emplace(hash, index);
+
+      auto& slot = d_keys.at(index);
+      const auto sequence = slot.d_sequence.load(std::memory_order_relaxed);
+      slot.d_sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.d_hash = hash;
+      filler(slot.d_key);
+      slot.d_sequence.store(sequence + 2, std::memory_order_release);
+      if (index >= d_keysCount.load(std::memory_order_relaxed)) {
+        d_keysCount.store(index + 1, std::memory_order_release);
+      }
+    }
+
+    /* reader side: the weight of this epoch at 'now', 0 if it is outside of the window.
+       The epochs are not rotated on read, so this one might already be the previous one */
+    [[nodiscard]] double getWeight(time_t start, time_t now, unsigned int window) const
+    {
+      if (start == s_invalidStart) {
+        return 0.0;
+      }
+      const auto elapsed = static_cast<double>(std::max(now - start, static_cast<time_t>(0)));
+      const auto windowD = static_cast<double>(window);
+      if (elapsed < windowD) {
+        return 1.0;
+      }
+      if (elapsed < 2 * windowD) {
+        return 1.0 - ((elapsed - windowD) / windowD);
+      }
+      return 0.0;
+    }
+
+    /* reader side, 0 if the epoch was reset in the meantime */
+    [[nodiscard]] double estimate(uint32_t hash, time_t now, unsigned int window) const
+    {
+      const auto sequence = d_sequence.load(std::memory_order_acquire);
+      if ((sequence % 2) != 0) {
+        return 0.0;
+      }
+      const auto weight = getWeight(d_start.load(std::memory_order_relaxed), now, window);
+      if (weight == 0.0) {
+        return 0.0;
+      }
+      const auto count = d_sketch.estimate(hash);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (d_sequence.load(std::memory_order_relaxed) != sequence) {
+        return 0.0;
+      }
+      return weight * static_cast<double>(count);
+    }
+
+    /* reader side, the visitor is called with the hash and a copy of every key
+       that was not being overwritten while we copied it */
+    template <typename F>
+    void visitKeys(time_t now, unsigned int window, const F& visitor) const
+    {
+      if (getWeight(d_start.load(std::memory_order_acquire), now, window) == 0.0) {
+        return;
+      }
+      const auto count = std::min(d_keysCount.load(std::memory_order_acquire), d_keys.size());
+      for (size_t index = 0; index < count; index++) {
+        const auto& slot = d_keys.at(index);
+        const auto sequence = slot.d_sequence.load(std::memory_order_acquire);
+        if ((sequence % 2) != 0) {
+          continue;
+        }
+        const uint32_t hash = slot.d_hash;
+        const KeyStorage<K> key = slot.d_key;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.d_sequence.load(std::memory_order_relaxed) != sequence) {
+          continue;
+        }
+        visitor(hash, key);
+      }
+    }
+
+    CountMinSketch d_sketch;
+    /* only accessed by the writer */
+    SpaceSaving<uint32_t> d_top;
+    std::unordered_map<uint32_t, size_t> d_keyIndexes;
+    /* keys of the SpaceSaving list, published for the readers */
+    std::vector<KeySlot> d_keys;
+    std::atomic<size_t> d_keysCount{0};
+    std::atomic<time_t> d_start{s_invalidStart};
+    /* odd while the epoch is being reset */
+    std::atomic<uint64_t> d_sequence{0};
+  };
+
+  struct Writer
+  {
+    Writer(size_t width, size_t depth, size_t capacity) :
+      d_epochs{Epoch(width, depth, capacity), Epoch(width, depth, capacity)}
+    {
+    }
+
+    void rotate(time_t now, unsigned int window, uint64_t generation)
+    {
+      if (d_generation.load(std::memory_order_relaxed) != generation) {
+        d_epochs.at(0).reset(Epoch::s_invalidStart);
+        d_epochs.at(1).reset(Epoch::s_invalidStart);
+        d_generation.store(generation, std::memory_order_release);
+      }
+
+      auto& current = d_epochs.at(d_current);
+      const auto start = current.d_start.load(std::memory_order_relaxed);
+      if (start != Epoch::s_invalidStart) {
+        if (now < start + static_cast<time_t>(window)) {
+          return;
+        }
+        if (now < start + 2 * static_cast<time_t>(window)) {
+          d_current = 1 - d_current;
+          d_epochs.at(d_current).reset(start + static_cast<time_t>(window));
+          return;
+        }
+      }
+      current.reset(now);
+      auto& other = d_epochs.at(1 - d_current);
+      if (other.d_start.load(std::memory_order_relaxed) != Epoch::s_invalidStart) {
+        other.reset(Epoch::s_invalidStart);
+      }
+    }
+
+    std::array<Epoch, 2> d_epochs;
+    /* the generation of the heavy hitters object when this thread last reset its content */
+    std::atomic<uint64_t> d_generation{0};
+    /* only accessed by the writer */
+    size_t d_current{0};
+  };
+
+  Writer& getWriter()
+  {
+    /* keyed by the ID of the object rather than its address, which might be reused */
+    static thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Writer>>> t_writers;
+    for (const auto& [objectID, writer] : t_writers) {
+      if (objectID == d_id) {
+        return *writer;
+      }
+    }
+
+    /* forget about the objects that have been destroyed */
+    t_writers.erase(std::remove_if(t_writers.begin(), t_writers.end(), [](const auto& entry) { return entry.second.use_count() == 1; }), t_writers.end());
+
+    auto writer = std::make_shared<Writer>(d_width, d_depth, d_capacity);
+    writer->d_generation.store(d_generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    d_writers.lock()->push_back(writer);
+    t_writers.emplace_back(d_id, writer);
+    return *writer;
+  }
+
+  /* the writers whose content has not been cleared */
+  [[nodiscard]] std::vector<std::shared_ptr<const Writer>> getWriters() const
+  {
+    const auto generation = d_generation.load(std::memory_order_relaxed);
+    std::vector<std::shared_ptr<const Writer>> result;
+    for (const auto& writer : *(d_writers.lock())) {
+      if (writer->d_generation.load(std::memory_order_acquire) == generation) {
+        result.push_back(writer);
+      }
+    }
+    return result;
+  }
+
+  [[nodiscard]] uint64_t estimate(const std::vector<std::shared_ptr<const Writer>>& writers, uint32_t hash, time_t now) const
+  {
+    double result = 0.0;
+    for (const auto& writer : writers) {
+      for (const auto& epoch : writer->d_epochs) {
+        result += epoch.estimate(hash, now, d_window);
+      }
+    }
+    return static_cast<uint64_t>(result);
+  }
+
+  /* only locked when a thread adds its first key, and by readers */
+  mutable LockGuarded<std::vector<std::shared_ptr<Writer>>> d_writers;
+  std::atomic<uint64_t> d_generation{0};
+  const size_t d_width;
+  const size_t d_depth;
+  const size_t d_capacity;
+  const uint64_t d_id;
+  const unsigned int d_window;
+};
+
+/* Keeps track of the heaviest clients (netmasks), query name suffixes and query types,
+   updated on the query path as a Rings observer */
+class HeavyHittersTracker : public Rings::Observer
+{
+public:
+  struct Options
+  {
+    size_t d_width{2048};
+    size_t d_depth{4};
+    size_t d_capacity{100};
+    unsigned int d_window{60};
+    uint8_t d_v4Mask{32};
+    uint8_t d_v6Mask{128};
+    uint8_t d_suffixLabels{2};
+  };
+
+  explicit HeavyHittersTracker(const Options& options);
+
+  void onQuery(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype) override;
+  void onResponse(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, unsigned int usec, unsigned int size, const struct dnsheader& dnsHeader, const ComboAddress& backend) override;
+  /* the sketches are not tied to the content of the rings and are not cleared */
+  void onClear() override;
+
+  [[nodiscard]] AddressAndPortRange getClientKey(const ComboAddress& requestor) const;
+
+  [[nodiscard]] const HeavyHitters<AddressAndPortRange, AddressAndPortRange::hash>& getClients() const
+  {
+    return d_clients;
+  }
+
+  [[nodiscard]] const HeavyHitters<DNSName>& getSuffixes() const
+  {
+    return d_suffixes;
+  }
+
+  [[nodiscard]] const HeavyHitters<uint16_t>& getQTypes() const
+  {
+    return d_qtypes;
+  }
+
+  [[nodiscard]] const Options& getOptions() const
+  {
+    return d_options;
+  }
+
+  /* approximate memory usage, in bytes */
+  [[nodiscard]] size_t getMemoryUsage() const;
+
+private:
+  const Options d_options;
+  HeavyHitters<AddressAndPortRange, AddressAndPortRange::hash> d_clients;
+  HeavyHitters<DNSName> d_suffixes;
+  HeavyHitters<uint16_t> d_qtypes;
+};
+
+/* set at configuration time, nullptr if heavy hitters tracking is disabled */
+extern std::shared_ptr<HeavyHittersTracker> g_heavyHitters;
+}
@@ -4,8 +4,6 @@
 #include "dnsdist-tcp.hh"
 #include "dnsdist-tcp-downstream.hh"
 
-struct TCPCrossProtocolResponse;
-
 class TCPClientThreadData
 {
 public:
@@ -19,10 +17,7 @@ public:
   LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>> localCacheInsertedRespRuleActions;
   LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>> localXFRRespRuleActions;
   std::unique_ptr<FDMultiplexer> mplexer{nullptr};
-  pdns::channel::Receiver<ConnectionInfo> queryReceiver;
-  pdns::channel::Receiver<CrossProtocolQuery> crossProtocolQueryReceiver;
-  pdns::channel::Receiver<TCPCrossProtocolResponse> crossProtocolResponseReceiver;
-  pdns::channel::Sender<TCPCrossProtocolResponse> crossProtocolResponseSender;
+  std::shared_ptr<TCPWorkerQueues> queues{nullptr};
 };
 
 class IncomingTCPConnectionState : public TCPQuerySender, public std::enable_shared_from_this<IncomingTCPConnectionState>
@@ -129,7 +129,7 @@ std::shared_ptr<TCPConnectionToBackend> IncomingTCPConnectionState::getDownstrea
   return downstream;
 }
 
-static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates);
+static void tcpClientThread(std::shared_ptr<TCPWorkerQueues> queues, std::vector<ClientState*> tcpAcceptStates);
 
 TCPClientCollection::TCPClientCollection(size_t maxThreads, std::vector<ClientState*> tcpAcceptStates) :
   d_tcpclientthreads(maxThreads), d_maxthreads(maxThreads)
@@ -142,11 +142,9 @@ TCPClientCollection::TCPClientCollection(size_t maxThreads, std::vector<ClientSt
 void TCPClientCollection::addTCPClientThread(std::vector<ClientState*>& tcpAcceptStates)
 {
   try {
-    auto [queryChannelSender, queryChannelReceiver] = pdns::channel::createObjectQueue<ConnectionInfo>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, g_tcpInternalPipeBufferSize);
-
-    auto [crossProtocolQueryChannelSender, crossProtocolQueryChannelReceiver] = pdns::channel::createObjectQueue<CrossProtocolQuery>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, g_tcpInternalPipeBufferSize);
-
-    auto [crossProtocolResponseChannelSender, crossProtocolResponseChannelReceiver] = pdns::channel::createObjectQueue<TCPCrossProtocolResponse>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, g_tcpInternalPipeBufferSize);
+    /* the queues used to be pipes, so keep the existing setting meaningful:
+       one object per pointer-sized slot, 0 meaning no limit */
+    auto queues = std::make_shared<TCPWorkerQueues>(g_tcpInternalPipeBufferSize / sizeof(void*));
 
     vinfolog("Adding TCP Client thread");
 
@@ -155,10 +153,8 @@ void TCPClientCollection::addTCPClientThread(std::vector<ClientState*>& tcpAccep
       return;
     }
 
-    TCPWorkerThread worker(std::move(queryChannelSender), std::move(crossProtocolQueryChannelSender));
-
     try {
-      std::thread clientThread(tcpClientThread, std::move(queryChannelReceiver), std::move(crossProtocolQueryChannelReceiver), std::move(crossProtocolResponseChannelReceiver), std::move(crossProtocolResponseChannelSender), tcpAcceptStates);
+      std::thread clientThread(tcpClientThread, queues, tcpAcceptStates);
       clientThread.detach();
     }
     catch (const std::runtime_error& e) {
@@ -166,7 +162,7 @@ void TCPClientCollection::addTCPClientThread(std::vector<ClientState*>& tcpAccep
       return;
     }
 
-    d_tcpclientthreads.at(d_numthreads) = std::move(worker);
+    d_tcpclientthreads.at(d_numthreads) = std::move(queues);
     ++d_numthreads;
   }
   catch (const std::exception& e) {
@@ -176,6 +172,13 @@ void TCPClientCollection::addTCPClientThread(std::vector<ClientState*>& tcpAccep
 
 std::unique_ptr<TCPClientCollection> g_tcpclientthreads;
 
+TCPWorkerQueues::TCPWorkerQueues(size_t capacity) :
+  d_queries(capacity), d_crossProtocolQueries(capacity), d_crossProtocolResponses(capacity)
+{
+}
+
+TCPWorkerQueues::~TCPWorkerQueues() = default;
+
 static IOState sendQueuedResponses(std::shared_ptr<IncomingTCPConnectionState>& state, const struct timeval& now)
 {
   IOState result = IOState::Done;
@@ -614,14 +617,18 @@ void IncomingTCPConnectionState::handleCrossProtocolResponse(const struct timeva
 {
   std::shared_ptr<IncomingTCPConnectionState> state = shared_from_this();
   try {
+    auto& queues = state->d_threadData.queues;
+    if (!queues) {
+      throw std::runtime_error("no queue to the TCP worker thread");
+    }
     auto ptr = std::make_unique<TCPCrossProtocolResponse>(std::move(response), state, now);
-    if (!state->d_threadData.crossProtocolResponseSender.send(std::move(ptr))) {
+    if (!queues->push(queues->d_crossProtocolResponses, std::move(ptr))) {
       ++dnsdist::metrics::g_stats.tcpCrossProtocolResponsePipeFull;
-      vinfolog("Unable to pass a cross-protocol response to the TCP worker thread because the pipe is full");
+      vinfolog("Unable to pass a cross-protocol response to the TCP worker thread because the queue is full");
     }
   }
   catch (const std::exception& e) {
-    vinfolog("Unable to pass a cross-protocol response to the TCP worker thread because we couldn't write to the pipe: %s", stringerror());
+    vinfolog("Unable to pass a cross-protocol response to the TCP worker thread: %s", e.what());
   }
 }
 
@@ -703,19 +710,16 @@ IncomingTCPConnectionState::QueryProcessingResult IncomingTCPConnectionState::ha
     }
   }
 
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast
-  ids.qname = DNSName(reinterpret_cast<const char*>(query.data()), static_cast<int>(query.size()), sizeof(dnsheader), false, &ids.qtype, &ids.qclass);
+  ids.parseQuestion(query);
   ids.protocol = getProtocol();
   if (ids.dnsCryptQuery) {
     ids.protocol = dnsdist::Protocol::DNSCryptTCP;
   }
 
   DNSQuestion dnsQuestion(ids, query);
-  dnsdist::PacketMangling::editDNSHeaderFromPacket(dnsQuestion.getMutableData(), [&ids](dnsheader& header) {
-    const uint16_t* flags = getFlagsFromDNSHeader(&header);
-    ids.origFlags = *flags;
-    return true;
-  });
+  /* read-only access, so that the scan of the query done by parseQuestion() stays valid */
+  const uint16_t* flags = getFlagsFromDNSHeader(dnsQuestion.getHeader().get());
+  ids.origFlags = *flags;
   dnsQuestion.d_incomingTCPState = state;
   dnsQuestion.sni = d_handler.getServerNameIndication();
 
@@ -1275,22 +1279,8 @@ void IncomingTCPConnectionState::handleTimeout(std::shared_ptr<IncomingTCPConnec
   }
 }
 
-static void handleIncomingTCPQuery(int pipefd, FDMultiplexer::funcparam_t& param)
+static void handleIncomingTCPQuery(TCPClientThreadData* threadData, std::unique_ptr<ConnectionInfo>&& citmp)
 {
-  auto* threadData = boost::any_cast<TCPClientThreadData*>(param);
-
-  std::unique_ptr<ConnectionInfo> citmp{nullptr};
-  try {
-    auto tmp = threadData->queryReceiver.receive();
-    if (!tmp) {
-      return;
-    }
-    citmp = std::move(*tmp);
-  }
-  catch (const std::exception& e) {
-    throw std::runtime_error("Error while reading from the TCP query channel: " + std::string(e.what()));
-  }
-
   g_tcpclientthreads->decrementQueuedCount();
 
   timeval now{};
@@ -1308,22 +1298,8 @@ static void handleIncomingTCPQuery(int pipefd, FDMultiplexer::funcparam_t& param
   }
 }
 
-static void handleCrossProtocolQuery(int pipefd, FDMultiplexer::funcparam_t& param)
+static void handleCrossProtocolQuery(TCPClientThreadData* threadData, std::unique_ptr<CrossProtocolQuery>&& cpq)
 {
-  auto* threadData = boost::any_cast<TCPClientThreadData*>(param);
-
-  std::unique_ptr<CrossProtocolQuery> cpq{nullptr};
-  try {
-    auto tmp = threadData->crossProtocolQueryReceiver.receive();
-    if (!tmp) {
-      return;
-    }
-    cpq = std::move(*tmp);
-  }
-  catch (const std::exception& e) {
-    throw std::runtime_error("Error while reading from the TCP cross-protocol channel: " + std::string(e.what()));
-  }
-
   timeval now{};
   gettimeofday(&now, nullptr);
 
@@ -1345,22 +1321,8 @@ static void handleCrossProtocolQuery(int pipefd, FDMultiplexer::funcparam_t& par
   }
 }
 
-static void handleCrossProtocolResponse(int pipefd, FDMultiplexer::funcparam_t& param)
+static void handleCrossProtocolResponse(std::unique_ptr<TCPCrossProtocolResponse>&& cpr)
 {
-  auto* threadData = boost::any_cast<TCPClientThreadData*>(param);
-
-  std::unique_ptr<TCPCrossProtocolResponse> cpr{nullptr};
-  try {
-    auto tmp = threadData->crossProtocolResponseReceiver.receive();
-    if (!tmp) {
-      return;
-    }
-    cpr = std::move(*tmp);
-  }
-  catch (const std::exception& e) {
-    throw std::runtime_error("Error while reading from the TCP cross-protocol response: " + std::string(e.what()));
-  }
-
   auto& response = *cpr;
 
   try {
@@ -1379,6 +1341,45 @@ static void handleCrossProtocolResponse(int pipefd, FDMultiplexer::funcparam_t&
   }
 }
 
+/* maximum number of objects processed from each queue in one go, so that
+   a busy producer cannot starve the connections already owned by the worker */
+static constexpr size_t s_maxObjectsPerQueueRun{1024};
+
+/* returns true if there are still objects waiting in the queues */
+static bool processWorkerQueues(TCPClientThreadData* threadData)
+{
+  auto& queues = *threadData->queues;
+  for (size_t idx = 0; idx < s_maxObjectsPerQueueRun; idx++) {
+    auto connInfo = queues.d_queries.pop();
+    if (!connInfo) {
+      break;
+    }
+    handleIncomingTCPQuery(threadData, std::move(connInfo));
+  }
+  for (size_t idx = 0; idx < s_maxObjectsPerQueueRun; idx++) {
+    auto cpq = queues.d_crossProtocolQueries.pop();
+    if (!cpq) {
+      break;
+    }
+    handleCrossProtocolQuery(threadData, std::move(cpq));
+  }
+  for (size_t idx = 0; idx < s_maxObjectsPerQueueRun; idx++) {
+    auto cpr = queues.d_crossProtocolResponses.pop();
+    if (!cpr) {
+      break;
+    }
+    handleCrossProtocolResponse(std::move(cpr));
+  }
+  return !queues.empty();
+}
+
+static void handleWorkerQueuesDoorbell(int desc, FDMultiplexer::funcparam_t& param)
+{
+  auto* threadData = boost::any_cast<TCPClientThreadData*>(param);
+  threadData->queues->d_doorbell.clear();
+  processWorkerQueues(threadData);
+}
+
 struct TCPAcceptorParam
 {
   // NOLINTNEXTLINE(cppcoreguidelines-avoid-const-or-ref-data-members)
@@ -1480,7 +1481,7 @@ static void dumpTCPStates(const TCPClientThreadData& data)
         infolog(" - %s", conn->toString());
       }
       else if (param.type() == typeid(TCPClientThreadData*)) {
-        infolog(" - Worker thread pipe");
+        infolog(" - Worker thread doorbell");
       }
     });
     infolog("The TCP/DoT client cache has %d active and %d idle outgoing connections cached", t_downstreamTCPConnectionsManager.getActiveCount(), t_downstreamTCPConnectionsManager.getIdleCount());
@@ -1488,23 +1489,18 @@ static void dumpTCPStates(const TCPClientThreadData& data)
 }
 
 // NOLINTNEXTLINE(performance-unnecessary-value-param): you are wrong, clang-tidy, go home
-static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates)
+static void tcpClientThread(std::shared_ptr<TCPWorkerQueues> queues, std::vector<ClientState*> tcpAcceptStates)
 {
-  /* we get launched with a pipe on which we receive file descriptors from clients that we own
-     from that point on */
+  /* we get launched with queues on which we receive connections from clients that we own
+     from that point on, and cross-protocol queries and responses */
 
   setThreadName("dnsdist/tcpClie");
 
   try {
     TCPClientThreadData data;
-    data.crossProtocolResponseSender = std::move(crossProtocolResponseSender);
-    data.queryReceiver = std::move(queryReceiver);
-    data.crossProtocolQueryReceiver = std::move(crossProtocolQueryReceiver);
-    data.crossProtocolResponseReceiver = std::move(crossProtocolResponseReceiver);
-
-    data.mplexer->addReadFD(data.queryReceiver.getDescriptor(), handleIncomingTCPQuery, &data);
-    data.mplexer->addReadFD(data.crossProtocolQueryReceiver.getDescriptor(), handleCrossProtocolQuery, &data);
-    data.mplexer->addReadFD(data.crossProtocolResponseReceiver.getDescriptor(), handleCrossProtocolResponse, &data);
+    data.queues = std::move(queues);
+    auto& doorbell = data.queues->d_doorbell;
+    data.mplexer->addReadFD(doorbell.getDescriptor(), handleWorkerQueuesDoorbell, &data);
 
     /* only used in single acceptor mode for now */
     auto acl = g_ACL.getLocal();
@@ -1533,7 +1529,12 @@ static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryRecei
     time_t lastTimeoutScan = now.tv_sec;
 
     for (;;) {
-      data.mplexer->run(&now);
+      /* producers only ring the doorbell if we are about to wait, so we need
+         to check the queues after saying so, and not block if they are not empty */
+      doorbell.prepareToWait();
+      bool pending = processWorkerQueues(&data);
+      data.mplexer->run(&now, pending ? 0 : 500);
+      doorbell.doneWaiting();
 
       try {
         t_downstreamTCPConnectionsManager.cleanupClosedConnections(now);
@@ -23,10 +23,10 @@
 
 #include <optional>
 #include <unistd.h>
-#include "channel.hh"
 #include "iputils.hh"
 #include "dnsdist.hh"
 #include "dnsdist-metrics.hh"
+#include "dnsdist-mpsc-queue.hh"
 
 struct ConnectionInfo
 {
@@ -215,6 +215,40 @@ struct CrossProtocolQuery
   bool d_isResponse{false};
 };
 
+struct TCPCrossProtocolResponse;
+
+/* the queues used to pass objects to a TCP worker thread, shared between
+   that thread and the ones feeding it */
+struct TCPWorkerQueues
+{
+  TCPWorkerQueues(size_t capacity);
+  TCPWorkerQueues(const TCPWorkerQueues&) = delete;
+  TCPWorkerQueues(TCPWorkerQueues&&) = delete;
+  TCPWorkerQueues& operator=(const TCPWorkerQueues&) = delete;
+  TCPWorkerQueues& operator=(TCPWorkerQueues&&) = delete;
+  ~TCPWorkerQueues();
+
+  template <typename T>
+  bool push(dnsdist::MPSCQueue<T>& queue, std::unique_ptr<T>&& object)
+  {
+    if (!queue.push(std::move(object))) {
+      return false;
+    }
+    d_doorbell.ring();
+    return true;
+  }
+
+  bool empty() const
+  {
+    return d_queries.empty() && d_crossProtocolQueries.empty() && d_crossProtocolResponses.empty();
+  }
+
+  dnsdist::MPSCQueue<ConnectionInfo> d_queries;
+  dnsdist::MPSCQueue<CrossProtocolQuery> d_crossProtocolQueries;
+  dnsdist::MPSCQueue<TCPCrossProtocolResponse> d_crossProtocolResponses;
+  dnsdist::Doorbell d_doorbell;
+};
+
 class TCPClientCollection
 {
 public:
@@ -227,11 +261,12 @@ public:
     }
 
     uint64_t pos = d_pos++;
-    /* we need to increment this counter _before_ writing to the pipe,
+    /* we need to increment this counter _before_ queueing the connection,
        otherwise there is a very real possiblity that the other end
        decrement the counter before we can increment it, leading to an underflow */
     ++d_queued;
-    if (!d_tcpclientthreads.at(pos % d_numthreads).d_querySender.send(std::move(conn))) {
+    auto& queues = *d_tcpclientthreads.at(pos % d_numthreads);
+    if (!queues.push(queues.d_queries, std::move(conn))) {
       --d_queued;
       ++dnsdist::metrics::g_stats.tcpQueryPipeFull;
       return false;
@@ -247,7 +282,8 @@ public:
     }
 
     uint64_t pos = d_pos++;
-    if (!d_tcpclientthreads.at(pos % d_numthreads).d_crossProtocolQuerySender.send(std::move(cpq))) {
+    auto& queues = *d_tcpclientthreads.at(pos % d_numthreads);
+    if (!queues.push(queues.d_crossProtocolQueries, std::move(cpq))) {
       ++dnsdist::metrics::g_stats.tcpCrossProtocolQueryPipeFull;
       return false;
     }
@@ -278,27 +314,7 @@ public:
 private:
   void addTCPClientThread(std::vector<ClientState*>& tcpAcceptStates);
 
-  struct TCPWorkerThread
-  {
-    TCPWorkerThread()
-    {
-    }
-
-    TCPWorkerThread(pdns::channel::Sender<ConnectionInfo>&& querySender, pdns::channel::Sender<CrossProtocolQuery>&& crossProtocolQuerySender) :
-      d_querySender(std::move(querySender)), d_crossProtocolQuerySender(std::move(crossProtocolQuerySender))
-    {
-    }
-
-    TCPWorkerThread(TCPWorkerThread&& rhs) = default;
-    TCPWorkerThread& operator=(TCPWorkerThread&& rhs) = default;
-    TCPWorkerThread(const TCPWorkerThread& rhs) = delete;
-    TCPWorkerThread& operator=(const TCPWorkerThread&) = delete;
-
-    pdns::channel::Sender<ConnectionInfo> d_querySender;
-    pdns::channel::Sender<CrossProtocolQuery> d_crossProtocolQuerySender;
-  };
-
-  std::vector<TCPWorkerThread> d_tcpclientthreads;
+  std::vector<std::shared_ptr<TCPWorkerQueues>> d_tcpclientthreads;
   stat_t d_numthreads{0};
   stat_t d_pos{0};
   stat_t d_queued{0};
@@ -0,0 +1,134 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace dnsdist
+{
+/* A hashed timer wheel: a timer is stored in the slot corresponding to its
+   expiration tick, modulo the number of slots, so that scheduling a timer and
+   finding the expired ones only cost a constant amount of work per timer,
+   regardless of the number of pending timers. Timers expiring after more than
+   one rotation of the wheel are supported, but are looked at once per rotation.
+   Not thread-safe. */
+template <typename T>
+class TimerWheel
+{
+public:
+  TimerWheel(size_t slotsCount, uint64_t tickUsec, uint64_t nowUsec) :
+    d_slots(slotsCount), d_tickUsec(tickUsec), d_currentTick(nowUsec / tickUsec)
+  {
+    if (slotsCount == 0 || tickUsec == 0) {
+      throw std::runtime_error("A timer wheel needs at least one slot and a non-zero tick duration");
+    }
+  }
+
+  /* the timer will expire at the first tick following the supplied time,
+     or at the next tick if that time has already passed */
+  void schedule(T&& value, uint64_t whenUsec)
+  {
+    auto tick = (whenUsec + d_tickUsec - 1) / d_tickUsec;
+    if (tick <= d_currentTick) {
+      tick = d_currentTick + 1;
+    }
+    d_slots.at(tick % d_slots.size()).push_back({tick, std::move(value)});
+    ++d_size;
+  }
+
+  /* calls the supplied callback, with the value and the time of expiration, for every
+     timer that expired at or before the supplied time. The callback is allowed to
+     schedule new timers, which will not expire before the next tick */
+  template <typename CallbackType>
+  void advance(uint64_t nowUsec, CallbackType&& callback)
+  {
+    const auto target = nowUsec / d_tickUsec;
+    if (target <= d_currentTick) {
+      return;
+    }
+
+    /* once every slot has been visited there is no point in going further */
+    auto tick = d_currentTick + 1;
+    if (target - d_currentTick > d_slots.size()) {
+      tick = target - d_slots.size() + 1;
+    }
+    d_currentTick = target;
+
+    for (; tick <= target; tick++) {
+      auto& slot = d_slots.at(tick % d_slots.size());
+      for (size_t idx = 0; idx < slot.size();) {
+        if (slot[idx].d_tick > target) {
+          ++idx;
+          continue;
+        }
+        d_expired.push_back(std::move(slot[idx]));
+        if (idx != slot.size() - 1) {
+          slot[idx] = std::move(slot.back());
+        }
+        slot.pop_back();
+      }
+    }
+
+    d_size -= d_expired.size();
+    /* the callback might schedule new timers, so we cannot walk the slots while calling it */
+    auto expired = std::move(d_expired);
+    d_expired.clear();
+    for (auto& entry : expired) {
+      callback(std::move(entry.d_value), entry.d_tick * d_tickUsec);
+    }
+    expired.clear();
+    /* reuse the allocated memory */
+    d_expired = std::move(expired);
+  }
+
+  /* the time at which the next tick starts */
+  uint64_t getNextTickUsec() const
+  {
+    return (d_currentTick + 1) * d_tickUsec;
+  }
+
+  size_t size() const
+  {
+    return d_size;
+  }
+
+  bool empty() const
+  {
+    return d_size == 0;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t d_tick;
+    T d_value;
+  };
+
+  std::vector<std::vector<Entry>> d_slots;
+  std::vector<Entry> d_expired;
+  const uint64_t d_tickUsec;
+  uint64_t d_currentTick;
+  size_t d_size{0};
+};
+}
@@ -37,6 +37,7 @@
 #include "dnsdist-metrics.hh"
 #include "dnsdist-prometheus.hh"
 #include "dnsdist-rings.hh"
+#include "dnsdist-sketches.hh"
 #include "dnsdist-rule-chains.hh"
 #include "dnsdist-web.hh"
 #include "dolog.hh"
@@ -197,6 +198,10 @@ std::map<std::string, MetricDefinition> MetricDefinitionStorage::metrics{
   {"empty-queries", MetricDefinition(PrometheusMetricType::counter, "Number of empty queries received from clients")},
   {"cache-hits", MetricDefinition(PrometheusMetricType::counter, "Number of times an answer was retrieved from cache")},
   {"cache-misses", MetricDefinition(PrometheusMetricType::counter, "Number of times an answer not found in the cache")},
+  {"cache-collapsed-queries", MetricDefinition(PrometheusMetricType::counter, "Number of cache misses that waited for an identical query already sent to a backend")},
+  {"cache-collapsing-overflows", MetricDefinition(PrometheusMetricType::counter, "Number of cache misses forwarded because too many identical queries were already waiting")},
+  {"cache-collapsing-timeouts", MetricDefinition(PrometheusMetricType::counter, "Number of queries that stopped waiting for an identical query because it was not answered in time")},
+  {"xsk-response-drops", MetricDefinition(PrometheusMetricType::counter, "Number of responses to XSK queries dropped because they did not fit into an XSK frame")},
   {"cpu-iowait", MetricDefinition(PrometheusMetricType::counter, "Time waiting for I/O to complete by the whole system, in units of USER_HZ")},
   {"cpu-user-msec", MetricDefinition(PrometheusMetricType::counter, "Milliseconds spent by dnsdist in the user state")},
   {"cpu-steal", MetricDefinition(PrometheusMetricType::counter, "Stolen time, which is the time spent by the whole system in other operating systems when running in a virtualized environment, in units of USER_HZ")},
@@ -204,6 +209,8 @@ std::map<std::string, MetricDefinition> MetricDefinitionStorage::metrics{
   {"fd-usage", MetricDefinition(PrometheusMetricType::gauge, "Number of currently used file descriptors")},
   {"dyn-blocked", MetricDefinition(PrometheusMetricType::counter, "Number of queries dropped because of a dynamic block")},
   {"dyn-block-nmg-size", MetricDefinition(PrometheusMetricType::gauge, "Number of dynamic blocks entries")},
+  {"rings-overwrites", MetricDefinition(PrometheusMetricType::counter, "Number of entries overwritten in the lock-free ring buffers")},
+  {"rings-laps", MetricDefinition(PrometheusMetricType::counter, "Number of lock-free ring buffers entries skipped by a reader because they were overwritten while being read")},
   {"security-status", MetricDefinition(PrometheusMetricType::gauge, "Security status of this software. 0=unknown, 1=OK, 2=upgrade recommended, 3=upgrade mandatory")},
   {"doh-query-pipe-full", MetricDefinition(PrometheusMetricType::counter, "Number of DoH queries dropped because the internal pipe used to distribute queries was full")},
   {"doh-response-pipe-full", MetricDefinition(PrometheusMetricType::counter, "Number of DoH responses dropped because the internal pipe used to distribute responses was full")},
@@ -466,7 +473,7 @@ static json11::Json::array someResponseRulesToJson(GlobalStateHolder<vector<T>>*
 
 #ifndef DISABLE_PROMETHEUS
 template <typename T>
-static void addRulesToPrometheusOutput(std::ostringstream& output, GlobalStateHolder<vector<T>>& rules)
+static void addRulesToPrometheusOutput(std::ostringstream& output, GlobalStateHolder<T>& rules)
 {
   auto localRules = rules.getLocal();
   for (const auto& entry : *localRules) {
@@ -578,6 +585,10 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   output << "# TYPE " << statesbase << "senderrors "                      << "counter"                                                                              << "\n";
   output << "# HELP " << statesbase << "outstanding "                     << "Current number of queries that are waiting for a backend response"                    << "\n";
   output << "# TYPE " << statesbase << "outstanding "                     << "gauge"                                                                                << "\n";
+  output << "# HELP " << statesbase << "idstatescapacity "                << "Number of slots available to track queries waiting for a backend response"            << "\n";
+  output << "# TYPE " << statesbase << "idstatescapacity "                << "gauge"                                                                                << "\n";
+  output << "# HELP " << statesbase << "idstatecollisions "               << "Number of times the slot picked for a new query was already in use"                   << "\n";
+  output << "# TYPE " << statesbase << "idstatecollisions "               << "counter"                                                                              << "\n";
   output << "# HELP " << statesbase << "order "                           << "The order in which this server is picked"                                             << "\n";
   output << "# TYPE " << statesbase << "order "                           << "gauge"                                                                                << "\n";
   output << "# HELP " << statesbase << "weight "                          << "The weight within the order in which this server is picked"                           << "\n";
@@ -651,6 +662,8 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
     }
     output << statesbase << "senderrors"                       << label << " " << state->sendErrors.load()               << "\n";
     output << statesbase << "outstanding"                      << label << " " << state->outstanding.load()              << "\n";
+    output << statesbase << "idstatescapacity"                 << label << " " << state->getIDStatesCapacity()           << "\n";
+    output << statesbase << "idstatecollisions"                << label << " " << state->idStateCollisions.load()        << "\n";
     output << statesbase << "order"                            << label << " " << state->d_config.order                  << "\n";
     output << statesbase << "weight"                           << label << " " << state->d_config.d_weight               << "\n";
     output << statesbase << "tcpdiedsendingquery"              << label << " " << state->tcpDiedSendingQuery             << "\n";
@@ -712,6 +725,14 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   output << "# TYPE " << frontsbase << "tlsinactiveticketkeys " << "counter" << "\n";
   output << "# HELP " << frontsbase << "tlshandshakefailures " << "Amount of TLS handshake failures" << "\n";
   output << "# TYPE " << frontsbase << "tlshandshakefailures " << "counter" << "\n";
+  output << "# HELP " << frontsbase << "quicreceivecalls " << "Number of system calls used to receive QUIC datagrams" << "\n";
+  output << "# TYPE " << frontsbase << "quicreceivecalls " << "counter" << "\n";
+  output << "# HELP " << frontsbase << "quicreceiveddatagrams " << "Number of QUIC datagrams received" << "\n";
+  output << "# TYPE " << frontsbase << "quicreceiveddatagrams " << "counter" << "\n";
+  output << "# HELP " << frontsbase << "quicsendcalls " << "Number of system calls used to send QUIC datagrams" << "\n";
+  output << "# TYPE " << frontsbase << "quicsendcalls " << "counter" << "\n";
+  output << "# HELP " << frontsbase << "quicsentdatagrams " << "Number of QUIC datagrams sent" << "\n";
+  output << "# TYPE " << frontsbase << "quicsentdatagrams " << "counter" << "\n";
 
   std::map<std::string,uint64_t> frontendDuplicates;
   for (const auto& front : g_frontends) {
@@ -736,6 +757,25 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
     output << frontsbase << "queries" << label << front->queries.load() << "\n";
     output << frontsbase << "noncompliantqueries" << label << front->nonCompliantQueries.load() << "\n";
     output << frontsbase << "responses" << label << front->responses.load() << "\n";
+#if defined(HAVE_DNS_OVER_QUIC) || defined(HAVE_DNS_OVER_HTTP3)
+    const dnsdist::doq::DatagramStats* datagramStats = nullptr;
+#ifdef HAVE_DNS_OVER_QUIC
+    if (front->doqFrontend != nullptr) {
+      datagramStats = &front->doqFrontend->d_datagramStats;
+    }
+#endif /* HAVE_DNS_OVER_QUIC */
+#ifdef HAVE_DNS_OVER_HTTP3
+    if (front->doh3Frontend != nullptr) {
+      datagramStats = &front->doh3Frontend->d_datagramStats;
+    }
+#endif /* HAVE_DNS_OVER_HTTP3 */
+    if (datagramStats != nullptr) {
+      output << frontsbase << "quicreceivecalls" << label << datagramStats->d_receiveCalls.load() << "\n";
+      output << frontsbase << "quicreceiveddatagrams" << label << datagramStats->d_receivedDatagrams.load() << "\n";
+      output << frontsbase << "quicsendcalls" << label << datagramStats->d_sendCalls.load() << "\n";
+      output << frontsbase << "quicsentdatagrams" << label << datagramStats->d_sentDatagrams.load() << "\n";
+    }
+#endif /* HAVE_DNS_OVER_QUIC || HAVE_DNS_OVER_HTTP3 */
     if (front->isTCP()) {
       output << frontsbase << "tcpdiedreadingquery" << label << front->tcpDiedReadingQuery.load() << "\n";
       output << frontsbase << "tcpdiedsendingresponse" << label << front->tcpDiedSendingResponse.load() << "\n";
@@ -923,6 +963,20 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   }
 #endif /* DISABLE_DYNBLOCKS */
 
+#ifdef HAVE_EBPF
+  if (g_defaultBPFFilter && g_defaultBPFFilter->supportsRateLimiting()) {
+    output << "# HELP dnsdist_ebpf_ratelimit_passed " << "Number of queries allowed by this in-kernel eBPF rate-limiting stage" << "\n";
+    output << "# TYPE dnsdist_ebpf_ratelimit_passed " << "counter" << "\n";
+    output << "# HELP dnsdist_ebpf_ratelimit_limited " << "Number of queries dropped or truncated by this in-kernel eBPF rate-limiting stage" << "\n";
+    output << "# TYPE dnsdist_ebpf_ratelimit_limited " << "counter" << "\n";
+    for (const auto& [name, stage] : {std::pair{"sources", BPFFilter::RateLimitStage::Sources}, std::pair{"suffixes", BPFFilter::RateLimitStage::Suffixes}}) {
+      const auto counters = g_defaultBPFFilter->getRateLimitCounters(stage);
+      output << "dnsdist_ebpf_ratelimit_passed{stage=\"" << name << "\"} " << counters.d_passed << "\n";
+      output << "dnsdist_ebpf_ratelimit_limited{stage=\"" << name << "\"} " << counters.d_limited << "\n";
+    }
+  }
+#endif /* HAVE_EBPF */
+
   output << "# HELP dnsdist_info " << "Info from dnsdist, value is always 1" << "\n";
   output << "# TYPE dnsdist_info " << "gauge" << "\n";
   output << "dnsdist_info{version=\"" << VERSION << "\"} " << "1" << "\n";
@@ -1101,6 +1155,8 @@ static void addServerToJSON(Json::array& servers, int identifier, const std::sha
     {"qpsLimit", (double)backend->qps.getRate()},
     {"outstanding", (double)backend->outstanding},
     {"reuseds", (double)backend->reuseds},
+    {"idStatesCapacity", (double)backend->getIDStatesCapacity()},
+    {"idStateCollisions", (double)backend->idStateCollisions},
     {"weight", (double)backend->d_config.d_weight},
     {"order", (double)backend->d_config.order},
     {"pools", std::move(pools)},
@@ -1691,27 +1747,19 @@ static void handleRings(const YaHTTP::Request& req, YaHTTP::Response& resp)
   };
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    if (!maxNumberOfQueries || numberOfQueries < *maxNumberOfQueries) {
-      auto queryRing = shard->queryRing.lock();
-      for (const auto& entry : *queryRing) {
-        addRingEntryToList(now, queries, entry);
-        numberOfQueries++;
-        if (maxNumberOfQueries && numberOfQueries >= *maxNumberOfQueries) {
-          break;
-        }
-      }
-    }
-    if (!maxNumberOfResponses || numberOfResponses < *maxNumberOfResponses) {
-      auto responseRing = shard->respRing.lock();
-      for (const auto& entry : *responseRing) {
-        addRingEntryToList(now, responses, entry);
-        numberOfResponses++;
-        if (maxNumberOfResponses && numberOfResponses >= *maxNumberOfResponses) {
-          break;
-        }
-      }
-    }
+  if (!maxNumberOfQueries || *maxNumberOfQueries > 0) {
+    g_rings.visitQueries([&](const Rings::Query& entry) {
+      addRingEntryToList(now, queries, entry);
+      numberOfQueries++;
+      return !maxNumberOfQueries || numberOfQueries < *maxNumberOfQueries;
+    });
+  }
+  if (!maxNumberOfResponses || *maxNumberOfResponses > 0) {
+    g_rings.visitResponses([&](const Rings::Response& entry) {
+      addRingEntryToList(now, responses, entry);
+      numberOfResponses++;
+      return !maxNumberOfResponses || numberOfResponses < *maxNumberOfResponses;
+    });
   }
   doc.emplace("queries", std::move(queries));
   doc.emplace("responses", std::move(responses));
@@ -1720,6 +1768,51 @@ static void handleRings(const YaHTTP::Request& req, YaHTTP::Response& resp)
   resp.headers["Content-Type"] = "application/json";
 }
 
+static void handleHeavyHitters(const YaHTTP::Request& req, YaHTTP::Response& resp)
+{
+  handleCORS(req, resp);
+
+  const auto& tracker = dnsdist::sketches::g_heavyHitters;
+  if (!tracker) {
+    resp.status = 404;
+    return;
+  }
+
+  size_t numberOfEntries = 10;
+  const auto top = req.getvars.find("top");
+  if (top != req.getvars.end()) {
+    try {
+      numberOfEntries = pdns::checked_stoi<size_t>(top->second);
+    }
+    catch (const std::exception& exp) {
+      vinfolog("Error parsing the 'top' value from heavy hitters HTTP GET query: %s", exp.what());
+    }
+  }
+
+  const auto now = time(nullptr);
+  auto toJSON = [](const auto& entries, const auto& toString) {
+    Json::array list;
+    for (const auto& entry : entries) {
+      list.emplace_back(Json::object{
+        {"key", toString(entry.d_key)},
+        {"count", static_cast<double>(entry.d_count)},
+      });
+    }
+    return list;
+  };
+
+  Json::object doc{
+    {"window", static_cast<int>(tracker->getClients().getWindow())},
+    {"clients", toJSON(tracker->getClients().getTop(numberOfEntries, now), [](const AddressAndPortRange& key) { return key.toString(); })},
+    {"suffixes", toJSON(tracker->getSuffixes().getTop(numberOfEntries, now), [](const DNSName& key) { return key.toString(); })},
+    {"qtypes", toJSON(tracker->getQTypes().getTop(numberOfEntries, now), [](uint16_t key) { return QType(key).toString(); })},
+  };
+  resp.status = 200;
+  Json my_json = doc;
+  resp.body = my_json.dump();
+  resp.headers["Content-Type"] = "application/json";
+}
+
 using WebHandler = std::function<void(const YaHTTP::Request&, YaHTTP::Response&)>;
 struct WebHandlerContext
 {
@@ -1799,6 +1892,7 @@ void registerBuiltInWebHandlers()
   registerWebHandler("/api/v1/servers/localhost/pool", handlePoolStats);
   registerWebHandler("/api/v1/servers/localhost/statistics", handleStatsOnly);
   registerWebHandler("/api/v1/servers/localhost/rings", handleRings);
+  registerWebHandler("/api/v1/servers/localhost/heavy-hitters", handleHeavyHitters);
 #ifndef DISABLE_WEB_CONFIG
   registerWebHandler("/api/v1/servers/localhost/config", handleConfigDump);
   registerWebHandler("/api/v1/servers/localhost/config/allow-from", handleAllowFrom);
@@ -219,7 +219,11 @@ void XskClientThread(ClientState* clientState)
 #else
     xskInfo->incomingPacketsQueue.consume_all([&](XskPacket& packet) {
 #endif
-      if (XskProcessQuery(*clientState, holders, packet)) {
+      if (clientState->d_xskCacheFastPath && XskProcessCacheHit(*clientState, holders, packet)) {
+        packet.updatePacket();
+        xskInfo->pushToSendQueue(packet);
+      }
+      else if (XskProcessQuery(*clientState, holders, packet)) {
         packet.updatePacket();
         xskInfo->pushToSendQueue(packet);
       }
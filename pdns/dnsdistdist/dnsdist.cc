@@ -64,7 +64,9 @@
 #include "dnsdist-lua-hooks.hh"
 #include "dnsdist-nghttp2.hh"
 #include "dnsdist-proxy-protocol.hh"
+#include "dnsdist-query-collapsing.hh"
 #include "dnsdist-random.hh"
+#include "dnsdist-remote-logging.hh"
 #include "dnsdist-rings.hh"
 #include "dnsdist-secpoll.hh"
 #include "dnsdist-tcp.hh"
@@ -222,6 +224,74 @@ struct DelayedPacket
 static std::unique_ptr<DelayPipe<DelayedPacket>> g_delay{nullptr};
 #endif /* DISABLE_DELAY_PIPE */
 
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+/* responses to UDP clients, gathered by a responder thread from the answers received in a single recvmmsg() call */
+struct UDPResponsesBatch
+{
+  struct Entry
+  {
+    ComboAddress local;
+    ComboAddress remote;
+    iovec iov{};
+    int fd{-1};
+    cmsgbuf_aligned cbuf{};
+  };
+
+  UDPResponsesBatch(size_t size) :
+    d_entries(size), d_msgs(size)
+  {
+  }
+
+  /* the response buffer has to stay valid until flush() has been called */
+  bool queue(int sock, const PacketBuffer& response, const ComboAddress& local, const ComboAddress& remote)
+  {
+    if (d_count >= d_entries.size()) {
+      return false;
+    }
+    auto& entry = d_entries.at(d_count);
+    entry.fd = sock;
+    entry.local = local;
+    entry.remote = remote;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast,cppcoreguidelines-pro-type-reinterpret-cast): API
+    entry.iov.iov_base = const_cast<char*>(reinterpret_cast<const char*>(response.data()));
+    entry.iov.iov_len = response.size();
+    ++d_count;
+    return true;
+  }
+
+  void flush()
+  {
+    /* sort by socket so that responses for the same frontend are sent together */
+    std::stable_sort(d_entries.begin(), d_entries.begin() + static_cast<ssize_t>(d_count), [](const Entry& lhs, const Entry& rhs) { return lhs.fd < rhs.fd; });
+
+    size_t idx = 0;
+    while (idx < d_count) {
+      const int sock = d_entries.at(idx).fd;
+      unsigned int count = 0;
+      for (; idx < d_count && d_entries.at(idx).fd == sock; idx++, count++) {
+        auto& entry = d_entries.at(idx);
+        auto& msg = d_msgs.at(count);
+        msg.msg_len = 0;
+        fillMSGHdr(&msg.msg_hdr, &entry.iov, nullptr, 0, static_cast<char*>(entry.iov.iov_base), entry.iov.iov_len, &entry.remote);
+        if (entry.local.sin4.sin_family != 0) {
+          addCMsgSrcAddr(&msg.msg_hdr, &entry.cbuf, &entry.local, 0);
+        }
+      }
+
+      const size_t first = idx - count;
+      sendMultipleMessages(sock, d_msgs.data(), count, [this, first](unsigned int failed, int error) {
+        vinfolog("Error sending UDP response to %s: %s", d_entries.at(first + failed).remote.toStringWithPort(), stringerror(error));
+      });
+    }
+    d_count = 0;
+  }
+
+  std::vector<Entry> d_entries;
+  std::vector<mmsghdr> d_msgs;
+  size_t d_count{0};
+};
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
 std::string DNSQuestion::getTrailingData() const
 {
   // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
@@ -579,6 +649,8 @@ bool processResponseAfterRules(PacketBuffer& response, const std::vector<dnsdist
     }
 
     dnsResponse.ids.packetCache->insert(cacheKey, zeroScope ? boost::none : dnsResponse.ids.subnet, dnsResponse.ids.cacheFlags, dnsResponse.ids.dnssecOK, dnsResponse.ids.qname, dnsResponse.ids.qtype, dnsResponse.ids.qclass, response, dnsResponse.ids.forwardedOverUDP, dnsResponse.getHeader()->rcode, dnsResponse.ids.tempFailureTTL);
+    /* identical queries waiting for this response can now be answered from the cache */
+    dnsdist::collapsing::releaseWaiting(dnsResponse.ids);
 
     if (!applyRulesToResponse(cacheInsertedRespRuleActions, dnsResponse)) {
       return false;
@@ -688,7 +760,7 @@ void handleResponseSent(const DNSName& qname, const QType& qtype, double udiff,
   doLatencyStats(incomingProtocol, udiff);
 }
 
-static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& respRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, const std::shared_ptr<DownstreamState>& backend, bool isAsync, bool selfGenerated)
+static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& respRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, const std::shared_ptr<DownstreamState>& backend, bool isAsync, bool selfGenerated, [[maybe_unused]] UDPResponsesBatch* batch = nullptr)
 {
   DNSResponse dnsResponse(ids, response, backend);
 
@@ -711,6 +783,8 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
 
   if (!isAsync) {
     if (!processResponse(response, respRuleActions, cacheInsertedRespRuleActions, dnsResponse, ids.cs != nullptr && ids.cs->muted)) {
+      /* the response has been dropped, identical queries waiting for it have to be forwarded on their own */
+      dnsdist::collapsing::releaseWaiting(ids);
       return;
     }
 
@@ -719,6 +793,10 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
     }
   }
 
+  /* a no-op if they have already been released after the response was inserted into the cache,
+     otherwise the response was not cacheable and they have to be forwarded on their own */
+  dnsdist::collapsing::releaseWaiting(ids);
+
   ++dnsdist::metrics::g_stats.responses;
   if (ids.cs != nullptr) {
     ++ids.cs->responses;
@@ -726,7 +804,13 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
 
   bool muted = true;
   if (ids.cs != nullptr && !ids.cs->muted && !ids.isXSK()) {
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    if (batch == nullptr || dnsResponse.ids.delayMsec > 0 || !batch->queue(ids.cs->udpFD, response, ids.hopLocal, ids.hopRemote)) {
+      sendUDPResponse(ids.cs->udpFD, response, dnsResponse.ids.delayMsec, ids.hopLocal, ids.hopRemote);
+    }
+#else
     sendUDPResponse(ids.cs->udpFD, response, dnsResponse.ids.delayMsec, ids.hopLocal, ids.hopRemote);
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
     muted = false;
   }
 
@@ -751,7 +835,7 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
   }
 }
 
-bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& localRespRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, InternalQueryState&& ids)
+bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& localRespRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, InternalQueryState&& ids, UDPResponsesBatch* batch)
 {
 
   const dnsheader_aligned dnsHeader(response.data());
@@ -772,6 +856,7 @@ bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer&
   double udiff = ids.queryRealTime.udiff();
   // do that _before_ the processing, otherwise it's not fair to the backend
   dss->latencyUsec = (127.0 * dss->latencyUsec / 128.0) + udiff / 128.0;
+  dss->latencyPeakEWMA.submit(udiff);
   dss->reportResponse(dnsHeader->rcode);
 
   /* don't call processResponse for DOH */
@@ -783,10 +868,125 @@ bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer&
     return false;
   }
 
-  handleResponseForUDPClient(ids, response, localRespRuleActions, cacheInsertedRespRuleActions, dss, false, false);
+  handleResponseForUDPClient(ids, response, localRespRuleActions, cacheInsertedRespRuleActions, dss, false, false, batch);
   return true;
 }
 
+static void handleResponseFromBackend(std::shared_ptr<DownstreamState>& dss, int sockDesc, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& localRespRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& localCacheInsertedRespRuleActions, UDPResponsesBatch* batch)
+{
+  uint16_t queryId = 0;
+  try {
+    const dnsheader_aligned dnsHeader(response.data());
+    queryId = dnsHeader->id;
+
+    auto ids = dss->getState(queryId);
+    if (!ids) {
+      return;
+    }
+
+    if (!ids->isXSK() && sockDesc != ids->backendFD) {
+      dss->restoreState(queryId, std::move(*ids));
+      return;
+    }
+
+    if (processResponderPacket(dss, response, localRespRuleActions, localCacheInsertedRespRuleActions, std::move(*ids), batch) && ids->isXSK() && ids->cs->xskInfo) {
+#ifdef HAVE_XSK
+      auto& xskInfo = ids->cs->xskInfo;
+      auto xskPacket = xskInfo->getEmptyFrame();
+      if (!xskPacket) {
+        return;
+      }
+      xskPacket->setHeader(ids->xskPacketHeader);
+      if (!xskPacket->setPayload(response)) {
+        /* the response is empty or does not fit into the frame */
+        ++dnsdist::metrics::g_stats.xskResponseDrops;
+        xskInfo->markAsFree(*xskPacket);
+        return;
+      }
+      if (ids->delayMsec > 0) {
+        xskPacket->addDelay(ids->delayMsec);
+      }
+      xskPacket->updatePacket();
+      xskInfo->pushToSendQueue(*xskPacket);
+      xskInfo->notifyXskSocket();
+#endif /* HAVE_XSK */
+    }
+  }
+  catch (const std::exception& e) {
+    vinfolog("Got an error in UDP responder thread while parsing a response from %s, id %d: %s", dss->d_config.remote.toStringWithPort(), queryId, e.what());
+  }
+}
+
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+static void multipleMessagesResponderThread(std::shared_ptr<DownstreamState>& dss, LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>>& localRespRuleActions, LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>>& localCacheInsertedRespRuleActions)
+{
+  const size_t vectSize = g_udpVectorSize;
+  const size_t initialBufferSize = getInitialUDPPacketBufferSize(false);
+  auto responses = std::vector<PacketBuffer>(vectSize);
+  auto iovs = std::vector<iovec>(vectSize);
+  auto msgVec = std::vector<mmsghdr>(vectSize);
+  UDPResponsesBatch responsesBatch(vectSize);
+  std::vector<int> sockets;
+  sockets.reserve(dss->sockets.size());
+
+  for (;;) {
+    try {
+      if (dss->isStopped()) {
+        break;
+      }
+
+      if (!dss->connected) {
+        dss->waitUntilConnected();
+        continue;
+      }
+
+      dss->pickSocketsReadyForReceiving(sockets);
+
+      if (dss->isStopped()) {
+        break;
+      }
+
+      for (const auto& sockDesc : sockets) {
+        for (size_t idx = 0; idx < vectSize; idx++) {
+          /* allocate one more byte so we can detect truncation */
+          // NOLINTNEXTLINE(bugprone-use-after-move): DoH responses are moved out of the buffer, resizing it afterwards is fine
+          responses[idx].resize(initialBufferSize + 1);
+          iovs[idx].iov_base = responses[idx].data();
+          iovs[idx].iov_len = responses[idx].size();
+          msgVec[idx] = mmsghdr{};
+          msgVec[idx].msg_hdr.msg_iov = &iovs[idx];
+          msgVec[idx].msg_hdr.msg_iovlen = 1;
+        }
+
+        /* block until we have at least one response ready, but return
+           as many as possible to save the syscall costs */
+        int msgsGot = recvmmsg(sockDesc, msgVec.data(), vectSize, MSG_WAITFORONE, nullptr);
+        if (msgsGot <= 0) {
+          continue;
+        }
+
+        for (int msgIdx = 0; msgIdx < msgsGot; msgIdx++) {
+          const size_t got = msgVec[msgIdx].msg_len;
+          if (got < sizeof(dnsheader) || got == (initialBufferSize + 1)) {
+            continue;
+          }
+
+          auto& response = responses[msgIdx];
+          response.resize(got);
+          handleResponseFromBackend(dss, sockDesc, response, *localRespRuleActions, *localCacheInsertedRespRuleActions, &responsesBatch);
+        }
+
+        /* the responses are still referencing our buffers, send them before receiving again */
+        responsesBatch.flush();
+      }
+    }
+    catch (const std::exception& e) {
+      vinfolog("Got an error in UDP responder thread while handling responses from %s: %s", dss->d_config.remote.toStringWithPort(), e.what());
+    }
+  }
+}
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
 // listens on a dedicated socket, lobs answers from downstream servers to original requestors
 void responderThread(std::shared_ptr<DownstreamState> dss)
 {
@@ -794,10 +994,15 @@ void responderThread(std::shared_ptr<DownstreamState> dss)
     setThreadName("dnsdist/respond");
     auto localRespRuleActions = dnsdist::rules::getResponseRuleChainHolder(dnsdist::rules::ResponseRuleChain::ResponseRules).getLocal();
     auto localCacheInsertedRespRuleActions = dnsdist::rules::getResponseRuleChainHolder(dnsdist::rules::ResponseRuleChain::CacheInsertedResponseRules).getLocal();
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    if (g_udpVectorSize > 1) {
+      multipleMessagesResponderThread(dss, localRespRuleActions, localCacheInsertedRespRuleActions);
+      return;
+    }
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
     const size_t initialBufferSize = getInitialUDPPacketBufferSize(false);
     /* allocate one more byte so we can detect truncation */
     PacketBuffer response(initialBufferSize + 1);
-    uint16_t queryId = 0;
     std::vector<int> sockets;
     sockets.reserve(dss->sockets.size());
 
@@ -839,41 +1044,11 @@ void responderThread(std::shared_ptr<DownstreamState> dss)
           }
 
           response.resize(static_cast<size_t>(got));
-          const dnsheader_aligned dnsHeader(response.data());
-          queryId = dnsHeader->id;
-
-          auto ids = dss->getState(queryId);
-          if (!ids) {
-            continue;
-          }
-
-          if (!ids->isXSK() && sockDesc != ids->backendFD) {
-            dss->restoreState(queryId, std::move(*ids));
-            continue;
-          }
-
-          if (processResponderPacket(dss, response, *localRespRuleActions, *localCacheInsertedRespRuleActions, std::move(*ids)) && ids->isXSK() && ids->cs->xskInfo) {
-#ifdef HAVE_XSK
-            auto& xskInfo = ids->cs->xskInfo;
-            auto xskPacket = xskInfo->getEmptyFrame();
-            if (!xskPacket) {
-              continue;
-            }
-            xskPacket->setHeader(ids->xskPacketHeader);
-            if (!xskPacket->setPayload(response)) {
-            }
-            if (ids->delayMsec > 0) {
-              xskPacket->addDelay(ids->delayMsec);
-            }
-            xskPacket->updatePacket();
-            xskInfo->pushToSendQueue(*xskPacket);
-            xskInfo->notifyXskSocket();
-#endif /* HAVE_XSK */
-          }
+          handleResponseFromBackend(dss, sockDesc, response, *localRespRuleActions, *localCacheInsertedRespRuleActions, nullptr);
         }
       }
       catch (const std::exception& e) {
-        vinfolog("Got an error in UDP responder thread while parsing a response from %s, id %d: %s", dss->d_config.remote.toStringWithPort(), queryId, e.what());
+        vinfolog("Got an error in UDP responder thread while handling responses from %s: %s", dss->d_config.remote.toStringWithPort(), e.what());
       }
     }
   }
@@ -1033,13 +1208,22 @@ bool processRulesResult(const DNSAction::Action& action, DNSQuestion& dnsQuestio
   return false;
 }
 
-static bool applyRulesChainToQuery(const std::vector<dnsdist::rules::RuleAction>& rules, DNSQuestion& dnsQuestion)
+static bool applyRulesChainToQuery(const dnsdist::rules::RuleActions& rules, DNSQuestion& dnsQuestion)
 {
   DNSAction::Action action = DNSAction::Action::None;
   string ruleresult;
   bool drop = false;
 
-  for (const auto& rule : rules) {
+  if (rules.empty()) {
+    return true;
+  }
+
+  /* only evaluate the rules that might match, in order */
+  const auto& compiled = rules.getCompiled();
+  auto candidates = compiled.getCandidates(dnsQuestion.ids.qname, dnsQuestion.ids.qtype, dnsQuestion.getHeader()->opcode, dnsQuestion.ids.origRemote);
+  size_t position = 0;
+  while (candidates.next(position)) {
+    const auto& rule = rules.at(position);
     if (!rule.d_rule->matches(&dnsQuestion)) {
       continue;
     }
@@ -1049,6 +1233,8 @@ static bool applyRulesChainToQuery(const std::vector<dnsdist::rules::RuleAction>
     if (processRulesResult(action, dnsQuestion, ruleresult, drop)) {
       break;
     }
+    /* the action might have altered the query */
+    candidates = compiled.getCandidates(dnsQuestion.ids.qname, dnsQuestion.ids.qtype, dnsQuestion.getHeader()->opcode, dnsQuestion.ids.origRemote, position + 1);
   }
 
   return !drop;
@@ -1242,6 +1428,23 @@ static bool applyRulesToQuery(LocalHolders& holders, DNSQuestion& dnsQuestion, c
   return applyRulesChainToQuery(*holders.ruleactions, dnsQuestion);
 }
 
+static void handleUDPBackendSendError(const std::shared_ptr<DownstreamState>& backend, int error, bool healthCheck)
+{
+  vinfolog("Error sending request to backend %s: %s", backend->d_config.remote.toStringWithPort(), stringerror(error));
+
+  /* This might sound silly, but on Linux send() might fail with EINVAL
+     if the interface the socket was bound to doesn't exist anymore.
+     We don't want to reconnect the real socket if the healthcheck failed,
+     because it's not using the same socket.
+  */
+  if (!healthCheck) {
+    if (error == EINVAL || error == ENODEV || error == ENETUNREACH || error == EHOSTUNREACH || error == EBADF) {
+      backend->reconnect();
+    }
+    backend->reportTimeoutOrError();
+  }
+}
+
 ssize_t udpClientSendRequestToBackend(const std::shared_ptr<DownstreamState>& backend, const int socketDesc, const PacketBuffer& request, bool healthCheck)
 {
   ssize_t result = 0;
@@ -1261,25 +1464,89 @@ ssize_t udpClientSendRequestToBackend(const std::shared_ptr<DownstreamState>& ba
   }
 
   if (result == -1) {
-    int savederrno = errno;
-    vinfolog("Error sending request to backend %s: %s", backend->d_config.remote.toStringWithPort(), stringerror(savederrno));
-
-    /* This might sound silly, but on Linux send() might fail with EINVAL
-       if the interface the socket was bound to doesn't exist anymore.
-       We don't want to reconnect the real socket if the healthcheck failed,
-       because it's not using the same socket.
-    */
-    if (!healthCheck) {
-      if (savederrno == EINVAL || savederrno == ENODEV || savederrno == ENETUNREACH || savederrno == EHOSTUNREACH || savederrno == EBADF) {
-        backend->reconnect();
-      }
-      backend->reportTimeoutOrError();
-    }
+    handleUDPBackendSendError(backend, errno, healthCheck);
   }
 
   return result;
 }
 
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+/* queries to backends, gathered by a UDP client thread from the queries received in a single recvmmsg() call */
+struct UDPBackendQueriesBatch
+{
+  struct Entry
+  {
+    std::shared_ptr<DownstreamState> backend;
+    iovec iov{};
+    int fd{-1};
+    uint16_t idOffset{0};
+  };
+
+  UDPBackendQueriesBatch(size_t size) :
+    d_entries(size), d_msgs(size)
+  {
+  }
+
+  /* the query buffer has to stay valid until flush() has been called */
+  bool queue(const std::shared_ptr<DownstreamState>& backend, int sock, uint16_t idOffset, const PacketBuffer& query)
+  {
+    if (d_count >= d_entries.size()) {
+      return false;
+    }
+    auto& entry = d_entries.at(d_count);
+    entry.backend = backend;
+    entry.fd = sock;
+    entry.idOffset = idOffset;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast,cppcoreguidelines-pro-type-reinterpret-cast): API
+    entry.iov.iov_base = const_cast<char*>(reinterpret_cast<const char*>(query.data()));
+    entry.iov.iov_len = query.size();
+    ++d_count;
+    return true;
+  }
+
+  void flush()
+  {
+    /* sort by socket so that queries to the same backend socket are sent together */
+    std::stable_sort(d_entries.begin(), d_entries.begin() + static_cast<ssize_t>(d_count), [](const Entry& lhs, const Entry& rhs) { return lhs.fd < rhs.fd; });
+
+    size_t idx = 0;
+    while (idx < d_count) {
+      const int sock = d_entries.at(idx).fd;
+      unsigned int count = 0;
+      for (; idx < d_count && d_entries.at(idx).fd == sock; idx++, count++) {
+        /* the backend sockets are connected, no need for a destination address */
+        auto& msg = d_msgs.at(count);
+        msg = mmsghdr{};
+        msg.msg_hdr.msg_iov = &d_entries.at(idx).iov;
+        msg.msg_hdr.msg_iovlen = 1;
+      }
+
+      const size_t first = idx - count;
+      sendMultipleMessages(sock, d_msgs.data(), count, [this, first](unsigned int failed, int error) {
+        auto& entry = d_entries.at(first + failed);
+        handleUDPBackendSendError(entry.backend, error, false);
+        /* clear up the state. In the very unlikely event it was reused
+           in the meantime, so be it. */
+        if (auto cleared = entry.backend->getState(entry.idOffset)) {
+          dnsdist::collapsing::releaseWaiting(*cleared);
+        }
+        ++dnsdist::metrics::g_stats.downstreamSendErrors;
+        ++entry.backend->sendErrors;
+      });
+    }
+
+    for (size_t entryIdx = 0; entryIdx < d_count; entryIdx++) {
+      d_entries.at(entryIdx).backend.reset();
+    }
+    d_count = 0;
+  }
+
+  std::vector<Entry> d_entries;
+  std::vector<mmsghdr> d_msgs;
+  size_t d_count{0};
+};
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
 static bool isUDPQueryAcceptable(ClientState& clientState, LocalHolders& holders, const struct msghdr* msgh, const ComboAddress& remote, ComboAddress& dest, bool& expectProxyProtocol)
 {
   if ((msgh->msg_flags & MSG_TRUNC) != 0) {
@@ -1604,6 +1871,11 @@ ProcessQueryResult processQueryAfterRules(DNSQuestion& dnsQuestion, LocalHolders
       dnsQuestion.proxyProtocolValues->push_back(ProxyProtocolValue{"", static_cast<uint8_t>(ProxyProtocolValue::Types::PP_TLV_SSL)});
     }
 
+    if (dnsQuestion.ids.packetCache && dnsdist::collapsing::parkIfInFlight(dnsQuestion)) {
+      /* an identical query is already on its way to a backend, this one will be resumed once its response has been cached */
+      return ProcessQueryResult::Asynchronous;
+    }
+
     selectedBackend->incQueriesCount();
     return ProcessQueryResult::PassToBackend;
   }
@@ -1647,9 +1919,9 @@ public:
     return handleResponse(now, std::move(response));
   }
 
-  void notifyIOError([[maybe_unused]] const struct timeval& now, [[maybe_unused]] TCPResponse&& response) override
+  void notifyIOError([[maybe_unused]] const struct timeval& now, TCPResponse&& response) override
   {
-    // nothing to do
+    dnsdist::collapsing::releaseWaiting(response.d_idstate);
   }
 };
 
@@ -1731,7 +2003,7 @@ ProcessQueryResult processQuery(DNSQuestion& dnsQuestion, LocalHolders& holders,
   return ProcessQueryResult::Drop;
 }
 
-bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstream, uint16_t queryID, DNSQuestion& dnsQuestion, PacketBuffer& query, bool actuallySend)
+bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstream, uint16_t queryID, DNSQuestion& dnsQuestion, PacketBuffer& query, bool actuallySend, [[maybe_unused]] UDPBackendQueriesBatch* batch)
 {
   bool doh = dnsQuestion.ids.du != nullptr;
 
@@ -1770,6 +2042,13 @@ bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstrea
       return true;
     }
 
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    /* the query will be sent along with the other ones from the same batch, errors are handled then */
+    if (batch != nullptr && downstream->d_config.sourceItf == 0 && batch->queue(downstream, descriptor, idOffset, query)) {
+      return true;
+    }
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
     /* you can't touch ids or du after this line, unless the call returned a non-negative value,
        because it might already have been freed */
     ssize_t ret = udpClientSendRequestToBackend(downstream, descriptor, query);
@@ -1783,6 +2062,7 @@ bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstrea
          in the meantime, so be it. */
       auto cleared = downstream->getState(idOffset);
       if (cleared) {
+        dnsdist::collapsing::releaseWaiting(*cleared);
         dnsQuestion.ids.du = std::move(cleared->du);
       }
       ++dnsdist::metrics::g_stats.downstreamSendErrors;
@@ -1797,7 +2077,7 @@ bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstrea
   return true;
 }
 
-static void processUDPQuery(ClientState& clientState, LocalHolders& holders, const struct msghdr* msgh, const ComboAddress& remote, ComboAddress& dest, PacketBuffer& query, std::vector<mmsghdr>* responsesVect, unsigned int* queuedResponses, struct iovec* respIOV, cmsgbuf_aligned* respCBuf)
+static void processUDPQuery(ClientState& clientState, LocalHolders& holders, const struct msghdr* msgh, const ComboAddress& remote, ComboAddress& dest, PacketBuffer& query, std::vector<mmsghdr>* responsesVect, unsigned int* queuedResponses, struct iovec* respIOV, cmsgbuf_aligned* respCBuf, UDPBackendQueriesBatch* queriesBatch = nullptr)
 {
   assert(responsesVect == nullptr || (queuedResponses != nullptr && respIOV != nullptr && respCBuf != nullptr));
   uint16_t queryId = 0;
@@ -1861,8 +2141,7 @@ static void processUDPQuery(ClientState& clientState, LocalHolders& holders, con
       }
     }
 
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    ids.qname = DNSName(reinterpret_cast<const char*>(query.data()), query.size(), sizeof(dnsheader), false, &ids.qtype, &ids.qclass);
+    ids.parseQuestion(query);
     if (ids.dnsCryptQuery) {
       ids.protocol = dnsdist::Protocol::DNSCryptUDP;
     }
@@ -1921,7 +2200,7 @@ static void processUDPQuery(ClientState& clientState, LocalHolders& holders, con
       return;
     }
 
-    assignOutgoingUDPQueryToBackend(backend, dnsHeader->id, dnsQuestion, query);
+    assignOutgoingUDPQueryToBackend(backend, dnsHeader->id, dnsQuestion, query, true, queriesBatch);
   }
   catch (const std::exception& e) {
     vinfolog("Got an error in UDP question thread while parsing a query from %s, id %d: %s", ids.origRemote.toStringWithPort(), queryId, e.what());
@@ -1985,8 +2264,7 @@ bool XskProcessQuery(ClientState& clientState, LocalHolders& holders, XskPacket&
       }
     }
 
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    ids.qname = DNSName(reinterpret_cast<const char*>(query.data()), query.size(), sizeof(dnsheader), false, &ids.qtype, &ids.qclass);
+    ids.parseQuestion(query);
     if (ids.origDest.sin4.sin_family == 0) {
       ids.origDest = clientState.local;
     }
@@ -2054,6 +2332,136 @@ bool XskProcessQuery(ClientState& clientState, LocalHolders& holders, XskPacket&
   return false;
 }
 
+/* returns the wire length of the qname starting right after the DNS header, or 0 if the name is compressed, invalid or truncated */
+static size_t getUncompressedQNameLength(const uint8_t* packet, size_t packetSize)
+{
+  size_t pos = sizeof(dnsheader);
+  while (pos < packetSize) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const uint8_t labelLength = packet[pos];
+    if (labelLength == 0) {
+      const size_t length = pos + 1 - sizeof(dnsheader);
+      return length <= DNSName::s_maxDNSNameLength ? length : 0;
+    }
+    if ((labelLength & 0xc0) != 0) {
+      return 0;
+    }
+    pos += labelLength + 1;
+  }
+  return 0;
+}
+
+bool XskProcessCacheHit(ClientState& clientState, LocalHolders& holders, XskPacket& packet)
+{
+  /* anything that might need to look at, or alter, the query before the cache lookup
+     sends us to the regular path */
+  if (clientState.dnscryptCtx || clientState.muted || g_qcount.enabled || !holders.ruleactions->empty() || !holders.cacheHitRespRuleactions->empty()) {
+    return false;
+  }
+
+  const auto& remote = packet.getFromAddr();
+  if (!holders.acl->match(remote) || expectProxyProtocolFrom(remote)) {
+    return false;
+  }
+
+  uint8_t* payload = packet.getMutablePayloadData();
+  const size_t querySize = packet.getDataLen();
+  if (querySize < sizeof(dnsheader)) {
+    return false;
+  }
+
+  const dnsheader_aligned queryHeader(payload);
+  if (queryHeader->qr || ntohs(queryHeader->qdcount) != 1) {
+    return false;
+  }
+
+  const size_t qnameWireLength = getUncompressedQNameLength(payload, querySize);
+  if (qnameWireLength == 0 || querySize < (sizeof(dnsheader) + qnameWireLength + DNS_TYPE_SIZE + DNS_CLASS_SIZE)) {
+    return false;
+  }
+
+  timespec now{};
+  gettime(&now);
+
+#ifndef DISABLE_DYNBLOCKS
+  if (!holders.dynSMTBlock->children.empty() || holders.dynSMTBlock->endNode) {
+    return false;
+  }
+  if (const auto* got = holders.dynNMGBlock->lookup(AddressAndPortRange(remote, remote.isIPv4() ? 32 : 128, 16)); got != nullptr && now < got->second.until) {
+    return false;
+  }
+#endif /* DISABLE_DYNBLOCKS */
+
+  static const std::string defaultPool;
+  const auto poolIt = holders.pools->find(defaultPool);
+  if (poolIt == holders.pools->end()) {
+    return false;
+  }
+  const auto& pool = poolIt->second;
+  const auto& cache = pool->packetCache;
+  if (!cache || !cache->isLockFreeEngineEnabled() || cache->isECSParsingEnabled() || pool->getECS()) {
+    return false;
+  }
+
+  bool dnssecOK = false;
+  if (queryHeader->arcount != 0) {
+    /* a query without additional records cannot contain an ECS option, and a backend adding one
+       would never get a hit for the unmodified query, so we only need to check the backends here */
+    for (const auto& server : *pool->getServers()) {
+      if (server.second->d_config.useECS) {
+        return false;
+      }
+    }
+    uint16_t udpPayloadSize = 0;
+    uint16_t zValue = 0;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (getEDNSUDPPayloadSizeAndZ(reinterpret_cast<const char*>(payload), querySize, &udpPayloadSize, &zValue)) {
+      dnssecOK = (zValue & EDNS_HEADER_FLAG_DO) != 0;
+    }
+  }
+
+  uint16_t qtype{0};
+  uint16_t qclass{0};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(&qtype, payload + sizeof(dnsheader) + qnameWireLength, sizeof(qtype));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  memcpy(&qclass, payload + sizeof(dnsheader) + qnameWireLength + sizeof(qtype), sizeof(qclass));
+  qtype = ntohs(qtype);
+  qclass = ntohs(qclass);
+
+  /* the response is about to overwrite the query */
+  const dnsheader queryHeaderCopy = *queryHeader;
+  const uint16_t origFlags = *getFlagsFromDNSHeader(&queryHeaderCopy);
+  const size_t responseSize = cache->getInPlace(payload, querySize, packet.getPayloadCapacity(), qnameWireLength, qtype, qclass, dnssecOK, true);
+  if (responseSize == 0) {
+    return false;
+  }
+
+  dnsheader responseHeader{};
+  memcpy(&responseHeader, payload, sizeof(responseHeader));
+  restoreFlags(&responseHeader, origFlags);
+  memcpy(payload, &responseHeader, sizeof(responseHeader));
+  packet.setPayloadSize(responseSize);
+
+  ++clientState.queries;
+  ++dnsdist::metrics::g_stats.queries;
+  if (queryHeaderCopy.rd) {
+    ++dnsdist::metrics::g_stats.rdQueries;
+  }
+  ++dnsdist::metrics::g_stats.cacheHits;
+  ++dnsdist::metrics::g_stats.responses;
+  ++clientState.responses;
+
+  /* the qname is still in place right after the header, even if the response is only a header */
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const DNSName qname(reinterpret_cast<const char*>(payload), sizeof(dnsheader) + qnameWireLength, sizeof(dnsheader), false);
+  if (g_rings.shouldRecordQueries()) {
+    g_rings.insertQuery(now, remote, qname, qtype, querySize, queryHeaderCopy, dnsdist::Protocol::DoUDP);
+  }
+  handleResponseSent(qname, QType(qtype), 0., remote, ComboAddress(), responseSize, responseHeader, dnsdist::Protocol::DoUDP, dnsdist::Protocol::DoUDP, false);
+  return true;
+}
+
 }
 #endif /* HAVE_XSK */
 
@@ -2079,6 +2487,8 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState, LocalHolde
   auto recvData = std::vector<MMReceiver>(vectSize);
   auto msgVec = std::vector<mmsghdr>(vectSize);
   auto outMsgVec = std::vector<mmsghdr>(vectSize);
+  /* queries that need to be forwarded to a backend are sent in batch as well */
+  UDPBackendQueriesBatch queriesBatch(vectSize);
 
   /* the actual buffer is larger because:
      - we may have to add EDNS and/or ECS
@@ -2131,9 +2541,11 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState, LocalHolde
       }
 
       recvData[msgIdx].packet.resize(got);
-      processUDPQuery(*clientState, holders, msgh, remote, recvData[msgIdx].dest, recvData[msgIdx].packet, &outMsgVec, &msgsToSend, &recvData[msgIdx].iov, &recvData[msgIdx].cbuf);
+      processUDPQuery(*clientState, holders, msgh, remote, recvData[msgIdx].dest, recvData[msgIdx].packet, &outMsgVec, &msgsToSend, &recvData[msgIdx].iov, &recvData[msgIdx].cbuf, &queriesBatch);
     }
 
+    queriesBatch.flush();
+
     /* immediate (not delayed or sent to a backend) responses (mostly from a rule, dynamic block
        or the cache) can be sent in batch too */
 
@@ -2301,6 +2713,11 @@ static void maintThread()
       }
     }
 
+#ifndef DISABLE_PROTOBUF
+    dnsdist::remotelogging::Aggregator::flushExpired(time(nullptr));
+#endif /* DISABLE_PROTOBUF */
+    dnsdist::collapsing::purgeExpired();
+
     counter++;
     if (counter >= g_cacheCleaningDelay) {
       /* keep track, for each cache, of whether we should keep
@@ -2376,49 +2793,7 @@ static void healthChecksThread()
 {
   setThreadName("dnsdist/healthC");
 
-  constexpr int intervalUsec = 1000 * 1000;
-  struct timeval lastRound
-  {
-    .tv_sec = 0,
-    .tv_usec = 0
-  };
-  auto states = g_dstates.getLocal(); // this points to the actual shared_ptrs!
-
-  for (;;) {
-    timeval now{};
-    gettimeofday(&now, nullptr);
-    auto elapsedTimeUsec = uSec(now - lastRound);
-    if (elapsedTimeUsec < intervalUsec) {
-      usleep(intervalUsec - elapsedTimeUsec);
-      gettimeofday(&lastRound, nullptr);
-    }
-    else {
-      lastRound = now;
-    }
-
-    std::unique_ptr<FDMultiplexer> mplexer{nullptr};
-    for (const auto& dss : *states) {
-      dss->updateStatisticsInfo();
-
-      dss->handleUDPTimeouts();
-
-      if (!dss->healthCheckRequired()) {
-        continue;
-      }
-
-      if (!mplexer) {
-        mplexer = std::unique_ptr<FDMultiplexer>(FDMultiplexer::getMultiplexerSilent(states->size()));
-      }
-
-      if (!queueHealthCheck(mplexer, dss)) {
-        dss->submitHealthCheckResult(false, false);
-      }
-    }
-
-    if (mplexer) {
-      handleQueuedHealthChecks(*mplexer);
-    }
-  }
+  runHealthChecksScheduler();
 }
 
 static void bindAny(int addressFamily, int sock)
@@ -2700,6 +3075,22 @@ static void setupLocalSocket(ClientState& clientState, const ComboAddress& addr,
   }
 }
 
+#if defined(HAVE_DNS_OVER_QUIC) || defined(HAVE_DNS_OVER_HTTP3)
+/* QUIC frontends can be served by several worker threads, each one having its own
+   socket bound to the same address via SO_REUSEPORT. The first one is the socket of
+   the ClientState itself. */
+static void setUpQUICWorkerSockets(ClientState& clientState, size_t workers, std::vector<int>& sockets)
+{
+  sockets.clear();
+  sockets.push_back(clientState.udpFD);
+  for (size_t worker = 1; worker < workers; worker++) {
+    int socket = -1;
+    setupLocalSocket(clientState, clientState.local, socket, false, false);
+    sockets.push_back(socket);
+  }
+}
+#endif /* HAVE_DNS_OVER_QUIC || HAVE_DNS_OVER_HTTP3 */
+
 static void setUpLocalBind(std::unique_ptr<ClientState>& cstate)
 {
   /* skip some warnings if there is an identical UDP context */
@@ -2724,9 +3115,15 @@ static void setUpLocalBind(std::unique_ptr<ClientState>& cstate)
     cstate->dohFrontend->setup();
   }
   if (cstate->doqFrontend != nullptr) {
+#ifdef HAVE_DNS_OVER_QUIC
+    setUpQUICWorkerSockets(*cstate, cstate->doqFrontend->d_workers, cstate->doqFrontend->d_workerSockets);
+#endif /* HAVE_DNS_OVER_QUIC */
     cstate->doqFrontend->setup();
   }
   if (cstate->doh3Frontend != nullptr) {
+#ifdef HAVE_DNS_OVER_HTTP3
+    setUpQUICWorkerSockets(*cstate, cstate->doh3Frontend->d_workers, cstate->doh3Frontend->d_workerSockets);
+#endif /* HAVE_DNS_OVER_HTTP3 */
     cstate->doh3Frontend->setup();
   }
 
@@ -3205,21 +3602,25 @@ static void startFrontends()
     }
     if (clientState->doqFrontend != nullptr) {
 #ifdef HAVE_DNS_OVER_QUIC
-      std::thread doqThreadHandle(doqThread, clientState.get());
-      if (!clientState->cpus.empty()) {
-        mapThreadToCPUList(doqThreadHandle.native_handle(), clientState->cpus);
+      for (size_t worker = 0; worker < clientState->doqFrontend->d_workers; worker++) {
+        std::thread doqThreadHandle(doqThread, clientState.get(), worker);
+        if (!clientState->cpus.empty()) {
+          mapThreadToCPUList(doqThreadHandle.native_handle(), clientState->cpus);
+        }
+        doqThreadHandle.detach();
       }
-      doqThreadHandle.detach();
 #endif /* HAVE_DNS_OVER_QUIC */
       continue;
     }
     if (clientState->doh3Frontend != nullptr) {
 #ifdef HAVE_DNS_OVER_HTTP3
-      std::thread doh3ThreadHandle(doh3Thread, clientState.get());
-      if (!clientState->cpus.empty()) {
-        mapThreadToCPUList(doh3ThreadHandle.native_handle(), clientState->cpus);
+      for (size_t worker = 0; worker < clientState->doh3Frontend->d_workers; worker++) {
+        std::thread doh3ThreadHandle(doh3Thread, clientState.get(), worker);
+        if (!clientState->cpus.empty()) {
+          mapThreadToCPUList(doh3ThreadHandle.native_handle(), clientState->cpus);
+        }
+        doh3ThreadHandle.detach();
       }
-      doh3ThreadHandle.detach();
 #endif /* HAVE_DNS_OVER_HTTP3 */
       continue;
     }
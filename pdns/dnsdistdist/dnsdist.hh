@@ -41,7 +41,9 @@
 #include "dnsdist-dynbpf.hh"
 #include "dnsdist-idstate.hh"
 #include "dnsdist-lbpolicies.hh"
+#include "dnsdist-peak-ewma.hh"
 #include "dnsdist-protocols.hh"
+#include "dnsdist-rule-chains.hh"
 #include "dnsname.hh"
 #include "dnsdist-doh-common.hh"
 #include "doq.hh"
@@ -88,6 +90,8 @@ struct DNSQuestion
   }
   PacketBuffer& getMutableData()
   {
+    /* the caller might change the layout of the packet */
+    ids.d_queryScan.valid = false;
     return data;
   }
 
@@ -202,7 +206,11 @@ struct DownstreamState;
 struct DNSResponse : DNSQuestion
 {
   DNSResponse(InternalQueryState& ids_, PacketBuffer& data_, const std::shared_ptr<DownstreamState>& downstream) :
-    DNSQuestion(ids_, data_), d_downstream(downstream) {}
+    DNSQuestion(ids_, data_), d_downstream(downstream)
+  {
+    /* the scan was done on the query, not on this response */
+    ids.d_queryScan.valid = false;
+  }
   DNSResponse(const DNSResponse&) = delete;
   DNSResponse& operator=(const DNSResponse&) = delete;
   DNSResponse(DNSResponse&&) = default;
@@ -575,6 +583,7 @@ struct ClientState
   bool tcp;
   bool reuseport;
   bool d_enableProxyProtocol{true}; // the global proxy protocol ACL still applies
+  bool d_xskCacheFastPath{false}; // serve packet cache hits directly from the AF_XDP frame
   bool ready{false};
 
   int getSocket() const
@@ -806,6 +815,7 @@ struct DownstreamState : public std::enable_shared_from_this<DownstreamState>
     bool ipBindAddrNoPort{true};
     bool reconnectOnUp{false};
     bool d_tcpCheck{false};
+    bool d_healthCheckKeepAlive{false};
     bool d_tcpOnly{false};
     bool d_addXForwardedHeaders{false}; // for DoH backends
     bool d_lazyHealthCheckUseExponentialBackOff{false};
@@ -835,6 +845,8 @@ struct DownstreamState : public std::enable_shared_from_this<DownstreamState>
   stat_t sendErrors{0};
   stat_t outstanding{0};
   stat_t reuseds{0};
+  /* number of times the ID state picked for a new query was already in use */
+  stat_t idStateCollisions{0};
   stat_t queries{0};
   stat_t responses{0};
   stat_t nonCompliantResponses{0};
@@ -866,11 +878,13 @@ struct DownstreamState : public std::enable_shared_from_this<DownstreamState>
   pdns::stat_t_trait<double> dropRate{0.0};
 
   SharedLockGuarded<std::vector<unsigned int>> hashes;
+  /* incremented every time the hashes of any backend are (re)computed, so that
+     the lookup tables of the chashed policy know when to rebuild */
+  static std::atomic<uint64_t> s_hashesGeneration;
   LockGuarded<std::unique_ptr<FDMultiplexer>> mplexer{nullptr};
 
 private:
-  LockGuarded<std::map<uint16_t, IDState>> d_idStatesMap;
-  vector<IDState> idStates;
+  IDStateTable d_idStates;
 
   struct LazyHealthCheckStats
   {
@@ -885,6 +899,21 @@ private:
     LazyStatus d_status{LazyStatus::Healthy};
   };
   LockGuarded<LazyHealthCheckStats> d_lazyHealthCheckStats;
+  /* outcomes of the regular queries, counted by each thread handling responses into its
+     own slot, and moved to the sample by the health-check thread. Only the owning thread
+     writes the counters, the health-check thread remembers what it already aggregated */
+  struct LazyHealthCheckCounters
+  {
+    std::atomic<uint64_t> d_successes{0};
+    std::atomic<uint64_t> d_failures{0};
+    /* only accessed while holding the d_lazyHealthCheckStats lock */
+    uint64_t d_aggregatedSuccesses{0};
+    uint64_t d_aggregatedFailures{0};
+  };
+  LazyHealthCheckCounters& getLazyHealthCheckCounters();
+  LockGuarded<std::vector<std::shared_ptr<LazyHealthCheckCounters>>> d_lazyHealthCheckCounters;
+  static inline std::atomic<uint64_t> s_nextLazyHealthCheckCountersID{0};
+  const uint64_t d_lazyHealthCheckCountersID{s_nextLazyHealthCheckCountersID++};
 
 public:
   std::shared_ptr<TLSCtx> d_tlsCtx{nullptr};
@@ -899,8 +928,12 @@ public:
   size_t socketsOffset{0};
   double latencyUsec{0.0};
   double latencyUsecTCP{0.0};
+  /* used by the p2cPeakEWMA policy, fed by both UDP and TCP responses */
+  dnsdist::PeakEWMA latencyPeakEWMA;
   unsigned int d_nextCheck{0};
   uint16_t currentCheckFailures{0};
+  /* set while a health-check query to this backend has neither been answered nor timed out */
+  std::atomic<bool> d_healthCheckPending{false};
   std::atomic<bool> hashesComputed{false};
   std::atomic<bool> connected{false};
   std::atomic<bool> upStatus{false};
@@ -908,6 +941,8 @@ public:
 private:
   void handleUDPTimeout(IDState& ids);
   void updateNextLazyHealthCheck(LazyHealthCheckStats& stats, bool checkScheduled, std::optional<time_t> currentTime = std::nullopt);
+  void aggregateLazyHealthCheckResults(LazyHealthCheckStats& stats);
+  void discardLazyHealthCheckResults(LazyHealthCheckStats& stats);
   void connectUDPSockets();
 #ifdef HAVE_XSK
   void addXSKDestination(int fd);
@@ -956,6 +991,7 @@ public:
     if (!newStatus) {
       latencyUsec = 0.0;
       latencyUsecTCP = 0.0;
+      latencyPeakEWMA.reset();
     }
   }
   void setDown()
@@ -963,6 +999,7 @@ public:
     d_config.availability = Availability::Down;
     latencyUsec = 0.0;
     latencyUsecTCP = 0.0;
+    latencyPeakEWMA.reset();
   }
   void setAuto()
   {
@@ -1028,6 +1065,7 @@ public:
   void updateTCPLatency(double udiff)
   {
     latencyUsecTCP = (127.0 * latencyUsecTCP / 128.0) + udiff / 128.0;
+    latencyPeakEWMA.submit(udiff);
   }
 
   void incQueriesCount()
@@ -1064,6 +1102,16 @@ public:
   uint16_t saveState(InternalQueryState&&);
   void restoreState(uint16_t id, InternalQueryState&&);
   std::optional<InternalQueryState> getState(uint16_t id);
+  size_t getIDStatesCapacity() const
+  {
+    return d_idStates.size();
+  }
+  /* randomized IDs span the whole 16-bit space and are mapped onto the table,
+     otherwise the ID is the index of the state */
+  size_t getIDStateIndex(uint16_t queryID) const
+  {
+    return s_randomizeIDs ? queryID % d_idStates.size() : queryID;
+  }
 
 #ifdef HAVE_XSK
   void registerXsk(std::vector<std::shared_ptr<XskSocket>>& xsks);
@@ -1110,6 +1158,13 @@ public:
   }
   virtual bool matches(const DNSQuestion* dq) const = 0;
   virtual string toString() const = 0;
+  /* A cheap condition that has to hold for this rule to match, if any. The rule is not
+     evaluated at all when the condition does not hold, so it must not have any side effect,
+     like updating a counter, in that case. */
+  virtual std::optional<dnsdist::rules::RuleSelector> getSelector() const
+  {
+    return std::nullopt;
+  }
   mutable stat_t d_matches{0};
 };
 
@@ -1229,8 +1284,6 @@ enum class ProcessQueryResult : uint8_t
   Asynchronous
 };
 
-#include "dnsdist-rule-chains.hh"
-
 struct LocalHolders
 {
   LocalHolders() :
@@ -1240,8 +1293,8 @@ struct LocalHolders
 
   LocalStateHolder<NetmaskGroup> acl;
   LocalStateHolder<ServerPolicy> policy;
-  LocalStateHolder<vector<dnsdist::rules::RuleAction>> ruleactions;
-  LocalStateHolder<vector<dnsdist::rules::RuleAction>> cacheMissRuleActions;
+  LocalStateHolder<dnsdist::rules::RuleActions> ruleactions;
+  LocalStateHolder<dnsdist::rules::RuleActions> cacheMissRuleActions;
   LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>> cacheHitRespRuleactions;
   LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>> cacheInsertedRespRuleActions;
   LocalStateHolder<vector<dnsdist::rules::ResponseRuleAction>> selfAnsweredRespRuleactions;
@@ -1256,10 +1309,13 @@ ProcessQueryResult processQueryAfterRules(DNSQuestion& dnsQuestion, LocalHolders
 bool processResponse(PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& respRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, DNSResponse& dnsResponse, bool muted);
 bool processRulesResult(const DNSAction::Action& action, DNSQuestion& dnsQuestion, std::string& ruleresult, bool& drop);
 bool processResponseAfterRules(PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, DNSResponse& dnsResponse, bool muted);
-bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& localRespRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, InternalQueryState&& ids);
+struct UDPResponsesBatch;
+struct UDPBackendQueriesBatch;
+
+bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, const std::vector<dnsdist::rules::ResponseRuleAction>& localRespRuleActions, const std::vector<dnsdist::rules::ResponseRuleAction>& cacheInsertedRespRuleActions, InternalQueryState&& ids, UDPResponsesBatch* batch = nullptr);
 bool applyRulesToResponse(const std::vector<dnsdist::rules::ResponseRuleAction>& respRuleActions, DNSResponse& dnsResponse);
 
-bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstream, uint16_t queryID, DNSQuestion& dnsQuestion, PacketBuffer& query, bool actuallySend = true);
+bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstream, uint16_t queryID, DNSQuestion& dnsQuestion, PacketBuffer& query, bool actuallySend = true, UDPBackendQueriesBatch* batch = nullptr);
 
 ssize_t udpClientSendRequestToBackend(const std::shared_ptr<DownstreamState>& backend, const int socketDesc, const PacketBuffer& request, bool healthCheck = false);
 bool sendUDPResponse(int origFD, const PacketBuffer& response, const int delayMsec, const ComboAddress& origDest, const ComboAddress& origRemote);
@@ -0,0 +1 @@
+../dnsqueryscan.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../dnsqueryscan.hh
\ No newline at end of file
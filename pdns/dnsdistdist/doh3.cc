@@ -79,14 +79,19 @@ static void sendBackDOH3Unit(DOH3UnitUniquePtr&& unit, const char* description);
 
 struct DOH3ServerConfig
 {
-  DOH3ServerConfig(QuicheConfig&& config_, QuicheHTTP3Config&& http3config_, uint32_t internalPipeBufferSize) :
-    config(std::move(config_)), http3config(std::move(http3config_))
+  DOH3ServerConfig(QuicheConfig&& config_, QuicheHTTP3Config&& http3config_, uint32_t internalPipeBufferSize, uint8_t workerIndex) :
+    config(std::move(config_)), http3config(std::move(http3config_)), d_workerIndex(workerIndex)
   {
     {
       auto [sender, receiver] = pdns::channel::createObjectQueue<DOH3Unit>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, internalPipeBufferSize);
       d_responseSender = std::move(sender);
       d_responseReceiver = std::move(receiver);
     }
+    {
+      auto [sender, receiver] = pdns::channel::createObjectQueue<ForwardedDatagram>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, internalPipeBufferSize);
+      d_datagramSender = std::move(sender);
+      d_datagramReceiver = std::move(receiver);
+    }
   }
   DOH3ServerConfig(const DOH3ServerConfig&) = delete;
   DOH3ServerConfig(DOH3ServerConfig&&) = default;
@@ -104,6 +109,10 @@ struct DOH3ServerConfig
   std::shared_ptr<DOH3Frontend> df{nullptr};
   pdns::channel::Sender<DOH3Unit> d_responseSender;
   pdns::channel::Receiver<DOH3Unit> d_responseReceiver;
+  /* datagrams received by other workers for connections owned by this one */
+  pdns::channel::Sender<ForwardedDatagram> d_datagramSender;
+  pdns::channel::Receiver<ForwardedDatagram> d_datagramReceiver;
+  uint8_t d_workerIndex{0};
 };
 
 /* these might seem useless, but they are needed because
@@ -380,21 +389,31 @@ static void handleResponse(DOH3Frontend& frontend, H3Connection& conn, const uin
 
 void DOH3Frontend::setup()
 {
-  auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
   d_quicheParams.d_alpn = std::string(DOH3_ALPN.begin(), DOH3_ALPN.end());
-  configureQuiche(config, d_quicheParams, true);
+  d_server_configs.clear();
+  for (size_t worker = 0; worker < d_workers; worker++) {
+    auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
+    configureQuiche(config, d_quicheParams, true);
+
+    auto http3config = QuicheHTTP3Config(quiche_h3_config_new(), quiche_h3_config_free);
 
-  auto http3config = QuicheHTTP3Config(quiche_h3_config_new(), quiche_h3_config_free);
+    d_server_configs.push_back(std::make_unique<DOH3ServerConfig>(std::move(config), std::move(http3config), d_internalPipeBufferSize, static_cast<uint8_t>(worker)));
+  }
 
-  d_server_config = std::make_unique<DOH3ServerConfig>(std::move(config), std::move(http3config), d_internalPipeBufferSize);
+  if (d_workerSockets.size() > 1 && !attachWorkerSteeringProgram(d_workerSockets.at(0))) {
+    warnlog("Unable to attach the connection ID steering program to the DoH3 sockets of %s, datagrams will be passed between worker threads instead", d_local.toStringWithPort());
+  }
 }
 
 void DOH3Frontend::reloadCertificates()
 {
-  auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
   d_quicheParams.d_alpn = std::string(DOH3_ALPN.begin(), DOH3_ALPN.end());
-  configureQuiche(config, d_quicheParams, true);
-  std::atomic_store_explicit(&d_server_config->config, std::move(config), std::memory_order_release);
+  /* the workers do not share their quiche configuration */
+  for (auto& serverConfig : d_server_configs) {
+    auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
+    configureQuiche(config, d_quicheParams, true);
+    std::atomic_store_explicit(&serverConfig->config, std::move(config), std::memory_order_release);
+  }
 }
 
 static std::optional<std::reference_wrapper<H3Connection>> getConnection(DOH3ServerConfig::ConnectionsMap& connMap, const PacketBuffer& connID)
@@ -476,7 +495,7 @@ static void processDOH3Query(DOH3UnitUniquePtr&& doh3Unit)
 {
   const auto handleImmediateResponse = [](DOH3UnitUniquePtr&& unit, [[maybe_unused]] const char* reason) {
     DEBUGLOG("handleImmediateResponse() reason=" << reason);
-    auto conn = getConnection(unit->dsc->df->d_server_config->d_connections, unit->serverConnID);
+    auto conn = getConnection(unit->dsc->d_connections, unit->serverConnID);
     handleResponse(*unit->dsc->df, *conn, unit->streamID, unit->status_code, unit->response);
     unit->ids.doh3u.reset();
   };
@@ -552,14 +571,11 @@ static void processDOH3Query(DOH3UnitUniquePtr&& doh3Unit)
     }
 
     auto downstream = unit->downstream;
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    unit->ids.qname = DNSName(reinterpret_cast<const char*>(unit->query.data()), static_cast<int>(unit->query.size()), sizeof(dnsheader), false, &unit->ids.qtype, &unit->ids.qclass);
+    unit->ids.parseQuestion(unit->query);
     DNSQuestion dnsQuestion(unit->ids, unit->query);
-    dnsdist::PacketMangling::editDNSHeaderFromPacket(dnsQuestion.getMutableData(), [&ids](dnsheader& header) {
-      const uint16_t* flags = getFlagsFromDNSHeader(&header);
-      ids.origFlags = *flags;
-      return true;
-    });
+    /* read-only access, so that the scan of the query done by parseQuestion() stays valid */
+    const uint16_t* flags = getFlagsFromDNSHeader(dnsQuestion.getHeader().get());
+    ids.origFlags = *flags;
     unit->ids.cs = &clientState;
 
     auto result = processQuery(dnsQuestion, holders, downstream);
@@ -662,7 +678,7 @@ static void flushResponses(pdns::channel::Receiver<DOH3Unit>& receiver)
       }
 
       auto unit = std::move(*tmp);
-      auto conn = getConnection(unit->dsc->df->d_server_config->d_connections, unit->serverConnID);
+      auto conn = getConnection(unit->dsc->d_connections, unit->serverConnID);
       if (conn) {
         handleResponse(*unit->dsc->df, *conn, unit->streamID, unit->status_code, unit->response);
       }
@@ -691,7 +707,7 @@ static void flushStalledResponses(H3Connection& conn)
   }
 }
 
-static void processH3HeaderEvent(ClientState& clientState, DOH3Frontend& frontend, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, const uint64_t streamID, quiche_h3_event* event)
+static void processH3HeaderEvent(ClientState& clientState, DOH3Frontend& frontend, DOH3ServerConfig& dsc, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, const uint64_t streamID, quiche_h3_event* event)
 {
   auto handleImmediateError = [&clientState, &frontend, &conn, streamID](const char* msg) {
     DEBUGLOG(msg);
@@ -744,7 +760,7 @@ static void processH3HeaderEvent(ClientState& clientState, DOH3Frontend& fronten
       return;
     }
     DEBUGLOG("Dispatching GET query");
-    doh3_dispatch_query(*(frontend.d_server_config), std::move(*payload), conn.d_localAddr, client, serverConnID, streamID);
+    doh3_dispatch_query(dsc, std::move(*payload), conn.d_localAddr, client, serverConnID, streamID);
     conn.d_streamBuffers.erase(streamID);
     conn.d_headersBuffers.erase(streamID);
     return;
@@ -760,7 +776,7 @@ static void processH3HeaderEvent(ClientState& clientState, DOH3Frontend& fronten
   handleImmediateError("Unsupported HTTP method");
 }
 
-static void processH3DataEvent(ClientState& clientState, DOH3Frontend& frontend, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, const uint64_t streamID, quiche_h3_event* event, PacketBuffer& buffer)
+static void processH3DataEvent(ClientState& clientState, DOH3Frontend& frontend, DOH3ServerConfig& dsc, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, const uint64_t streamID, quiche_h3_event* event, PacketBuffer& buffer)
 {
   auto handleImmediateError = [&clientState, &frontend, &conn, streamID](const char* msg) {
     DEBUGLOG(msg);
@@ -809,12 +825,12 @@ static void processH3DataEvent(ClientState& clientState, DOH3Frontend& frontend,
   }
 
   DEBUGLOG("Dispatching POST query");
-  doh3_dispatch_query(*(frontend.d_server_config), std::move(streamBuffer), conn.d_localAddr, client, serverConnID, streamID);
+  doh3_dispatch_query(dsc, std::move(streamBuffer), conn.d_localAddr, client, serverConnID, streamID);
   conn.d_headersBuffers.erase(streamID);
   conn.d_streamBuffers.erase(streamID);
 }
 
-static void processH3Events(ClientState& clientState, DOH3Frontend& frontend, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, PacketBuffer& buffer)
+static void processH3Events(ClientState& clientState, DOH3Frontend& frontend, DOH3ServerConfig& dsc, H3Connection& conn, const ComboAddress& client, const PacketBuffer& serverConnID, PacketBuffer& buffer)
 {
   while (true) {
     quiche_h3_event* event{nullptr};
@@ -830,11 +846,11 @@ static void processH3Events(ClientState& clientState, DOH3Frontend& frontend, H3
 
     switch (quiche_h3_event_type(event)) {
     case QUICHE_H3_EVENT_HEADERS: {
-      processH3HeaderEvent(clientState, frontend, conn, client, serverConnID, streamID, event);
+      processH3HeaderEvent(clientState, frontend, dsc, conn, client, serverConnID, streamID, event);
       break;
     }
     case QUICHE_H3_EVENT_DATA: {
-      processH3DataEvent(clientState, frontend, conn, client, serverConnID, streamID, event, buffer);
+      processH3DataEvent(clientState, frontend, dsc, conn, client, serverConnID, streamID, event, buffer);
       break;
     }
     case QUICHE_H3_EVENT_FINISHED:
@@ -848,147 +864,195 @@ static void processH3Events(ClientState& clientState, DOH3Frontend& frontend, H3
   }
 }
 
-static void handleSocketReadable(DOH3Frontend& frontend, ClientState& clientState, Socket& sock, PacketBuffer& buffer)
+static void forwardDatagram(DOH3ServerConfig& owner, PacketBuffer& buffer, const ComboAddress& client, const ComboAddress& localAddr)
+{
+  try {
+    auto datagram = std::make_unique<ForwardedDatagram>();
+    datagram->d_payload = std::move(buffer);
+    datagram->d_peer = client;
+    datagram->d_localAddr = localAddr;
+    if (!owner.d_datagramSender.send(std::move(datagram))) {
+      vinfolog("Unable to pass a DoH3 datagram to the worker thread owning the connection because the pipe is full");
+    }
+  }
+  catch (const std::exception& e) {
+    vinfolog("Unable to pass a DoH3 datagram to the worker thread owning the connection because we couldn't write to the pipe: %s", e.what());
+  }
+  buffer = PacketBuffer();
+}
+
+static void handleDatagram(DOH3Frontend& frontend, DOH3ServerConfig& dsc, ClientState& clientState, Socket& sock, PacketBuffer& buffer, ComboAddress& client, ComboAddress& localAddr, bool forwarded)
 {
+  DEBUGLOG("Received DoH3 datagram of size " << buffer.size() << " from " << client.toStringWithPort());
+
+  uint32_t version{0};
+  uint8_t type{0};
+  std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> scid{};
+  size_t scid_len = scid.size();
+  std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> dcid{};
+  size_t dcid_len = dcid.size();
+  std::array<uint8_t, MAX_TOKEN_LEN> token{};
+  size_t token_len = token.size();
+
+  auto res = quiche_header_info(buffer.data(), buffer.size(), LOCAL_CONN_ID_LEN,
+                                &version, &type,
+                                scid.data(), &scid_len,
+                                dcid.data(), &dcid_len,
+                                token.data(), &token_len);
+  if (res != 0) {
+    DEBUGLOG("Error in quiche_header_info: " << res);
+    return;
+  }
+
   // destination connection ID, will have to be sent as original destination connection ID
-  PacketBuffer serverConnID;
+  PacketBuffer serverConnID(dcid.begin(), dcid.begin() + dcid_len);
   // source connection ID, will have to be sent as destination connection ID
-  PacketBuffer clientConnID;
-  PacketBuffer tokenBuf;
-  while (true) {
-    ComboAddress client;
-    ComboAddress localAddr;
-    client.sin4.sin_family = clientState.local.sin4.sin_family;
-    localAddr.sin4.sin_family = clientState.local.sin4.sin_family;
-    buffer.resize(4096);
-    if (!dnsdist::doq::recvAsync(sock, buffer, client, localAddr)) {
+  PacketBuffer clientConnID(scid.begin(), scid.begin() + scid_len);
+  auto conn = getConnection(dsc.d_connections, serverConnID);
+
+  if (!conn && !forwarded && (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL) || token_len > 0)) {
+    /* the connection ID has been generated by us, so it tells us which worker owns (or will own) the connection.
+       The kernel usually delivers the datagram to the right socket, but not after a client migration, for example */
+    auto owner = getWorkerFromCID(serverConnID, frontend.d_server_configs.size());
+    if (owner && *owner != dsc.d_workerIndex) {
+      DEBUGLOG("Passing the datagram to worker " << *owner);
+      forwardDatagram(*frontend.d_server_configs.at(*owner), buffer, client, localAddr);
       return;
     }
-    if (localAddr.sin4.sin_family == 0) {
-      localAddr = clientState.local;
+  }
+
+  if (!conn) {
+    DEBUGLOG("Connection not found");
+    if (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL)) {
+      DEBUGLOG("Packet is not initial");
+      return;
     }
-    else {
-      /* we don't get the port, only the address */
-      localAddr.sin4.sin_port = clientState.local.sin4.sin_port;
+
+    if (!quiche_version_is_supported(version)) {
+      DEBUGLOG("Unsupported version");
+      ++frontend.d_doh3UnsupportedVersionErrors;
+      handleVersionNegociation(sock, clientConnID, serverConnID, client, localAddr, buffer);
+      return;
     }
 
-    DEBUGLOG("Received DoH3 datagram of size " << buffer.size() << " from " << client.toStringWithPort());
-
-    uint32_t version{0};
-    uint8_t type{0};
-    std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> scid{};
-    size_t scid_len = scid.size();
-    std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> dcid{};
-    size_t dcid_len = dcid.size();
-    std::array<uint8_t, MAX_TOKEN_LEN> token{};
-    size_t token_len = token.size();
-
-    auto res = quiche_header_info(buffer.data(), buffer.size(), LOCAL_CONN_ID_LEN,
-                                  &version, &type,
-                                  scid.data(), &scid_len,
-                                  dcid.data(), &dcid_len,
-                                  token.data(), &token_len);
-    if (res != 0) {
-      DEBUGLOG("Error in quiche_header_info: " << res);
-      continue;
+    if (token_len == 0) {
+      /* stateless retry */
+      DEBUGLOG("No token received");
+      handleStatelessRetry(sock, clientConnID, serverConnID, client, localAddr, version, buffer, dsc.d_workerIndex);
+      return;
     }
 
-    serverConnID.assign(dcid.begin(), dcid.begin() + dcid_len);
-    // source connection ID, will have to be sent as destination connection ID
-    clientConnID.assign(scid.begin(), scid.begin() + scid_len);
-    auto conn = getConnection(frontend.d_server_config->d_connections, serverConnID);
+    PacketBuffer tokenBuf(token.begin(), token.begin() + token_len);
+    auto originalDestinationID = validateToken(tokenBuf, client);
+    if (!originalDestinationID) {
+      ++frontend.d_doh3InvalidTokensReceived;
+      DEBUGLOG("Discarding invalid token");
+      return;
+    }
 
+    DEBUGLOG("Creating a new connection");
+    conn = createConnection(dsc, serverConnID, *originalDestinationID, localAddr, client);
     if (!conn) {
-      DEBUGLOG("Connection not found");
-      if (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL)) {
-        DEBUGLOG("Packet is not initial");
-        continue;
-      }
+      return;
+    }
+  }
+  DEBUGLOG("Connection found");
+  quiche_recv_info recv_info = {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    reinterpret_cast<struct sockaddr*>(&client),
+    client.getSocklen(),
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    reinterpret_cast<struct sockaddr*>(&localAddr),
+    localAddr.getSocklen(),
+  };
 
-      if (!quiche_version_is_supported(version)) {
-        DEBUGLOG("Unsupported version");
-        ++frontend.d_doh3UnsupportedVersionErrors;
-        handleVersionNegociation(sock, clientConnID, serverConnID, client, localAddr, buffer);
-        continue;
-      }
+  auto done = quiche_conn_recv(conn->get().d_conn.get(), buffer.data(), buffer.size(), &recv_info);
+  if (done < 0) {
+    return;
+  }
 
-      if (token_len == 0) {
-        /* stateless retry */
-        DEBUGLOG("No token received");
-        handleStatelessRetry(sock, clientConnID, serverConnID, client, localAddr, version, buffer);
-        continue;
-      }
+  if (quiche_conn_is_established(conn->get().d_conn.get()) || quiche_conn_is_in_early_data(conn->get().d_conn.get())) {
+    DEBUGLOG("Connection is established");
 
-      tokenBuf.assign(token.begin(), token.begin() + token_len);
-      auto originalDestinationID = validateToken(tokenBuf, client);
-      if (!originalDestinationID) {
-        ++frontend.d_doh3InvalidTokensReceived;
-        DEBUGLOG("Discarding invalid token");
-        continue;
+    if (!conn->get().d_http3) {
+      conn->get().d_http3 = QuicheHTTP3Connection(quiche_h3_conn_new_with_transport(conn->get().d_conn.get(), dsc.http3config.get()),
+                                                  quiche_h3_conn_free);
+      if (!conn->get().d_http3) {
+        return;
       }
+      DEBUGLOG("Successfully created HTTP/3 connection");
+    }
 
-      DEBUGLOG("Creating a new connection");
-      conn = createConnection(*frontend.d_server_config, serverConnID, *originalDestinationID, localAddr, client);
-      if (!conn) {
-        continue;
-      }
+    processH3Events(clientState, frontend, dsc, conn->get(), client, serverConnID, buffer);
+
+    flushEgress(sock, conn->get().d_conn, client, localAddr, buffer, frontend.d_datagramStats);
+  }
+  else {
+    DEBUGLOG("Connection not established");
+  }
+}
+
+static void handleSocketReadable(DOH3Frontend& frontend, DOH3ServerConfig& dsc, ClientState& clientState, Socket& sock, DatagramReceiver& receiver, PacketBuffer& buffer)
+{
+  while (true) {
+    ComboAddress client;
+    ComboAddress localAddr;
+    if (!receiver.next(buffer, client, localAddr)) {
+      return;
     }
-    DEBUGLOG("Connection found");
-    quiche_recv_info recv_info = {
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      reinterpret_cast<struct sockaddr*>(&client),
-      client.getSocklen(),
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      reinterpret_cast<struct sockaddr*>(&localAddr),
-      localAddr.getSocklen(),
-    };
-
-    auto done = quiche_conn_recv(conn->get().d_conn.get(), buffer.data(), buffer.size(), &recv_info);
-    if (done < 0) {
-      continue;
+    if (localAddr.sin4.sin_family == 0) {
+      localAddr = clientState.local;
+    }
+    else {
+      /* we don't get the port, only the address */
+      localAddr.sin4.sin_port = clientState.local.sin4.sin_port;
     }
 
-    if (quiche_conn_is_established(conn->get().d_conn.get()) || quiche_conn_is_in_early_data(conn->get().d_conn.get())) {
-      DEBUGLOG("Connection is established");
+    handleDatagram(frontend, dsc, clientState, sock, buffer, client, localAddr, false);
+  }
+}
 
-      if (!conn->get().d_http3) {
-        conn->get().d_http3 = QuicheHTTP3Connection(quiche_h3_conn_new_with_transport(conn->get().d_conn.get(), frontend.d_server_config->http3config.get()),
-                                                    quiche_h3_conn_free);
-        if (!conn->get().d_http3) {
-          continue;
-        }
-        DEBUGLOG("Successfully created HTTP/3 connection");
+static void handleForwardedDatagrams(DOH3Frontend& frontend, DOH3ServerConfig& dsc, ClientState& clientState, Socket& sock)
+{
+  for (;;) {
+    try {
+      auto tmp = dsc.d_datagramReceiver.receive();
+      if (!tmp) {
+        return;
       }
 
-      processH3Events(clientState, frontend, conn->get(), client, serverConnID, buffer);
-
-      flushEgress(sock, conn->get().d_conn, client, localAddr, buffer);
+      auto datagram = std::move(*tmp);
+      handleDatagram(frontend, dsc, clientState, sock, datagram->d_payload, datagram->d_peer, datagram->d_localAddr, true);
     }
-    else {
-      DEBUGLOG("Connection not established");
+    catch (const std::exception& e) {
+      errlog("Error while processing a datagram passed by another DoH3 worker: %s", e.what());
     }
   }
 }
 
 // this is the entrypoint from dnsdist.cc
-void doh3Thread(ClientState* clientState)
+void doh3Thread(ClientState* clientState, size_t workerIndex)
 {
   try {
     std::shared_ptr<DOH3Frontend>& frontend = clientState->doh3Frontend;
+    auto& dsc = *frontend->d_server_configs.at(workerIndex);
 
-    frontend->d_server_config->clientState = clientState;
-    frontend->d_server_config->df = clientState->doh3Frontend;
+    dsc.clientState = clientState;
+    dsc.df = clientState->doh3Frontend;
 
     setThreadName("dnsdist/doh3");
 
-    Socket sock(clientState->udpFD);
+    Socket sock(frontend->d_workerSockets.empty() ? clientState->udpFD : frontend->d_workerSockets.at(workerIndex));
     sock.setNonBlocking();
+    DatagramReceiver receiver(sock, clientState->local.sin4.sin_family, frontend->d_datagramStats);
 
     auto mplexer = std::unique_ptr<FDMultiplexer>(FDMultiplexer::getMultiplexerSilent());
 
-    auto responseReceiverFD = frontend->d_server_config->d_responseReceiver.getDescriptor();
+    auto responseReceiverFD = dsc.d_responseReceiver.getDescriptor();
+    auto datagramReceiverFD = dsc.d_datagramReceiver.getDescriptor();
     mplexer->addReadFD(sock.getHandle(), [](int, FDMultiplexer::funcparam_t&) {});
     mplexer->addReadFD(responseReceiverFD, [](int, FDMultiplexer::funcparam_t&) {});
+    mplexer->addReadFD(datagramReceiverFD, [](int, FDMultiplexer::funcparam_t&) {});
     std::vector<int> readyFDs;
     PacketBuffer buffer(4096);
     while (true) {
@@ -997,17 +1061,21 @@ void doh3Thread(ClientState* clientState)
 
       try {
         if (std::find(readyFDs.begin(), readyFDs.end(), sock.getHandle()) != readyFDs.end()) {
-          handleSocketReadable(*frontend, *clientState, sock, buffer);
+          handleSocketReadable(*frontend, dsc, *clientState, sock, receiver, buffer);
+        }
+
+        if (std::find(readyFDs.begin(), readyFDs.end(), datagramReceiverFD) != readyFDs.end()) {
+          handleForwardedDatagrams(*frontend, dsc, *clientState, sock);
         }
 
         if (std::find(readyFDs.begin(), readyFDs.end(), responseReceiverFD) != readyFDs.end()) {
-          flushResponses(frontend->d_server_config->d_responseReceiver);
+          flushResponses(dsc.d_responseReceiver);
         }
 
-        for (auto conn = frontend->d_server_config->d_connections.begin(); conn != frontend->d_server_config->d_connections.end();) {
+        for (auto conn = dsc.d_connections.begin(); conn != dsc.d_connections.end();) {
           quiche_conn_on_timeout(conn->second.d_conn.get());
 
-          flushEgress(sock, conn->second.d_conn, conn->second.d_peer, conn->second.d_localAddr, buffer);
+          flushEgress(sock, conn->second.d_conn, conn->second.d_peer, conn->second.d_localAddr, buffer, frontend->d_datagramStats);
 
           if (quiche_conn_is_closed(conn->second.d_conn.get())) {
 #ifdef DEBUGLOG_ENABLED
@@ -1019,7 +1087,7 @@ void doh3Thread(ClientState* clientState)
 
             DEBUGLOG("Connection (DoH3) closed, recv=" << stats.recv << " sent=" << stats.sent << " lost=" << stats.lost << " rtt=" << path_stats.rtt << "ns cwnd=" << path_stats.cwnd);
 #endif
-            conn = frontend->d_server_config->d_connections.erase(conn);
+            conn = dsc.d_connections.erase(conn);
           }
           else {
             flushStalledResponses(conn->second);
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "config.h"
 #include "channel.hh"
@@ -50,7 +51,11 @@ struct DOH3Frontend
   void setup();
   void reloadCertificates();
 
-  std::unique_ptr<DOH3ServerConfig> d_server_config;
+  /* one per worker thread */
+  std::vector<std::unique_ptr<DOH3ServerConfig>> d_server_configs;
+  /* the UDP sockets of the worker threads, bound to the same address via SO_REUSEPORT */
+  std::vector<int> d_workerSockets;
+  size_t d_workers{1};
   ComboAddress d_local;
 
 #ifdef __linux__
@@ -66,6 +71,7 @@ struct DOH3Frontend
   pdns::stat_t d_doh3InvalidTokensReceived{0}; // Discarded received tokens
   pdns::stat_t d_validResponses{0}; // Valid responses sent
   pdns::stat_t d_errorResponses{0}; // Empty responses (no backend, drops, invalid queries, etc.)
+  dnsdist::doq::DatagramStats d_datagramStats;
 };
 
 struct DOH3Unit
@@ -98,7 +104,7 @@ struct CrossProtocolQuery;
 struct DNSQuestion;
 std::unique_ptr<CrossProtocolQuery> getDOH3CrossProtocolQueryFromDQ(DNSQuestion& dnsQuestion, bool isResponse);
 
-void doh3Thread(ClientState* clientState);
+void doh3Thread(ClientState* clientState, size_t workerIndex);
 
 #else
 
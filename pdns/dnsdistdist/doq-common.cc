@@ -24,6 +24,11 @@
 #include "dnsdist-random.hh"
 #include "libssl.hh"
 
+#ifdef __linux__
+#include <linux/filter.h>
+#include <netinet/udp.h>
+#endif
+
 #ifdef HAVE_DNS_OVER_QUIC
 
 #if 0
@@ -77,15 +82,51 @@ void fillRandom(PacketBuffer& buffer, size_t size)
   }
 }
 
-std::optional<PacketBuffer> getCID()
+std::optional<PacketBuffer> getCID(uint8_t workerIndex)
 {
   PacketBuffer buffer;
 
-  fillRandom(buffer, LOCAL_CONN_ID_LEN);
+  buffer.push_back(workerIndex);
+  fillRandom(buffer, LOCAL_CONN_ID_LEN - 1);
 
   return buffer;
 }
 
+std::optional<size_t> getWorkerFromCID(const PacketBuffer& connID, size_t workers)
+{
+  if (connID.size() != LOCAL_CONN_ID_LEN || connID.at(0) >= workers) {
+    return std::nullopt;
+  }
+  return connID.at(0);
+}
+
+bool attachWorkerSteeringProgram([[maybe_unused]] int socket)
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  /* The program is run by the kernel on the UDP payload of every datagram received on
+     a socket of the SO_REUSEPORT group, and returns the index of the socket that should
+     get it. We return the first byte of the destination connection ID, which is the
+     index of the worker if we generated it, located at offset 6 for long header packets
+     and at offset 1 for short header ones. The kernel falls back to the usual hash when
+     the value is larger than the number of sockets in the group, and user-space takes
+     care of the datagrams that still end up on the wrong worker. */
+  std::array<struct sock_filter, 6> code{{
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x80, 0, 2),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  }};
+  struct sock_fprog program{};
+  program.len = code.size();
+  program.filter = code.data();
+  return setsockopt(socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+#else
+  return false;
+#endif
+}
+
 // returns the original destination ID if the token is valid, nothing otherwise
 std::optional<PacketBuffer> validateToken(const PacketBuffer& token, const ComboAddress& peer)
 {
@@ -147,9 +188,9 @@ static void sendFromTo(Socket& sock, const ComboAddress& peer, const ComboAddres
   }
 }
 
-void handleStatelessRetry(Socket& sock, const PacketBuffer& clientConnID, const PacketBuffer& serverConnID, const ComboAddress& peer, const ComboAddress& localAddr, uint32_t version, PacketBuffer& buffer)
+void handleStatelessRetry(Socket& sock, const PacketBuffer& clientConnID, const PacketBuffer& serverConnID, const ComboAddress& peer, const ComboAddress& localAddr, uint32_t version, PacketBuffer& buffer, uint8_t workerIndex)
 {
-  auto newServerConnID = getCID();
+  auto newServerConnID = getCID(workerIndex);
   if (!newServerConnID) {
     return;
   }
@@ -190,23 +231,124 @@ void handleVersionNegociation(Socket& sock, const PacketBuffer& clientConnID, co
   sendFromTo(sock, peer, localAddr, buffer);
 }
 
-void flushEgress(Socket& sock, QuicheConnection& conn, const ComboAddress& peer, const ComboAddress& localAddr, PacketBuffer& buffer)
+/* sends several datagrams of segmentSize bytes, except the last one which might be shorter, with a single call.
+   Returns false if GSO is not usable on that socket, in which case the datagrams have to be sent one by one */
+static bool sendWithGSO([[maybe_unused]] Socket& sock, [[maybe_unused]] const ComboAddress& peer, [[maybe_unused]] const ComboAddress& local, [[maybe_unused]] const uint8_t* data, [[maybe_unused]] size_t size, [[maybe_unused]] uint16_t segmentSize, [[maybe_unused]] DatagramStats& stats)
 {
-  buffer.resize(MAX_DATAGRAM_SIZE);
+#ifdef UDP_SEGMENT
+  msghdr msgh{};
+  iovec iov{};
+  cmsgbuf_aligned cbuf{};
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-type-const-cast): it's the API
+  msgh.msg_name = reinterpret_cast<void*>(const_cast<ComboAddress*>(&peer));
+  msgh.msg_namelen = peer.getSocklen();
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): it's the API
+  iov.iov_base = const_cast<uint8_t*>(data);
+  iov.iov_len = size;
+  msgh.msg_iov = &iov;
+  msgh.msg_iovlen = 1;
+
+  size_t controlLen = 0;
+  if (local.sin4.sin_family != 0) {
+    addCMsgSrcAddr(&msgh, &cbuf, &local, 0);
+    controlLen = msgh.msg_controllen;
+  }
+  static_assert(CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(uint16_t)) <= sizeof(cbuf), "Buffer is too small for UDP_SEGMENT");
+  msgh.msg_control = &cbuf;
+  msgh.msg_controllen = controlLen + CMSG_SPACE(sizeof(uint16_t));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  auto* cmsg = reinterpret_cast<struct cmsghdr*>(reinterpret_cast<char*>(&cbuf) + controlLen);
+  cmsg->cmsg_level = IPPROTO_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+
+  if (sendmsg(sock.getHandle(), &msgh, 0) < 0) {
+    auto error = errno;
+    /* EIO is returned when the interface cannot do the checksum offload GSO requires,
+       the others when the kernel does not support GSO or that segment size */
+    if (error == EIO || error == EINVAL || error == EOPNOTSUPP || error == ENOPROTOOPT) {
+      if (stats.d_gsoSupported.exchange(false)) {
+        warnlog("Disabling UDP segmentation offload (GSO) for QUIC on this socket after a failure to send to %s: %s", peer.toStringWithPort(), stringerror(error));
+      }
+      return false;
+    }
+    /* the datagrams are lost, QUIC will retransmit them */
+    vinfolog("Error while sending QUIC datagrams of size %d to %s: %s", size, peer.toStringWithPort(), stringerror(error));
+    return true;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+static void sendSegments(Socket& sock, const ComboAddress& peer, const ComboAddress& local, PacketBuffer& buffer, size_t size, size_t segmentSize, size_t segments, DatagramStats& stats)
+{
+  if (segments > 1 && sendWithGSO(sock, peer, local, buffer.data(), size, static_cast<uint16_t>(segmentSize), stats)) {
+    ++stats.d_sendCalls;
+    stats.d_sentDatagrams += segments;
+    return;
+  }
+
+  PacketBuffer datagram;
+  for (size_t offset = 0; offset < size; offset += segmentSize) {
+    const auto* data = &buffer.at(offset);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    datagram.assign(data, data + std::min(segmentSize, size - offset));
+    sendFromTo(sock, peer, local, datagram);
+    ++stats.d_sendCalls;
+    ++stats.d_sentDatagrams;
+  }
+}
+
+void flushEgress(Socket& sock, QuicheConnection& conn, const ComboAddress& peer, const ComboAddress& localAddr, PacketBuffer& buffer, DatagramStats& stats)
+{
+  /* With GSO, consecutive datagrams are written next to each other and handed to the kernel
+     with a single call. They all need to have the same size, except the last one which might
+     be shorter. */
+#ifdef UDP_SEGMENT
+  static constexpr size_t maxSegmentsPerCall = 32;
+  const size_t maxSegments = stats.d_gsoSupported.load(std::memory_order_relaxed) ? maxSegmentsPerCall : 1;
+#else
+  const size_t maxSegments = 1;
+#endif
+  buffer.resize(maxSegments * MAX_DATAGRAM_SIZE);
   quiche_send_info send_info;
+  size_t used = 0;
+  size_t segments = 0;
+  size_t segmentSize = 0;
 
   while (true) {
-    auto written = quiche_conn_send(conn.get(), buffer.data(), buffer.size(), &send_info);
-    if (written == QUICHE_ERR_DONE) {
-      return;
+    auto written = quiche_conn_send(conn.get(), &buffer.at(used), MAX_DATAGRAM_SIZE, &send_info);
+    if (written == QUICHE_ERR_DONE || written < 0) {
+      break;
+    }
+    // FIXME pacing (as send_info.at should tell us when to send the packet) ?
+    const auto datagramSize = static_cast<size_t>(written);
+    if (segments > 0 && datagramSize > segmentSize) {
+      /* larger than the previous ones, it has to start a new batch */
+      sendSegments(sock, peer, localAddr, buffer, used, segmentSize, segments, stats);
+      memmove(buffer.data(), &buffer.at(used), datagramSize);
+      used = 0;
+      segments = 0;
+    }
+    if (segments == 0) {
+      segmentSize = datagramSize;
     }
+    used += datagramSize;
+    ++segments;
 
-    if (written < 0) {
-      return;
+    if (datagramSize < segmentSize || segments == maxSegments) {
+      sendSegments(sock, peer, localAddr, buffer, used, segmentSize, segments, stats);
+      used = 0;
+      segments = 0;
     }
-    // FIXME pacing (as send_info.at should tell us when to send the packet) ?
-    buffer.resize(static_cast<size_t>(written));
-    sendFromTo(sock, peer, localAddr, buffer);
+  }
+
+  if (segments > 0) {
+    sendSegments(sock, peer, localAddr, buffer, used, segmentSize, segments, stats);
   }
 }
 
@@ -280,30 +422,8 @@ void configureQuiche(QuicheConfig& config, const QuicheParams& params, bool isHT
   }
 }
 
-bool recvAsync(Socket& socket, PacketBuffer& buffer, ComboAddress& clientAddr, ComboAddress& localAddr)
+static void harvestLocalAddress(const msghdr& msgh, ComboAddress& localAddr)
 {
-  msghdr msgh{};
-  iovec iov{};
-  /* used by HarvestDestinationAddress */
-  cmsgbuf_aligned cbuf;
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-  fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), reinterpret_cast<char*>(&buffer.at(0)), buffer.size(), &clientAddr);
-
-  ssize_t got = recvmsg(socket.getHandle(), &msgh, 0);
-  if (got < 0) {
-    int error = errno;
-    if (error != EAGAIN) {
-      throw NetworkError("Error in recvmsg: " + stringerror(error));
-    }
-    return false;
-  }
-
-  if ((msgh.msg_flags & MSG_TRUNC) != 0) {
-    return false;
-  }
-
-  buffer.resize(static_cast<size_t>(got));
-
   if (HarvestDestinationAddress(&msgh, &localAddr)) {
     /* so it turns out that sometimes the kernel lies to us:
        the address is set to 0.0.0.0:0 which makes our sendfromto() use
@@ -321,8 +441,130 @@ bool recvAsync(Socket& socket, PacketBuffer& buffer, ComboAddress& clientAddr, C
   else {
     localAddr.sin4.sin_family = 0;
   }
+}
 
-  return !buffer.empty();
+/* the size of a coalesced datagram, as reported by UDP_GRO, or 0 */
+static size_t getGROSegmentSize([[maybe_unused]] const msghdr& msgh)
+{
+#ifdef UDP_GRO
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): CMSG_NXTHDR is not const-correct
+  auto* header = const_cast<msghdr*>(&msgh);
+  for (auto* cmsg = CMSG_FIRSTHDR(header); cmsg != nullptr; cmsg = CMSG_NXTHDR(header, cmsg)) {
+    if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int segmentSize{0};
+      memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+      return segmentSize > 0 ? static_cast<size_t>(segmentSize) : 0;
+    }
+  }
+#endif
+  return 0;
+}
+
+static constexpr size_t s_receiveBatchSize{16};
+
+DatagramReceiver::DatagramReceiver(Socket& socket, int family, DatagramStats& stats) :
+  d_messages(s_receiveBatchSize), d_headers(s_receiveBatchSize), d_socket(socket), d_stats(stats), d_family(family)
+{
+  size_t bufferSize = 4096;
+#ifdef UDP_GRO
+  /* let the kernel coalesce datagrams of the same flow into a single buffer */
+  int one = 1;
+  if (setsockopt(d_socket.getHandle(), IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) == 0) {
+    bufferSize = std::numeric_limits<uint16_t>::max();
+  }
+#endif
+  for (auto& message : d_messages) {
+    message.d_data.resize(bufferSize);
+  }
+}
+
+bool DatagramReceiver::fill()
+{
+  d_received = 0;
+  d_current = 0;
+  for (size_t idx = 0; idx < d_messages.size(); idx++) {
+    auto& message = d_messages.at(idx);
+    message.d_remote.sin4.sin_family = d_family;
+#ifdef HAVE_RECVMMSG
+    auto& msgh = d_headers.at(idx).msg_hdr;
+    d_headers.at(idx).msg_len = 0;
+#else
+    auto& msgh = d_headers.at(idx);
+#endif
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    fillMSGHdr(&msgh, &message.d_iov, &message.d_cbuf, sizeof(message.d_cbuf), reinterpret_cast<char*>(message.d_data.data()), message.d_data.size(), &message.d_remote);
+  }
+
+#ifdef HAVE_RECVMMSG
+  int got = recvmmsg(d_socket.getHandle(), d_headers.data(), d_headers.size(), 0, nullptr);
+#else
+  ssize_t got = recvmsg(d_socket.getHandle(), &d_headers.at(0), 0);
+#endif
+  if (got < 0) {
+    int error = errno;
+    if (error != EAGAIN && error != EWOULDBLOCK) {
+      throw NetworkError("Error while receiving QUIC datagrams: " + stringerror(error));
+    }
+    return false;
+  }
+  ++d_stats.d_receiveCalls;
+
+#ifdef HAVE_RECVMMSG
+  d_received = static_cast<size_t>(got);
+#else
+  d_received = got > 0 ? 1 : 0;
+#endif
+  for (size_t idx = 0; idx < d_received; idx++) {
+    auto& message = d_messages.at(idx);
+#ifdef HAVE_RECVMMSG
+    const auto& msgh = d_headers.at(idx).msg_hdr;
+    message.d_size = d_headers.at(idx).msg_len;
+#else
+    const auto& msgh = d_headers.at(idx);
+    message.d_size = static_cast<size_t>(got);
+#endif
+    message.d_offset = 0;
+    if ((msgh.msg_flags & MSG_TRUNC) != 0) {
+      message.d_size = 0;
+      continue;
+    }
+    message.d_local.sin4.sin_family = d_family;
+    harvestLocalAddress(msgh, message.d_local);
+    message.d_segmentSize = getGROSegmentSize(msgh);
+    if (message.d_segmentSize == 0) {
+      message.d_segmentSize = message.d_size;
+    }
+  }
+
+  return true;
+}
+
+bool DatagramReceiver::next(PacketBuffer& buffer, ComboAddress& clientAddr, ComboAddress& localAddr)
+{
+  while (true) {
+    if (d_current >= d_received) {
+      if (!fill()) {
+        return false;
+      }
+      continue;
+    }
+
+    auto& message = d_messages.at(d_current);
+    if (message.d_offset >= message.d_size) {
+      ++d_current;
+      continue;
+    }
+
+    const auto size = std::min(message.d_segmentSize, message.d_size - message.d_offset);
+    const auto* data = &message.d_data.at(message.d_offset);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    buffer.assign(data, data + size);
+    message.d_offset += size;
+    clientAddr = message.d_remote;
+    localAddr = message.d_local;
+    ++d_stats.d_receivedDatagrams;
+    return true;
+  }
 }
 
 };
@@ -31,9 +31,11 @@
 #include <quiche.h>
 
 #include "dolog.hh"
+#include "misc.hh"
 #include "noinitvector.hh"
 #include "sstuff.hh"
 #include "libssl.hh"
+#include "stat_t.hh"
 #include "dnsdist-crypto.hh"
 
 namespace dnsdist::doq
@@ -88,15 +90,75 @@ static constexpr size_t LOCAL_CONN_ID_LEN = 16;
 static constexpr std::array<uint8_t, 4> DOQ_ALPN{'\x03', 'd', 'o', 'q'};
 static constexpr std::array<uint8_t, 3> DOH3_ALPN{'\x02', 'h', '3'};
 
+/* how many datagrams are carried by each system call, which is more than one when
+   recvmmsg() and UDP generic receive and segmentation offloads (GRO, GSO) are used */
+struct DatagramStats
+{
+  pdns::stat_t d_receiveCalls{0};
+  pdns::stat_t d_receivedDatagrams{0};
+  pdns::stat_t d_sendCalls{0};
+  pdns::stat_t d_sentDatagrams{0};
+  /* cleared once the kernel or the interface behind the socket has told us it cannot do GSO */
+  std::atomic<bool> d_gsoSupported{true};
+};
+
+/* reads several datagrams per system call, when possible */
+class DatagramReceiver
+{
+public:
+  DatagramReceiver(Socket& socket, int family, DatagramStats& stats);
+  /* copies the next datagram into the buffer, returns false when the socket has nothing left to read */
+  bool next(PacketBuffer& buffer, ComboAddress& clientAddr, ComboAddress& localAddr);
+
+private:
+  struct Message
+  {
+    PacketBuffer d_data;
+    ComboAddress d_remote;
+    ComboAddress d_local;
+    iovec d_iov{};
+    size_t d_size{0};
+    size_t d_offset{0};
+    size_t d_segmentSize{0};
+    /* has to be last, as it contains a flexible array member */
+    cmsgbuf_aligned d_cbuf;
+  };
+
+  bool fill();
+
+  std::vector<Message> d_messages;
+#ifdef HAVE_RECVMMSG
+  std::vector<struct mmsghdr> d_headers;
+#else
+  std::vector<struct msghdr> d_headers;
+#endif
+  Socket& d_socket;
+  DatagramStats& d_stats;
+  size_t d_received{0};
+  size_t d_current{0};
+  int d_family;
+};
+
+/* a datagram received by a worker thread that does not own the corresponding connection,
+   passed to the owning worker */
+struct ForwardedDatagram
+{
+  PacketBuffer d_payload;
+  ComboAddress d_peer;
+  ComboAddress d_localAddr;
+};
+
 void fillRandom(PacketBuffer& buffer, size_t size);
-std::optional<PacketBuffer> getCID();
+/* the first byte of the connection IDs we generate is the index of the worker owning the connection */
+std::optional<PacketBuffer> getCID(uint8_t workerIndex = 0);
+std::optional<size_t> getWorkerFromCID(const PacketBuffer& connID, size_t workers);
+bool attachWorkerSteeringProgram(int socket);
 PacketBuffer mintToken(const PacketBuffer& dcid, const ComboAddress& peer);
 std::optional<PacketBuffer> validateToken(const PacketBuffer& token, const ComboAddress& peer);
-void handleStatelessRetry(Socket& sock, const PacketBuffer& clientConnID, const PacketBuffer& serverConnID, const ComboAddress& peer, const ComboAddress& localAddr, uint32_t version, PacketBuffer& buffer);
+void handleStatelessRetry(Socket& sock, const PacketBuffer& clientConnID, const PacketBuffer& serverConnID, const ComboAddress& peer, const ComboAddress& localAddr, uint32_t version, PacketBuffer& buffer, uint8_t workerIndex);
 void handleVersionNegociation(Socket& sock, const PacketBuffer& clientConnID, const PacketBuffer& serverConnID, const ComboAddress& peer, const ComboAddress& localAddr, PacketBuffer& buffer);
-void flushEgress(Socket& sock, QuicheConnection& conn, const ComboAddress& peer, const ComboAddress& localAddr, PacketBuffer& buffer);
+void flushEgress(Socket& sock, QuicheConnection& conn, const ComboAddress& peer, const ComboAddress& localAddr, PacketBuffer& buffer, DatagramStats& stats);
 void configureQuiche(QuicheConfig& config, const QuicheParams& params, bool isHTTP);
-bool recvAsync(Socket& socket, PacketBuffer& buffer, ComboAddress& clientAddr, ComboAddress& localAddr);
 
 };
 
@@ -74,14 +74,19 @@ static void sendBackDOQUnit(DOQUnitUniquePtr&& unit, const char* description);
 
 struct DOQServerConfig
 {
-  DOQServerConfig(QuicheConfig&& config_, uint32_t internalPipeBufferSize) :
-    config(std::move(config_))
+  DOQServerConfig(QuicheConfig&& config_, uint32_t internalPipeBufferSize, uint8_t workerIndex) :
+    config(std::move(config_)), d_workerIndex(workerIndex)
   {
     {
       auto [sender, receiver] = pdns::channel::createObjectQueue<DOQUnit>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, internalPipeBufferSize);
       d_responseSender = std::move(sender);
       d_responseReceiver = std::move(receiver);
     }
+    {
+      auto [sender, receiver] = pdns::channel::createObjectQueue<ForwardedDatagram>(pdns::channel::SenderBlockingMode::SenderNonBlocking, pdns::channel::ReceiverBlockingMode::ReceiverNonBlocking, internalPipeBufferSize);
+      d_datagramSender = std::move(sender);
+      d_datagramReceiver = std::move(receiver);
+    }
   }
   DOQServerConfig(const DOQServerConfig&) = delete;
   DOQServerConfig(DOQServerConfig&&) = default;
@@ -98,6 +103,10 @@ struct DOQServerConfig
   std::shared_ptr<DOQFrontend> df{nullptr};
   pdns::channel::Sender<DOQUnit> d_responseSender;
   pdns::channel::Receiver<DOQUnit> d_responseReceiver;
+  /* datagrams received by other workers for connections owned by this one */
+  pdns::channel::Sender<ForwardedDatagram> d_datagramSender;
+  pdns::channel::Receiver<ForwardedDatagram> d_datagramReceiver;
+  uint8_t d_workerIndex{0};
 };
 
 /* these might seem useless, but they are needed because
@@ -305,18 +314,28 @@ static void handleResponse(DOQFrontend& frontend, Connection& conn, const uint64
 
 void DOQFrontend::setup()
 {
-  auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
   d_quicheParams.d_alpn = std::string(DOQ_ALPN.begin(), DOQ_ALPN.end());
-  configureQuiche(config, d_quicheParams, false);
-  d_server_config = std::make_unique<DOQServerConfig>(std::move(config), d_internalPipeBufferSize);
+  d_server_configs.clear();
+  for (size_t worker = 0; worker < d_workers; worker++) {
+    auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
+    configureQuiche(config, d_quicheParams, false);
+    d_server_configs.push_back(std::make_unique<DOQServerConfig>(std::move(config), d_internalPipeBufferSize, static_cast<uint8_t>(worker)));
+  }
+
+  if (d_workerSockets.size() > 1 && !attachWorkerSteeringProgram(d_workerSockets.at(0))) {
+    warnlog("Unable to attach the connection ID steering program to the DoQ sockets of %s, datagrams will be passed between worker threads instead", d_local.toStringWithPort());
+  }
 }
 
 void DOQFrontend::reloadCertificates()
 {
-  auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
   d_quicheParams.d_alpn = std::string(DOQ_ALPN.begin(), DOQ_ALPN.end());
-  configureQuiche(config, d_quicheParams, false);
-  std::atomic_store_explicit(&d_server_config->config, std::move(config), std::memory_order_release);
+  /* the workers do not share their quiche configuration */
+  for (auto& serverConfig : d_server_configs) {
+    auto config = QuicheConfig(quiche_config_new(QUICHE_PROTOCOL_VERSION), quiche_config_free);
+    configureQuiche(config, d_quicheParams, false);
+    std::atomic_store_explicit(&serverConfig->config, std::move(config), std::memory_order_release);
+  }
 }
 
 static std::optional<std::reference_wrapper<Connection>> getConnection(DOQServerConfig::ConnectionsMap& connMap, const PacketBuffer& connID)
@@ -398,7 +417,7 @@ static void processDOQQuery(DOQUnitUniquePtr&& doqUnit)
 {
   const auto handleImmediateResponse = [](DOQUnitUniquePtr&& unit, [[maybe_unused]] const char* reason) {
     DEBUGLOG("handleImmediateResponse() reason=" << reason);
-    auto conn = getConnection(unit->dsc->df->d_server_config->d_connections, unit->serverConnID);
+    auto conn = getConnection(unit->dsc->d_connections, unit->serverConnID);
     handleResponse(*unit->dsc->df, *conn, unit->streamID, unit->response);
     unit->ids.doqu.reset();
   };
@@ -470,14 +489,11 @@ static void processDOQQuery(DOQUnitUniquePtr&& doqUnit)
     }
 
     auto downstream = unit->downstream;
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    unit->ids.qname = DNSName(reinterpret_cast<const char*>(unit->query.data()), static_cast<int>(unit->query.size()), sizeof(dnsheader), false, &unit->ids.qtype, &unit->ids.qclass);
+    unit->ids.parseQuestion(unit->query);
     DNSQuestion dnsQuestion(unit->ids, unit->query);
-    dnsdist::PacketMangling::editDNSHeaderFromPacket(dnsQuestion.getMutableData(), [&ids](dnsheader& header) {
-      const uint16_t* flags = getFlagsFromDNSHeader(&header);
-      ids.origFlags = *flags;
-      return true;
-    });
+    /* read-only access, so that the scan of the query done by parseQuestion() stays valid */
+    const uint16_t* flags = getFlagsFromDNSHeader(dnsQuestion.getHeader().get());
+    ids.origFlags = *flags;
     unit->ids.cs = &clientState;
 
     auto result = processQuery(dnsQuestion, holders, downstream);
@@ -575,7 +591,7 @@ static void flushResponses(pdns::channel::Receiver<DOQUnit>& receiver)
       }
 
       auto unit = std::move(*tmp);
-      auto conn = getConnection(unit->dsc->df->d_server_config->d_connections, unit->serverConnID);
+      auto conn = getConnection(unit->dsc->d_connections, unit->serverConnID);
       if (conn) {
         handleResponse(*unit->dsc->df, *conn, unit->streamID, unit->response);
       }
@@ -604,7 +620,7 @@ static void flushStalledResponses(Connection& conn)
   }
 }
 
-static void handleReadableStream(DOQFrontend& frontend, ClientState& clientState, Connection& conn, uint64_t streamID, const ComboAddress& client, const PacketBuffer& serverConnID)
+static void handleReadableStream(DOQServerConfig& dsc, ClientState& clientState, Connection& conn, uint64_t streamID, const ComboAddress& client, const PacketBuffer& serverConnID)
 {
   auto& streamBuffer = conn.d_streamBuffers[streamID];
   while (true) {
@@ -655,144 +671,193 @@ static void handleReadableStream(DOQFrontend& frontend, ClientState& clientState
     return;
   }
   DEBUGLOG("Dispatching query");
-  doq_dispatch_query(*(frontend.d_server_config), std::move(streamBuffer), conn.d_localAddr, client, serverConnID, streamID);
+  doq_dispatch_query(dsc, std::move(streamBuffer), conn.d_localAddr, client, serverConnID, streamID);
   conn.d_streamBuffers.erase(streamID);
 }
 
-static void handleSocketReadable(DOQFrontend& frontend, ClientState& clientState, Socket& sock, PacketBuffer& buffer)
+static void forwardDatagram(DOQServerConfig& owner, PacketBuffer& buffer, const ComboAddress& client, const ComboAddress& localAddr)
 {
+  try {
+    auto datagram = std::make_unique<ForwardedDatagram>();
+    datagram->d_payload = std::move(buffer);
+    datagram->d_peer = client;
+    datagram->d_localAddr = localAddr;
+    if (!owner.d_datagramSender.send(std::move(datagram))) {
+      vinfolog("Unable to pass a DoQ datagram to the worker thread owning the connection because the pipe is full");
+    }
+  }
+  catch (const std::exception& e) {
+    vinfolog("Unable to pass a DoQ datagram to the worker thread owning the connection because we couldn't write to the pipe: %s", e.what());
+  }
+  buffer = PacketBuffer();
+}
+
+static void handleDatagram(DOQFrontend& frontend, DOQServerConfig& dsc, ClientState& clientState, Socket& sock, PacketBuffer& buffer, ComboAddress& client, ComboAddress& localAddr, bool forwarded)
+{
+  DEBUGLOG("Received DoQ datagram of size " << buffer.size() << " from " << client.toStringWithPort());
+
+  uint32_t version{0};
+  uint8_t type{0};
+  std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> scid{};
+  size_t scid_len = scid.size();
+  std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> dcid{};
+  size_t dcid_len = dcid.size();
+  std::array<uint8_t, MAX_TOKEN_LEN> token{};
+  size_t token_len = token.size();
+
+  auto res = quiche_header_info(buffer.data(), buffer.size(), LOCAL_CONN_ID_LEN,
+                                &version, &type,
+                                scid.data(), &scid_len,
+                                dcid.data(), &dcid_len,
+                                token.data(), &token_len);
+  if (res != 0) {
+    DEBUGLOG("Error in quiche_header_info: " << res);
+    return;
+  }
+
   // destination connection ID, will have to be sent as original destination connection ID
-  PacketBuffer serverConnID;
+  PacketBuffer serverConnID(dcid.begin(), dcid.begin() + dcid_len);
   // source connection ID, will have to be sent as destination connection ID
-  PacketBuffer clientConnID;
-  PacketBuffer tokenBuf;
-  while (true) {
-    ComboAddress client;
-    ComboAddress localAddr;
-    client.sin4.sin_family = clientState.local.sin4.sin_family;
-    localAddr.sin4.sin_family = clientState.local.sin4.sin_family;
-    buffer.resize(4096);
-    if (!dnsdist::doq::recvAsync(sock, buffer, client, localAddr)) {
+  PacketBuffer clientConnID(scid.begin(), scid.begin() + scid_len);
+  auto conn = getConnection(dsc.d_connections, serverConnID);
+
+  if (!conn && !forwarded && (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL) || token_len > 0)) {
+    /* the connection ID has been generated by us, so it tells us which worker owns (or will own) the connection.
+       The kernel usually delivers the datagram to the right socket, but not after a client migration, for example */
+    auto owner = getWorkerFromCID(serverConnID, frontend.d_server_configs.size());
+    if (owner && *owner != dsc.d_workerIndex) {
+      DEBUGLOG("Passing the datagram to worker " << *owner);
+      forwardDatagram(*frontend.d_server_configs.at(*owner), buffer, client, localAddr);
       return;
     }
-    if (localAddr.sin4.sin_family == 0) {
-      localAddr = clientState.local;
-    }
-    else {
-      /* we don't get the port, only the address */
-      localAddr.sin4.sin_port = clientState.local.sin4.sin_port;
-    }
+  }
 
-    DEBUGLOG("Received DoQ datagram of size " << buffer.size() << " from " << client.toStringWithPort());
+  if (!conn) {
+    DEBUGLOG("Connection not found");
+    if (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL)) {
+      DEBUGLOG("Packet is not initial");
+      return;
+    }
 
-    uint32_t version{0};
-    uint8_t type{0};
-    std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> scid{};
-    size_t scid_len = scid.size();
-    std::array<uint8_t, QUICHE_MAX_CONN_ID_LEN> dcid{};
-    size_t dcid_len = dcid.size();
-    std::array<uint8_t, MAX_TOKEN_LEN> token{};
-    size_t token_len = token.size();
+    if (!quiche_version_is_supported(version)) {
+      DEBUGLOG("Unsupported version");
+      ++frontend.d_doqUnsupportedVersionErrors;
+      handleVersionNegociation(sock, clientConnID, serverConnID, client, localAddr, buffer);
+      return;
+    }
 
-    auto res = quiche_header_info(buffer.data(), buffer.size(), LOCAL_CONN_ID_LEN,
-                                  &version, &type,
-                                  scid.data(), &scid_len,
-                                  dcid.data(), &dcid_len,
-                                  token.data(), &token_len);
-    if (res != 0) {
-      DEBUGLOG("Error in quiche_header_info: " << res);
-      continue;
+    if (token_len == 0) {
+      /* stateless retry */
+      DEBUGLOG("No token received");
+      handleStatelessRetry(sock, clientConnID, serverConnID, client, localAddr, version, buffer, dsc.d_workerIndex);
+      return;
     }
 
-    serverConnID.assign(dcid.begin(), dcid.begin() + dcid_len);
-    clientConnID.assign(scid.begin(), scid.begin() + scid_len);
-    auto conn = getConnection(frontend.d_server_config->d_connections, serverConnID);
+    PacketBuffer tokenBuf(token.begin(), token.begin() + token_len);
+    auto originalDestinationID = validateToken(tokenBuf, client);
+    if (!originalDestinationID) {
+      ++frontend.d_doqInvalidTokensReceived;
+      DEBUGLOG("Discarding invalid token");
+      return;
+    }
 
+    DEBUGLOG("Creating a new connection");
+    conn = createConnection(dsc, serverConnID, *originalDestinationID, client, localAddr);
     if (!conn) {
-      DEBUGLOG("Connection not found");
-      if (type != static_cast<uint8_t>(DOQ_Packet_Types::QUIC_PACKET_TYPE_INITIAL)) {
-        DEBUGLOG("Packet is not initial");
-        continue;
-      }
-
-      if (!quiche_version_is_supported(version)) {
-        DEBUGLOG("Unsupported version");
-        ++frontend.d_doqUnsupportedVersionErrors;
-        handleVersionNegociation(sock, clientConnID, serverConnID, client, localAddr, buffer);
-        continue;
-      }
+      return;
+    }
+  }
+  DEBUGLOG("Connection found");
+  quiche_recv_info recv_info = {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    reinterpret_cast<struct sockaddr*>(&client),
+    client.getSocklen(),
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    reinterpret_cast<struct sockaddr*>(&localAddr),
+    localAddr.getSocklen(),
+  };
 
-      if (token_len == 0) {
-        /* stateless retry */
-        DEBUGLOG("No token received");
-        handleStatelessRetry(sock, clientConnID, serverConnID, client, localAddr, version, buffer);
-        continue;
-      }
+  auto done = quiche_conn_recv(conn->get().d_conn.get(), buffer.data(), buffer.size(), &recv_info);
+  if (done < 0) {
+    return;
+  }
 
-      tokenBuf.assign(token.begin(), token.begin() + token_len);
-      auto originalDestinationID = validateToken(tokenBuf, client);
-      if (!originalDestinationID) {
-        ++frontend.d_doqInvalidTokensReceived;
-        DEBUGLOG("Discarding invalid token");
-        continue;
-      }
+  if (quiche_conn_is_established(conn->get().d_conn.get()) || quiche_conn_is_in_early_data(conn->get().d_conn.get())) {
+    auto readable = std::unique_ptr<quiche_stream_iter, decltype(&quiche_stream_iter_free)>(quiche_conn_readable(conn->get().d_conn.get()), quiche_stream_iter_free);
 
-      DEBUGLOG("Creating a new connection");
-      conn = createConnection(*frontend.d_server_config, serverConnID, *originalDestinationID, client, localAddr);
-      if (!conn) {
-        continue;
-      }
+    uint64_t streamID = 0;
+    while (quiche_stream_iter_next(readable.get(), &streamID)) {
+      handleReadableStream(dsc, clientState, *conn, streamID, client, serverConnID);
     }
-    DEBUGLOG("Connection found");
-    quiche_recv_info recv_info = {
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      reinterpret_cast<struct sockaddr*>(&client),
-      client.getSocklen(),
-      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-      reinterpret_cast<struct sockaddr*>(&localAddr),
-      localAddr.getSocklen(),
-    };
 
-    auto done = quiche_conn_recv(conn->get().d_conn.get(), buffer.data(), buffer.size(), &recv_info);
-    if (done < 0) {
-      continue;
+    flushEgress(sock, conn->get().d_conn, client, localAddr, buffer, frontend.d_datagramStats);
+  }
+  else {
+    DEBUGLOG("Connection not established");
+  }
+}
+
+static void handleSocketReadable(DOQFrontend& frontend, DOQServerConfig& dsc, ClientState& clientState, Socket& sock, DatagramReceiver& receiver, PacketBuffer& buffer)
+{
+  while (true) {
+    ComboAddress client;
+    ComboAddress localAddr;
+    if (!receiver.next(buffer, client, localAddr)) {
+      return;
+    }
+    if (localAddr.sin4.sin_family == 0) {
+      localAddr = clientState.local;
+    }
+    else {
+      /* we don't get the port, only the address */
+      localAddr.sin4.sin_port = clientState.local.sin4.sin_port;
     }
 
-    if (quiche_conn_is_established(conn->get().d_conn.get()) || quiche_conn_is_in_early_data(conn->get().d_conn.get())) {
-      auto readable = std::unique_ptr<quiche_stream_iter, decltype(&quiche_stream_iter_free)>(quiche_conn_readable(conn->get().d_conn.get()), quiche_stream_iter_free);
+    handleDatagram(frontend, dsc, clientState, sock, buffer, client, localAddr, false);
+  }
+}
 
-      uint64_t streamID = 0;
-      while (quiche_stream_iter_next(readable.get(), &streamID)) {
-        handleReadableStream(frontend, clientState, *conn, streamID, client, serverConnID);
+static void handleForwardedDatagrams(DOQFrontend& frontend, DOQServerConfig& dsc, ClientState& clientState, Socket& sock)
+{
+  for (;;) {
+    try {
+      auto tmp = dsc.d_datagramReceiver.receive();
+      if (!tmp) {
+        return;
       }
 
-      flushEgress(sock, conn->get().d_conn, client, localAddr, buffer);
+      auto datagram = std::move(*tmp);
+      handleDatagram(frontend, dsc, clientState, sock, datagram->d_payload, datagram->d_peer, datagram->d_localAddr, true);
     }
-    else {
-      DEBUGLOG("Connection not established");
+    catch (const std::exception& e) {
+      errlog("Error while processing a datagram passed by another DoQ worker: %s", e.what());
     }
   }
 }
 
 // this is the entrypoint from dnsdist.cc
-void doqThread(ClientState* clientState)
+void doqThread(ClientState* clientState, size_t workerIndex)
 {
   try {
     std::shared_ptr<DOQFrontend>& frontend = clientState->doqFrontend;
+    auto& dsc = *frontend->d_server_configs.at(workerIndex);
 
-    frontend->d_server_config->clientState = clientState;
-    frontend->d_server_config->df = clientState->doqFrontend;
+    dsc.clientState = clientState;
+    dsc.df = clientState->doqFrontend;
 
     setThreadName("dnsdist/doq");
 
-    Socket sock(clientState->udpFD);
+    Socket sock(frontend->d_workerSockets.empty() ? clientState->udpFD : frontend->d_workerSockets.at(workerIndex));
     sock.setNonBlocking();
+    DatagramReceiver receiver(sock, clientState->local.sin4.sin_family, frontend->d_datagramStats);
 
     auto mplexer = std::unique_ptr<FDMultiplexer>(FDMultiplexer::getMultiplexerSilent());
 
-    auto responseReceiverFD = frontend->d_server_config->d_responseReceiver.getDescriptor();
+    auto responseReceiverFD = dsc.d_responseReceiver.getDescriptor();
+    auto datagramReceiverFD = dsc.d_datagramReceiver.getDescriptor();
     mplexer->addReadFD(sock.getHandle(), [](int, FDMultiplexer::funcparam_t&) {});
     mplexer->addReadFD(responseReceiverFD, [](int, FDMultiplexer::funcparam_t&) {});
+    mplexer->addReadFD(datagramReceiverFD, [](int, FDMultiplexer::funcparam_t&) {});
     std::vector<int> readyFDs;
     PacketBuffer buffer(4096);
     while (true) {
@@ -801,17 +866,21 @@ void doqThread(ClientState* clientState)
 
       try {
         if (std::find(readyFDs.begin(), readyFDs.end(), sock.getHandle()) != readyFDs.end()) {
-          handleSocketReadable(*frontend, *clientState, sock, buffer);
+          handleSocketReadable(*frontend, dsc, *clientState, sock, receiver, buffer);
+        }
+
+        if (std::find(readyFDs.begin(), readyFDs.end(), datagramReceiverFD) != readyFDs.end()) {
+          handleForwardedDatagrams(*frontend, dsc, *clientState, sock);
         }
 
         if (std::find(readyFDs.begin(), readyFDs.end(), responseReceiverFD) != readyFDs.end()) {
-          flushResponses(frontend->d_server_config->d_responseReceiver);
+          flushResponses(dsc.d_responseReceiver);
         }
 
-        for (auto conn = frontend->d_server_config->d_connections.begin(); conn != frontend->d_server_config->d_connections.end();) {
+        for (auto conn = dsc.d_connections.begin(); conn != dsc.d_connections.end();) {
           quiche_conn_on_timeout(conn->second.d_conn.get());
 
-          flushEgress(sock, conn->second.d_conn, conn->second.d_peer, conn->second.d_localAddr, buffer);
+          flushEgress(sock, conn->second.d_conn, conn->second.d_peer, conn->second.d_localAddr, buffer, frontend->d_datagramStats);
 
           if (quiche_conn_is_closed(conn->second.d_conn.get())) {
 #ifdef DEBUGLOG_ENABLED
@@ -823,7 +892,7 @@ void doqThread(ClientState* clientState)
 
             DEBUGLOG("Connection (DoQ) closed, recv=" << stats.recv << " sent=" << stats.sent << " lost=" << stats.lost << " rtt=" << path_stats.rtt << "ns cwnd=" << path_stats.cwnd);
 #endif
-            conn = frontend->d_server_config->d_connections.erase(conn);
+            conn = dsc.d_connections.erase(conn);
           }
           else {
             flushStalledResponses(conn->second);
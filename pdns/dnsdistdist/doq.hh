@@ -22,6 +22,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "config.h"
 #include "channel.hh"
@@ -51,7 +52,11 @@ struct DOQFrontend
   void setup();
   void reloadCertificates();
 
-  std::unique_ptr<DOQServerConfig> d_server_config;
+  /* one per worker thread */
+  std::vector<std::unique_ptr<DOQServerConfig>> d_server_configs;
+  /* the UDP sockets of the worker threads, bound to the same address via SO_REUSEPORT */
+  std::vector<int> d_workerSockets;
+  size_t d_workers{1};
   dnsdist::doq::QuicheParams d_quicheParams;
   ComboAddress d_local;
 
@@ -67,6 +72,7 @@ struct DOQFrontend
   pdns::stat_t d_doqInvalidTokensReceived{0}; // Discarded received tokens
   pdns::stat_t d_validResponses{0}; // Valid responses sent
   pdns::stat_t d_errorResponses{0}; // Empty responses (no backend, drops, invalid queries, etc.)
+  dnsdist::doq::DatagramStats d_datagramStats;
 };
 
 struct DOQUnit
@@ -98,7 +104,7 @@ struct CrossProtocolQuery;
 struct DNSQuestion;
 std::unique_ptr<CrossProtocolQuery> getDOQCrossProtocolQueryFromDQ(DNSQuestion& dnsQuestion, bool isResponse);
 
-void doqThread(ClientState* clientState);
+void doqThread(ClientState* clientState, size_t workerIndex);
 
 #else
 
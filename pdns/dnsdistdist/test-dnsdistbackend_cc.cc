@@ -8,6 +8,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "dnsdist.hh"
+#include "dnsdist-rings.hh"
 
 BOOST_AUTO_TEST_SUITE(dnsdistbackend_cc)
 
@@ -217,6 +218,43 @@ BOOST_AUTO_TEST_CASE(test_Lazy)
   BOOST_CHECK_EQUAL(ds.healthCheckRequired(), false);
 }
 
+BOOST_AUTO_TEST_CASE(test_LazyManyResults)
+{
+  DownstreamState::Config config;
+  config.d_lazyHealthCheckSampleSize = 100;
+  config.d_lazyHealthCheckMinSampleCount = 10;
+  config.d_lazyHealthCheckThreshold = 20;
+  config.availability = DownstreamState::Availability::Lazy;
+  /* prevents a re-connection */
+  config.remote = ComboAddress("0.0.0.0");
+
+  DownstreamState ds(std::move(config), nullptr, false);
+  BOOST_CHECK_EQUAL(ds.healthCheckRequired(), false);
+
+  /* many more results than the sample size between two checks, with 10% of failures:
+     the ones that are kept should have the same proportion of failures */
+  for (size_t idx = 0; idx < 1000; idx++) {
+    if (idx % 10 == 0) {
+      ds.reportTimeoutOrError();
+    }
+    else {
+      ds.reportResponse(RCode::NoError);
+    }
+  }
+  BOOST_CHECK_EQUAL(ds.healthCheckRequired(), false);
+
+  /* and now 25% of failures, still more results than the sample size */
+  for (size_t idx = 0; idx < 200; idx++) {
+    if (idx % 4 == 0) {
+      ds.reportResponse(RCode::ServFail);
+    }
+    else {
+      ds.reportResponse(RCode::NoError);
+    }
+  }
+  BOOST_CHECK_EQUAL(ds.healthCheckRequired(), true);
+}
+
 BOOST_AUTO_TEST_CASE(test_LazyExponentialBackOff)
 {
   DownstreamState::Config config;
@@ -291,4 +329,120 @@ BOOST_AUTO_TEST_CASE(test_LazyExponentialBackOff)
   BOOST_CHECK_EQUAL(ds.healthCheckRequired(), false);
 }
 
+BOOST_AUTO_TEST_CASE(test_IDStateTable)
+{
+  IDStateTable table;
+  BOOST_CHECK_EQUAL(table.size(), 0U);
+  BOOST_CHECK_THROW(table.resize(IDStateTable::s_maxSize + 1), std::runtime_error);
+
+  table.resize(130);
+  BOOST_CHECK_EQUAL(table.size(), 130U);
+
+  std::vector<uint16_t> visited;
+  auto visitor = [&visited](uint16_t id, IDState& ids) {
+    BOOST_CHECK(ids.isInUse());
+    visited.push_back(id);
+  };
+  table.visitInUse(visitor);
+  BOOST_CHECK(visited.empty());
+
+  for (const uint16_t id : {129, 0, 63, 64}) {
+    table.setInUse(id, true);
+  }
+  table.visitInUse(visitor);
+  BOOST_CHECK((visited == std::vector<uint16_t>{0, 63, 64, 129}));
+
+  visited.clear();
+  table.setInUse(63, false);
+  BOOST_CHECK(!table[63].isInUse());
+  table.visitInUse(visitor);
+  BOOST_CHECK((visited == std::vector<uint16_t>{0, 64, 129}));
+}
+
+BOOST_AUTO_TEST_CASE(test_SaveAndGetStates)
+{
+  /* smaller than the 16-bit space, so that several randomized IDs map onto the same state */
+  const auto maxOutstanding = g_maxOutstanding;
+  g_maxOutstanding = 16384;
+  for (const bool randomized : {false, true}) {
+    DownstreamState::s_randomizeIDs = randomized;
+    DownstreamState::Config config;
+    config.remote = ComboAddress("192.0.2.1:53");
+    DownstreamState ds(std::move(config), nullptr, true);
+    BOOST_CHECK_EQUAL(ds.getIDStatesCapacity(), g_maxOutstanding);
+
+    std::map<uint16_t, DNSName> saved;
+    for (size_t idx = 0; idx < 1000; idx++) {
+      InternalQueryState ids;
+      ids.qname = DNSName("name-" + std::to_string(idx) + ".powerdns.com.");
+      auto qname = ids.qname;
+      auto id = ds.saveState(std::move(ids));
+      saved[id] = qname;
+    }
+    BOOST_CHECK_EQUAL(ds.outstanding.load(), saved.size());
+    if (!randomized) {
+      BOOST_CHECK_EQUAL(ds.idStateCollisions.load(), 0U);
+    }
+
+    for (const auto& [id, qname] : saved) {
+      auto ids = ds.getState(id);
+      BOOST_REQUIRE(ids);
+      BOOST_CHECK_EQUAL(ids->qname, qname);
+      /* the state has been released */
+      BOOST_CHECK(!ds.getState(id));
+    }
+    BOOST_CHECK_EQUAL(ds.outstanding.load(), 0U);
+
+    /* out of range */
+    if (!randomized) {
+      BOOST_CHECK(!ds.getState(g_maxOutstanding));
+      const auto reuseds = ds.reuseds.load();
+      InternalQueryState outOfRange;
+      ds.restoreState(g_maxOutstanding, std::move(outOfRange));
+      BOOST_CHECK_EQUAL(ds.reuseds.load(), reuseds + 1);
+      BOOST_CHECK_EQUAL(ds.outstanding.load(), 0U);
+    }
+
+    /* restoring a state makes it available again */
+    InternalQueryState ids;
+    ids.qname = DNSName("restored.powerdns.com.");
+    ds.restoreState(42, std::move(ids));
+    BOOST_CHECK_EQUAL(ds.outstanding.load(), 1U);
+    if (randomized) {
+      /* another ID mapped onto the same state is not a match */
+      BOOST_CHECK(!ds.getState(static_cast<uint16_t>(42 + ds.getIDStatesCapacity())));
+    }
+    auto restored = ds.getState(42);
+    BOOST_REQUIRE(restored);
+    BOOST_CHECK_EQUAL(restored->qname, DNSName("restored.powerdns.com."));
+  }
+  DownstreamState::s_randomizeIDs = false;
+  g_maxOutstanding = maxOutstanding;
+}
+
+BOOST_AUTO_TEST_CASE(test_UDPTimeouts)
+{
+  /* the rings are not initialized */
+  g_rings.setRecordResponses(false);
+  DownstreamState::Config config;
+  config.remote = ComboAddress("192.0.2.1:53");
+  DownstreamState ds(std::move(config), nullptr, true);
+
+  InternalQueryState ids;
+  ids.qname = DNSName("timeout.powerdns.com.");
+  auto id = ds.saveState(std::move(ids));
+  BOOST_CHECK_EQUAL(ds.outstanding.load(), 1U);
+
+  /* the state gets older every time we check, until it has been there for longer than the UDP timeout */
+  for (int idx = 0; idx <= DownstreamState::s_udpTimeout; idx++) {
+    ds.handleUDPTimeouts();
+    BOOST_CHECK_EQUAL(ds.outstanding.load(), 1U);
+  }
+  ds.handleUDPTimeouts();
+  BOOST_CHECK_EQUAL(ds.outstanding.load(), 0U);
+  BOOST_CHECK_EQUAL(ds.reuseds.load(), 1U);
+  BOOST_CHECK(!ds.getState(id));
+  g_rings.setRecordResponses(true);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #define BOOST_TEST_NO_MAIN
 
 #include <boost/test/unit_test.hpp>
+#include <random>
 
 #include "dnsdist.hh"
 #include "dnsdist-dynblocks.hh"
@@ -171,6 +172,420 @@ BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_QueryRate, TestFixture) {
   }
 }
 
+BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_QueryRate_Incremental, TestFixture) {
+  dnsheader dnsHeader{};
+  memset(&dnsHeader, 0, sizeof(dnsHeader));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  ComboAddress requestor2("192.0.2.2");
+  ComboAddress backend("192.0.2.42");
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  dnsdist::Protocol outgoingProtocol = dnsdist::Protocol::DoUDP;
+  unsigned int responseTime = 0;
+  struct timespec now;
+  gettime(&now);
+  NetmaskTree<DynBlock, AddressAndPortRange> emptyNMG;
+
+  size_t numberOfSeconds = 10;
+  size_t blockDuration = 60;
+  const auto action = DNSAction::Action::Drop;
+  const std::string reason = "Exceeded query rate";
+
+  DynBlockRulesGroup dbrg;
+  dbrg.setQuiet(true);
+
+  {
+    /* block above 50 qps for numberOfSeconds seconds, no warning */
+    DynBlockRulesGroup::DynBlockRule rule(reason, blockDuration, 50, 0, numberOfSeconds, action);
+    dbrg.setQueryRate(std::move(rule));
+  }
+
+  BOOST_CHECK_THROW(dbrg.enableIncrementalEvaluation(g_rings, 0), std::runtime_error);
+  dbrg.enableIncrementalEvaluation(g_rings);
+  BOOST_CHECK_THROW(dbrg.enableIncrementalEvaluation(g_rings), std::runtime_error);
+  BOOST_REQUIRE(dbrg.isIncremental());
+  const auto& counters = dbrg.getIncrementalCounters();
+  BOOST_CHECK_EQUAL(counters->getWindow(), numberOfSeconds);
+
+  {
+    /* insert 45 qps from a given client in the last 10s
+       this should not trigger the rule, nor make the client a candidate */
+    size_t numberOfQueries = 45 * numberOfSeconds;
+    g_rings.clear();
+    g_dynblockNMG.setState(emptyNMG);
+
+    for (size_t idx = 0; idx < numberOfQueries; idx++) {
+      g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+      g_rings.insertResponse(now, requestor1, qname, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+    }
+    /* nothing is done until the rules are applied */
+    BOOST_CHECK_EQUAL(counters->getClientsCount(), 0U);
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(counters->getClientsCount(), 1U);
+    BOOST_CHECK_EQUAL(counters->getCandidatesCount(), 0U);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+    BOOST_CHECK(g_dynblockNMG.getLocal()->lookup(requestor1) == nullptr);
+  }
+
+  {
+    /* insert just above 50 qps from a given client in the last 10s
+       this should trigger the rule this time */
+    size_t numberOfQueries = (50 * numberOfSeconds) + 1;
+    g_rings.clear();
+    g_dynblockNMG.setState(emptyNMG);
+
+    for (size_t idx = 0; idx < numberOfQueries; idx++) {
+      g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+      g_rings.insertResponse(now, requestor1, qname, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+    }
+    /* and a single query from a second client, which should not be a candidate */
+    g_rings.insertQuery(now, requestor2, qname, qtype, size, dnsHeader, protocol);
+
+    dbrg.apply(now);
+    /* the entries removed from the rings by clear() are gone */
+    BOOST_CHECK_EQUAL(counters->getClientsCount(), 2U);
+    BOOST_CHECK_EQUAL(counters->getCandidatesCount(), 1U);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 1U);
+    BOOST_CHECK(g_dynblockNMG.getLocal()->lookup(requestor1) != nullptr);
+    BOOST_CHECK(g_dynblockNMG.getLocal()->lookup(requestor2) == nullptr);
+    const auto& block = g_dynblockNMG.getLocal()->lookup(requestor1)->second;
+    BOOST_CHECK_EQUAL(block.reason, reason);
+    BOOST_CHECK_EQUAL(static_cast<size_t>(block.until.tv_sec), now.tv_sec + blockDuration);
+    BOOST_CHECK(block.action == action);
+    BOOST_CHECK_EQUAL(block.warning, false);
+  }
+
+  {
+    /* clear the rings and dynamic blocks */
+    g_rings.clear();
+    g_dynblockNMG.setState(emptyNMG);
+
+    /* Insert 100 qps from a given client in the last 10s
+       this should trigger the rule */
+    size_t numberOfQueries = 100;
+
+    for (size_t timeIdx = 0; timeIdx < numberOfSeconds; timeIdx++) {
+      for (size_t idx = 0; idx < numberOfQueries; idx++) {
+        struct timespec when = now;
+        when.tv_sec -= (9 - timeIdx);
+        g_rings.insertQuery(when, requestor1, qname, qtype, size, dnsHeader, protocol);
+        g_rings.insertResponse(when, requestor1, qname, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+      }
+    }
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 1U);
+
+    /* same sequence as the ring-based test above, 20s, 5s then 6s in the future */
+    g_dynblockNMG.setState(emptyNMG);
+    struct timespec later = now;
+    later.tv_sec += 20;
+    dbrg.apply(later);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+
+    g_dynblockNMG.setState(emptyNMG);
+    later = now;
+    later.tv_sec += 5;
+    dbrg.apply(later);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 1U);
+
+    g_dynblockNMG.setState(emptyNMG);
+    later = now;
+    later.tv_sec += 6;
+    dbrg.apply(later);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+  }
+
+  {
+    /* entries older than the window are forgotten once a newer entry has been seen */
+    g_rings.reset();
+    g_rings.init();
+    g_dynblockNMG.setState(emptyNMG);
+    struct timespec old = now;
+    old.tv_sec -= 2 * numberOfSeconds;
+    for (size_t idx = 0; idx < 1000; idx++) {
+      g_rings.insertQuery(old, requestor1, qname, qtype, size, dnsHeader, protocol);
+    }
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+    BOOST_CHECK_EQUAL(counters->getCandidatesCount(), 1U);
+
+    g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+    BOOST_CHECK_EQUAL(counters->getClientsCount(), 1U);
+    BOOST_CHECK_EQUAL(counters->getCandidatesCount(), 0U);
+  }
+
+  {
+    /* entries that are no longer in the rings are forgotten as well */
+    g_rings.reset();
+    g_rings.setCapacity(100, 1);
+    g_rings.init();
+    g_dynblockNMG.setState(emptyNMG);
+    for (size_t idx = 0; idx < 1000; idx++) {
+      g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+    }
+    g_rings.insertQuery(now, requestor2, qname, qtype, size, dnsHeader, protocol);
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+    BOOST_CHECK_EQUAL(counters->getClientsCount(), 2U);
+    BOOST_CHECK_EQUAL(counters->getCandidatesCount(), 0U);
+    g_rings.reset();
+    g_rings.setCapacity(10000, 10);
+  }
+}
+
+static std::set<std::string> getDynamicBlocksSnapshot()
+{
+  std::set<std::string> result;
+  for (const auto& entry : *g_dynblockNMG.getLocal()) {
+    result.insert(entry.first.toString() + " " + entry.second.reason + " " + std::to_string(entry.second.warning) + " " + std::to_string(entry.second.until.tv_sec));
+  }
+  g_dynblockSMT.getLocal()->visit([&result](const SuffixMatchTree<DynBlock>& node) {
+    result.insert(node.d_value.domain.toString() + " " + node.d_value.reason + " " + std::to_string(node.d_value.until.tv_sec));
+  });
+  return result;
+}
+
+BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_Incremental_SameAsRings, TestFixture) {
+  /* check that the incremental evaluation yields the same blocks than the ring-based one on the same traffic,
+     with sub-second timestamps, in both ring modes, and whether entries get evicted from the rings or not */
+  dnsheader dnsHeader{};
+  memset(&dnsHeader, 0, sizeof(dnsHeader));
+  ComboAddress backend("192.0.2.42");
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  dnsdist::Protocol outgoingProtocol = dnsdist::Protocol::DoUDP;
+  struct timespec now;
+  gettime(&now);
+  NetmaskTree<DynBlock, AddressAndPortRange> emptyNMG;
+  SuffixMatchTree<DynBlock> emptySMT;
+  const unsigned int numberOfSeconds = 10;
+  const unsigned int blockDuration = 60;
+  const auto action = DNSAction::Action::Drop;
+
+  auto setRules = [](DynBlockRulesGroup& group) {
+    group.setQuiet(true);
+    group.setQueryRate(DynBlockRulesGroup::DynBlockRule("query rate", blockDuration, 50, 20, numberOfSeconds, action));
+    group.setQTypeRate(QType::ANY, DynBlockRulesGroup::DynBlockRule("qtype rate", blockDuration, 5, 0, 5, action));
+    group.setRCodeRate(RCode::ServFail, DynBlockRulesGroup::DynBlockRule("rcode rate", blockDuration, 10, 0, numberOfSeconds, action));
+    group.setRCodeRatio(RCode::NXDomain, DynBlockRulesGroup::DynBlockRatioRule("rcode ratio", blockDuration, 0.5, 0.0, numberOfSeconds, action, 20));
+    group.setResponseByteRate(DynBlockRulesGroup::DynBlockRule("response byte rate", blockDuration, 5000, 0, numberOfSeconds, action));
+    group.setSuffixMatchRule(DynBlockRulesGroup::DynBlockRule("suffix", blockDuration, 0, 0, numberOfSeconds, action), [](const StatNode& node, const StatNode::Stat& self, const StatNode::Stat& children) {
+      if (self.servfails > 20) {
+        return std::tuple<bool, boost::optional<std::string>, boost::optional<int>>(true, boost::none, boost::none);
+      }
+      return std::tuple<bool, boost::optional<std::string>, boost::optional<int>>(false, boost::none, boost::none);
+    });
+  };
+
+  /* capacity of the rings, lock-free mode. The smaller capacity only holds a few seconds of traffic */
+  const std::vector<std::pair<size_t, bool>> configurations{{100000, false}, {100000, true}, {8000, false}, {8000, true}};
+  for (const auto& [capacity, lockFree] : configurations) {
+    DynBlockRulesGroup ringBased;
+    setRules(ringBased);
+    DynBlockRulesGroup incremental;
+    setRules(incremental);
+
+    g_rings.reset();
+    g_rings.setCapacity(capacity, 2);
+    g_rings.setLockFree(lockFree);
+    g_rings.init();
+    incremental.enableIncrementalEvaluation(g_rings);
+
+    bool sawBlocks = false;
+    const auto compare = [&](const struct timespec& applyTime) {
+      g_dynblockNMG.setState(emptyNMG);
+      g_dynblockSMT.setState(emptySMT);
+      ringBased.apply(applyTime);
+      const auto expected = getDynamicBlocksSnapshot();
+
+      g_dynblockNMG.setState(emptyNMG);
+      g_dynblockSMT.setState(emptySMT);
+      incremental.apply(applyTime);
+      const auto got = getDynamicBlocksSnapshot();
+
+      sawBlocks = sawBlocks || !expected.empty();
+      BOOST_CHECK_EQUAL_COLLECTIONS(got.begin(), got.end(), expected.begin(), expected.end());
+    };
+
+    /* a mix of regular clients, and clients hitting each of the rules, spread over 15s */
+    std::mt19937 gen(42);
+    size_t inserted = 0;
+    for (unsigned int second = 0; second < 15; second++) {
+      struct timespec when = now;
+      when.tv_sec -= (14 - second);
+      for (unsigned int clientIdx = 0; clientIdx < 50; clientIdx++) {
+        const ComboAddress requestor("192.0.2." + std::to_string(clientIdx));
+        const auto profile = clientIdx % 8;
+        const auto queries = (profile == 0 ? 60 : 0) + gen() % 40;
+        for (unsigned int idx = 0; idx < queries; idx++) {
+          const DNSName qname(std::to_string(gen() % 4) + ".victim" + std::to_string(gen() % 2) + ".powerdns.com.");
+          uint16_t qtype = (profile == 1 && gen() % 4 == 0) ? QType::ANY : QType::A;
+          dnsHeader.rcode = RCode::NoError;
+          if (profile == 2 && gen() % 2 == 0) {
+            dnsHeader.rcode = RCode::ServFail;
+          }
+          else if (profile == 3 && gen() % 2 == 0) {
+            dnsHeader.rcode = RCode::NXDomain;
+          }
+          const uint16_t responseSize = profile == 4 ? 1500 : size;
+          when.tv_nsec = static_cast<long>(gen() % 1000000000);
+          g_rings.insertQuery(when, requestor, qname, qtype, size, dnsHeader, protocol);
+          g_rings.insertResponse(when, requestor, qname, qtype, 1000, responseSize, dnsHeader, backend, outgoingProtocol);
+          inserted++;
+        }
+      }
+
+      /* apply the rules while the traffic is flowing, so the incremental evaluation only fetches the new entries */
+      struct timespec applyTime = when;
+      applyTime.tv_nsec = 999999999;
+      compare(applyTime);
+    }
+
+    if (capacity > 50000) {
+      /* nothing should have been evicted from the rings */
+      BOOST_CHECK_EQUAL(g_rings.getNumberOfQueryEntries(), inserted);
+    }
+    else {
+      BOOST_CHECK_GT(inserted, capacity);
+    }
+
+    for (const auto offset : {1, 3, 7, 12}) {
+      /* the cut-off falls in the middle of a second. Note that the time of the maintenance
+         thread does not go backward, and neither does the one we apply the rules at */
+      struct timespec applyTime = now;
+      applyTime.tv_sec += offset;
+      applyTime.tv_nsec = 500000000;
+      compare(applyTime);
+    }
+    BOOST_CHECK(sawBlocks);
+  }
+  g_dynblockNMG.setState(emptyNMG);
+  g_dynblockSMT.setState(emptySMT);
+  g_rings.reset();
+  g_rings.setLockFree(false);
+
+#ifdef BENCH_DYNBLOCKS
+  {
+    /* 1M queries from 500k clients, only 10 of them above the threshold */
+    DynBlockRulesGroup ringBasedBench;
+    ringBasedBench.setQuiet(true);
+    ringBasedBench.setQueryRate(DynBlockRulesGroup::DynBlockRule("query rate", blockDuration, 50, 0, numberOfSeconds, action));
+    DynBlockRulesGroup incrementalBench;
+    incrementalBench.setQuiet(true);
+    incrementalBench.setQueryRate(DynBlockRulesGroup::DynBlockRule("query rate", blockDuration, 50, 0, numberOfSeconds, action));
+
+    g_rings.reset();
+    g_rings.setCapacity(1000000, 1);
+    incrementalBench.enableIncrementalEvaluation(g_rings);
+    g_rings.init();
+
+    const DNSName qname("rings.powerdns.com.");
+    StopWatch sw;
+    sw.start();
+    for (size_t idx = 0; idx < 990000; idx++) {
+      const ComboAddress requestor("10." + std::to_string((idx / 2) / 65536) + "." + std::to_string(((idx / 2) / 256) % 256) + "." + std::to_string((idx / 2) % 256));
+      g_rings.insertQuery(now, requestor, qname, QType::A, size, dnsHeader, protocol);
+    }
+    for (size_t idx = 0; idx < 10000; idx++) {
+      const ComboAddress requestor("192.0.2." + std::to_string(idx % 10));
+      g_rings.insertQuery(now, requestor, qname, QType::A, size, dnsHeader, protocol);
+    }
+    cerr<<"inserted 1000000 queries in "<<std::to_string(sw.udiff()/1000)<<"ms"<<endl;
+
+    sw.start();
+    ringBasedBench.apply(now);
+    cerr<<"ring-based evaluation took "<<std::to_string(sw.udiff())<<"us"<<endl;
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 10U);
+    g_dynblockNMG.setState(emptyNMG);
+
+    sw.start();
+    incrementalBench.apply(now);
+    cerr<<"incremental evaluation, fetching all the entries, took "<<std::to_string(sw.udiff())<<"us"<<endl;
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 10U);
+    g_dynblockNMG.setState(emptyNMG);
+
+    for (size_t idx = 0; idx < 10000; idx++) {
+      const ComboAddress requestor("192.0.2." + std::to_string(idx % 10));
+      g_rings.insertQuery(now, requestor, qname, QType::A, size, dnsHeader, protocol);
+    }
+    sw.start();
+    incrementalBench.apply(now);
+    cerr<<"incremental evaluation, fetching 10000 new entries, took "<<std::to_string(sw.udiff())<<"us"<<endl;
+    BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 10U);
+    g_dynblockNMG.setState(emptyNMG);
+  }
+#endif
+}
+
+BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_HeavyHitters, TestFixture) {
+  dnsheader dnsHeader{};
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  ComboAddress requestor2("192.0.2.2");
+  ComboAddress requestor3("192.0.2.3");
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  struct timespec now;
+  gettime(&now);
+  NetmaskTree<DynBlock, AddressAndPortRange> emptyNMG;
+  g_dynblockNMG.setState(emptyNMG);
+
+  const unsigned int window = 10;
+  const unsigned int blockDuration = 60;
+  const std::string reason = "Heavy hitter";
+
+  dnsdist::sketches::HeavyHittersTracker::Options options;
+  options.d_window = window;
+  auto tracker = std::make_shared<dnsdist::sketches::HeavyHittersTracker>(options);
+  g_rings.reset();
+  g_rings.addObserver(tracker);
+  g_rings.init();
+
+  DynBlockRulesGroup dbrg;
+  dbrg.setQuiet(true);
+  BOOST_CHECK_THROW(dbrg.setHeavyHittersRate(nullptr, DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 100, 0, 0, DNSAction::Action::Drop)), std::runtime_error);
+  /* block above 100 qps, warning above 50 qps, over the window of the tracker */
+  dbrg.setHeavyHittersRate(tracker, DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 100, 50, 0, DNSAction::Action::Drop));
+
+  for (size_t idx = 0; idx < (100 * window) + 1; idx++) {
+    g_rings.insertQuery(now, requestor1, qname, QType::A, 42, dnsHeader, protocol);
+  }
+  for (size_t idx = 0; idx < (50 * window) + 1; idx++) {
+    g_rings.insertQuery(now, requestor2, qname, QType::A, 42, dnsHeader, protocol);
+  }
+  for (size_t idx = 0; idx < 100 * window; idx++) {
+    g_rings.insertQuery(now, requestor3, qname, QType::A, 42, dnsHeader, protocol);
+  }
+  /* the tracker does not care about the content of the rings */
+  g_rings.clear();
+
+  dbrg.apply(now);
+  BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 3U);
+  const auto* block = g_dynblockNMG.getLocal()->lookup(requestor1);
+  BOOST_REQUIRE(block != nullptr);
+  BOOST_CHECK_EQUAL(block->second.reason, reason);
+  BOOST_CHECK_EQUAL(block->second.warning, false);
+  block = g_dynblockNMG.getLocal()->lookup(requestor2);
+  BOOST_REQUIRE(block != nullptr);
+  BOOST_CHECK_EQUAL(block->second.warning, true);
+  /* exactly at the limit, warning only */
+  block = g_dynblockNMG.getLocal()->lookup(requestor3);
+  BOOST_REQUIRE(block != nullptr);
+  BOOST_CHECK_EQUAL(block->second.warning, true);
+  g_dynblockNMG.setState(emptyNMG);
+
+  /* two windows later, nothing should be left */
+  struct timespec later = now;
+  later.tv_sec += 2 * window;
+  dbrg.apply(later);
+  BOOST_CHECK_EQUAL(g_dynblockNMG.getLocal()->size(), 0U);
+}
+
 BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_QueryRate_RangeV6, TestFixture) {
   /* Check that we correctly group IPv6 addresses from the same /64 subnet into the same
      dynamic block entry, if instructed to do so */
@@ -5,6 +5,9 @@
 
 #define BOOST_TEST_NO_MAIN
 
+#include <numeric>
+#include <queue>
+#include <random>
 #include <boost/test/unit_test.hpp>
 
 #include "dnsdist.hh"
@@ -21,7 +24,7 @@ bool g_snmpEnabled{false};
 bool g_snmpTrapsEnabled{false};
 std::unique_ptr<DNSDistSNMPAgent> g_snmpAgent{nullptr};
 
-#if BENCH_POLICIES
+#ifdef BENCH_POLICIES
 bool g_verbose{true};
 #include "dnsdist-rings.hh"
 Rings g_rings;
@@ -101,7 +104,7 @@ static DNSQuestion getDQ(const DNSName* providedName = nullptr)
 
 static void benchPolicy(const ServerPolicy& pol)
 {
-#if BENCH_POLICIES
+#ifdef BENCH_POLICIES
   bool existingVerboseValue = g_verbose;
   g_verbose = false;
 
@@ -552,6 +555,341 @@ BOOST_AUTO_TEST_CASE(test_chashed)
   g_verbose = existingVerboseValue;
 }
 
+/* the straightforward implementation of the consistent hashing with bounded loads algorithm,
+   looking up the closest point of every server, to check that the lookup table gives the same results */
+static std::shared_ptr<DownstreamState> chashedReference(const ServerPolicy::NumberedServerVector& servers, size_t qhash)
+{
+  unsigned int sel = std::numeric_limits<unsigned int>::max();
+  unsigned int min = std::numeric_limits<unsigned int>::max();
+  std::shared_ptr<DownstreamState> ret{nullptr};
+  std::shared_ptr<DownstreamState> first{nullptr};
+
+  double targetLoad = std::numeric_limits<double>::max();
+  if (g_consistentHashBalancingFactor > 0) {
+    double currentLoad = 1;
+    size_t totalWeight = 0;
+    for (const auto& pair : servers) {
+      if (pair.second->isUp()) {
+        currentLoad += pair.second->outstanding;
+        totalWeight += pair.second->d_config.d_weight;
+      }
+    }
+    if (totalWeight > 0) {
+      targetLoad = (currentLoad / totalWeight) * g_consistentHashBalancingFactor;
+    }
+  }
+
+  for (const auto& pair : servers) {
+    const auto& server = pair.second;
+    if (!server->isUp() || (g_consistentHashBalancingFactor > 0 && server->outstanding > (targetLoad * server->d_config.d_weight))) {
+      continue;
+    }
+    auto hashes = server->hashes.read_lock();
+    if (min > *(hashes->begin())) {
+      min = *(hashes->begin());
+      first = server;
+    }
+    auto hashIt = std::lower_bound(hashes->begin(), hashes->end(), qhash);
+    if (hashIt != hashes->end() && *hashIt < sel) {
+      sel = *hashIt;
+      ret = server;
+    }
+  }
+  return ret != nullptr ? ret : first;
+}
+
+BOOST_AUTO_TEST_CASE(test_chashed_LookupTable)
+{
+  bool existingVerboseValue = g_verbose;
+  g_verbose = false;
+  const auto existingBalancingFactor = g_consistentHashBalancingFactor;
+
+  ServerPolicy::NumberedServerVector servers;
+  for (size_t idx = 1; idx <= 10; idx++) {
+    servers.emplace_back(idx, std::make_shared<DownstreamState>(ComboAddress("192.0.2." + std::to_string(idx) + ":53")));
+    servers.at(idx - 1).second->setUp();
+    servers.at(idx - 1).second->setWeight(100 * idx);
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<uint32_t> hashes;
+  const auto checkAgainstReference = [&servers, &gen, &hashes]() {
+    for (size_t idx = 0; idx < 10000; idx++) {
+      const auto qhash = hashes(gen);
+      BOOST_REQUIRE(chashedFromHash(servers, qhash) == chashedReference(servers, qhash));
+    }
+    /* edge cases, including a hash larger than all the points */
+    for (const size_t qhash : {size_t(0), size_t(std::numeric_limits<uint32_t>::max()), size_t(std::numeric_limits<uint32_t>::max()) + 1}) {
+      BOOST_REQUIRE(chashedFromHash(servers, qhash) == chashedReference(servers, qhash));
+    }
+  };
+
+  checkAgainstReference();
+
+  /* some servers are down */
+  servers.at(0).second->setDown();
+  servers.at(5).second->setDown();
+  checkAgainstReference();
+
+  /* the weight of a server changes, the table has to be rebuilt */
+  servers.at(3).second->setWeight(5000);
+  checkAgainstReference();
+
+  /* a server is added to the vector, same thing */
+  servers.emplace_back(11, std::make_shared<DownstreamState>(ComboAddress("192.0.2.11:53")));
+  servers.at(10).second->setUp();
+  servers.at(10).second->setWeight(1000);
+  checkAgainstReference();
+
+  /* bounded-load, with some servers having a lot of queries in the air */
+  g_consistentHashBalancingFactor = 1.25;
+  servers.at(1).second->outstanding = 1000;
+  servers.at(3).second->outstanding = 500;
+  servers.at(7).second->outstanding = 200;
+  checkAgainstReference();
+
+  /* no server is up */
+  for (auto& server : servers) {
+    server.second->setDown();
+  }
+  BOOST_CHECK(chashedFromHash(servers, 42) == nullptr);
+
+  for (auto& server : servers) {
+    server.second->outstanding = 0;
+  }
+  g_consistentHashBalancingFactor = existingBalancingFactor;
+  g_verbose = existingVerboseValue;
+}
+
+BOOST_AUTO_TEST_CASE(test_PeakEWMA)
+{
+  dnsdist::PeakEWMA ewma;
+  const int64_t now = 1000000;
+  BOOST_CHECK_EQUAL(ewma.get(now), 0.0);
+
+  ewma.submit(1000.0, now);
+  BOOST_CHECK_EQUAL(ewma.get(now), 1000.0);
+
+  /* a slower response is taken into account at once */
+  ewma.submit(5000.0, now + 1);
+  BOOST_CHECK_EQUAL(ewma.get(now + 1), 5000.0);
+
+  /* a faster one only gradually */
+  ewma.submit(1000.0, now + 2);
+  BOOST_CHECK_GT(ewma.get(now + 2), 4900.0);
+  BOOST_CHECK_LT(ewma.get(now + 2), 5000.0);
+
+  /* and the value decays with time */
+  const auto decay = static_cast<int64_t>(dnsdist::PeakEWMA::getDecayTime());
+  const auto value = ewma.get(now + 2);
+  BOOST_CHECK_CLOSE(ewma.get(now + 2 + decay), value / M_E, 0.01);
+  ewma.submit(1000.0, now + 2 + 10 * decay);
+  BOOST_CHECK_CLOSE(ewma.get(now + 2 + 10 * decay), 1000.0, 1.0);
+
+  /* but not below a hundredth of its value, even after a very long time */
+  ewma.submit(1000.0, now);
+  BOOST_CHECK_CLOSE(ewma.get(now + 10 * decay), 10.0, 0.01);
+  BOOST_CHECK_CLOSE(ewma.get(now + 1000 * decay), 10.0, 0.01);
+
+  ewma.reset();
+  BOOST_CHECK_EQUAL(ewma.get(now), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_p2cPeakEWMA)
+{
+  auto dnsQuestion = getDQ();
+
+  ServerPolicy pol{"p2cPeakEWMA", p2cPeakEWMA, false};
+  ServerPolicy::NumberedServerVector servers;
+  servers.emplace_back(1, std::make_shared<DownstreamState>(ComboAddress("192.0.2.1:53")));
+
+  /* servers start as 'down' */
+  auto server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == nullptr);
+
+  /* mark the server as 'up' */
+  servers.at(0).second->setUp();
+  server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == servers.at(0).second);
+
+  /* with two servers, both are always considered */
+  servers.emplace_back(2, std::make_shared<DownstreamState>(ComboAddress("192.0.2.2:53")));
+  servers.at(1).second->setUp();
+  servers.at(0).second->latencyPeakEWMA.submit(10000.0);
+  servers.at(1).second->latencyPeakEWMA.submit(1000.0);
+  for (size_t idx = 0; idx < 100; idx++) {
+    server = pol.getSelectedBackend(servers, dnsQuestion);
+    BOOST_CHECK(server == servers.at(1).second);
+  }
+
+  /* unless the fastest one has too many queries in the air */
+  servers.at(1).second->outstanding = 20;
+  for (size_t idx = 0; idx < 100; idx++) {
+    server = pol.getSelectedBackend(servers, dnsQuestion);
+    BOOST_CHECK(server == servers.at(0).second);
+  }
+
+  /* a server without any response yet is fine when idle, not when it has queries in the air */
+  servers.at(1).second->outstanding = 0;
+  servers.at(1).second->latencyPeakEWMA.reset();
+  server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == servers.at(1).second);
+  servers.at(1).second->outstanding = 1;
+  server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == servers.at(0).second);
+  servers.at(1).second->outstanding = 0;
+
+  /* a timeout counts as a very slow response */
+  servers.at(1).second->latencyPeakEWMA.submit(1000.0);
+  servers.at(1).second->reportTimeoutOrError();
+  server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == servers.at(0).second);
+
+  /* a slow server that has been idle for a very long time does not look faster than a fast one */
+  const auto longAgo = dnsdist::PeakEWMA::getNowUsec() - 1000 * static_cast<int64_t>(dnsdist::PeakEWMA::getDecayTime());
+  servers.at(0).second->latencyPeakEWMA.reset();
+  servers.at(0).second->latencyPeakEWMA.submit(100000.0, longAgo);
+  servers.at(1).second->latencyPeakEWMA.reset();
+  servers.at(1).second->latencyPeakEWMA.submit(100.0);
+  for (size_t idx = 0; idx < 100; idx++) {
+    server = pol.getSelectedBackend(servers, dnsQuestion);
+    BOOST_CHECK(server == servers.at(1).second);
+  }
+
+  /* and a server marked down is forgotten */
+  servers.at(0).second->setDown();
+  server = pol.getSelectedBackend(servers, dnsQuestion);
+  BOOST_CHECK(server == servers.at(1).second);
+  BOOST_CHECK_EQUAL(servers.at(0).second->latencyPeakEWMA.get(dnsdist::PeakEWMA::getNowUsec()), 0.0);
+
+  benchPolicy(pol);
+}
+
+using SimulationSelector = std::function<std::shared_ptr<DownstreamState>(const ServerPolicy::NumberedServerVector&, int64_t)>;
+
+struct SimulationResult
+{
+  double d_shareToSlowest{0.0};
+  double d_meanLatencyUsec{0.0};
+  double d_p99LatencyUsec{0.0};
+};
+
+/* discrete-event simulation of a pool of backends with skewed latencies: queries arrive at a
+   fixed rate, and the backend selected by the policy answers after its own latency plus some
+   jitter. If latenciesAfterHalfUsec is not empty, the latencies change half-way through */
+static SimulationResult simulatePolicy(const SimulationSelector& selector, const std::vector<double>& latenciesUsec, const std::vector<double>& latenciesAfterHalfUsec, size_t queries, int64_t intervalUsec)
+{
+  ServerPolicy::NumberedServerVector servers;
+  for (size_t idx = 0; idx < latenciesUsec.size(); idx++) {
+    servers.emplace_back(idx + 1, std::make_shared<DownstreamState>(ComboAddress("192.0.2." + std::to_string(idx + 1) + ":53")));
+    servers.at(idx).second->setUp();
+  }
+  const auto slowest = std::distance(latenciesUsec.begin(), std::max_element(latenciesUsec.begin(), latenciesUsec.end()));
+
+  /* time of the response, server index, latency */
+  using Completion = std::tuple<int64_t, size_t, double>;
+  std::priority_queue<Completion, std::vector<Completion>, std::greater<>> completions;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> jitter(0.9, 1.1);
+  std::vector<double> observed;
+  observed.reserve(queries);
+  size_t toSlowest = 0;
+  /* start at a non-zero time to make sure the ages of the measures make sense */
+  int64_t now = 1000000;
+
+  for (size_t query = 0; query < queries; query++) {
+    now += intervalUsec;
+    while (!completions.empty() && std::get<0>(completions.top()) <= now) {
+      const auto [when, idx, latency] = completions.top();
+      completions.pop();
+      auto& server = servers.at(idx).second;
+      --server->outstanding;
+      server->latencyUsec = (127.0 * server->latencyUsec / 128.0) + latency / 128.0;
+      server->latencyPeakEWMA.submit(latency, when);
+    }
+
+    auto selected = selector(servers, now);
+    BOOST_REQUIRE(selected != nullptr);
+    size_t idx = 0;
+    while (servers.at(idx).second != selected) {
+      idx++;
+    }
+    if (idx == static_cast<size_t>(slowest)) {
+      toSlowest++;
+    }
+    const auto& latencies = (query >= queries / 2 && !latenciesAfterHalfUsec.empty()) ? latenciesAfterHalfUsec : latenciesUsec;
+    const double latency = latencies.at(idx) * jitter(gen);
+    ++selected->outstanding;
+    completions.emplace(now + static_cast<int64_t>(latency), idx, latency);
+    observed.push_back(latency);
+  }
+
+  SimulationResult result;
+  result.d_shareToSlowest = static_cast<double>(toSlowest) / static_cast<double>(queries);
+  result.d_meanLatencyUsec = std::accumulate(observed.begin(), observed.end(), 0.0) / static_cast<double>(observed.size());
+  std::nth_element(observed.begin(), observed.begin() + (observed.size() * 99 / 100), observed.end());
+  result.d_p99LatencyUsec = observed.at(observed.size() * 99 / 100);
+  return result;
+}
+
+static SimulationSelector getSimulationSelector(const ServerPolicy& pol)
+{
+  return [&pol](const ServerPolicy::NumberedServerVector& servers, int64_t now) {
+    auto dnsQuestion = getDQ();
+    return pol.getSelectedBackend(servers, dnsQuestion);
+  };
+}
+
+BOOST_AUTO_TEST_CASE(test_p2cPeakEWMA_Simulation)
+{
+  /* one backend is twenty times slower than the other ones */
+  const std::vector<double> latencies{20000.0, 1000.0, 1000.0, 1000.0, 1000.0};
+  const SimulationSelector p2c = [](const ServerPolicy::NumberedServerVector& servers, int64_t now) {
+    return p2cPeakEWMAAtTime(servers, now);
+  };
+  const auto p2cResult = simulatePolicy(p2c, latencies, {}, 20000, 100);
+  ServerPolicy wrandomPol{"wrandom", wrandom, false};
+  const auto wrandomResult = simulatePolicy(getSimulationSelector(wrandomPol), latencies, {}, 20000, 100);
+
+  BOOST_CHECK_LT(p2cResult.d_shareToSlowest, 0.05);
+  BOOST_CHECK_LT(p2cResult.d_meanLatencyUsec, wrandomResult.d_meanLatencyUsec);
+
+  /* the second backend becomes very slow half-way through, we should notice quickly */
+  const std::vector<double> after{20000.0, 50000.0, 1000.0, 1000.0, 1000.0};
+  const auto shifted = simulatePolicy(p2c, latencies, after, 20000, 100);
+  const auto shiftedWrandom = simulatePolicy(getSimulationSelector(wrandomPol), latencies, after, 20000, 100);
+  BOOST_CHECK_LT(shifted.d_meanLatencyUsec, shiftedWrandom.d_meanLatencyUsec);
+  BOOST_CHECK_LT(shifted.d_p99LatencyUsec, shiftedWrandom.d_p99LatencyUsec);
+}
+
+#ifdef BENCH_POLICIES
+BOOST_AUTO_TEST_CASE(test_Policies_Simulation_Bench)
+{
+  /* ten backends, one very slow, one slow, and a third one that becomes very slow half-way through */
+  const std::vector<double> latencies{50000.0, 20000.0, 1000.0, 2000.0, 1000.0, 1500.0, 1000.0, 3000.0, 1000.0, 1200.0};
+  std::vector<double> after(latencies);
+  after.at(2) = 80000.0;
+
+  ServerPolicy leastOutstandingPol{"leastOutstanding", leastOutstanding, false};
+  ServerPolicy wrandomPol{"wrandom", wrandom, false};
+  ServerPolicy roundrobinPol{"roundrobin", roundrobin, false};
+  const std::vector<std::pair<std::string, SimulationSelector>> selectors{
+    {"leastOutstanding", getSimulationSelector(leastOutstandingPol)},
+    {"wrandom", getSimulationSelector(wrandomPol)},
+    {"roundrobin", getSimulationSelector(roundrobinPol)},
+    {"p2cPeakEWMA", [](const ServerPolicy::NumberedServerVector& servers, int64_t now) { return p2cPeakEWMAAtTime(servers, now); }},
+  };
+
+  for (const auto& [name, selector] : selectors) {
+    StopWatch stopWatch;
+    stopWatch.start();
+    /* 50k qps for 20 virtual seconds */
+    const auto result = simulatePolicy(selector, latencies, after, 1000000, 20);
+    cerr << name << ": " << result.d_shareToSlowest * 100.0 << "% to the slowest backend, mean latency " << result.d_meanLatencyUsec / 1000.0 << " ms, p99 " << result.d_p99LatencyUsec / 1000.0 << " ms, simulated in " << stopWatch.udiff() / 1000 << " ms" << endl;
+  }
+}
+#endif /* BENCH_POLICIES */
+
 BOOST_AUTO_TEST_CASE(test_lua)
 {
   std::vector<DNSName> names;
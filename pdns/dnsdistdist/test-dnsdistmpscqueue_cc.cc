@@ -0,0 +1,182 @@
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <poll.h>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-mpsc-queue.hh"
+
+using namespace dnsdist;
+
+struct MyObject
+{
+  MyObject(uint64_t producer, uint64_t value) :
+    d_producer(producer), d_value(value)
+  {
+  }
+  uint64_t d_producer;
+  uint64_t d_value;
+};
+
+static bool isReadable(int desc)
+{
+  pollfd pfd{};
+  pfd.fd = desc;
+  pfd.events = POLLIN;
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN) != 0;
+}
+
+BOOST_AUTO_TEST_SUITE(dnsdistmpscqueue_cc)
+
+BOOST_AUTO_TEST_CASE(test_MPSCQueue_Basic)
+{
+  MPSCQueue<MyObject> queue;
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK(queue.pop() == nullptr);
+
+  for (uint64_t idx = 0; idx < 10; idx++) {
+    BOOST_CHECK(queue.push(std::make_unique<MyObject>(0, idx)));
+  }
+  BOOST_CHECK(!queue.empty());
+  BOOST_CHECK_EQUAL(queue.size(), 10U);
+
+  for (uint64_t idx = 0; idx < 10; idx++) {
+    auto obj = queue.pop();
+    BOOST_REQUIRE(obj != nullptr);
+    BOOST_CHECK_EQUAL(obj->d_value, idx);
+  }
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK(queue.pop() == nullptr);
+
+  /* the remaining objects are released with the queue */
+  BOOST_CHECK(queue.push(std::make_unique<MyObject>(0, 42)));
+}
+
+BOOST_AUTO_TEST_CASE(test_MPSCQueue_Capacity)
+{
+  MPSCQueue<MyObject> queue(2);
+  BOOST_CHECK(queue.push(std::make_unique<MyObject>(0, 0)));
+  BOOST_CHECK(queue.push(std::make_unique<MyObject>(0, 1)));
+
+  auto obj = std::make_unique<MyObject>(0, 2);
+  BOOST_CHECK(!queue.push(std::move(obj)));
+  /* not consumed */
+  BOOST_REQUIRE(obj != nullptr);
+  BOOST_CHECK_EQUAL(obj->d_value, 2U);
+
+  BOOST_CHECK(queue.pop() != nullptr);
+  BOOST_CHECK(queue.push(std::move(obj)));
+  BOOST_CHECK_EQUAL(queue.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(test_MPSCQueue_Concurrent)
+{
+  const size_t producersCount = 4;
+  const uint64_t objectsPerProducer = 100000;
+  MPSCQueue<MyObject> queue;
+
+  std::vector<std::thread> producers;
+  producers.reserve(producersCount);
+  for (size_t producer = 0; producer < producersCount; producer++) {
+    producers.emplace_back([&queue, producer]() {
+      for (uint64_t idx = 0; idx < objectsPerProducer; idx++) {
+        queue.push(std::make_unique<MyObject>(producer, idx));
+      }
+    });
+  }
+
+  /* objects from a given producer have to come in order */
+  std::vector<uint64_t> expected(producersCount, 0);
+  uint64_t received = 0;
+  while (received < producersCount * objectsPerProducer) {
+    auto obj = queue.pop();
+    if (!obj) {
+      std::this_thread::yield();
+      continue;
+    }
+    BOOST_REQUIRE_LT(obj->d_producer, producersCount);
+    BOOST_REQUIRE_EQUAL(obj->d_value, expected.at(obj->d_producer));
+    expected.at(obj->d_producer)++;
+    received++;
+  }
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  BOOST_CHECK(queue.empty());
+  BOOST_CHECK_EQUAL(queue.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_Doorbell)
+{
+  Doorbell doorbell;
+  BOOST_REQUIRE_GE(doorbell.getDescriptor(), 0);
+  BOOST_CHECK(!isReadable(doorbell.getDescriptor()));
+
+  /* the consumer is not waiting, nothing to do */
+  doorbell.ring();
+  BOOST_CHECK(!isReadable(doorbell.getDescriptor()));
+  BOOST_CHECK_EQUAL(doorbell.getRingsCount(), 0U);
+
+  /* only the first ring while waiting writes to the descriptor */
+  doorbell.prepareToWait();
+  doorbell.ring();
+  doorbell.ring();
+  BOOST_CHECK(isReadable(doorbell.getDescriptor()));
+  BOOST_CHECK_EQUAL(doorbell.getRingsCount(), 1U);
+
+  doorbell.clear();
+  doorbell.doneWaiting();
+  BOOST_CHECK(!isReadable(doorbell.getDescriptor()));
+
+  doorbell.ring();
+  BOOST_CHECK_EQUAL(doorbell.getRingsCount(), 1U);
+  BOOST_CHECK(!isReadable(doorbell.getDescriptor()));
+}
+
+BOOST_AUTO_TEST_CASE(test_Doorbell_NoLostWakeUp)
+{
+  const uint64_t objectsCount = 100000;
+  MPSCQueue<MyObject> queue;
+  Doorbell doorbell;
+
+  std::thread producer([&queue, &doorbell]() {
+    for (uint64_t idx = 0; idx < objectsCount; idx++) {
+      queue.push(std::make_unique<MyObject>(0, idx));
+      doorbell.ring();
+    }
+  });
+
+  uint64_t received = 0;
+  while (received < objectsCount) {
+    doorbell.prepareToWait();
+    while (auto obj = queue.pop()) {
+      BOOST_REQUIRE_EQUAL(obj->d_value, received);
+      received++;
+    }
+    if (received == objectsCount) {
+      break;
+    }
+    if (queue.empty()) {
+      /* a lost wake-up would block us forever here */
+      pollfd pfd{};
+      pfd.fd = doorbell.getDescriptor();
+      pfd.events = POLLIN;
+      BOOST_REQUIRE_EQUAL(poll(&pfd, 1, 5000), 1);
+      doorbell.clear();
+    }
+    doorbell.doneWaiting();
+  }
+
+  producer.join();
+  BOOST_CHECK_EQUAL(received, objectsCount);
+  /* most objects should not have required a write to the descriptor */
+  BOOST_CHECK_LT(doorbell.getRingsCount(), objectsCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
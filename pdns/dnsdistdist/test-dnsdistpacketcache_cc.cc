@@ -1240,4 +1240,517 @@ BOOST_AUTO_TEST_CASE(test_PacketCacheXFR)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_PacketCacheLockFree)
+{
+  const size_t maxEntries = 150000;
+  DNSDistPacketCache localCache(maxEntries, 86400, 1);
+  localCache.enableLockFreeEngine(512);
+  BOOST_CHECK(localCache.isLockFreeEngineEnabled());
+  BOOST_CHECK_EQUAL(localCache.getSize(), 0U);
+
+  size_t counter = 0;
+  size_t skipped = 0;
+  bool dnssecOK = false;
+  const time_t now = time(nullptr);
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+
+  for (counter = 0; counter < 100000; ++counter) {
+    ids.qname = DNSName(std::to_string(counter)) + DNSName(" hello");
+
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->ra = 1;
+    pwR.getHeader()->qr = 1;
+    pwR.getHeader()->id = pwQ.getHeader()->id;
+    pwR.startRecord(ids.qname, QType::A, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfr32BitInt(0x01020304);
+    pwR.commit();
+
+    uint32_t key = 0;
+    boost::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = localCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+    BOOST_CHECK_EQUAL(found, false);
+
+    localCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, boost::none);
+
+    found = localCache.get(dnsQuestion, pwR.getHeader()->id, &key, subnet, dnssecOK, receivedOverUDP, 0, true);
+    if (found) {
+      BOOST_CHECK_EQUAL(dnsQuestion.getData().size(), response.size());
+      int match = memcmp(dnsQuestion.getData().data(), response.data(), dnsQuestion.getData().size());
+      BOOST_CHECK_EQUAL(match, 0);
+    }
+    else {
+      skipped++;
+    }
+  }
+
+  BOOST_CHECK_EQUAL(skipped, localCache.getInsertCollisions());
+  BOOST_CHECK_EQUAL(localCache.getSize(), counter - skipped);
+  BOOST_CHECK_EQUAL(localCache.getDeferredLookups(), 0U);
+
+  /* a response that does not fit in the inline storage goes to the regular maps */
+  ids.qname = DNSName("large.answer.powerdns.com.");
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::TXT, QClass::IN, 0);
+  pwQ.getHeader()->rd = 1;
+  PacketBuffer response;
+  GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::TXT, QClass::IN, 0);
+  pwR.getHeader()->rd = 1;
+  pwR.getHeader()->qr = 1;
+  pwR.getHeader()->id = pwQ.getHeader()->id;
+  for (size_t idx = 0; idx < 4; idx++) {
+    pwR.startRecord(ids.qname, QType::TXT, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfrText("\"" + std::string(200, 'a' + idx) + "\"");
+    pwR.commit();
+  }
+  BOOST_REQUIRE_GT(response.size(), 512U);
+
+  ids.qtype = QType::TXT;
+  uint32_t key = 0;
+  boost::optional<Netmask> subnet;
+  DNSQuestion dnsQuestion(ids, query);
+  BOOST_CHECK_EQUAL(localCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP), false);
+  auto sizeBefore = localCache.getSize();
+  localCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::TXT, QClass::IN, response, receivedOverUDP, 0, boost::none);
+  BOOST_CHECK_EQUAL(localCache.getSize(), sizeBefore + 1);
+  BOOST_CHECK_EQUAL(localCache.get(dnsQuestion, pwR.getHeader()->id, &key, subnet, dnssecOK, receivedOverUDP, 0, true), true);
+  BOOST_CHECK(dnsQuestion.getData() == response);
+  BOOST_CHECK_EQUAL(localCache.expungeByName(ids.qname), 1U);
+  BOOST_CHECK_EQUAL(localCache.getSize(), sizeBefore);
+
+  ids.qtype = QType::A;
+  size_t deleted = 0;
+  for (size_t delcounter = 0; delcounter < counter / 1000; ++delcounter) {
+    ids.qname = DNSName(std::to_string(delcounter)) + DNSName(" hello");
+    PacketBuffer delQuery;
+    GenericDNSPacketWriter<PacketBuffer> pwDel(delQuery, ids.qname, QType::A, QClass::IN, 0);
+    pwDel.getHeader()->rd = 1;
+    DNSQuestion delQuestion(ids, delQuery);
+    if (localCache.get(delQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP)) {
+      auto removed = localCache.expungeByName(ids.qname);
+      BOOST_CHECK_EQUAL(removed, 1U);
+      deleted += removed;
+    }
+  }
+  BOOST_CHECK_EQUAL(localCache.getSize(), counter - skipped - deleted);
+
+  /* keep only 100 entries, the limit applying to the whole cache and not to the lock-free and regular storages separately */
+  localCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, DNSName("large.answer.powerdns.com."), QType::TXT, QClass::IN, response, receivedOverUDP, 0, boost::none);
+  BOOST_CHECK_EQUAL(localCache.getSize(), counter - skipped - deleted + 1);
+  BOOST_CHECK_EQUAL(localCache.expunge(100), counter - skipped - deleted + 1 - 100);
+  BOOST_CHECK_EQUAL(localCache.getSize(), 100U);
+
+  BOOST_CHECK_EQUAL(localCache.expungeByName(DNSName("large.answer.powerdns.com.")), 1U);
+  auto remaining = localCache.getSize();
+  BOOST_CHECK_EQUAL(localCache.expungeByName(DNSName(" hello"), QType::ANY, true), remaining);
+  BOOST_CHECK_EQUAL(localCache.getSize(), 0U);
+  BOOST_CHECK_EQUAL(localCache.purgeExpired(0, now), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheLockFreeECSCollision)
+{
+  const size_t maxEntries = 150000;
+  DNSDistPacketCache localCache(maxEntries, 86400, 1, 60, 3600, 60, false, 1, true, true);
+  localCache.enableLockFreeEngine(512);
+
+  InternalQueryState ids;
+  ids.qtype = QType::AAAA;
+  ids.qclass = QClass::IN;
+  ids.qname = DNSName("www.powerdns.com.");
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  uint16_t qid = 0x42;
+  uint32_t key{};
+  uint32_t secondKey{};
+  boost::optional<Netmask> subnetOut;
+  bool dnssecOK = false;
+
+  /* same collision as in test_PCCollision */
+  {
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, ids.qtype, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+    pwQ.getHeader()->id = qid;
+    GenericDNSPacketWriter<PacketBuffer>::optvect_t ednsOptions;
+    EDNSSubnetOpts opt;
+    opt.source = Netmask("10.0.59.220/32");
+    ednsOptions.emplace_back(EDNSOptionCode::ECS, makeEDNSSubnetOptsString(opt));
+    pwQ.addOpt(512, 0, 0, ednsOptions);
+    pwQ.commit();
+
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = localCache.get(dnsQuestion, 0, &key, subnetOut, dnssecOK, receivedOverUDP);
+    BOOST_CHECK_EQUAL(found, false);
+    BOOST_REQUIRE(subnetOut);
+
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, ids.qtype, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->id = qid;
+    pwR.startRecord(ids.qname, ids.qtype, 100, QClass::IN, DNSResourceRecord::ANSWER);
+    ComboAddress v6addr("::1");
+    pwR.xfrCAWithoutPort(6, v6addr);
+    pwR.commit();
+    pwR.addOpt(512, 0, 0, ednsOptions);
+    pwR.commit();
+
+    localCache.insert(key, subnetOut, *(getFlagsFromDNSHeader(pwR.getHeader())), dnssecOK, ids.qname, ids.qtype, QClass::IN, response, receivedOverUDP, RCode::NoError, boost::none);
+    BOOST_CHECK_EQUAL(localCache.getSize(), 1U);
+
+    found = localCache.get(dnsQuestion, 0, &key, subnetOut, dnssecOK, receivedOverUDP);
+    BOOST_CHECK_EQUAL(found, true);
+  }
+
+  {
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, ids.qtype, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+    pwQ.getHeader()->id = qid;
+    GenericDNSPacketWriter<PacketBuffer>::optvect_t ednsOptions;
+    EDNSSubnetOpts opt;
+    opt.source = Netmask("10.0.167.48/32");
+    ednsOptions.emplace_back(EDNSOptionCode::ECS, makeEDNSSubnetOptsString(opt));
+    pwQ.addOpt(512, 0, 0, ednsOptions);
+    pwQ.commit();
+
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = localCache.get(dnsQuestion, 0, &secondKey, subnetOut, dnssecOK, receivedOverUDP);
+    BOOST_CHECK_EQUAL(found, false);
+    BOOST_CHECK_EQUAL(secondKey, key);
+    BOOST_CHECK_EQUAL(localCache.getLookupCollisions(), 1U);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheLockFreeInPlace)
+{
+  DNSDistPacketCache localCache(10000, 86400, 1);
+  localCache.enableLockFreeEngine(512);
+
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  ids.qname = DNSName("www.powerdns.com.");
+
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+  pwQ.getHeader()->rd = 1;
+
+  PacketBuffer response;
+  GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+  pwR.getHeader()->rd = 1;
+  pwR.getHeader()->ra = 1;
+  pwR.getHeader()->qr = 1;
+  pwR.getHeader()->id = pwQ.getHeader()->id;
+  pwR.startRecord(ids.qname, QType::A, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+  pwR.xfr32BitInt(0x01020304);
+  pwR.commit();
+
+  uint32_t key = 0;
+  boost::optional<Netmask> subnet;
+  DNSQuestion dnsQuestion(ids, query);
+  BOOST_CHECK_EQUAL(localCache.get(dnsQuestion, 0, &key, subnet, false, receivedOverUDP), false);
+  localCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), false, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, boost::none);
+  const auto hits = localCache.getHits();
+  const auto misses = localCache.getMisses();
+
+  /* same query, different case and ID, in a buffer larger than the query itself */
+  const DNSName mixedCase("WwW.PowerDNS.CoM.");
+  const size_t qnameWireLength = mixedCase.wirelength();
+  PacketBuffer frame;
+  GenericDNSPacketWriter<PacketBuffer> pwF(frame, mixedCase, QType::A, QClass::IN, 0);
+  pwF.getHeader()->rd = 1;
+  pwF.getHeader()->id = htons(4242);
+  const size_t querySize = frame.size();
+  frame.resize(512);
+  const auto original = frame;
+
+  /* not enough room for the response */
+  BOOST_CHECK_EQUAL(localCache.getInPlace(frame.data(), querySize, querySize, qnameWireLength, QType::A, QClass::IN, false, receivedOverUDP), 0U);
+  /* different qtype, DO bit or transport */
+  BOOST_CHECK_EQUAL(localCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::AAAA, QClass::IN, false, receivedOverUDP), 0U);
+  BOOST_CHECK_EQUAL(localCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::A, QClass::IN, true, receivedOverUDP), 0U);
+  BOOST_CHECK_EQUAL(localCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::A, QClass::IN, false, !receivedOverUDP), 0U);
+  /* the query has not been touched, and the misses are left to the regular path */
+  BOOST_CHECK(frame == original);
+  BOOST_CHECK_EQUAL(localCache.getHits(), hits);
+  BOOST_CHECK_EQUAL(localCache.getMisses(), misses);
+
+  const auto responseSize = localCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::A, QClass::IN, false, receivedOverUDP);
+  BOOST_REQUIRE_EQUAL(responseSize, response.size());
+  BOOST_CHECK_EQUAL(localCache.getHits(), hits + 1);
+  /* the ID and the qname are the ones from the query */
+  BOOST_CHECK_EQUAL(memcmp(frame.data(), original.data(), sizeof(uint16_t)), 0);
+  BOOST_CHECK_EQUAL(memcmp(&frame.at(sizeof(dnsheader)), &original.at(sizeof(dnsheader)), qnameWireLength), 0);
+  /* the rest is the cached response */
+  BOOST_CHECK_EQUAL(memcmp(&frame.at(sizeof(uint16_t)), &response.at(sizeof(uint16_t)), sizeof(dnsheader) - sizeof(uint16_t)), 0);
+  const size_t offset = sizeof(dnsheader) + qnameWireLength;
+  BOOST_CHECK_EQUAL(memcmp(&frame.at(offset), &response.at(offset), responseSize - offset), 0);
+
+  /* ECS is not supported */
+  DNSDistPacketCache ecsCache(10000, 86400, 1, 60, 3600, 60, false, 1, true, true);
+  ecsCache.enableLockFreeEngine(512);
+  BOOST_CHECK_EQUAL(ecsCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::A, QClass::IN, false, receivedOverUDP), 0U);
+  /* nor is a cache without the lock-free engine */
+  DNSDistPacketCache regularCache(10000, 86400, 1);
+  BOOST_CHECK_EQUAL(regularCache.getInPlace(frame.data(), querySize, frame.size(), qnameWireLength, QType::A, QClass::IN, false, receivedOverUDP), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheBinaryDump)
+{
+  const size_t maxEntries = 10000;
+  bool dnssecOK = false;
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+
+  auto makeQuery = [&ids](size_t counter) {
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, ids.qtype, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+    if (counter % 2 == 0) {
+      /* half of the queries have an ECS option */
+      GenericDNSPacketWriter<PacketBuffer>::optvect_t ednsOptions;
+      EDNSSubnetOpts opt;
+      opt.source = Netmask("192.0.2." + std::to_string(counter % 256) + "/32");
+      ednsOptions.emplace_back(EDNSOptionCode::ECS, makeEDNSSubnetOptsString(opt));
+      pwQ.addOpt(512, 0, 0, ednsOptions);
+    }
+    pwQ.commit();
+    return query;
+  };
+
+  for (const bool lockFree : {false, true}) {
+    DNSDistPacketCache source(maxEntries, 86400, 1, 60, 3600, 60, false, 4, true, true);
+    DNSDistPacketCache target(maxEntries, 86400, 1, 60, 3600, 60, false, 4, true, true);
+    if (lockFree) {
+      source.enableLockFreeEngine(512);
+      target.enableLockFreeEngine(512);
+    }
+
+    std::vector<PacketBuffer> responses;
+    for (size_t counter = 0; counter < 1000; ++counter) {
+      ids.qname = DNSName(std::to_string(counter) + ".dump.powerdns.com.");
+      auto query = makeQuery(counter);
+
+      PacketBuffer response;
+      GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, ids.qtype, QClass::IN, 0);
+      pwR.getHeader()->rd = 1;
+      pwR.getHeader()->ra = 1;
+      pwR.getHeader()->qr = 1;
+      pwR.startRecord(ids.qname, ids.qtype, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+      pwR.xfr32BitInt(0x01020304 + counter);
+      pwR.commit();
+
+      uint32_t key = 0;
+      boost::optional<Netmask> subnet;
+      DNSQuestion dnsQuestion(ids, query);
+      BOOST_CHECK(!source.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP));
+      BOOST_CHECK_EQUAL(static_cast<bool>(subnet), counter % 2 == 0);
+      source.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, ids.qtype, QClass::IN, response, receivedOverUDP, 0, boost::none);
+      responses.push_back(std::move(response));
+    }
+
+    std::array<char, 32> fileName{"/tmp/dnsdist-pc-dump-XXXXXX"};
+    int fileDesc = mkstemp(fileName.data());
+    BOOST_REQUIRE(fileDesc >= 0);
+    unlink(fileName.data());
+
+    const auto dumped = source.dumpBinary(fileDesc);
+    BOOST_CHECK_EQUAL(dumped, source.getSize());
+    BOOST_REQUIRE_EQUAL(lseek(fileDesc, 0, SEEK_SET), 0);
+    BOOST_CHECK_EQUAL(target.load(fileDesc), dumped);
+
+    /* a truncated dump is loaded up to the last complete entry */
+    const auto dumpSize = lseek(fileDesc, 0, SEEK_END);
+    BOOST_REQUIRE(dumpSize > 5);
+    BOOST_REQUIRE_EQUAL(ftruncate(fileDesc, dumpSize - 5), 0);
+    BOOST_REQUIRE_EQUAL(lseek(fileDesc, 0, SEEK_SET), 0);
+    DNSDistPacketCache truncated(maxEntries, 86400, 1, 60, 3600, 60, false, 4, true, true);
+    if (lockFree) {
+      truncated.enableLockFreeEngine(512);
+    }
+    BOOST_CHECK_EQUAL(truncated.load(fileDesc), dumped - 1);
+    close(fileDesc);
+    BOOST_CHECK_EQUAL(target.getSize(), source.getSize());
+
+    /* only one dump at a time */
+    BOOST_CHECK(source.startDump());
+    BOOST_CHECK(!source.startDump());
+    source.finishDump();
+    BOOST_CHECK(source.startDump());
+    source.finishDump();
+
+    size_t found = 0;
+    for (size_t counter = 0; counter < 1000; ++counter) {
+      ids.qname = DNSName(std::to_string(counter) + ".dump.powerdns.com.");
+      auto query = makeQuery(counter);
+      uint32_t key = 0;
+      boost::optional<Netmask> subnet;
+      DNSQuestion dnsQuestion(ids, query);
+      if (target.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP, 0, true)) {
+        found++;
+        const auto& response = responses.at(counter);
+        BOOST_REQUIRE_EQUAL(dnsQuestion.getData().size(), response.size());
+        BOOST_CHECK_EQUAL(memcmp(dnsQuestion.getData().data(), response.data(), response.size()), 0);
+      }
+    }
+    BOOST_CHECK_EQUAL(found, source.getSize());
+  }
+
+  {
+    /* not a dump */
+    std::array<char, 32> fileName{"/tmp/dnsdist-pc-dump-XXXXXX"};
+    int fileDesc = mkstemp(fileName.data());
+    BOOST_REQUIRE(fileDesc >= 0);
+    unlink(fileName.data());
+    BOOST_REQUIRE_EQUAL(write(fileDesc, "; dnsdist's packet cache dump follows\n", 38), 38);
+    BOOST_REQUIRE_EQUAL(lseek(fileDesc, 0, SEEK_SET), 0);
+    DNSDistPacketCache cache(maxEntries);
+    BOOST_CHECK_THROW(cache.load(fileDesc), std::runtime_error);
+    close(fileDesc);
+    BOOST_CHECK_EQUAL(cache.getSize(), 0U);
+  }
+
+  {
+    /* the keys of a cache skipping different EDNS options would not match */
+    DNSDistPacketCache source(maxEntries);
+    ids.qname = DNSName("keys.dump.powerdns.com.");
+    auto query = makeQuery(1);
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, ids.qtype, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->qr = 1;
+    pwR.startRecord(ids.qname, ids.qtype, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfr32BitInt(0x01020304);
+    pwR.commit();
+    uint32_t key = 0;
+    boost::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    BOOST_CHECK(!source.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP));
+    source.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, ids.qtype, QClass::IN, response, receivedOverUDP, 0, boost::none);
+    BOOST_REQUIRE_EQUAL(source.getSize(), 1U);
+
+    std::array<char, 32> fileName{"/tmp/dnsdist-pc-dump-XXXXXX"};
+    int fileDesc = mkstemp(fileName.data());
+    BOOST_REQUIRE(fileDesc >= 0);
+    unlink(fileName.data());
+    BOOST_CHECK_EQUAL(source.dumpBinary(fileDesc), 1U);
+
+    DNSDistPacketCache target(maxEntries);
+    target.setSkippedOptions({});
+    BOOST_REQUIRE_EQUAL(lseek(fileDesc, 0, SEEK_SET), 0);
+    BOOST_CHECK_THROW(target.load(fileDesc), std::runtime_error);
+    BOOST_CHECK_EQUAL(target.getSize(), 0U);
+
+    DNSDistPacketCache sameKeys(maxEntries);
+    BOOST_REQUIRE_EQUAL(lseek(fileDesc, 0, SEEK_SET), 0);
+    BOOST_CHECK_EQUAL(sameKeys.load(fileDesc), 1U);
+    close(fileDesc);
+  }
+}
+
+#ifdef BENCH_PACKETCACHE
+/* Not a real unit test, but a microbenchmark comparing the lookup performance of
+   the sharded and lock-free engines when several threads hammer a hot cache. */
+static void benchmarkCacheReaders(DNSDistPacketCache& cache, size_t numberOfThreads, const char* name)
+{
+  const size_t hotNames = 1000;
+  const size_t lookupsPerThread = 200000;
+  bool dnssecOK = false;
+
+  std::vector<PacketBuffer> queries;
+  std::vector<DNSName> names;
+  queries.reserve(hotNames);
+  names.reserve(hotNames);
+  for (size_t idx = 0; idx < hotNames; idx++) {
+    InternalQueryState ids;
+    ids.qtype = QType::A;
+    ids.qclass = QClass::IN;
+    ids.protocol = dnsdist::Protocol::DoUDP;
+    ids.qname = DNSName("hot" + std::to_string(idx) + ".powerdns.com.");
+
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->qr = 1;
+    pwR.startRecord(ids.qname, QType::A, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfr32BitInt(0x01020304);
+    pwR.commit();
+
+    uint32_t key = 0;
+    boost::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+    cache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, boost::none);
+    queries.push_back(std::move(query));
+    names.push_back(ids.qname);
+  }
+
+  std::atomic<uint64_t> hits{0};
+  std::vector<std::thread> threads;
+  threads.reserve(numberOfThreads);
+  StopWatch stopWatch;
+  stopWatch.start();
+  for (size_t threadIdx = 0; threadIdx < numberOfThreads; threadIdx++) {
+    threads.emplace_back([&cache, &queries, &names, &hits, threadIdx, dnssecOK]() {
+      uint64_t localHits = 0;
+      InternalQueryState ids;
+      ids.qtype = QType::A;
+      ids.qclass = QClass::IN;
+      ids.protocol = dnsdist::Protocol::DoUDP;
+      for (size_t counter = 0; counter < lookupsPerThread; counter++) {
+        auto idx = (counter + (threadIdx * 7919)) % hotNames;
+        ids.qname = names.at(idx);
+        PacketBuffer query = queries.at(idx);
+        uint32_t key = 0;
+        boost::optional<Netmask> subnet;
+        DNSQuestion dnsQuestion(ids, query);
+        if (cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP)) {
+          localHits++;
+        }
+      }
+      hits += localHits;
+    });
+  }
+  for (auto& thr : threads) {
+    thr.join();
+  }
+  auto elapsedMs = stopWatch.udiff() / 1000;
+
+  cerr << name << " engine, " << numberOfThreads << " reader threads: " << (numberOfThreads * lookupsPerThread) << " lookups in " << elapsedMs << " ms, " << hits << " hits, " << cache.getDeferredLookups() << " deferred lookups" << endl;
+  BOOST_CHECK_EQUAL(hits + cache.getDeferredLookups(), numberOfThreads * lookupsPerThread);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheEnginesReaders)
+{
+  const size_t maxEntries = 10000;
+  const size_t numberOfThreads = std::max(2U, std::min(8U, std::thread::hardware_concurrency()));
+
+  {
+    DNSDistPacketCache shardedCache(maxEntries, 86400, 1, 60, 3600, 60, false, 20);
+    benchmarkCacheReaders(shardedCache, numberOfThreads, "sharded");
+  }
+  {
+    DNSDistPacketCache lockFreeCache(maxEntries, 86400, 1, 60, 3600, 60, false, 20);
+    lockFreeCache.enableLockFreeEngine(512);
+    benchmarkCacheReaders(lockFreeCache, numberOfThreads, "lock-free");
+    BOOST_CHECK_EQUAL(lockFreeCache.getDeferredLookups(), 0U);
+  }
+}
+#endif /* BENCH_PACKETCACHE */
+
 BOOST_AUTO_TEST_SUITE_END()
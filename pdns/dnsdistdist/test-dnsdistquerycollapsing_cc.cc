@@ -0,0 +1,165 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-query-collapsing.hh"
+
+using namespace dnsdist::collapsing;
+
+BOOST_AUTO_TEST_SUITE(test_dnsdistquerycollapsing)
+
+struct DummyCrossProtocolQuery : public CrossProtocolQuery
+{
+  DummyCrossProtocolQuery(uint16_t queryID) :
+    CrossProtocolQuery()
+  {
+    query.d_idstate.origID = queryID;
+  }
+
+  std::shared_ptr<TCPQuerySender> getTCPQuerySender() override
+  {
+    return nullptr;
+  }
+};
+
+static const DNSDistPacketCache* getDummyCache(uintptr_t value)
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,performance-no-int-to-ptr): the pointer is only used as part of the key
+  return reinterpret_cast<const DNSDistPacketCache*>(value);
+}
+
+BOOST_AUTO_TEST_CASE(test_LeaderAndWaiting)
+{
+  InFlightQueries inFlight;
+  const InFlightKey key{getDummyCache(1), 42};
+  struct timeval now
+  {
+    1000, 0
+  };
+  size_t parkCalls = 0;
+  uint16_t nextID = 0;
+  auto park = [&parkCalls, &nextID]() -> std::unique_ptr<CrossProtocolQuery> {
+    ++parkCalls;
+    return std::make_unique<DummyCrossProtocolQuery>(nextID++);
+  };
+
+  InFlightQueries::WaitingList expired;
+  BOOST_CHECK(inFlight.add(key, now, 1000, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK_EQUAL(parkCalls, 0U);
+  BOOST_CHECK_EQUAL(inFlight.size(), 1U);
+
+  for (size_t idx = 0; idx < 3; idx++) {
+    BOOST_CHECK(inFlight.add(key, now, 1000, 10, park, expired) == InFlightQueries::Outcome::Parked);
+  }
+  BOOST_CHECK_EQUAL(parkCalls, 3U);
+  BOOST_CHECK(expired.empty());
+
+  /* a different cache key, or the same key for a different cache, is not collapsed */
+  BOOST_CHECK(inFlight.add(InFlightKey{getDummyCache(1), 43}, now, 1000, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK(inFlight.add(InFlightKey{getDummyCache(2), 42}, now, 1000, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK_EQUAL(inFlight.size(), 3U);
+
+  auto waiting = inFlight.release(key);
+  BOOST_REQUIRE_EQUAL(waiting.size(), 3U);
+  for (size_t idx = 0; idx < waiting.size(); idx++) {
+    BOOST_CHECK_EQUAL(waiting.at(idx)->query.d_idstate.origID, idx);
+  }
+  BOOST_CHECK_EQUAL(inFlight.size(), 2U);
+
+  /* released twice (the leader timed out and a new one got answered first, for example) */
+  BOOST_CHECK(inFlight.release(key).empty());
+
+  /* the next miss becomes the leader again */
+  BOOST_CHECK(inFlight.add(key, now, 1000, 10, park, expired) == InFlightQueries::Outcome::Leader);
+}
+
+BOOST_AUTO_TEST_CASE(test_Bounds)
+{
+  InFlightQueries inFlight(4, 1);
+  struct timeval now
+  {
+    1000, 0
+  };
+  auto park = []() -> std::unique_ptr<CrossProtocolQuery> {
+    return std::make_unique<DummyCrossProtocolQuery>(0);
+  };
+
+  InFlightQueries::WaitingList expired;
+  const InFlightKey key{getDummyCache(1), 0};
+  BOOST_CHECK(inFlight.add(key, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK(inFlight.add(key, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Parked);
+  BOOST_CHECK(inFlight.add(key, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Parked);
+  /* the wait list is full */
+  BOOST_CHECK(inFlight.add(key, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Overflow);
+
+  for (uint32_t cacheKey = 1; cacheKey < 4; cacheKey++) {
+    BOOST_CHECK(inFlight.add(InFlightKey{getDummyCache(1), cacheKey}, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Leader);
+  }
+  /* too many distinct queries in flight */
+  BOOST_CHECK(inFlight.add(InFlightKey{getDummyCache(1), 4}, now, 1000, 2, park, expired) == InFlightQueries::Outcome::Overflow);
+  BOOST_CHECK_EQUAL(inFlight.size(), 4U);
+  BOOST_CHECK_EQUAL(inFlight.release(key).size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(test_Expiration)
+{
+  InFlightQueries inFlight;
+  struct timeval now
+  {
+    1000, 0
+  };
+  auto park = []() -> std::unique_ptr<CrossProtocolQuery> {
+    return std::make_unique<DummyCrossProtocolQuery>(0);
+  };
+
+  InFlightQueries::WaitingList expired;
+  const InFlightKey key{getDummyCache(1), 42};
+  const InFlightKey otherKey{getDummyCache(1), 43};
+  BOOST_CHECK(inFlight.add(key, now, 500, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK(inFlight.add(key, now, 500, 10, park, expired) == InFlightQueries::Outcome::Parked);
+  BOOST_CHECK(inFlight.add(otherKey, now, 1500, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK(inFlight.add(otherKey, now, 1500, 10, park, expired) == InFlightQueries::Outcome::Parked);
+
+  /* not expired yet */
+  BOOST_CHECK(inFlight.purgeExpired(now).empty());
+  BOOST_CHECK_EQUAL(inFlight.size(), 2U);
+
+  /* the leader did not get an answer in time, the next miss lets the waiting queries go and takes over */
+  now.tv_usec = 600000;
+  BOOST_CHECK(inFlight.add(key, now, 500, 10, park, expired) == InFlightQueries::Outcome::Leader);
+  BOOST_CHECK_EQUAL(expired.size(), 1U);
+  expired.clear();
+  BOOST_CHECK(inFlight.add(key, now, 500, 10, park, expired) == InFlightQueries::Outcome::Parked);
+
+  now.tv_sec = 1002;
+  auto purged = inFlight.purgeExpired(now);
+  BOOST_CHECK_EQUAL(purged.size(), 2U);
+  BOOST_CHECK_EQUAL(inFlight.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
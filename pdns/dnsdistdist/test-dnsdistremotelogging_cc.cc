@@ -0,0 +1,311 @@
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include <protozero/pbf_reader.hpp>
+
+#include "dnsdist-remote-logging.hh"
+#include "remote_logger.hh"
+
+using namespace dnsdist::remotelogging;
+
+class CapturingLogger : public RemoteLoggerInterface
+{
+public:
+  Result queueData(const std::string& data) override
+  {
+    d_messages.push_back(data);
+    return Result::Queued;
+  }
+  [[nodiscard]] std::string address() const override
+  {
+    return "capture";
+  }
+  [[nodiscard]] std::string toString() override
+  {
+    return "capture";
+  }
+  [[nodiscard]] std::string name() const override
+  {
+    return "capture";
+  }
+  [[nodiscard]] Stats getStats() override
+  {
+    return {};
+  }
+
+  std::vector<std::string> d_messages;
+};
+
+/* a logger whose queue is only drained every few messages, or never */
+class SlowLogger : public CapturingLogger
+{
+public:
+  Result queueData(const std::string& data) override
+  {
+    if (d_result != Result::Queued) {
+      return d_result;
+    }
+    if (++d_calls % 3 != 0) {
+      return Result::PipeFull;
+    }
+    return CapturingLogger::queueData(data);
+  }
+
+  Result d_result{Result::Queued};
+  size_t d_calls{0};
+};
+
+struct Summary
+{
+  std::string d_qname;
+  std::string d_from;
+  uint64_t d_count{0};
+  uint32_t d_rcode{0};
+};
+
+static Summary parseSummary(const std::string& data)
+{
+  Summary summary;
+  protozero::pbf_reader message{data};
+  while (message.next()) {
+    switch (message.tag()) {
+    case 6: /* from */
+      summary.d_from = message.get_bytes();
+      break;
+    case 12: { /* question */
+      auto question = message.get_message();
+      while (question.next(1)) {
+        summary.d_qname = question.get_string();
+      }
+      break;
+    }
+    case 13: { /* response */
+      auto response = message.get_message();
+      while (response.next(1)) {
+        summary.d_rcode = response.get_uint32();
+      }
+      break;
+    }
+    case 22: { /* meta */
+      auto meta = message.get_message();
+      std::string key;
+      uint64_t value{0};
+      while (meta.next()) {
+        if (meta.tag() == 1) {
+          key = meta.get_string();
+        }
+        else if (meta.tag() == 2) {
+          auto metaValue = meta.get_message();
+          while (metaValue.next(2)) {
+            value = metaValue.get_uint64();
+          }
+        }
+        else {
+          meta.skip();
+        }
+      }
+      if (key == "aggregated-count") {
+        summary.d_count = value;
+      }
+      break;
+    }
+    default:
+      message.skip();
+    }
+  }
+  return summary;
+}
+
+static std::map<std::string, Summary> parseSummaries(const std::vector<std::string>& messages)
+{
+  std::map<std::string, Summary> result;
+  for (const auto& data : messages) {
+    auto summary = parseSummary(data);
+    auto key = summary.d_qname + "/" + std::to_string(summary.d_from.size()) + "/" + std::to_string(summary.d_rcode);
+    BOOST_REQUIRE(result.count(key) == 0);
+    result[key] = summary;
+  }
+  return result;
+}
+
+BOOST_AUTO_TEST_SUITE(dnsdistremotelogging_cc)
+
+BOOST_AUTO_TEST_CASE(test_Sampling)
+{
+  const ComboAddress client("192.0.2.1");
+  const DNSName qname("www.powerdns.com.");
+
+  /* 0 and 1 mean no sampling */
+  BOOST_CHECK(isSampled(client, qname, 0));
+  BOOST_CHECK(isSampled(client, qname, 1));
+
+  /* the decision only depends on the client and the qname, case-insensitively */
+  const bool decision = isSampled(client, qname, 10);
+  for (size_t idx = 0; idx < 10; idx++) {
+    BOOST_CHECK_EQUAL(isSampled(client, qname, 10), decision);
+    BOOST_CHECK_EQUAL(isSampled(ComboAddress("192.0.2.1:4242"), DNSName("WWW.PowerDNS.com."), 10), decision);
+  }
+
+  size_t sampled = 0;
+  const size_t total = 10000;
+  for (size_t idx = 0; idx < total; idx++) {
+    if (isSampled(client, DNSName("name-" + std::to_string(idx) + ".powerdns.com."), 10)) {
+      sampled++;
+    }
+  }
+  BOOST_CHECK_GT(sampled, total / 10 * 8 / 10);
+  BOOST_CHECK_LT(sampled, total / 10 * 12 / 10);
+}
+
+BOOST_AUTO_TEST_CASE(test_Aggregation)
+{
+  auto logger = std::make_shared<CapturingLogger>();
+  Aggregator::Configuration config;
+  config.d_logger = logger;
+  config.d_interval = 60;
+  auto aggregator = Aggregator::create(std::move(config));
+
+  const DNSName first("a.powerdns.com.");
+  const DNSName second("b.powerdns.com.");
+  const size_t threadsCount = 4;
+  std::vector<std::thread> threads;
+  threads.reserve(threadsCount);
+  for (size_t idx = 0; idx < threadsCount; idx++) {
+    threads.emplace_back([&aggregator, &first, &second]() {
+      for (size_t count = 0; count < 1000; count++) {
+        /* both clients are in the same /24 */
+        aggregator->record(ComboAddress("192.0.2.1"), first, QType::A, RCode::NoError);
+        aggregator->record(ComboAddress("192.0.2.200"), first, QType::A, RCode::NoError);
+        aggregator->record(ComboAddress("2001:db8::1"), second, QType::AAAA, RCode::NoError);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  /* the window has not ended yet */
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr)), 0U);
+  BOOST_CHECK(logger->d_messages.empty());
+
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr) + 3600), 2U);
+  auto summaries = parseSummaries(logger->d_messages);
+  BOOST_REQUIRE_EQUAL(summaries.size(), 2U);
+  BOOST_CHECK_EQUAL(summaries.at("a.powerdns.com./4/0").d_count, 2 * threadsCount * 1000);
+  BOOST_CHECK(summaries.at("a.powerdns.com./4/0").d_from == ComboAddress("192.0.2.0").toByteString());
+  BOOST_CHECK_EQUAL(summaries.at("b.powerdns.com./16/0").d_count, threadsCount * 1000);
+
+  /* and the tables are now empty */
+  logger->d_messages.clear();
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr) + 7200), 0U);
+  BOOST_CHECK(logger->d_messages.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_AggregationResponsesAndLimit)
+{
+  auto logger = std::make_shared<CapturingLogger>();
+  Aggregator::Configuration config;
+  config.d_logger = logger;
+  config.d_interval = 1;
+  config.d_maxEntries = 3;
+  config.d_responses = true;
+  auto aggregator = Aggregator::create(std::move(config));
+
+  const DNSName qname("powerdns.com.");
+  const ComboAddress client("192.0.2.1");
+  /* the rcode is part of the tuple for responses */
+  aggregator->record(client, qname, QType::A, RCode::NoError);
+  aggregator->record(client, qname, QType::A, RCode::ServFail);
+  aggregator->record(client, qname, QType::A, RCode::ServFail);
+  /* over the limit, these go to the catch-all tuple */
+  for (size_t idx = 0; idx < 10; idx++) {
+    aggregator->record(client, DNSName("name-" + std::to_string(idx) + ".powerdns.com."), QType::A, RCode::NoError);
+  }
+
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr) + 3600), 4U);
+  auto summaries = parseSummaries(logger->d_messages);
+  BOOST_REQUIRE_EQUAL(summaries.size(), 4U);
+  BOOST_CHECK_EQUAL(summaries.at("powerdns.com./4/0").d_count, 1U);
+  BOOST_CHECK_EQUAL(summaries.at("powerdns.com./4/2").d_count, 2U);
+  uint64_t total = 0;
+  for (const auto& [key, summary] : summaries) {
+    total += summary.d_count;
+  }
+  BOOST_CHECK_EQUAL(total, 13U);
+  BOOST_CHECK_EQUAL(summaries.at("/0/0").d_count, 9U);
+}
+
+BOOST_AUTO_TEST_CASE(test_AggregationQueueFull)
+{
+  auto logger = std::make_shared<SlowLogger>();
+  Aggregator::Configuration config;
+  config.d_logger = logger;
+  config.d_interval = 1;
+  auto aggregator = Aggregator::create(std::move(config));
+
+  const ComboAddress client("192.0.2.1");
+  for (size_t idx = 0; idx < 10; idx++) {
+    aggregator->record(client, DNSName("name-" + std::to_string(idx) + ".powerdns.com."), QType::A, RCode::NoError);
+  }
+  /* every summary is eventually queued, at the pace the queue is drained */
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr) + 3600), 10U);
+  BOOST_CHECK_EQUAL(logger->d_messages.size(), 10U);
+  BOOST_CHECK_EQUAL(aggregator->getDroppedCount(), 0U);
+
+  /* other errors are not retried, and the summaries are counted as dropped */
+  logger->d_result = RemoteLoggerInterface::Result::OtherError;
+  for (size_t idx = 0; idx < 5; idx++) {
+    aggregator->record(client, DNSName("name-" + std::to_string(idx) + ".powerdns.com."), QType::A, RCode::NoError);
+  }
+  BOOST_CHECK_EQUAL(aggregator->flush(time(nullptr) + 7200), 0U);
+  BOOST_CHECK_EQUAL(aggregator->getDroppedCount(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(test_AggregationConcurrentFlush)
+{
+  /* the tables are flushed while the threads are recording, nothing should be lost or counted twice */
+  auto logger = std::make_shared<CapturingLogger>();
+  Aggregator::Configuration config;
+  config.d_logger = logger;
+  config.d_interval = 1;
+  auto aggregator = Aggregator::create(std::move(config));
+
+  const DNSName qname("powerdns.com.");
+  const size_t threadsCount = 4;
+  const size_t perThread = 100000;
+  std::atomic<size_t> done{0};
+  std::vector<std::thread> threads;
+  threads.reserve(threadsCount);
+  for (size_t idx = 0; idx < threadsCount; idx++) {
+    threads.emplace_back([&aggregator, &qname, &done]() {
+      for (size_t count = 0; count < perThread; count++) {
+        aggregator->record(ComboAddress("192.0.2.1"), qname, QType::A, RCode::NoError);
+      }
+      ++done;
+    });
+  }
+
+  time_t now = time(nullptr);
+  while (done < threadsCount) {
+    now += 3600;
+    aggregator->flush(now);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  aggregator->flush(now + 3600);
+
+  uint64_t total = 0;
+  for (const auto& message : logger->d_messages) {
+    total += parseSummary(message).d_count;
+  }
+  BOOST_CHECK_EQUAL(total, threadsCount * perThread);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -296,4 +296,299 @@ BOOST_AUTO_TEST_CASE(test_Rings_Threaded) {
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(test_Rings_LockFree)
+{
+  const size_t maxEntries = 10;
+  const size_t numberOfShards = 2;
+  const size_t entriesPerShard = maxEntries / numberOfShards;
+  Rings rings(maxEntries, numberOfShards);
+  rings.setLockFree(true);
+  rings.init();
+  BOOST_CHECK(rings.isLockFree());
+  BOOST_CHECK_THROW(rings.setLockFree(false), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(rings.d_lockFreeShards.size(), numberOfShards);
+
+  dnsheader dh;
+  memset(&dh, 0, sizeof(dh));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  ComboAddress requestor2("192.0.2.2");
+  ComboAddress server("192.0.2.42");
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  unsigned int latency = 100;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  struct timespec now;
+  gettime(&now);
+
+  /* this thread owns the first lock-free shard, fill it */
+  for (size_t idx = 0; idx < entriesPerShard; idx++) {
+    rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+    rings.insertResponse(now, requestor1, qname, qtype, latency, size, dh, server, protocol);
+  }
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerShard);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), entriesPerShard);
+  BOOST_CHECK_EQUAL(rings.getNumberOfOverwrittenEntries(), 0U);
+
+  size_t count = 0;
+  rings.visitQueries([&](const Rings::Query& entry) {
+    BOOST_CHECK_EQUAL(entry.name, qname);
+    BOOST_CHECK_EQUAL(entry.qtype, qtype);
+    BOOST_CHECK_EQUAL(entry.size, size);
+    BOOST_CHECK_EQUAL(entry.when.tv_sec, now.tv_sec);
+    BOOST_CHECK_EQUAL(entry.requestor.toStringWithPort(), requestor1.toStringWithPort());
+    count++;
+  });
+  BOOST_CHECK_EQUAL(count, entriesPerShard);
+
+  count = 0;
+  rings.visitResponses([&](const Rings::Response& entry) {
+    BOOST_CHECK_EQUAL(entry.name, qname);
+    BOOST_CHECK_EQUAL(entry.usec, latency);
+    BOOST_CHECK_EQUAL(entry.ds.toStringWithPort(), server.toStringWithPort());
+    count++;
+  });
+  BOOST_CHECK_EQUAL(count, entriesPerShard);
+
+  /* now overwrite all of them */
+  for (size_t idx = 0; idx < entriesPerShard; idx++) {
+    rings.insertQuery(now, requestor2, qname, qtype, size, dh, protocol);
+  }
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerShard);
+  BOOST_CHECK_EQUAL(rings.getNumberOfOverwrittenEntries(), entriesPerShard);
+  count = 0;
+  rings.visitQueries([&](const Rings::Query& entry) {
+    BOOST_CHECK_EQUAL(entry.requestor.toStringWithPort(), requestor2.toStringWithPort());
+    count++;
+  });
+  BOOST_CHECK_EQUAL(count, entriesPerShard);
+
+  /* another thread gets its own shard, and the next one falls back to the regular, locked, shard.
+     The second one is started from the first one so that they cannot share the same thread ID */
+  std::thread writer([&]() {
+    rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+    std::thread nested([&]() {
+      rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+    });
+    nested.join();
+  });
+  writer.join();
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerShard + 2);
+  BOOST_CHECK_EQUAL(rings.d_lockFreeShards.at(1)->queryRing.getOverwrites(), 0U);
+  BOOST_CHECK_EQUAL(rings.d_shards.at(0)->queryRing.lock()->size(), 1U);
+
+  count = 0;
+  rings.visitQueries([&](const Rings::Query&) {
+    count++;
+  });
+  BOOST_CHECK_EQUAL(count, entriesPerShard + 2);
+
+  rings.clear();
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 0U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), 0U);
+  count = 0;
+  rings.visitQueries([&](const Rings::Query&) {
+    count++;
+  });
+  rings.visitResponses([&](const Rings::Response&) {
+    count++;
+  });
+  BOOST_CHECK_EQUAL(count, 0U);
+
+  /* inserting after a clear does not count as an overwrite */
+  rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 1U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfOverwrittenEntries(), entriesPerShard);
+
+  /* a re-initialization gives us a brand new shard */
+  rings.reset();
+  rings.init();
+  rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 1U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfOverwrittenEntries(), 0U);
+}
+
+static void lockFreeRingReaderThread(Rings& rings, std::atomic<bool>& done, size_t numberOfEntries, uint16_t qtype, const DNSName& qname)
+{
+  size_t iterationsDone = 0;
+
+  while (done == false) {
+    size_t numberOfQueries = 0;
+    size_t numberOfResponses = 0;
+    bool valid = true;
+
+    rings.visitQueries([&](const Rings::Query& entry) {
+      numberOfQueries++;
+      if (entry.qtype != qtype || entry.name != qname) {
+        valid = false;
+      }
+    });
+    rings.visitResponses([&](const Rings::Response& entry) {
+      numberOfResponses++;
+      if (entry.qtype != qtype || entry.name != qname) {
+        valid = false;
+      }
+    });
+
+    if (!valid) {
+      cerr<<"Invalid entry read from a lock-free ring!"<<endl;
+      BOOST_CHECK(valid);
+      return;
+    }
+    BOOST_CHECK_LE(numberOfQueries, numberOfEntries);
+    BOOST_CHECK_LE(numberOfResponses, numberOfEntries);
+    iterationsDone++;
+    usleep(1000);
+  }
+
+  BOOST_CHECK_GT(iterationsDone, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(test_Rings_VisitFrom)
+{
+  dnsheader dh;
+  memset(&dh, 0, sizeof(dh));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor("192.0.2.1");
+  ComboAddress server("192.0.2.42");
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  struct timespec now;
+  gettime(&now);
+
+  for (const auto lockFree : {false, true}) {
+    /* a single shard holding 10 entries in both modes */
+    Rings rings(10, 1);
+    rings.setLockFree(lockFree);
+    rings.init();
+    const size_t shardIdx = lockFree ? 1 : 0;
+    BOOST_REQUIRE_EQUAL(rings.getNumberOfShardsToVisit(), shardIdx + 1);
+
+    for (uint16_t qtype = 0; qtype < 5; qtype++) {
+      rings.insertQuery(now, requestor, qname, qtype, size, dh, protocol);
+    }
+
+    std::vector<std::pair<uint64_t, uint16_t>> seen;
+    auto visitor = [&seen](uint64_t position, const Rings::Query& entry) {
+      seen.emplace_back(position, entry.qtype);
+    };
+    auto [oldest, next] = rings.visitQueriesFrom(shardIdx, 0, visitor, false);
+    BOOST_CHECK_EQUAL(oldest, 0U);
+    BOOST_CHECK_EQUAL(next, 5U);
+    BOOST_REQUIRE_EQUAL(seen.size(), 5U);
+    for (size_t idx = 0; idx < seen.size(); idx++) {
+      BOOST_CHECK_EQUAL(seen.at(idx).first, idx);
+      BOOST_CHECK_EQUAL(seen.at(idx).second, idx);
+    }
+
+    /* only the new entries, some of the old ones being evicted */
+    for (uint16_t qtype = 5; qtype < 12; qtype++) {
+      rings.insertQuery(now, requestor, qname, qtype, size, dh, protocol);
+    }
+    seen.clear();
+    std::tie(oldest, next) = rings.visitQueriesFrom(shardIdx, next, visitor, false);
+    BOOST_CHECK_EQUAL(oldest, 2U);
+    BOOST_CHECK_EQUAL(next, 12U);
+    BOOST_REQUIRE_EQUAL(seen.size(), 7U);
+    BOOST_CHECK_EQUAL(seen.front().first, 5U);
+    BOOST_CHECK_EQUAL(seen.front().second, 5U);
+    BOOST_CHECK_EQUAL(seen.back().first, 11U);
+    BOOST_CHECK_EQUAL(seen.back().second, 11U);
+
+    /* entries we missed that have been evicted are skipped */
+    seen.clear();
+    std::tie(oldest, next) = rings.visitQueriesFrom(shardIdx, 1, visitor, false);
+    BOOST_CHECK_EQUAL(seen.size(), 10U);
+    BOOST_CHECK_EQUAL(seen.front().first, 2U);
+
+    /* nothing is left after a clear */
+    rings.clear();
+    seen.clear();
+    std::tie(oldest, next) = rings.visitQueriesFrom(shardIdx, 0, visitor, false);
+    BOOST_CHECK(seen.empty());
+    BOOST_CHECK_EQUAL(oldest, next);
+
+    /* responses are numbered separately */
+    rings.insertResponse(now, requestor, qname, QType::A, 100, size, dh, server, protocol);
+    std::tie(oldest, next) = rings.visitResponsesFrom(shardIdx, 0, [&qname](uint64_t position, const Rings::Response& entry) {
+      BOOST_CHECK_EQUAL(position, 0U);
+      BOOST_CHECK_EQUAL(entry.name, qname);
+    });
+    BOOST_CHECK_EQUAL(oldest, 0U);
+    BOOST_CHECK_EQUAL(next, 1U);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_Rings_LockFree_Threaded) {
+  size_t numberOfEntries = 1000000;
+  size_t numberOfWriterThreads = 4;
+  /* one shard per writer thread, none of them using the locked fallback */
+  size_t numberOfShards = numberOfWriterThreads;
+  size_t entriesPerShard = numberOfEntries / numberOfShards;
+
+  struct timespec now;
+  gettime(&now);
+  dnsheader dh;
+  memset(&dh, 0, sizeof(dh));
+  dh.id = htons(4242);
+  dh.qdcount = htons(1);
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor("192.0.2.1");
+  ComboAddress server("192.0.2.42");
+  unsigned int latency = 100;
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  dnsdist::Protocol outgoingProtocol = dnsdist::Protocol::DoUDP;
+
+  Rings rings(numberOfEntries, numberOfShards);
+  rings.setLockFree(true);
+  rings.init();
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+  Rings::Query query({requestor, qname, now, dh, size, qtype, protocol, dnsdist::MacAddress(), false});
+#else
+  Rings::Query query({requestor, qname, now, dh, size, qtype, protocol});
+#endif
+  Rings::Response response({requestor, server, qname, now, dh, latency, size, qtype, outgoingProtocol});
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> writerThreads;
+  std::thread readerThread(lockFreeRingReaderThread, std::ref(rings), std::ref(done), numberOfEntries, qtype, std::cref(qname));
+
+  /* every writer owns its shard, so we know exactly how many entries will be overwritten */
+  size_t insertionsPerThread = entriesPerShard * 2;
+  for (size_t idx = 0; idx < numberOfWriterThreads; idx++) {
+    writerThreads.push_back(std::thread(ringWriterThread, std::ref(rings), insertionsPerThread, query, response));
+  }
+
+  for (auto& t : writerThreads) {
+    t.join();
+  }
+
+  done = true;
+  readerThread.join();
+
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), numberOfEntries);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), numberOfEntries);
+  BOOST_CHECK_EQUAL(rings.getNumberOfOverwrittenEntries(), 2 * numberOfEntries);
+  BOOST_CHECK_EQUAL(rings.d_shards.at(0)->queryRing.lock()->size(), 0U);
+
+  size_t totalQueries = 0;
+  rings.visitQueries([&](const Rings::Query& entry) {
+    BOOST_CHECK_EQUAL(entry.name, qname);
+    BOOST_CHECK_EQUAL(entry.qtype, qtype);
+    BOOST_CHECK_EQUAL(entry.size, size);
+    BOOST_CHECK_EQUAL(entry.when.tv_sec, now.tv_sec);
+    totalQueries++;
+  });
+  size_t totalResponses = 0;
+  rings.visitResponses([&](const Rings::Response& entry) {
+    BOOST_CHECK_EQUAL(entry.usec, latency);
+    BOOST_CHECK_EQUAL(entry.ds.toStringWithPort(), server.toStringWithPort());
+    totalResponses++;
+  });
+  BOOST_CHECK_EQUAL(totalQueries, numberOfEntries);
+  BOOST_CHECK_EQUAL(totalResponses, numberOfEntries);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 
 #define BOOST_TEST_NO_MAIN
 
+#include <random>
 #include <thread>
 #include <boost/test/unit_test.hpp>
 
@@ -228,4 +229,203 @@ BOOST_AUTO_TEST_CASE(test_payloadSizeRule) {
   BOOST_CHECK_THROW(PayloadSizeRule("invalid", 42U), std::runtime_error);
 }
 
+class CountingRule : public DNSRule
+{
+public:
+  CountingRule(bool result) :
+    d_result(result)
+  {
+  }
+  bool matches(const DNSQuestion* dnsQuestion) const override
+  {
+    ++d_evaluated;
+    return d_result;
+  }
+  string toString() const override
+  {
+    return "counting";
+  }
+  mutable size_t d_evaluated{0};
+
+private:
+  bool d_result;
+};
+
+static dnsdist::rules::RuleAction makeRuleAction(std::shared_ptr<DNSRule> rule)
+{
+  return {std::move(rule), nullptr, "", getUniqueID(), 0};
+}
+
+static std::optional<size_t> getFirstMatch(const dnsdist::rules::RuleActions& rules, const DNSQuestion& dnsQuestion)
+{
+  auto candidates = rules.getCompiled().getCandidates(dnsQuestion.ids.qname, dnsQuestion.ids.qtype, dnsQuestion.getHeader()->opcode, dnsQuestion.ids.origRemote);
+  size_t position = 0;
+  while (candidates.next(position)) {
+    if (rules.at(position).d_rule->matches(&dnsQuestion)) {
+      return position;
+    }
+  }
+  return std::nullopt;
+}
+
+static std::optional<size_t> getFirstMatchLinear(const dnsdist::rules::RuleActions& rules, const DNSQuestion& dnsQuestion)
+{
+  for (size_t position = 0; position < rules.size(); position++) {
+    if (rules.at(position).d_rule->matches(&dnsQuestion)) {
+      return position;
+    }
+  }
+  return std::nullopt;
+}
+
+static std::vector<size_t> getCandidates(const dnsdist::rules::RuleActions& rules, const DNSName& qname, uint16_t qtype, uint8_t opcode, const ComboAddress& source, size_t from = 0)
+{
+  std::vector<size_t> result;
+  auto candidates = rules.getCompiled().getCandidates(qname, qtype, opcode, source, from);
+  size_t position = 0;
+  while (candidates.next(position)) {
+    result.push_back(position);
+  }
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_CompiledRuleChain) {
+  NetmaskGroup sources;
+  sources.addMask("192.0.2.0/24");
+  sources.addMask("192.0.2.128/25");
+  sources.addMask("!192.0.2.1");
+  NetmaskGroup subnet;
+  subnet.addMask("192.0.2.0/28");
+  SuffixMatchNode powerdns;
+  powerdns.add(DNSName("powerdns.com."));
+  SuffixMatchNode com;
+  com.add(DNSName("com."));
+  auto counting = std::make_shared<CountingRule>(true);
+
+  dnsdist::rules::RuleActions rules;
+  rules.push_back(makeRuleAction(std::make_shared<QTypeRule>(QType::AAAA)));
+  rules.push_back(makeRuleAction(std::make_shared<SuffixMatchNodeRule>(powerdns)));
+  rules.push_back(makeRuleAction(std::make_shared<QNameRule>(DNSName("www.example.net."))));
+  rules.push_back(makeRuleAction(std::make_shared<NetmaskGroupRule>(sources, true)));
+  rules.push_back(makeRuleAction(std::make_shared<CountingRule>(false)));
+  rules.push_back(makeRuleAction(std::make_shared<OpcodeRule>(Opcode::Notify)));
+  rules.push_back(makeRuleAction(std::make_shared<AndRule>(std::vector<std::pair<int, std::shared_ptr<DNSRule>>>{{1, std::make_shared<QTypeRule>(QType::TXT)}, {2, counting}})));
+  rules.push_back(makeRuleAction(std::make_shared<OrRule>(std::vector<std::pair<int, std::shared_ptr<DNSRule>>>{{1, std::make_shared<QTypeRule>(QType::MX)}, {2, std::make_shared<QTypeRule>(QType::NS)}})));
+  rules.push_back(makeRuleAction(std::make_shared<NetmaskGroupRule>(subnet, false)));
+  rules.push_back(makeRuleAction(std::make_shared<SuffixMatchNodeRule>(com)));
+  rules.push_back(makeRuleAction(std::make_shared<NetmaskGroupRule>(subnet, true)));
+  rules.push_back(makeRuleAction(std::make_shared<OrRule>(std::vector<std::pair<int, std::shared_ptr<DNSRule>>>{{1, std::make_shared<QTypeRule>(QType::SOA)}, {2, std::make_shared<OpcodeRule>(Opcode::Update)}})));
+
+  /* the destination netmask rule, the counting one and the mixed OrRule are not indexed */
+  BOOST_CHECK_EQUAL(rules.getCompiled().getIndexedRulesCount(), rules.size() - 3);
+
+  const ComboAddress outside("198.51.100.1");
+  BOOST_CHECK(getCandidates(rules, DNSName("www.example.org."), QType::A, Opcode::Query, outside) == std::vector<size_t>({4, 8, 11}));
+  BOOST_CHECK(getCandidates(rules, DNSName("www.example.org."), QType::AAAA, Opcode::Query, outside) == std::vector<size_t>({0, 4, 8, 11}));
+  /* both powerdns.com. and its ancestor com. */
+  BOOST_CHECK(getCandidates(rules, DNSName("www.POWERDNS.com."), QType::A, Opcode::Query, outside) == std::vector<size_t>({1, 4, 8, 9, 11}));
+  BOOST_CHECK(getCandidates(rules, DNSName("foo.www.example.net."), QType::TXT, Opcode::Notify, outside) == std::vector<size_t>({2, 4, 5, 6, 8, 11}));
+  /* 192.0.2.0/28 is in 192.0.2.0/24 */
+  BOOST_CHECK(getCandidates(rules, DNSName("www.example.org."), QType::MX, Opcode::Query, ComboAddress("192.0.2.2")) == std::vector<size_t>({3, 4, 7, 8, 10, 11}));
+  BOOST_CHECK(getCandidates(rules, DNSName("www.example.org."), QType::A, Opcode::Query, ComboAddress("192.0.2.200")) == std::vector<size_t>({3, 4, 8, 11}));
+  BOOST_CHECK(getCandidates(rules, DNSName("www.example.org."), QType::A, Opcode::Query, ComboAddress("192.0.2.200"), 5) == std::vector<size_t>({8, 11}));
+
+  /* copies are indexed on their own */
+  auto copy = rules;
+  copy.erase(copy.begin());
+  BOOST_CHECK(getCandidates(copy, DNSName("www.example.org."), QType::AAAA, Opcode::Query, outside) == std::vector<size_t>({3, 7, 10}));
+
+  /* evaluating only the candidates gives the same result, including the side effects */
+  const std::vector<DNSName> names{DNSName("powerdns.com."), DNSName("www.powerdns.com."), DNSName("www.example.net."), DNSName("example.net."), DNSName("www.example.org."), DNSName(".")};
+  const std::vector<uint16_t> qtypes{QType::A, QType::AAAA, QType::TXT, QType::MX, QType::NS, QType::SOA};
+  const std::vector<uint8_t> opcodes{Opcode::Query, Opcode::Notify, Opcode::Update};
+  std::mt19937 gen(42);
+  for (size_t idx = 0; idx < 10000; idx++) {
+    InternalQueryState ids;
+    ids.qname = names.at(gen() % names.size());
+    ids.qtype = qtypes.at(gen() % qtypes.size());
+    ids.qclass = QClass::IN;
+    ids.origRemote = ComboAddress("192.0.2." + std::to_string(gen() % 256));
+    ids.origDest = ComboAddress("192.0.2." + std::to_string(gen() % 32));
+    ids.protocol = dnsdist::Protocol::DoUDP;
+    dnsheader dnsHeader{};
+    dnsHeader.opcode = opcodes.at(gen() % opcodes.size());
+    PacketBuffer packet(sizeof(dnsHeader));
+    memcpy(packet.data(), &dnsHeader, sizeof(dnsHeader));
+    DNSQuestion dnsQuestion(ids, packet);
+
+    const auto before = counting->d_evaluated;
+    const auto expected = getFirstMatchLinear(rules, dnsQuestion);
+    const auto evaluated = counting->d_evaluated - before;
+    BOOST_REQUIRE(getFirstMatch(rules, dnsQuestion) == expected);
+    BOOST_REQUIRE_EQUAL(counting->d_evaluated - before, 2 * evaluated);
+  }
+}
+
+#ifdef BENCH_RULES
+static dnsdist::rules::RuleActions getBenchRules(size_t count)
+{
+  dnsdist::rules::RuleActions rules;
+  for (size_t idx = 0; idx < count; idx++) {
+    switch (idx % 4) {
+    case 0: {
+      SuffixMatchNode smn;
+      smn.add(DNSName("domain-" + std::to_string(idx) + ".example."));
+      rules.push_back(makeRuleAction(std::make_shared<SuffixMatchNodeRule>(smn)));
+      break;
+    }
+    case 1:
+      rules.push_back(makeRuleAction(std::make_shared<QNameRule>(DNSName("www.name-" + std::to_string(idx) + ".example."))));
+      break;
+    case 2: {
+      NetmaskGroup nmg;
+      nmg.addMask("10." + std::to_string((idx / 256) % 256) + "." + std::to_string(idx % 256) + ".0/24");
+      rules.push_back(makeRuleAction(std::make_shared<NetmaskGroupRule>(nmg, true)));
+      break;
+    }
+    default:
+      rules.push_back(makeRuleAction(std::make_shared<AndRule>(std::vector<std::pair<int, std::shared_ptr<DNSRule>>>{{1, std::make_shared<QTypeRule>(1024 + idx)}, {2, std::make_shared<QNameRule>(DNSName("name-" + std::to_string(idx) + ".example."))}})));
+      break;
+    }
+  }
+  return rules;
+}
+
+BOOST_AUTO_TEST_CASE(test_CompiledRuleChain_Bench) {
+  InternalQueryState ids;
+  ids.qname = DNSName("www.powerdns.com.");
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.origRemote = ComboAddress("192.0.2.1");
+  ids.origDest = ComboAddress("127.0.0.1:53");
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  PacketBuffer packet(sizeof(dnsheader));
+  DNSQuestion dnsQuestion(ids, packet);
+  const size_t queries = 100000;
+
+  for (const size_t count : {10, 100, 1000}) {
+    const auto rules = getBenchRules(count);
+    StopWatch sw;
+    sw.start();
+    rules.getCompiled();
+    const auto compilation = sw.udiff();
+
+    /* no rule matches, the worst case for the linear evaluation */
+    size_t matches = 0;
+    sw.start();
+    for (size_t idx = 0; idx < queries; idx++) {
+      matches += getFirstMatchLinear(rules, dnsQuestion) ? 1 : 0;
+    }
+    const auto linear = sw.udiff();
+    sw.start();
+    for (size_t idx = 0; idx < queries; idx++) {
+      matches += getFirstMatch(rules, dnsQuestion) ? 1 : 0;
+    }
+    const auto compiled = sw.udiff();
+    BOOST_CHECK_EQUAL(matches, 0U);
+    cerr << count << " rules: " << queries << " queries in " << linear / 1000 << "ms (linear) vs " << compiled / 1000 << "ms (compiled, built in " << compilation << "us)" << endl;
+  }
+}
+#endif /* BENCH_RULES */
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,294 @@
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <random>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist.hh"
+#include "dnsdist-sketches.hh"
+#include "gettime.hh"
+
+using namespace dnsdist::sketches;
+
+BOOST_AUTO_TEST_SUITE(dnsdistsketches_cc)
+
+BOOST_AUTO_TEST_CASE(test_CountMinSketch)
+{
+  BOOST_CHECK_THROW(CountMinSketch(0, 4), std::runtime_error);
+  BOOST_CHECK_THROW(CountMinSketch(1024, 0), std::runtime_error);
+
+  CountMinSketch sketch(1024, 4);
+  BOOST_CHECK_EQUAL(sketch.estimate(42), 0U);
+
+  std::hash<uint32_t> hasher;
+  std::unordered_map<uint32_t, uint64_t> actual;
+  std::mt19937 gen(42);
+  uint64_t total = 0;
+  for (size_t idx = 0; idx < 100000; idx++) {
+    /* a few keys are much more frequent than the others */
+    uint32_t key = (idx % 10 == 0) ? (idx % 50) : gen() % 10000;
+    sketch.add(hasher(key));
+    actual[key]++;
+    total++;
+  }
+
+  for (const auto& [key, count] : actual) {
+    const auto estimate = sketch.estimate(hasher(key));
+    /* never underestimate */
+    BOOST_CHECK_GE(estimate, count);
+    /* and with a width of 1024, the overestimation is very likely below e / 1024 * total */
+    BOOST_CHECK_LE(estimate, count + (total * 3 / 1024));
+  }
+
+  sketch.add(hasher(424242), 1000);
+  BOOST_CHECK_GE(sketch.estimate(hasher(424242)), 1000U);
+
+  sketch.clear();
+  for (const auto& entry : actual) {
+    BOOST_CHECK_EQUAL(sketch.estimate(hasher(entry.first)), 0U);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_SpaceSaving)
+{
+  SpaceSaving<std::string> list(3);
+  BOOST_CHECK_EQUAL(list.getCapacity(), 3U);
+
+  list.add("a", 10);
+  list.add("b", 5);
+  list.add("c", 1);
+  list.add("b", 1);
+  BOOST_CHECK_EQUAL(list.size(), 3U);
+
+  /* "d" replaces "c", the entry with the lowest count, and inherits its count as error */
+  list.add("d", 2);
+  BOOST_CHECK_EQUAL(list.size(), 3U);
+
+  std::vector<SpaceSaving<std::string>::Entry> entries;
+  list.visit([&entries](const SpaceSaving<std::string>::Entry& entry) {
+    entries.push_back(entry);
+  });
+  BOOST_REQUIRE_EQUAL(entries.size(), 3U);
+  BOOST_CHECK_EQUAL(entries.at(0).d_key, "a");
+  BOOST_CHECK_EQUAL(entries.at(0).d_count, 10U);
+  BOOST_CHECK_EQUAL(entries.at(0).d_error, 0U);
+  BOOST_CHECK_EQUAL(entries.at(1).d_key, "b");
+  BOOST_CHECK_EQUAL(entries.at(1).d_count, 6U);
+  BOOST_CHECK_EQUAL(entries.at(2).d_key, "d");
+  BOOST_CHECK_EQUAL(entries.at(2).d_count, 3U);
+  BOOST_CHECK_EQUAL(entries.at(2).d_error, 1U);
+
+  list.clear();
+  BOOST_CHECK_EQUAL(list.size(), 0U);
+
+  SpaceSaving<std::string> empty(0);
+  empty.add("a");
+  BOOST_CHECK_EQUAL(empty.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_SpaceSaving_HeavyHitters)
+{
+  /* every key responsible for more than 1/capacity of the total has to be present */
+  SpaceSaving<uint32_t> list(20);
+  std::mt19937 gen(42);
+  for (size_t idx = 0; idx < 100000; idx++) {
+    if (idx % 4 == 0) {
+      list.add(1000000 + (idx % 5));
+    }
+    else {
+      list.add(gen() % 100000);
+    }
+  }
+
+  std::set<uint32_t> found;
+  list.visit([&found](const SpaceSaving<uint32_t>::Entry& entry) {
+    found.insert(entry.d_key);
+  });
+  for (uint32_t key = 1000000; key < 1000005; key++) {
+    BOOST_CHECK(found.count(key) == 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_HeavyHitters)
+{
+  BOOST_CHECK_THROW((HeavyHitters<uint16_t>(0, 4, 10, 60)), std::runtime_error);
+  BOOST_CHECK_THROW((HeavyHitters<uint16_t>(1024, 4, 10, 0)), std::runtime_error);
+
+  const unsigned int window = 10;
+  HeavyHitters<DNSName> heavyHitters(1024, 4, 10, window);
+  BOOST_CHECK_EQUAL(heavyHitters.getWindow(), window);
+
+  const time_t now = time(nullptr);
+  const DNSName heavy("heavy.powerdns.com.");
+  const DNSName medium("medium.powerdns.com.");
+  for (size_t idx = 0; idx < 1000; idx++) {
+    heavyHitters.add(heavy, now);
+    if (idx % 2 == 0) {
+      heavyHitters.add(medium, now);
+    }
+    heavyHitters.add(DNSName("name-" + std::to_string(idx) + ".powerdns.com."), now);
+  }
+  /* names are case-insensitive */
+  heavyHitters.add(DNSName("HEAVY.powerdns.com."), now, 10);
+
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(heavy, now), 1010U);
+  BOOST_CHECK_GE(heavyHitters.estimate(medium, now), 500U);
+
+  auto top = heavyHitters.getTop(2, now);
+  BOOST_REQUIRE_EQUAL(top.size(), 2U);
+  BOOST_CHECK_EQUAL(top.at(0).d_key, heavy);
+  BOOST_CHECK_EQUAL(top.at(0).d_count, 1010U);
+  BOOST_CHECK_EQUAL(top.at(1).d_key, medium);
+
+  /* half-way through the next window, half of the previous epoch still counts */
+  time_t later = now + window + (window / 2);
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(heavy, later), 505U);
+  /* new entries go to the new epoch */
+  heavyHitters.add(heavy, later, 100);
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(heavy, later), 605U);
+  top = heavyHitters.getTop(1, later);
+  BOOST_REQUIRE_EQUAL(top.size(), 1U);
+  BOOST_CHECK_EQUAL(top.at(0).d_key, heavy);
+  BOOST_CHECK_EQUAL(top.at(0).d_count, 605U);
+
+  /* two windows later, nothing is left */
+  later += 2 * window;
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(heavy, later), 0U);
+  BOOST_CHECK(heavyHitters.getTop(10, later).empty());
+
+  heavyHitters.add(medium, later);
+  heavyHitters.clear();
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(medium, later), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_HeavyHitters_Threads)
+{
+  /* every thread writes to its own sketches, readers merge them */
+  const unsigned int window = 60;
+  HeavyHitters<uint32_t> heavyHitters(1024, 4, 10, window);
+  const time_t now = time(nullptr);
+  const size_t numberOfWriters = 4;
+  const size_t perWriter = 10000;
+  std::atomic<bool> done{false};
+
+  std::thread reader([&heavyHitters, &done, now]() {
+    uint64_t previous = 0;
+    while (!done.load()) {
+      auto top = heavyHitters.getTop(1, now);
+      if (!top.empty()) {
+        BOOST_CHECK_EQUAL(top.at(0).d_key, 0U);
+        /* the count only goes up */
+        BOOST_CHECK_GE(top.at(0).d_count, previous);
+        previous = top.at(0).d_count;
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (size_t writerIdx = 0; writerIdx < numberOfWriters; writerIdx++) {
+    writers.emplace_back([&heavyHitters, writerIdx, now]() {
+      for (size_t idx = 0; idx < perWriter; idx++) {
+        heavyHitters.add(0, now);
+        heavyHitters.add(static_cast<uint32_t>(1 + (writerIdx * perWriter) + idx), now);
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  BOOST_CHECK_EQUAL(heavyHitters.getNumberOfWriters(), numberOfWriters);
+  BOOST_CHECK_GE(heavyHitters.estimate(0, now), numberOfWriters * perWriter);
+  auto top = heavyHitters.getTop(1, now);
+  BOOST_REQUIRE_EQUAL(top.size(), 1U);
+  BOOST_CHECK_EQUAL(top.at(0).d_key, 0U);
+  BOOST_CHECK_GE(top.at(0).d_count, numberOfWriters * perWriter);
+
+  heavyHitters.clear();
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(0, now), 0U);
+  BOOST_CHECK(heavyHitters.getTop(10, now).empty());
+  /* a thread that adds a key after the clear starts from scratch */
+  heavyHitters.add(0, now);
+  BOOST_CHECK_EQUAL(heavyHitters.estimate(0, now), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(test_HeavyHittersTracker)
+{
+  HeavyHittersTracker::Options options;
+  options.d_v4Mask = 24;
+  options.d_suffixLabels = 2;
+  options.d_window = 60;
+  HeavyHittersTracker tracker(options);
+
+  Rings rings(1000, 1);
+  rings.addObserver(std::shared_ptr<HeavyHittersTracker>(&tracker, [](HeavyHittersTracker*) {}));
+  rings.init();
+
+  dnsheader dnsHeader{};
+  struct timespec now{};
+  gettime(&now);
+  for (size_t idx = 0; idx < 100; idx++) {
+    rings.insertQuery(now, ComboAddress("192.0.2." + std::to_string(idx)), DNSName("www" + std::to_string(idx) + ".powerdns.com."), QType::A, 42, dnsHeader, dnsdist::Protocol::DoUDP);
+  }
+  rings.insertQuery(now, ComboAddress("2001:db8::1"), DNSName("com."), QType::AAAA, 42, dnsHeader, dnsdist::Protocol::DoUDP);
+
+  auto clients = tracker.getClients().getTop(10, now.tv_sec);
+  BOOST_REQUIRE_EQUAL(clients.size(), 2U);
+  BOOST_CHECK_EQUAL(clients.at(0).d_key.toString(), "192.0.2.0/24");
+  BOOST_CHECK_EQUAL(clients.at(0).d_count, 100U);
+  BOOST_CHECK_EQUAL(clients.at(1).d_key.toString(), "2001:db8::1/128");
+  BOOST_CHECK_EQUAL(clients.at(1).d_count, 1U);
+
+  auto suffixes = tracker.getSuffixes().getTop(10, now.tv_sec);
+  BOOST_REQUIRE_EQUAL(suffixes.size(), 2U);
+  BOOST_CHECK_EQUAL(suffixes.at(0).d_key, DNSName("powerdns.com."));
+  BOOST_CHECK_EQUAL(suffixes.at(0).d_count, 100U);
+  BOOST_CHECK_EQUAL(suffixes.at(1).d_key, DNSName("com."));
+  /* the suffixes are hashed from the storage of the query name, which has to match the hash of the suffix itself */
+  BOOST_CHECK_EQUAL(tracker.getSuffixes().estimate(DNSName("POWERDNS.com."), now.tv_sec), 100U);
+
+  auto qtypes = tracker.getQTypes().getTop(10, now.tv_sec);
+  BOOST_REQUIRE_EQUAL(qtypes.size(), 2U);
+  BOOST_CHECK_EQUAL(qtypes.at(0).d_key, QType::A);
+  BOOST_CHECK_EQUAL(qtypes.at(1).d_key, QType::AAAA);
+
+  /* the sketches are not cleared with the rings */
+  rings.clear();
+  BOOST_CHECK_EQUAL(tracker.getClients().getTop(10, now.tv_sec).size(), 2U);
+  BOOST_CHECK_GT(tracker.getMemoryUsage(), 0U);
+}
+
+#ifdef BENCH_SKETCHES
+BOOST_AUTO_TEST_CASE(test_HeavyHittersTracker_Bench)
+{
+  HeavyHittersTracker::Options options;
+  HeavyHittersTracker tracker(options);
+  dnsheader dnsHeader{};
+  struct timespec now{};
+  gettime(&now);
+
+  std::vector<ComboAddress> clients;
+  for (size_t idx = 0; idx < 65536; idx++) {
+    clients.emplace_back("10.0." + std::to_string(idx / 256) + "." + std::to_string(idx % 256));
+  }
+  const DNSName qname("www.powerdns.com.");
+  StopWatch sw;
+  sw.start();
+  for (size_t idx = 0; idx < 1000000; idx++) {
+    tracker.onQuery(now, clients.at(idx % clients.size()), qname, QType::A);
+  }
+  cerr << "inserted 1000000 queries in " << std::to_string(sw.udiff() / 1000) << "ms" << endl;
+  sw.start();
+  auto top = tracker.getClients().getTop(20, now.tv_sec);
+  cerr << "retrieved the top 20 clients in " << std::to_string(sw.udiff()) << "us, using " << tracker.getMemoryUsage() << " bytes" << endl;
+}
+#endif /* BENCH_SKETCHES */
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-timer-wheel.hh"
+
+using namespace dnsdist;
+
+BOOST_AUTO_TEST_SUITE(dnsdisttimerwheel_cc)
+
+BOOST_AUTO_TEST_CASE(test_TimerWheel_Basic)
+{
+  /* ten slots of 10 ms */
+  const uint64_t tick = 10000;
+  uint64_t now = 1000000;
+  TimerWheel<int> wheel(10, tick, now);
+  BOOST_CHECK(wheel.empty());
+  BOOST_CHECK_EQUAL(wheel.getNextTickUsec(), now + tick);
+
+  std::vector<std::pair<int, uint64_t>> expired;
+  const auto collect = [&expired](int&& value, uint64_t when) {
+    expired.emplace_back(value, when);
+  };
+
+  wheel.schedule(1, now + 15000);
+  wheel.schedule(2, now + 20000);
+  wheel.schedule(3, now + 55000);
+  /* already in the past, fires at the next tick */
+  wheel.schedule(4, now - 5000);
+  BOOST_CHECK_EQUAL(wheel.size(), 4U);
+
+  /* not yet at the next tick */
+  wheel.advance(now + 9999, collect);
+  BOOST_CHECK(expired.empty());
+
+  wheel.advance(now + tick, collect);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+  BOOST_CHECK_EQUAL(expired.at(0).first, 4);
+  BOOST_CHECK_EQUAL(expired.at(0).second, now + tick);
+  expired.clear();
+
+  /* never before the scheduled time */
+  wheel.advance(now + 19999, collect);
+  BOOST_CHECK(expired.empty());
+  wheel.advance(now + 20000, collect);
+  BOOST_REQUIRE_EQUAL(expired.size(), 2U);
+  std::sort(expired.begin(), expired.end());
+  BOOST_CHECK_EQUAL(expired.at(0).first, 1);
+  BOOST_CHECK_EQUAL(expired.at(1).first, 2);
+  BOOST_CHECK_EQUAL(wheel.size(), 1U);
+  expired.clear();
+
+  /* going back in time does nothing */
+  wheel.advance(now, collect);
+  BOOST_CHECK(expired.empty());
+
+  wheel.advance(now + 100000, collect);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+  BOOST_CHECK_EQUAL(expired.at(0).first, 3);
+  BOOST_CHECK_EQUAL(expired.at(0).second, now + 60000);
+  BOOST_CHECK(wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_TimerWheel_SeveralRotations)
+{
+  const uint64_t tick = 1000;
+  uint64_t now = 0;
+  TimerWheel<size_t> wheel(16, tick, now);
+
+  /* timers spread over several rotations of the wheel end up sharing slots */
+  const size_t count = 1000;
+  for (size_t idx = 0; idx < count; idx++) {
+    wheel.schedule(size_t(idx), (idx + 1) * 100);
+  }
+
+  size_t fired = 0;
+  for (now = 0; now <= (count + 1) * 100; now += 250) {
+    wheel.advance(now, [&fired, now, tick](size_t&& value, uint64_t when) {
+      /* it has expired, but not more than one tick ago */
+      BOOST_CHECK_LE((value + 1) * 100, when);
+      BOOST_CHECK_LE(when, now);
+      BOOST_CHECK_LT(when - (value + 1) * 100, tick);
+      ++fired;
+    });
+  }
+  BOOST_CHECK_EQUAL(fired, count);
+  BOOST_CHECK(wheel.empty());
+
+  /* a long pause, much longer than a rotation */
+  for (size_t idx = 0; idx < count; idx++) {
+    wheel.schedule(size_t(idx), now + (idx * 37));
+  }
+  fired = 0;
+  now += 1000 * tick;
+  wheel.advance(now, [&fired](size_t&&, uint64_t) {
+    ++fired;
+  });
+  BOOST_CHECK_EQUAL(fired, count);
+  BOOST_CHECK(wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_TimerWheel_Reschedule)
+{
+  const uint64_t tick = 10000;
+  const uint64_t interval = 1000000;
+  uint64_t now = 0;
+  TimerWheel<size_t> wheel(100, tick, now);
+
+  /* periodic timers rescheduling themselves from the callback, as the health-check scheduler does */
+  const size_t timersCount = 50;
+  for (size_t idx = 0; idx < timersCount; idx++) {
+    wheel.schedule(size_t(idx), idx * (interval / timersCount));
+  }
+
+  std::vector<size_t> counts(timersCount, 0);
+  for (now = 0; now < 10 * interval; now += 3000) {
+    wheel.advance(now, [&wheel, &counts](size_t&& value, uint64_t when) {
+      counts.at(value)++;
+      wheel.schedule(std::move(value), when + interval);
+    });
+  }
+
+  for (const auto count : counts) {
+    BOOST_CHECK_EQUAL(count, 10U);
+  }
+  BOOST_CHECK_EQUAL(wheel.size(), timersCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,224 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsname.hh"
+#include "dnsparser.hh"
+#include "dnsqueryscan.hh"
+#include "dnswriter.hh"
+#include "ednscookies.hh"
+#include "ednsoptions.hh"
+#include "ednssubnet.hh"
+
+BOOST_AUTO_TEST_SUITE(test_dnsqueryscan_cc)
+
+static const uint16_t ednsFlagDO = 0x8000;
+
+BOOST_AUTO_TEST_CASE(test_scan_no_edns)
+{
+  const DNSName name("www.PowerDNS.com.");
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pw(query, name, QType::AAAA, QClass::CHAOS, 0);
+  pw.getHeader()->rd = 1;
+  pw.commit();
+
+  DNSQueryScan scan;
+  BOOST_REQUIRE(scanDNSQuery(query.data(), query.size(), scan));
+  BOOST_CHECK(scan.valid);
+  BOOST_CHECK(scan.simpleLayout);
+  BOOST_CHECK_EQUAL(scan.qnameWireLength, name.wirelength());
+  BOOST_CHECK_EQUAL(scan.qtype, QType::AAAA);
+  BOOST_CHECK_EQUAL(scan.qclass, QClass::CHAOS);
+  BOOST_CHECK_EQUAL(scan.optRDPosition, 0U);
+  BOOST_CHECK_EQUAL(scan.ecsPosition, 0U);
+  BOOST_CHECK_EQUAL(scan.cookiePosition, 0U);
+
+  /* the validated labels can be used as they are, case included */
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto scanned = DNSName::fromValidatedWire(reinterpret_cast<const char*>(&query.at(sizeof(dnsheader))), scan.qnameWireLength);
+  BOOST_CHECK_EQUAL(scanned, name);
+  BOOST_CHECK_EQUAL(scanned.toString(), name.toString());
+  BOOST_CHECK_EQUAL(scanned.wirelength(), name.wirelength());
+}
+
+BOOST_AUTO_TEST_CASE(test_scan_edns_options)
+{
+  const DNSName name("www.powerdns.com.");
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pw(query, name, QType::A, QClass::IN, 0);
+  GenericDNSPacketWriter<PacketBuffer>::optvect_t opts;
+  EDNSSubnetOpts ecsOpts;
+  ecsOpts.source = Netmask("192.0.2.1/24");
+  const auto ecsOptionStr = makeEDNSSubnetOptsString(ecsOpts);
+  const EDNSCookiesOpt cookiesOpt("deadbeefdeadbeef");
+  const auto cookiesOptionStr = cookiesOpt.makeOptString();
+  opts.emplace_back(EDNSOptionCode::NSID, "");
+  opts.emplace_back(EDNSOptionCode::COOKIE, cookiesOptionStr);
+  opts.emplace_back(EDNSOptionCode::ECS, ecsOptionStr);
+  pw.addOpt(512, 0, ednsFlagDO, opts);
+  pw.commit();
+
+  DNSQueryScan scan;
+  BOOST_REQUIRE(scanDNSQuery(query.data(), query.size(), scan));
+  BOOST_CHECK(scan.simpleLayout);
+  BOOST_CHECK(scan.validOptions);
+  BOOST_CHECK_EQUAL(scan.ednsZ, ednsFlagDO);
+
+  const size_t expectedOptRDPosition = sizeof(dnsheader) + name.wirelength() + 4 /* qtype, qclass */ + 1 /* root */ + 4 /* type, class */ + 4 /* TTL */;
+  BOOST_REQUIRE_EQUAL(scan.optRDPosition, expectedOptRDPosition);
+
+  /* the positions should match what getEDNSOption() finds */
+  size_t optionPosition = 0;
+  size_t optionSize = 0;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  BOOST_REQUIRE_EQUAL(getEDNSOption(reinterpret_cast<const char*>(&query.at(scan.optRDPosition)), query.size() - scan.optRDPosition, EDNSOptionCode::ECS, &optionPosition, &optionSize), 0);
+  BOOST_CHECK_EQUAL(scan.ecsPosition, scan.optRDPosition + optionPosition);
+  BOOST_CHECK_EQUAL(scan.ecsSize, optionSize);
+  BOOST_CHECK_EQUAL(scan.ecsSize, ecsOptionStr.size() + 4);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  BOOST_REQUIRE_EQUAL(getEDNSOption(reinterpret_cast<const char*>(&query.at(scan.optRDPosition)), query.size() - scan.optRDPosition, EDNSOptionCode::COOKIE, &optionPosition, &optionSize), 0);
+  BOOST_CHECK_EQUAL(scan.cookiePosition, scan.optRDPosition + optionPosition);
+  BOOST_CHECK_EQUAL(scan.cookieSize, optionSize);
+
+  /* now truncate the last option */
+  query.resize(query.size() - 1);
+  BOOST_REQUIRE(scanDNSQuery(query.data(), query.size(), scan));
+  BOOST_CHECK(scan.simpleLayout);
+  BOOST_CHECK_EQUAL(scan.optRDPosition, expectedOptRDPosition);
+  BOOST_CHECK(!scan.validOptions);
+  BOOST_CHECK_EQUAL(scan.ecsPosition, 0U);
+  BOOST_CHECK_EQUAL(scan.cookiePosition, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_scan_not_simple_layout)
+{
+  const DNSName name("powerdns.com.");
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pw(query, name, QType::A, QClass::IN, 0);
+  pw.startRecord(name, QType::A, 60, QClass::IN, DNSResourceRecord::ADDITIONAL);
+  pw.xfrIP(0x01020304);
+  pw.addOpt(512, 0, 0);
+  pw.commit();
+
+  DNSQueryScan scan;
+  BOOST_REQUIRE(scanDNSQuery(query.data(), query.size(), scan));
+  BOOST_CHECK(scan.valid);
+  BOOST_CHECK(!scan.simpleLayout);
+  BOOST_CHECK_EQUAL(scan.qtype, QType::A);
+  BOOST_CHECK_EQUAL(scan.optRDPosition, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_scan_invalid)
+{
+  DNSQueryScan scan;
+
+  {
+    /* too short */
+    PacketBuffer query(sizeof(dnsheader) - 1);
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+    BOOST_CHECK(!scan.valid);
+  }
+
+  const DNSName name("www.powerdns.com.");
+  PacketBuffer valid;
+  GenericDNSPacketWriter<PacketBuffer> pw(valid, name, QType::A, QClass::IN, 0);
+  pw.commit();
+  BOOST_REQUIRE(scanDNSQuery(valid.data(), valid.size(), scan));
+
+  {
+    /* no room for the qtype and qclass */
+    auto query = valid;
+    query.resize(query.size() - 1);
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+    BOOST_CHECK(!scan.valid);
+  }
+
+  {
+    /* unterminated qname */
+    auto query = valid;
+    query.resize(sizeof(dnsheader) + 4);
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+  }
+
+  {
+    /* compression pointer in the question */
+    auto query = valid;
+    query.at(sizeof(dnsheader) + 4) = 0xc0;
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+  }
+
+  {
+    /* label longer than 63 bytes */
+    auto query = valid;
+    query.at(sizeof(dnsheader)) = 64;
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+  }
+
+  {
+    /* qname longer than 255 bytes */
+    PacketBuffer query(valid.begin(), valid.begin() + sizeof(dnsheader));
+    for (size_t idx = 0; idx < 5; idx++) {
+      query.push_back(63);
+      query.insert(query.end(), 63, 'a');
+    }
+    query.push_back(0);
+    query.insert(query.end(), 4, 0);
+    BOOST_CHECK(!scanDNSQuery(query.data(), query.size(), scan));
+    BOOST_CHECK_THROW(DNSName(reinterpret_cast<const char*>(query.data()), query.size(), sizeof(dnsheader), false), std::range_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_lowercase)
+{
+  std::vector<uint8_t> input(256 * 3);
+  for (size_t idx = 0; idx < input.size(); idx++) {
+    input.at(idx) = static_cast<uint8_t>(idx % 256);
+  }
+
+  /* exercise the vectorized parts and the remaining bytes, with unaligned starts */
+  for (size_t offset = 0; offset < 3; offset++) {
+    for (size_t length = 0; length < (input.size() - offset); length += 7) {
+      std::vector<uint8_t> output(length);
+      dnsLowercaseCopy(output.data(), &input.at(offset), length);
+      for (size_t idx = 0; idx < length; idx++) {
+        BOOST_REQUIRE_EQUAL(output.at(idx), dns_tolower(input.at(offset + idx)));
+      }
+    }
+  }
+
+  const std::string qname("\x03WwW\x08PowerDNS\x03" "COM");
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto* data = reinterpret_cast<const uint8_t*>(qname.data());
+  for (size_t length = 0; length <= qname.size(); length++) {
+    BOOST_CHECK_EQUAL(burtleLowercase(data, length, 42), burtleCI(data, length, 42));
+  }
+  BOOST_CHECK_EQUAL(burtleLowercase(input.data(), input.size(), 0), burtleCI(input.data(), input.size(), 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
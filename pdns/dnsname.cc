@@ -113,6 +113,13 @@ DNSName::DNSName(const char* pos, size_t len, size_t offset, bool uncompress, ui
   packetParser(pos, len, offset, uncompress, qtype, qclass, consumed, 0, minOffset);
 }
 
+DNSName DNSName::fromValidatedWire(const char* labels, size_t length)
+{
+  DNSName ret;
+  ret.d_storage.assign(labels, length);
+  return ret;
+}
+
 static void checkLabelLength(uint8_t length)
 {
   if (length == 0) {
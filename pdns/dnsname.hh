@@ -102,6 +102,7 @@ public:
 
   explicit DNSName(std::string_view sw); //!< Constructs from a human formatted, escaped presentation
   DNSName(const char* p, size_t len, size_t offset, bool uncompress, uint16_t* qtype = nullptr, uint16_t* qclass = nullptr, unsigned int* consumed = nullptr, uint16_t minOffset = 0); //!< Construct from a DNS Packet, taking the first question if offset=12. If supplied, consumed is set to the number of bytes consumed from the packet, which will not be equal to the wire length of the resulting name in case of compression.
+  static DNSName fromValidatedWire(const char* labels, size_t length); //!< Construct from uncompressed labels in wire format, root label included, that have already been validated, for example by scanDNSQuery(). No check is done.
 
   bool isPartOf(const DNSName& rhs) const;   //!< Are we part of the rhs name? Note that name.isPartOf(name).
   inline bool operator==(const DNSName& rhs) const; //!< DNS-native comparison (case insensitive) - empty compares to empty
@@ -615,6 +616,11 @@ struct SuffixMatchNode
       return d_tree.getBestMatch(name);
     }
 
+    const std::set<DNSName>& getNames() const
+    {
+      return d_nodes;
+    }
+
     std::string toString() const
     {
       std::string ret;
@@ -630,7 +636,7 @@ struct SuffixMatchNode
     }
 
   private:
-    mutable std::set<DNSName> d_nodes; // Only used for string generation
+    mutable std::set<DNSName> d_nodes; // Only used for string generation and getNames()
 };
 
 std::ostream & operator<<(std::ostream &os, const DNSName& d);
@@ -0,0 +1,184 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <array>
+#include <cstring>
+#include <limits>
+#include <netinet/in.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "dnsqueryscan.hh"
+#include "dns.hh"
+#include "dnsname.hh"
+#include "ednsoptions.hh"
+#include "qtype.hh"
+
+static uint16_t get16BitValue(const uint8_t* data)
+{
+  return (static_cast<uint16_t>(data[0]) << 8) + data[1];
+}
+
+static void scanEDNSOptions(const uint8_t* packet, size_t packetSize, DNSQueryScan& scan)
+{
+  /* same logic than getEDNSOptions(), we only keep the first ECS and cookie options */
+  size_t pos = scan.optRDPosition;
+  const uint16_t rdLen = get16BitValue(&packet[pos]);
+  pos += DNS_RDLENGTH_SIZE;
+  if ((pos + rdLen) > packetSize) {
+    return;
+  }
+
+  const size_t end = pos + rdLen;
+  while ((pos + EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE) <= end) {
+    const size_t optionStart = pos;
+    const uint16_t optionCode = get16BitValue(&packet[pos]);
+    pos += EDNS_OPTION_CODE_SIZE;
+    const uint16_t optionLen = get16BitValue(&packet[pos]);
+    pos += EDNS_OPTION_LENGTH_SIZE;
+    if (optionLen > (end - pos)) {
+      scan.ecsPosition = scan.ecsSize = 0;
+      scan.cookiePosition = scan.cookieSize = 0;
+      return;
+    }
+
+    const auto optionSize = static_cast<uint16_t>(optionLen + EDNS_OPTION_CODE_SIZE + EDNS_OPTION_LENGTH_SIZE);
+    if (optionCode == EDNSOptionCode::ECS && scan.ecsPosition == 0) {
+      scan.ecsPosition = static_cast<uint16_t>(optionStart);
+      scan.ecsSize = optionSize;
+    }
+    else if (optionCode == EDNSOptionCode::COOKIE && scan.cookiePosition == 0) {
+      scan.cookiePosition = static_cast<uint16_t>(optionStart);
+      scan.cookieSize = optionSize;
+    }
+    pos += optionLen;
+  }
+
+  scan.validOptions = true;
+}
+
+bool scanDNSQuery(const uint8_t* packet, size_t packetSize, DNSQueryScan& scan)
+{
+  scan = DNSQueryScan();
+  /* the positions are stored on 16 bits */
+  if (packet == nullptr || packetSize < sizeof(dnsheader) || packetSize > std::numeric_limits<uint16_t>::max()) {
+    return false;
+  }
+
+  size_t pos = sizeof(dnsheader);
+  size_t wireLength = 1;
+  while (true) {
+    if (pos >= packetSize) {
+      return false;
+    }
+    const uint8_t labelLength = packet[pos];
+    ++pos;
+    if (labelLength == 0) {
+      break;
+    }
+    /* compression pointers are not allowed in the question, and neither are the reserved 0x40 and 0x80 types */
+    if (labelLength > 63) {
+      return false;
+    }
+    wireLength += labelLength + 1;
+    if (wireLength > DNSName::s_maxDNSNameLength) {
+      return false;
+    }
+    pos += labelLength;
+  }
+
+  if ((pos + DNS_TYPE_SIZE + DNS_CLASS_SIZE) > packetSize) {
+    return false;
+  }
+
+  scan.qnameWireLength = static_cast<uint16_t>(wireLength);
+  scan.qtype = get16BitValue(&packet[pos]);
+  pos += DNS_TYPE_SIZE;
+  scan.qclass = get16BitValue(&packet[pos]);
+  pos += DNS_CLASS_SIZE;
+  scan.valid = true;
+
+  const dnsheader_aligned dnsHeader(packet);
+  if (ntohs(dnsHeader->qdcount) != 1 || dnsHeader->ancount != 0 || dnsHeader->nscount != 0 || ntohs(dnsHeader->arcount) > 1) {
+    return true;
+  }
+
+  scan.simpleLayout = true;
+  if (dnsHeader->arcount == 0) {
+    return true;
+  }
+
+  /* root, type, class, TTL and RDLENGTH */
+  if ((pos + 1 + DNS_TYPE_SIZE + DNS_CLASS_SIZE + DNS_TTL_SIZE + DNS_RDLENGTH_SIZE) > packetSize || packet[pos] != 0) {
+    return true;
+  }
+  ++pos;
+
+  if (get16BitValue(&packet[pos]) != QType::OPT) {
+    return true;
+  }
+  pos += DNS_TYPE_SIZE + DNS_CLASS_SIZE;
+  scan.ednsZ = get16BitValue(&packet[pos + EDNS_EXTENDED_RCODE_SIZE + EDNS_VERSION_SIZE]);
+  pos += DNS_TTL_SIZE;
+  scan.optRDPosition = static_cast<uint16_t>(pos);
+
+  scanEDNSOptions(packet, packetSize, scan);
+  return true;
+}
+
+void dnsLowercaseCopy(uint8_t* dest, const uint8_t* source, size_t length)
+{
+  size_t idx = 0;
+  /* bytes are compared as signed values, so anything above 0x7f is never
+     considered an upper case letter, exactly like in dns_tolower() */
+#if defined(__SSE2__)
+  {
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; (idx + sizeof(__m128i)) <= length; idx += sizeof(__m128i)) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + idx));
+      const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(chunk, beforeA), _mm_cmpgt_epi8(afterZ, chunk));
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + idx), _mm_or_si128(chunk, _mm_and_si128(isUpper, caseBit)));
+    }
+  }
+#endif
+  for (; idx < length; idx++) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    dest[idx] = dns_tolower(source[idx]);
+  }
+}
+
+uint32_t burtleLowercase(const uint8_t* data, size_t length, uint32_t initval)
+{
+  /* only the first length bytes are read, and they are all written first */
+  std::array<uint8_t, DNSName::s_maxDNSNameLength + 1> lowered; // NOLINT(cppcoreguidelines-pro-type-member-init)
+  if (length > lowered.size()) {
+    return burtleCI(data, length, initval);
+  }
+
+  dnsLowercaseCopy(lowered.data(), data, length);
+  return burtle(lowered.data(), length, initval);
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* Everything we learn about a query from a single pass over its wire
+   representation: the question, and the position of the OPT RR and of the
+   ECS and cookie options when the query has the usual layout. Positions are
+   offsets from the beginning of the DNS header, 0 meaning 'not present'. */
+struct DNSQueryScan
+{
+  /* position of the RDLENGTH field of the OPT RR, as returned by getEDNSOptionsStart() */
+  uint16_t optRDPosition{0};
+  /* position and size of the ECS and cookie options, including the option code and length,
+     as returned by getEDNSOption() */
+  uint16_t ecsPosition{0};
+  uint16_t ecsSize{0};
+  uint16_t cookiePosition{0};
+  uint16_t cookieSize{0};
+  uint16_t qnameWireLength{0};
+  uint16_t qtype{0};
+  uint16_t qclass{0};
+  /* the 'Z' part of the OPT RR TTL, DO bit included */
+  uint16_t ednsZ{0};
+  /* one question, no answer or authority record and at most one additional record,
+     so the EDNS fields above are authoritative and callers do not need to look
+     at the packet again */
+  bool simpleLayout{false};
+  /* the OPT RR, if any, contains a valid list of options */
+  bool validOptions{false};
+  bool valid{false};
+};
+
+/* Scan a query in a single pass: validate the labels of the qname, which have
+   to be uncompressed, extract the qtype and qclass, and locate the OPT RR and
+   its ECS and cookie options when the layout is simple. Returns false if the
+   question section is not valid, in which case scan.valid is false as well. */
+bool scanDNSQuery(const uint8_t* packet, size_t packetSize, DNSQueryScan& scan);
+
+/* Copy length bytes from source to dest, lowercasing ASCII letters. Uses SSE2
+   when available, since this is run on every qname we hash */
+void dnsLowercaseCopy(uint8_t* dest, const uint8_t* source, size_t length);
+
+/* Same result as burtleCI(), but lowercases the whole input at once into a
+   stack buffer instead of one byte at a time */
+uint32_t burtleLowercase(const uint8_t* data, size_t length, uint32_t initval);
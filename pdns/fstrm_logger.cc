@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <thread>
 #include <unistd.h>
 #include <sys/un.h>
 
@@ -14,9 +16,13 @@
 #ifdef HAVE_FSTRM
 
 static const std::string DNSTAP_CONTENT_TYPE = "protobuf:dnstap.Dnstap";
+/* more producing threads than that will have to share a queue. Note that each
+   input queue holds up to inputQueueSize frames */
+static const unsigned int s_maxInputQueues = 64;
+static std::atomic<uint64_t> s_frameStreamLoggerIDs{0};
 
 FrameStreamLogger::FrameStreamLogger(const int family, std::string address, bool connect, const std::unordered_map<string, unsigned>& options) :
-  d_family(family), d_address(std::move(address))
+  d_family(family), d_address(std::move(address)), d_id(++s_frameStreamLoggerIDs)
 {
   try {
     d_fwopt = fstrm_writer_options_init();
@@ -83,11 +89,17 @@ FrameStreamLogger::FrameStreamLogger(const int family, std::string address, bool
       throw std::runtime_error("FrameStreamLogger: fstrm_iothr_options_init() failed.");
     }
 
-    res = fstrm_iothr_options_set_queue_model(d_iothropt, FSTRM_IOTHR_QUEUE_MODEL_MPSC);
+    res = fstrm_iothr_options_set_queue_model(d_iothropt, FSTRM_IOTHR_QUEUE_MODEL_SPSC);
     if (res != fstrm_res_success) {
       throw std::runtime_error("FrameStreamLogger: fstrm_iothr_options_set_queue_model failed: " + std::to_string(res));
     }
 
+    const auto numInputQueues = std::clamp(std::thread::hardware_concurrency(), 1U, s_maxInputQueues);
+    res = fstrm_iothr_options_set_num_input_queues(d_iothropt, numInputQueues);
+    if (res != fstrm_res_success) {
+      throw std::runtime_error("FrameStreamLogger: fstrm_iothr_options_set_num_input_queues failed: " + std::to_string(res));
+    }
+
     struct setters
     {
       const std::string name;
@@ -115,9 +127,14 @@ FrameStreamLogger::FrameStreamLogger(const int family, std::string address, bool
         throw std::runtime_error("FrameStreamLogger: fstrm_iothr_init() failed.");
       }
 
-      d_ioqueue = fstrm_iothr_get_input_queue(d_iothr);
-      if (d_ioqueue == nullptr) {
-        throw std::runtime_error("FrameStreamLogger: fstrm_iothr_get_input_queue() failed.");
+      d_ioqueues.reserve(numInputQueues);
+      for (unsigned int idx = 0; idx < numInputQueues; idx++) {
+        auto queue = std::make_shared<InputQueue>();
+        queue->d_queue = fstrm_iothr_get_input_queue_idx(d_iothr, idx);
+        if (queue->d_queue == nullptr) {
+          throw std::runtime_error("FrameStreamLogger: fstrm_iothr_get_input_queue_idx() failed.");
+        }
+        d_ioqueues.push_back(std::move(queue));
       }
     }
   }
@@ -129,6 +146,8 @@ FrameStreamLogger::FrameStreamLogger(const int family, std::string address, bool
 
 void FrameStreamLogger::cleanup()
 {
+  /* the queues are owned by the I/O thread */
+  d_ioqueues.clear();
   if (d_iothr != nullptr) {
     fstrm_iothr_destroy(&d_iothr);
     d_iothr = nullptr;
@@ -162,36 +181,90 @@ FrameStreamLogger::~FrameStreamLogger()
   this->cleanup();
 }
 
+const FrameStreamLogger::QueueClaim& FrameStreamLogger::getThreadQueue()
+{
+  /* keyed by the ID of the logger rather than its address, which might be reused */
+  static thread_local std::vector<std::pair<uint64_t, std::unique_ptr<QueueClaim>>> t_claims;
+  for (const auto& [loggerID, claim] : t_claims) {
+    if (loggerID == d_id) {
+      return *claim;
+    }
+  }
+
+  /* forget about the queues of the loggers that have been destroyed */
+  t_claims.erase(std::remove_if(t_claims.begin(), t_claims.end(), [](const auto& entry) { return entry.second->d_queue.use_count() == 1; }), t_claims.end());
+
+  /* threads get their own input queue as long as one is available,
+     the last queue being shared by all the remaining threads */
+  const auto sharedIndex = d_ioqueues.size() - 1;
+  for (size_t idx = 0; idx < sharedIndex; idx++) {
+    const auto& queue = d_ioqueues.at(idx);
+    if (!queue->d_claimed.load() && !queue->d_claimed.exchange(true)) {
+      t_claims.emplace_back(d_id, std::make_unique<QueueClaim>(queue, true));
+      return *t_claims.back().second;
+    }
+  }
+
+  t_claims.emplace_back(d_id, std::make_unique<QueueClaim>(d_ioqueues.at(sharedIndex), false));
+  return *t_claims.back().second;
+}
+
 RemoteLoggerInterface::Result FrameStreamLogger::queueData(const std::string& data)
 {
-  if ((d_ioqueue == nullptr) || d_iothr == nullptr) {
+  if (d_ioqueues.empty() || d_iothr == nullptr) {
     ++d_permanentFailures;
     return Result::OtherError;
   }
+
+  const auto& claim = getThreadQueue();
+  const bool exclusiveQueue = claim.d_exclusive;
+  auto& queue = *claim.d_queue;
+
   uint8_t* frame = (uint8_t*)malloc(data.length()); // NOLINT: it's the API
   if (frame == nullptr) {
-    ++d_queueFullDrops; // XXX separate count?
+    ++queue.d_queueFullDrops; // XXX separate count?
     return Result::TooLarge;
   }
   memcpy(frame, data.c_str(), data.length());
 
-  auto res = fstrm_iothr_submit(d_iothr, d_ioqueue, frame, data.length(), fstrm_free_wrapper, nullptr);
+  fstrm_res res{fstrm_res_failure};
+  if (exclusiveQueue) {
+    res = fstrm_iothr_submit(d_iothr, queue.d_queue, frame, data.length(), fstrm_free_wrapper, nullptr);
+  }
+  else {
+    std::lock_guard<std::mutex> lock(queue.d_lock);
+    res = fstrm_iothr_submit(d_iothr, queue.d_queue, frame, data.length(), fstrm_free_wrapper, nullptr);
+  }
 
   if (res == fstrm_res_success) {
     // Frame successfully queued.
-    ++d_framesSent;
+    ++queue.d_framesSent;
     // do not call free here
     return Result::Queued;
   }
   if (res == fstrm_res_again) {
     free(frame); // NOLINT: it's the API
-    ++d_queueFullDrops;
+    ++queue.d_queueFullDrops;
     return Result::PipeFull;
   }
   // Permanent failure.
   free(frame); // NOLINT: it's the API
-  ++d_permanentFailures;
+  ++queue.d_permanentFailures;
   return Result::OtherError;
 }
 
+RemoteLoggerInterface::Stats FrameStreamLogger::getStats()
+{
+  Stats stats{.d_queued = 0,
+              .d_pipeFull = 0,
+              .d_tooLarge = 0,
+              .d_otherError = d_permanentFailures};
+  for (const auto& queue : d_ioqueues) {
+    stats.d_queued += queue->d_framesSent;
+    stats.d_pipeFull += queue->d_queueFullDrops;
+    stats.d_otherError += queue->d_permanentFailures;
+  }
+  return stats;
+}
+
 #endif /* HAVE_FSTRM */
@@ -25,7 +25,9 @@
 
 #ifdef HAVE_FSTRM
 
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 #include <fstrm.h>
 #include <fstrm/iothr.h>
 #include <fstrm/unix_writer.h>
@@ -56,21 +58,58 @@ public:
 
   [[nodiscard]] std::string toString() override
   {
-    return "FrameStreamLogger to " + d_address + " (" + std::to_string(d_framesSent) + " frames sent, " + std::to_string(d_queueFullDrops) + " dropped, " + std::to_string(d_permanentFailures) + " permanent failures)";
+    auto stats = getStats();
+    return "FrameStreamLogger to " + d_address + " (" + std::to_string(stats.d_queued) + " frames sent, " + std::to_string(stats.d_pipeFull) + " dropped, " + std::to_string(stats.d_otherError) + " permanent failures)";
   }
 
-  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override
-  {
-    return Stats{.d_queued = d_framesSent,
-                 .d_pipeFull = d_queueFullDrops,
-                 .d_tooLarge = 0,
-                 .d_otherError = d_permanentFailures};
-  }
+  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override;
 
 private:
+  /* fstrm's single-producer queues are lock-free, so every thread submitting
+     frames gets its own one as long as there are enough of them. The last
+     queue is shared by the remaining threads, and is the only one accessed
+     under its lock */
+  struct InputQueue
+  {
+    /* only used for the last, shared, queue */
+    std::mutex d_lock;
+    struct fstrm_iothr_queue* d_queue{nullptr};
+    std::atomic<uint64_t> d_framesSent{0};
+    std::atomic<uint64_t> d_queueFullDrops{0};
+    std::atomic<uint64_t> d_permanentFailures{0};
+    /* whether a thread is currently using this queue exclusively */
+    std::atomic<bool> d_claimed{false};
+  };
+
+  /* held by a thread for as long as it uses a given queue of a logger, so that an
+     exclusive queue can be handed to another thread once this one has exited */
+  struct QueueClaim
+  {
+    QueueClaim(std::shared_ptr<InputQueue> queue, bool exclusive) :
+      d_queue(std::move(queue)), d_exclusive(exclusive)
+    {
+    }
+    QueueClaim(const QueueClaim&) = delete;
+    QueueClaim(QueueClaim&&) = delete;
+    QueueClaim& operator=(const QueueClaim&) = delete;
+    QueueClaim& operator=(QueueClaim&&) = delete;
+    ~QueueClaim()
+    {
+      if (d_exclusive) {
+        d_queue->d_claimed.store(false);
+      }
+    }
+
+    std::shared_ptr<InputQueue> d_queue;
+    const bool d_exclusive;
+  };
+
+  const QueueClaim& getThreadQueue();
+
   const int d_family;
   const std::string d_address;
-  struct fstrm_iothr_queue* d_ioqueue{nullptr};
+  std::vector<std::shared_ptr<InputQueue>> d_ioqueues;
+  const uint64_t d_id;
   struct fstrm_writer_options* d_fwopt{nullptr};
   struct fstrm_unix_writer_options* d_uwopt{nullptr};
 #ifdef HAVE_FSTRM_TCP_WRITER_INIT
@@ -79,8 +118,7 @@ private:
   struct fstrm_writer* d_writer{nullptr};
   struct fstrm_iothr_options* d_iothropt{nullptr};
   struct fstrm_iothr* d_iothr{nullptr};
-  std::atomic<uint64_t> d_framesSent{0};
-  std::atomic<uint64_t> d_queueFullDrops{0};
+  /* when not connected */
   std::atomic<uint64_t> d_permanentFailures{0};
 
   void cleanup();
@@ -321,6 +321,36 @@ int sendOnNBSocket(int fileDesc, const struct msghdr* msgh)
   return sendErr;
 }
 
+#if defined(HAVE_SENDMMSG)
+void sendMultipleMessages(int fileDesc, struct mmsghdr* msgs, unsigned int count, const std::function<void(unsigned int, int)>& onError)
+{
+  /* sendmmsg() stops at the first message it is unable to send, reporting an error only if that
+     was the very first one, so we keep going until all messages have been either sent or reported */
+  unsigned int done = 0;
+  while (done < count) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    int sent = sendmmsg(fileDesc, msgs + done, count - done, 0);
+    if (sent < 0) {
+      int error = errno;
+      if (error == EINTR) {
+        continue;
+      }
+      onError(done, error);
+      done++;
+    }
+    else if (sent == 0) {
+      /* should not happen, but we don't want to spin nor to silently drop the remaining messages */
+      for (; done < count; done++) {
+        onError(done, EAGAIN);
+      }
+    }
+    else {
+      done += static_cast<unsigned int>(sent);
+    }
+  }
+}
+#endif
+
 // be careful: when using this for receive purposes, make sure addr->sin4.sin_family is set appropriately so getSocklen works!
 // be careful: when using this function for *send* purposes, be sure to set cbufsize to 0!
 // be careful: if you don't call addCMsgSrcAddr after fillMSGHdr, make sure to set msg_control to NULL
@@ -1896,6 +1896,11 @@ bool HarvestDestinationAddress(const struct msghdr* msgh, ComboAddress* destinat
 bool HarvestTimestamp(struct msghdr* msgh, struct timeval* timeval);
 void fillMSGHdr(struct msghdr* msgh, struct iovec* iov, cmsgbuf_aligned* cbuf, size_t cbufsize, char* data, size_t datalen, ComboAddress* addr);
 int sendOnNBSocket(int fileDesc, const struct msghdr* msgh);
+#if defined(HAVE_SENDMMSG)
+/* Sends the messages with sendmmsg(). Every message is either sent or reported to onError
+   along with its index and the errno value */
+void sendMultipleMessages(int fileDesc, struct mmsghdr* msgs, unsigned int count, const std::function<void(unsigned int, int)>& onError);
+#endif
 size_t sendMsgWithOptions(int socketDesc, const void* buffer, size_t len, const ComboAddress* dest, const ComboAddress* local, unsigned int localItf, int flags);
 
 /* requires a non-blocking, connected TCP socket */
@@ -25,6 +25,7 @@
 #include <boost/format.hpp>
 
 #include "filterpo.hh"
+#include "burtle.hh"
 #include "namespaces.hh"
 #include "dnsrecords.hh"
 
@@ -57,9 +58,24 @@ bool DNSFilterEngine::Zone::findExactNSPolicy(const DNSName& qname, DNSFilterEng
   return false;
 }
 
+bool DNSFilterEngine::Zone::findQNamePolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const
+{
+  return findNamedPolicy(d_qpolName, qname, pol);
+}
+
+bool DNSFilterEngine::Zone::findNSPolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const
+{
+  if (findNamedPolicy(d_propolName, qname, pol)) {
+    // hitdata set by findNamedPolicy
+    pol.d_hitdata->d_trigger.appendRawLabel(rpzNSDnameName);
+    return true;
+  }
+  return false;
+}
+
 bool DNSFilterEngine::Zone::findNSIPPolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const
 {
-  if (const auto* fnd = d_propolNSAddr.lookup(addr)) {
+  if (const auto* fnd = d_propolNSAddr->lookup(addr)) {
     pol = fnd->second;
     pol.setHitData(Zone::maskToRPZ(fnd->first), addr.toString());
     pol.d_hitdata->d_trigger.appendRawLabel(rpzNSIPName);
@@ -70,7 +86,7 @@ bool DNSFilterEngine::Zone::findNSIPPolicy(const ComboAddress& addr, DNSFilterEn
 
 bool DNSFilterEngine::Zone::findResponsePolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const
 {
-  if (const auto* fnd = d_postpolAddr.lookup(addr)) {
+  if (const auto* fnd = d_postpolAddr->lookup(addr)) {
     pol = fnd->second;
     pol.setHitData(Zone::maskToRPZ(fnd->first), addr.toString());
     pol.d_hitdata->d_trigger.appendRawLabel(rpzIPName);
@@ -81,7 +97,7 @@ bool DNSFilterEngine::Zone::findResponsePolicy(const ComboAddress& addr, DNSFilt
 
 bool DNSFilterEngine::Zone::findClientPolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const
 {
-  if (const auto* fnd = d_qpolAddr.lookup(addr)) {
+  if (const auto* fnd = d_qpolAddr->lookup(addr)) {
     pol = fnd->second;
     pol.setHitData(Zone::maskToRPZ(fnd->first), addr.toString());
     pol.d_hitdata->d_trigger.appendRawLabel(rpzClientIPName);
@@ -90,7 +106,39 @@ bool DNSFilterEngine::Zone::findClientPolicy(const ComboAddress& addr, DNSFilter
   return false;
 }
 
-bool DNSFilterEngine::Zone::findNamedPolicy(const std::unordered_map<DNSName, DNSFilterEngine::Policy>& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol)
+static constexpr uint32_t s_wildcardHashSeed = 0x2a;
+
+size_t DNSFilterEngine::Zone::TriggerHash::operator()(const DNSName& name) const
+{
+  const auto& storage = name.getStorage();
+  const auto* raw = reinterpret_cast<const unsigned char*>(storage.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (storage.size() > 2 && raw[0] == 1 && raw[1] == '*') {
+    return hashWildcardSuffix(&raw[2], storage.size() - 2);
+  }
+  return burtleCI(raw, storage.size(), 0);
+}
+
+uint32_t DNSFilterEngine::Zone::TriggerHash::hashWildcardSuffix(const unsigned char* suffix, size_t suffixLen)
+{
+  return burtleCI(suffix, suffixLen, s_wildcardHashSeed);
+}
+
+bool DNSFilterEngine::Zone::TriggerHash::isWildcardOf(const DNSName& name, const unsigned char* suffix, size_t suffixLen)
+{
+  const auto& storage = name.getStorage();
+  const auto* raw = reinterpret_cast<const unsigned char*>(storage.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (storage.size() != suffixLen + 2 || raw[0] != 1 || raw[1] != '*') {
+    return false;
+  }
+  for (size_t idx = 0; idx < suffixLen; idx++) {
+    if (dns_tolower(raw[idx + 2]) != dns_tolower(suffix[idx])) { // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DNSFilterEngine::Zone::findNamedPolicy(const NamedPolicies& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol) const
 {
   if (polmap.empty()) {
     return false;
@@ -103,35 +151,33 @@ bool DNSFilterEngine::Zone::findNamedPolicy(const std::unordered_map<DNSName, DN
                     *.
    */
 
-  std::unordered_map<DNSName, DNSFilterEngine::Policy>::const_iterator iter;
-  iter = polmap.find(qname);
-
-  if (iter != polmap.end()) {
-    pol = iter->second;
+  if (findExactNamedPolicy(polmap, qname, pol)) {
     return true;
   }
 
-  DNSName sub(qname);
-  while (sub.chopOff()) {
-    iter = polmap.find(g_wildcarddnsname + sub);
-    if (iter != polmap.end()) {
-      pol = iter->second;
-      pol.setHitData(iter->first, qname.toStringNoDot());
-      return true;
+  /* the wildcards are looked up using the labels of qname directly, without building the wildcard names */
+  return TriggerHash::visitParents(qname, [this, &polmap, &qname, &pol](const unsigned char* suffix, size_t suffixLen) {
+    const auto* entry = polmap.findIf(TriggerHash::hashWildcardSuffix(suffix, suffixLen), [suffix, suffixLen](const DNSName& key) {
+      return TriggerHash::isWildcardOf(key, suffix, suffixLen);
+    });
+    if (entry == nullptr) {
+      return false;
     }
-  }
-  return false;
+    pol = getAction(entry->second);
+    pol.setHitData(entry->first, qname.toStringNoDot());
+    return true;
+  });
 }
 
-bool DNSFilterEngine::Zone::findExactNamedPolicy(const std::unordered_map<DNSName, DNSFilterEngine::Policy>& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol)
+bool DNSFilterEngine::Zone::findExactNamedPolicy(const NamedPolicies& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol) const
 {
   if (polmap.empty()) {
     return false;
   }
 
-  const auto iter = polmap.find(qname);
-  if (iter != polmap.end()) {
-    pol = iter->second;
+  const auto* entry = polmap.find(qname);
+  if (entry != nullptr) {
+    pol = getAction(entry->second);
     pol.setHitData(qname, qname.toStringNoDot());
     return true;
   }
@@ -168,33 +214,17 @@ bool DNSFilterEngine::getProcessingPolicy(const DNSName& qname, const std::unord
     return false;
   }
 
-  /* prepare the wildcard-based names */
-  std::vector<DNSName> wcNames;
-  wcNames.reserve(qname.countLabels());
-  DNSName sub(qname);
-  while (sub.chopOff()) {
-    wcNames.emplace_back(g_wildcarddnsname + sub);
-  }
-
+  const auto indexedMatches = getIndexedMatches(d_nsIndex, qname);
   count = 0;
   for (const auto& zone : d_zones) {
-    if (!zoneEnabled[count]) {
+    if (!zoneEnabled[count] || (count < d_indexedZones.size() && isRuledOutByIndex(indexedMatches, count, d_indexedZones[count].d_nsNames, zone->getNSTriggers()))) {
       ++count;
       continue;
     }
-    if (zone->findExactNSPolicy(qname, pol)) {
+    if (zone->findNSPolicy(qname, pol)) {
       // cerr<<"Had a hit on the nameserver ("<<qname<<") used to process the query"<<endl;
       return true;
     }
-
-    for (const auto& wildcard : wcNames) {
-      if (zone->findExactNSPolicy(wildcard, pol)) {
-        // cerr<<"Had a hit on the nameserver ("<<qname<<") used to process the query"<<endl;
-        // Hit is not the wildcard passed to findExactQNamePolicy but the actual qname!
-        pol.d_hitdata->d_hit = qname.toStringNoDot();
-        return true;
-      }
-    }
     ++count;
   }
 
@@ -275,35 +305,19 @@ bool DNSFilterEngine::getQueryPolicy(const DNSName& qname, const std::unordered_
     return false;
   }
 
-  /* prepare the wildcard-based names */
-  std::vector<DNSName> wcNames;
-  wcNames.reserve(qname.countLabels());
-  DNSName sub(qname);
-  while (sub.chopOff()) {
-    wcNames.emplace_back(g_wildcarddnsname + sub);
-  }
-
+  const auto indexedMatches = getIndexedMatches(d_qnameIndex, qname);
   count = 0;
   for (const auto& zone : d_zones) {
-    if (!zoneEnabled[count]) {
+    if (!zoneEnabled[count] || (count < d_indexedZones.size() && isRuledOutByIndex(indexedMatches, count, d_indexedZones[count].d_qnames, zone->getQNameTriggers()))) {
       ++count;
       continue;
     }
 
-    if (zone->findExactQNamePolicy(qname, pol)) {
+    if (zone->findQNamePolicy(qname, pol)) {
       // cerr<<"Had a hit on the name of the query"<<endl;
       return true;
     }
 
-    for (const auto& wildcard : wcNames) {
-      if (zone->findExactQNamePolicy(wildcard, pol)) {
-        // cerr<<"Had a hit on the name of the query"<<endl;
-        // Hit is not the wildcard passed to findExactQNamePolicy but the actual qname!
-        pol.d_hitdata->d_hit = qname.toStringNoDot();
-        return true;
-      }
-    }
-
     ++count;
   }
 
@@ -366,6 +380,86 @@ void DNSFilterEngine::assureZones(size_t zone)
   }
 }
 
+void DNSFilterEngine::indexZone(size_t zoneIdx)
+{
+  if (zoneIdx >= s_maxIndexedZones || zoneIdx >= d_zones.size()) {
+    return;
+  }
+  if (d_indexedZones.size() <= zoneIdx) {
+    d_indexedZones.resize(zoneIdx + 1);
+  }
+
+  auto& indexed = d_indexedZones.at(zoneIdx);
+  const auto& zone = d_zones.at(zoneIdx);
+  const Zone::NamedPolicies empty;
+  updateIndex(d_qnameIndex, zoneIdx, indexed.d_qnames, zone ? zone->getQNameTriggers() : empty);
+  updateIndex(d_nsIndex, zoneIdx, indexed.d_nsNames, zone ? zone->getNSTriggers() : empty);
+}
+
+void DNSFilterEngine::updateIndex(ZonesIndex& index, size_t zoneIdx, Zone::NamedPolicies& indexed, const Zone::NamedPolicies& current)
+{
+  const ZonesMask zoneBit = static_cast<ZonesMask>(1) << zoneIdx;
+  /* only the triggers added or removed since the version we indexed are looked at,
+     so an update of a large zone only costs as much as the number of changes */
+  current.diffKeys(
+    indexed,
+    [&index, &current, zoneBit](const DNSName& removed) {
+      const auto hash = static_cast<uint32_t>(Zone::TriggerHash()(removed));
+      /* another trigger of this zone might have the same hash */
+      if (current.findIf(hash, [hash](const DNSName& key) { return Zone::TriggerHash()(key) == hash; }) != nullptr) {
+        return;
+      }
+      auto* zones = index.findMutable(hash);
+      if (zones != nullptr) {
+        *zones &= ~zoneBit;
+        if (*zones == 0) {
+          index.erase(hash);
+        }
+      }
+    },
+    [&index, zoneBit](const DNSName& added) {
+      const auto hash = static_cast<uint32_t>(Zone::TriggerHash()(added));
+      auto* zones = index.findMutable(hash);
+      if (zones != nullptr) {
+        *zones |= zoneBit;
+      }
+      else {
+        index.insert(hash, zoneBit);
+      }
+    });
+  indexed = current;
+}
+
+DNSFilterEngine::ZonesMask DNSFilterEngine::getIndexedMatches(const ZonesIndex& index, const DNSName& qname)
+{
+  ZonesMask matches = 0;
+  if (index.empty()) {
+    return matches;
+  }
+
+  const auto* entry = index.find(static_cast<uint32_t>(Zone::TriggerHash()(qname)));
+  if (entry != nullptr) {
+    matches |= entry->second;
+  }
+  Zone::TriggerHash::visitParents(qname, [&index, &matches](const unsigned char* suffix, size_t suffixLen) {
+    const auto* wildcard = index.find(Zone::TriggerHash::hashWildcardSuffix(suffix, suffixLen));
+    if (wildcard != nullptr) {
+      matches |= wildcard->second;
+    }
+    return false;
+  });
+  return matches;
+}
+
+bool DNSFilterEngine::isRuledOutByIndex(ZonesMask matches, size_t zoneIdx, const Zone::NamedPolicies& indexed, const Zone::NamedPolicies& current)
+{
+  if (zoneIdx >= s_maxIndexedZones || !indexed.isSameVersion(current)) {
+    /* not indexed, or modified since it was indexed */
+    return false;
+  }
+  return (matches & (static_cast<ZonesMask>(1) << zoneIdx)) == 0;
+}
+
 static void addCustom(DNSFilterEngine::Policy& existingPol, const DNSFilterEngine::Policy& pol)
 {
   if (!existingPol.d_custom) {
@@ -377,12 +471,127 @@ static void addCustom(DNSFilterEngine::Policy& existingPol, const DNSFilterEngin
   }
 }
 
-void DNSFilterEngine::Zone::addNameTrigger(std::unordered_map<DNSName, Policy>& map, const DNSName& n, Policy&& pol, bool ignoreDuplicate, PolicyType ptype)
+/* short names are stored inside the DNSName object itself, without any additional allocation */
+static size_t getNameMemoryUsage(const DNSName& name)
 {
-  auto iter = map.find(n);
+  const auto& storage = name.getStorage();
+  const auto data = reinterpret_cast<uintptr_t>(storage.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto object = reinterpret_cast<uintptr_t>(&name); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (data >= object && data < object + sizeof(name)) {
+    return 0;
+  }
+  return storage.size();
+}
 
-  if (iter != map.end()) {
-    auto& existingPol = iter->second;
+uint32_t DNSFilterEngine::Zone::hashAction(const Policy& pol)
+{
+  const std::array<uint32_t, 3> header{static_cast<uint32_t>(pol.d_kind), static_cast<uint32_t>(pol.d_type), static_cast<uint32_t>(pol.d_ttl)};
+  auto hash = burtle(reinterpret_cast<const unsigned char*>(header.data()), sizeof(header), 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (pol.d_custom) {
+    for (const auto& record : *pol.d_custom) {
+      const auto content = record->getZoneRepresentation();
+      const uint16_t qtype = record->getType();
+      hash = burtle(reinterpret_cast<const unsigned char*>(&qtype), sizeof(qtype), hash); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      hash = burtle(reinterpret_cast<const unsigned char*>(content.data()), content.size(), hash); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+  }
+  return hash;
+}
+
+bool DNSFilterEngine::Zone::isSameAction(const Policy& lhs, const Policy& rhs)
+{
+  if (lhs.d_kind != rhs.d_kind || lhs.d_type != rhs.d_type || lhs.d_ttl != rhs.d_ttl || lhs.customRecordsSize() != rhs.customRecordsSize()) {
+    return false;
+  }
+  if (lhs.customRecordsSize() == 0) {
+    return true;
+  }
+  return std::equal(lhs.d_custom->cbegin(), lhs.d_custom->cend(), rhs.d_custom->cbegin(), [](const auto& left, const auto& right) {
+    return *left == *right;
+  });
+}
+
+size_t DNSFilterEngine::Zone::getActionMemoryUsage(const Policy& pol)
+{
+  /* a rough estimate for the content of a record, which depends on its type */
+  static constexpr size_t s_recordContentSize = 64;
+  size_t result = sizeof(ActionIndex); // in the list of actions with the same hash
+  if (pol.d_custom) {
+    result += sizeof(Policy::CustomData) + pol.d_custom->capacity() * sizeof(Policy::CustomData::value_type) + pol.d_custom->size() * s_recordContentSize;
+  }
+  return result;
+}
+
+DNSFilterEngine::Zone::ActionIndex DNSFilterEngine::Zone::addAction(Policy&& pol)
+{
+  pol.d_zoneData = d_zoneData;
+  pol.d_hitdata.reset();
+  const auto hash = hashAction(pol);
+
+  auto* sameHash = d_actionsByHash.findMutable(hash);
+  if (sameHash != nullptr) {
+    for (const auto actionIdx : *sameHash) {
+      const auto* existing = d_actions.find(actionIdx);
+      if (existing != nullptr && isSameAction(existing->second.d_policy, pol)) {
+        ++d_actions.findMutable(actionIdx)->d_users;
+        return actionIdx;
+      }
+    }
+  }
+
+  /* the indexes only wrap around after four billion new actions, skip the ones still in use when that happens */
+  while (d_actions.find(d_nextAction) != nullptr) {
+    ++d_nextAction;
+  }
+  const auto actionIdx = d_nextAction++;
+  d_actionsMemory += getActionMemoryUsage(pol);
+  d_actions.insert(actionIdx, Action{std::move(pol), 1});
+  if (sameHash != nullptr) {
+    sameHash->push_back(actionIdx);
+  }
+  else {
+    d_actionsByHash.insert(hash, {actionIdx});
+  }
+  return actionIdx;
+}
+
+void DNSFilterEngine::Zone::releaseAction(ActionIndex actionIdx)
+{
+  auto* action = d_actions.findMutable(actionIdx);
+  if (action == nullptr) {
+    return;
+  }
+  if (--action->d_users > 0) {
+    return;
+  }
+
+  const auto hash = hashAction(action->d_policy);
+  d_actionsMemory -= std::min(d_actionsMemory, getActionMemoryUsage(action->d_policy));
+  auto* sameHash = d_actionsByHash.findMutable(hash);
+  if (sameHash != nullptr) {
+    sameHash->erase(std::remove(sameHash->begin(), sameHash->end(), actionIdx), sameHash->end());
+    if (sameHash->empty()) {
+      d_actionsByHash.erase(hash);
+    }
+  }
+  d_actions.erase(actionIdx);
+}
+
+const DNSFilterEngine::Policy& DNSFilterEngine::Zone::getAction(ActionIndex actionIdx) const
+{
+  const auto* action = d_actions.find(actionIdx);
+  if (action == nullptr) {
+    throw std::runtime_error("Unknown action " + std::to_string(actionIdx) + " in RPZ zone " + getName());
+  }
+  return action->second.d_policy;
+}
+
+void DNSFilterEngine::Zone::addNameTrigger(NamedPolicies& map, const DNSName& n, Policy&& pol, bool ignoreDuplicate, PolicyType ptype)
+{
+  const auto* existing = map.find(n);
+
+  if (existing != nullptr) {
+    const auto& existingPol = getAction(existing->second);
 
     if (pol.d_kind != PolicyKind::Custom && !ignoreDuplicate) {
       if (d_zoneData->d_ignoreDuplicates) {
@@ -398,21 +607,35 @@ void DNSFilterEngine::Zone::addNameTrigger(std::unordered_map<DNSName, Policy>&
       throw std::runtime_error("Adding a " + getTypeToString(ptype) + "-based filter policy of kind " + getKindToString(pol.d_kind) + " but a policy of kind " + getKindToString(existingPol.d_kind) + " already exists for for the following name: " + n.toLogString());
     }
 
-    addCustom(existingPol, pol);
+    /* the existing action might be used by other names as well, so we do not modify it in place */
+    Policy merged(existingPol);
+    addCustom(merged, pol);
+    const auto mergedIdx = addAction(std::move(merged));
+    auto* actionIdx = map.findMutable(n);
+    releaseAction(*actionIdx);
+    *actionIdx = mergedIdx;
   }
   else {
-    auto& qpol = map.insert({n, std::move(pol)}).first->second;
-    qpol.d_zoneData = d_zoneData;
-    qpol.d_type = ptype;
+    pol.d_type = ptype;
+    map.insert(n, addAction(std::move(pol)));
+    d_namesMemory += getNameMemoryUsage(n);
+  }
+}
+
+NetmaskTree<DNSFilterEngine::Policy>& DNSFilterEngine::Zone::getMutableTree(NetmaskPolicies& nmt)
+{
+  if (nmt.use_count() > 1) {
+    nmt = std::make_shared<NetmaskTree<Policy>>(*nmt);
   }
+  return *nmt;
 }
 
-void DNSFilterEngine::Zone::addNetmaskTrigger(NetmaskTree<Policy>& nmt, const Netmask& netmask, Policy&& pol, bool ignoreDuplicate, PolicyType ptype)
+void DNSFilterEngine::Zone::addNetmaskTrigger(NetmaskPolicies& nmtPtr, const Netmask& netmask, Policy&& pol, bool ignoreDuplicate, PolicyType ptype)
 {
-  bool exists = nmt.has_key(netmask);
+  bool exists = nmtPtr->has_key(netmask);
 
   if (exists) {
-    auto& existingPol = nmt.lookup(netmask)->second;
+    const auto& existingPol = nmtPtr->lookup(netmask)->second;
 
     if (pol.d_kind != PolicyKind::Custom && !ignoreDuplicate) {
       if (d_zoneData->d_ignoreDuplicates) {
@@ -428,28 +651,33 @@ void DNSFilterEngine::Zone::addNetmaskTrigger(NetmaskTree<Policy>& nmt, const Ne
       throw std::runtime_error("Adding a " + getTypeToString(ptype) + "-based filter policy of kind " + getKindToString(pol.d_kind) + " but a policy of kind " + getKindToString(existingPol.d_kind) + " already exists for the following netmask: " + netmask.toString());
     }
 
-    addCustom(existingPol, pol);
+    addCustom(getMutableTree(nmtPtr).lookup(netmask)->second, pol);
   }
   else {
     pol.d_zoneData = d_zoneData;
     pol.d_type = ptype;
-    nmt.insert(netmask).second = std::move(pol);
+    getMutableTree(nmtPtr).insert(netmask).second = std::move(pol);
   }
 }
 
-bool DNSFilterEngine::Zone::rmNameTrigger(std::unordered_map<DNSName, Policy>& map, const DNSName& name, const Policy& pol)
+bool DNSFilterEngine::Zone::rmNameTrigger(NamedPolicies& map, const DNSName& name, const Policy& pol)
 {
-  auto found = map.find(name);
-  if (found == map.end()) {
+  const auto* found = map.find(name);
+  if (found == nullptr) {
     return false;
   }
 
-  auto& existing = found->second;
-  if (existing.d_kind != DNSFilterEngine::PolicyKind::Custom) {
-    map.erase(found);
+  const auto actionIdx = found->second;
+  if (getAction(actionIdx).d_kind != DNSFilterEngine::PolicyKind::Custom) {
+    map.erase(name);
+    releaseAction(actionIdx);
+    d_namesMemory -= std::min(d_namesMemory, getNameMemoryUsage(name));
     return true;
   }
 
+  /* the existing action might be used by other names as well, so we work on a copy */
+  Policy existing(getAction(actionIdx));
+
   /* for custom types, we might have more than one type,
      and then we need to remove only the right ones. */
   bool result = false;
@@ -467,20 +695,28 @@ bool DNSFilterEngine::Zone::rmNameTrigger(std::unordered_map<DNSName, Policy>& m
 
   // No records left for this trigger?
   if (existing.customRecordsSize() == 0) {
-    map.erase(found);
+    map.erase(name);
+    releaseAction(actionIdx);
+    d_namesMemory -= std::min(d_namesMemory, getNameMemoryUsage(name));
     return true;
   }
 
+  if (result) {
+    *map.findMutable(name) = addAction(std::move(existing));
+    releaseAction(actionIdx);
+  }
+
   return result;
 }
 
-bool DNSFilterEngine::Zone::rmNetmaskTrigger(NetmaskTree<Policy>& nmt, const Netmask& netmask, const Policy& pol)
+bool DNSFilterEngine::Zone::rmNetmaskTrigger(NetmaskPolicies& nmtPtr, const Netmask& netmask, const Policy& pol)
 {
-  bool found = nmt.has_key(netmask);
+  bool found = nmtPtr->has_key(netmask);
   if (!found) {
     return false;
   }
 
+  auto& nmt = getMutableTree(nmtPtr);
   auto& existing = nmt.lookup(netmask)->second;
   if (existing.d_kind != DNSFilterEngine::PolicyKind::Custom) {
     nmt.erase(netmask);
@@ -803,27 +1039,36 @@ void DNSFilterEngine::Zone::dump(FILE* filePtr) const
   auto soa = DNSRecordContent::make(QType::SOA, QClass::IN, "fake.RPZ. hostmaster.fake.RPZ. " + std::to_string(d_serial) + " " + std::to_string(d_refresh) + " 600 3600000 604800");
   fprintf(filePtr, "%s IN SOA %s\n", d_domain.toString().c_str(), soa->getZoneRepresentation().c_str());
 
-  for (const auto& pair : d_qpolName) {
-    dumpNamedPolicy(filePtr, pair.first + d_domain, pair.second);
-  }
+  d_qpolName.visit([this, filePtr](const DNSName& name, ActionIndex actionIdx) {
+    dumpNamedPolicy(filePtr, name + d_domain, getAction(actionIdx));
+  });
 
-  for (const auto& pair : d_propolName) {
-    dumpNamedPolicy(filePtr, pair.first + DNSName(rpzNSDnameName) + d_domain, pair.second);
-  }
+  const DNSName nsdnameSuffix = DNSName(rpzNSDnameName) + d_domain;
+  d_propolName.visit([this, filePtr, &nsdnameSuffix](const DNSName& name, ActionIndex actionIdx) {
+    dumpNamedPolicy(filePtr, name + nsdnameSuffix, getAction(actionIdx));
+  });
 
-  for (const auto& pair : d_qpolAddr) {
+  for (const auto& pair : *d_qpolAddr) {
     dumpAddrPolicy(filePtr, pair.first, DNSName(rpzClientIPName) + d_domain, pair.second);
   }
 
-  for (const auto& pair : d_propolNSAddr) {
+  for (const auto& pair : *d_propolNSAddr) {
     dumpAddrPolicy(filePtr, pair.first, DNSName(rpzNSIPName) + d_domain, pair.second);
   }
 
-  for (const auto& pair : d_postpolAddr) {
+  for (const auto& pair : *d_postpolAddr) {
     dumpAddrPolicy(filePtr, pair.first, DNSName(rpzIPName) + d_domain, pair.second);
   }
 }
 
+size_t DNSFilterEngine::Zone::getMemoryUsage() const
+{
+  /* a rough estimate for the netmask trees: a netmask, a policy and a few pointers for the tree itself */
+  static constexpr size_t s_netmaskEntrySize = sizeof(Netmask) + sizeof(Policy) + 4 * sizeof(void*);
+  const size_t netmaskEntries = d_qpolAddr->size() + d_propolNSAddr->size() + d_postpolAddr->size();
+  return d_qpolName.getMemoryUsage() + d_propolName.getMemoryUsage() + d_namesMemory + d_actions.getMemoryUsage() + d_actionsByHash.getMemoryUsage() + d_actionsMemory + netmaskEntries * s_netmaskEntrySize;
+}
+
 void mergePolicyTags(std::unordered_set<std::string>& tags, const std::unordered_set<std::string>& newTags)
 {
   for (const auto& tag : newTags) {
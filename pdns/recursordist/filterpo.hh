@@ -25,6 +25,7 @@
 #include "dnsname.hh"
 #include "dnsparser.hh"
 #include "logging.hh"
+#include "persistent-hashmap.hh"
 #include <map>
 #include <unordered_map>
 #include <limits>
@@ -298,22 +299,60 @@ public:
   class Zone
   {
   public:
+    using ActionIndex = uint32_t;
+    /* Wildcard triggers are hashed without their leading '*' label, so that the wildcards covering a name can be
+       looked up directly from the labels of that name, without building the wildcard names */
+    struct TriggerHash
+    {
+      size_t operator()(const DNSName& name) const;
+      static uint32_t hashWildcardSuffix(const unsigned char* suffix, size_t suffixLen);
+      static bool isWildcardOf(const DNSName& name, const unsigned char* suffix, size_t suffixLen);
+
+      /* calls visitor(suffix, suffixLen) with the raw storage of each parent of name, closest first,
+         until it returns true */
+      template <typename Visitor>
+      static bool visitParents(const DNSName& name, const Visitor& visitor)
+      {
+        const auto& storage = name.getStorage();
+        const auto* raw = reinterpret_cast<const unsigned char*>(storage.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        size_t pos = 0;
+        while (pos < storage.size() && raw[pos] != 0) { // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+          pos += raw[pos] + 1; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+          if (pos >= storage.size()) {
+            break;
+          }
+          if (visitor(&raw[pos], storage.size() - pos)) { // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            return true;
+          }
+        }
+        return false;
+      }
+    };
+    using NamedPolicies = pdns::PersistentHashMap<DNSName, ActionIndex, TriggerHash>;
+
     Zone() :
       d_zoneData(std::make_shared<PolicyZoneData>())
     {
     }
 
+    /* Copying a zone is cheap: the name-based triggers are stored in persistent maps sharing their nodes with
+       the copies, and the netmask-based ones are only copied when a copy modifies them. */
     void clear()
     {
-      d_qpolAddr.clear();
-      d_postpolAddr.clear();
+      d_qpolAddr = std::make_shared<NetmaskTree<Policy>>();
+      d_postpolAddr = std::make_shared<NetmaskTree<Policy>>();
       d_propolName.clear();
-      d_propolNSAddr.clear();
+      d_propolNSAddr = std::make_shared<NetmaskTree<Policy>>();
       d_qpolName.clear();
+      d_namesMemory = 0;
+      d_actions.clear();
+      d_actionsByHash.clear();
+      d_actionsMemory = 0;
+      d_nextAction = 0;
     }
-    void reserve(size_t entriesCount)
+    void reserve([[maybe_unused]] size_t entriesCount)
     {
-      d_qpolName.reserve(entriesCount);
+      /* the persistent maps grow one node at a time, there is nothing to reserve */
     }
     void setName(const std::string& name)
     {
@@ -377,7 +416,26 @@ public:
 
     [[nodiscard]] size_t size() const
     {
-      return d_qpolAddr.size() + d_postpolAddr.size() + d_propolName.size() + d_propolNSAddr.size() + d_qpolName.size();
+      return d_qpolAddr->size() + d_postpolAddr->size() + d_propolName.size() + d_propolNSAddr->size() + d_qpolName.size();
+    }
+
+    /* Approximate number of bytes used by the triggers of this zone, including the parts shared with other copies */
+    [[nodiscard]] size_t getMemoryUsage() const;
+
+    [[nodiscard]] const NamedPolicies& getQNameTriggers() const
+    {
+      return d_qpolName;
+    }
+
+    [[nodiscard]] const NamedPolicies& getNSTriggers() const
+    {
+      return d_propolName;
+    }
+
+    /* Number of distinct actions used by the name-based triggers */
+    [[nodiscard]] size_t getActionsCount() const
+    {
+      return d_actions.size();
     }
 
     void setIncludeSOA(bool flag)
@@ -406,13 +464,16 @@ public:
 
     bool findExactQNamePolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const;
     bool findExactNSPolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const;
+    /* look for an exact match first, then for the closest wildcard covering qname */
+    bool findQNamePolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const;
+    bool findNSPolicy(const DNSName& qname, DNSFilterEngine::Policy& pol) const;
     bool findNSIPPolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const;
     bool findResponsePolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const;
     bool findClientPolicy(const ComboAddress& addr, DNSFilterEngine::Policy& pol) const;
 
     [[nodiscard]] bool hasClientPolicies() const
     {
-      return !d_qpolAddr.empty();
+      return !d_qpolAddr->empty();
     }
     [[nodiscard]] bool hasQNamePolicies() const
     {
@@ -424,11 +485,11 @@ public:
     }
     [[nodiscard]] bool hasNSIPPolicies() const
     {
-      return !d_propolNSAddr.empty();
+      return !d_propolNSAddr->empty();
     }
     [[nodiscard]] bool hasResponsePolicies() const
     {
-      return !d_postpolAddr.empty();
+      return !d_postpolAddr->empty();
     }
     [[nodiscard]] Priority getPriority() const
     {
@@ -442,37 +503,68 @@ public:
     static DNSName maskToRPZ(const Netmask& netmask);
 
   private:
-    void addNameTrigger(std::unordered_map<DNSName, Policy>& map, const DNSName& n, Policy&& pol, bool ignoreDuplicate, PolicyType ptype);
-    void addNetmaskTrigger(NetmaskTree<Policy>& nmt, const Netmask& netmask, Policy&& pol, bool ignoreDuplicate, PolicyType ptype);
-    static bool rmNameTrigger(std::unordered_map<DNSName, Policy>& map, const DNSName& n, const Policy& pol);
-    static bool rmNetmaskTrigger(NetmaskTree<Policy>& nmt, const Netmask& netmask, const Policy& pol);
-
-    static bool findExactNamedPolicy(const std::unordered_map<DNSName, DNSFilterEngine::Policy>& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol);
-    static bool findNamedPolicy(const std::unordered_map<DNSName, DNSFilterEngine::Policy>& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol);
+    /* The name-based triggers only store the index of their action in a table of the distinct actions of the zone:
+       most zones use a handful of actions for millions of names ("CNAME ." for example), and names with the same
+       local data share a single copy of the records. */
+    struct Action
+    {
+      Policy d_policy;
+      uint32_t d_users{0};
+    };
+    using NetmaskPolicies = std::shared_ptr<NetmaskTree<Policy>>;
+    using Actions = pdns::PersistentHashMap<ActionIndex, Action>;
+    /* the indexes of the actions, by hash of their content, to find whether an identical action already exists */
+    using ActionsByHash = pdns::PersistentHashMap<uint32_t, std::vector<ActionIndex>>;
+
+    ActionIndex addAction(Policy&& pol);
+    void releaseAction(ActionIndex actionIdx);
+    [[nodiscard]] const Policy& getAction(ActionIndex actionIdx) const;
+    static uint32_t hashAction(const Policy& pol);
+    static bool isSameAction(const Policy& lhs, const Policy& rhs);
+    static size_t getActionMemoryUsage(const Policy& pol);
+
+    void addNameTrigger(NamedPolicies& map, const DNSName& n, Policy&& pol, bool ignoreDuplicate, PolicyType ptype);
+    void addNetmaskTrigger(NetmaskPolicies& nmt, const Netmask& netmask, Policy&& pol, bool ignoreDuplicate, PolicyType ptype);
+    bool rmNameTrigger(NamedPolicies& map, const DNSName& n, const Policy& pol);
+    static bool rmNetmaskTrigger(NetmaskPolicies& nmt, const Netmask& netmask, const Policy& pol);
+    /* the netmask trees are shared between copies of the zone until one of them needs to modify its tree */
+    static NetmaskTree<Policy>& getMutableTree(NetmaskPolicies& nmt);
+
+    bool findExactNamedPolicy(const NamedPolicies& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol) const;
+    bool findNamedPolicy(const NamedPolicies& polmap, const DNSName& qname, DNSFilterEngine::Policy& pol) const;
     static void dumpNamedPolicy(FILE* filePtr, const DNSName& name, const Policy& pol);
     static void dumpAddrPolicy(FILE* filePtr, const Netmask& netmask, const DNSName& name, const Policy& pol);
 
-    std::unordered_map<DNSName, Policy> d_qpolName; // QNAME trigger (RPZ)
-    NetmaskTree<Policy> d_qpolAddr; // Source address
-    std::unordered_map<DNSName, Policy> d_propolName; // NSDNAME (RPZ)
-    NetmaskTree<Policy> d_propolNSAddr; // NSIP (RPZ)
-    NetmaskTree<Policy> d_postpolAddr; // IP trigger (RPZ)
+    NamedPolicies d_qpolName; // QNAME trigger (RPZ)
+    NetmaskPolicies d_qpolAddr{std::make_shared<NetmaskTree<Policy>>()}; // Source address
+    NamedPolicies d_propolName; // NSDNAME (RPZ)
+    NetmaskPolicies d_propolNSAddr{std::make_shared<NetmaskTree<Policy>>()}; // NSIP (RPZ)
+    NetmaskPolicies d_postpolAddr{std::make_shared<NetmaskTree<Policy>>()}; // IP trigger (RPZ)
     DNSName d_domain;
+    Actions d_actions;
+    ActionsByHash d_actionsByHash;
+    size_t d_namesMemory{0}; // memory allocated by the names of the name-based triggers
+    size_t d_actionsMemory{0}; // memory allocated by the local data of the actions
     std::shared_ptr<PolicyZoneData> d_zoneData{nullptr};
     uint32_t d_serial{0};
     uint32_t d_refresh{0};
+    ActionIndex d_nextAction{0};
   };
 
   DNSFilterEngine();
   void clear()
   {
-    for (auto& zone : d_zones) {
-      zone->clear();
+    for (size_t zoneIdx = 0; zoneIdx < d_zones.size(); zoneIdx++) {
+      d_zones[zoneIdx]->clear();
+      indexZone(zoneIdx);
     }
   }
   void clearZones()
   {
     d_zones.clear();
+    d_indexedZones.clear();
+    d_qnameIndex.clear();
+    d_nsIndex.clear();
   }
   [[nodiscard]] std::shared_ptr<Zone> getZone(size_t zoneIdx) const
   {
@@ -496,6 +588,7 @@ public:
   {
     newZone->setPriority(d_zones.size());
     d_zones.push_back(newZone);
+    indexZone(d_zones.size() - 1);
     return (d_zones.size() - 1);
   }
   void setZone(size_t zoneIdx, const std::shared_ptr<Zone>& newZone)
@@ -504,6 +597,7 @@ public:
       assureZones(zoneIdx);
       newZone->setPriority(zoneIdx);
       d_zones[zoneIdx] = newZone;
+      indexZone(zoneIdx);
     }
   }
 
@@ -566,8 +660,31 @@ public:
   }
 
 private:
+  /* Combined index of the name-based triggers of all zones: for the hash of each trigger, the zones having a trigger
+     with that hash. A single walk over the labels of a name tells which zones might have a matching trigger, and
+     the other ones are skipped. Hash collisions only make us look into a zone for nothing. */
+  using ZonesMask = uint32_t;
+  using ZonesIndex = pdns::PersistentHashMap<uint32_t, ZonesMask>;
+  static constexpr size_t s_maxIndexedZones = std::numeric_limits<ZonesMask>::digits;
+  struct IndexedZone
+  {
+    /* the versions of the triggers of the zone present in the indexes. The zones are only supposed to be modified
+       before being passed to setZone(), but if one is modified afterwards, we notice and stop trusting the index
+       for that zone */
+    Zone::NamedPolicies d_qnames;
+    Zone::NamedPolicies d_nsNames;
+  };
+
   void assureZones(size_t zone);
+  void indexZone(size_t zoneIdx);
+  static void updateIndex(ZonesIndex& index, size_t zoneIdx, Zone::NamedPolicies& indexed, const Zone::NamedPolicies& current);
+  static ZonesMask getIndexedMatches(const ZonesIndex& index, const DNSName& qname);
+  static bool isRuledOutByIndex(ZonesMask matches, size_t zoneIdx, const Zone::NamedPolicies& indexed, const Zone::NamedPolicies& current);
+
   vector<std::shared_ptr<Zone>> d_zones;
+  vector<IndexedZone> d_indexedZones;
+  ZonesIndex d_qnameIndex;
+  ZonesIndex d_nsIndex;
 };
 
 void mergePolicyTags(std::unordered_set<std::string>& tags, const std::unordered_set<std::string>& newTags);
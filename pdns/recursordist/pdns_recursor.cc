@@ -2174,6 +2174,157 @@ bool expectProxyProtocol(const ComboAddress& from, const ComboAddress& listenAdd
   return g_proxyProtocolACL.match(from) && g_proxyProtocolExceptions.count(listenAddress) == 0;
 }
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+/* maximum number of queries read from a listening socket by a single recvmmsg() call,
+   and therefore of packet cache hits sent back by a single sendmmsg() call */
+static constexpr size_t s_udpBatchSize = 32;
+
+/* queries read from a listening socket by a single recvmmsg() call */
+class UDPQueriesBatch
+{
+public:
+  UDPQueriesBatch(size_t size) :
+    d_data(size), d_remotes(size), d_iovs(size), d_cbufs(size), d_msgs(size)
+  {
+  }
+
+  int receive(int fileDesc, size_t count, size_t maxQuerySize)
+  {
+    count = std::min(count, d_msgs.size());
+    for (size_t idx = 0; idx < count; idx++) {
+      auto& data = d_data.at(idx);
+      auto& remote = d_remotes.at(idx);
+      data.resize(maxQuerySize);
+      remote.sin6.sin6_family = AF_INET6; // this makes sure remote is big enough
+      d_msgs.at(idx).msg_len = 0;
+      fillMSGHdr(&d_msgs.at(idx).msg_hdr, &d_iovs.at(idx), &d_cbufs.at(idx), sizeof(cmsgbuf_aligned), data.data(), data.size(), &remote);
+    }
+    return recvmmsg(fileDesc, d_msgs.data(), count, MSG_WAITFORONE, nullptr);
+  }
+
+  std::string& getData(size_t idx)
+  {
+    return d_data.at(idx);
+  }
+
+  ComboAddress& getRemote(size_t idx)
+  {
+    return d_remotes.at(idx);
+  }
+
+  mmsghdr& getMessage(size_t idx)
+  {
+    return d_msgs.at(idx);
+  }
+
+private:
+  std::vector<std::string> d_data;
+  std::vector<ComboAddress> d_remotes;
+  std::vector<iovec> d_iovs;
+  std::vector<cmsgbuf_aligned> d_cbufs;
+  std::vector<mmsghdr> d_msgs;
+};
+
+/* packet cache hits for the queries of a single UDPQueriesBatch, sent back with sendmmsg() once the batch
+   has been processed. Queries that need to be resolved are answered by their own mthread, as before. */
+class UDPResponsesBatch
+{
+public:
+  UDPResponsesBatch(size_t size) :
+    d_entries(size), d_msgs(size)
+  {
+  }
+
+  /* start queueing the responses to queries received on fileDesc */
+  void start(int fileDesc)
+  {
+    d_socket = fileDesc;
+  }
+
+  bool queue(int fileDesc, std::string&& response, const ComboAddress& remote, const ComboAddress& source, const ComboAddress* local, const struct timeval& received)
+  {
+    if (fileDesc != d_socket || d_count >= d_entries.size()) {
+      return false;
+    }
+    auto& entry = d_entries.at(d_count);
+    entry.response = std::move(response);
+    entry.remote = remote;
+    entry.source = source;
+    if (local != nullptr) {
+      entry.local = *local;
+    }
+    else {
+      entry.local.reset();
+    }
+    entry.received = received;
+    ++d_count;
+    return true;
+  }
+
+  void flush()
+  {
+    if (d_count > 0) {
+      for (size_t idx = 0; idx < d_count; idx++) {
+        auto& entry = d_entries.at(idx);
+        auto& msg = d_msgs.at(idx);
+        msg.msg_len = 0;
+        fillMSGHdr(&msg.msg_hdr, &entry.iov, nullptr, 0, entry.response.data(), entry.response.size(), &entry.remote);
+        if (entry.local.sin4.sin_family != 0) {
+          addCMsgSrcAddr(&msg.msg_hdr, &entry.cbuf, &entry.local, 0);
+        }
+      }
+      send();
+      t_Counters.at(rec::Histogram::udpSendBatches)(d_count);
+
+      struct timeval now
+      {
+      };
+      Utility::gettimeofday(&now, nullptr);
+      for (size_t idx = 0; idx < d_count; idx++) {
+        t_Counters.at(rec::Histogram::cumulativeAnswers)(uSec(now - d_entries.at(idx).received));
+      }
+    }
+    d_count = 0;
+    d_socket = -1;
+  }
+
+private:
+  void send()
+  {
+    sendMultipleMessages(d_socket, d_msgs.data(), static_cast<unsigned int>(d_count), [this](unsigned int failed, int sendErr) {
+      if (g_logCommonErrors) {
+        const auto& entry = d_entries.at(failed);
+        SLOG(g_log << Logger::Warning << "Sending UDP reply to client " << entry.source.toStringWithPort()
+                   << (entry.source != entry.remote ? " (via " + entry.remote.toStringWithPort() + ")" : "") << " failed with: "
+                   << stringerror(sendErr) << endl,
+             g_slogudpin->error(Logr::Error, sendErr, "Sending UDP reply to client failed", "source", Logging::Loggable(entry.source), "remote", Logging::Loggable(entry.remote)));
+      }
+    });
+  }
+
+  struct Entry
+  {
+    std::string response;
+    ComboAddress remote;
+    ComboAddress source;
+    ComboAddress local;
+    struct timeval received
+    {
+    };
+    iovec iov{};
+    cmsgbuf_aligned cbuf{};
+  };
+
+  std::vector<Entry> d_entries;
+  std::vector<mmsghdr> d_msgs;
+  size_t d_count{0};
+  int d_socket{-1};
+};
+
+/* only queues responses while a worker thread is processing a batch of queries read from one of its listening sockets */
+static thread_local UDPResponsesBatch t_udpResponses(s_udpBatchSize);
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG && MSG_WAITFORONE */
+
 // fromaddr: the address the query is coming from
 // destaddr: the address the query was received on
 // source: the address we assume the query is coming from, might be set by proxy protocol
@@ -2320,20 +2471,29 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
                                  "qname", Logging::Loggable(qname), "qtype", Logging::Loggable(QType(qtype)),
                                  "source", Logging::Loggable(source), "remote", Logging::Loggable(fromaddr)));
         }
-        struct msghdr msgh
-        {
-        };
-        struct iovec iov
-        {
-        };
-        cmsgbuf_aligned cbuf{};
-        fillMSGHdr(&msgh, &iov, &cbuf, 0, reinterpret_cast<char*>(response.data()), response.length(), const_cast<ComboAddress*>(&fromaddr)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-type-const-cast)
-        msgh.msg_control = nullptr;
+        const bool fromto = g_fromtosockets.count(fileDesc) != 0;
+        int sendErr = 0;
+        bool queued = false;
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+        /* the answer time is recorded once the batch has actually been sent */
+        queued = t_udpResponses.queue(fileDesc, std::move(response), fromaddr, source, fromto ? &destaddr : nullptr, tval);
+#endif
+        if (!queued) {
+          struct msghdr msgh
+          {
+          };
+          struct iovec iov
+          {
+          };
+          cmsgbuf_aligned cbuf{};
+          fillMSGHdr(&msgh, &iov, &cbuf, 0, reinterpret_cast<char*>(response.data()), response.length(), const_cast<ComboAddress*>(&fromaddr)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-type-const-cast)
+          msgh.msg_control = nullptr;
 
-        if (g_fromtosockets.count(fileDesc) != 0) {
-          addCMsgSrcAddr(&msgh, &cbuf, &destaddr, 0);
+          if (fromto) {
+            addCMsgSrcAddr(&msgh, &cbuf, &destaddr, 0);
+          }
+          sendErr = sendOnNBSocket(fileDesc, &msgh);
         }
-        int sendErr = sendOnNBSocket(fileDesc, &msgh);
         eventTrace.add(RecEventTrace::AnswerSent);
 
         if (t_protobufServers.servers && logResponse && (!luaconfsLocal->protobufExportConfig.taggedOnly || !pbData || pbData->d_tagged)) {
@@ -2350,12 +2510,14 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
                      << stringerror(sendErr) << endl,
                g_slogudpin->error(Logr::Error, sendErr, "Sending UDP reply to client failed", "source", Logging::Loggable(source), "remote", Logging::Loggable(fromaddr)));
         }
-        struct timeval now
-        {
-        };
-        Utility::gettimeofday(&now, nullptr);
-        uint64_t spentUsec = uSec(now - tval);
-        t_Counters.at(rec::Histogram::cumulativeAnswers)(spentUsec);
+        if (!queued) {
+          struct timeval now
+          {
+          };
+          Utility::gettimeofday(&now, nullptr);
+          uint64_t spentUsec = uSec(now - tval);
+          t_Counters.at(rec::Histogram::cumulativeAnswers)(spentUsec);
+        }
         t_Counters.updateSnap(g_regressionTestMode);
         return nullptr;
       }
@@ -2456,217 +2618,261 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
   return nullptr;
 }
 
-static void handleNewUDPQuestion(int fileDesc, FDMultiplexer::funcparam_t& /* var */) // NOLINT(readability-function-cognitive-complexity): https://github.com/PowerDNS/pdns/issues/12791
+// fileDesc: the listening socket the query has been read from
+// data: the query, as read from the socket, of which len bytes are valid
+// msgh: the header filled by recvmsg() or recvmmsg(), to get the ancillary data from
+// fromaddr: the address the query is coming from
+static void handleUDPQuestion(int fileDesc, std::string& data, ssize_t len, struct msghdr& msgh, const ComboAddress& fromaddr, std::vector<ProxyProtocolValue>& proxyProtocolValues, RecEventTrace& eventTrace) // NOLINT(readability-function-cognitive-complexity): https://github.com/PowerDNS/pdns/issues/12791
 {
-  static const size_t maxIncomingQuerySize = g_proxyProtocolACL.empty() ? 512 : (512 + g_proxyProtocolMaximumSize);
-  static thread_local std::string data;
-  ComboAddress fromaddr; // the address the query is coming from
   ComboAddress source; // the address we assume the query is coming from, might be set by proxy protocol
   ComboAddress destination; // the address we assume the query was sent to, might be set by proxy protocol
-  struct msghdr msgh
-  {
-  };
-  struct iovec iov
-  {
-  };
-  cmsgbuf_aligned cbuf;
-  bool firstQuery = true;
-  std::vector<ProxyProtocolValue> proxyProtocolValues;
-  RecEventTrace eventTrace;
+  bool proxyProto = false;
+  proxyProtocolValues.clear();
 
-  for (size_t queriesCounter = 0; queriesCounter < g_maxUDPQueriesPerRound; queriesCounter++) {
-    bool proxyProto = false;
-    proxyProtocolValues.clear();
-    data.resize(maxIncomingQuerySize);
-    fromaddr.sin6.sin6_family = AF_INET6; // this makes sure fromaddr is big enough
-    fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), data.data(), data.size(), &fromaddr);
+  eventTrace.clear();
+  eventTrace.setEnabled(SyncRes::s_event_trace_enabled != 0);
+  eventTrace.add(RecEventTrace::ReqRecv);
 
-    if (ssize_t len = recvmsg(fileDesc, &msgh, 0); len >= 0) {
-      eventTrace.clear();
-      eventTrace.setEnabled(SyncRes::s_event_trace_enabled != 0);
-      eventTrace.add(RecEventTrace::ReqRecv);
+  if ((msgh.msg_flags & MSG_TRUNC) != 0) {
+    t_Counters.at(rec::Counter::truncatedDrops)++;
+    if (!g_quiet) {
+      SLOG(g_log << Logger::Error << "Ignoring truncated query from " << fromaddr.toString() << endl,
+           g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr)));
+    }
+    return;
+  }
 
-      firstQuery = false;
+  data.resize(static_cast<size_t>(len));
 
-      if ((msgh.msg_flags & MSG_TRUNC) != 0) {
-        t_Counters.at(rec::Counter::truncatedDrops)++;
-        if (!g_quiet) {
-          SLOG(g_log << Logger::Error << "Ignoring truncated query from " << fromaddr.toString() << endl,
-               g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr)));
-        }
-        return;
+  ComboAddress destaddr; // the address the query was sent to to
+  destaddr.reset(); // this makes sure we ignore this address if not explictly set below
+  const auto* loc = rplookup(g_listenSocketsAddresses, fileDesc);
+  if (HarvestDestinationAddress(&msgh, &destaddr)) {
+    // but.. need to get port too
+    if (loc != nullptr) {
+      destaddr.sin4.sin_port = loc->sin4.sin_port;
+    }
+  }
+  else {
+    if (loc != nullptr) {
+      destaddr = *loc;
+    }
+    else {
+      destaddr.sin4.sin_family = fromaddr.sin4.sin_family;
+      socklen_t slen = destaddr.getSocklen();
+      getsockname(fileDesc, reinterpret_cast<sockaddr*>(&destaddr), &slen); // if this fails, we're ok with it  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+  }
+  if (expectProxyProtocol(fromaddr, destaddr)) {
+    bool tcp = false;
+    ssize_t used = parseProxyHeader(data, proxyProto, source, destination, tcp, proxyProtocolValues);
+    if (used <= 0) {
+      ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+      if (!g_quiet) {
+        SLOG(g_log << Logger::Error << "Ignoring invalid proxy protocol (" << std::to_string(len) << ", " << std::to_string(used) << ") query from " << fromaddr.toStringWithPort() << endl,
+             g_slogudpin->info(Logr::Error, "Ignoring invalid proxy protocol query", "length", Logging::Loggable(len),
+                               "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr)));
+      }
+      return;
+    }
+    if (static_cast<size_t>(used) > g_proxyProtocolMaximumSize) {
+      if (g_quiet) {
+        SLOG(g_log << Logger::Error << "Proxy protocol header in UDP packet from " << fromaddr.toStringWithPort() << " is larger than proxy-protocol-maximum-size (" << used << "), dropping" << endl,
+             g_slogudpin->info(Logr::Error, "Proxy protocol header in UDP packet  is larger than proxy-protocol-maximum-size",
+                               "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr)));
       }
+      ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+      return;
+    }
 
-      data.resize(static_cast<size_t>(len));
+    data.erase(0, used);
+  }
+  else if (len > 512) {
+    /* we only allow UDP packets larger than 512 for those with a proxy protocol header */
+    t_Counters.at(rec::Counter::truncatedDrops)++;
+    if (!g_quiet) {
+      SLOG(g_log << Logger::Error << "Ignoring truncated query from " << fromaddr.toStringWithPort() << endl,
+           g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr)));
+    }
+    return;
+  }
 
-      ComboAddress destaddr; // the address the query was sent to to
-      destaddr.reset(); // this makes sure we ignore this address if not explictly set below
-      const auto* loc = rplookup(g_listenSocketsAddresses, fileDesc);
-      if (HarvestDestinationAddress(&msgh, &destaddr)) {
-        // but.. need to get port too
-        if (loc != nullptr) {
-          destaddr.sin4.sin_port = loc->sin4.sin_port;
-        }
+  if (data.size() < sizeof(dnsheader)) {
+    t_Counters.at(rec::Counter::ignoredCount)++;
+    if (!g_quiet) {
+      SLOG(g_log << Logger::Error << "Ignoring too-short (" << std::to_string(data.size()) << ") query from " << fromaddr.toString() << endl,
+           g_slogudpin->info(Logr::Error, "Ignoring too-short query", "length", Logging::Loggable(data.size()),
+                             "remote", Logging::Loggable(fromaddr)));
+    }
+    return;
+  }
+
+  if (!proxyProto) {
+    source = fromaddr;
+  }
+  ComboAddress mappedSource = source;
+  if (t_proxyMapping) {
+    if (const auto* iter = t_proxyMapping->lookup(source)) {
+      mappedSource = iter->second.address;
+      ++iter->second.stats.netmaskMatches;
+    }
+  }
+  if (t_remotes) {
+    t_remotes->push_back(source);
+  }
+
+  if (t_allowFrom && !t_allowFrom->match(&mappedSource)) {
+    if (!g_quiet) {
+      SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP query from " << mappedSource.toString() << ", address not matched by allow-from" << endl,
+           g_slogudpin->info(Logr::Error, "Dropping UDP query, address not matched by allow-from", "source", Logging::Loggable(mappedSource)));
+    }
+
+    t_Counters.at(rec::Counter::unauthorizedUDP)++;
+    return;
+  }
+
+  BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
+  if (fromaddr.sin4.sin_port == 0) { // also works for IPv6
+    if (!g_quiet) {
+      SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP query from " << fromaddr.toStringWithPort() << ", can't deal with port 0" << endl,
+           g_slogudpin->info(Logr::Error, "Dropping UDP query can't deal with port 0", "remote", Logging::Loggable(fromaddr)));
+    }
+
+    t_Counters.at(rec::Counter::clientParseError)++; // not quite the best place to put it, but needs to go somewhere
+    return;
+  }
+
+  try {
+    const dnsheader_aligned headerdata(data.data());
+    const dnsheader* dnsheader = headerdata.get();
+
+    if (dnsheader->qr) {
+      t_Counters.at(rec::Counter::ignoredCount)++;
+      if (g_logCommonErrors) {
+        SLOG(g_log << Logger::Error << "Ignoring answer from " << fromaddr.toString() << " on server socket!" << endl,
+             g_slogudpin->info(Logr::Error, "Ignoring answer on server socket", "remote", Logging::Loggable(fromaddr)));
       }
-      else {
-        if (loc != nullptr) {
-          destaddr = *loc;
-        }
-        else {
-          destaddr.sin4.sin_family = fromaddr.sin4.sin_family;
-          socklen_t slen = destaddr.getSocklen();
-          getsockname(fileDesc, reinterpret_cast<sockaddr*>(&destaddr), &slen); // if this fails, we're ok with it  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-        }
+    }
+    else if (dnsheader->opcode != static_cast<unsigned>(Opcode::Query) && dnsheader->opcode != static_cast<unsigned>(Opcode::Notify)) {
+      t_Counters.at(rec::Counter::ignoredCount)++;
+      if (g_logCommonErrors) {
+        SLOG(g_log << Logger::Error << "Ignoring unsupported opcode " << Opcode::to_s(dnsheader->opcode) << " from " << fromaddr.toString() << " on server socket!" << endl,
+             g_slogudpin->info(Logr::Error, "Ignoring unsupported opcode server socket", "remote", Logging::Loggable(fromaddr), "opcode", Logging::Loggable(Opcode::to_s(dnsheader->opcode))));
       }
-      if (expectProxyProtocol(fromaddr, destaddr)) {
-        bool tcp = false;
-        ssize_t used = parseProxyHeader(data, proxyProto, source, destination, tcp, proxyProtocolValues);
-        if (used <= 0) {
-          ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+    }
+    else if (dnsheader->qdcount == 0U) {
+      t_Counters.at(rec::Counter::emptyQueriesCount)++;
+      if (g_logCommonErrors) {
+        SLOG(g_log << Logger::Error << "Ignoring empty (qdcount == 0) query from " << fromaddr.toString() << " on server socket!" << endl,
+             g_slogudpin->info(Logr::Error, "Ignoring empty (qdcount == 0) query on server socket!", "remote", Logging::Loggable(fromaddr)));
+      }
+    }
+    else {
+      if (dnsheader->opcode == static_cast<unsigned>(Opcode::Notify)) {
+        if (!t_allowNotifyFrom || !t_allowNotifyFrom->match(&mappedSource)) {
           if (!g_quiet) {
-            SLOG(g_log << Logger::Error << "Ignoring invalid proxy protocol (" << std::to_string(len) << ", " << std::to_string(used) << ") query from " << fromaddr.toStringWithPort() << endl,
-                 g_slogudpin->info(Logr::Error, "Ignoring invalid proxy protocol query", "length", Logging::Loggable(len),
-                                   "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr)));
+            SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP NOTIFY from " << mappedSource.toString() << ", address not matched by allow-notify-from" << endl,
+                 g_slogudpin->info(Logr::Error, "Dropping UDP NOTIFY from address not matched by allow-notify-from",
+                                   "source", Logging::Loggable(mappedSource)));
           }
-          return;
-        }
-        if (static_cast<size_t>(used) > g_proxyProtocolMaximumSize) {
-          if (g_quiet) {
-            SLOG(g_log << Logger::Error << "Proxy protocol header in UDP packet from " << fromaddr.toStringWithPort() << " is larger than proxy-protocol-maximum-size (" << used << "), dropping" << endl,
-                 g_slogudpin->info(Logr::Error, "Proxy protocol header in UDP packet  is larger than proxy-protocol-maximum-size",
-                                   "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr)));
-          }
-          ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
-          return;
-        }
-
-        data.erase(0, used);
-      }
-      else if (len > 512) {
-        /* we only allow UDP packets larger than 512 for those with a proxy protocol header */
-        t_Counters.at(rec::Counter::truncatedDrops)++;
-        if (!g_quiet) {
-          SLOG(g_log << Logger::Error << "Ignoring truncated query from " << fromaddr.toStringWithPort() << endl,
-               g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr)));
-        }
-        return;
-      }
 
-      if (data.size() < sizeof(dnsheader)) {
-        t_Counters.at(rec::Counter::ignoredCount)++;
-        if (!g_quiet) {
-          SLOG(g_log << Logger::Error << "Ignoring too-short (" << std::to_string(data.size()) << ") query from " << fromaddr.toString() << endl,
-               g_slogudpin->info(Logr::Error, "Ignoring too-short query", "length", Logging::Loggable(data.size()),
-                                 "remote", Logging::Loggable(fromaddr)));
+          t_Counters.at(rec::Counter::sourceDisallowedNotify)++;
+          return;
         }
-        return;
       }
 
+      struct timeval tval = {0, 0};
+      HarvestTimestamp(&msgh, &tval);
       if (!proxyProto) {
-        source = fromaddr;
+        destination = destaddr;
       }
-      ComboAddress mappedSource = source;
-      if (t_proxyMapping) {
-        if (const auto* iter = t_proxyMapping->lookup(source)) {
-          mappedSource = iter->second.address;
-          ++iter->second.stats.netmaskMatches;
-        }
+
+      if (RecThreadInfo::weDistributeQueries()) {
+        std::string localdata = data;
+        distributeAsyncFunction(data, [localdata = std::move(localdata), fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace]() mutable {
+          return doProcessUDPQuestion(localdata, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace);
+        });
       }
-      if (t_remotes) {
-        t_remotes->push_back(source);
+      else {
+        doProcessUDPQuestion(data, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace);
       }
+    }
+  }
+  catch (const MOADNSException& mde) {
+    t_Counters.at(rec::Counter::clientParseError)++;
+    if (g_logCommonErrors) {
+      SLOG(g_log << Logger::Error << "Unable to parse packet from remote UDP client " << fromaddr.toString() << ": " << mde.what() << endl,
+           g_slogudpin->error(Logr::Error, mde.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("MOADNSException")));
+    }
+  }
+  catch (const std::runtime_error& e) {
+    t_Counters.at(rec::Counter::clientParseError)++;
+    if (g_logCommonErrors) {
+      SLOG(g_log << Logger::Error << "Unable to parse packet from remote UDP client " << fromaddr.toString() << ": " << e.what() << endl,
+           g_slogudpin->error(Logr::Error, e.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("std::runtime_error")));
+    }
+  }
+}
 
-      if (t_allowFrom && !t_allowFrom->match(&mappedSource)) {
-        if (!g_quiet) {
-          SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP query from " << mappedSource.toString() << ", address not matched by allow-from" << endl,
-               g_slogudpin->info(Logr::Error, "Dropping UDP query, address not matched by allow-from", "source", Logging::Loggable(mappedSource)));
-        }
-
-        t_Counters.at(rec::Counter::unauthorizedUDP)++;
-        return;
-      }
+static void handleNewUDPQuestion(int fileDesc, FDMultiplexer::funcparam_t& /* var */)
+{
+  static const size_t maxIncomingQuerySize = g_proxyProtocolACL.empty() ? 512 : (512 + g_proxyProtocolMaximumSize);
+  std::vector<ProxyProtocolValue> proxyProtocolValues;
+  RecEventTrace eventTrace;
+  bool firstQuery = true;
 
-      BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
-      if (fromaddr.sin4.sin_port == 0) { // also works for IPv6
-        if (!g_quiet) {
-          SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP query from " << fromaddr.toStringWithPort() << ", can't deal with port 0" << endl,
-               g_slogudpin->info(Logr::Error, "Dropping UDP query can't deal with port 0", "remote", Logging::Loggable(fromaddr)));
-        }
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+  static thread_local UDPQueriesBatch queries(s_udpBatchSize);
+  // when distributing queries, the answers (including packet cache hits) are sent by the worker threads
+  const bool batchResponses = !RecThreadInfo::weDistributeQueries();
 
-        t_Counters.at(rec::Counter::clientParseError)++; // not quite the best place to put it, but needs to go somewhere
-        return;
+  size_t queriesCounter = 0;
+  while (queriesCounter < g_maxUDPQueriesPerRound) {
+    const size_t wanted = std::min(s_udpBatchSize, g_maxUDPQueriesPerRound - queriesCounter);
+    int received = queries.receive(fileDesc, wanted, maxIncomingQuerySize);
+    if (received <= 0) {
+      if (firstQuery && errno == EAGAIN) {
+        t_Counters.at(rec::Counter::noPacketError)++;
       }
+      break;
+    }
 
-      try {
-        const dnsheader_aligned headerdata(data.data());
-        const dnsheader* dnsheader = headerdata.get();
-
-        if (dnsheader->qr) {
-          t_Counters.at(rec::Counter::ignoredCount)++;
-          if (g_logCommonErrors) {
-            SLOG(g_log << Logger::Error << "Ignoring answer from " << fromaddr.toString() << " on server socket!" << endl,
-                 g_slogudpin->info(Logr::Error, "Ignoring answer on server socket", "remote", Logging::Loggable(fromaddr)));
-          }
-        }
-        else if (dnsheader->opcode != static_cast<unsigned>(Opcode::Query) && dnsheader->opcode != static_cast<unsigned>(Opcode::Notify)) {
-          t_Counters.at(rec::Counter::ignoredCount)++;
-          if (g_logCommonErrors) {
-            SLOG(g_log << Logger::Error << "Ignoring unsupported opcode " << Opcode::to_s(dnsheader->opcode) << " from " << fromaddr.toString() << " on server socket!" << endl,
-                 g_slogudpin->info(Logr::Error, "Ignoring unsupported opcode server socket", "remote", Logging::Loggable(fromaddr), "opcode", Logging::Loggable(Opcode::to_s(dnsheader->opcode))));
-          }
-        }
-        else if (dnsheader->qdcount == 0U) {
-          t_Counters.at(rec::Counter::emptyQueriesCount)++;
-          if (g_logCommonErrors) {
-            SLOG(g_log << Logger::Error << "Ignoring empty (qdcount == 0) query from " << fromaddr.toString() << " on server socket!" << endl,
-                 g_slogudpin->info(Logr::Error, "Ignoring empty (qdcount == 0) query on server socket!", "remote", Logging::Loggable(fromaddr)));
-          }
-        }
-        else {
-          if (dnsheader->opcode == static_cast<unsigned>(Opcode::Notify)) {
-            if (!t_allowNotifyFrom || !t_allowNotifyFrom->match(&mappedSource)) {
-              if (!g_quiet) {
-                SLOG(g_log << Logger::Error << "[" << g_multiTasker->getTid() << "] dropping UDP NOTIFY from " << mappedSource.toString() << ", address not matched by allow-notify-from" << endl,
-                     g_slogudpin->info(Logr::Error, "Dropping UDP NOTIFY from address not matched by allow-notify-from",
-                                       "source", Logging::Loggable(mappedSource)));
-              }
+    firstQuery = false;
+    t_Counters.at(rec::Histogram::udpReceiveBatches)(received);
+    if (batchResponses) {
+      t_udpResponses.start(fileDesc);
+    }
+    for (size_t idx = 0; idx < static_cast<size_t>(received); idx++) {
+      auto& msg = queries.getMessage(idx);
+      handleUDPQuestion(fileDesc, queries.getData(idx), static_cast<ssize_t>(msg.msg_len), msg.msg_hdr, queries.getRemote(idx), proxyProtocolValues, eventTrace);
+    }
+    t_udpResponses.flush();
 
-              t_Counters.at(rec::Counter::sourceDisallowedNotify)++;
-              return;
-            }
-          }
+    queriesCounter += static_cast<size_t>(received);
+    if (static_cast<size_t>(received) < wanted) {
+      // the socket has been drained
+      break;
+    }
+  }
+#else
+  static thread_local std::string data;
+  ComboAddress fromaddr; // the address the query is coming from
+  struct msghdr msgh
+  {
+  };
+  struct iovec iov
+  {
+  };
+  cmsgbuf_aligned cbuf;
 
-          struct timeval tval = {0, 0};
-          HarvestTimestamp(&msgh, &tval);
-          if (!proxyProto) {
-            destination = destaddr;
-          }
+  for (size_t queriesCounter = 0; queriesCounter < g_maxUDPQueriesPerRound; queriesCounter++) {
+    data.resize(maxIncomingQuerySize);
+    fromaddr.sin6.sin6_family = AF_INET6; // this makes sure fromaddr is big enough
+    fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), data.data(), data.size(), &fromaddr);
 
-          if (RecThreadInfo::weDistributeQueries()) {
-            std::string localdata = data;
-            distributeAsyncFunction(data, [localdata = std::move(localdata), fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace]() mutable {
-              return doProcessUDPQuestion(localdata, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace);
-            });
-          }
-          else {
-            doProcessUDPQuestion(data, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace);
-          }
-        }
-      }
-      catch (const MOADNSException& mde) {
-        t_Counters.at(rec::Counter::clientParseError)++;
-        if (g_logCommonErrors) {
-          SLOG(g_log << Logger::Error << "Unable to parse packet from remote UDP client " << fromaddr.toString() << ": " << mde.what() << endl,
-               g_slogudpin->error(Logr::Error, mde.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("MOADNSException")));
-        }
-      }
-      catch (const std::runtime_error& e) {
-        t_Counters.at(rec::Counter::clientParseError)++;
-        if (g_logCommonErrors) {
-          SLOG(g_log << Logger::Error << "Unable to parse packet from remote UDP client " << fromaddr.toString() << ": " << e.what() << endl,
-               g_slogudpin->error(Logr::Error, e.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("std::runtime_error")));
-        }
-      }
+    if (ssize_t len = recvmsg(fileDesc, &msgh, 0); len >= 0) {
+      firstQuery = false;
+      handleUDPQuestion(fileDesc, data, len, msgh, fromaddr, proxyProtocolValues, eventTrace);
     }
     else {
       // cerr<<t_id<<" had error: "<<stringerror()<<endl;
@@ -2677,6 +2883,7 @@ static void handleNewUDPQuestion(int fileDesc, FDMultiplexer::funcparam_t& /* va
       break;
     }
   }
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG && MSG_WAITFORONE */
   t_Counters.updateSnap(g_regressionTestMode);
 }
 
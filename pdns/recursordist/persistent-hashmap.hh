@@ -0,0 +1,382 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace pdns
+{
+/* A hash map whose copies share their storage, so that copying even a very large map is cheap.
+
+   The entries are stored in a tree of nodes (a Hash Array Mapped Trie), each level of the tree being indexed by the
+   next 5 bits of the hash of the keys. Copying the map only copies the pointer to the root of the tree, and a
+   modification only copies the nodes on the path to the modified entry, if they are shared with another copy.
+   Nodes that only belong to this copy are modified in place, so loading a large map does not copy anything.
+
+   Reading a copy from several threads at once is fine, but a copy must not be modified while it is being read:
+   the intended use is to copy a map that is in use, modify the copy, then publish it in place of the old one. */
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class PersistentHashMap
+{
+public:
+  using value_type = std::pair<Key, Value>;
+
+  [[nodiscard]] const value_type* find(const Key& key) const
+  {
+    return findEntry(key, getHash(key));
+  }
+
+  /* Look for an entry without having to build a key: hash has to be the value Hash would return for the key of the
+     entry we are looking for, and matches(key) has to return true for that key only */
+  template <typename Matches>
+  [[nodiscard]] const value_type* findIf(uint32_t hash, const Matches& matches) const
+  {
+    return findMatchingEntry(hash, matches);
+  }
+
+  /* Get a pointer to the value associated to key, that can be modified without impacting the other copies.
+     This copies the nodes leading to the entry if they are shared. */
+  Value* findMutable(const Key& key)
+  {
+    const auto hash = getHash(key);
+    if (findEntry(key, hash) == nullptr) {
+      return nullptr;
+    }
+
+    Node* node = &own(d_root);
+    for (unsigned int level = 0; level < s_maxLevel; level++) {
+      const auto bit = getBit(hash, level);
+      if ((node->d_valuesMap & bit) != 0) {
+        return &node->d_values.at(getIndex(node->d_valuesMap, bit)).second;
+      }
+      node = &own(node->d_children.at(getIndex(node->d_childrenMap, bit)));
+    }
+    for (auto& entry : node->d_values) {
+      if (KeyEqual()(entry.first, key)) {
+        return &entry.second;
+      }
+    }
+    return nullptr;
+  }
+
+  /* returns false, and leaves the map untouched, if there already is an entry for this key */
+  bool insert(const Key& key, Value value)
+  {
+    const auto hash = getHash(key);
+    if (findEntry(key, hash) != nullptr) {
+      return false;
+    }
+    if (!d_root) {
+      d_root = std::make_shared<Node>();
+      ++d_nodesCount;
+    }
+    insertInto(d_root, 0, hash, value_type(key, std::move(value)));
+    ++d_size;
+    return true;
+  }
+
+  bool erase(const Key& key)
+  {
+    const auto hash = getHash(key);
+    if (findEntry(key, hash) == nullptr) {
+      return false;
+    }
+    eraseFrom(d_root, 0, hash, key);
+    --d_size;
+    if (d_size == 0) {
+      clear();
+    }
+    return true;
+  }
+
+  void clear()
+  {
+    d_root.reset();
+    d_size = 0;
+    d_nodesCount = 0;
+  }
+
+  /* calls visitor(key, value) for every entry, in no particular order */
+  template <typename Visitor>
+  void visit(const Visitor& visitor) const
+  {
+    if (d_root) {
+      visitNode(*d_root, visitor);
+    }
+  }
+
+  /* Calls removed(key) for every key of older that is not in this map, and added(key) for every key of this map
+     that is not in older. The nodes shared by both maps are skipped, so comparing a modified copy with the map it
+     was copied from takes a time proportional to the number of modifications, not to the size of the maps. */
+  template <typename Removed, typename Added>
+  void diffKeys(const PersistentHashMap& older, const Removed& removed, const Added& added) const
+  {
+    diffNodes(older, older.d_root.get(), d_root.get(), 0, removed, added);
+  }
+
+  /* whether this map is still the same version as other, meaning that neither of them has been modified since one
+     was copied from the other */
+  [[nodiscard]] bool isSameVersion(const PersistentHashMap& other) const
+  {
+    return d_root == other.d_root;
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  [[nodiscard]] bool empty() const
+  {
+    return d_size == 0;
+  }
+
+  /* Approximate number of bytes used by the tree and the entries, not including the memory allocated by the keys
+     and values themselves. Nodes shared with other copies are counted as well. */
+  [[nodiscard]] size_t getMemoryUsage() const
+  {
+    /* every node is allocated along with its control block, then referenced by a pointer from its parent */
+    static constexpr size_t s_controlBlockSize = 16;
+    return d_nodesCount * (sizeof(Node) + s_controlBlockSize + sizeof(std::shared_ptr<Node>)) + d_size * sizeof(value_type);
+  }
+
+private:
+  struct Node
+  {
+    /* entries stored directly in this node, and children nodes, ordered by their 5-bit slot.
+       Past s_maxLevel there are no hash bits left, the entries are simply stored one after the other */
+    std::vector<value_type> d_values;
+    std::vector<std::shared_ptr<Node>> d_children;
+    uint32_t d_valuesMap{0};
+    uint32_t d_childrenMap{0};
+  };
+
+  static constexpr unsigned int s_bitsPerLevel = 5;
+  static constexpr unsigned int s_maxLevel = (32 + s_bitsPerLevel - 1) / s_bitsPerLevel;
+
+  static uint32_t getHash(const Key& key)
+  {
+    return static_cast<uint32_t>(Hash()(key));
+  }
+
+  static uint32_t getBit(uint32_t hash, unsigned int level)
+  {
+    return 1U << ((hash >> (level * s_bitsPerLevel)) & ((1U << s_bitsPerLevel) - 1));
+  }
+
+  static size_t getIndex(uint32_t map, uint32_t bit)
+  {
+    return __builtin_popcount(map & (bit - 1));
+  }
+
+  /* make sure that the node is not shared with another copy before it is modified */
+  static Node& own(std::shared_ptr<Node>& node)
+  {
+    if (node.use_count() > 1) {
+      node = std::make_shared<Node>(*node);
+    }
+    return *node;
+  }
+
+  const value_type* findEntry(const Key& key, uint32_t hash) const
+  {
+    return findMatchingEntry(hash, [&key](const Key& entryKey) { return KeyEqual()(entryKey, key); });
+  }
+
+  template <typename Matches>
+  const value_type* findMatchingEntry(uint32_t hash, const Matches& matches) const
+  {
+    const Node* node = d_root.get();
+    if (node == nullptr) {
+      return nullptr;
+    }
+
+    for (unsigned int level = 0; level < s_maxLevel; level++) {
+      const auto bit = getBit(hash, level);
+      if ((node->d_valuesMap & bit) != 0) {
+        const auto& entry = node->d_values[getIndex(node->d_valuesMap, bit)];
+        return matches(entry.first) ? &entry : nullptr;
+      }
+      if ((node->d_childrenMap & bit) == 0) {
+        return nullptr;
+      }
+      node = node->d_children[getIndex(node->d_childrenMap, bit)].get();
+    }
+
+    for (const auto& entry : node->d_values) {
+      if (matches(entry.first)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  void insertInto(std::shared_ptr<Node>& nodePtr, unsigned int level, uint32_t hash, value_type&& entry)
+  {
+    Node& node = own(nodePtr);
+    if (level >= s_maxLevel) {
+      node.d_values.push_back(std::move(entry));
+      return;
+    }
+
+    const auto bit = getBit(hash, level);
+    if ((node.d_childrenMap & bit) != 0) {
+      insertInto(node.d_children.at(getIndex(node.d_childrenMap, bit)), level + 1, hash, std::move(entry));
+      return;
+    }
+
+    if ((node.d_valuesMap & bit) != 0) {
+      /* the slot is already used by a different key, move both entries to a new child */
+      const auto valueIdx = getIndex(node.d_valuesMap, bit);
+      auto existing = std::move(node.d_values.at(valueIdx));
+      node.d_values.erase(node.d_values.begin() + static_cast<std::ptrdiff_t>(valueIdx));
+      node.d_valuesMap &= ~bit;
+
+      auto child = std::make_shared<Node>();
+      ++d_nodesCount;
+      const auto existingHash = getHash(existing.first);
+      insertInto(child, level + 1, existingHash, std::move(existing));
+      insertInto(child, level + 1, hash, std::move(entry));
+      node.d_children.insert(node.d_children.begin() + static_cast<std::ptrdiff_t>(getIndex(node.d_childrenMap, bit)), std::move(child));
+      node.d_childrenMap |= bit;
+      return;
+    }
+
+    node.d_values.insert(node.d_values.begin() + static_cast<std::ptrdiff_t>(getIndex(node.d_valuesMap, bit)), std::move(entry));
+    node.d_valuesMap |= bit;
+  }
+
+  void eraseFrom(std::shared_ptr<Node>& nodePtr, unsigned int level, uint32_t hash, const Key& key)
+  {
+    Node& node = own(nodePtr);
+    if (level >= s_maxLevel) {
+      for (auto entryIt = node.d_values.begin(); entryIt != node.d_values.end(); ++entryIt) {
+        if (KeyEqual()(entryIt->first, key)) {
+          node.d_values.erase(entryIt);
+          return;
+        }
+      }
+      return;
+    }
+
+    const auto bit = getBit(hash, level);
+    if ((node.d_valuesMap & bit) != 0) {
+      node.d_values.erase(node.d_values.begin() + static_cast<std::ptrdiff_t>(getIndex(node.d_valuesMap, bit)));
+      node.d_valuesMap &= ~bit;
+      return;
+    }
+
+    const auto childIdx = getIndex(node.d_childrenMap, bit);
+    auto& child = node.d_children.at(childIdx);
+    eraseFrom(child, level + 1, hash, key);
+
+    /* keep the tree compact: a child with no children of its own and at most one entry is not needed,
+       that entry can be stored in our slot instead */
+    if (child->d_children.empty() && child->d_values.size() <= 1) {
+      if (!child->d_values.empty()) {
+        /* the child has been made ours by the recursive call, we can move from it */
+        auto remaining = std::move(child->d_values.front());
+        node.d_values.insert(node.d_values.begin() + static_cast<std::ptrdiff_t>(getIndex(node.d_valuesMap, bit)), std::move(remaining));
+        node.d_valuesMap |= bit;
+      }
+      node.d_children.erase(node.d_children.begin() + static_cast<std::ptrdiff_t>(childIdx));
+      node.d_childrenMap &= ~bit;
+      --d_nodesCount;
+    }
+  }
+
+  template <typename Removed, typename Added>
+  void diffNodes(const PersistentHashMap& older, const Node* oldNode, const Node* newNode, unsigned int level, const Removed& removed, const Added& added) const
+  {
+    if (oldNode == newNode) {
+      return;
+    }
+
+    const auto reportRemoved = [this, &removed](const Key& key, const Value& /* value */) {
+      if (findEntry(key, getHash(key)) == nullptr) {
+        removed(key);
+      }
+    };
+    const auto reportAdded = [&older, &added](const Key& key, const Value& /* value */) {
+      if (older.findEntry(key, getHash(key)) == nullptr) {
+        added(key);
+      }
+    };
+
+    if (oldNode == nullptr || newNode == nullptr || level >= s_maxLevel) {
+      if (oldNode != nullptr) {
+        visitNode(*oldNode, reportRemoved);
+      }
+      if (newNode != nullptr) {
+        visitNode(*newNode, reportAdded);
+      }
+      return;
+    }
+
+    for (unsigned int slot = 0; slot < (1U << s_bitsPerLevel); slot++) {
+      const uint32_t bit = 1U << slot;
+      const bool oldChild = (oldNode->d_childrenMap & bit) != 0;
+      const bool newChild = (newNode->d_childrenMap & bit) != 0;
+      if (oldChild && newChild) {
+        diffNodes(older, oldNode->d_children[getIndex(oldNode->d_childrenMap, bit)].get(), newNode->d_children[getIndex(newNode->d_childrenMap, bit)].get(), level + 1, removed, added);
+        continue;
+      }
+      /* an entry on at least one side: checking the keys against the other map is simpler than matching the
+         entry with the content of the other side */
+      visitSlot(*oldNode, bit, reportRemoved);
+      visitSlot(*newNode, bit, reportAdded);
+    }
+  }
+
+  template <typename Visitor>
+  static void visitSlot(const Node& node, uint32_t bit, const Visitor& visitor)
+  {
+    if ((node.d_valuesMap & bit) != 0) {
+      const auto& entry = node.d_values[getIndex(node.d_valuesMap, bit)];
+      visitor(entry.first, entry.second);
+    }
+    else if ((node.d_childrenMap & bit) != 0) {
+      visitNode(*node.d_children[getIndex(node.d_childrenMap, bit)], visitor);
+    }
+  }
+
+  template <typename Visitor>
+  static void visitNode(const Node& node, const Visitor& visitor)
+  {
+    for (const auto& entry : node.d_values) {
+      visitor(entry.first, entry.second);
+    }
+    for (const auto& child : node.d_children) {
+      visitNode(*child, visitor);
+    }
+  }
+
+  std::shared_ptr<Node> d_root{nullptr};
+  size_t d_size{0};
+  size_t d_nodesCount{0};
+};
+}
@@ -134,6 +134,8 @@ enum class Histogram : uint8_t
   cumulativeAnswers,
   cumulativeAuth4Answers,
   cumulativeAuth6Answers,
+  udpReceiveBatches,
+  udpSendBatches,
 
   numberOfCounters
 };
@@ -208,7 +210,9 @@ struct Counters
     pdns::Histogram{"ourtime", {1000, 2000, 4000, 8000, 16000, 32000}},
     pdns::Histogram{"cumul-clientanswers-", 10, 19},
     pdns::Histogram{"cumul-authanswers-", 1000, 13},
-    pdns::Histogram{"cumul-authanswers-", 1000, 13}};
+    pdns::Histogram{"cumul-authanswers-", 1000, 13},
+    pdns::Histogram{"cumul-udprecvbatch-", {1, 2, 4, 8, 16, 32}},
+    pdns::Histogram{"cumul-udpsendbatch-", {1, 2, 4, 8, 16, 32}}};
 
   // Response stats
   RecResponseStats responseStats{};
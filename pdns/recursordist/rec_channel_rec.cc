@@ -508,6 +508,23 @@ static RecursorControlChannel::Answer doDumpRPZ(int s, T begin, T end)
   return {0, "done\n"};
 }
 
+static string getRPZMemory()
+{
+  ostringstream ret;
+  ret << "Entries\tActions\tMemory\tPer-entry\tZone" << endl;
+  auto luaconf = g_luaconfs.getLocal();
+  for (size_t zoneIdx = 0; zoneIdx < luaconf->dfe.size(); zoneIdx++) {
+    const auto zone = luaconf->dfe.getZone(zoneIdx);
+    if (!zone) {
+      continue;
+    }
+    const auto entries = zone->size();
+    const auto memory = zone->getMemoryUsage();
+    ret << entries << '\t' << zone->getActionsCount() << '\t' << memory << '\t' << (entries > 0 ? memory / entries : 0) << '\t' << zone->getName() << endl;
+  }
+  return ret.str();
+}
+
 template <typename T>
 static string doWipeCache(T begin, T end, uint16_t qtype)
 {
@@ -1166,6 +1183,24 @@ static StatsMap toStatsMap(const string& name, const pdns::Histogram& histogram)
   return entries;
 }
 
+// For histograms of counts instead of durations, so no conversion to seconds
+static StatsMap toCountStatsMap(const string& name, const pdns::Histogram& histogram)
+{
+  const auto& data = histogram.getCumulativeBuckets();
+  const string pbasename = getPrometheusName(name);
+  StatsMap entries;
+
+  for (const auto& bucket : data) {
+    std::string pname = pbasename + "bucket{" + "le=\"" + (bucket.d_boundary == std::numeric_limits<uint64_t>::max() ? "+Inf" : std::to_string(bucket.d_boundary)) + "\"}";
+    entries.emplace(bucket.d_name, StatsMapEntry{std::move(pname), std::to_string(bucket.d_count)});
+  }
+
+  entries.emplace(name + "sum", StatsMapEntry{pbasename + "sum", std::to_string(histogram.getSum())});
+  entries.emplace(name + "count", StatsMapEntry{pbasename + "count", std::to_string(data.back().d_count)});
+
+  return entries;
+}
+
 static StatsMap toStatsMap(const string& name, const pdns::Histogram& histogram4, const pdns::Histogram& histogram6)
 {
   const string pbasename = getPrometheusName(name);
@@ -1586,6 +1621,12 @@ static void registerAllStats1()
   addGetStat("cumul-authanswers", []() {
     return toStatsMap(t_Counters.at(rec::Histogram::cumulativeAuth4Answers).getName(), g_Counters.sum(rec::Histogram::cumulativeAuth4Answers), g_Counters.sum(rec::Histogram::cumulativeAuth6Answers));
   });
+  addGetStat("cumul-udprecvbatch", []() {
+    return toCountStatsMap(t_Counters.at(rec::Histogram::udpReceiveBatches).getName(), g_Counters.sum(rec::Histogram::udpReceiveBatches));
+  });
+  addGetStat("cumul-udpsendbatch", []() {
+    return toCountStatsMap(t_Counters.at(rec::Histogram::udpSendBatches).getName(), g_Counters.sum(rec::Histogram::udpSendBatches));
+  });
   addGetStat("policy-hits", []() {
     return toRPZStatsMap("policy-hits", g_Counters.sum(rec::PolicyNameHits::policyName).counts);
   });
@@ -2130,6 +2171,7 @@ static RecursorControlChannel::Answer help()
           "get-qtypelist                    get QType statistics\n"
           "                                 notice: queries from cache aren't being counted yet\n"
           "get-remotelogger-stats           get remote logger statistics\n"
+          "get-rpz-memory                   get the number of entries and the memory used by each RPZ zone\n"
           "hash-password [work-factor]      ask for a password then return the hashed version\n"
           "help                             get this list\n"
           "list-dnssec-algos                list supported DNSSEC algorithms\n"
@@ -2484,6 +2526,9 @@ RecursorControlChannel::Answer RecursorControlParser::getAnswer(int socket, cons
   if (cmd == "get-remotelogger-stats") {
     return {0, getRemoteLoggerStats()};
   }
+  if (cmd == "get-rpz-memory") {
+    return {0, getRPZMemory()};
+  }
   if (cmd == "list-dnssec-algos") {
     return {0, DNSCryptoKeyEngine::listSupportedAlgoNames()};
   }
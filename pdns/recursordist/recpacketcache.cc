@@ -3,6 +3,8 @@
 #endif
 #include <iostream>
 #include <cinttypes>
+#include <cmath>
+#include <thread>
 
 #include "recpacketcache.hh"
 #include "cachecleaner.hh"
@@ -12,11 +14,26 @@
 
 unsigned int RecursorPacketCache::s_refresh_ttlperc{0};
 
+static std::atomic<uint64_t> s_serial{0};
+
+RecursorPacketCache::RecursorPacketCache(size_t maxsize, size_t shards, bool lockFreeReads) :
+  d_maps(shards), d_serial(++s_serial), d_lockFree(lockFreeReads)
+{
+  if (d_lockFree) {
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+    d_lockFreeReaders = std::make_unique<LockFreeReader[]>(s_maxLockFreeReaders);
+  }
+  setMaxSize(maxsize);
+}
+
 void RecursorPacketCache::setShardSizes(size_t shardSize)
 {
   for (auto& shard : d_maps) {
     auto lock = shard.lock();
     lock->d_shardSize = shardSize;
+    if (d_lockFree) {
+      resizeLockFreeTable(shard, *lock);
+    }
   }
 }
 
@@ -37,6 +54,9 @@ uint64_t RecursorPacketCache::bytes()
     for (const auto& entry : lock->d_map) {
       sum += sizeof(entry) + entry.d_packet.length() + 4;
     }
+    for (const auto* entry : lock->d_lockFreeEntries) {
+      sum += sizeof(*entry) + entry->d_packet.length() + 4;
+    }
   }
   return sum;
 }
@@ -48,6 +68,11 @@ uint64_t RecursorPacketCache::getHits()
     auto lock = shard.lock();
     sum += lock->d_hits;
   }
+  if (d_lockFree) {
+    for (size_t idx = 0; idx < s_maxLockFreeReaders; idx++) {
+      sum += d_lockFreeReaders[idx].d_hits.load(std::memory_order_relaxed);
+    }
+  }
   return sum;
 }
 
@@ -58,6 +83,11 @@ uint64_t RecursorPacketCache::getMisses()
     auto lock = shard.lock();
     sum += lock->d_misses;
   }
+  if (d_lockFree) {
+    for (size_t idx = 0; idx < s_maxLockFreeReaders; idx++) {
+      sum += d_lockFreeReaders[idx].d_misses.load(std::memory_order_relaxed);
+    }
+  }
   return sum;
 }
 
@@ -78,6 +108,21 @@ uint64_t RecursorPacketCache::doWipePacketCache(const DNSName& name, uint16_t qt
   uint64_t count = 0;
   for (auto& map : d_maps) {
     auto shard = map.lock();
+    if (d_lockFree) {
+      auto& idx = shard->d_lockFreeEntries.get<NameTag>();
+      for (auto iter = idx.lower_bound(name); iter != idx.end();) {
+        auto* entry = *iter;
+        if (subtree ? !entry->d_name.isPartOf(name) : entry->d_name != name) {
+          break;
+        }
+        ++iter;
+        if (qtype == 0xffff || entry->d_type == qtype) {
+          removeLockFree(map, *shard, entry);
+          count++;
+        }
+      }
+      continue;
+    }
     auto& idx = shard->d_map.get<NameTag>();
     for (auto iter = idx.lower_bound(name); iter != idx.end();) {
       if (subtree) {
@@ -103,63 +148,75 @@ uint64_t RecursorPacketCache::doWipePacketCache(const DNSName& name, uint16_t qt
   return count;
 }
 
-bool RecursorPacketCache::qrMatch(const packetCache_t::index<HashTag>::type::iterator& iter, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass)
+bool RecursorPacketCache::qrMatch(const Entry& entry, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass)
 {
   // this ignores checking on the EDNS subnet flags!
-  if (qname != iter->d_name || iter->d_type != qtype || iter->d_class != qclass) {
+  if (qname != entry.d_name || entry.d_type != qtype || entry.d_class != qclass) {
     return false;
   }
 
   static const std::unordered_set<uint16_t> optionsToSkip{EDNSOptionCode::COOKIE, EDNSOptionCode::ECS};
-  return queryMatches(iter->d_query, queryPacket, qname, optionsToSkip);
+  return queryMatches(entry.d_query, queryPacket, qname, optionsToSkip);
+}
+
+// whether a fresh entry should be refreshed in the background, not taking into account whether that has already been done
+bool RecursorPacketCache::needsRefresh(const Entry& entry, uint16_t qtype, time_t now)
+{
+  if (s_refresh_ttlperc == 0 || !taskQTypeIsSupported(qtype)) {
+    return false;
+  }
+  const dnsheader_aligned header(entry.d_packet.data());
+  const auto* headerPtr = header.get();
+  if (headerPtr->rcode != RCode::NoError) {
+    return false;
+  }
+  // we know ttl is > 0
+  auto ttl = static_cast<uint32_t>(entry.d_ttd - now);
+  const uint32_t deadline = entry.getOrigTTL() * s_refresh_ttlperc / 100;
+  return ttl <= deadline;
+}
+
+void RecursorPacketCache::copyResponse(const Entry& entry, const std::string& queryPacket, const DNSName& qname, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
+{
+  // coverity[store_truncates_time_t]
+  *age = static_cast<uint32_t>(now - entry.d_creation);
+  *responsePacket = entry.d_packet;
+  responsePacket->replace(0, 2, queryPacket.c_str(), 2);
+  *valState = entry.d_vstate;
+
+  const size_t wirelength = qname.wirelength();
+  if (responsePacket->size() > (sizeof(dnsheader) + wirelength)) {
+    responsePacket->replace(sizeof(dnsheader), wirelength, queryPacket, sizeof(dnsheader), wirelength);
+  }
+
+  if (pbdata != nullptr) {
+    if (entry.d_pbdata) {
+      *pbdata = entry.d_pbdata;
+    }
+    else {
+      *pbdata = boost::none;
+    }
+  }
 }
 
 bool RecursorPacketCache::checkResponseMatches(MapCombo::LockedContent& shard, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
 {
   for (auto iter = range.first; iter != range.second; ++iter) {
     // the possibility is VERY real that we get hits that are not right - birthday paradox
-    if (!qrMatch(iter, queryPacket, qname, qtype, qclass)) {
+    if (!qrMatch(*iter, queryPacket, qname, qtype, qclass)) {
       continue;
     }
 
     if (now < iter->d_ttd) { // it is right, it is fresh!
-      // coverity[store_truncates_time_t]
-      *age = static_cast<uint32_t>(now - iter->d_creation);
-      // we know ttl is > 0
-      auto ttl = static_cast<uint32_t>(iter->d_ttd - now);
-      if (s_refresh_ttlperc > 0 && !iter->d_submitted && taskQTypeIsSupported(qtype)) {
-        const dnsheader_aligned header(iter->d_packet.data());
-        const auto* headerPtr = header.get();
-        if (headerPtr->rcode == RCode::NoError) {
-          const uint32_t deadline = iter->getOrigTTL() * s_refresh_ttlperc / 100;
-          const bool almostExpired = ttl <= deadline;
-          if (almostExpired) {
-            iter->d_submitted = true;
-            pushAlmostExpiredTask(qname, qtype, iter->d_ttd, Netmask());
-          }
-        }
-      }
-      *responsePacket = iter->d_packet;
-      responsePacket->replace(0, 2, queryPacket.c_str(), 2);
-      *valState = iter->d_vstate;
-
-      const size_t wirelength = qname.wirelength();
-      if (responsePacket->size() > (sizeof(dnsheader) + wirelength)) {
-        responsePacket->replace(sizeof(dnsheader), wirelength, queryPacket, sizeof(dnsheader), wirelength);
+      if (!iter->d_submitted && needsRefresh(*iter, qtype, now)) {
+        iter->d_submitted = true;
+        pushAlmostExpiredTask(qname, qtype, iter->d_ttd, Netmask());
       }
+      copyResponse(*iter, queryPacket, qname, now, responsePacket, age, valState, pbdata);
 
       shard.d_hits++;
       moveCacheItemToBack<SequencedTag>(shard.d_map, iter);
 
-      if (pbdata != nullptr) {
-        if (iter->d_pbdata) {
-          *pbdata = iter->d_pbdata;
-        }
-        else {
-          *pbdata = boost::none;
-        }
-      }
-
       return true;
     }
     // We used to move the item to the front of "the to be deleted" sequence,
@@ -178,6 +235,12 @@ bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string&
 {
   *qhash = canHashPacket(queryPacket, s_skipOptions);
   auto& map = getMap(tag, *qhash, tcp);
+  if (d_lockFree) {
+    auto getQName = [&qname, qtype, qclass]() -> std::tuple<const DNSName&, uint16_t, uint16_t> {
+      return {qname, qtype, qclass};
+    };
+    return getResponsePacketLockFree(map, tag, *qhash, tcp, queryPacket, getQName, now, responsePacket, age, valState, pbdata);
+  }
   auto shard = map.lock();
   const auto& idx = shard->d_map.get<HashTag>();
   auto range = idx.equal_range(std::tie(tag, *qhash, tcp));
@@ -195,6 +258,18 @@ bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string&
 {
   *qhash = canHashPacket(queryPacket, s_skipOptions);
   auto& map = getMap(tag, *qhash, tcp);
+  if (d_lockFree) {
+    // only parse the qname once we know there is a candidate
+    bool parsed = false;
+    auto getQName = [&]() -> std::tuple<const DNSName&, uint16_t, uint16_t> {
+      if (!parsed) {
+        qname = DNSName(queryPacket.c_str(), static_cast<int>(queryPacket.length()), sizeof(dnsheader), false, qtype, qclass);
+        parsed = true;
+      }
+      return {qname, *qtype, *qclass};
+    };
+    return getResponsePacketLockFree(map, tag, *qhash, tcp, queryPacket, getQName, now, responsePacket, age, valState, pbdata);
+  }
   auto shard = map.lock();
   const auto& idx = shard->d_map.get<HashTag>();
   auto range = idx.equal_range(std::tie(tag, *qhash, tcp));
@@ -213,6 +288,10 @@ void RecursorPacketCache::insertResponsePacket(unsigned int tag, uint32_t qhash,
 {
   auto& map = getMap(tag, qhash, tcp);
   auto shard = map.lock();
+  if (d_lockFree) {
+    insertResponsePacketLockFree(map, *shard, tag, qhash, std::move(query), qname, qtype, qclass, std::move(responsePacket), now, ttl, valState, std::move(pbdata), tcp);
+    return;
+  }
   auto& idx = shard->d_map.get<HashTag>();
   auto range = idx.equal_range(std::tie(tag, qhash, tcp));
   auto iter = range.first;
@@ -254,6 +333,10 @@ void RecursorPacketCache::insertResponsePacket(unsigned int tag, uint32_t qhash,
 
 void RecursorPacketCache::doPruneTo(time_t now, size_t maxSize)
 {
+  if (d_lockFree) {
+    pruneLockFree(now, maxSize);
+    return;
+  }
   size_t cacheSize = size();
   pruneMutexCollectionsVector<SequencedTag>(now, d_maps, maxSize, cacheSize);
 }
@@ -278,10 +361,19 @@ uint64_t RecursorPacketCache::doDump(int file)
   size_t max = 0;
   uint64_t maxSize = 0;
 
+  auto dumpEntry = [&filePtr, now](const Entry& entry) {
+    try {
+      fprintf(filePtr.get(), "%s %" PRId64 " %s  ; tag %d %s\n", entry.d_name.toString().c_str(), static_cast<int64_t>(entry.d_ttd - now), DNSRecordContent::NumberToType(entry.d_type).c_str(), entry.d_tag, entry.d_tcp ? "tcp" : "udp");
+    }
+    catch (...) {
+      fprintf(filePtr.get(), "; error printing '%s'\n", entry.d_name.empty() ? "EMPTY" : entry.d_name.toString().c_str());
+    }
+  };
+
   for (auto& shard : d_maps) {
     auto lock = shard.lock();
     const auto& sidx = lock->d_map.get<SequencedTag>();
-    const auto shardSize = lock->d_map.size();
+    const auto shardSize = lock->d_map.size() + lock->d_lockFreeEntries.size();
     fprintf(filePtr.get(), "; packetcache shard %zu; size %zu/%zu\n", shardNum, shardSize, lock->d_shardSize);
     min = std::min(min, shardSize);
     max = std::max(max, shardSize);
@@ -289,14 +381,395 @@ uint64_t RecursorPacketCache::doDump(int file)
     shardNum++;
     for (const auto& entry : sidx) {
       count++;
-      try {
-        fprintf(filePtr.get(), "%s %" PRId64 " %s  ; tag %d %s\n", entry.d_name.toString().c_str(), static_cast<int64_t>(entry.d_ttd - now), DNSRecordContent::NumberToType(entry.d_type).c_str(), entry.d_tag, entry.d_tcp ? "tcp" : "udp");
-      }
-      catch (...) {
-        fprintf(filePtr.get(), "; error printing '%s'\n", entry.d_name.empty() ? "EMPTY" : entry.d_name.toString().c_str());
-      }
+      dumpEntry(entry);
+    }
+    for (const auto* entry : lock->d_lockFreeEntries.get<SequencedTag>()) {
+      count++;
+      dumpEntry(*entry);
     }
   }
   fprintf(filePtr.get(), "; packetcache size: %" PRIu64 "/%" PRIu64 " shards: %zu min/max shard size: %zu/%zu\n", size(), maxSize, d_maps.size(), min, max);
   return count;
 }
+
+uint64_t RecursorPacketCache::getLockFreeKey(unsigned int tag, uint32_t hash, bool tcp)
+{
+  /* the shard has been selected using combine(), mix the bits again to spread the entries over the buckets of the shard */
+  uint64_t key = (static_cast<uint64_t>(tag) << 32U) | hash;
+  if (tcp) {
+    key ^= 0x9e3779b97f4a7c15ULL;
+  }
+  key ^= key >> 30U;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27U;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31U;
+  /* 0 marks an empty slot */
+  return key | 1U;
+}
+
+RecursorPacketCache::LockFreeReader* RecursorPacketCache::getLockFreeReader()
+{
+  struct Registration
+  {
+    uint64_t d_serial;
+    LockFreeReader* d_reader;
+  };
+  static thread_local std::vector<Registration> t_registrations;
+
+  for (const auto& registration : t_registrations) {
+    if (registration.d_serial == d_serial) {
+      return registration.d_reader;
+    }
+  }
+
+  LockFreeReader* reader = nullptr;
+  const auto index = d_lockFreeReadersCount++;
+  if (index < s_maxLockFreeReaders) {
+    reader = &d_lockFreeReaders[index];
+  }
+  t_registrations.push_back({d_serial, reader});
+  return reader;
+}
+
+uint64_t RecursorPacketCache::getOldestReaderEpoch() const
+{
+  uint64_t oldest = d_epoch.load();
+  const auto readers = std::min(d_lockFreeReadersCount.load(), s_maxLockFreeReaders);
+  for (size_t idx = 0; idx < readers; idx++) {
+    const auto epoch = d_lockFreeReaders[idx].d_epoch.load();
+    if (epoch != 0 && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  return oldest;
+}
+
+void RecursorPacketCache::retire(MapCombo::LockedContent& content, LockFreeEntry* entry)
+{
+  /* the entry has been unlinked already, so readers announcing a later epoch cannot see it */
+  content.d_retired.emplace_back(d_epoch.fetch_add(1), entry);
+  if (content.d_retired.size() >= content.d_nextReclaim) {
+    reclaim(content);
+  }
+}
+
+void RecursorPacketCache::reclaim(MapCombo::LockedContent& content)
+{
+  auto& retired = content.d_retired;
+  if (!retired.empty()) {
+    const auto oldest = getOldestReaderEpoch();
+    retired.erase(std::remove_if(retired.begin(), retired.end(), [oldest](const auto& entry) { return entry.first < oldest; }), retired.end());
+  }
+  content.d_nextReclaim = retired.size() + s_lockFreeReclaimBatch;
+}
+
+template <typename QNameGetter>
+bool RecursorPacketCache::lookupLockFree(const LockFreeTable& table, unsigned int tag, uint32_t qhash, bool tcp, const std::string& queryPacket, QNameGetter& getQName, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
+{
+  const auto key = getLockFreeKey(tag, qhash, tcp);
+  const auto start = table.getBucketStart(key);
+
+  for (size_t idx = start; idx < (start + s_lockFreeBucketSize); idx++) {
+    const auto& slot = table.d_slots[idx];
+    if (slot.d_key.load(std::memory_order_relaxed) != key) {
+      continue;
+    }
+    const auto* entry = slot.d_entry.load(std::memory_order_acquire);
+    if (entry == nullptr || entry->d_tag != tag || entry->d_qhash != qhash || entry->d_tcp != tcp) {
+      continue;
+    }
+
+    auto [qname, qtype, qclass] = getQName();
+    // the possibility is VERY real that we get hits that are not right - birthday paradox
+    if (!qrMatch(*entry, queryPacket, qname, qtype, qclass)) {
+      continue;
+    }
+
+    if (now >= entry->d_ttd) {
+      // it is right but not fresh, we very likely will update the entry very soon
+      return false;
+    }
+
+    /* only write to the entry when needed, hot entries are read by all threads */
+    if (!entry->d_referenced.load(std::memory_order_relaxed)) {
+      entry->d_referenced.store(true, std::memory_order_relaxed);
+    }
+    if (needsRefresh(*entry, qtype, now) && !entry->d_refreshSubmitted.exchange(true)) {
+      pushAlmostExpiredTask(qname, qtype, entry->d_ttd, Netmask());
+    }
+    copyResponse(*entry, queryPacket, qname, now, responsePacket, age, valState, pbdata);
+    return true;
+  }
+
+  return false;
+}
+
+template <typename QNameGetter>
+bool RecursorPacketCache::getResponsePacketLockFree(MapCombo& map, unsigned int tag, uint32_t qhash, bool tcp, const std::string& queryPacket, QNameGetter& getQName, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
+{
+  auto* reader = getLockFreeReader();
+  if (reader == nullptr) {
+    auto shard = map.lock();
+    const bool hit = lookupLockFree(*shard->d_lockFreeTable, tag, qhash, tcp, queryPacket, getQName, now, responsePacket, age, valState, pbdata);
+    ++(hit ? shard->d_hits : shard->d_misses);
+    return hit;
+  }
+
+  struct ReadSection
+  {
+    ReadSection(LockFreeReader& reader, uint64_t epoch) :
+      d_reader(reader)
+    {
+      /* nothing we can reach from now on will be freed before we are done */
+      d_reader.d_epoch.store(epoch);
+      /* the announcement has to be visible to the writers before we load any slot, and a
+         store followed by a load to a different location can otherwise be reordered */
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    ~ReadSection()
+    {
+      d_reader.d_epoch.store(0, std::memory_order_release);
+    }
+    ReadSection(const ReadSection&) = delete;
+    ReadSection(ReadSection&&) = delete;
+    ReadSection& operator=(const ReadSection&) = delete;
+    ReadSection& operator=(ReadSection&&) = delete;
+
+    LockFreeReader& d_reader;
+  };
+
+  bool hit = false;
+  {
+    ReadSection section(*reader, d_epoch.load());
+    hit = lookupLockFree(*map.getLockFreeTable(), tag, qhash, tcp, queryPacket, getQName, now, responsePacket, age, valState, pbdata);
+  }
+  /* only this thread updates its counters */
+  auto& counter = hit ? reader->d_hits : reader->d_misses;
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  return hit;
+}
+
+void RecursorPacketCache::insertResponsePacketLockFree(MapCombo& map, MapCombo::LockedContent& content, unsigned int tag, uint32_t qhash, std::string&& query, const DNSName& qname, uint16_t qtype, uint16_t qclass, std::string&& responsePacket, time_t now, uint32_t ttl, const vState& valState, OptPBData&& pbdata, bool tcp)
+{
+  auto& table = *content.d_lockFreeTable;
+  const auto key = getLockFreeKey(tag, qhash, tcp);
+  const auto start = table.getBucketStart(key);
+  LockFreeEntry* existing = nullptr;
+  std::optional<size_t> target;
+
+  for (size_t idx = start; idx < (start + s_lockFreeBucketSize); idx++) {
+    auto* entry = table.d_slots[idx].d_entry.load(std::memory_order_relaxed);
+    if (entry == nullptr) {
+      if (!target) {
+        target = idx;
+      }
+      continue;
+    }
+    if (entry->d_tag == tag && entry->d_qhash == qhash && entry->d_tcp == tcp && entry->d_type == qtype && entry->d_class == qclass && entry->d_name == qname) {
+      existing = entry;
+      break;
+    }
+  }
+
+  auto newEntry = std::make_unique<LockFreeEntry>(DNSName(qname), qtype, qclass, std::move(responsePacket), std::move(query), tcp, qhash, now + ttl, now, tag, valState);
+  if (pbdata) {
+    newEntry->d_pbdata = std::move(*pbdata);
+  }
+
+  auto& sidx = content.d_lockFreeEntries.get<SequencedTag>();
+  if (existing != nullptr) {
+    /* readers might still be looking at the existing entry, so replace it instead of updating it,
+       and move it to the back of the CLOCK list */
+    auto iter = content.d_lockFreeEntries.find(existing);
+    newEntry->d_slot = existing->d_slot;
+    content.d_lockFreeEntries.replace(iter, newEntry.get());
+    auto* entry = newEntry.release();
+    sidx.relocate(sidx.end(), content.d_lockFreeEntries.project<SequencedTag>(iter));
+    table.d_slots[entry->d_slot].d_entry.store(entry);
+    retire(content, existing);
+    return;
+  }
+
+  if (!target) {
+    /* the bucket is full, evict an expired entry if any, otherwise the first one that was not used since we last looked */
+    LockFreeEntry* victim = nullptr;
+    for (size_t idx = start; victim == nullptr && idx < (start + s_lockFreeBucketSize); idx++) {
+      auto* entry = table.d_slots[idx].d_entry.load(std::memory_order_relaxed);
+      if (entry->isStale(now)) {
+        victim = entry;
+      }
+    }
+    for (size_t idx = start; victim == nullptr && idx < (start + s_lockFreeBucketSize); idx++) {
+      auto* entry = table.d_slots[idx].d_entry.load(std::memory_order_relaxed);
+      if (!entry->d_referenced.exchange(false, std::memory_order_relaxed)) {
+        victim = entry;
+      }
+    }
+    if (victim == nullptr) {
+      victim = table.d_slots[start].d_entry.load(std::memory_order_relaxed);
+    }
+    target = victim->d_slot;
+    removeLockFree(map, content, victim);
+  }
+
+  newEntry->d_slot = *target;
+  sidx.push_back(newEntry.get());
+  auto* entry = newEntry.release();
+  auto& slot = table.d_slots[*target];
+  slot.d_entry.store(entry, std::memory_order_release);
+  slot.d_key.store(key, std::memory_order_relaxed);
+  map.incEntriesCount();
+
+  if (content.d_lockFreeEntries.size() > content.d_shardSize) {
+    evictLockFree(map, content, content.d_lockFreeEntries.size() - content.d_shardSize);
+  }
+}
+
+void RecursorPacketCache::removeLockFree(MapCombo& map, MapCombo::LockedContent& content, LockFreeEntry* entry)
+{
+  auto& slot = content.d_lockFreeTable->d_slots[entry->d_slot];
+  slot.d_key.store(0, std::memory_order_relaxed);
+  slot.d_entry.store(nullptr);
+  content.d_lockFreeEntries.erase(entry);
+  map.decEntriesCount();
+  retire(content, entry);
+}
+
+void RecursorPacketCache::evictLockFree(MapCombo& map, MapCombo::LockedContent& content, size_t count)
+{
+  auto& sidx = content.d_lockFreeEntries.get<SequencedTag>();
+  /* readers might keep setting the referenced bits behind our back, so stop giving second chances after a while */
+  size_t chances = 2 * sidx.size();
+
+  while (count > 0 && !sidx.empty()) {
+    auto iter = sidx.begin();
+    auto* entry = *iter;
+    if (chances > 0 && entry->d_referenced.load(std::memory_order_relaxed)) {
+      entry->d_referenced.store(false, std::memory_order_relaxed);
+      sidx.relocate(sidx.end(), iter);
+      --chances;
+      continue;
+    }
+    removeLockFree(map, content, entry);
+    --count;
+  }
+}
+
+void RecursorPacketCache::resizeLockFreeTable(MapCombo& map, MapCombo::LockedContent& content)
+{
+  /* an entry can only live in the bucket its key maps to, so keep the load factor at 0.25 to make overflowing a bucket unlikely */
+  const size_t buckets = std::max(static_cast<size_t>(1), ((content.d_shardSize * 4) + s_lockFreeBucketSize - 1) / s_lockFreeBucketSize);
+
+  if (!content.d_lockFreeTable || content.d_lockFreeTable->d_buckets != buckets) {
+    auto table = std::make_unique<LockFreeTable>(buckets);
+    std::vector<LockFreeEntry*> dropped;
+
+    /* most recently inserted entries first, the ones that do not fit in their new bucket are dropped */
+    auto& sidx = content.d_lockFreeEntries.get<SequencedTag>();
+    for (auto iter = sidx.rbegin(); iter != sidx.rend(); ++iter) {
+      auto* entry = *iter;
+      const auto key = getLockFreeKey(entry->d_tag, entry->d_qhash, entry->d_tcp);
+      const auto start = table->getBucketStart(key);
+      bool placed = false;
+      for (size_t idx = start; !placed && idx < (start + s_lockFreeBucketSize); idx++) {
+        auto& slot = table->d_slots[idx];
+        if (slot.d_entry.load(std::memory_order_relaxed) == nullptr) {
+          entry->d_slot = idx;
+          slot.d_entry.store(entry, std::memory_order_relaxed);
+          slot.d_key.store(key, std::memory_order_relaxed);
+          placed = true;
+        }
+      }
+      if (!placed) {
+        dropped.push_back(entry);
+      }
+    }
+
+    map.setLockFreeTable(table.get());
+    auto oldTable = std::move(content.d_lockFreeTable);
+    content.d_lockFreeTable = std::move(table);
+
+    for (auto* entry : dropped) {
+      content.d_lockFreeEntries.erase(entry);
+      map.decEntriesCount();
+      retire(content, entry);
+    }
+
+    if (oldTable) {
+      /* resizing is rare, just wait for the readers that might still be walking the old table */
+      const auto epoch = d_epoch.fetch_add(1);
+      while (getOldestReaderEpoch() <= epoch) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  if (content.d_lockFreeEntries.size() > content.d_shardSize) {
+    evictLockFree(map, content, content.d_lockFreeEntries.size() - content.d_shardSize);
+  }
+}
+
+uint64_t RecursorPacketCache::pruneLockFree(time_t now, size_t maxSize)
+{
+  uint64_t cacheSize = size();
+  uint64_t toTrim = 0;
+  uint64_t lookAt = 0;
+  uint64_t erased = 0;
+
+  // same strategy as pruneMutexCollectionsVector(), except that the second pass follows CLOCK instead of LRU
+  if (cacheSize > maxSize) {
+    toTrim = cacheSize - maxSize;
+    lookAt = std::max(5 * toTrim, cacheSize / 10);
+  }
+  else {
+    lookAt = cacheSize / 10;
+  }
+
+  for (auto& map : d_maps) {
+    auto content = map.lock();
+    auto& sidx = content->d_lockFreeEntries.get<SequencedTag>();
+    const auto shardSize = sidx.size();
+    if (shardSize > 0) {
+      const uint64_t toScanForThisShard = std::ceil(lookAt * ((1.0 * shardSize) / cacheSize));
+      uint64_t lookedAt = 0;
+      for (auto iter = sidx.begin(); iter != sidx.end() && lookedAt < toScanForThisShard; lookedAt++) {
+        auto* entry = *iter;
+        ++iter;
+        if (entry->isStale(now)) {
+          removeLockFree(map, *content, entry);
+          erased++;
+        }
+      }
+    }
+    reclaim(*content);
+  }
+
+  if (erased >= toTrim) {
+    return erased;
+  }
+
+  toTrim -= erased;
+  cacheSize -= erased;
+
+  for (auto& map : d_maps) {
+    auto content = map.lock();
+    const auto shardSize = content->d_lockFreeEntries.size();
+    if (shardSize == 0) {
+      continue;
+    }
+    const uint64_t toTrimForThisShard = std::min(toTrim, static_cast<uint64_t>(std::round(static_cast<double>(toTrim) * shardSize / cacheSize)));
+    cacheSize -= shardSize;
+    if (toTrimForThisShard == 0) {
+      continue;
+    }
+    evictLockFree(map, *content, toTrimForThisShard);
+    erased += toTrimForThisShard;
+    toTrim -= toTrimForThisShard;
+    if (toTrim == 0) {
+      break;
+    }
+  }
+
+  return erased;
+}
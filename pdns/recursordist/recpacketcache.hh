@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #pragma once
+#include <atomic>
 #include <string>
 #include <cinttypes>
 #include "dns.hh"
@@ -56,11 +57,12 @@ public:
   };
   using OptPBData = boost::optional<PBData>;
 
-  RecursorPacketCache(size_t maxsize, size_t shards = 1024) :
-    d_maps(shards)
-  {
-    setMaxSize(maxsize);
-  }
+  RecursorPacketCache(size_t maxsize, size_t shards = 1024, bool lockFreeReads = false);
+  ~RecursorPacketCache() = default;
+  RecursorPacketCache(const RecursorPacketCache&) = delete;
+  RecursorPacketCache(RecursorPacketCache&&) = delete;
+  RecursorPacketCache& operator=(const RecursorPacketCache&) = delete;
+  RecursorPacketCache& operator=(RecursorPacketCache&&) = delete;
 
   bool getResponsePacket(unsigned int tag, const std::string& queryPacket, time_t now,
                          std::string* responsePacket, uint32_t* age, uint32_t* qhash)
@@ -101,6 +103,11 @@ public:
   [[nodiscard]] uint64_t getMisses();
   [[nodiscard]] pair<uint64_t, uint64_t> stats();
 
+  [[nodiscard]] bool hasLockFreeReads() const
+  {
+    return d_lockFree;
+  }
+
 private:
   struct Entry
   {
@@ -147,6 +154,62 @@ private:
     }
   };
 
+  /* With lock-free reads, entries are immutable once published: an update replaces the entry.
+     Readers set the referenced bit on a hit instead of moving the entry to the back of the LRU list,
+     and writers give referenced entries a second chance before evicting them (CLOCK). */
+  struct LockFreeEntry : public Entry
+  {
+    using Entry::Entry;
+
+    mutable std::atomic<bool> d_referenced{false};
+    mutable std::atomic<bool> d_refreshSubmitted{false};
+    size_t d_slot{0}; // only accessed with the shard lock held
+  };
+
+  /* A slot only holds the key as a hint, readers check the entry itself */
+  struct LockFreeSlot
+  {
+    std::atomic<uint64_t> d_key{0};
+    std::atomic<LockFreeEntry*> d_entry{nullptr};
+  };
+
+  /* number of slots per bucket, an entry can only be stored in the bucket its key maps to */
+  static constexpr size_t s_lockFreeBucketSize{8};
+
+  /* Open-addressed table of the entries of a shard, walked by readers without the shard lock */
+  struct LockFreeTable
+  {
+    LockFreeTable(size_t buckets) :
+      // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+      d_slots(std::make_unique<LockFreeSlot[]>(buckets * s_lockFreeBucketSize)), d_buckets(buckets)
+    {
+    }
+
+    [[nodiscard]] size_t getBucketStart(uint64_t key) const
+    {
+      /* map the key to [0, d_buckets[ without a division */
+      return ((key >> 32U) * d_buckets >> 32U) * s_lockFreeBucketSize;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+    std::unique_ptr<LockFreeSlot[]> d_slots;
+    const size_t d_buckets;
+  };
+
+  /* One per reader thread. Readers announce the epoch they started in, a retired entry (or table)
+     can be freed once every reader has announced a later epoch, or is outside of a lookup (0). */
+  struct alignas(64) LockFreeReader
+  {
+    std::atomic<uint64_t> d_epoch{0};
+    std::atomic<uint64_t> d_hits{0};
+    std::atomic<uint64_t> d_misses{0};
+  };
+
+  /* readers are never unregistered, additional reader threads do their lookups with the shard lock held */
+  static constexpr size_t s_maxLockFreeReaders{256};
+  /* number of retired entries after which a shard checks which ones can be freed */
+  static constexpr size_t s_lockFreeReclaimBatch{32};
+
   struct HashTag
   {
   };
@@ -165,6 +228,12 @@ private:
                                                          sequenced<tag<SequencedTag>>,
                                                          ordered_non_unique<tag<NameTag>, member<Entry, DNSName, &Entry::d_name>, CanonDNSNameCompare>>>;
 
+  /* the entries of a shard with lock-free reads, owned by the shard. The sequenced index is the CLOCK list */
+  using lockFreeEntries_t = multi_index_container<LockFreeEntry*,
+                                                  indexed_by<hashed_unique<tag<HashTag>, identity<LockFreeEntry*>>,
+                                                             sequenced<tag<SequencedTag>>,
+                                                             ordered_non_unique<tag<NameTag>, member<Entry, DNSName, &Entry::d_name>, CanonDNSNameCompare>>>;
+
   struct MapCombo
   {
     MapCombo() = default;
@@ -176,6 +245,18 @@ private:
 
     struct LockedContent
     {
+      LockedContent() = default;
+      ~LockedContent()
+      {
+        for (auto* entry : d_lockFreeEntries) {
+          delete entry; // NOLINT(cppcoreguidelines-owning-memory)
+        }
+      }
+      LockedContent(const LockedContent&) = delete;
+      LockedContent(LockedContent&&) = delete;
+      LockedContent& operator=(const LockedContent&) = delete;
+      LockedContent& operator=(LockedContent&&) = delete;
+
       packetCache_t d_map;
       size_t d_shardSize{0};
       uint64_t d_hits{0};
@@ -184,6 +265,12 @@ private:
       uint64_t d_acquired_count{0};
       void invalidate() {}
       void preRemoval(const Entry& /* entry */) {}
+
+      // lock-free reads only
+      lockFreeEntries_t d_lockFreeEntries;
+      std::unique_ptr<LockFreeTable> d_lockFreeTable;
+      std::vector<std::pair<uint64_t, std::unique_ptr<LockFreeEntry>>> d_retired;
+      size_t d_nextReclaim{0};
     };
 
     LockGuardedTryHolder<MapCombo::LockedContent> lock()
@@ -212,12 +299,30 @@ private:
       --d_entriesCount;
     }
 
+    [[nodiscard]] const LockFreeTable* getLockFreeTable() const
+    {
+      return d_lockFreeTable.load();
+    }
+
+    void setLockFreeTable(LockFreeTable* table)
+    {
+      d_lockFreeTable.store(table);
+    }
+
   private:
     LockGuarded<LockedContent> d_content;
     pdns::stat_t d_entriesCount{0};
+    /* the table owned by d_content, published for readers */
+    std::atomic<LockFreeTable*> d_lockFreeTable{nullptr};
   };
 
   vector<MapCombo> d_maps;
+  // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+  std::unique_ptr<LockFreeReader[]> d_lockFreeReaders;
+  std::atomic<size_t> d_lockFreeReadersCount{0};
+  std::atomic<uint64_t> d_epoch{1};
+  const uint64_t d_serial;
+  const bool d_lockFree;
 
   static size_t combine(unsigned int tag, uint32_t hash, bool tcp)
   {
@@ -238,8 +343,25 @@ private:
     return d_maps.at(combine(tag, hash, tcp) % d_maps.size());
   }
 
-  static bool qrMatch(const packetCache_t::index<HashTag>::type::iterator& iter, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass);
+  static bool qrMatch(const Entry& entry, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass);
+  static bool needsRefresh(const Entry& entry, uint16_t qtype, time_t now);
+  static void copyResponse(const Entry& entry, const std::string& queryPacket, const DNSName& qname, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
   static bool checkResponseMatches(MapCombo::LockedContent& shard, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
 
+  static uint64_t getLockFreeKey(unsigned int tag, uint32_t hash, bool tcp);
+  LockFreeReader* getLockFreeReader();
+  [[nodiscard]] uint64_t getOldestReaderEpoch() const;
+  void retire(MapCombo::LockedContent& content, LockFreeEntry* entry);
+  void reclaim(MapCombo::LockedContent& content);
+  template <typename QNameGetter>
+  bool getResponsePacketLockFree(MapCombo& map, unsigned int tag, uint32_t qhash, bool tcp, const std::string& queryPacket, QNameGetter& getQName, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
+  template <typename QNameGetter>
+  static bool lookupLockFree(const LockFreeTable& table, unsigned int tag, uint32_t qhash, bool tcp, const std::string& queryPacket, QNameGetter& getQName, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
+  void insertResponsePacketLockFree(MapCombo& map, MapCombo::LockedContent& content, unsigned int tag, uint32_t qhash, std::string&& query, const DNSName& qname, uint16_t qtype, uint16_t qclass, std::string&& responsePacket, time_t now, uint32_t ttl, const vState& valState, OptPBData&& pbdata, bool tcp);
+  void removeLockFree(MapCombo& map, MapCombo::LockedContent& content, LockFreeEntry* entry);
+  void evictLockFree(MapCombo& map, MapCombo::LockedContent& content, size_t count);
+  void resizeLockFreeTable(MapCombo& map, MapCombo::LockedContent& content);
+  uint64_t pruneLockFree(time_t now, size_t maxSize);
+
   void setShardSizes(size_t shardSize);
 };
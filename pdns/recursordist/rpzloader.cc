@@ -316,7 +316,7 @@ static void incRPZFailedTransfers(const std::string& zone)
   }
 }
 
-static void setRPZZoneNewState(const std::string& zone, uint32_t serial, uint64_t numberOfRecords, bool fromFile, bool wasAXFR)
+static void setRPZZoneNewState(const std::string& zone, uint32_t serial, uint64_t numberOfRecords, size_t memoryUsage, uint64_t updateDurationUsec, bool fromFile, bool wasAXFR)
 {
   auto stats = getRPZZoneStats(zone);
   if (stats == nullptr) {
@@ -331,12 +331,16 @@ static void setRPZZoneNewState(const std::string& zone, uint32_t serial, uint64_
   stats->d_lastUpdate = time(nullptr);
   stats->d_serial = serial;
   stats->d_numberOfRecords = numberOfRecords;
+  stats->d_memoryUsage = memoryUsage;
+  stats->d_lastUpdateDuration = updateDurationUsec;
 }
 
 // this function is silent - you do the logging
 std::shared_ptr<const SOARecordContent> loadRPZFromFile(const std::string& fname, const std::shared_ptr<DNSFilterEngine::Zone>& zone, const boost::optional<DNSFilterEngine::Policy>& defpol, bool defpolOverrideLocal, uint32_t maxTTL)
 {
   shared_ptr<const SOARecordContent> soaRecordContent = nullptr;
+  DTime loadTime;
+  loadTime.set();
   ZoneParserTNG zpt(fname);
   zpt.setMaxGenerateSteps(::arg().asNum("max-generate-steps"));
   zpt.setMaxIncludes(::arg().asNum("max-include-depth"));
@@ -372,7 +376,7 @@ std::shared_ptr<const SOARecordContent> loadRPZFromFile(const std::string& fname
   if (soaRecordContent != nullptr) {
     zone->setRefresh(soaRecordContent->d_st.refresh);
     zone->setSOA(std::move(soaRecord));
-    setRPZZoneNewState(zone->getName(), soaRecordContent->d_st.serial, zone->size(), true, false);
+    setRPZZoneNewState(zone->getName(), soaRecordContent->d_st.serial, zone->size(), zone->getMemoryUsage(), loadTime.udiff(), true, false);
   }
   return soaRecordContent;
 }
@@ -450,15 +454,17 @@ static void preloadRPZFIle(RPZTrackerParams& params, const DNSName& zoneName, st
   while (!params.soaRecordContent) {
     /* if we received an empty sr, the zone was not really preloaded */
 
-    /* full copy, as promised */
+    /* the copy shares the triggers of the old zone until they are modified */
     std::shared_ptr<DNSFilterEngine::Zone> newZone = std::make_shared<DNSFilterEngine::Zone>(*oldZone);
     for (const auto& primary : params.primaries) {
       try {
+        DTime loadTime;
+        loadTime.set();
         params.soaRecordContent = loadRPZFromServer(logger, primary, zoneName, newZone, params.defpol, params.defpolOverrideLocal, params.maxTTL, params.tsigtriplet, params.maxReceivedMBytes, params.localAddress, params.xfrTimeout);
         newZone->setSerial(params.soaRecordContent->d_st.serial);
         newZone->setRefresh(params.soaRecordContent->d_st.refresh);
         refresh = std::max(params.refreshFromConf != 0 ? params.refreshFromConf : newZone->getRefresh(), 1U);
-        setRPZZoneNewState(polName, params.soaRecordContent->d_st.serial, newZone->size(), false, true);
+        setRPZZoneNewState(polName, params.soaRecordContent->d_st.serial, newZone->size(), newZone->getMemoryUsage(), loadTime.udiff(), false, true);
 
         g_luaconfs.modify([zoneIdx = params.zoneIdx, &newZone](LuaConfigItems& lci) {
           lci.dfe.setZone(zoneIdx, newZone);
@@ -583,7 +589,10 @@ static bool RPZTrackerIteration(RPZTrackerParams& params, const DNSName& zoneNam
            logger->info(Logr::Info, "This policy is no more, stopping the existing RPZ update thread"));
       return false;
     }
-    /* we need to make a _full copy_ of the zone we are going to work on */
+    /* we need a copy of the zone we are going to work on, since the existing one is in use. That copy is cheap:
+       the triggers are shared with the existing zone, and only the parts touched by the deltas are duplicated */
+    DTime updateTime;
+    updateTime.set();
     std::shared_ptr<DNSFilterEngine::Zone> newZone = std::make_shared<DNSFilterEngine::Zone>(*oldZone);
     /* initialize the current serial to the last one */
     std::shared_ptr<const SOARecordContent> currentSR = params.soaRecordContent;
@@ -651,7 +660,7 @@ static bool RPZTrackerIteration(RPZTrackerParams& params, const DNSName& zoneNam
          logger->info(Logr::Info, "RPZ mutations", "removals", Logging::Loggable(totremove), "additions", Logging::Loggable(totadd), "newserial", Logging::Loggable(params.soaRecordContent->d_st.serial)));
     newZone->setSerial(params.soaRecordContent->d_st.serial);
     newZone->setRefresh(params.soaRecordContent->d_st.refresh);
-    setRPZZoneNewState(polName, params.soaRecordContent->d_st.serial, newZone->size(), false, fullUpdate);
+    setRPZZoneNewState(polName, params.soaRecordContent->d_st.serial, newZone->size(), newZone->getMemoryUsage(), updateTime.udiff(), false, fullUpdate);
 
     /* we need to replace the existing zone with the new one,
        but we don't want to touch anything else, especially other zones,
@@ -64,6 +64,8 @@ struct rpzStats
   std::atomic<uint64_t> d_fullTransfers;
   std::atomic<uint64_t> d_numberOfRecords;
   std::atomic<time_t> d_lastUpdate;
+  std::atomic<uint64_t> d_lastUpdateDuration; // microseconds spent applying the latest update
+  std::atomic<uint64_t> d_memoryUsage; // approximate, see DNSFilterEngine::Zone::getMemoryUsage()
   std::atomic<uint32_t> d_serial;
 };
 
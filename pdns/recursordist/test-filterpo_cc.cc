@@ -12,6 +12,7 @@
 
 #include "dnsrecords.hh"
 #include "filterpo.hh"
+#include "misc.hh"
 
 BOOST_AUTO_TEST_CASE(test_filter_policies_basic)
 {
@@ -834,6 +835,283 @@ BOOST_AUTO_TEST_CASE(test_multiple_filter_policies_order)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_filter_policies_zone_copy)
+{
+  const DNSName blockedName("blocked.");
+  const DNSName customName("custom.");
+  const ComboAddress clientIP("192.0.2.128");
+  const DNSName addedName("added.");
+
+  auto original = std::make_shared<DNSFilterEngine::Zone>();
+  original->setName("Unit test policy 0");
+  original->addQNameTrigger(blockedName, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName));
+  original->addQNameTrigger(customName, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Custom, DNSFilterEngine::PolicyType::QName, 0, nullptr, {DNSRecordContent::make(QType::A, QClass::IN, "192.0.2.1")}));
+  original->addClientTrigger(Netmask(clientIP, 32), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::ClientIP));
+  for (size_t idx = 0; idx < 1000; idx++) {
+    original->addQNameTrigger(DNSName("name-" + std::to_string(idx) + "."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+  }
+  BOOST_CHECK_EQUAL(original->size(), 1003U);
+  BOOST_CHECK_GT(original->getMemoryUsage(), 0U);
+
+  /* the triggers are shared between the copies, but modifying one does not impact the other */
+  auto copy = std::make_shared<DNSFilterEngine::Zone>(*original);
+  BOOST_CHECK(copy->rmQNameTrigger(blockedName, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName)));
+  BOOST_CHECK(copy->rmClientTrigger(Netmask(clientIP, 32), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::ClientIP)));
+  copy->addQNameTrigger(addedName, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName));
+  copy->addQNameTrigger(customName, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Custom, DNSFilterEngine::PolicyType::QName, 0, nullptr, {DNSRecordContent::make(QType::A, QClass::IN, "192.0.2.2")}));
+  BOOST_CHECK_EQUAL(copy->size(), 1002U);
+
+  DNSFilterEngine::Policy pol;
+  BOOST_CHECK(original->findExactQNamePolicy(blockedName, pol));
+  BOOST_CHECK(original->findClientPolicy(clientIP, pol));
+  BOOST_CHECK(!original->findExactQNamePolicy(addedName, pol));
+  BOOST_CHECK(original->findExactQNamePolicy(customName, pol));
+  BOOST_CHECK_EQUAL(pol.customRecordsSize(), 1U);
+  BOOST_CHECK_EQUAL(original->size(), 1003U);
+
+  BOOST_CHECK(!copy->findExactQNamePolicy(blockedName, pol));
+  BOOST_CHECK(!copy->findClientPolicy(clientIP, pol));
+  BOOST_CHECK(copy->findExactQNamePolicy(addedName, pol));
+  BOOST_CHECK(copy->findExactQNamePolicy(customName, pol));
+  BOOST_CHECK_EQUAL(pol.customRecordsSize(), 2U);
+  BOOST_CHECK(copy->findExactQNamePolicy(DNSName("name-42."), pol));
+  BOOST_CHECK(pol.d_kind == DNSFilterEngine::PolicyKind::NXDOMAIN);
+
+  /* clearing the copy, as for an IXFR containing a whole new zone, leaves the original alone */
+  copy->clear();
+  BOOST_CHECK_EQUAL(copy->size(), 0U);
+  BOOST_CHECK_EQUAL(original->size(), 1003U);
+  BOOST_CHECK(original->findClientPolicy(clientIP, pol));
+  BOOST_CHECK(original->findExactQNamePolicy(DNSName("name-42."), pol));
+}
+
+BOOST_AUTO_TEST_CASE(test_filter_policies_shared_actions)
+{
+  auto zone = std::make_shared<DNSFilterEngine::Zone>();
+  zone->setName("Unit test policy shared actions");
+
+  const DNSName garden1("garden1.example.");
+  const DNSName garden2("garden2.example.");
+  const auto gardenRecord = [] { return DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Custom, DNSFilterEngine::PolicyType::QName, 0, nullptr, {DNSRecordContent::make(QType::CNAME, QClass::IN, "garden.example.net.")}); };
+
+  for (size_t idx = 0; idx < 100; idx++) {
+    zone->addQNameTrigger(DNSName("nx-" + std::to_string(idx) + ".example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+    zone->addNSTrigger(DNSName("ns-" + std::to_string(idx) + ".example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::NSDName));
+  }
+  zone->addQNameTrigger(DNSName("*.wildcard.example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+  zone->addQNameTrigger(DNSName("nx-ttl.example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName, 42));
+  zone->addQNameTrigger(garden1, gardenRecord());
+  zone->addQNameTrigger(garden2, gardenRecord());
+  BOOST_CHECK_EQUAL(zone->size(), 204U);
+  /* NXDOMAIN for QName, NXDOMAIN for NSDName, NXDOMAIN with a TTL, and the local data */
+  BOOST_CHECK_EQUAL(zone->getActionsCount(), 4U);
+
+  /* adding records to a name does not impact the other names sharing the same local data */
+  zone->addQNameTrigger(garden2, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Custom, DNSFilterEngine::PolicyType::QName, 0, nullptr, {DNSRecordContent::make(QType::A, QClass::IN, "192.0.2.1")}));
+  BOOST_CHECK_EQUAL(zone->getActionsCount(), 5U);
+
+  DNSFilterEngine::Policy pol;
+  BOOST_REQUIRE(zone->findExactQNamePolicy(garden1, pol));
+  BOOST_CHECK_EQUAL(pol.customRecordsSize(), 1U);
+  BOOST_REQUIRE(zone->findExactQNamePolicy(garden2, pol));
+  BOOST_CHECK_EQUAL(pol.customRecordsSize(), 2U);
+  BOOST_REQUIRE(zone->findExactQNamePolicy(DNSName("nx-ttl.example."), pol));
+  BOOST_CHECK_EQUAL(pol.d_ttl, 42);
+  BOOST_CHECK(pol.d_type == DNSFilterEngine::PolicyType::QName);
+  BOOST_REQUIRE(zone->findExactNSPolicy(DNSName("ns-1.example."), pol));
+  BOOST_CHECK(pol.d_type == DNSFilterEngine::PolicyType::NSDName);
+
+  /* wildcards are matched case-insensitively, from the labels of the name */
+  BOOST_REQUIRE(zone->findQNamePolicy(DNSName("Sub.Domain.WildCard.Example."), pol));
+  BOOST_CHECK(pol.d_kind == DNSFilterEngine::PolicyKind::NXDOMAIN);
+  BOOST_CHECK_EQUAL(pol.getTrigger(), DNSName("*.wildcard.example."));
+  BOOST_CHECK_EQUAL(pol.getHit(), "Sub.Domain.WildCard.Example");
+  BOOST_CHECK(!zone->findQNamePolicy(DNSName("wildcard.example."), pol));
+  BOOST_CHECK(!zone->findQNamePolicy(DNSName("sub.wildcard2.example."), pol));
+
+  /* removing the local data of the last name using it removes the action */
+  BOOST_CHECK(zone->rmQNameTrigger(garden2, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Custom, DNSFilterEngine::PolicyType::QName, 0, nullptr, {DNSRecordContent::make(QType::A, QClass::IN, "192.0.2.1")})));
+  BOOST_CHECK_EQUAL(zone->getActionsCount(), 4U);
+  BOOST_CHECK(zone->rmQNameTrigger(garden1, gardenRecord()));
+  BOOST_CHECK(zone->rmQNameTrigger(garden2, gardenRecord()));
+  BOOST_CHECK_EQUAL(zone->getActionsCount(), 3U);
+  BOOST_CHECK(!zone->findExactQNamePolicy(garden2, pol));
+  BOOST_CHECK_EQUAL(zone->size(), 202U);
+}
+
+BOOST_AUTO_TEST_CASE(test_filter_policies_loading)
+{
+  /* a large zone made of NXDOMAIN triggers, as most RPZ feeds are */
+  const size_t testSize = 100000;
+  vector<DNSName> names;
+  names.reserve(testSize);
+  for (size_t idx = 0; idx < testSize; idx++) {
+    names.emplace_back("name-" + std::to_string(idx) + ".blocked-domain-" + std::to_string(idx % 1000) + ".example.");
+  }
+
+#ifdef BENCH_FILTERPO
+  DTime time;
+  time.set();
+#endif
+  auto zone = std::make_shared<DNSFilterEngine::Zone>();
+  zone->setName("Unit test policy loading");
+  for (const auto& name : names) {
+    zone->addQNameTrigger(name, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+  }
+#ifdef BENCH_FILTERPO
+  const auto loadTime = time.udiff(true);
+#endif
+
+  size_t found = 0;
+  DNSFilterEngine::Policy pol;
+  for (const auto& name : names) {
+    if (zone->findQNamePolicy(name, pol)) {
+      ++found;
+    }
+  }
+#ifdef BENCH_FILTERPO
+  const auto lookupTime = time.udiff(true);
+  BOOST_TEST_MESSAGE("Loaded " << testSize << " entries in " << loadTime << " us, looked them up in " << lookupTime << " us, " << zone->getMemoryUsage() / testSize << " bytes per entry");
+#endif
+
+  BOOST_CHECK_EQUAL(zone->size(), testSize);
+  BOOST_CHECK_EQUAL(found, testSize);
+  /* the entries share a single action */
+  BOOST_CHECK_EQUAL(zone->getActionsCount(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(test_multiple_filter_policies_index)
+{
+  DNSFilterEngine dfe;
+  const DNSName bad("bad.example.com.");
+  const DNSName badNS("ns.bad.example.com.");
+  const DNSName sub("sub.wildcard.example.com.");
+  const DNSName added("added.example.com.");
+
+  std::vector<std::shared_ptr<DNSFilterEngine::Zone>> zones;
+  for (size_t idx = 0; idx < 3; idx++) {
+    auto zone = std::make_shared<DNSFilterEngine::Zone>();
+    zone->setName("Unit test policy " + std::to_string(idx));
+    zones.push_back(zone);
+  }
+  zones.at(1)->addQNameTrigger(bad, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName));
+  zones.at(2)->addQNameTrigger(bad, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+  zones.at(2)->addQNameTrigger(DNSName("*.wildcard.example.com."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NODATA, DNSFilterEngine::PolicyType::QName));
+  zones.at(2)->addNSTrigger(badNS, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::NSDName));
+  for (const auto& zone : zones) {
+    dfe.addZone(zone);
+  }
+
+  /* the highest priority match wins, zones that are disabled or of a lower priority than the current policy are skipped */
+  BOOST_CHECK(dfe.getQueryPolicy(bad, {}, DNSFilterEngine::maximumPriority).d_kind == DNSFilterEngine::PolicyKind::Drop);
+  BOOST_CHECK(dfe.getQueryPolicy(bad, {{zones.at(1)->getName(), true}}, DNSFilterEngine::maximumPriority).d_kind == DNSFilterEngine::PolicyKind::NXDOMAIN);
+  BOOST_CHECK(dfe.getQueryPolicy(bad, {}, 1).d_type == DNSFilterEngine::PolicyType::None);
+  BOOST_CHECK(dfe.getQueryPolicy(sub, {}, DNSFilterEngine::maximumPriority).d_kind == DNSFilterEngine::PolicyKind::NODATA);
+  BOOST_CHECK(dfe.getQueryPolicy(DNSName("wildcard.example.com."), {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::None);
+  BOOST_CHECK(dfe.getProcessingPolicy(badNS, {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::NSDName);
+  BOOST_CHECK(dfe.getProcessingPolicy(bad, {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::None);
+
+  /* updating a zone the way the RPZ loader does it: copy, modify then replace */
+  auto newZone = std::make_shared<DNSFilterEngine::Zone>(*zones.at(1));
+  BOOST_CHECK(newZone->rmQNameTrigger(bad, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName)));
+  newZone->addQNameTrigger(added, DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Truncate, DNSFilterEngine::PolicyType::QName));
+  newZone->addQNameTrigger(DNSName("*.example.com."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName));
+  dfe.setZone(1, newZone);
+
+  BOOST_CHECK(dfe.getQueryPolicy(bad, {}, DNSFilterEngine::maximumPriority).d_kind == DNSFilterEngine::PolicyKind::Drop);
+  BOOST_CHECK_EQUAL(dfe.getQueryPolicy(bad, {}, DNSFilterEngine::maximumPriority).getName(), newZone->getName());
+  BOOST_CHECK(dfe.getQueryPolicy(added, {}, DNSFilterEngine::maximumPriority).d_kind == DNSFilterEngine::PolicyKind::Truncate);
+  /* the wildcard of the second zone is closer, but the first zone has a higher priority */
+  BOOST_CHECK_EQUAL(dfe.getQueryPolicy(sub, {}, DNSFilterEngine::maximumPriority).getName(), newZone->getName());
+
+  /* a zone modified after being added to the engine is still looked into */
+  zones.at(0)->addQNameTrigger(DNSName("late.example.net."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::QName));
+  BOOST_CHECK_EQUAL(dfe.getQueryPolicy(DNSName("late.example.net."), {}, DNSFilterEngine::maximumPriority).getName(), zones.at(0)->getName());
+  zones.at(2)->addNSTrigger(DNSName("*.example.net."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::Drop, DNSFilterEngine::PolicyType::NSDName));
+  BOOST_CHECK(dfe.getProcessingPolicy(DNSName("ns.example.net."), {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::NSDName);
+
+  dfe.clear();
+  BOOST_CHECK(dfe.getQueryPolicy(bad, {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::None);
+  BOOST_CHECK(dfe.getQueryPolicy(DNSName("late.example.net."), {}, DNSFilterEngine::maximumPriority).d_type == DNSFilterEngine::PolicyType::None);
+}
+
+BOOST_AUTO_TEST_CASE(test_multiple_filter_policies_lookups)
+{
+  /* a dozen zones, and names that are mostly not blocked */
+  const size_t zonesCount = 12;
+  const size_t entriesPerZone = 10000;
+  const size_t lookupsCount = 100000;
+
+  DNSFilterEngine dfe;
+  for (size_t zoneIdx = 0; zoneIdx < zonesCount; zoneIdx++) {
+    auto zone = std::make_shared<DNSFilterEngine::Zone>();
+    zone->setName("Unit test policy " + std::to_string(zoneIdx));
+    for (size_t idx = 0; idx < entriesPerZone; idx++) {
+      zone->addQNameTrigger(DNSName("blocked-" + std::to_string(idx) + ".zone-" + std::to_string(zoneIdx) + ".example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+    }
+    zone->addQNameTrigger(DNSName("*.wildcard-" + std::to_string(zoneIdx) + ".example."), DNSFilterEngine::Policy(DNSFilterEngine::PolicyKind::NXDOMAIN, DNSFilterEngine::PolicyType::QName));
+    dfe.addZone(zone);
+  }
+
+  vector<DNSName> names;
+  names.reserve(lookupsCount);
+  for (size_t idx = 0; idx < lookupsCount; idx++) {
+    if (idx % 100 == 0) {
+      names.emplace_back("www.blocked-" + std::to_string(idx % entriesPerZone) + ".wildcard-" + std::to_string(idx % zonesCount) + ".example.");
+    }
+    else if (idx % 100 == 1) {
+      names.emplace_back("blocked-" + std::to_string(idx % entriesPerZone) + ".zone-" + std::to_string(idx % zonesCount) + ".example.");
+    }
+    else {
+      names.emplace_back("www.name-" + std::to_string(idx) + ".allowed.example.");
+    }
+  }
+
+  /* what we would get by looking into each zone, one after the other */
+#ifdef BENCH_FILTERPO
+  DTime time;
+  time.set();
+#endif
+  size_t expectedHits = 0;
+  vector<std::string> expected;
+  expected.reserve(lookupsCount);
+  for (const auto& name : names) {
+    DNSFilterEngine::Policy pol;
+    std::string zoneName;
+    for (size_t zoneIdx = 0; zoneIdx < dfe.size(); zoneIdx++) {
+      if (dfe.getZone(zoneIdx)->findQNamePolicy(name, pol)) {
+        zoneName = pol.getName();
+        ++expectedHits;
+        break;
+      }
+    }
+    expected.push_back(std::move(zoneName));
+  }
+#ifdef BENCH_FILTERPO
+  const auto perZoneTime = time.udiff(true);
+#endif
+
+  size_t hits = 0;
+  size_t mismatches = 0;
+  for (size_t idx = 0; idx < names.size(); idx++) {
+    const auto pol = dfe.getQueryPolicy(names.at(idx), {}, DNSFilterEngine::maximumPriority);
+    if (pol.wasHit()) {
+      ++hits;
+    }
+    if (pol.getName() != expected.at(idx)) {
+      ++mismatches;
+    }
+  }
+#ifdef BENCH_FILTERPO
+  const auto indexedTime = time.udiff(true);
+  BOOST_TEST_MESSAGE("Looked up " << lookupsCount << " names in " << zonesCount << " zones: " << perZoneTime << " us zone by zone, " << indexedTime << " us with the combined index");
+#endif
+
+  BOOST_CHECK_EQUAL(hits, lookupsCount / 50);
+  BOOST_CHECK_EQUAL(hits, expectedHits);
+  BOOST_CHECK_EQUAL(mismatches, 0U);
+}
+
 BOOST_AUTO_TEST_CASE(test_mask_to_rpz)
 {
   BOOST_CHECK_EQUAL(DNSFilterEngine::Zone::maskToRPZ(Netmask("::2/127")).toString(), "127.2.zz.");
@@ -0,0 +1,230 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "persistent-hashmap.hh"
+
+BOOST_AUTO_TEST_SUITE(persistent_hashmap_hh)
+
+/* only keep a few bits of the hash, to get deep trees and collisions with a few entries */
+struct PoorHash
+{
+  size_t operator()(uint32_t key) const
+  {
+    return key & 0xC0000421U;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(test_basic)
+{
+  pdns::PersistentHashMap<std::string, int> map;
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(map.find("a") == nullptr);
+  BOOST_CHECK(!map.erase("a"));
+
+  BOOST_CHECK(map.insert("a", 1));
+  BOOST_CHECK(map.insert("b", 2));
+  BOOST_CHECK(!map.insert("a", 3));
+  BOOST_CHECK_EQUAL(map.size(), 2U);
+  BOOST_REQUIRE(map.find("a") != nullptr);
+  BOOST_CHECK_EQUAL(map.find("a")->first, "a");
+  BOOST_CHECK_EQUAL(map.find("a")->second, 1);
+
+  auto* value = map.findMutable("b");
+  BOOST_REQUIRE(value != nullptr);
+  *value = 42;
+  BOOST_CHECK_EQUAL(map.find("b")->second, 42);
+  BOOST_CHECK(map.findMutable("c") == nullptr);
+
+  BOOST_CHECK(map.erase("a"));
+  BOOST_CHECK(map.find("a") == nullptr);
+  BOOST_CHECK_EQUAL(map.size(), 1U);
+  BOOST_CHECK(map.erase("b"));
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK_EQUAL(map.getMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_collisions)
+{
+  pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash> map;
+  std::unordered_map<uint32_t, uint32_t> reference;
+
+  for (uint32_t key = 0; key < 2000; key++) {
+    BOOST_CHECK(map.insert(key, key * 2));
+    reference[key] = key * 2;
+  }
+  BOOST_CHECK_EQUAL(map.size(), reference.size());
+
+  for (uint32_t key = 0; key < 2000; key += 3) {
+    BOOST_CHECK(map.erase(key));
+    reference.erase(key);
+  }
+  BOOST_CHECK_EQUAL(map.size(), reference.size());
+
+  for (uint32_t key = 0; key < 2000; key++) {
+    const auto* entry = map.find(key);
+    if (reference.count(key) == 0) {
+      BOOST_CHECK(entry == nullptr);
+    }
+    else {
+      BOOST_REQUIRE(entry != nullptr);
+      BOOST_CHECK_EQUAL(entry->second, reference.at(key));
+    }
+  }
+
+  size_t visited = 0;
+  map.visit([&visited, &reference](const uint32_t& key, const uint32_t& value) {
+    BOOST_CHECK_EQUAL(reference.at(key), value);
+    ++visited;
+  });
+  BOOST_CHECK_EQUAL(visited, reference.size());
+
+  for (const auto& entry : reference) {
+    BOOST_CHECK(map.erase(entry.first));
+  }
+  BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_find_if)
+{
+  pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash> map;
+  for (uint32_t key = 0; key < 100; key++) {
+    map.insert(key, key * 2);
+  }
+
+  /* entries with the same hash are told apart by the predicate */
+  const auto* entry = map.findIf(PoorHash()(33), [](uint32_t key) { return key == 33; });
+  BOOST_REQUIRE(entry != nullptr);
+  BOOST_CHECK_EQUAL(entry->second, 66U);
+  BOOST_CHECK(map.findIf(PoorHash()(33), [](uint32_t key) { return key == 1000; }) == nullptr);
+  BOOST_CHECK(map.findIf(PoorHash()(1000), [](uint32_t /* key */) { return true; }) != nullptr);
+  BOOST_CHECK(map.findIf(PoorHash()(1024), [](uint32_t /* key */) { return true; }) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_copies)
+{
+  pdns::PersistentHashMap<uint32_t, uint32_t> original;
+  for (uint32_t key = 0; key < 10000; key++) {
+    original.insert(key, key);
+  }
+
+  auto copy = original;
+  BOOST_CHECK_EQUAL(copy.size(), original.size());
+
+  /* modifications of the copy are not visible in the original, and the other way around */
+  BOOST_CHECK(copy.erase(1));
+  BOOST_CHECK(copy.insert(10000, 10000));
+  *copy.findMutable(2) = 42;
+  BOOST_CHECK(original.erase(3));
+
+  BOOST_CHECK(original.find(1) != nullptr);
+  BOOST_CHECK(original.find(10000) == nullptr);
+  BOOST_CHECK_EQUAL(original.find(2)->second, 2U);
+  BOOST_CHECK_EQUAL(original.size(), 9999U);
+
+  BOOST_CHECK(copy.find(1) == nullptr);
+  BOOST_CHECK(copy.find(10000) != nullptr);
+  BOOST_CHECK_EQUAL(copy.find(2)->second, 42U);
+  BOOST_CHECK(copy.find(3) != nullptr);
+  BOOST_CHECK_EQUAL(copy.size(), 10000U);
+
+  /* clearing a copy does not touch the other one */
+  copy.clear();
+  BOOST_CHECK(copy.empty());
+  BOOST_CHECK_EQUAL(original.size(), 9999U);
+  for (uint32_t key = 4; key < 10000; key++) {
+    BOOST_REQUIRE(original.find(key) != nullptr);
+    BOOST_CHECK_EQUAL(original.find(key)->second, key);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_diff_keys)
+{
+  pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash> original;
+  for (uint32_t key = 0; key < 5000; key++) {
+    original.insert(key, key);
+  }
+
+  auto copy = original;
+  std::set<uint32_t> removed;
+  std::set<uint32_t> added;
+  const auto diff = [&](const pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash>& newer, const pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash>& older) {
+    removed.clear();
+    added.clear();
+    newer.diffKeys(older, [&removed](uint32_t key) { BOOST_CHECK(removed.insert(key).second); }, [&added](uint32_t key) { BOOST_CHECK(added.insert(key).second); });
+  };
+
+  diff(copy, original);
+  BOOST_CHECK(removed.empty());
+  BOOST_CHECK(added.empty());
+  BOOST_CHECK(copy.isSameVersion(original));
+
+  /* modified values are not reported, only the keys */
+  *copy.findMutable(1) = 42;
+  BOOST_CHECK(!copy.isSameVersion(original));
+  for (uint32_t key = 100; key < 200; key++) {
+    BOOST_CHECK(copy.erase(key));
+  }
+  for (uint32_t key = 10000; key < 10050; key++) {
+    BOOST_CHECK(copy.insert(key, key));
+  }
+  /* removed then added back */
+  BOOST_CHECK(copy.erase(300));
+  BOOST_CHECK(copy.insert(300, 300));
+
+  diff(copy, original);
+  BOOST_CHECK_EQUAL(removed.size(), 100U);
+  BOOST_CHECK_EQUAL(*removed.begin(), 100U);
+  BOOST_CHECK_EQUAL(*removed.rbegin(), 199U);
+  BOOST_CHECK_EQUAL(added.size(), 50U);
+  BOOST_CHECK_EQUAL(*added.begin(), 10000U);
+  BOOST_CHECK_EQUAL(*added.rbegin(), 10049U);
+
+  diff(original, copy);
+  BOOST_CHECK_EQUAL(removed.size(), 50U);
+  BOOST_CHECK_EQUAL(added.size(), 100U);
+
+  /* against an empty map */
+  diff(copy, pdns::PersistentHashMap<uint32_t, uint32_t, PoorHash>());
+  BOOST_CHECK(removed.empty());
+  BOOST_CHECK_EQUAL(added.size(), copy.size());
+  copy.clear();
+  diff(copy, original);
+  BOOST_CHECK_EQUAL(removed.size(), original.size());
+  BOOST_CHECK(added.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
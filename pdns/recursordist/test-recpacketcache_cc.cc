@@ -15,6 +15,9 @@
 #include "recpacketcache.hh"
 #include "taskqueue.hh"
 #include "rec-taskqueue.hh"
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <utility>
 
 BOOST_AUTO_TEST_SUITE(test_recpacketcache_cc)
@@ -450,4 +453,365 @@ BOOST_AUTO_TEST_CASE(test_recPacketCache_TCP)
   BOOST_CHECK_EQUAL(fpacket, r1packet);
 }
 
+/* the cache replaces the ID of the response with the one of the query, use the same one */
+static std::string makeLockFreeTestQuery(const DNSName& qname, uint16_t qtype)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, qtype);
+  pw.getHeader()->rd = true;
+  pw.getHeader()->qr = false;
+  pw.getHeader()->id = 0x4242;
+  return {reinterpret_cast<const char*>(packet.data()), packet.size()};
+}
+
+static std::string makeLockFreeTestResponse(const DNSName& qname, const std::string& address, uint32_t ttl)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, QType::A);
+  pw.getHeader()->rd = true;
+  pw.getHeader()->qr = true;
+  pw.getHeader()->id = 0x4242;
+  pw.startRecord(qname, QType::A, ttl);
+  ARecordContent ar(address);
+  ar.toPacket(pw);
+  pw.commit();
+  return {reinterpret_cast<const char*>(packet.data()), packet.size()};
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCacheLockFree)
+{
+  RecursorPacketCache::s_refresh_ttlperc = 30;
+  RecursorPacketCache rpc(1000, 16, true);
+  BOOST_CHECK(rpc.hasLockFreeReads());
+  string fpacket;
+  uint32_t age = 0;
+  uint32_t qhash = 0;
+  uint32_t qhash2 = 0;
+  uint32_t ttd = 3600;
+  vState valState{vState::Indeterminate};
+  BOOST_CHECK_EQUAL(rpc.size(), 0U);
+
+  taskQueueClear();
+
+  DNSName qname("www.powerdns.com");
+  auto qpacket = makeLockFreeTestQuery(qname, QType::A);
+  auto r1packet = makeLockFreeTestResponse(qname, "127.0.0.1", ttd);
+  auto r2packet = makeLockFreeTestResponse(qname, "127.0.0.2", ttd);
+
+  time_t now = time(nullptr);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash), false);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, qname, QType::A, QClass::IN, now, &fpacket, &age, &qhash2), false);
+  BOOST_CHECK_EQUAL(qhash, qhash2);
+
+  rpc.insertResponsePacket(0, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, ttd, vState::Secure, boost::none, false);
+  BOOST_CHECK_EQUAL(rpc.size(), 1U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash2), true);
+  BOOST_CHECK_EQUAL(fpacket, r1packet);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, qname, QType::A, QClass::IN, now + 10, &fpacket, &age, &valState, &qhash2, nullptr, false), true);
+  BOOST_CHECK_EQUAL(fpacket, r1packet);
+  BOOST_CHECK_EQUAL(age, 10U);
+  BOOST_CHECK_EQUAL(valState, vState::Secure);
+
+  /* not for a different tag, nor over TCP */
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(1, qpacket, now, &fpacket, &age, &qhash2), false);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, qname, QType::A, QClass::IN, now, &fpacket, &age, &valState, &qhash2, nullptr, true), false);
+
+  /* updating the entry replaces it */
+  rpc.insertResponsePacket(0, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r2packet), now, ttd, vState::Indeterminate, boost::none, false);
+  BOOST_CHECK_EQUAL(rpc.size(), 1U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash2), true);
+  BOOST_CHECK_EQUAL(fpacket, r2packet);
+
+  /* a different response over TCP and for another tag */
+  rpc.insertResponsePacket(0, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, ttd, vState::Indeterminate, boost::none, true);
+  rpc.insertResponsePacket(1, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, ttd, vState::Indeterminate, boost::none, false);
+  BOOST_CHECK_EQUAL(rpc.size(), 3U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, qname, QType::A, QClass::IN, now, &fpacket, &age, &valState, &qhash2, nullptr, true), true);
+  BOOST_CHECK_EQUAL(fpacket, r1packet);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(1, qpacket, now, &fpacket, &age, &qhash2), true);
+  BOOST_CHECK_EQUAL(fpacket, r1packet);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash2), true);
+  BOOST_CHECK_EQUAL(fpacket, r2packet);
+
+  /* another name does not match */
+  auto otherQuery = makeLockFreeTestQuery(DNSName("www.powerdns.com.co.uk"), QType::A);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, otherQuery, now, &fpacket, &age, &qhash2), false);
+
+  /* only one refresh task is submitted for an almost expired entry */
+  BOOST_REQUIRE_EQUAL(getTaskSize(), 0U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now + (ttd * 3 / 4), &fpacket, &age, &qhash2), true);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now + (ttd * 3 / 4), &fpacket, &age, &qhash2), true);
+  BOOST_REQUIRE_EQUAL(getTaskSize(), 1U);
+  BOOST_CHECK_EQUAL(taskQueuePop().d_qname, qname);
+
+  /* expired */
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now + ttd, &fpacket, &age, &qhash2), false);
+
+  BOOST_CHECK_EQUAL(rpc.getHits(), 8U);
+  BOOST_CHECK_EQUAL(rpc.getMisses(), 6U);
+
+  BOOST_CHECK_EQUAL(rpc.doWipePacketCache(qname, QType::AAAA), 0U);
+  BOOST_CHECK_EQUAL(rpc.doWipePacketCache(qname), 3U);
+  BOOST_CHECK_EQUAL(rpc.size(), 0U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash2), false);
+
+  rpc.insertResponsePacket(0, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, ttd, vState::Indeterminate, boost::none, false);
+  BOOST_CHECK_EQUAL(rpc.doWipePacketCache(DNSName("com"), 0xffff, true), 1U);
+  BOOST_CHECK_EQUAL(rpc.size(), 0U);
+
+  /* expired entries are pruned first */
+  rpc.insertResponsePacket(0, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, ttd, vState::Indeterminate, boost::none, false);
+  rpc.insertResponsePacket(1, qhash, string(qpacket), qname, QType::A, QClass::IN, string(r1packet), now, 1, vState::Indeterminate, boost::none, false);
+  BOOST_CHECK_EQUAL(rpc.size(), 2U);
+  rpc.doPruneTo(now + 2, 1);
+  BOOST_CHECK_EQUAL(rpc.size(), 1U);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, qpacket, now, &fpacket, &age, &qhash2), true);
+  rpc.doPruneTo(now, 0);
+  BOOST_CHECK_EQUAL(rpc.size(), 0U);
+  RecursorPacketCache::s_refresh_ttlperc = 0;
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCacheLockFreeEviction)
+{
+  const size_t maxEntries = 100;
+  RecursorPacketCache rpc(maxEntries, 1, true);
+  string fpacket;
+  uint32_t age = 0;
+  uint32_t qhash = 0;
+  uint32_t ttd = 3600;
+  time_t now = time(nullptr);
+
+  std::vector<DNSName> names;
+  std::vector<std::string> queries;
+  for (size_t idx = 0; idx < 2 * maxEntries; idx++) {
+    names.emplace_back("name" + std::to_string(idx) + ".powerdns.com");
+    queries.push_back(makeLockFreeTestQuery(names.back(), QType::A));
+  }
+
+  for (size_t idx = 0; idx < maxEntries; idx++) {
+    BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash), false);
+    rpc.insertResponsePacket(0, qhash, string(queries.at(idx)), names.at(idx), QType::A, QClass::IN, makeLockFreeTestResponse(names.at(idx), "192.0.2.1", ttd), now, ttd, vState::Indeterminate, boost::none, false);
+  }
+  BOOST_CHECK_EQUAL(rpc.size(), maxEntries);
+
+  /* the first half of the entries are used and should get a second chance */
+  size_t hits = 0;
+  for (size_t idx = 0; idx < maxEntries / 2; idx++) {
+    if (rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash)) {
+      hits++;
+    }
+  }
+  BOOST_CHECK_EQUAL(hits, maxEntries / 2);
+
+  for (size_t idx = maxEntries; idx < maxEntries + (maxEntries / 2); idx++) {
+    BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash), false);
+    rpc.insertResponsePacket(0, qhash, string(queries.at(idx)), names.at(idx), QType::A, QClass::IN, makeLockFreeTestResponse(names.at(idx), "192.0.2.1", ttd), now, ttd, vState::Indeterminate, boost::none, false);
+  }
+  BOOST_CHECK_EQUAL(rpc.size(), maxEntries);
+
+  hits = 0;
+  for (size_t idx = 0; idx < maxEntries / 2; idx++) {
+    if (rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash)) {
+      hits++;
+    }
+  }
+  BOOST_CHECK_EQUAL(hits, maxEntries / 2);
+  for (size_t idx = maxEntries / 2; idx < maxEntries; idx++) {
+    BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash), false);
+  }
+
+  /* shrinking the cache resizes the table, the entries that were used recently are kept */
+  rpc.setMaxSize(maxEntries / 4);
+  BOOST_CHECK_LE(rpc.size(), maxEntries / 4);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, queries.at((maxEntries / 2) - 1), now, &fpacket, &age, &qhash), true);
+  BOOST_CHECK_EQUAL(rpc.getResponsePacket(0, queries.at(maxEntries), now, &fpacket, &age, &qhash), false);
+
+  rpc.setMaxSize(maxEntries * 2);
+  for (size_t idx = 0; idx < 2 * maxEntries; idx++) {
+    if (!rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash)) {
+      rpc.insertResponsePacket(0, qhash, string(queries.at(idx)), names.at(idx), QType::A, QClass::IN, makeLockFreeTestResponse(names.at(idx), "192.0.2.1", ttd), now, ttd, vState::Indeterminate, boost::none, false);
+    }
+  }
+  BOOST_CHECK_LE(rpc.size(), 2 * maxEntries);
+  const auto remaining = rpc.size();
+  BOOST_CHECK_EQUAL(rpc.doWipePacketCache(DNSName("powerdns.com"), 0xffff, true), remaining);
+  BOOST_CHECK_EQUAL(rpc.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCacheLockFreeConcurrency)
+{
+  /* readers looking up names while another thread keeps inserting, evicting, pruning and resizing,
+     every hit should be a complete response to the query */
+  const size_t maxEntries = 100;
+  const size_t namesCount = 3 * maxEntries;
+  const size_t numberOfReaders = 4;
+  const size_t lookupsPerReader = 20000;
+  const uint32_t ttd = 3600;
+  const time_t now = time(nullptr);
+  RecursorPacketCache rpc(maxEntries, 2, true);
+
+  std::vector<DNSName> names;
+  std::vector<std::string> queries;
+  std::vector<size_t> responseSizes;
+  for (size_t idx = 0; idx < namesCount; idx++) {
+    names.emplace_back("name" + std::to_string(idx) + ".powerdns.com");
+    queries.push_back(makeLockFreeTestQuery(names.back(), QType::A));
+    responseSizes.push_back(makeLockFreeTestResponse(names.back(), "192.0.2.1", ttd).size());
+  }
+
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    size_t counter = 0;
+    string fpacket;
+    uint32_t age = 0;
+    uint32_t qhash = 0;
+    while (!done) {
+      const auto idx = counter % namesCount;
+      rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash);
+      rpc.insertResponsePacket(0, qhash, string(queries.at(idx)), names.at(idx), QType::A, QClass::IN, makeLockFreeTestResponse(names.at(idx), "192.0.2." + std::to_string(counter % 250), ttd), now, ttd, vState::Indeterminate, boost::none, false);
+      ++counter;
+      if (counter % 500 == 0) {
+        rpc.doPruneTo(now, maxEntries / 2);
+      }
+      if (counter % 5000 == 0) {
+        rpc.setMaxSize((counter / 5000) % 2 == 0 ? maxEntries : maxEntries / 2);
+      }
+    }
+  });
+
+  std::atomic<size_t> hits{0};
+  std::atomic<size_t> invalid{0};
+  std::vector<std::thread> readers;
+  readers.reserve(numberOfReaders);
+  for (size_t readerIdx = 0; readerIdx < numberOfReaders; readerIdx++) {
+    readers.emplace_back([&, readerIdx]() {
+      string fpacket;
+      uint32_t age = 0;
+      uint32_t qhash = 0;
+      for (size_t counter = 0; counter < lookupsPerReader; counter++) {
+        const auto idx = (counter + (readerIdx * 7)) % namesCount;
+        if (!rpc.getResponsePacket(0, queries.at(idx), now, &fpacket, &age, &qhash)) {
+          continue;
+        }
+        ++hits;
+        if (fpacket.size() != responseSizes.at(idx)) {
+          ++invalid;
+          continue;
+        }
+        const dnsheader_aligned header(fpacket.data());
+        if (!header->qr || ntohs(header->ancount) != 1) {
+          ++invalid;
+        }
+      }
+    });
+  }
+
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  done = true;
+  writer.join();
+
+  BOOST_CHECK_GT(hits.load(), 0U);
+  BOOST_CHECK_EQUAL(invalid.load(), 0U);
+  BOOST_CHECK_LE(rpc.size(), maxEntries);
+}
+
+#ifdef BENCH_PACKETCACHE
+/* Not a real unit test, but a microbenchmark reporting the latency of packet cache hits
+   when every worker thread hammers the same hot names, while another thread keeps updating them. */
+static void benchmarkPacketCacheHits(RecursorPacketCache& rpc, size_t numberOfThreads, const char* name)
+{
+  const size_t hotNames = 1000;
+  const size_t lookupsPerThread = 200000;
+  const uint32_t ttd = 3600;
+  const time_t now = time(nullptr);
+
+  std::vector<DNSName> names;
+  std::vector<std::string> queries;
+  std::vector<std::string> responses;
+  std::vector<uint32_t> hashes;
+  for (size_t idx = 0; idx < hotNames; idx++) {
+    names.emplace_back("hot" + std::to_string(idx) + ".powerdns.com");
+    queries.push_back(makeLockFreeTestQuery(names.back(), QType::A));
+    responses.push_back(makeLockFreeTestResponse(names.back(), "192.0.2.1", ttd));
+    string fpacket;
+    uint32_t age = 0;
+    uint32_t qhash = 0;
+    rpc.getResponsePacket(0, queries.back(), now, &fpacket, &age, &qhash);
+    rpc.insertResponsePacket(0, qhash, string(queries.back()), names.back(), QType::A, QClass::IN, string(responses.back()), now, ttd, vState::Indeterminate, boost::none, false);
+    hashes.push_back(qhash);
+  }
+
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    size_t idx = 0;
+    while (!done) {
+      rpc.insertResponsePacket(0, hashes.at(idx), string(queries.at(idx)), names.at(idx), QType::A, QClass::IN, string(responses.at(idx)), now, ttd, vState::Indeterminate, boost::none, false);
+      idx = (idx + 1) % hotNames;
+      if (idx == 0) {
+        rpc.doPruneTo(now, hotNames * 2);
+      }
+    }
+  });
+
+  std::atomic<uint64_t> hits{0};
+  std::vector<std::vector<uint32_t>> latencies(numberOfThreads);
+  std::vector<std::thread> threads;
+  threads.reserve(numberOfThreads);
+  for (size_t threadIdx = 0; threadIdx < numberOfThreads; threadIdx++) {
+    threads.emplace_back([&rpc, &queries, &hits, &latencies, threadIdx, now]() {
+      auto& samples = latencies.at(threadIdx);
+      samples.reserve(lookupsPerThread);
+      uint64_t localHits = 0;
+      string fpacket;
+      uint32_t age = 0;
+      uint32_t qhash = 0;
+      for (size_t counter = 0; counter < lookupsPerThread; counter++) {
+        const auto& query = queries.at((counter + (threadIdx * 7919)) % hotNames);
+        auto start = std::chrono::steady_clock::now();
+        if (rpc.getResponsePacket(0, query, now, &fpacket, &age, &qhash)) {
+          localHits++;
+        }
+        samples.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+      }
+      hits += localHits;
+    });
+  }
+  for (auto& thr : threads) {
+    thr.join();
+  }
+  done = true;
+  writer.join();
+
+  std::vector<uint32_t> all;
+  all.reserve(numberOfThreads * lookupsPerThread);
+  for (const auto& samples : latencies) {
+    all.insert(all.end(), samples.begin(), samples.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double perc) {
+    return all.at(std::min(all.size() - 1, static_cast<size_t>(static_cast<double>(all.size()) * perc / 100.0)));
+  };
+
+  cerr << name << " packet cache, " << numberOfThreads << " worker threads: hit latency p50 " << percentile(50) << " ns, p99 " << percentile(99) << " ns, p99.9 " << percentile(99.9) << " ns, " << hits << "/" << all.size() << " hits" << endl;
+  BOOST_CHECK_EQUAL(hits, numberOfThreads * lookupsPerThread);
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCacheLockFreeReaders)
+{
+  const size_t maxEntries = 10000;
+  const size_t numberOfThreads = std::max(2U, std::min(8U, std::thread::hardware_concurrency()));
+
+  {
+    RecursorPacketCache rpc(maxEntries, 16);
+    benchmarkPacketCacheHits(rpc, numberOfThreads, "locked");
+  }
+  {
+    RecursorPacketCache rpc(maxEntries, 16, true);
+    benchmarkPacketCacheHits(rpc, numberOfThreads, "lock-free");
+  }
+}
+#endif /* BENCH_PACKETCACHE */
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -511,6 +511,8 @@ static void apiServerRPZStats(HttpRequest* /* req */, HttpResponse* resp)
       {"transfers_full", (double)stats->d_fullTransfers},
       {"records", (double)stats->d_numberOfRecords},
       {"last_update", (double)stats->d_lastUpdate},
+      {"last_update_duration", (double)stats->d_lastUpdateDuration},
+      {"memory_usage", (double)stats->d_memoryUsage},
       {"serial", (double)stats->d_serial},
     };
     ret[name] = zoneInfo;
@@ -1199,6 +1201,14 @@ const std::map<std::string, MetricDefinition> MetricDefinitionStorage::d_metrics
   {"cumul-authanswers-count4",
    MetricDefinition(PrometheusMetricType::histogram,
                     "histogram of answer times of authoritative servers")},
+  // For cumulative histogram, state the xxx_count name where xxx matches the name in rec_channel_rec
+  {"cumul-udprecvbatch-count",
+   MetricDefinition(PrometheusMetricType::histogram,
+                    "histogram of the number of queries read from a UDP socket in a single batch")},
+  // For cumulative histogram, state the xxx_count name where xxx matches the name in rec_channel_rec
+  {"cumul-udpsendbatch-count",
+   MetricDefinition(PrometheusMetricType::histogram,
+                    "histogram of the number of packet cache hits sent to UDP clients in a single batch")},
   {"almost-expired-pushed",
    MetricDefinition(PrometheusMetricType::counter,
                     "Number of almost-expired tasks pushed")},
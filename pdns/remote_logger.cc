@@ -13,86 +13,91 @@
 #endif
 #include "logging.hh"
 
-bool CircularWriteBuffer::hasRoomFor(const std::string& str) const
+bool FrameRing::hasRoomFor(const std::string& str) const
 {
-  if (d_buffer.size() + 2 + str.size() > d_buffer.capacity()) {
+  if (size() + 2 + str.size() > d_capacity) {
     return false;
   }
 
   return true;
 }
 
-bool CircularWriteBuffer::write(const std::string& str)
+void FrameRing::copyIn(size_t pos, const char* data, size_t size)
+{
+  auto offset = pos % d_capacity;
+  auto first = std::min(size, d_capacity - offset);
+  memcpy(&d_buffer[offset], data, first);
+  if (first < size) {
+    memcpy(&d_buffer[0], data + first, size - first);
+  }
+}
+
+bool FrameRing::write(const std::string& str)
 {
   if (str.size() > std::numeric_limits<uint16_t>::max() || !hasRoomFor(str)) {
     return false;
   }
 
+  auto head = d_head.load(std::memory_order_relaxed);
   uint16_t len = htons(str.size());
-  const char* ptr = reinterpret_cast<const char*>(&len);
-  d_buffer.insert(d_buffer.end(), ptr, ptr + 2);
-  d_buffer.insert(d_buffer.end(), str.begin(), str.end());
+  copyIn(head, reinterpret_cast<const char*>(&len), sizeof(len));
+  copyIn(head + sizeof(len), str.data(), str.size());
+  /* publish the whole frame at once */
+  d_head.store(head + sizeof(len) + str.size(), std::memory_order_release);
 
   return true;
 }
 
-bool CircularWriteBuffer::flush(int fd)
+size_t FrameRing::getQueued(std::array<iovec, 2>& iov) const
 {
-  if (d_buffer.empty()) {
-    // not optional, we report EOF otherwise
-    return false;
+  auto tail = d_tail.load(std::memory_order_relaxed);
+  auto queued = d_head.load(std::memory_order_acquire) - tail;
+  if (queued == 0) {
+    return 0;
   }
 
-  auto arr1 = d_buffer.array_one();
-  auto arr2 = d_buffer.array_two();
-
-  struct iovec iov[2];
-  int pos = 0;
-  for(const auto& arr : {arr1, arr2}) {
-    if(arr.second) {
-      iov[pos].iov_base = arr.first;
-      iov[pos].iov_len = arr.second;
-      ++pos;
-    }
+  auto offset = tail % d_capacity;
+  auto first = std::min(queued, d_capacity - offset);
+  iov[0].iov_base = &d_buffer[offset];
+  iov[0].iov_len = first;
+  if (first == queued) {
+    return 1;
   }
+  iov[1].iov_base = &d_buffer[0];
+  iov[1].iov_len = queued - first;
+  return 2;
+}
 
-  ssize_t res = 0;
-  do {
-    res = writev(fd, iov, pos);
-
-    if (res < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        return false;
-      }
-
-      /* we can't be sure we haven't sent a partial message,
-         and we don't want to send the remaining part after reconnecting */
-      d_buffer.clear();
-      throw std::runtime_error("Couldn't flush a thing: " + stringerror());
-    }
-    else if (!res) {
-      /* we can't be sure we haven't sent a partial message,
-         and we don't want to send the remaining part after reconnecting */
-      d_buffer.clear();
-      throw std::runtime_error("EOF");
-    }
+uint16_t FrameRing::readLength(size_t pos) const
+{
+  std::array<uint8_t, sizeof(uint16_t)> len{};
+  for (size_t idx = 0; idx < len.size(); idx++) {
+    len.at(idx) = static_cast<uint8_t>(d_buffer[(pos + idx) % d_capacity]);
   }
-  while (res < 0);
+  return static_cast<uint16_t>(len.at(0) * 256 + len.at(1));
+}
 
-  if (static_cast<size_t>(res) == d_buffer.size()) {
-    d_buffer.clear();
-  }
-  else {
-    while (res--) {
-      d_buffer.pop_front();
-    }
+void FrameRing::consume(size_t bytes)
+{
+  auto tail = d_tail.load(std::memory_order_relaxed) + bytes;
+  /* keep track of the frame boundaries while the lengths have not been overwritten yet */
+  while (d_nextFrame < tail) {
+    d_nextFrame += sizeof(uint16_t) + readLength(d_nextFrame);
   }
+  d_tail.store(tail, std::memory_order_release);
+}
 
-  return true;
+size_t FrameRing::discard()
+{
+  auto tail = d_tail.load(std::memory_order_relaxed);
+  auto head = d_head.load(std::memory_order_acquire);
+  size_t frames = d_nextFrame > tail ? 1 : 0;
+  while (d_nextFrame < head) {
+    d_nextFrame += sizeof(uint16_t) + readLength(d_nextFrame);
+    ++frames;
+  }
+  d_tail.store(head, std::memory_order_release);
+  return frames;
 }
 
 const std::string& RemoteLoggerInterface::toErrorString(Result r)
@@ -108,7 +113,9 @@ const std::string& RemoteLoggerInterface::toErrorString(Result r)
   return str[std::min(i, 4U)];
 }
 
-RemoteLogger::RemoteLogger(const ComboAddress& remote, uint16_t timeout, uint64_t maxQueuedBytes, uint8_t reconnectWaitTime, bool asyncConnect): d_remote(remote), d_timeout(timeout), d_reconnectWaitTime(reconnectWaitTime), d_asyncConnect(asyncConnect), d_runtime({CircularWriteBuffer(maxQueuedBytes), nullptr})
+static std::atomic<uint64_t> s_remoteLoggerIDs{0};
+
+RemoteLogger::RemoteLogger(const ComboAddress& remote, uint16_t timeout, uint64_t maxQueuedBytes, uint8_t reconnectWaitTime, bool asyncConnect): d_remote(remote), d_maxQueuedBytes(maxQueuedBytes), d_id(++s_remoteLoggerIDs), d_timeout(timeout), d_reconnectWaitTime(reconnectWaitTime), d_asyncConnect(asyncConnect)
 {
   if (!d_asyncConnect) {
     reconnect();
@@ -124,12 +131,9 @@ bool RemoteLogger::reconnect()
     newSock->setNonBlocking();
     newSock->connect(d_remote, d_timeout);
 
-    {
-      /* we are now successfully connected, time to take the lock and update the
-         socket */
-      auto runtime = d_runtime.lock();
-      runtime->d_socket = std::move(newSock);
-    }
+    /* we are now successfully connected, the socket is only used by the
+       maintenance thread */
+    d_socket = std::move(newSock);
   }
   catch (const std::exception& e) {
 #ifdef WE_ARE_RECURSOR
@@ -144,47 +148,174 @@ bool RemoteLogger::reconnect()
   return true;
 }
 
+FrameRing& RemoteLogger::getThreadRing()
+{
+  /* keyed by the ID of the logger rather than its address, which might be reused */
+  static thread_local std::vector<std::pair<uint64_t, std::shared_ptr<FrameRing>>> t_rings;
+  for (const auto& [loggerID, ring] : t_rings) {
+    if (loggerID == d_id) {
+      return *ring;
+    }
+  }
+
+  /* forget about the rings of the loggers that have been destroyed */
+  t_rings.erase(std::remove_if(t_rings.begin(), t_rings.end(), [](const auto& entry) { return entry.second.use_count() == 1; }), t_rings.end());
+
+  auto ring = std::make_shared<FrameRing>(d_maxQueuedBytes);
+  d_rings.lock()->push_back(ring);
+  t_rings.emplace_back(d_id, ring);
+  return *ring;
+}
+
+void RemoteLogger::wakeUp()
+{
+  if (d_wakeUpRequested.load() || d_wakeUpRequested.exchange(true)) {
+    return;
+  }
+  /* taking the lock makes sure that the maintenance thread is either waiting or
+     about to look at d_wakeUpRequested, so the notification cannot be lost */
+  std::lock_guard<std::mutex> lock(d_wakeUpMutex);
+  d_wakeUpCond.notify_one();
+}
+
 RemoteLoggerInterface::Result RemoteLogger::queueData(const std::string& data)
 {
-  auto runtime = d_runtime.lock();
+  auto& ring = getThreadRing();
 
   if (data.size() > std::numeric_limits<uint16_t>::max()) {
-    ++runtime->d_stats.d_tooLarge;
+    ++ring.d_stats.d_tooLarge;
     return Result::TooLarge;
   }
 
-  if (!runtime->d_writer.hasRoomFor(data)) {
-    /* not connected, queue is full, just drop */
-    if (!runtime->d_socket) {
-      ++runtime->d_stats.d_pipeFull;
-      return Result::PipeFull;
+  if (!ring.write(data)) {
+    /* queue is full (not connected, or the remote end is not keeping up), just drop */
+    ++ring.d_stats.d_pipeFull;
+    wakeUp();
+    return Result::PipeFull;
+  }
+
+  ++ring.d_stats.d_queued;
+  if (ring.size() >= ring.capacity() / 2) {
+    wakeUp();
+  }
+  return Result::Queued;
+}
+
+RemoteLoggerInterface::Stats RemoteLogger::getStats()
+{
+  RemoteLoggerInterface::Stats stats;
+  auto rings = d_rings.lock();
+  for (const auto& ring : *rings) {
+    stats.d_queued += ring->d_stats.d_queued.load(std::memory_order_relaxed);
+    stats.d_pipeFull += ring->d_stats.d_pipeFull.load(std::memory_order_relaxed);
+    stats.d_tooLarge += ring->d_stats.d_tooLarge.load(std::memory_order_relaxed);
+  }
+  stats.d_otherError = d_otherErrors.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/* writes as many of the queued frames as the socket accepts, returns false if there was nothing to write
+   or if the outgoing TCP buffer is full */
+bool RemoteLogger::flush()
+{
+  std::vector<std::shared_ptr<FrameRing>> rings;
+  {
+    auto lock = d_rings.lock();
+    rings.reserve(lock->size());
+    /* the rest of a frame that has been partially written has to go first */
+    if (d_partiallyWritten) {
+      rings.push_back(d_partiallyWritten);
+    }
+    for (const auto& ring : *lock) {
+      if (ring != d_partiallyWritten) {
+        rings.push_back(ring);
+      }
+    }
+  }
+
+  std::vector<iovec> iovs;
+  std::vector<std::pair<FrameRing*, size_t>> queued;
+  iovs.reserve(rings.size() * 2);
+  queued.reserve(rings.size());
+  for (const auto& ring : rings) {
+    std::array<iovec, 2> iov{};
+    auto count = ring->getQueued(iov);
+    if (count == 0) {
+      continue;
+    }
+    if (iovs.size() + count > IOV_MAX) {
+      break;
     }
-    try {
-      /* we try to flush some data */
-      if (!runtime->d_writer.flush(runtime->d_socket->getHandle())) {
-        /* but failed, let's just drop */
-        ++runtime->d_stats.d_pipeFull;
-        return Result::PipeFull;
+    size_t bytes = 0;
+    for (size_t idx = 0; idx < count; idx++) {
+      iovs.push_back(iov.at(idx));
+      bytes += iov.at(idx).iov_len;
+    }
+    queued.emplace_back(ring.get(), bytes);
+  }
+
+  if (iovs.empty()) {
+    return false;
+  }
+
+  ssize_t res = 0;
+  do {
+    res = writev(d_socket->getHandle(), iovs.data(), static_cast<int>(iovs.size()));
+
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
       }
 
-      /* see if we freed enough data */
-      if (!runtime->d_writer.hasRoomFor(data)) {
-        /* we didn't */
-        ++runtime->d_stats.d_pipeFull;
-        return Result::PipeFull;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
       }
+
+      /* we can't be sure we haven't sent a partial message,
+         and we don't want to send the remaining part after reconnecting */
+      discardQueued();
+      throw std::runtime_error("Couldn't flush a thing: " + stringerror());
     }
-    catch(const std::exception& e) {
-      //      cout << "Got exception writing: "<<e.what()<<endl;
-      runtime->d_socket.reset();
-      ++runtime->d_stats.d_otherError;
-      return Result::OtherError;
+    else if (!res) {
+      /* we can't be sure we haven't sent a partial message,
+         and we don't want to send the remaining part after reconnecting */
+      discardQueued();
+      throw std::runtime_error("EOF");
     }
   }
+  while (res < 0);
 
-  runtime->d_writer.write(data);
-  ++runtime->d_stats.d_queued;
-  return Result::Queued;
+  auto written = static_cast<size_t>(res);
+  d_partiallyWritten.reset();
+  for (const auto& [ring, bytes] : queued) {
+    auto consumed = std::min(written, bytes);
+    ring->consume(consumed);
+    written -= consumed;
+    if (consumed < bytes) {
+      if (consumed > 0) {
+        for (const auto& entry : rings) {
+          if (entry.get() == ring) {
+            d_partiallyWritten = entry;
+            break;
+          }
+        }
+      }
+      break;
+    }
+  }
+
+  return true;
+}
+
+void RemoteLogger::discardQueued()
+{
+  uint64_t discarded = 0;
+  auto rings = d_rings.lock();
+  for (const auto& ring : *rings) {
+    discarded += ring->discard();
+  }
+  d_otherErrors += discarded;
+  d_partiallyWritten.reset();
 }
 
 void RemoteLogger::maintenanceThread() 
@@ -197,44 +328,57 @@ void RemoteLogger::maintenanceThread()
 #endif
     setThreadName(threadName);
 
+    /* reconnection attempts are spaced by at least reconnectWaitTime, regardless
+       of the wake-up requests sent by the producers when their ring is full */
+    const auto reconnectWaitTime = std::chrono::seconds(d_reconnectWaitTime);
+    std::chrono::steady_clock::time_point lastReconnect{};
+    if (!d_asyncConnect) {
+      /* the constructor just tried to connect */
+      lastReconnect = std::chrono::steady_clock::now();
+    }
+
     for (;;) {
       if (d_exiting) {
         break;
       }
 
-      bool connected = true;
-      if (d_runtime.lock()->d_socket == nullptr) {
-        // if it was unset, it will remain so, we are the only ones setting it!
+      bool connected = d_socket != nullptr;
+      if (!connected && std::chrono::steady_clock::now() - lastReconnect >= reconnectWaitTime) {
+        lastReconnect = std::chrono::steady_clock::now();
         connected = reconnect();
       }
 
-      /* we will just go to sleep if the reconnection just failed */
+      /* we will just go to sleep if we are not connected */
       if (connected) {
         try {
-          /* we don't want to take the lock while trying to reconnect */
-          auto runtime = d_runtime.lock();
-          if (runtime->d_socket) { // check if it is set
-            /* if flush() returns false, it means that we couldn't flush anything yet
-               either because there is nothing to flush, or because the outgoing TCP
-               buffer is full. That's fine by us */
-            runtime->d_writer.flush(runtime->d_socket->getHandle());
-          }
-          else {
-            connected = false;
+          /* if flush() returns false, it means that we couldn't flush anything yet
+             either because there is nothing to flush, or because the outgoing TCP
+             buffer is full. That's fine by us */
+          while (!d_exiting && flush()) {
           }
         }
         catch (const std::exception& e) {
-          d_runtime.lock()->d_socket.reset();
+          d_socket.reset();
           connected = false;
         }
 
-        if (!connected) {
+        if (!connected && std::chrono::steady_clock::now() - lastReconnect >= reconnectWaitTime) {
           /* let's try to reconnect right away, we are about to sleep anyway */
-          reconnect();
+          lastReconnect = std::chrono::steady_clock::now();
+          connected = reconnect();
         }
       }
 
-      sleep(d_reconnectWaitTime);
+      std::unique_lock<std::mutex> lock(d_wakeUpMutex);
+      if (connected) {
+        d_wakeUpCond.wait_for(lock, reconnectWaitTime, [this]() { return d_wakeUpRequested.load() || d_exiting.load(); });
+        d_wakeUpRequested = false;
+      }
+      else {
+        /* there is nothing we can do with the queued frames until the next reconnection attempt,
+           and leaving d_wakeUpRequested set spares the producers from taking the lock to wake us up */
+        d_wakeUpCond.wait_until(lock, lastReconnect + reconnectWaitTime, [this]() { return d_exiting.load(); });
+      }
     }
   }
   catch (const std::exception& e)
@@ -250,7 +394,7 @@ void RemoteLogger::maintenanceThread()
 
 RemoteLogger::~RemoteLogger()
 {
-  d_exiting = true;
+  stop();
 
   d_thread.join();
 }
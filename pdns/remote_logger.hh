@@ -24,37 +24,74 @@
 #include "config.h"
 #endif
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
+#include <sys/uio.h>
 
 #include "iputils.hh"
-#include "circular_buffer.hh"
 #include "lock.hh"
 #include "sstuff.hh"
 
-/* Writes can be submitted and they are atomically accepted. Either the whole write
-   ends up in the buffer or nothing ends up in the buffer.
-   In case nothing ends up in the buffer, an exception is thrown.
-   Similarly, EOF leads to this treatment
-
-   The filedescriptor can be in non-blocking mode.
-
-   This class is not threadsafe.
+/* Single-producer, single-consumer ring of length-prefixed frames, allocated
+   once by each thread submitting messages to a RemoteLogger. A message is
+   either entirely accepted or not at all, and the queued frames are already
+   in wire format so the consumer can pass them to writev() as they are.
+   The producer never takes a lock nor shares a cache line with the other
+   producers.
 */
-
-class CircularWriteBuffer
+class FrameRing
 {
 public:
-  explicit CircularWriteBuffer(size_t size) : d_buffer(size)
+  explicit FrameRing(size_t capacity) :
+    d_buffer(std::make_unique<char[]>(capacity)), d_capacity(capacity)
   {
   }
 
+  /* producer */
   bool hasRoomFor(const std::string& str) const;
   bool write(const std::string& str);
-  bool flush(int fd);
+
+  /* consumer: points the iovecs to the frames queued so far, returns the number of iovecs used (0 to 2) */
+  size_t getQueued(std::array<iovec, 2>& iov) const;
+  void consume(size_t bytes);
+  /* consumer: drops everything queued so far, returns the number of frames that will not be sent,
+     including one that might have been partially consumed */
+  size_t discard();
+
+  size_t size() const
+  {
+    return d_head.load(std::memory_order_acquire) - d_tail.load(std::memory_order_acquire);
+  }
+  size_t capacity() const
+  {
+    return d_capacity;
+  }
+
+  /* only updated by the producer */
+  struct Stats
+  {
+    std::atomic<uint64_t> d_queued{0};
+    std::atomic<uint64_t> d_pipeFull{0};
+    std::atomic<uint64_t> d_tooLarge{0};
+  };
+  Stats d_stats;
+
 private:
-  boost::circular_buffer<char> d_buffer;
+  void copyIn(size_t pos, const char* data, size_t size);
+  uint16_t readLength(size_t pos) const;
+
+  std::unique_ptr<char[]> d_buffer;
+  const size_t d_capacity;
+  /* absolute positions, the offsets in the buffer are these modulo the capacity */
+  alignas(64) std::atomic<size_t> d_head{0};
+  alignas(64) std::atomic<size_t> d_tail{0};
+  /* only accessed by the consumer: position of the first frame starting at or after the tail */
+  size_t d_nextFrame{0};
 };
 
 class RemoteLoggerInterface
@@ -105,9 +142,15 @@ private:
 };
 
 /* Thread safe. Will connect asynchronously on request.
-   Runs a reconnection thread that also periodicall flushes.
-   Note that the buffer only runs as long as there is a connection.
-   If there is no connection we don't buffer a thing
+   Each thread submitting data gets its own FrameRing of maxQueuedBytes, the
+   maintenance thread takes care of (re)connecting and of writing the queued
+   frames from all rings to the socket, every reconnectWaitTime seconds or as
+   soon as one of the rings is half full, but never tries to reconnect more
+   often than every reconnectWaitTime seconds.
+   While there is no connection the frames stay in the rings until they are
+   full, and new ones are dropped after that. The frames that are still queued
+   when the connection is lost are discarded, since the remaining part of a
+   partially written frame cannot be sent over a new connection.
 */
 class RemoteLogger : public RemoteLoggerInterface
 {
@@ -130,38 +173,48 @@ public:
   }
   [[nodiscard]] std::string toString() override
   {
-    auto runtime = d_runtime.lock();
-    return d_remote.toStringWithPort() + " (" + std::to_string(runtime->d_stats.d_queued) + " processed, " + std::to_string(runtime->d_stats.d_pipeFull + runtime->d_stats.d_tooLarge + runtime->d_stats.d_otherError) + " dropped)";
+    auto stats = getStats();
+    return d_remote.toStringWithPort() + " (" + std::to_string(stats.d_queued) + " processed, " + std::to_string(stats.d_pipeFull + stats.d_tooLarge + stats.d_otherError) + " dropped)";
   }
 
-  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override
-  {
-    return d_runtime.lock()->d_stats;
-  }
+  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override;
 
   void stop()
   {
     d_exiting = true;
+    /* not using wakeUp() because a wake-up might already have been requested,
+       and is ignored, while we are not connected */
+    std::lock_guard<std::mutex> lock(d_wakeUpMutex);
+    d_wakeUpCond.notify_one();
   }
 
 private:
   bool reconnect();
   void maintenanceThread();
-
-  struct RuntimeData
-  {
-    CircularWriteBuffer d_writer;
-    std::unique_ptr<Socket> d_socket{nullptr};
-    RemoteLoggerInterface::Stats d_stats{};
-  };
+  FrameRing& getThreadRing();
+  void wakeUp();
+  bool flush();
+  void discardQueued();
 
   ComboAddress d_remote;
+  const size_t d_maxQueuedBytes;
+  const uint64_t d_id;
   uint16_t d_timeout;
   uint8_t d_reconnectWaitTime;
   std::atomic<bool> d_exiting{false};
   bool d_asyncConnect{false};
-
-  LockGuarded<RuntimeData> d_runtime;
+  /* number of times queued frames had to be discarded because writing to the socket failed */
+  std::atomic<uint64_t> d_otherErrors{0};
+
+  /* only accessed by the maintenance thread once it has been started */
+  std::unique_ptr<Socket> d_socket{nullptr};
+  /* ring whose first frame has been partially written to the socket,
+     if any, which therefore has to be written first */
+  std::shared_ptr<FrameRing> d_partiallyWritten{nullptr};
+
+  LockGuarded<std::vector<std::shared_ptr<FrameRing>>> d_rings;
+  std::mutex d_wakeUpMutex;
+  std::condition_variable d_wakeUpCond;
+  std::atomic<bool> d_wakeUpRequested{false};
   std::thread d_thread;
 };
-
@@ -14,6 +14,8 @@
 #include "lock.hh"
 #include "dns_random.hh"
 #include "arguments.hh"
+#include "dnsqueryscan.hh"
+#include "ednsoptions.hh"
 
 #if defined(HAVE_LIBSODIUM)
 #include <sodium.h>
@@ -1155,6 +1157,82 @@ private:
   const string d_name;
 };
 
+struct BurtleHashLowercaseTest
+{
+  explicit BurtleHashLowercaseTest(const string& str) : d_name(str) {}
+
+  string getName() const
+  {
+    return "BurtleHashLowercase";
+  }
+
+  void operator()() const
+  {
+    burtleLowercase(reinterpret_cast<const unsigned char*>(d_name.data()), d_name.length(), 0);
+  }
+
+private:
+  const string d_name;
+};
+
+static vector<uint8_t> makeQueryWithECSAndCookie(const DNSName& qname)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, qname, QType::AAAA);
+  pw.getHeader()->rd = 1;
+  DNSPacketWriter::optvect_t opts;
+  /* 192.0.2.0/24 */
+  opts.emplace_back(EDNSOptionCode::ECS, string("\x00\x01\x18\x00\xc0\x00\x02", 7));
+  opts.emplace_back(EDNSOptionCode::COOKIE, string("\x01\x02\x03\x04\x05\x06\x07\x08", 8));
+  pw.addOpt(1232, 0, EDNSOpts::DNSSECOK, opts);
+  pw.commit();
+  return packet;
+}
+
+/* what dnsdist used to do: parse the question, then look for the OPT RR and the ECS option separately */
+struct DNSQuerySeparatePassesTest
+{
+  explicit DNSQuerySeparatePassesTest(const vector<uint8_t>& packet) : d_packet(packet) {}
+
+  string getName() const
+  {
+    return "DNS query separate passes";
+  }
+
+  void operator()() const
+  {
+    uint16_t qtype{0};
+    uint16_t qclass{0};
+    DNSName qname(reinterpret_cast<const char*>(d_packet.data()), d_packet.size(), sizeof(dnsheader), false, &qtype, &qclass);
+    MOADNSParser mdp(true, reinterpret_cast<const char*>(d_packet.data()), d_packet.size());
+    g_ret = mdp.d_answers.empty();
+    g_ret = burtleCI(reinterpret_cast<const unsigned char*>(qname.getStorage().data()), qname.getStorage().size(), 0) == 0;
+  }
+
+private:
+  const vector<uint8_t>& d_packet;
+};
+
+struct DNSQueryScanTest
+{
+  explicit DNSQueryScanTest(const vector<uint8_t>& packet) : d_packet(packet) {}
+
+  string getName() const
+  {
+    return "DNS query single-pass scan";
+  }
+
+  void operator()() const
+  {
+    DNSQueryScan scan;
+    g_ret = scanDNSQuery(d_packet.data(), d_packet.size(), scan);
+    g_ret = burtleLowercase(&d_packet.at(sizeof(dnsheader)), scan.qnameWireLength, 0) == 0;
+  }
+
+private:
+  const vector<uint8_t>& d_packet;
+};
+
 
 #if defined(HAVE_LIBSODIUM)
 struct SipHashTest
@@ -1332,6 +1410,15 @@ int main()
 
     doRun(BurtleHashTest("a string of chars"));
     doRun(BurtleHashCITest("A String Of Chars"));
+    doRun(BurtleHashLowercaseTest("A String Of Chars"));
+    doRun(BurtleHashCITest("\x03WWW\x0fPowerDNS-Example\x03Com"));
+    doRun(BurtleHashLowercaseTest("\x03WWW\x0fPowerDNS-Example\x03Com"));
+
+    {
+      auto query = makeQueryWithECSAndCookie(DNSName("www.PowerDNS-Example.com"));
+      doRun(DNSQuerySeparatePassesTest(query));
+      doRun(DNSQueryScanTest(query));
+    }
 #ifdef HAVE_LIBSODIUM
     doRun(SipHashTest("a string of chars"));
 #endif
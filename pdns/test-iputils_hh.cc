@@ -8,6 +8,7 @@
 #include "config.h"
 #endif
 #include <boost/test/unit_test.hpp>
+#include <array>
 #include <bitset>
 #include "iputils.hh"
 
@@ -895,4 +896,53 @@ BOOST_AUTO_TEST_CASE(test_parseIPAndPort)
   }
 }
 
+#if defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG) && defined(MSG_WAITFORONE)
+BOOST_AUTO_TEST_CASE(test_sendMultipleMessages)
+{
+  ComboAddress destination("127.0.0.1", 0);
+  int receiver = SSocket(AF_INET, SOCK_DGRAM, 0);
+  SBind(receiver, destination);
+  socklen_t socklen = destination.getSocklen();
+  BOOST_REQUIRE_EQUAL(getsockname(receiver, reinterpret_cast<struct sockaddr*>(&destination), &socklen), 0);
+  int sender = SSocket(AF_INET, SOCK_DGRAM, 0);
+
+  /* the second one is too large for a UDP datagram */
+  std::vector<std::string> payloads{"first", std::string(70000, 'a'), "third", "fourth"};
+  std::vector<struct iovec> iovs(payloads.size());
+  std::vector<struct mmsghdr> msgs(payloads.size());
+  for (size_t idx = 0; idx < payloads.size(); idx++) {
+    fillMSGHdr(&msgs.at(idx).msg_hdr, &iovs.at(idx), nullptr, 0, payloads.at(idx).data(), payloads.at(idx).size(), &destination);
+  }
+
+  std::vector<std::pair<unsigned int, int>> errors;
+  auto onError = [&errors](unsigned int idx, int error) {
+    errors.emplace_back(idx, error);
+  };
+
+  sendMultipleMessages(sender, msgs.data(), 0, onError);
+  BOOST_CHECK(errors.empty());
+
+  sendMultipleMessages(sender, msgs.data(), msgs.size(), onError);
+  BOOST_REQUIRE_EQUAL(errors.size(), 1U);
+  BOOST_CHECK_EQUAL(errors.at(0).first, 1U);
+  BOOST_CHECK_EQUAL(errors.at(0).second, EMSGSIZE);
+
+  /* the other ones are received in a single batch */
+  std::vector<std::array<char, 512>> buffers(payloads.size());
+  std::vector<ComboAddress> remotes(payloads.size(), ComboAddress("127.0.0.1"));
+  for (size_t idx = 0; idx < payloads.size(); idx++) {
+    fillMSGHdr(&msgs.at(idx).msg_hdr, &iovs.at(idx), nullptr, 0, buffers.at(idx).data(), buffers.at(idx).size(), &remotes.at(idx));
+    msgs.at(idx).msg_len = 0;
+  }
+  int got = recvmmsg(receiver, msgs.data(), msgs.size(), MSG_WAITFORONE, nullptr);
+  BOOST_REQUIRE_EQUAL(got, 3);
+  BOOST_CHECK_EQUAL(std::string(buffers.at(0).data(), msgs.at(0).msg_len), payloads.at(0));
+  BOOST_CHECK_EQUAL(std::string(buffers.at(1).data(), msgs.at(1).msg_len), payloads.at(2));
+  BOOST_CHECK_EQUAL(std::string(buffers.at(2).data(), msgs.at(2).msg_len), payloads.at(3));
+
+  close(sender);
+  close(receiver);
+}
+#endif /* HAVE_SENDMMSG && HAVE_RECVMMSG && MSG_WAITFORONE */
+
 BOOST_AUTO_TEST_SUITE_END()
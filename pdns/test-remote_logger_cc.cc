@@ -0,0 +1,274 @@
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+#include <csignal>
+#include <numeric>
+#include <thread>
+
+#include "misc.hh"
+#include "remote_logger.hh"
+
+static std::string getQueuedData(const FrameRing& ring)
+{
+  std::array<iovec, 2> iov{};
+  std::string result;
+  auto count = ring.getQueued(iov);
+  for (size_t idx = 0; idx < count; idx++) {
+    result.append(static_cast<const char*>(iov.at(idx).iov_base), iov.at(idx).iov_len);
+  }
+  return result;
+}
+
+static std::string getFrame(const std::string& payload)
+{
+  std::string frame;
+  frame.push_back(static_cast<char>(payload.size() / 256));
+  frame.push_back(static_cast<char>(payload.size() % 256));
+  frame.append(payload);
+  return frame;
+}
+
+static std::unique_ptr<Socket> getListeningSocket(ComboAddress& addr)
+{
+  auto sock = std::make_unique<Socket>(addr.sin4.sin_family, SOCK_STREAM, 0);
+  sock->bind(addr);
+  sock->listen(128);
+  socklen_t addrLen = addr.getSocklen();
+  BOOST_REQUIRE_EQUAL(getsockname(sock->getHandle(), reinterpret_cast<struct sockaddr*>(&addr), &addrLen), 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  return sock;
+}
+
+BOOST_AUTO_TEST_SUITE(test_remote_logger_cc)
+
+BOOST_AUTO_TEST_CASE(test_FrameRing)
+{
+  FrameRing ring(16);
+  std::array<iovec, 2> iov{};
+
+  BOOST_CHECK_EQUAL(ring.capacity(), 16U);
+  BOOST_CHECK_EQUAL(ring.size(), 0U);
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 0U);
+
+  BOOST_CHECK(ring.write("abcd"));
+  BOOST_CHECK(ring.write("efgh"));
+  BOOST_CHECK_EQUAL(ring.size(), 12U);
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 1U);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("abcd") + getFrame("efgh"));
+
+  /* a frame is either entirely queued, or not at all */
+  BOOST_CHECK(!ring.hasRoomFor("ijk"));
+  BOOST_CHECK(!ring.write("ijk"));
+  BOOST_CHECK(ring.hasRoomFor("ij"));
+  BOOST_CHECK(ring.write("ij"));
+  BOOST_CHECK_EQUAL(ring.size(), 16U);
+  BOOST_CHECK(!ring.write(""));
+
+  /* the consumer might only be able to send part of a frame */
+  ring.consume(3);
+  BOOST_CHECK_EQUAL(ring.size(), 13U);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("abcd").substr(3) + getFrame("efgh") + getFrame("ij"));
+  ring.consume(3);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("efgh") + getFrame("ij"));
+
+  /* wrap around, the frame being split between the end and the beginning of the buffer */
+  BOOST_CHECK(ring.write("klmn"));
+  BOOST_CHECK_EQUAL(ring.size(), 16U);
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 2U);
+  BOOST_CHECK_EQUAL(iov.at(0).iov_len, 10U);
+  BOOST_CHECK_EQUAL(iov.at(1).iov_len, 6U);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("efgh") + getFrame("ij") + getFrame("klmn"));
+
+  /* and the length itself being split */
+  ring.consume(10);
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 1U);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("klmn"));
+  ring.consume(6);
+  BOOST_CHECK(ring.write("opqrstu"));
+  ring.consume(9);
+  BOOST_CHECK_EQUAL(ring.size(), 0U);
+  BOOST_CHECK(ring.write("vwx"));
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 2U);
+  BOOST_CHECK_EQUAL(iov.at(0).iov_len, 1U);
+  BOOST_CHECK_EQUAL(iov.at(1).iov_len, 4U);
+  BOOST_CHECK_EQUAL(getQueuedData(ring), getFrame("vwx"));
+  ring.consume(5);
+  BOOST_CHECK_EQUAL(ring.size(), 0U);
+  BOOST_CHECK_EQUAL(ring.getQueued(iov), 0U);
+
+  /* discarding the queued frames counts the one that has been partially consumed */
+  BOOST_CHECK(ring.write("ab"));
+  BOOST_CHECK(ring.write("cd"));
+  BOOST_CHECK(ring.write("ef"));
+  ring.consume(5);
+  BOOST_CHECK_EQUAL(ring.discard(), 2U);
+  BOOST_CHECK_EQUAL(ring.size(), 0U);
+  BOOST_CHECK_EQUAL(ring.discard(), 0U);
+  BOOST_CHECK(ring.write("gh"));
+  BOOST_CHECK_EQUAL(ring.discard(), 1U);
+
+  /* a frame larger than the capacity, or than what the length can represent */
+  BOOST_CHECK(!ring.write(std::string(15, 'a')));
+  BOOST_CHECK(ring.write(std::string(14, 'a')));
+  FrameRing large(100000);
+  BOOST_CHECK(!large.write(std::string(65536, 'a')));
+  BOOST_CHECK(large.write(std::string(65535, 'a')));
+}
+
+BOOST_AUTO_TEST_CASE(test_RemoteLoggerPartialWrites)
+{
+  /* the socket buffers fill up while we are not reading, so frames end up being partially written */
+  ComboAddress addr("127.0.0.1", 0);
+  auto listener = getListeningSocket(addr);
+  constexpr size_t producersCount = 4;
+  constexpr size_t framesPerProducer = 20000;
+  std::array<size_t, producersCount> queued{};
+  {
+    RemoteLogger logger(addr, 2, 1000000, 1, false);
+    auto conn = listener->accept();
+    BOOST_REQUIRE(conn != nullptr);
+
+    std::vector<std::thread> producers;
+    for (size_t producer = 0; producer < producersCount; producer++) {
+      producers.emplace_back([&logger, &queued, producer]() {
+        for (size_t idx = 0; idx < framesPerProducer; idx++) {
+          /* the size of the frame is derived from its content so that we can check it */
+          auto payload = std::to_string(producer) + ":" + std::to_string(idx) + ":";
+          payload.append(idx % 500, 'x');
+          if (logger.queueData(payload) == RemoteLoggerInterface::Result::Queued) {
+            ++queued.at(producer);
+          }
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+
+    const auto total = std::accumulate(queued.begin(), queued.end(), static_cast<size_t>(0));
+    BOOST_CHECK_GT(total, 0U);
+    std::array<ssize_t, producersCount> lastSeen{};
+    lastSeen.fill(-1);
+    std::array<size_t, producersCount> received{};
+    std::string buffer;
+    size_t frames = 0;
+    conn->setNonBlocking();
+    const auto deadline = time(nullptr) + 10;
+    while (frames < total && time(nullptr) < deadline) {
+      std::string data;
+      if (waitForData(conn->getHandle(), 0, 100000) <= 0) {
+        continue;
+      }
+      conn->read(data);
+      buffer.append(data);
+      size_t pos = 0;
+      while (buffer.size() - pos >= 2) {
+        const size_t len = static_cast<uint8_t>(buffer.at(pos)) * 256 + static_cast<uint8_t>(buffer.at(pos + 1));
+        if (buffer.size() - pos - 2 < len) {
+          break;
+        }
+        const auto payload = buffer.substr(pos + 2, len);
+        pos += 2 + len;
+        ++frames;
+
+        const auto first = payload.find(':');
+        const auto second = payload.find(':', first + 1);
+        BOOST_REQUIRE(first != std::string::npos && second != std::string::npos);
+        const auto producer = std::stoul(payload.substr(0, first));
+        const auto idx = std::stoul(payload.substr(first + 1, second - first - 1));
+        BOOST_REQUIRE_LT(producer, producersCount);
+        BOOST_CHECK_EQUAL(payload.size() - second - 1, idx % 500);
+        /* frames from a given producer are received in order, some of them might have been dropped */
+        BOOST_CHECK_GT(static_cast<ssize_t>(idx), lastSeen.at(producer));
+        lastSeen.at(producer) = static_cast<ssize_t>(idx);
+        ++received.at(producer);
+      }
+      buffer.erase(0, pos);
+    }
+
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(frames, total);
+    for (size_t producer = 0; producer < producersCount; producer++) {
+      BOOST_CHECK_EQUAL(received.at(producer), queued.at(producer));
+    }
+    auto stats = logger.getStats();
+    BOOST_CHECK_EQUAL(stats.d_queued, total);
+    BOOST_CHECK_EQUAL(stats.d_queued + stats.d_pipeFull, producersCount * framesPerProducer);
+    BOOST_CHECK_EQUAL(stats.d_otherError, 0U);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_RemoteLoggerUnreachable)
+{
+  ComboAddress addr("127.0.0.1", 0);
+  {
+    /* get a port nothing is listening on */
+    auto unused = getListeningSocket(addr);
+  }
+
+  auto start = time(nullptr);
+  {
+    RemoteLogger logger(addr, 1, 1000, 1, true);
+    size_t dropped = 0;
+    for (size_t idx = 0; idx < 1000; idx++) {
+      if (logger.queueData(std::string(100, 'a')) == RemoteLoggerInterface::Result::PipeFull) {
+        ++dropped;
+      }
+    }
+    /* the frames are kept until the ring is full */
+    BOOST_CHECK_EQUAL(dropped, 1000U - 9U);
+    auto stats = logger.getStats();
+    BOOST_CHECK_EQUAL(stats.d_queued, 9U);
+    BOOST_CHECK_EQUAL(stats.d_pipeFull, 1000U - 9U);
+  }
+  /* stopping the logger does not wait for the next reconnection attempt */
+  BOOST_CHECK_LE(time(nullptr) - start, 1);
+
+  /* now a collector that closes every connection right away: every drop wakes the maintenance thread up,
+     but it should not try to reconnect more than once per second */
+  auto listener = getListeningSocket(addr);
+  std::atomic<bool> done{false};
+  std::atomic<size_t> connections{0};
+  std::thread collector([&listener, &done, &connections]() {
+    listener->setNonBlocking();
+    while (!done) {
+      if (waitForData(listener->getHandle(), 0, 10000) > 0) {
+        try {
+          auto conn = listener->accept();
+          if (conn) {
+            ++connections;
+          }
+        }
+        catch (const std::exception& e) {
+        }
+      }
+    }
+  });
+
+  /* writing to a closed connection would otherwise raise SIGPIPE */
+  auto previousHandler = signal(SIGPIPE, SIG_IGN);
+  {
+    RemoteLogger logger(addr, 1, 1000, 1, true);
+    const auto until = time(nullptr) + 3;
+    while (time(nullptr) < until) {
+      (void)logger.queueData(std::string(100, 'a'));
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    auto stats = logger.getStats();
+    BOOST_CHECK_GT(stats.d_otherError, 0U);
+  }
+  done = true;
+  collector.join();
+  signal(SIGPIPE, previousHandler);
+
+  BOOST_CHECK_GT(connections.load(), 0U);
+  BOOST_CHECK_LE(connections.load(), 5U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
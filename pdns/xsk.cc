@@ -810,6 +810,16 @@ bool XskPacket::setPayload(const PacketBuffer& buf)
   return true;
 }
 
+bool XskPacket::setPayloadSize(size_t size) noexcept
+{
+  if (size == 0 || size > getPayloadCapacity()) {
+    return false;
+  }
+  flags |= UPDATE;
+  frameLength = getDataOffset() + size;
+  return true;
+}
+
 void XskPacket::addDelay(const int relativeMilliseconds) noexcept
 {
   gettime(&sendTime);
@@ -877,6 +887,21 @@ const void* XskPacket::getPayloadData() const
   return frame + getDataOffset();
 }
 
+uint8_t* XskPacket::getMutablePayloadData() noexcept
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return frame + getDataOffset();
+}
+
+size_t XskPacket::getPayloadCapacity() const noexcept
+{
+  const auto offset = getDataOffset();
+  if (offset >= frameSize) {
+    return 0;
+  }
+  return frameSize - offset;
+}
+
 void XskPacket::setAddr(const ComboAddress& from_, MACAddr fromMAC, const ComboAddress& to_, MACAddr toMAC) noexcept
 {
   auto ethHeader = getEthernetHeader();
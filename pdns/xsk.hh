@@ -242,6 +242,10 @@ public:
   [[nodiscard]] const ComboAddress& getFromAddr() const noexcept;
   [[nodiscard]] const ComboAddress& getToAddr() const noexcept;
   [[nodiscard]] const void* getPayloadData() const;
+  // direct access to the payload in the frame, so that a response can be built in place
+  [[nodiscard]] uint8_t* getMutablePayloadData() noexcept;
+  // maximum size of the payload, given the size of the existing headers
+  [[nodiscard]] size_t getPayloadCapacity() const noexcept;
   [[nodiscard]] bool isIPV6() const noexcept;
   [[nodiscard]] size_t getCapacity() const noexcept;
   [[nodiscard]] uint32_t getDataLen() const noexcept;
@@ -250,6 +254,8 @@ public:
   [[nodiscard]] PacketBuffer cloneHeaderToPacketBuffer() const;
   void setAddr(const ComboAddress& from_, MACAddr fromMAC, const ComboAddress& to_, MACAddr toMAC) noexcept;
   bool setPayload(const PacketBuffer& buf);
+  // the payload has been rewritten in place via getMutablePayloadData(), update its size
+  bool setPayloadSize(size_t size) noexcept;
   void rewrite() noexcept;
   void setHeader(PacketBuffer& buf);
   XskPacket(uint8_t* frame, size_t dataSize, size_t frameSize);
@@ -2978,3 +2978,43 @@ class TestCachingOfVeryLargeAnswers(DNSDistTest):
         self.assertFalse(receivedResponse)
         receivedQuery.id = query.id
         self.assertEqual(query, receivedQuery)
+
+class TestCachingCollapsedQueriesLeaderTimeout(DNSDistTest):
+
+    # the backend does not answer queries it has no response for
+    _answerUnexpected = False
+    _config_template = """
+    setUDPTimeout(1)
+    pc = newPacketCache(100, {collapseQueries=true, collapsingTimeout=10000})
+    getPool(""):setCache(pc)
+    newServer{address="127.0.0.1:%d"}
+    """
+
+    def testLeaderNeverAnswered(self):
+        """
+        Cache: Queries waiting for a leader that never gets an answer are forwarded once it times out
+        """
+        name = 'leader-timeout.collapsing.cache.tests.powerdns.com.'
+        query = dns.message.make_query(name, 'A', 'IN')
+        response = dns.message.make_response(query)
+        rrset = dns.rrset.from_text(name,
+                                    3600,
+                                    dns.rdataclass.IN,
+                                    dns.rdatatype.A,
+                                    '192.0.2.1')
+        response.answer.append(rrset)
+
+        # the leader, that the backend will drop
+        self._sock.send(query.to_wire())
+        time.sleep(0.2)
+
+        # this one waits for the leader, then has to be forwarded on its own once the leader
+        # has timed out, well before the collapsing timeout
+        start = time.time()
+        (receivedQuery, receivedResponse) = self.sendUDPQuery(query, response, timeout=5.0)
+        self.assertLess(time.time() - start, 5.0)
+        self.assertTrue(receivedQuery)
+        self.assertTrue(receivedResponse)
+        receivedQuery.id = query.id
+        self.assertEqual(query, receivedQuery)
+        self.assertEqual(receivedResponse, response)
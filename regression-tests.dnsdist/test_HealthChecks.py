@@ -184,6 +184,31 @@ class TestHealthCheckCustomNameNoAnswer(HealthCheckTest):
         self.assertGreater(self.getBackendMetric(0, 'healthCheckFailures'), 0)
         self.assertGreater(self.getBackendMetric(0, 'healthCheckFailuresTimeout'), 0)
 
+class TestHealthCheckTimeoutLargerThanInterval(HealthCheckTest):
+    # this test suite uses a different responder port
+    # because it uses a different health check configuration
+    _testServerPort = pickAvailablePort()
+
+    _answerUnexpected = False
+    _config_template = """
+    setKey("%s")
+    controlSocket("127.0.0.1:%d")
+    webserver("127.0.0.1:%s")
+    setWebserverConfig({apiKey="%s"})
+    srv = newServer{address="127.0.0.1:%d", checkName='powerdns.com.', checkInterval=1, checkTimeout=3000}
+    """
+
+    def testNoOverlappingChecks(self):
+        """
+        HealthChecks: A new check is not sent while the previous one is pending
+        """
+        before = self.getBackendMetric(0, 'healthCheckFailuresTimeout')
+        time.sleep(6)
+        after = self.getBackendMetric(0, 'healthCheckFailuresTimeout')
+        # one check every second would time out 6 times, but each one takes 3s to time out
+        self.assertGreater(after, before)
+        self.assertLessEqual(after - before, 3)
+
 class TestHealthCheckCustomFunction(HealthCheckTest):
     # this test suite uses a different responder port
     # because it uses a different health check configuration